@@ -2,14 +2,116 @@
 #include <Windows.h>
 #include <msclr/marshal.h>
 #include <msclr/marshal_cppstd.h>
+#include <memory>
 #include "ManagedStreamWrapper.h"
+#include "../ScreenRecorderLibNative/WriteCoalescingBuffer.h"
+#include "../ScreenRecorderLibNative/Log.h"
 
 namespace ScreenRecorderLib {
+	/// <summary>
+	/// Forwards the writes coalesced by WriteCoalescingBuffer to the managed stream delegates.
+	/// Called from the buffer's background thread, so managed exceptions are caught and reported as failures.
+	/// </summary>
+	private class ManagedStreamWriteTarget : public IWriteCoalescingTarget
+	{
+	public:
+		ManagedStreamWriteTarget(SeekFnc* pSeekFnc, ReadFnc* pReadFnc, WriteFnc* pWriteFnc, SetLengthFnc* pSetLengthFnc, GetLengthFnc* pGetLengthFnc)
+			: m_pSeekFnc(pSeekFnc),
+			m_pReadFnc(pReadFnc),
+			m_pWriteFnc(pWriteFnc),
+			m_pSetLengthFnc(pSetLengthFnc),
+			m_pGetLengthFnc(pGetLengthFnc)
+		{
+		}
+
+		virtual bool Write(const uint8_t* pData, size_t cb) override
+		{
+			try {
+				//The managed Write takes an int count, so very large buffers are written in several calls.
+				while (cb > 0) {
+					int count = (int)min(cb, (size_t)INT_MAX);
+					m_pWriteFnc(System::IntPtr((void*)pData), 0, count);
+					pData += count;
+					cb -= count;
+				}
+				return true;
+			}
+			catch (System::Exception^ ex) {
+				LOG_ERROR(L"Failed to write to output stream: %ls", msclr::interop::marshal_as<std::wstring>(ex->Message).c_str());
+				return false;
+			}
+		}
+		virtual bool Read(uint8_t* pData, size_t cb, size_t* pcbRead) override
+		{
+			try {
+				*pcbRead = m_pReadFnc(System::IntPtr(pData), 0, (int)min(cb, (size_t)INT_MAX));
+				return true;
+			}
+			catch (System::Exception^ ex) {
+				LOG_ERROR(L"Failed to read from output stream: %ls", msclr::interop::marshal_as<std::wstring>(ex->Message).c_str());
+				return false;
+			}
+		}
+		virtual bool Seek(int64_t position) override
+		{
+			try {
+				m_pSeekFnc(position, System::IO::SeekOrigin::Begin);
+				return true;
+			}
+			catch (System::Exception^ ex) {
+				LOG_ERROR(L"Failed to seek output stream: %ls", msclr::interop::marshal_as<std::wstring>(ex->Message).c_str());
+				return false;
+			}
+		}
+		virtual bool SetLength(int64_t length) override
+		{
+			try {
+				m_pSetLengthFnc(length);
+				return true;
+			}
+			catch (System::Exception^ ex) {
+				LOG_ERROR(L"Failed to set length of output stream: %ls", msclr::interop::marshal_as<std::wstring>(ex->Message).c_str());
+				return false;
+			}
+		}
+		virtual bool GetLength(int64_t* pLength) override
+		{
+			try {
+				*pLength = m_pGetLengthFnc();
+				return true;
+			}
+			catch (System::Exception^ ex) {
+				LOG_ERROR(L"Failed to get length of output stream: %ls", msclr::interop::marshal_as<std::wstring>(ex->Message).c_str());
+				return false;
+			}
+		}
+		virtual bool GetPosition(int64_t* pPosition) override
+		{
+			try {
+				*pPosition = m_pSeekFnc(0, System::IO::SeekOrigin::Current);
+				return true;
+			}
+			catch (System::Exception^ ex) {
+				LOG_ERROR(L"Failed to get position of output stream: %ls", msclr::interop::marshal_as<std::wstring>(ex->Message).c_str());
+				return false;
+			}
+		}
+	private:
+		SeekFnc* m_pSeekFnc;
+		ReadFnc* m_pReadFnc;
+		WriteFnc* m_pWriteFnc;
+		SetLengthFnc* m_pSetLengthFnc;
+		GetLengthFnc* m_pGetLengthFnc;
+	};
+
 	private class ManagedIStream : public IStream
 	{
 	public:
-		ManagedIStream(System::IO::Stream^ stream)
-			: refCount(1)
+		/// <param name="stream">The managed stream to wrap.</param>
+		/// <param name="writeBufferSize">If larger than 0, writes to a seekable and writable stream are coalesced in buffers of this size and written on a background thread.</param>
+		ManagedIStream(System::IO::Stream^ stream, size_t writeBufferSize = 0)
+			: refCount(1),
+			m_CanRead(false)
 		{
 			this->baseStream = gcnew ManagedStreamWrapper(stream);
 
@@ -24,6 +126,25 @@ namespace ScreenRecorderLib {
 			m_pCanSeekFnc = baseStream->GetCanSeekFunctionPointer();
 			m_pSetLengthFnc = baseStream->GetSetLengthFunctionPointer();
 			m_pGetLengthFnc = baseStream->GetLengthFunctionPointer();
+
+			if (writeBufferSize > 0 && m_pCanSeekFnc() && m_pCanWriteFnc()) {
+				//Stream capabilities are cached while buffering, as querying them on every call defeats the purpose.
+				m_CanRead = m_pCanReadFnc();
+				m_WriteTarget = std::make_unique<ManagedStreamWriteTarget>(m_pSeekFnc, m_pReadFnc, m_pWriteFnc, m_pSetLengthFnc, m_pGetLengthFnc);
+				m_WriteBuffer = std::make_unique<WriteCoalescingBuffer>(m_WriteTarget.get(), writeBufferSize);
+				LOG_DEBUG(L"Buffering writes to managed stream with a buffer size of %zu bytes", writeBufferSize);
+			}
+		}
+
+		~ManagedIStream()
+		{
+			if (m_WriteBuffer) {
+				m_WriteBuffer->Flush();
+				WRITE_COALESCING_STATS stats = m_WriteBuffer->GetStats();
+				LOG_DEBUG(L"Managed stream write buffer: %llu writes and %llu seeks coalesced into %llu writes and %llu seeks (%llu calls saved, %llu patched writes, %llu bytes)",
+					stats.WriteCalls, stats.SeekCalls, stats.TargetWriteCalls, stats.TargetSeekCalls, stats.GetCallsSaved(), stats.PatchedWrites, stats.BytesWritten);
+				m_WriteBuffer.reset();
+			}
 		}
 
 	public:
@@ -44,6 +165,15 @@ namespace ScreenRecorderLib {
 		// IStream
 		virtual HRESULT STDMETHODCALLTYPE Read(void* pv, _In_  ULONG cb, _Out_opt_ ULONG* pcbRead)override
 		{
+			if (m_WriteBuffer) {
+				if (!m_CanRead)
+					return E_ACCESSDENIED;
+				size_t bytesRead = 0;
+				if (!m_WriteBuffer->Read((uint8_t*)pv, cb, &bytesRead))
+					return STG_E_READFAULT;
+				if (pcbRead != nullptr) *pcbRead = (ULONG)bytesRead;
+				return S_OK;
+			}
 			if (!m_pCanReadFnc())
 				return E_ACCESSDENIED;
 
@@ -53,6 +183,12 @@ namespace ScreenRecorderLib {
 		}
 		virtual HRESULT STDMETHODCALLTYPE Write(const void* pv, ULONG cb, ULONG* pcbWritten) override
 		{
+			if (m_WriteBuffer) {
+				if (!m_WriteBuffer->Write((const uint8_t*)pv, cb))
+					return STG_E_WRITEFAULT;
+				if (pcbWritten != nullptr) *pcbWritten = cb;
+				return S_OK;
+			}
 			if (!m_pCanWriteFnc())
 				return E_ACCESSDENIED;
 
@@ -62,6 +198,16 @@ namespace ScreenRecorderLib {
 		}
 		virtual HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER dlibMove, DWORD dwOrigin, _Out_opt_  ULARGE_INTEGER* plibNewPosition) override
 		{
+			if (m_WriteBuffer) {
+				if (dwOrigin > STREAM_SEEK_END)
+					return STG_E_INVALIDFUNCTION;
+				int64_t position = 0;
+				if (!m_WriteBuffer->Seek(dlibMove.QuadPart, static_cast<WriteCoalescingSeekOrigin>(dwOrigin), &position))
+					return STG_E_INVALIDFUNCTION;
+				if (plibNewPosition != nullptr)
+					plibNewPosition->QuadPart = position;
+				return S_OK;
+			}
 			if (!m_pCanSeekFnc())
 				return E_ACCESSDENIED;
 			System::IO::SeekOrigin seekOrigin;
@@ -81,6 +227,9 @@ namespace ScreenRecorderLib {
 		}
 		virtual HRESULT STDMETHODCALLTYPE SetSize(ULARGE_INTEGER libNewSize)
 		{
+			if (m_WriteBuffer) {
+				return m_WriteBuffer->SetLength(libNewSize.QuadPart) ? S_OK : STG_E_WRITEFAULT;
+			}
 			m_pSetLengthFnc(libNewSize.QuadPart);
 			return S_OK;
 		}
@@ -88,7 +237,13 @@ namespace ScreenRecorderLib {
 		{
 			return E_NOTIMPL;
 		}
-		virtual HRESULT STDMETHODCALLTYPE Commit(DWORD  grfCommitFlags) override { return E_NOTIMPL; }
+		virtual HRESULT STDMETHODCALLTYPE Commit(DWORD  grfCommitFlags) override
+		{
+			if (m_WriteBuffer) {
+				return m_WriteBuffer->Flush() ? S_OK : STG_E_WRITEFAULT;
+			}
+			return S_OK;
+		}
 		virtual HRESULT STDMETHODCALLTYPE Revert(void) override { return E_NOTIMPL; }
 		virtual HRESULT STDMETHODCALLTYPE LockRegion(ULARGE_INTEGER libOffset, ULARGE_INTEGER cb, DWORD dwLockType) override { return E_NOTIMPL; }
 		virtual HRESULT STDMETHODCALLTYPE UnlockRegion(ULARGE_INTEGER libOffset, ULARGE_INTEGER cb, DWORD dwLockType) override { return E_NOTIMPL; }
@@ -97,6 +252,11 @@ namespace ScreenRecorderLib {
 		{
 			memset(pstatstg, 0, sizeof(::STATSTG));
 			pstatstg->type = STGTY_STREAM;
+			if (m_WriteBuffer) {
+				pstatstg->cbSize.QuadPart = m_WriteBuffer->GetLength();
+				pstatstg->grfMode |= m_CanRead ? STGM_READWRITE : STGM_WRITE;
+				return S_OK;
+			}
 			pstatstg->cbSize.QuadPart = m_pGetLengthFnc();
 
 			if (m_pCanReadFnc() && m_pCanWriteFnc())
@@ -122,5 +282,9 @@ namespace ScreenRecorderLib {
 		CanSeekFnc* m_pCanSeekFnc;
 		SetLengthFnc* m_pSetLengthFnc;
 		GetLengthFnc* m_pGetLengthFnc;
+
+		bool m_CanRead;
+		std::unique_ptr<ManagedStreamWriteTarget> m_WriteTarget;
+		std::unique_ptr<WriteCoalescingBuffer> m_WriteBuffer;
 	};
 }
@@ -18,7 +18,7 @@ namespace ScreenRecorderLib {
 	};
 	public enum class MouseDetectionMode {
 		///<summary>
-		///Use polling for detecting mouse clicks. Does not affect mouse performance, but may not work for all mouse clicks generated programmatically.
+		///Use raw input for detecting mouse clicks. Does not affect mouse performance. Falls back to a low level hook if the application already receives raw mouse input, as only one window per process can.
 		///</summary>
 		Polling = MOUSE_OPTIONS::MOUSE_DETECTION_MODE_POLLING,
 		///<summary>
@@ -31,7 +31,19 @@ namespace ScreenRecorderLib {
 		PNG,
 		JPEG,
 		TIFF,
-		BMP
+		BMP,
+		///<summary>
+		///PNG encoded with the built-in encoder. Much faster than the Windows encoder for screen content, at a slightly larger file size.
+		///</summary>
+		FastPNG,
+		///<summary>
+		///The lossless QOI image format (https://qoiformat.org), encoded with the built-in encoder. The fastest format to encode, with larger files than PNG.
+		///</summary>
+		QOI,
+		///<summary>
+		///JPEG encoded with the built-in encoder.
+		///</summary>
+		FastJPEG
 	};
 
 	public enum class AudioChannels {
@@ -47,13 +59,31 @@ namespace ScreenRecorderLib {
 
 	};
 
+	public enum class SegmentManifestFormat {
+		///<summary>No manifest is written.</summary>
+		None = (int)SegmentManifestFormatInternal::None,
+		///<summary>An HLS-style .m3u8 playlist of the segments, next to the first segment.</summary>
+		M3U8 = (int)SegmentManifestFormatInternal::M3U8,
+		///<summary>A .json file listing the segments, next to the first segment.</summary>
+		Json = (int)SegmentManifestFormatInternal::Json
+	};
+
 	public enum class RecorderMode {
 		///<summary>Record to mp4 container in H.264/AVC or H.265/HEVC format. </summary>
 		Video = (int)RecorderModeInternal::Video,
 		///<summary>Record a slideshow of pictures. </summary>
 		Slideshow = (int)RecorderModeInternal::Slideshow,
 		///<summary>Create a single screenshot.</summary>
-		Screenshot = (int)RecorderModeInternal::Screenshot
+		Screenshot = (int)RecorderModeInternal::Screenshot,
+		///<summary>Record an animated GIF or APNG. Only the parts of each frame that changed are encoded, so it suits screen content with small changes. The format is set with OutputOptions.AnimationFormat.</summary>
+		Animation = (int)RecorderModeInternal::Animation
+	};
+
+	public enum class AnimationFormat {
+		///<summary>Animated GIF, with up to 255 colors per frame. Frames shorter than 20 ms are shown for 20 ms.</summary>
+		GIF = (int)AnimationFormatInternal::Gif,
+		///<summary>Lossless animated PNG. Larger than GIF, but without color quantization.</summary>
+		APNG = (int)AnimationFormatInternal::Apng
 	};
 
 	public ref class SourceOptions : public INotifyPropertyChanged {
@@ -93,12 +123,14 @@ namespace ScreenRecorderLib {
 		Nullable<bool> _isVideoCaptureEnabled;
 		Nullable<bool> _isVideoFramePreviewEnabled;
 		ScreenSize^ _videoFramePreviewSize;
+		Nullable<int> _videoFramePreviewFps;
 	public:
 		DynamicOutputOptions() {
 			SourceRect = ScreenRect::Empty;
 			IsVideoCaptureEnabled = true;
 			IsVideoFramePreviewEnabled = false;
 			VideoFramePreviewSize = ScreenSize::Empty;
+			VideoFramePreviewFps = 0;
 		}
 		virtual event PropertyChangedEventHandler^ PropertyChanged;
 		void OnPropertyChanged(String^ info)
@@ -159,6 +191,107 @@ namespace ScreenRecorderLib {
 				}
 			}
 		}
+		/// <summary>
+		/// The max number of frame bitmaps per second sent through the OnFrameRecorded event. Frames in between are reported without bitmap. 0 sends a bitmap for every frame.
+		/// Bitmaps are read back from the GPU and delivered on a separate thread, and are dropped if the event handler can't keep up.
+		/// </summary>
+		property Nullable<int> VideoFramePreviewFps {
+			Nullable<int> get() {
+				return _videoFramePreviewFps;
+			}
+			void set(Nullable<int> value) {
+				if (!Object::Equals(_videoFramePreviewFps, value)) {
+					_videoFramePreviewFps = value;
+					OnPropertyChanged("VideoFramePreviewFps");
+				}
+			}
+		}
+	};
+
+	/// <summary>
+	/// An additional video file encoded from the same frames and audio as the recording, e.g. a low resolution proxy next to a full resolution archive.
+	/// Capture and composition are shared with the recording, and each rendition is encoded on its own thread, so a slow rendition can't stall the recording.
+	/// </summary>
+	public ref class OutputRendition : public INotifyPropertyChanged {
+	private:
+		String^ _outputPath;
+		ScreenSize^ _frameSize;
+		int _framerateDivisor;
+		Nullable<int> _bitrate;
+		Nullable<bool> _isFragmentedMp4Enabled;
+	public:
+		OutputRendition() {
+			FrameSize = ScreenSize::Empty;
+			FramerateDivisor = 1;
+		}
+		OutputRendition(String^ outputPath) :OutputRendition() {
+			OutputPath = outputPath;
+		}
+		virtual event PropertyChangedEventHandler^ PropertyChanged;
+		void OnPropertyChanged(String^ info)
+		{
+			PropertyChanged(this, gcnew PropertyChangedEventArgs(info));
+		}
+		/// <summary>
+		/// The path of the video file of the rendition.
+		/// </summary>
+		property String^ OutputPath {
+			String^ get() {
+				return _outputPath;
+			}
+			void set(String^ value) {
+				_outputPath = value;
+				OnPropertyChanged("OutputPath");
+			}
+		}
+		/// <summary>
+		/// The frame size of the rendition in pixels. If the width or height is 0, it is calculated from the aspect ratio of the recording. Empty uses the frame size of the recording.
+		/// </summary>
+		property ScreenSize^ FrameSize {
+			ScreenSize^ get() {
+				return _frameSize;
+			}
+			void set(ScreenSize^ value) {
+				_frameSize = value;
+				OnPropertyChanged("FrameSize");
+			}
+		}
+		/// <summary>
+		/// Only every Nth frame of the recording is encoded to the rendition, e.g. 2 gives half the frame rate. Default is 1.
+		/// </summary>
+		property int FramerateDivisor {
+			int get() {
+				return _framerateDivisor;
+			}
+			void set(int value) {
+				_framerateDivisor = value;
+				OnPropertyChanged("FramerateDivisor");
+			}
+		}
+		/// <summary>
+		/// The bitrate of the rendition in bits per second. If the recording uses the quality bitrate mode, the rendition uses unconstrained VBR instead. Null uses the bitrate settings of the recording.
+		/// </summary>
+		property Nullable<int> Bitrate {
+			Nullable<int> get() {
+				return _bitrate;
+			}
+			void set(Nullable<int> value) {
+				_bitrate = value;
+				OnPropertyChanged("Bitrate");
+			}
+		}
+		/// <summary>
+		/// Write the rendition as fragmented MP4. Null uses the setting of the recording.
+		/// </summary>
+		property Nullable<bool> IsFragmentedMp4Enabled {
+			Nullable<bool> get() {
+				return _isFragmentedMp4Enabled;
+			}
+			void set(Nullable<bool> value) {
+				_isFragmentedMp4Enabled = value;
+				OnPropertyChanged("IsFragmentedMp4Enabled");
+			}
+		}
 	};
 
 	public ref class OutputOptions :public DynamicOutputOptions {
@@ -166,11 +299,37 @@ namespace ScreenRecorderLib {
 		StretchMode _stretch;
 		ScreenSize^ _outputFrameSize;
 		RecorderMode _recorderMode;
+		int _streamWriteBufferSize;
+		int _segmentDurationMillis;
+		long long _segmentMaxSizeBytes;
+		SegmentManifestFormat _segmentManifestFormat;
+		int _replayBufferDurationMillis;
+		long long _replayBufferMaxSizeBytes;
+		String^ _frameExportName;
+		int _frameExportSlotCount;
+		int _frameExportFps;
+		List<OutputRendition^>^ _renditions;
+		int _slideshowEncoderThreadCount;
+		bool _isSlideshowManifestEnabled;
+		ScreenRecorderLib::AnimationFormat _animationFormat;
 	public:
 		OutputOptions() :DynamicOutputOptions() {
 			Stretch = StretchMode::Uniform;
 			OutputFrameSize = ScreenSize::Empty;
 			RecorderMode = ScreenRecorderLib::RecorderMode::Video;
+			StreamWriteBufferSize = 0;
+			SegmentDurationMillis = 0;
+			SegmentMaxSizeBytes = 0;
+			SegmentManifestFormat = ScreenRecorderLib::SegmentManifestFormat::None;
+			ReplayBufferDurationMillis = 0;
+			ReplayBufferMaxSizeBytes = 0;
+			FrameExportName = nullptr;
+			FrameExportSlotCount = 4;
+			FrameExportFps = 0;
+			Renditions = gcnew List<OutputRendition^>();
+			SlideshowEncoderThreadCount = 0;
+			IsSlideshowManifestEnabled = false;
+			AnimationFormat = ScreenRecorderLib::AnimationFormat::GIF;
 		}
 
 		/// <summary>
@@ -207,6 +366,171 @@ namespace ScreenRecorderLib {
 				OnPropertyChanged("RecorderMode");
 			}
 		}
+		/// <summary>
+		/// Size in bytes of the write buffer used when recording to a System.IO.Stream.
+		/// Small writes and seeks from the encoder are collected and written to the stream in large blocks on a background thread,
+		/// which greatly reduces the number of calls into managed code. 0 disables buffering. Only used for seekable streams. Default is 0.
+		/// </summary>
+		property int StreamWriteBufferSize {
+			int get() {
+				return _streamWriteBufferSize;
+			}
+			void set(int value) {
+				_streamWriteBufferSize = value;
+				OnPropertyChanged("StreamWriteBufferSize");
+			}
+		}
+		/// <summary>
+		/// Max duration in milliseconds of each output file when recording video to a file.
+		/// When reached, the recording continues in a new file named after the output file with an increasing number appended, e.g. video_1.mp4, video_2.mp4.
+		/// The first segment is written to the output path. 0 disables duration based segmenting. Default is 0.
+		/// </summary>
+		property int SegmentDurationMillis {
+			int get() {
+				return _segmentDurationMillis;
+			}
+			void set(int value) {
+				_segmentDurationMillis = value;
+				OnPropertyChanged("SegmentDurationMillis");
+			}
+		}
+		/// <summary>
+		/// Max size in bytes of each output file when recording video to a file. Segments may exceed this by the amount of data the encoder has buffered.
+		/// 0 disables size based segmenting. Default is 0.
+		/// </summary>
+		property long long SegmentMaxSizeBytes {
+			long long get() {
+				return _segmentMaxSizeBytes;
+			}
+			void set(long long value) {
+				_segmentMaxSizeBytes = value;
+				OnPropertyChanged("SegmentMaxSizeBytes");
+			}
+		}
+		/// <summary>
+		/// The format of the manifest listing the segments of a segmented recording. The manifest is updated each time a segment is finished. Default is None.
+		/// </summary>
+		property ScreenRecorderLib::SegmentManifestFormat SegmentManifestFormat {
+			ScreenRecorderLib::SegmentManifestFormat get() {
+				return _segmentManifestFormat;
+			}
+			void set(ScreenRecorderLib::SegmentManifestFormat value) {
+				_segmentManifestFormat = value;
+				OnPropertyChanged("SegmentManifestFormat");
+			}
+		}
+		/// <summary>
+		/// Enables the replay buffer when recording video. The encoded video is then kept in memory instead of being written to the output,
+		/// and only the most recent part is kept. Use Recorder.SaveReplay to save the buffer while recording, and when the recording stops the buffer is written to the output.
+		/// The buffer always holds at least this duration in milliseconds, plus up to one keyframe interval. 0 disables the duration limit. Default is 0.
+		/// </summary>
+		property int ReplayBufferDurationMillis {
+			int get() {
+				return _replayBufferDurationMillis;
+			}
+			void set(int value) {
+				_replayBufferDurationMillis = value;
+				OnPropertyChanged("ReplayBufferDurationMillis");
+			}
+		}
+		/// <summary>
+		/// Max size in bytes of the encoded video and audio kept in the replay buffer. Setting this also enables the replay buffer.
+		/// The newest keyframe interval is always kept, even if larger. 0 disables the size limit. Default is 0.
+		/// </summary>
+		property long long ReplayBufferMaxSizeBytes {
+			long long get() {
+				return _replayBufferMaxSizeBytes;
+			}
+			void set(long long value) {
+				_replayBufferMaxSizeBytes = value;
+				OnPropertyChanged("ReplayBufferMaxSizeBytes");
+			}
+		}
+		/// <summary>
+		/// Name of a shared memory ring that the output frames are exported to while recording, so other processes can read them without copying, e.g. Local\MyRecorderFrames.
+		/// Frames are written as tightly packed BGRA32 bitmaps. The layout of the ring is described in FrameExportLayout.h. Null or empty disables frame export. Default is null.
+		/// </summary>
+		property String^ FrameExportName {
+			String^ get() {
+				return _frameExportName;
+			}
+			void set(String^ value) {
+				_frameExportName = value;
+				OnPropertyChanged("FrameExportName");
+			}
+		}
+		/// <summary>
+		/// The number of frames in the frame export ring. Readers can hold all but one of them without the recorder dropping frames. Default is 4.
+		/// </summary>
+		property int FrameExportSlotCount {
+			int get() {
+				return _frameExportSlotCount;
+			}
+			void set(int value) {
+				_frameExportSlotCount = value;
+				OnPropertyChanged("FrameExportSlotCount");
+			}
+		}
+		/// <summary>
+		/// Max number of frames per second exported to the frame export ring. 0 exports every frame. Default is 0.
+		/// </summary>
+		property int FrameExportFps {
+			int get() {
+				return _frameExportFps;
+			}
+			void set(int value) {
+				_frameExportFps = value;
+				OnPropertyChanged("FrameExportFps");
+			}
+		}
+		/// <summary>
+		/// Additional video files encoded from the same frames and audio as the recording, each with its own frame size, frame rate and bitrate. Only used when recording video.
+		/// </summary>
+		property List<OutputRendition^>^ Renditions {
+			List<OutputRendition^>^ get() {
+				return _renditions;
+			}
+			void set(List<OutputRendition^>^ value) {
+				_renditions = value;
+				OnPropertyChanged("Renditions");
+			}
+		}
+		/// <summary>
+		/// Number of threads encoding slideshow images in parallel, so short snapshot intervals can keep up with slow image formats like PNG. 0 picks a count from the number of processors. Default is 0.
+		/// </summary>
+		property int SlideshowEncoderThreadCount {
+			int get() {
+				return _slideshowEncoderThreadCount;
+			}
+			void set(int value) {
+				_slideshowEncoderThreadCount = value;
+				OnPropertyChanged("SlideshowEncoderThreadCount");
+			}
+		}
+		/// <summary>
+		/// Writes a manifest named frames.tsv to the slideshow folder, with a line for each frame as soon as it is written. Each line holds the frame delay in milliseconds and the file name, separated by a tab. Default is false.
+		/// </summary>
+		property bool IsSlideshowManifestEnabled {
+			bool get() {
+				return _isSlideshowManifestEnabled;
+			}
+			void set(bool value) {
+				_isSlideshowManifestEnabled = value;
+				OnPropertyChanged("IsSlideshowManifestEnabled");
+			}
+		}
+		/// <summary>
+		/// The file format of RecorderMode.Animation. The frame rate is set with VideoEncoderOptions.Framerate. Default is GIF.
+		/// </summary>
+		property ScreenRecorderLib::AnimationFormat AnimationFormat {
+			ScreenRecorderLib::AnimationFormat get() {
+				return _animationFormat;
+			}
+			void set(ScreenRecorderLib::AnimationFormat value) {
+				_animationFormat = value;
+				OnPropertyChanged("AnimationFormat");
+			}
+		}
 	};
 
 	public ref class VideoEncoderOptions : public INotifyPropertyChanged {
@@ -704,6 +1028,7 @@ namespace ScreenRecorderLib {
 	public ref class MouseOptions :DynamicMouseOptions {
 	private:
 		MouseDetectionMode _mouseClickDetectionMode;
+		bool _isMousePointerMetadataEnabled;
 	public:
 		MouseOptions() :DynamicMouseOptions() {
 			MouseClickDetectionMode = MouseDetectionMode::Polling;
@@ -713,6 +1038,7 @@ namespace ScreenRecorderLib {
 			MouseRightClickDetectionColor = "#FFFF00";
 			MouseClickDetectionRadius = 20;
 			MouseClickDetectionDuration = 150;
+			IsMousePointerMetadataEnabled = false;
 		}
 		/// <summary>
 		/// The mode for detecting mouse clicks. Default is Polling.
@@ -726,6 +1052,21 @@ namespace ScreenRecorderLib {
 				OnPropertyChanged("MouseClickDetectionMode");
 			}
 		}
+		/// <summary>
+		/// Record the mouse pointer position, shape and clicks to a cursor track file next to the recording, named as the recording with .cursor appended.
+		/// The pointer can then be drawn at playback or export time instead of, or as well as, in the video.
+		/// When IsMousePointerEnabled is false, pointer movement alone no longer causes new frames, so the video only changes when the screen does.
+		/// Not supported when recording to a stream. Default is false.
+		/// </summary>
+		property bool IsMousePointerMetadataEnabled {
+			bool get() {
+				return _isMousePointerMetadataEnabled;
+			}
+			void set(bool value) {
+				_isMousePointerMetadataEnabled = value;
+				OnPropertyChanged("IsMousePointerMetadataEnabled");
+			}
+		}
 	};
 
 	public ref class OverLayOptions : public INotifyPropertyChanged {
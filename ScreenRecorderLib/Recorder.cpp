@@ -2,12 +2,14 @@
 #include <memory>
 #include <msclr\marshal.h>
 #include <msclr\marshal_cppstd.h>
+#include <msclr\lock.h>
 #include "ManagedIStream.h"
 using namespace ScreenRecorderLib;
-using namespace nlohmann;
 
 Recorder::Recorder(RecorderOptions^ options)
 {
+	_resourcesLock = gcnew Object();
+	_activeRecordingCount = 0;
 	m_Rec = new RecordingManager();
 	if (!options) {
 		options = RecorderOptions::DefaultMainMonitor;
@@ -69,6 +71,15 @@ void Recorder::SetOptions(RecorderOptions^ options) {
 				case ImageFormat::TIFF:
 					snapshotOptions->SetSnapshotSaveFormat(GUID_ContainerFormatTiff);
 					break;
+				case ImageFormat::FastPNG:
+				case ImageFormat::QOI:
+					snapshotOptions->SetSnapshotSaveFormat(GUID_ContainerFormatPng);
+					snapshotOptions->SetImageEncoder(options->SnapshotOptions->SnapshotFormat == ImageFormat::QOI ? ImageEncoderInternal::Qoi : ImageEncoderInternal::FastPng);
+					break;
+				case ImageFormat::FastJPEG:
+					snapshotOptions->SetSnapshotSaveFormat(GUID_ContainerFormatJpeg);
+					snapshotOptions->SetImageEncoder(ImageEncoderInternal::FastJpeg);
+					break;
 				default:
 				case ImageFormat::PNG:
 					snapshotOptions->SetSnapshotSaveFormat(GUID_ContainerFormatPng);
@@ -95,6 +106,46 @@ void Recorder::SetOptions(RecorderOptions^ options) {
 			if (options->OutputOptions->VideoFramePreviewSize && !options->OutputOptions->VideoFramePreviewSize->Equals(ScreenSize::Empty)) {
 				outputOptions->SetVideoFramePreviewSize(SIZE{ (long)round(options->OutputOptions->VideoFramePreviewSize->Width),(long)round(options->OutputOptions->VideoFramePreviewSize->Height) });
 			}
+			if (options->OutputOptions->VideoFramePreviewFps.HasValue) {
+				outputOptions->SetVideoFramePreviewFps(max(0, options->OutputOptions->VideoFramePreviewFps.Value));
+			}
+			outputOptions->SetStreamWriteBufferSize(max(0, options->OutputOptions->StreamWriteBufferSize));
+			outputOptions->SetSegmentDuration(max(0, options->OutputOptions->SegmentDurationMillis));
+			outputOptions->SetSegmentMaxSize(static_cast<UINT64>(max(0LL, options->OutputOptions->SegmentMaxSizeBytes)));
+			outputOptions->SetSegmentManifestFormat(static_cast<SegmentManifestFormatInternal>(options->OutputOptions->SegmentManifestFormat));
+			outputOptions->SetReplayBufferDuration(max(0, options->OutputOptions->ReplayBufferDurationMillis));
+			outputOptions->SetReplayBufferMaxSize(static_cast<UINT64>(max(0LL, options->OutputOptions->ReplayBufferMaxSizeBytes)));
+			if (!String::IsNullOrEmpty(options->OutputOptions->FrameExportName)) {
+				outputOptions->SetFrameExportName(msclr::interop::marshal_as<std::wstring>(options->OutputOptions->FrameExportName));
+			}
+			outputOptions->SetFrameExportSlotCount(max(1, options->OutputOptions->FrameExportSlotCount));
+			outputOptions->SetFrameExportFps(max(0, options->OutputOptions->FrameExportFps));
+			outputOptions->SetSlideshowEncoderThreadCount(max(0, options->OutputOptions->SlideshowEncoderThreadCount));
+			outputOptions->SetIsSlideshowManifestEnabled(options->OutputOptions->IsSlideshowManifestEnabled);
+			outputOptions->SetAnimationFormat(static_cast<AnimationFormatInternal>(options->OutputOptions->AnimationFormat));
+			if (options->OutputOptions->Renditions) {
+				std::vector<OUTPUT_RENDITION> renditions{};
+				for each (OutputRendition ^ managedRendition in options->OutputOptions->Renditions)
+				{
+					if (!managedRendition || String::IsNullOrEmpty(managedRendition->OutputPath)) {
+						continue;
+					}
+					OUTPUT_RENDITION rendition{};
+					rendition.OutputPath = msclr::interop::marshal_as<std::wstring>(managedRendition->OutputPath);
+					if (managedRendition->FrameSize && !managedRendition->FrameSize->Equals(ScreenSize::Empty)) {
+						rendition.FrameSize = managedRendition->FrameSize->ToSIZE();
+					}
+					rendition.FramerateDivisor = max(1, managedRendition->FramerateDivisor);
+					if (managedRendition->Bitrate.HasValue) {
+						rendition.VideoBitrate = static_cast<UINT32>(max(0, managedRendition->Bitrate.Value));
+					}
+					if (managedRendition->IsFragmentedMp4Enabled.HasValue) {
+						rendition.IsFragmentedMp4Enabled = managedRendition->IsFragmentedMp4Enabled.Value;
+					}
+					renditions.push_back(rendition);
+				}
+				outputOptions->SetRenditions(renditions);
+			}
 			m_Rec->SetOutputOptions(outputOptions);
 		}
 		if (options->AudioOptions) {
@@ -157,6 +208,7 @@ void Recorder::SetOptions(RecorderOptions^ options) {
 				mouseOptions->SetMouseClickDetectionDuration(options->MouseOptions->MouseClickDetectionDuration.Value);
 			}
 			mouseOptions->SetMouseClickDetectionMode((UINT32)options->MouseOptions->MouseClickDetectionMode);
+			mouseOptions->SetMousePointerMetadataEnabled(options->MouseOptions->IsMousePointerMetadataEnabled);
 			m_Rec->SetMouseOptions(mouseOptions);
 		}
 		if (options->OverlayOptions) {
@@ -232,6 +284,9 @@ void Recorder::SetDynamicOptions(DynamicOptions^ options)
 		if (options->OutputOptions->VideoFramePreviewSize) {
 			m_Rec->GetOutputOptions()->SetVideoFramePreviewSize(options->OutputOptions->VideoFramePreviewSize->ToSIZE());
 		}
+		if (options->OutputOptions->VideoFramePreviewFps.HasValue) {
+			m_Rec->GetOutputOptions()->SetVideoFramePreviewFps(max(0, options->OutputOptions->VideoFramePreviewFps.Value));
+		}
 	}
 	if (options->SourceRects) {
 		for each (KeyValuePair<String^, ScreenRect^> ^ kvp in options->SourceRects)
@@ -645,19 +700,22 @@ Recorder^ Recorder::CreateRecorder(RecorderOptions^ options)
 	return rec;
 }
 void Recorder::Record(System::Runtime::InteropServices::ComTypes::IStream^ stream) {
-	SetupCallbacks();
 	IStream* pNativeStream = (IStream*)Marshal::GetComInterfaceForObject(stream, System::Runtime::InteropServices::ComTypes::IStream::typeid).ToPointer();
-	m_Rec->BeginRecording(pNativeStream);
+	BeginActiveRecording();
+	EndBeginRecording(m_Rec->BeginRecording(pNativeStream));
+	pNativeStream->Release();
 }
 void Recorder::Record(System::IO::Stream^ stream) {
-	SetupCallbacks();
-	m_ManagedStream = new ManagedIStream(stream);
-	m_Rec->BeginRecording(m_ManagedStream);
+	//The recording keeps its own reference to the stream until it is finalized.
+	ManagedIStream* pManagedStream = new ManagedIStream(stream, m_Rec->GetOutputOptions()->GetStreamWriteBufferSize());
+	BeginActiveRecording();
+	EndBeginRecording(m_Rec->BeginRecording(pManagedStream));
+	pManagedStream->Release();
 }
 void Recorder::Record(System::String^ path) {
-	SetupCallbacks();
 	std::wstring stdPathString = msclr::interop::marshal_as<std::wstring>(path);
-	m_Rec->BeginRecording(stdPathString);
+	BeginActiveRecording();
+	EndBeginRecording(m_Rec->BeginRecording(stdPathString));
 }
 void Recorder::Pause() {
 	m_Rec->PauseRecording();
@@ -668,6 +726,15 @@ void Recorder::Resume() {
 void Recorder::Stop() {
 	m_Rec->EndRecording();
 }
+bool Recorder::Warm() {
+	return Warm(0);
+}
+bool Recorder::Warm(long long maxVideoMemoryBytes) {
+	return SUCCEEDED(m_Rec->Warm(static_cast<UINT64>(max(0LL, maxVideoMemoryBytes))));
+}
+void Recorder::Cool() {
+	m_Rec->Cool();
+}
 bool Recorder::TakeSnapshot()
 {
 	HRESULT hr = m_Rec->TakeSnapshot(L"");
@@ -686,12 +753,42 @@ bool Recorder::TakeSnapshot(System::IO::Stream^ stream) {
 	OutputDebugStringW(L"Snapshot returning");
 	return SUCCEEDED(hr);
 }
+bool Recorder::TakeScreenshot(System::String^ path)
+{
+	std::wstring stdPathString = msclr::interop::marshal_as<std::wstring>(path);
+	HRESULT hr = m_Rec->TakeScreenshot(stdPathString);
+	return SUCCEEDED(hr);
+}
+bool Recorder::TakeScreenshot(System::IO::Stream^ stream) {
+	ManagedIStream* interopStream = new ManagedIStream(stream);
+	HRESULT hr = m_Rec->TakeScreenshot(interopStream);
+	interopStream->Release();
+	return SUCCEEDED(hr);
+}
+bool Recorder::SaveReplay(System::String^ path)
+{
+	std::wstring stdPathString = msclr::interop::marshal_as<std::wstring>(path);
+	HRESULT hr = m_Rec->SaveReplay(stdPathString);
+	return SUCCEEDED(hr);
+}
+bool Recorder::SaveReplay(System::IO::Stream^ stream) {
+	ManagedIStream* interopStream = new ManagedIStream(stream);
+	HRESULT hr = m_Rec->SaveReplay(interopStream);
+	interopStream->Release();
+	return SUCCEEDED(hr);
+}
 void Recorder::SetupCallbacks() {
-	CreateErrorCallback();
-	CreateCompletionCallback();
-	CreateStatusCallback();
-	CreateSnapshotCallback();
-	CreateFrameNumberCallback();
+	//A previous recording may still be finalizing and use the existing callbacks, so they are reused if present.
+	if (!_errorDelegateGcHandler.IsAllocated)
+		CreateErrorCallback();
+	if (!_completedDelegateGcHandler.IsAllocated)
+		CreateCompletionCallback();
+	if (!_statusChangedDelegateGcHandler.IsAllocated)
+		CreateStatusCallback();
+	if (!_snapshotDelegateGcHandler.IsAllocated)
+		CreateSnapshotCallback();
+	if (!_frameNumberDelegateGcHandler.IsAllocated)
+		CreateFrameNumberCallback();
 }
 
 void Recorder::ReleaseCallbacks() {
@@ -707,12 +804,31 @@ void Recorder::ReleaseCallbacks() {
 		_frameNumberDelegateGcHandler.Free();
 }
 
+void Recorder::BeginActiveRecording() {
+	//Counted before the recording starts, so a previous recording that finishes finalizing in the meantime doesn't release the callbacks and streams this one uses.
+	msclr::lock lock(_resourcesLock);
+	_activeRecordingCount++;
+	SetupCallbacks();
+	_isStartingRecording = true;
+}
+
+void Recorder::EndBeginRecording(HRESULT hr) {
+	_isStartingRecording = false;
+	//BeginRecording only returns S_OK if the recording started, and then it ends with a completion or failure callback.
+	if (hr != S_OK) {
+		EndActiveRecording();
+	}
+}
+
+void Recorder::EndActiveRecording() {
+	msclr::lock lock(_resourcesLock);
+	if (_activeRecordingCount > 0 && --_activeRecordingCount == 0) {
+		ReleaseResources();
+	}
+}
+
 void Recorder::ReleaseResources() {
 	ReleaseCallbacks();
-	if (m_ManagedStream) {
-		delete m_ManagedStream;
-		m_ManagedStream = nullptr;
-	}
 	if (m_Rec) {
 		for each (auto var in m_Rec->GetRecordingOverlays())
 		{
@@ -754,6 +870,7 @@ HRESULT Recorder::CreateOrUpdateNativeRecordingSource(_In_ RecordingSourceBase^
 		&& (managedSource->VideoFramePreviewSize->Width > 0 || managedSource->VideoFramePreviewSize->Height > 0)) {
 		pNativeSource->VideoFramePreviewSize = managedSource->VideoFramePreviewSize->ToSIZE();
 	}
+	pNativeSource->VideoFramePreviewFps = static_cast<UINT32>(max(0, managedSource->VideoFramePreviewFps));
 
 	pNativeSource->IsVideoCaptureEnabled = managedSource->IsVideoCaptureEnabled;
 	pNativeSource->Stretch = static_cast<TextureStretchMode>(managedSource->Stretch);
@@ -818,6 +935,7 @@ HRESULT Recorder::CreateOrUpdateNativeRecordingSource(_In_ RecordingSourceBase^
 	else if (isinst<VideoRecordingSource^>(managedSource)) {
 		VideoRecordingSource^ videoSource = (VideoRecordingSource^)managedSource;
 		pNativeSource->Type = RecordingSourceType::Video;
+		pNativeSource->LoopMode = static_cast<VideoLoopModeInternal>(videoSource->LoopMode);
 		if (videoSource->SourceStream) {
 			SafeRelease(&pNativeSource->SourceStream);
 			pNativeSource->SourceStream = new ManagedIStream(videoSource->SourceStream);
@@ -883,6 +1001,7 @@ HRESULT Recorder::CreateOrUpdateNativeRecordingOverlay(_In_ RecordingOverlayBase
 	else if (isinst<VideoOverlay^>(managedOverlay)) {
 		VideoOverlay^ videoOverlay = (VideoOverlay^)managedOverlay;
 		pNativeOverlay->Type = RecordingSourceType::Video;
+		pNativeOverlay->LoopMode = static_cast<VideoLoopModeInternal>(videoOverlay->LoopMode);
 		if (videoOverlay->SourceStream) {
 			SafeRelease(&pNativeOverlay->SourceStream);
 			pNativeOverlay->SourceStream = new ManagedIStream(videoOverlay->SourceStream);
@@ -1063,21 +1182,26 @@ void Recorder::CreateFrameNumberCallback() {
 	CallbackFrameNumberChangedFunction cb = static_cast<CallbackFrameNumberChangedFunction>(ip.ToPointer());
 	m_Rec->RecordingFrameNumberChangedCallback = cb;
 }
-void Recorder::EventComplete(std::wstring path, fifo_map<std::wstring, int> delays)
+void Recorder::EventComplete(std::wstring path, const FrameManifest *pFrameManifest)
 {
-	ReleaseResources();
-
-	List<FrameData^>^ frameInfos = gcnew List<FrameData^>();
+	//Failures reported while starting a recording don't end the recordings that use the resources.
+	if (!_isStartingRecording) {
+		EndActiveRecording();
+	}
 
-	for (auto x : delays) {
-		frameInfos->Add(gcnew FrameData(gcnew String(x.first.c_str()), x.second));
+	int frameCount = pFrameManifest ? static_cast<int>(pFrameManifest->Size()) : 0;
+	List<FrameData^>^ frameInfos = gcnew List<FrameData^>(frameCount);
+	for (int i = 0; i < frameCount; i++) {
+		frameInfos->Add(gcnew FrameData(gcnew String(pFrameManifest->GetPath(i).c_str()), pFrameManifest->GetDelay(i)));
 	}
 	RecordingCompleteEventArgs^ args = gcnew RecordingCompleteEventArgs(gcnew String(path.c_str()), frameInfos);
 	OnRecordingComplete(this, args);
 }
 void Recorder::EventFailed(std::wstring error, std::wstring path)
 {
-	ReleaseResources();
+	if (!_isStartingRecording) {
+		EndActiveRecording();
+	}
 	OnRecordingFailed(this, gcnew RecordingFailedEventArgs(gcnew String(error.c_str()), gcnew String(path.c_str())));
 }
 void Recorder::EventStatusChanged(int status)
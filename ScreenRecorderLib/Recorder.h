@@ -18,7 +18,7 @@ using namespace System::Collections::Generic;
 using namespace System::ComponentModel;
 
 delegate void InternalStatusCallbackDelegate(int status);
-delegate void InternalCompletionCallbackDelegate(std::wstring path, nlohmann::fifo_map<std::wstring, int>);
+delegate void InternalCompletionCallbackDelegate(std::wstring path, const FrameManifest *pFrameManifest);
 delegate void InternalErrorCallbackDelegate(std::wstring error, std::wstring path);
 delegate void InternalSnapshotCallbackDelegate(std::wstring path);
 delegate void InternalFrameNumberCallbackDelegate(int newFrameNumber, INT64 timestamp, FRAME_BITMAP_DATA* data);
@@ -60,7 +60,7 @@ namespace ScreenRecorderLib {
 		void CreateStatusCallback();
 		void CreateSnapshotCallback();
 		void CreateFrameNumberCallback();
-		void EventComplete(std::wstring path, nlohmann::fifo_map<std::wstring, int> delays);
+		void EventComplete(std::wstring path, const FrameManifest *pFrameManifest);
 		void EventFailed(std::wstring error, std::wstring path);
 		void EventStatusChanged(int status);
 		void EventSnapshotCreated(std::wstring str);
@@ -68,6 +68,9 @@ namespace ScreenRecorderLib {
 		void SetupCallbacks();
 		void ReleaseCallbacks();
 		void ReleaseResources();
+		void BeginActiveRecording();
+		void EndBeginRecording(HRESULT hr);
+		void EndActiveRecording();
 		static HRESULT CreateOrUpdateNativeRecordingSource(_In_ RecordingSourceBase^ managedSource, _Inout_ RECORDING_SOURCE* pNativeSource);
 		static HRESULT CreateOrUpdateNativeRecordingOverlay(_In_ RecordingOverlayBase^ managedOverlay, _Inout_ RECORDING_OVERLAY* pNativeOverlay);
 		static List<VideoCaptureFormat^>^ CreateVideoCaptureFormatList(_In_ std::vector< IMFMediaType*> mediaTypes);
@@ -78,12 +81,17 @@ namespace ScreenRecorderLib {
 		int _currentFrameNumber;
 		RecorderStatus _status;
 		RecordingManager* m_Rec;
-		ManagedIStream* m_ManagedStream;
 		GCHandle _statusChangedDelegateGcHandler;
 		GCHandle _errorDelegateGcHandler;
 		GCHandle _completedDelegateGcHandler;
 		GCHandle _snapshotDelegateGcHandler;
 		GCHandle _frameNumberDelegateGcHandler;
+		//Guards the callbacks and source streams, which are shared by the running recording and the ones still finalizing.
+		Object^ _resourcesLock;
+		//Recordings that are starting, running or finalizing. The callbacks and source streams are released when the last one ends.
+		int _activeRecordingCount;
+		//Set while BeginRecording runs on this thread, as the failures it reports synchronously don't end a started recording.
+		[ThreadStatic] static bool _isStartingRecording;
 
 	internal:
 		void SetDynamicOptions(DynamicOptions^ options);
@@ -114,9 +122,63 @@ namespace ScreenRecorderLib {
 		bool TakeSnapshot();
 		bool TakeSnapshot(System::String^ path);
 		bool TakeSnapshot(System::IO::Stream^ stream);
+		/// <summary>
+		/// Takes a screenshot of the recording sources and returns when it is written, without starting a recording. This is much faster than recording in Screenshot mode, as no capture threads, encoder or audio capture are started.
+		/// Call Warm first to also reuse the graphics device between screenshots. Overlays are not drawn, and a recording can not be in progress.
+		/// </summary>
+		/// <param name="path">The file to write the screenshot to, in the format of SnapshotOptions.SnapshotFormat.</param>
+		/// <returns>true if the screenshot was written.</returns>
+		bool TakeScreenshot(System::String^ path);
+		/// <summary>
+		/// Takes a screenshot of the recording sources and returns when it is written to the stream, without starting a recording.
+		/// </summary>
+		/// <returns>true if the screenshot was written.</returns>
+		bool TakeScreenshot(System::IO::Stream^ stream);
+		/// <summary>
+		/// Saves the replay buffer to an MP4 file while the recording continues. Requires OutputOptions.ReplayBufferDurationMillis or ReplayBufferMaxSizeBytes to be set.
+		/// </summary>
+		/// <returns>true if the replay was saved.</returns>
+		bool SaveReplay(System::String^ path);
+		/// <summary>
+		/// Saves the replay buffer as MP4 to a seekable stream while the recording continues. Requires OutputOptions.ReplayBufferDurationMillis or ReplayBufferMaxSizeBytes to be set.
+		/// </summary>
+		/// <returns>true if the replay was saved.</returns>
+		bool SaveReplay(System::IO::Stream^ stream);
 		void Pause();
 		void Resume();
 		void Stop();
+		/// <summary>
+		/// Keeps the graphics device, shaders and audio capture objects alive between recordings, so new recordings start faster.
+		/// </summary>
+		/// <returns>true if the recorder is warm.</returns>
+		bool Warm();
+		/// <summary>
+		/// Keeps the graphics device, shaders and audio capture objects alive between recordings, so new recordings start faster.
+		/// </summary>
+		/// <param name="maxVideoMemoryBytes">If the video memory used by the process exceeds this when a recording ends, the recorder is cooled down. 0 means no limit.</param>
+		/// <returns>true if the recorder is warm.</returns>
+		bool Warm(long long maxVideoMemoryBytes);
+		/// <summary>
+		/// Releases the resources kept alive by Warm. If a recording is in progress, they are released when it ends.
+		/// </summary>
+		void Cool();
+		property bool IsWarm {
+			bool get() {
+				return m_Rec->IsWarm();
+			}
+		}
+		/// <summary>
+		/// The time from the last call to Record until the first frame was encoded, or null if no frame has been encoded yet.
+		/// </summary>
+		property Nullable<TimeSpan> LastStartupLatency {
+			Nullable<TimeSpan> get() {
+				double millis = m_Rec->GetLastStartupLatencyMillis();
+				if (millis < 0) {
+					return Nullable<TimeSpan>();
+				}
+				return Nullable<TimeSpan>(TimeSpan::FromTicks(static_cast<long long>(millis * TimeSpan::TicksPerMillisecond)));
+			}
+		}
 		void SetOptions(RecorderOptions^ options);
 		/// <summary>
 		/// DynamicOptionsBuilder can be used to update a subset of options while a recording is in progress.
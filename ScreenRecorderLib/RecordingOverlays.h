@@ -127,6 +127,7 @@ namespace ScreenRecorderLib {
 	private:
 		String^ _sourcePath;
 		System::IO::Stream^ _sourceStream;
+		VideoLoopMode _loopMode;
 	public:
 		VideoOverlay() :RecordingOverlayBase() {
 
@@ -140,6 +141,7 @@ namespace ScreenRecorderLib {
 		VideoOverlay(VideoOverlay^ source) :RecordingOverlayBase(source) {
 			SourcePath = source->SourcePath;
 			SourceStream = source->SourceStream;
+			LoopMode = source->LoopMode;
 		}
 		/// <summary>
 		///The file path of the video to record
@@ -165,6 +167,18 @@ namespace ScreenRecorderLib {
 				OnPropertyChanged("SourceStream");
 			}
 		}
+		/// <summary>
+		///How the video restarts when the end is reached. The default is VideoLoopMode.Seek.
+		/// </summary>
+		property VideoLoopMode LoopMode {
+			VideoLoopMode get() {
+				return _loopMode;
+			}
+			void set(VideoLoopMode value) {
+				_loopMode = value;
+				OnPropertyChanged("LoopMode");
+			}
+		}
 	};
 	public ref class ImageOverlay :RecordingOverlayBase {
 	private:
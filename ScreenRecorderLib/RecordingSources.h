@@ -16,6 +16,14 @@ namespace ScreenRecorderLib {
 		///<summary>WindowsGraphicsCapture requires Windows 10 version 1803 or higher. This API supports recording windows in addition to screens.</summary>
 		WindowsGraphicsCapture = 1,
 	};
+	public enum class VideoLoopMode {
+		///<summary>Seek back to the start when the end of the video is reached. The last frame is shown until the first frame is decoded again.</summary>
+		Seek = (int)VideoLoopModeInternal::Seek,
+		///<summary>Cache the first half second of the video, and show it while the video is decoded from the start again, so the loop has no visible pause.</summary>
+		Gapless = (int)VideoLoopModeInternal::Gapless,
+		///<summary>Cache every frame of short videos, and play them from the cache after the first pass without decoding. Videos too long to cache are looped as with Gapless.</summary>
+		Cached = (int)VideoLoopModeInternal::Cached
+	};
 	public ref class RecordingSourceBase abstract : public INotifyPropertyChanged {
 	private:
 		String^ _id;
@@ -27,6 +35,7 @@ namespace ScreenRecorderLib {
 		ScreenRect^ _sourceRect;
 		bool _isVideoCaptureEnabled;
 		bool _isVideoFramePreviewEnabled;
+		int _videoFramePreviewFps;
 		GCHandle _frameRecordedGcHandler;
 		[DebuggerBrowsable(DebuggerBrowsableState::Never)]
 			CallbackNewFrameDataFunction _cb;
@@ -51,6 +60,7 @@ namespace ScreenRecorderLib {
 			SourceRect = base->SourceRect;
 			IsVideoCaptureEnabled = base->IsVideoCaptureEnabled;
 			IsVideoFramePreviewEnabled = base->IsVideoFramePreviewEnabled;
+			VideoFramePreviewFps = base->VideoFramePreviewFps;
 		}
 		~RecordingSourceBase() {
 			if (_frameRecordedGcHandler.IsAllocated)
@@ -190,6 +200,21 @@ namespace ScreenRecorderLib {
 				}
 			}
 		}
+		/// <summary>
+		/// The max number of frame bitmaps per second sent through the OnFrameRecorded event of this source. 0 sends a bitmap for every captured frame.
+		/// Frames in between are not read back from the GPU, and bitmaps are dropped if the event handler can't keep up.
+		/// </summary>
+		property int VideoFramePreviewFps {
+			int get() {
+				return _videoFramePreviewFps;
+			}
+			void set(int value) {
+				if (_videoFramePreviewFps != value) {
+					_videoFramePreviewFps = value;
+					OnPropertyChanged("VideoFramePreviewFps");
+				}
+			}
+		}
 
 		void OnPropertyChanged(String^ info)
 		{
@@ -399,10 +424,14 @@ namespace ScreenRecorderLib {
 		/// </summary>
 		property String^ SourcePath;
 		property System::IO::Stream^ SourceStream;
+		/// <summary>
+		/// How the video restarts when the end is reached. The default is VideoLoopMode.Seek.
+		/// </summary>
+		property VideoLoopMode LoopMode;
 
 		VideoRecordingSource()
 		{
-
+			LoopMode = VideoLoopMode::Seek;
 		}
 		VideoRecordingSource(String^ path) :VideoRecordingSource() {
 			SourcePath = path;
@@ -410,8 +439,9 @@ namespace ScreenRecorderLib {
 		VideoRecordingSource(VideoRecordingSource^ source) :RecordingSourceBase(source) {
 			SourcePath = source->SourcePath;
 			SourceStream = source->SourceStream;
+			LoopMode = source->LoopMode;
 		}
-		VideoRecordingSource(System::IO::Stream^ stream) {
+		VideoRecordingSource(System::IO::Stream^ stream) :VideoRecordingSource() {
 			SourceStream = stream;
 		}
 	};
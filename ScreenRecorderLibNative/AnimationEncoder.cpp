@@ -0,0 +1,833 @@
+#include "AnimationEncoder.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define ANIMATION_ENCODER_SSE2
+#endif
+
+using namespace std;
+
+namespace {
+	//Colors are counted in a histogram with 5 bits per channel.
+	const int HISTOGRAM_BITS = 15;
+	const uint32_t HISTOGRAM_SIZE = 1 << HISTOGRAM_BITS;
+	//A palette is reused if its error is at most this much larger than the error of a new palette, per pixel and as a fraction of the new palette error.
+	const uint64_t PALETTE_REUSE_MARGIN_PER_PIXEL = 4;
+	const uint64_t PALETTE_REUSE_MARGIN_DIVISOR = 4;
+	//Browsers show GIF frames with a delay below 20 ms for 100 ms, so shorter frames are rounded up to this.
+	const uint32_t MIN_GIF_DELAY_CENTISECONDS = 2;
+	const uint32_t OPAQUE_ALPHA = 0xFF000000;
+	//Unchanged pixels are only made transparent in runs of at least this many pixels. Short runs of transparent pixels between changed ones compress worse than the pixels themselves.
+	const uint32_t MIN_TRANSPARENT_RUN = 16;
+
+	const uint32_t LZW_MAX_CODE = 4096;
+	const int LZW_MAX_CODE_SIZE = 12;
+	const int LZW_HASH_BITS = 14;
+
+	inline uint32_t Load32(const uint8_t *p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	inline void Store32(uint8_t *p, uint32_t value)
+	{
+		memcpy(p, &value, sizeof(value));
+	}
+
+	/// <summary>
+	/// The histogram bin of a Bgra32 pixel, with the top 5 bits of red, green and blue.
+	/// </summary>
+	inline uint32_t GetHistogramBin(uint32_t pixel)
+	{
+		return ((pixel & 0xF8) >> 3) | ((pixel & 0xF800) >> 6) | ((pixel & 0xF80000) >> 9);
+	}
+
+	/// <summary>
+	/// A histogram bin, with the sum of the colors in it so its mean color is exact.
+	/// </summary>
+	struct HISTOGRAM_BIN {
+		uint32_t Count;
+		uint32_t Red;
+		uint32_t Green;
+		uint32_t Blue;
+	};
+
+	inline void AddToBin(HISTOGRAM_BIN &bin, uint32_t pixel)
+	{
+		bin.Count++;
+		bin.Blue += pixel & 0xFF;
+		bin.Green += (pixel >> 8) & 0xFF;
+		bin.Red += (pixel >> 16) & 0xFF;
+	}
+
+	void AppendLittleEndian16(vector<uint8_t> &output, uint32_t value)
+	{
+		output.push_back(static_cast<uint8_t>(value));
+		output.push_back(static_cast<uint8_t>(value >> 8));
+	}
+
+	void AppendBigEndian32(vector<uint8_t> &output, uint32_t value)
+	{
+		output.push_back(static_cast<uint8_t>(value >> 24));
+		output.push_back(static_cast<uint8_t>(value >> 16));
+		output.push_back(static_cast<uint8_t>(value >> 8));
+		output.push_back(static_cast<uint8_t>(value));
+	}
+
+	void AppendBigEndian16(vector<uint8_t> &output, uint32_t value)
+	{
+		output.push_back(static_cast<uint8_t>(value >> 8));
+		output.push_back(static_cast<uint8_t>(value));
+	}
+
+	/// <summary>
+	/// Counts the pixels of a Bgra32 buffer per histogram bin. Pixels with alpha 0 are skipped.
+	/// </summary>
+	void AddToHistogram(const uint8_t *pPixels, size_t pixelCount, HISTOGRAM_BIN *pHistogram)
+	{
+		size_t i = 0;
+#ifdef ANIMATION_ENCODER_SSE2
+		const __m128i blueMask = _mm_set1_epi32(0xF8);
+		const __m128i greenMask = _mm_set1_epi32(0xF800);
+		const __m128i redMask = _mm_set1_epi32(0xF80000);
+		const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(OPAQUE_ALPHA));
+		const __m128i zero = _mm_setzero_si128();
+		alignas(16) uint32_t bins[4];
+		for (; i + 4 <= pixelCount; i += 4) {
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pPixels + i * 4));
+			__m128i bin = _mm_or_si128(_mm_or_si128(
+				_mm_srli_epi32(_mm_and_si128(pixels, blueMask), 3),
+				_mm_srli_epi32(_mm_and_si128(pixels, greenMask), 6)),
+				_mm_srli_epi32(_mm_and_si128(pixels, redMask), 9));
+			int transparent = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(pixels, alphaMask), zero)));
+			_mm_store_si128(reinterpret_cast<__m128i *>(bins), bin);
+			for (int lane = 0; lane < 4; lane++) {
+				if (!(transparent & (1 << lane))) {
+					AddToBin(pHistogram[bins[lane]], Load32(pPixels + (i + lane) * 4));
+				}
+			}
+		}
+#endif
+		for (; i < pixelCount; i++) {
+			uint32_t pixel = Load32(pPixels + i * 4);
+			if (pixel & OPAQUE_ALPHA) {
+				AddToBin(pHistogram[GetHistogramBin(pixel)], pixel);
+			}
+		}
+	}
+
+	struct COLOR_ENTRY {
+		uint8_t Color[3];
+		uint32_t Count;
+	};
+
+	/// <summary>
+	/// Finds the nearest palette color of a color. The palette is stored in groups of 4 colors, so 4 distances are computed at once with SSE2.
+	/// </summary>
+	class PaletteSearch
+	{
+	public:
+		explicit PaletteSearch(const ANIMATION_PALETTE &palette) :
+			m_ColorCount(palette.GetColorCount())
+		{
+			uint32_t paddedCount = (m_ColorCount + 3) & ~3u;
+			//Padding colors are far outside the color space, so they are never the nearest.
+			m_RedGreen.assign(paddedCount * 2, 4095);
+			m_Blue.assign(paddedCount * 2, 0);
+			for (uint32_t i = 0; i < paddedCount; i++) {
+				m_Blue[i * 2] = 4095;
+			}
+			for (uint32_t i = 0; i < m_ColorCount; i++) {
+				m_RedGreen[i * 2] = palette.Colors[i * 3];
+				m_RedGreen[i * 2 + 1] = palette.Colors[i * 3 + 1];
+				m_Blue[i * 2] = palette.Colors[i * 3 + 2];
+			}
+		}
+
+		/// <returns>The index of the nearest color. The squared distance to it is returned in distance.</returns>
+		uint32_t FindNearest(int red, int green, int blue, uint32_t &distance) const
+		{
+			uint32_t bestIndex = 0;
+			uint32_t bestDistance = UINT32_MAX;
+			uint32_t paddedCount = static_cast<uint32_t>(m_RedGreen.size() / 2);
+#ifdef ANIMATION_ENCODER_SSE2
+			const __m128i redGreen = _mm_set1_epi32((green << 16) | red);
+			const __m128i blueZero = _mm_set1_epi32(blue);
+			__m128i best = _mm_set1_epi32(INT32_MAX);
+			__m128i bestIndices = _mm_setzero_si128();
+			__m128i indices = _mm_setr_epi32(0, 1, 2, 3);
+			const __m128i four = _mm_set1_epi32(4);
+			for (uint32_t i = 0; i < paddedCount; i += 4) {
+				__m128i dRedGreen = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(m_RedGreen.data() + i * 2)), redGreen);
+				__m128i dBlue = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(m_Blue.data() + i * 2)), blueZero);
+				__m128i dist = _mm_add_epi32(_mm_madd_epi16(dRedGreen, dRedGreen), _mm_madd_epi16(dBlue, dBlue));
+				__m128i isLess = _mm_cmplt_epi32(dist, best);
+				best = _mm_or_si128(_mm_and_si128(isLess, dist), _mm_andnot_si128(isLess, best));
+				bestIndices = _mm_or_si128(_mm_and_si128(isLess, indices), _mm_andnot_si128(isLess, bestIndices));
+				indices = _mm_add_epi32(indices, four);
+			}
+			alignas(16) uint32_t distances[4];
+			alignas(16) uint32_t laneIndices[4];
+			_mm_store_si128(reinterpret_cast<__m128i *>(distances), best);
+			_mm_store_si128(reinterpret_cast<__m128i *>(laneIndices), bestIndices);
+			for (int lane = 0; lane < 4; lane++) {
+				if (distances[lane] < bestDistance || (distances[lane] == bestDistance && laneIndices[lane] < bestIndex)) {
+					bestDistance = distances[lane];
+					bestIndex = laneIndices[lane];
+				}
+			}
+#else
+			for (uint32_t i = 0; i < paddedCount; i++) {
+				int dRed = m_RedGreen[i * 2] - red;
+				int dGreen = m_RedGreen[i * 2 + 1] - green;
+				int dBlue = m_Blue[i * 2] - blue;
+				uint32_t dist = static_cast<uint32_t>(dRed * dRed + dGreen * dGreen + dBlue * dBlue);
+				if (dist < bestDistance) {
+					bestDistance = dist;
+					bestIndex = i;
+				}
+			}
+#endif
+			distance = bestDistance;
+			return bestIndex;
+		}
+
+	private:
+		const uint32_t m_ColorCount;
+		//Red and green of each color as 16 bit pairs, and blue paired with 0, in the layout _mm_madd_epi16 sums the squares of.
+		vector<int16_t> m_RedGreen;
+		vector<int16_t> m_Blue;
+	};
+
+	/// <summary>
+	/// Returns the sum of the squared distances of the colors to their nearest palette color, weighted by their count. Stops counting once the sum exceeds maxError.
+	/// </summary>
+	uint64_t GetPaletteError(const ANIMATION_PALETTE &palette, const vector<COLOR_ENTRY> &entries, uint64_t maxError)
+	{
+		PaletteSearch search(palette);
+		uint64_t error = 0;
+		for (const COLOR_ENTRY &entry : entries) {
+			uint32_t distance;
+			search.FindNearest(entry.Color[0], entry.Color[1], entry.Color[2], distance);
+			error += static_cast<uint64_t>(distance) * entry.Count;
+			if (error > maxError) {
+				break;
+			}
+		}
+		return error;
+	}
+
+	/// <summary>
+	/// Builds a palette with the median cut algorithm. The box with the most pixels times color range is split at the median of its widest channel, until there are enough boxes.
+	/// </summary>
+	shared_ptr<ANIMATION_PALETTE> BuildPalette(vector<COLOR_ENTRY> entries, uint32_t maxColors)
+	{
+		struct BOX {
+			size_t Begin;
+			size_t End;
+			uint64_t Count;
+			int Channel;
+			int Range;
+		};
+		auto MeasureBox([&entries](size_t begin, size_t end) {
+			BOX box{ begin, end, 0, 0, 0 };
+			int minimum[3] = { 255, 255, 255 };
+			int maximum[3] = { 0, 0, 0 };
+			for (size_t i = begin; i < end; i++) {
+				box.Count += entries[i].Count;
+				for (int channel = 0; channel < 3; channel++) {
+					minimum[channel] = min<int>(minimum[channel], entries[i].Color[channel]);
+					maximum[channel] = max<int>(maximum[channel], entries[i].Color[channel]);
+				}
+			}
+			for (int channel = 0; channel < 3; channel++) {
+				if (maximum[channel] - minimum[channel] > box.Range) {
+					box.Range = maximum[channel] - minimum[channel];
+					box.Channel = channel;
+				}
+			}
+			return box;
+		});
+
+		vector<BOX> boxes;
+		boxes.reserve(maxColors);
+		if (!entries.empty()) {
+			boxes.push_back(MeasureBox(0, entries.size()));
+		}
+		while (boxes.size() < maxColors) {
+			size_t splitIndex = SIZE_MAX;
+			uint64_t bestScore = 0;
+			for (size_t i = 0; i < boxes.size(); i++) {
+				uint64_t score = boxes[i].Count * static_cast<uint64_t>(boxes[i].Range);
+				if (boxes[i].End - boxes[i].Begin > 1 && score > bestScore) {
+					bestScore = score;
+					splitIndex = i;
+				}
+			}
+			if (splitIndex == SIZE_MAX) {
+				break;
+			}
+			BOX box = boxes[splitIndex];
+			int channel = box.Channel;
+			sort(entries.begin() + box.Begin, entries.begin() + box.End, [channel](const COLOR_ENTRY &a, const COLOR_ENTRY &b) {
+				return a.Color[channel] < b.Color[channel];
+			});
+			//Split at the median pixel, keeping at least one color on each side.
+			size_t median = box.Begin + 1;
+			uint64_t count = entries[box.Begin].Count;
+			while (median < box.End - 1 && count + entries[median].Count <= box.Count / 2) {
+				count += entries[median].Count;
+				median++;
+			}
+			boxes[splitIndex] = MeasureBox(box.Begin, median);
+			boxes.push_back(MeasureBox(median, box.End));
+		}
+
+		auto pPalette = make_shared<ANIMATION_PALETTE>();
+		pPalette->Colors.reserve(boxes.size() * 3);
+		for (const BOX &box : boxes) {
+			uint64_t sums[3] = { 0, 0, 0 };
+			for (size_t i = box.Begin; i < box.End; i++) {
+				for (int channel = 0; channel < 3; channel++) {
+					sums[channel] += static_cast<uint64_t>(entries[i].Color[channel]) * entries[i].Count;
+				}
+			}
+			for (int channel = 0; channel < 3; channel++) {
+				pPalette->Colors.push_back(static_cast<uint8_t>((sums[channel] + box.Count / 2) / max<uint64_t>(box.Count, 1)));
+			}
+		}
+		if (pPalette->Colors.empty()) {
+			pPalette->Colors.assign(3, 0);
+		}
+		return pPalette;
+	}
+
+	/// <summary>
+	/// The number of bits per index of a GIF color table that holds the palette and a transparent color after it.
+	/// </summary>
+	int GetColorTableBits(const ANIMATION_PALETTE &palette)
+	{
+		int bits = 1;
+		while ((1u << bits) < palette.GetColorCount() + 1) {
+			bits++;
+		}
+		return bits;
+	}
+
+	void AppendColorTable(vector<uint8_t> &output, const ANIMATION_PALETTE &palette, int bits)
+	{
+		output.insert(output.end(), palette.Colors.begin(), palette.Colors.end());
+		output.insert(output.end(), ((size_t)1 << bits) * 3 - palette.Colors.size(), 0);
+	}
+
+	/// <summary>
+	/// Writes GIF LZW codes starting with the least significant bit, in sub-blocks of up to 255 bytes.
+	/// </summary>
+	class LzwBitWriter
+	{
+	public:
+		LzwBitWriter(vector<uint8_t> &output) : m_Output(output) {}
+
+		inline void Write(uint32_t code, int size)
+		{
+			m_Buffer |= code << m_Count;
+			m_Count += size;
+			while (m_Count >= 8) {
+				WriteByte(static_cast<uint8_t>(m_Buffer));
+				m_Buffer >>= 8;
+				m_Count -= 8;
+			}
+		}
+
+		void Finish()
+		{
+			if (m_Count > 0) {
+				WriteByte(static_cast<uint8_t>(m_Buffer));
+			}
+			if (m_BlockSize > 0) {
+				m_Output[m_BlockStart] = static_cast<uint8_t>(m_BlockSize);
+			}
+			m_Output.push_back(0);
+		}
+	private:
+		vector<uint8_t> &m_Output;
+		uint32_t m_Buffer = 0;
+		int m_Count = 0;
+		size_t m_BlockStart = 0;
+		uint32_t m_BlockSize = 0;
+
+		inline void WriteByte(uint8_t value)
+		{
+			if (m_BlockSize == 0) {
+				m_BlockStart = m_Output.size();
+				m_Output.push_back(0);
+			}
+			m_Output.push_back(value);
+			if (++m_BlockSize == 255) {
+				m_Output[m_BlockStart] = 255;
+				m_BlockSize = 0;
+			}
+		}
+	};
+
+	/// <summary>
+	/// Compresses color indices with GIF LZW. The dictionary is a hash table of prefix code and next index, and it is cleared when it is full.
+	/// </summary>
+	void EncodeLzw(const uint8_t *pIndices, size_t count, int minCodeSize, vector<uint8_t> &output)
+	{
+		const uint32_t clearCode = 1u << minCodeSize;
+		const uint32_t endCode = clearCode + 1;
+		const uint32_t hashSize = 1u << LZW_HASH_BITS;
+		//Keys are the prefix code and index plus one, so 0 marks a free slot.
+		vector<uint32_t> keys(hashSize, 0);
+		vector<uint16_t> codes(hashSize);
+
+		output.push_back(static_cast<uint8_t>(minCodeSize));
+		LzwBitWriter writer(output);
+		int codeSize = minCodeSize + 1;
+		uint32_t nextCode = endCode + 1;
+		writer.Write(clearCode, codeSize);
+		if (count == 0) {
+			writer.Write(endCode, codeSize);
+			writer.Finish();
+			return;
+		}
+		uint32_t prefix = pIndices[0];
+		for (size_t i = 1; i < count; i++) {
+			uint32_t index = pIndices[i];
+			uint32_t key = ((prefix << 8) | index) + 1;
+			uint32_t slot = (key * 2654435761u) >> (32 - LZW_HASH_BITS);
+			while (keys[slot] != 0 && keys[slot] != key) {
+				slot = (slot + 1) & (hashSize - 1);
+			}
+			if (keys[slot] == key) {
+				prefix = codes[slot];
+				continue;
+			}
+			writer.Write(prefix, codeSize);
+			if (nextCode == LZW_MAX_CODE) {
+				writer.Write(clearCode, codeSize);
+				fill(keys.begin(), keys.end(), 0);
+				codeSize = minCodeSize + 1;
+				nextCode = endCode + 1;
+			}
+			else {
+				keys[slot] = key;
+				codes[slot] = static_cast<uint16_t>(nextCode++);
+				//The decoder adds each code one step later, so the code size grows when the code after the next one no longer fits.
+				if (nextCode > (1u << codeSize) && codeSize < LZW_MAX_CODE_SIZE) {
+					codeSize++;
+				}
+			}
+			prefix = index;
+		}
+		writer.Write(prefix, codeSize);
+		writer.Write(endCode, codeSize);
+		writer.Finish();
+	}
+
+	bool EncodeGifFrame(const ANIMATION_FRAME &frame, vector<uint8_t> &output)
+	{
+		if (!frame.Palette) {
+			return false;
+		}
+		const ANIMATION_PALETTE &palette = *frame.Palette;
+		const int bits = GetColorTableBits(palette);
+		const uint32_t transparentIndex = palette.GetColorCount();
+		//The first frame has nothing to show through, and it may be shown without the later frames.
+		const bool hasTransparency = frame.Index > 0;
+
+		uint64_t delay = frame.EndMillis / 10 - frame.StartMillis / 10;
+		delay = min<uint64_t>(max<uint64_t>(delay, MIN_GIF_DELAY_CENTISECONDS), 0xFFFF);
+		//Graphic control extension. The frame is left in place when the next is drawn, so the transparent pixels of the next frame show it.
+		const uint8_t disposeNone = 1;
+		output.push_back(0x21);
+		output.push_back(0xF9);
+		output.push_back(4);
+		output.push_back(static_cast<uint8_t>((disposeNone << 2) | (hasTransparency ? 1 : 0)));
+		AppendLittleEndian16(output, static_cast<uint32_t>(delay));
+		output.push_back(static_cast<uint8_t>(hasTransparency ? transparentIndex : 0));
+		output.push_back(0);
+		//Image descriptor
+		output.push_back(0x2C);
+		AppendLittleEndian16(output, frame.X);
+		AppendLittleEndian16(output, frame.Y);
+		AppendLittleEndian16(output, frame.Width);
+		AppendLittleEndian16(output, frame.Height);
+		if (frame.IsGlobalPalette) {
+			output.push_back(0);
+		}
+		else {
+			output.push_back(static_cast<uint8_t>(0x80 | (bits - 1)));
+			AppendColorTable(output, palette, bits);
+		}
+
+		//Colors are mapped through a lookup table per histogram bin, which is filled with the nearest color of the first pixel seen in each bin, so only the colors in the frame are searched.
+		PaletteSearch search(palette);
+		vector<uint16_t> lookup(HISTOGRAM_SIZE, UINT16_MAX);
+		const size_t pixelCount = static_cast<size_t>(frame.Width) * frame.Height;
+		vector<uint8_t> indices(pixelCount);
+		for (size_t i = 0; i < pixelCount; i++) {
+			uint32_t pixel = Load32(frame.Pixels.data() + i * 4);
+			if (!(pixel & OPAQUE_ALPHA)) {
+				indices[i] = static_cast<uint8_t>(transparentIndex);
+				continue;
+			}
+			uint32_t bin = GetHistogramBin(pixel);
+			if (lookup[bin] == UINT16_MAX) {
+				uint32_t distance;
+				lookup[bin] = static_cast<uint16_t>(search.FindNearest((pixel >> 16) & 0xFF, (pixel >> 8) & 0xFF, pixel & 0xFF, distance));
+			}
+			indices[i] = static_cast<uint8_t>(lookup[bin]);
+		}
+		EncodeLzw(indices.data(), indices.size(), max(2, bits), output);
+		return true;
+	}
+
+	bool EncodeApngFrame(const ANIMATION_FRAME &frame, vector<uint8_t> &output)
+	{
+		//Every frame but the first has a frame control and a frame data chunk, which share one sequence of numbers.
+		const uint32_t controlSequence = frame.Index == 0 ? 0 : frame.Index * 2 - 1;
+		const uint32_t dataSequence = frame.Index * 2;
+		const uint8_t disposeNone = 0;
+		const uint8_t blendSource = 0;
+		const uint8_t blendOver = 1;
+		vector<uint8_t> control;
+		AppendBigEndian32(control, controlSequence);
+		AppendBigEndian32(control, frame.Width);
+		AppendBigEndian32(control, frame.Height);
+		AppendBigEndian32(control, frame.X);
+		AppendBigEndian32(control, frame.Y);
+		AppendBigEndian16(control, static_cast<uint32_t>(min<uint64_t>(frame.EndMillis - frame.StartMillis, AnimationEncoder::MAX_APNG_FRAME_MILLIS)));
+		AppendBigEndian16(control, 1000);
+		control.push_back(disposeNone);
+		//Unchanged pixels are transparent, and show the previous frame when blended over it.
+		control.push_back(frame.Index == 0 ? blendSource : blendOver);
+		WritePngChunk(output, "fcTL", control.data(), control.size());
+
+		//Rows of RGBA with the Up filter, like EncodeFastPng. Transparent pixels are all zero, so unchanged areas compress to almost nothing.
+		const size_t rowSize = static_cast<size_t>(frame.Width) * 4;
+		vector<uint8_t> filtered((rowSize + 1) * frame.Height);
+		vector<uint8_t> previousRow(rowSize, 0);
+		vector<uint8_t> currentRow(rowSize);
+		for (uint32_t y = 0; y < frame.Height; y++) {
+			const uint8_t *pSrc = frame.Pixels.data() + y * rowSize;
+			for (size_t x = 0; x < rowSize; x += 4) {
+				currentRow[x] = pSrc[x + 2];
+				currentRow[x + 1] = pSrc[x + 1];
+				currentRow[x + 2] = pSrc[x];
+				currentRow[x + 3] = pSrc[x + 3];
+			}
+			uint8_t *pDest = filtered.data() + y * (rowSize + 1);
+			*pDest++ = 2;
+			size_t x = 0;
+#ifdef ANIMATION_ENCODER_SSE2
+			for (; x + 16 <= rowSize; x += 16) {
+				__m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i *>(currentRow.data() + x));
+				__m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i *>(previousRow.data() + x));
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(pDest + x), _mm_sub_epi8(current, previous));
+			}
+#endif
+			for (; x < rowSize; x++) {
+				pDest[x] = static_cast<uint8_t>(currentRow[x] - previousRow[x]);
+			}
+			swap(previousRow, currentRow);
+		}
+		vector<uint8_t> data;
+		data.reserve(filtered.size() / 4 + 4);
+		if (frame.Index == 0) {
+			CompressZlibFast(filtered.data(), filtered.size(), data);
+			WritePngChunk(output, "IDAT", data.data(), data.size());
+		}
+		else {
+			AppendBigEndian32(data, dataSequence);
+			CompressZlibFast(filtered.data(), filtered.size(), data);
+			WritePngChunk(output, "fdAT", data.data(), data.size());
+		}
+		return true;
+	}
+}
+
+AnimationEncoder::AnimationEncoder(AnimationFormat format, uint32_t width, uint32_t height, bool isFrameDifferencingEnabled) :
+	m_Format(format),
+	m_Width(width),
+	m_Height(height),
+	m_IsFrameDifferencingEnabled(isFrameDifferencingEnabled),
+	m_PreviousFrame(static_cast<size_t>(width) * height * 4),
+	m_Histogram(format == AnimationFormat::Gif ? HISTOGRAM_SIZE * 4 : 0)
+{
+}
+
+bool AnimationEncoder::AddFrame(const IMAGE_BITMAP &bitmap, uint64_t timestampMillis, std::unique_ptr<ANIMATION_FRAME> &completedFrame)
+{
+	completedFrame.reset();
+	if (!bitmap.pData
+		|| bitmap.Width != m_Width
+		|| bitmap.Height != m_Height
+		|| bitmap.Stride < bitmap.Width * 4
+		|| bitmap.Layout != ImagePixelLayout::Bgra32) {
+		return false;
+	}
+	m_Stats.AddedFrames++;
+	const bool isFullFrame = !m_HasPreviousFrame || !m_IsFrameDifferencingEnabled;
+	uint32_t left = 0;
+	uint32_t top = 0;
+	uint32_t right = m_Width;
+	uint32_t bottom = m_Height;
+	if (!m_HasPreviousFrame) {
+		m_FirstTimestampMillis = timestampMillis;
+	}
+	else if (!FindChangedRect(bitmap, left, top, right, bottom)) {
+		//The pending frame is simply shown longer.
+		m_Stats.UnchangedFrames++;
+		return true;
+	}
+	if (isFullFrame) {
+		left = 0;
+		top = 0;
+		right = m_Width;
+		bottom = m_Height;
+	}
+
+	auto pFrame = make_unique<ANIMATION_FRAME>();
+	pFrame->Index = m_NextFrameIndex++;
+	pFrame->X = left;
+	pFrame->Y = top;
+	pFrame->Width = right - left;
+	pFrame->Height = bottom - top;
+	pFrame->StartMillis = max(timestampMillis, m_FirstTimestampMillis) - m_FirstTimestampMillis;
+	pFrame->Pixels.resize(static_cast<size_t>(pFrame->Width) * pFrame->Height * 4);
+	const size_t rowBytes = static_cast<size_t>(pFrame->Width) * 4;
+	for (uint32_t y = top; y < bottom; y++) {
+		const uint8_t *pSrc = bitmap.pData + static_cast<size_t>(y) * bitmap.Stride + left * 4;
+		uint8_t *pPrevious = m_PreviousFrame.data() + (static_cast<size_t>(y) * m_Width + left) * 4;
+		uint8_t *pDest = pFrame->Pixels.data() + (y - top) * rowBytes;
+		size_t x = 0;
+		if (isFullFrame) {
+			for (; x < rowBytes; x += 4) {
+				Store32(pDest + x, Load32(pSrc + x) | OPAQUE_ALPHA);
+			}
+		}
+		else {
+			//Pixels that are unchanged become transparent, the others opaque.
+#ifdef ANIMATION_ENCODER_SSE2
+			const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(OPAQUE_ALPHA));
+			for (; x + 16 <= rowBytes; x += 16) {
+				__m128i current = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc + x)), alphaMask);
+				__m128i previous = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pPrevious + x)), alphaMask);
+				__m128i isUnchanged = _mm_cmpeq_epi32(current, previous);
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(pDest + x), _mm_andnot_si128(isUnchanged, current));
+			}
+#endif
+			for (; x < rowBytes; x += 4) {
+				uint32_t current = Load32(pSrc + x) | OPAQUE_ALPHA;
+				uint32_t previous = Load32(pPrevious + x) | OPAQUE_ALPHA;
+				Store32(pDest + x, current == previous ? 0 : current);
+			}
+			for (uint32_t runStart = 0; runStart < pFrame->Width;) {
+				if (Load32(pDest + runStart * 4) != 0) {
+					runStart++;
+					continue;
+				}
+				uint32_t runEnd = runStart + 1;
+				while (runEnd < pFrame->Width && Load32(pDest + runEnd * 4) == 0) {
+					runEnd++;
+				}
+				if (runEnd - runStart < MIN_TRANSPARENT_RUN) {
+					for (uint32_t i = runStart; i < runEnd; i++) {
+						Store32(pDest + i * 4, Load32(pSrc + i * 4) | OPAQUE_ALPHA);
+					}
+				}
+				runStart = runEnd;
+			}
+		}
+		memcpy(pPrevious, pSrc, rowBytes);
+	}
+	m_HasPreviousFrame = true;
+	m_Stats.EncodedPixels += static_cast<uint64_t>(pFrame->Width) * pFrame->Height;
+	if (m_Format == AnimationFormat::Gif) {
+		SelectPalette(*pFrame);
+	}
+	CompleteFrame(pFrame->StartMillis, completedFrame);
+	m_PendingFrame = std::move(pFrame);
+	return true;
+}
+
+void AnimationEncoder::Finish(uint64_t endTimestampMillis, std::unique_ptr<ANIMATION_FRAME> &completedFrame)
+{
+	completedFrame.reset();
+	if (m_PendingFrame) {
+		CompleteFrame(max(endTimestampMillis, m_FirstTimestampMillis) - m_FirstTimestampMillis, completedFrame);
+	}
+}
+
+void AnimationEncoder::CompleteFrame(uint64_t endMillis, std::unique_ptr<ANIMATION_FRAME> &completedFrame)
+{
+	if (m_PendingFrame) {
+		m_PendingFrame->EndMillis = max(endMillis, m_PendingFrame->StartMillis);
+		completedFrame = std::move(m_PendingFrame);
+	}
+}
+
+bool AnimationEncoder::GetHeader(std::vector<uint8_t> &output) const
+{
+	if (m_NextFrameIndex == 0) {
+		return false;
+	}
+	if (m_Format == AnimationFormat::Gif) {
+		const char *signature = "GIF89a";
+		output.insert(output.end(), signature, signature + 6);
+		AppendLittleEndian16(output, m_Width);
+		AppendLittleEndian16(output, m_Height);
+		const int bits = GetColorTableBits(*m_GlobalPalette);
+		output.push_back(static_cast<uint8_t>(0x80 | (7 << 4) | (bits - 1)));
+		output.push_back(0);//Background color
+		output.push_back(0);//Pixel aspect ratio
+		AppendColorTable(output, *m_GlobalPalette, bits);
+		//Netscape application extension, to loop the animation forever.
+		const uint8_t loop[] = { 0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00 };
+		output.insert(output.end(), loop, loop + sizeof(loop));
+	}
+	else {
+		const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		output.insert(output.end(), signature, signature + sizeof(signature));
+		vector<uint8_t> header;
+		AppendBigEndian32(header, m_Width);
+		AppendBigEndian32(header, m_Height);
+		header.push_back(8);//Bit depth
+		header.push_back(6);//Truecolor with alpha
+		header.push_back(0);//Deflate
+		header.push_back(0);//Adaptive filtering
+		header.push_back(0);//Not interlaced
+		WritePngChunk(output, "IHDR", header.data(), header.size());
+		GetFrameCountChunk(0, output);
+	}
+	return true;
+}
+
+void AnimationEncoder::GetTrailer(std::vector<uint8_t> &output) const
+{
+	if (m_Format == AnimationFormat::Gif) {
+		output.push_back(0x3B);
+	}
+	else {
+		WritePngChunk(output, "IEND", nullptr, 0);
+	}
+}
+
+void AnimationEncoder::GetFrameCountChunk(uint32_t frameCount, std::vector<uint8_t> &output) const
+{
+	vector<uint8_t> control;
+	AppendBigEndian32(control, frameCount);
+	AppendBigEndian32(control, 0);//Loop forever
+	WritePngChunk(output, "acTL", control.data(), control.size());
+}
+
+uint64_t AnimationEncoder::GetFrameCountChunkOffset()
+{
+	//After the signature and the header chunk.
+	return 8 + 12 + 13;
+}
+
+bool AnimationEncoder::EncodeFrame(AnimationFormat format, const ANIMATION_FRAME &frame, std::vector<uint8_t> &output)
+{
+	if (frame.Width == 0
+		|| frame.Height == 0
+		|| frame.Pixels.size() < static_cast<size_t>(frame.Width) * frame.Height * 4) {
+		return false;
+	}
+	if (format == AnimationFormat::Gif) {
+		return EncodeGifFrame(frame, output);
+	}
+	return EncodeApngFrame(frame, output);
+}
+
+bool AnimationEncoder::FindChangedRect(const IMAGE_BITMAP &bitmap, uint32_t &left, uint32_t &top, uint32_t &right, uint32_t &bottom) const
+{
+	left = m_Width;
+	top = m_Height;
+	right = 0;
+	bottom = 0;
+	for (uint32_t y = 0; y < m_Height; y++) {
+		const uint8_t *pCurrent = bitmap.pData + static_cast<size_t>(y) * bitmap.Stride;
+		const uint8_t *pPrevious = m_PreviousFrame.data() + static_cast<size_t>(y) * m_Width * 4;
+		//Find the first changed pixel of the row.
+		uint32_t x = 0;
+#ifdef ANIMATION_ENCODER_SSE2
+		const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(OPAQUE_ALPHA));
+		for (; x + 4 <= m_Width; x += 4) {
+			__m128i current = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pCurrent + x * 4)), alphaMask);
+			__m128i previous = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pPrevious + x * 4)), alphaMask);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(current, previous)) != 0xFFFF) {
+				break;
+			}
+		}
+#endif
+		while (x < m_Width && ((Load32(pCurrent + x * 4) ^ Load32(pPrevious + x * 4)) & ~OPAQUE_ALPHA) == 0) {
+			x++;
+		}
+		if (x == m_Width) {
+			continue;
+		}
+		//Find the last changed pixel of the row, which is at least the first one.
+		uint32_t lastX = m_Width - 1;
+		while (lastX > x && ((Load32(pCurrent + lastX * 4) ^ Load32(pPrevious + lastX * 4)) & ~OPAQUE_ALPHA) == 0) {
+			lastX--;
+		}
+		left = min(left, x);
+		right = max(right, lastX + 1);
+		top = min(top, y);
+		bottom = y + 1;
+	}
+	return bottom > 0;
+}
+
+void AnimationEncoder::SelectPalette(ANIMATION_FRAME &frame)
+{
+	fill(m_Histogram.begin(), m_Histogram.end(), 0);
+	HISTOGRAM_BIN *pHistogram = reinterpret_cast<HISTOGRAM_BIN *>(m_Histogram.data());
+	AddToHistogram(frame.Pixels.data(), static_cast<size_t>(frame.Width) * frame.Height, pHistogram);
+	vector<COLOR_ENTRY> entries;
+	uint64_t pixelCount = 0;
+	for (uint32_t i = 0; i < HISTOGRAM_SIZE; i++) {
+		const HISTOGRAM_BIN &bin = pHistogram[i];
+		if (bin.Count > 0) {
+			uint32_t half = bin.Count / 2;
+			entries.push_back(COLOR_ENTRY{ {
+					static_cast<uint8_t>((bin.Red + half) / bin.Count),
+					static_cast<uint8_t>((bin.Green + half) / bin.Count),
+					static_cast<uint8_t>((bin.Blue + half) / bin.Count) },
+				bin.Count });
+			pixelCount += bin.Count;
+		}
+	}
+	shared_ptr<const ANIMATION_PALETTE> pNewPalette = BuildPalette(entries, MAX_PALETTE_COLORS);
+	shared_ptr<const ANIMATION_PALETTE> pPalette = pNewPalette;
+	if (m_IsFrameDifferencingEnabled && (m_LastPalette || m_GlobalPalette)) {
+		//Reusing a palette keeps colors stable between frames, and the global palette also saves the local color table.
+		uint64_t newError = GetPaletteError(*pNewPalette, entries, UINT64_MAX);
+		uint64_t maxError = newError + newError / PALETTE_REUSE_MARGIN_DIVISOR + pixelCount * PALETTE_REUSE_MARGIN_PER_PIXEL;
+		for (const shared_ptr<const ANIMATION_PALETTE> &pCandidate : { m_GlobalPalette, m_LastPalette }) {
+			if (pCandidate && GetPaletteError(*pCandidate, entries, maxError) <= maxError) {
+				pPalette = pCandidate;
+				break;
+			}
+		}
+	}
+	if (pPalette == pNewPalette) {
+		m_Stats.NewPalettes++;
+	}
+	else {
+		m_Stats.ReusedPalettes++;
+	}
+	if (!m_GlobalPalette) {
+		m_GlobalPalette = pPalette;
+	}
+	m_LastPalette = pPalette;
+	frame.Palette = pPalette;
+	frame.IsGlobalPalette = pPalette == m_GlobalPalette;
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "ImageEncoder.h"
+
+//Encodes animated GIF and APNG files from a sequence of captured frames. Like ImageEncoder.h, it doesn't depend on any platform API.
+//Only the area of a frame that changed since the previous frame is encoded, with the unchanged pixels in it made transparent.
+//Frames without any changes are not encoded at all, they extend the delay of the previous frame instead.
+
+enum class AnimationFormat {
+	/// <summary>Animated GIF, with up to 255 colors per frame.</summary>
+	Gif,
+	/// <summary>Lossless animated PNG.</summary>
+	Apng
+};
+
+/// <summary>
+/// A GIF color table.
+/// </summary>
+struct ANIMATION_PALETTE {
+	/// <summary>Up to MAX_PALETTE_COLORS colors in red, green, blue byte order.</summary>
+	std::vector<uint8_t> Colors;
+
+	uint32_t GetColorCount() const { return static_cast<uint32_t>(Colors.size() / 3); }
+};
+
+/// <summary>
+/// A frame that is ready to be encoded with AnimationEncoder::EncodeFrame. It holds a copy of its changed area, so it can be encoded on any thread.
+/// </summary>
+struct ANIMATION_FRAME {
+	/// <summary>The number of the frame in the animation, starting at 0.</summary>
+	uint32_t Index = 0;
+	/// <summary>The position of the changed area within the animation.</summary>
+	uint32_t X = 0;
+	uint32_t Y = 0;
+	/// <summary>The size of the changed area.</summary>
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	/// <summary>The changed area in Bgra32 layout, Width * 4 bytes per row. Pixels with alpha 0 have not changed since the previous frame, and are encoded as transparent.</summary>
+	std::vector<uint8_t> Pixels;
+	/// <summary>The time the frame is shown, from the start of the animation.</summary>
+	uint64_t StartMillis = 0;
+	uint64_t EndMillis = 0;
+	/// <summary>GIF only. The colors the frame is mapped to.</summary>
+	std::shared_ptr<const ANIMATION_PALETTE> Palette;
+	/// <summary>GIF only. True if the palette is the global color table of the file, so the frame doesn't need a local color table.</summary>
+	bool IsGlobalPalette = false;
+};
+
+struct ANIMATION_ENCODER_STATS {
+	/// <summary>Frames given to AddFrame.</summary>
+	uint64_t AddedFrames = 0;
+	/// <summary>Frames that were identical to the previous frame, and extended its delay instead of being encoded.</summary>
+	uint64_t UnchangedFrames = 0;
+	/// <summary>The number of pixels in the changed areas of all frames.</summary>
+	uint64_t EncodedPixels = 0;
+	/// <summary>GIF only. Frames that were mapped to the palette of an earlier frame.</summary>
+	uint64_t ReusedPalettes = 0;
+	/// <summary>GIF only. Frames that needed a new palette.</summary>
+	uint64_t NewPalettes = 0;
+};
+
+/// <summary>
+/// Turns captured frames into animation frames, and encodes them.
+/// AddFrame compares each frame to the previous one and picks its palette, which is fast and must be done in frame order. EncodeFrame does the expensive color mapping and compression, and can run on several threads at once.
+/// The encoded frames must be written in frame order, after GetHeader and followed by GetTrailer.
+/// </summary>
+class AnimationEncoder
+{
+public:
+	static const uint32_t MAX_PALETTE_COLORS = 255;
+	//A GIF frame can be shown for at most 655.35 seconds, and an APNG frame for 65.535 seconds.
+	static const uint64_t MAX_GIF_FRAME_MILLIS = 655350;
+	static const uint64_t MAX_APNG_FRAME_MILLIS = 65535;
+
+	/// <param name="width">The width of the animation. All frames must have this size.</param>
+	/// <param name="height">The height of the animation.</param>
+	/// <param name="isFrameDifferencingEnabled">If false, every frame is encoded in full with a new palette. Only useful to measure what frame differencing saves.</param>
+	AnimationEncoder(AnimationFormat format, uint32_t width, uint32_t height, bool isFrameDifferencingEnabled = true);
+	/// <summary>
+	/// Adds the next frame. The previous frame is completed and returned when this frame has changes, as that ends its delay.
+	/// </summary>
+	/// <param name="timestampMillis">The time the frame was captured. Must not be less than the timestamp of the previous frame.</param>
+	/// <param name="completedFrame">Receives the previous frame if it was completed, else it is reset.</param>
+	/// <returns>false if the bitmap doesn't match the size of the animation.</returns>
+	bool AddFrame(const IMAGE_BITMAP &bitmap, uint64_t timestampMillis, std::unique_ptr<ANIMATION_FRAME> &completedFrame);
+	/// <summary>
+	/// Completes the last frame.
+	/// </summary>
+	/// <param name="endTimestampMillis">The time the last frame stops showing.</param>
+	/// <param name="completedFrame">Receives the last frame, or is reset if no frames were added.</param>
+	void Finish(uint64_t endTimestampMillis, std::unique_ptr<ANIMATION_FRAME> &completedFrame);
+	/// <summary>
+	/// Appends the file header, which must be written before the first frame. Can be called once the first frame is added.
+	/// The APNG header holds the frame count, which is 0 until it is rewritten with GetFrameCountChunk.
+	/// </summary>
+	/// <returns>false if no frame has been added yet.</returns>
+	bool GetHeader(std::vector<uint8_t> &output) const;
+	/// <summary>
+	/// Appends the end of the file, which must be written after the last frame.
+	/// </summary>
+	void GetTrailer(std::vector<uint8_t> &output) const;
+	/// <summary>
+	/// APNG only. Appends the animation control chunk with the final frame count. It has the same size as the one in the header, and replaces it at GetFrameCountChunkOffset.
+	/// </summary>
+	void GetFrameCountChunk(uint32_t frameCount, std::vector<uint8_t> &output) const;
+	/// <summary>
+	/// APNG only. The position of the animation control chunk in the file.
+	/// </summary>
+	static uint64_t GetFrameCountChunkOffset();
+	/// <summary>
+	/// Maps the frame to its palette and compresses it. Does not depend on the state of any encoder, so frames can be encoded on any thread in any order.
+	/// </summary>
+	/// <param name="output">The encoded frame is appended to this.</param>
+	static bool EncodeFrame(AnimationFormat format, const ANIMATION_FRAME &frame, std::vector<uint8_t> &output);
+	ANIMATION_ENCODER_STATS GetStats() const { return m_Stats; }
+private:
+	const AnimationFormat m_Format;
+	const uint32_t m_Width;
+	const uint32_t m_Height;
+	const bool m_IsFrameDifferencingEnabled;
+	//The last added frame, in Bgra32 layout, that new frames are compared to.
+	std::vector<uint8_t> m_PreviousFrame;
+	bool m_HasPreviousFrame = false;
+	//The frame that was added last, waiting for the next frame with changes to know its delay.
+	std::unique_ptr<ANIMATION_FRAME> m_PendingFrame;
+	uint32_t m_NextFrameIndex = 0;
+	uint64_t m_FirstTimestampMillis = 0;
+	std::shared_ptr<const ANIMATION_PALETTE> m_GlobalPalette;
+	std::shared_ptr<const ANIMATION_PALETTE> m_LastPalette;
+	//GIF only. The count and color sums of each 15 bit color, 4 values per color.
+	std::vector<uint32_t> m_Histogram;
+	ANIMATION_ENCODER_STATS m_Stats{};
+
+	/// <summary>
+	/// Finds the smallest rectangle that holds all changed pixels. Returns false if nothing changed.
+	/// </summary>
+	bool FindChangedRect(const IMAGE_BITMAP &bitmap, uint32_t &left, uint32_t &top, uint32_t &right, uint32_t &bottom) const;
+	/// <summary>
+	/// Picks the palette of the frame, reusing the last or the global palette when they fit the changed pixels well enough.
+	/// </summary>
+	void SelectPalette(ANIMATION_FRAME &frame);
+	void CompleteFrame(uint64_t endMillis, std::unique_ptr<ANIMATION_FRAME> &completedFrame);
+};
@@ -0,0 +1,413 @@
+#include "AnimationWriter.h"
+#include "TextureReadback.h"
+#include "Cleanup.h"
+#include <algorithm>
+#include <atlbase.h>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct AnimationWriter::Impl {
+	struct STAGING_TEXTURE {
+		CComPtr<ID3D11Texture2D> Texture;
+		D3D11_TEXTURE2D_DESC Desc{};
+		bool IsInUse = false;
+	};
+	struct PENDING_FRAME {
+		UINT64 Timestamp;
+		int StagingIndex;
+	};
+	struct ENCODED_FRAME {
+		vector<uint8_t> Data;
+		HRESULT Result;
+	};
+
+	Impl(UINT threadCount, UINT maxQueuedFrames) :
+		m_ThreadCount(threadCount > 0 ? threadCount : clamp<UINT>(thread::hardware_concurrency() / 2, 1, MAX_DEFAULT_THREAD_COUNT)),
+		m_MaxQueuedFrames(maxQueuedFrames > 0 ? maxQueuedFrames : m_ThreadCount * 2),
+		m_WorkerPool(make_unique<ReadbackWorkerPool>(m_ThreadCount))
+	{
+	}
+
+	~Impl()
+	{
+		//Encodes that are already submitted to the pool reference this instance.
+		unique_lock<mutex> lock(m_Mutex);
+		m_FrameEncodedCondition.wait(lock, [this]() { return m_EncodingCount == 0; });
+	}
+
+	HRESULT Initialize(ID3D11DeviceContext *pDeviceContext, ID3D11Device *pDevice)
+	{
+		if (!m_PendingFrames.empty()) {
+			//Staging textures from a previous device can't be mapped on the new one.
+			LOG_WARN(L"Discarding %zu animation frames that were not read back before the device was reinitialized", m_PendingFrames.size());
+			m_PendingFrames.clear();
+		}
+		m_StagingTextures.clear();
+		m_StagingTextures.resize(DEFAULT_RING_SIZE);
+		m_DeviceContext = pDeviceContext;
+		m_Device = pDevice;
+		LOG_DEBUG(L"Animation writer initialized with %u encoder threads and %u queued frames", m_ThreadCount, m_MaxQueuedFrames);
+		return S_OK;
+	}
+
+	HRESULT Begin(IStream *pStream, AnimationFormat format)
+	{
+		if (!pStream) {
+			return E_INVALIDARG;
+		}
+		unique_lock<mutex> lock(m_Mutex);
+		m_FrameEncodedCondition.wait(lock, [this]() { return m_EncodingCount == 0; });
+		m_Stream = pStream;
+		m_Format = format;
+		m_Encoder.reset();
+		m_IsHeaderWritten = false;
+		m_NextSequence = 0;
+		m_NextPublishSequence = 0;
+		m_Result = S_OK;
+		m_Stats = ANIMATION_WRITER_STATS{};
+		return S_OK;
+	}
+
+	HRESULT WriteFrame(UINT64 timestampMillis, ID3D11Texture2D *pTexture)
+	{
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			if (FAILED(m_Result)) {
+				return m_Result;
+			}
+		}
+		if (!pTexture || !m_Device || !m_Stream) {
+			return E_INVALIDARG;
+		}
+		int stagingIndex = GetFreeStagingIndex();
+		while (stagingIndex < 0 && !m_PendingFrames.empty()) {
+			//All staging textures are still in use, so wait for the oldest copy to finish.
+			{
+				lock_guard<mutex> lock(m_Mutex);
+				m_Stats.BlockingWaits++;
+			}
+			RETURN_ON_BAD_HR(ReadNextPendingFrame(true));
+			stagingIndex = GetFreeStagingIndex();
+		}
+		RETURN_ON_BAD_HR(CopyToStagingTexture(pTexture, m_StagingTextures[stagingIndex]));
+		m_StagingTextures[stagingIndex].IsInUse = true;
+		m_PendingFrames.push_back(PENDING_FRAME{ timestampMillis, stagingIndex });
+		return ReadPendingFrames(false);
+	}
+
+	HRESULT Finish(UINT64 endTimestampMillis)
+	{
+		HRESULT hr = ReadPendingFrames(true);
+		if (SUCCEEDED(hr) && m_Encoder) {
+			unique_ptr<ANIMATION_FRAME> pLastFrame;
+			m_Encoder->Finish(endTimestampMillis, pLastFrame);
+			if (pLastFrame) {
+				hr = SubmitFrame(std::move(pLastFrame));
+			}
+		}
+		{
+			unique_lock<mutex> lock(m_Mutex);
+			m_FrameEncodedCondition.wait(lock, [this]() { return m_EncodingCount == 0; });
+			if (FAILED(m_Result)) {
+				hr = m_Result;
+			}
+		}
+		CComPtr<IStream> pStream = m_Stream;
+		m_Stream.Release();
+		RETURN_ON_BAD_HR(hr);
+		if (!m_Encoder || !pStream) {
+			LOG_ERROR(L"No frames were written to the animation");
+			return E_NOT_VALID_STATE;
+		}
+		vector<uint8_t> trailer;
+		m_Encoder->GetTrailer(trailer);
+		RETURN_ON_BAD_HR(WriteToStream(pStream, trailer));
+		if (m_Format == AnimationFormat::Apng) {
+			//The frame count in the header is only known now.
+			vector<uint8_t> frameCountChunk;
+			m_Encoder->GetFrameCountChunk(static_cast<uint32_t>(m_Stats.WrittenFrames), frameCountChunk);
+			LARGE_INTEGER offset{};
+			offset.QuadPart = static_cast<LONGLONG>(AnimationEncoder::GetFrameCountChunkOffset());
+			hr = pStream->Seek(offset, STREAM_SEEK_SET, nullptr);
+			if (FAILED(hr)) {
+				LOG_ERROR(L"Failed to write the APNG frame count, the output stream is not seekable: hr = 0x%08x", hr);
+				return hr;
+			}
+			RETURN_ON_BAD_HR(WriteToStream(pStream, frameCountChunk));
+			offset.QuadPart = 0;
+			RETURN_ON_BAD_HR(pStream->Seek(offset, STREAM_SEEK_END, nullptr));
+		}
+		hr = pStream->Commit(STGC_DEFAULT);
+		if (FAILED(hr) && hr != E_NOTIMPL) {
+			LOG_ERROR(L"Failed to commit animation stream: hr = 0x%08x", hr);
+			return hr;
+		}
+		return S_OK;
+	}
+
+	ANIMATION_WRITER_STATS GetStats()
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		return m_Stats;
+	}
+
+private:
+	const UINT m_ThreadCount;
+	const UINT m_MaxQueuedFrames;
+	CComPtr<ID3D11DeviceContext> m_DeviceContext;
+	CComPtr<ID3D11Device> m_Device;
+	AnimationFormat m_Format = AnimationFormat::Gif;
+	vector<STAGING_TEXTURE> m_StagingTextures;
+	//Frames copied to a staging texture but not yet mapped, in frame order.
+	deque<PENDING_FRAME> m_PendingFrames;
+	//Created with the size of the first frame. Only used on the recording thread.
+	unique_ptr<AnimationEncoder> m_Encoder;
+	//Holds frames in R8G8B8A8 format converted to Bgra32 for the encoder.
+	vector<uint8_t> m_ConvertedFrame;
+	bool m_IsHeaderWritten = false;
+	//Sequence number of the next frame handed to the encoders.
+	UINT64 m_NextSequence = 0;
+
+	//Guards everything below, which is shared with the worker pool.
+	mutex m_Mutex;
+	condition_variable m_FrameEncodedCondition;
+	UINT m_EncodingCount = 0;
+	CComPtr<IStream> m_Stream;
+	//Frames that finished encoding before an earlier frame, keyed by sequence number.
+	map<UINT64, ENCODED_FRAME> m_EncodedFrames;
+	UINT64 m_NextPublishSequence = 0;
+	HRESULT m_Result = S_OK;
+	ANIMATION_WRITER_STATS m_Stats{};
+
+	//Declared last, so the pool is stopped before the members its work uses are destroyed.
+	unique_ptr<ReadbackWorkerPool> m_WorkerPool;
+
+	static HRESULT WriteToStream(IStream *pStream, const vector<uint8_t> &data)
+	{
+		ULONG written = 0;
+		RETURN_ON_BAD_HR(pStream->Write(data.data(), static_cast<ULONG>(data.size()), &written));
+		return written == data.size() ? S_OK : STG_E_MEDIUMFULL;
+	}
+
+	int GetFreeStagingIndex()
+	{
+		for (size_t i = 0; i < m_StagingTextures.size(); i++) {
+			if (!m_StagingTextures[i].IsInUse) {
+				return static_cast<int>(i);
+			}
+		}
+		return -1;
+	}
+
+	HRESULT CopyToStagingTexture(ID3D11Texture2D *pTexture, STAGING_TEXTURE &staging)
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		pTexture->GetDesc(&desc);
+		if (!staging.Texture
+			|| staging.Desc.Width != desc.Width
+			|| staging.Desc.Height != desc.Height
+			|| staging.Desc.Format != desc.Format) {
+			staging.Texture.Release();
+			desc.Usage = D3D11_USAGE_STAGING;
+			desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+			desc.MiscFlags = 0;
+			desc.BindFlags = 0;
+			RETURN_ON_BAD_HR(m_Device->CreateTexture2D(&desc, nullptr, &staging.Texture));
+			staging.Desc = desc;
+		}
+		m_DeviceContext->CopyResource(staging.Texture, pTexture);
+		//Submit the copy now, so it is likely finished by the time the frame is mapped.
+		m_DeviceContext->Flush();
+		return S_OK;
+	}
+
+	HRESULT ReadPendingFrames(bool wait)
+	{
+		while (!m_PendingFrames.empty()) {
+			HRESULT hr = ReadNextPendingFrame(wait);
+			if (hr == DXGI_ERROR_WAS_STILL_DRAWING) {
+				return S_OK;
+			}
+			RETURN_ON_BAD_HR(hr);
+		}
+		return S_OK;
+	}
+
+	/// <summary>
+	/// Maps the oldest pending frame and adds it to the encoder, which copies the area that changed since the previous frame. Submits the previous frame to the encoders if this frame completed it.
+	/// </summary>
+	/// <returns>DXGI_ERROR_WAS_STILL_DRAWING if wait is false and the GPU has not finished copying the frame.</returns>
+	HRESULT ReadNextPendingFrame(bool wait)
+	{
+		PENDING_FRAME pending = m_PendingFrames.front();
+		STAGING_TEXTURE &staging = m_StagingTextures[pending.StagingIndex];
+		D3D11_MAPPED_SUBRESOURCE map;
+		HRESULT hr = m_DeviceContext->Map(staging.Texture, 0, D3D11_MAP_READ, wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, &map);
+		if (hr == DXGI_ERROR_WAS_STILL_DRAWING && !wait) {
+			return hr;
+		}
+		staging.IsInUse = false;
+		m_PendingFrames.pop_front();
+		if (FAILED(hr)) {
+			LOG_ERROR(L"Failed to map animation staging texture: hr = 0x%08x", hr);
+			return hr;
+		}
+		ExecuteFuncOnExit unmapOnExit([&]() { m_DeviceContext->Unmap(staging.Texture, 0); });
+
+		const UINT width = staging.Desc.Width;
+		const UINT height = staging.Desc.Height;
+		IMAGE_BITMAP bitmap;
+		bitmap.pData = static_cast<const uint8_t *>(map.pData);
+		bitmap.Width = width;
+		bitmap.Height = height;
+		bitmap.Stride = map.RowPitch;
+		bitmap.Layout = ImagePixelLayout::Bgra32;
+		switch (staging.Desc.Format) {
+			case DXGI_FORMAT_B8G8R8A8_UNORM:
+			case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+			case DXGI_FORMAT_B8G8R8X8_UNORM:
+			case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+				break;
+			case DXGI_FORMAT_R8G8B8A8_UNORM:
+			case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+				m_ConvertedFrame.resize(static_cast<size_t>(width) * height * 4);
+				for (UINT y = 0; y < height; y++) {
+					const uint8_t *pSrc = bitmap.pData + static_cast<size_t>(y) * map.RowPitch;
+					uint8_t *pDest = m_ConvertedFrame.data() + static_cast<size_t>(y) * width * 4;
+					for (UINT x = 0; x < width * 4; x += 4) {
+						pDest[x] = pSrc[x + 2];
+						pDest[x + 1] = pSrc[x + 1];
+						pDest[x + 2] = pSrc[x];
+						pDest[x + 3] = pSrc[x + 3];
+					}
+				}
+				bitmap.pData = m_ConvertedFrame.data();
+				bitmap.Stride = width * 4;
+				break;
+			default:
+				LOG_ERROR(L"Animations do not support the pixel format %d", staging.Desc.Format);
+				return WINCODEC_ERR_UNSUPPORTEDPIXELFORMAT;
+		}
+		if (!m_Encoder) {
+			m_Encoder = make_unique<AnimationEncoder>(m_Format, width, height);
+		}
+		unique_ptr<ANIMATION_FRAME> pCompletedFrame;
+		if (!m_Encoder->AddFrame(bitmap, pending.Timestamp, pCompletedFrame)) {
+			LOG_ERROR(L"Animation frame size %ux%u does not match the size of the first frame", width, height);
+			return E_INVALIDARG;
+		}
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			ANIMATION_ENCODER_STATS encoderStats = m_Encoder->GetStats();
+			m_Stats.UnchangedFrames = encoderStats.UnchangedFrames;
+			m_Stats.ReusedPalettes = encoderStats.ReusedPalettes;
+			m_Stats.NewPalettes = encoderStats.NewPalettes;
+		}
+		if (!m_IsHeaderWritten) {
+			//Nothing is being encoded yet, so the header is written before any frame.
+			vector<uint8_t> header;
+			m_Encoder->GetHeader(header);
+			RETURN_ON_BAD_HR(WriteToStream(m_Stream, header));
+			m_IsHeaderWritten = true;
+		}
+		if (pCompletedFrame) {
+			return SubmitFrame(std::move(pCompletedFrame));
+		}
+		return S_OK;
+	}
+
+	/// <summary>
+	/// Submits a completed frame to the encoders. Waits for a free encoder slot if the queue is full.
+	/// </summary>
+	HRESULT SubmitFrame(unique_ptr<ANIMATION_FRAME> pFrame)
+	{
+		{
+			unique_lock<mutex> lock(m_Mutex);
+			if (m_EncodingCount >= m_MaxQueuedFrames) {
+				//The encoders can't keep up. Wait rather than drop the frame, as the frames after it only hold what changed since it.
+				m_Stats.BlockingWaits++;
+				m_FrameEncodedCondition.wait(lock, [this]() { return m_EncodingCount < m_MaxQueuedFrames; });
+			}
+			m_EncodingCount++;
+		}
+		UINT64 sequence = m_NextSequence++;
+		AnimationFormat format = m_Format;
+		shared_ptr<const ANIMATION_FRAME> pSharedFrame = std::move(pFrame);
+		m_WorkerPool->Submit([this, sequence, format, pSharedFrame]() {
+			vector<uint8_t> data;
+			HRESULT hr = AnimationEncoder::EncodeFrame(format, *pSharedFrame, data) ? S_OK : E_FAIL;
+			OnFrameEncoded(sequence, ENCODED_FRAME{ std::move(data), hr });
+		});
+		return S_OK;
+	}
+
+	/// <summary>
+	/// Runs on the worker pool. Writes the frame, and any later frames that were waiting for it, to the stream in frame order.
+	/// </summary>
+	void OnFrameEncoded(UINT64 sequence, ENCODED_FRAME &&frame)
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		m_EncodedFrames.insert(make_pair(sequence, std::move(frame)));
+		for (auto next = m_EncodedFrames.find(m_NextPublishSequence); next != m_EncodedFrames.end(); next = m_EncodedFrames.find(++m_NextPublishSequence)) {
+			ENCODED_FRAME &encoded = next->second;
+			HRESULT hr = encoded.Result;
+			if (SUCCEEDED(hr) && SUCCEEDED(m_Result)) {
+				hr = WriteToStream(m_Stream, encoded.Data);
+			}
+			if (SUCCEEDED(hr)) {
+				m_Stats.WrittenFrames++;
+			}
+			else {
+				LOG_ERROR(L"Writing of animation frame %llu failed: hr = 0x%08x", m_NextPublishSequence, hr);
+			}
+			if (FAILED(hr) && SUCCEEDED(m_Result)) {
+				//The frames after a missing frame would be drawn over the wrong content, so nothing more is written.
+				m_Result = hr;
+			}
+			m_EncodedFrames.erase(next);
+		}
+		m_EncodingCount--;
+		m_FrameEncodedCondition.notify_all();
+	}
+};
+
+AnimationWriter::AnimationWriter(_In_ UINT threadCount, _In_ UINT maxQueuedFrames) :
+	m_Impl(make_unique<Impl>(threadCount, maxQueuedFrames))
+{
+}
+
+AnimationWriter::~AnimationWriter()
+{
+}
+
+HRESULT AnimationWriter::Initialize(_In_ ID3D11DeviceContext *pDeviceContext, _In_ ID3D11Device *pDevice)
+{
+	return m_Impl->Initialize(pDeviceContext, pDevice);
+}
+
+HRESULT AnimationWriter::Begin(_In_ IStream *pStream, _In_ AnimationFormat format)
+{
+	return m_Impl->Begin(pStream, format);
+}
+
+HRESULT AnimationWriter::WriteFrame(_In_ UINT64 timestampMillis, _In_ ID3D11Texture2D *pTexture)
+{
+	return m_Impl->WriteFrame(timestampMillis, pTexture);
+}
+
+HRESULT AnimationWriter::Finish(_In_ UINT64 endTimestampMillis)
+{
+	return m_Impl->Finish(endTimestampMillis);
+}
+
+ANIMATION_WRITER_STATS AnimationWriter::GetStats()
+{
+	return m_Impl->GetStats();
+}
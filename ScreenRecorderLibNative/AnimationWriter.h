@@ -0,0 +1,67 @@
+#pragma once
+#include <d3d11.h>
+#include <objidl.h>
+#include <memory>
+#include "CommonTypes.h"
+#include "AnimationEncoder.h"
+
+struct ANIMATION_WRITER_STATS {
+	/// <summary>Frames encoded and written to the output.</summary>
+	UINT64 WrittenFrames = 0;
+	/// <summary>Frames that were identical to the previous frame, and extended its delay instead of being written.</summary>
+	UINT64 UnchangedFrames = 0;
+	/// <summary>Times the caller had to wait, either for the GPU to finish a copy or for an encoder thread to become free.</summary>
+	UINT64 BlockingWaits = 0;
+	/// <summary>GIF only. Frames that reused the palette of an earlier frame.</summary>
+	UINT64 ReusedPalettes = 0;
+	/// <summary>GIF only. Frames that needed a new palette.</summary>
+	UINT64 NewPalettes = 0;
+};
+
+/// <summary>
+/// Writes frames to an animated GIF or APNG without encoding them on the recording thread.
+/// Each texture is copied to a ring of staging textures, like in SlideshowWriter. Once the GPU has finished the copy, the frame is compared to the previous one on the recording thread,
+/// and its changed area is encoded in parallel on a pool of worker threads. The encoded frames are written to the output stream in frame order.
+/// Frames are never dropped. If all encoder threads are busy and the queue is full, WriteFrame waits.
+/// All methods except GetStats must be called from one thread at a time.
+/// </summary>
+class AnimationWriter
+{
+public:
+	static const UINT DEFAULT_RING_SIZE = 3;
+	static const UINT MAX_DEFAULT_THREAD_COUNT = 4;
+
+	/// <param name="threadCount">The number of encoder threads. 0 uses half the processor count, up to MAX_DEFAULT_THREAD_COUNT.</param>
+	/// <param name="maxQueuedFrames">The number of frames that can be waiting for or being encoded before WriteFrame waits. 0 uses twice the thread count.</param>
+	AnimationWriter(_In_ UINT threadCount = 0, _In_ UINT maxQueuedFrames = 0);
+	/// <summary>
+	/// Discards frames that are not read back yet, and waits for the frames being encoded. The animation is incomplete unless Finish was called.
+	/// </summary>
+	~AnimationWriter();
+	/// <summary>
+	/// Sets up the writer for a device. Can be called again with a new device, e.g. after a device loss. Frames that were still being copied on the previous device are lost.
+	/// </summary>
+	HRESULT Initialize(_In_ ID3D11DeviceContext *pDeviceContext, _In_ ID3D11Device *pDevice);
+	/// <summary>
+	/// Starts an animation. The size of the animation is the size of the first frame.
+	/// </summary>
+	/// <param name="pStream">The stream to write to. APNG needs a seekable stream, as the frame count is written to the header at the end.</param>
+	HRESULT Begin(_In_ IStream *pStream, _In_ AnimationFormat format);
+	/// <summary>
+	/// Copies the texture to the staging ring and queues it to be compared and encoded.
+	/// </summary>
+	/// <param name="timestampMillis">The time the frame was captured, from the start of the recording.</param>
+	/// <param name="pTexture">The frame. It can be reused by the caller when this returns.</param>
+	/// <returns>The error of an earlier frame if one has failed, so the recording stops, else the result of queuing this frame.</returns>
+	HRESULT WriteFrame(_In_ UINT64 timestampMillis, _In_ ID3D11Texture2D *pTexture);
+	/// <summary>
+	/// Waits for all frames to be written, and completes the file.
+	/// </summary>
+	/// <param name="endTimestampMillis">The time the last frame stops showing.</param>
+	/// <returns>The first error of any frame, or S_OK.</returns>
+	HRESULT Finish(_In_ UINT64 endTimestampMillis);
+	ANIMATION_WRITER_STATS GetStats();
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_Impl;
+};
@@ -55,13 +55,31 @@ void AudioManager::OnOptionsChanged() {
 HRESULT AudioManager::Initialize(_In_ std::shared_ptr<AUDIO_OPTIONS> &audioOptions)
 {
 	HRESULT hr = S_OK;
-	m_AudioOptions = audioOptions;
+	//A reused manager is initialized again with new options, so the listener of the previous options is stopped before they are replaced.
 	StopOptionsChangeListenerThread();
+	{
+		EnterCriticalSection(&m_CriticalSection);
+		LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
+		m_AudioOptions = audioOptions;
+	}
 	ResetEvent(m_OptionsListenerStopEvent);
 	m_OptionsListenerThread = std::thread([this] {OnOptionsChanged(); });
 	return hr;
 }
 
+bool AudioManager::IsUsingOptions(_In_ const std::shared_ptr<AUDIO_OPTIONS> &audioOptions)
+{
+	if (!m_AudioOptions || !audioOptions) {
+		return m_AudioOptions == audioOptions;
+	}
+	//Volumes, downmixing and enabling the devices are read from the options while capturing, so they may differ.
+	return m_AudioOptions->GetAudioOutputDevice() == audioOptions->GetAudioOutputDevice()
+		&& m_AudioOptions->GetAudioInputDevice() == audioOptions->GetAudioInputDevice()
+		&& m_AudioOptions->GetAudioChannels() == audioOptions->GetAudioChannels()
+		&& m_AudioOptions->GetAudioSamplesPerSecond() == audioOptions->GetAudioSamplesPerSecond()
+		&& m_AudioOptions->GetAudioBitsPerSample() == audioOptions->GetAudioBitsPerSample();
+}
+
 void AudioManager::ClearRecordedBytes()
 {
 	if (m_AudioOutputCapture)
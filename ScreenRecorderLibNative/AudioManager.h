@@ -12,6 +12,11 @@ public:
 	HRESULT StartCapture();
 	HRESULT StopCapture();
 	std::vector<BYTE> GrabAudioFrame(_In_ UINT64 durationHundredNanos);
+	/// <summary>
+	/// Returns true if the options select the same devices and audio format as the options this manager was initialized with.
+	/// The capture devices are created for those, so the manager can then be initialized again with the new options instead of being recreated.
+	/// </summary>
+	bool IsUsingOptions(_In_ const std::shared_ptr<AUDIO_OPTIONS> &audioOptions);
 private:
 	CRITICAL_SECTION m_CriticalSection;
 	std::shared_ptr<AUDIO_OPTIONS> m_AudioOptions;
@@ -0,0 +1,564 @@
+//Compares the time and output size of AnimationEncoder.h with frame differencing against encoding every frame in full, on synthetic screen recordings.
+//The encoder doesn't depend on Windows, so the benchmark runs on Linux. zlib is used to decode the APNG frames.
+//
+//Build and run from this directory:
+//  g++ -std=c++17 -O2 -msse2 -I.. AnimationEncoderBenchmark.cpp ../AnimationEncoder.cpp ../ImageEncoder.cpp -lz -o animation_encoder_benchmark
+//  ./animation_encoder_benchmark
+//
+//Every animation is decoded again and each decoded frame is compared to the captured frame shown at that time.
+//APNG must match exactly. GIF is quantized to 255 colors per frame, so it must only stay above a minimum PSNR.
+
+#include "AnimationEncoder.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+using namespace std;
+
+static const double MIN_GIF_PSNR = 30.0;
+
+struct ANIMATION_SOURCE {
+	string Name;
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	//Frames in Bgra32 layout, as captured frames are.
+	vector<vector<uint8_t>> Frames;
+	vector<uint64_t> Timestamps;
+	uint64_t EndTimestamp = 0;
+};
+
+struct DECODED_FRAME {
+	uint64_t StartMillis = 0;
+	vector<uint8_t> Pixels;
+};
+
+static uint32_t ReadBigEndian32(const uint8_t *p)
+{
+	return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static uint32_t ReadLittleEndian16(const uint8_t *p)
+{
+	return p[0] | (static_cast<uint32_t>(p[1]) << 8);
+}
+
+/// <summary>
+/// Decodes a GIF LZW stream of sub-blocks to color indices.
+/// </summary>
+static bool DecodeLzw(const vector<uint8_t> &file, size_t &pos, size_t pixelCount, vector<uint8_t> &indices)
+{
+	int minCodeSize = file[pos++];
+	vector<uint8_t> data;
+	while (pos < file.size() && file[pos] != 0) {
+		size_t size = file[pos];
+		data.insert(data.end(), file.begin() + pos + 1, file.begin() + pos + 1 + size);
+		pos += 1 + size;
+	}
+	pos++;
+	const uint32_t clearCode = 1u << minCodeSize;
+	const uint32_t endCode = clearCode + 1;
+	vector<uint16_t> prefixes(4096);
+	vector<uint8_t> suffixes(4096);
+	vector<uint8_t> firsts(4096);
+	for (uint32_t i = 0; i < clearCode; i++) {
+		suffixes[i] = static_cast<uint8_t>(i);
+		firsts[i] = static_cast<uint8_t>(i);
+	}
+	int codeSize = minCodeSize + 1;
+	uint32_t nextCode = endCode + 1;
+	int32_t previous = -1;
+	uint32_t buffer = 0;
+	int bits = 0;
+	size_t bytePos = 0;
+	indices.clear();
+	vector<uint8_t> stack;
+	while (true) {
+		while (bits < codeSize) {
+			if (bytePos >= data.size()) {
+				return false;
+			}
+			buffer |= static_cast<uint32_t>(data[bytePos++]) << bits;
+			bits += 8;
+		}
+		uint32_t code = buffer & ((1u << codeSize) - 1);
+		buffer >>= codeSize;
+		bits -= codeSize;
+		if (code == clearCode) {
+			codeSize = minCodeSize + 1;
+			nextCode = endCode + 1;
+			previous = -1;
+			continue;
+		}
+		if (code == endCode) {
+			break;
+		}
+		if (code > nextCode || (code == nextCode && previous < 0)) {
+			return false;
+		}
+		uint32_t current = code == nextCode ? static_cast<uint32_t>(previous) : code;
+		stack.clear();
+		while (current >= clearCode) {
+			stack.push_back(suffixes[current]);
+			current = prefixes[current];
+		}
+		stack.push_back(static_cast<uint8_t>(current));
+		uint8_t first = stack.back();
+		if (code == nextCode) {
+			stack.insert(stack.begin(), first);
+		}
+		indices.insert(indices.end(), stack.rbegin(), stack.rend());
+		if (previous >= 0 && nextCode < 4096) {
+			prefixes[nextCode] = static_cast<uint16_t>(previous);
+			suffixes[nextCode] = first;
+			firsts[nextCode] = firsts[previous];
+			nextCode++;
+			if (nextCode == (1u << codeSize) && codeSize < 12) {
+				codeSize++;
+			}
+		}
+		previous = static_cast<int32_t>(code);
+	}
+	return indices.size() == pixelCount;
+}
+
+/// <summary>
+/// Decodes an animated GIF to the full canvas after each frame.
+/// </summary>
+static bool DecodeGif(const vector<uint8_t> &file, uint32_t width, uint32_t height, vector<DECODED_FRAME> &frames)
+{
+	if (file.size() < 13 || memcmp(file.data(), "GIF89a", 6) != 0 || ReadLittleEndian16(&file[6]) != width || ReadLittleEndian16(&file[8]) != height) {
+		return false;
+	}
+	size_t pos = 13;
+	vector<uint8_t> globalTable;
+	if (file[10] & 0x80) {
+		size_t size = (static_cast<size_t>(1) << ((file[10] & 7) + 1)) * 3;
+		globalTable.assign(file.begin() + pos, file.begin() + pos + size);
+		pos += size;
+	}
+	vector<uint8_t> canvas(static_cast<size_t>(width) * height * 4, 0);
+	uint64_t time = 0;
+	uint32_t delay = 0;
+	int transparentIndex = -1;
+	while (pos < file.size()) {
+		uint8_t block = file[pos++];
+		if (block == 0x3B) {
+			return true;
+		}
+		if (block == 0x21) {
+			uint8_t label = file[pos++];
+			if (label == 0xF9) {
+				transparentIndex = (file[pos + 1] & 1) ? file[pos + 4] : -1;
+				delay = ReadLittleEndian16(&file[pos + 2]) * 10;
+			}
+			while (file[pos] != 0) {
+				pos += 1 + file[pos];
+			}
+			pos++;
+		}
+		else if (block == 0x2C) {
+			uint32_t x = ReadLittleEndian16(&file[pos]);
+			uint32_t y = ReadLittleEndian16(&file[pos + 2]);
+			uint32_t frameWidth = ReadLittleEndian16(&file[pos + 4]);
+			uint32_t frameHeight = ReadLittleEndian16(&file[pos + 6]);
+			uint8_t packed = file[pos + 8];
+			pos += 9;
+			vector<uint8_t> table = globalTable;
+			if (packed & 0x80) {
+				size_t size = (static_cast<size_t>(1) << ((packed & 7) + 1)) * 3;
+				table.assign(file.begin() + pos, file.begin() + pos + size);
+				pos += size;
+			}
+			if (x + frameWidth > width || y + frameHeight > height) {
+				return false;
+			}
+			vector<uint8_t> indices;
+			if (!DecodeLzw(file, pos, static_cast<size_t>(frameWidth) * frameHeight, indices)) {
+				return false;
+			}
+			for (uint32_t row = 0; row < frameHeight; row++) {
+				for (uint32_t column = 0; column < frameWidth; column++) {
+					uint8_t index = indices[static_cast<size_t>(row) * frameWidth + column];
+					if (index == transparentIndex || index * 3u + 2 >= table.size()) {
+						continue;
+					}
+					uint8_t *p = &canvas[((static_cast<size_t>(y) + row) * width + x + column) * 4];
+					p[0] = table[index * 3 + 2];
+					p[1] = table[index * 3 + 1];
+					p[2] = table[index * 3];
+					p[3] = 255;
+				}
+			}
+			frames.push_back(DECODED_FRAME{ time, canvas });
+			time += delay;
+			transparentIndex = -1;
+		}
+		else {
+			return false;
+		}
+	}
+	return false;
+}
+
+/// <summary>
+/// Decodes an APNG with 8 bit RGBA frames that use the Up filter, blending each frame over the canvas as the fcTL chunk says.
+/// </summary>
+static bool DecodeApng(const vector<uint8_t> &file, uint32_t width, uint32_t height, vector<DECODED_FRAME> &frames)
+{
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	if (file.size() < 8 || memcmp(file.data(), signature, 8) != 0) {
+		return false;
+	}
+	vector<uint8_t> canvas(static_cast<size_t>(width) * height * 4, 0);
+	uint64_t time = 0;
+	uint32_t frameCount = 0;
+	uint32_t expectedSequence = 0;
+	uint32_t x = 0, y = 0, frameWidth = 0, frameHeight = 0, delay = 0;
+	bool isBlendOver = false;
+	for (size_t pos = 8; pos + 12 <= file.size();) {
+		uint32_t length = ReadBigEndian32(file.data() + pos);
+		string type(reinterpret_cast<const char *>(file.data() + pos + 4), 4);
+		const uint8_t *pData = file.data() + pos + 8;
+		if (pos + 12 + length > file.size()
+			|| crc32(crc32(0, file.data() + pos + 4, 4), pData, length) != ReadBigEndian32(pData + length)) {
+			return false;
+		}
+		if (type == "IHDR") {
+			if (ReadBigEndian32(pData) != width || ReadBigEndian32(pData + 4) != height || pData[8] != 8 || pData[9] != 6) {
+				return false;
+			}
+		}
+		else if (type == "acTL") {
+			frameCount = ReadBigEndian32(pData);
+		}
+		else if (type == "fcTL") {
+			if (ReadBigEndian32(pData) != expectedSequence++) {
+				return false;
+			}
+			frameWidth = ReadBigEndian32(pData + 4);
+			frameHeight = ReadBigEndian32(pData + 8);
+			x = ReadBigEndian32(pData + 12);
+			y = ReadBigEndian32(pData + 16);
+			delay = (pData[20] << 8 | pData[21]) * 1000 / (pData[22] << 8 | pData[23]);
+			isBlendOver = pData[25] == 1;
+		}
+		else if (type == "IDAT" || type == "fdAT") {
+			const uint8_t *pCompressed = pData;
+			uint32_t compressedSize = length;
+			if (type == "fdAT") {
+				if (ReadBigEndian32(pData) != expectedSequence++) {
+					return false;
+				}
+				pCompressed += 4;
+				compressedSize -= 4;
+			}
+			size_t rowSize = static_cast<size_t>(frameWidth) * 4;
+			vector<uint8_t> filtered((rowSize + 1) * frameHeight);
+			uLongf filteredSize = static_cast<uLongf>(filtered.size());
+			if (uncompress(filtered.data(), &filteredSize, pCompressed, compressedSize) != Z_OK || filteredSize != filtered.size()) {
+				return false;
+			}
+			vector<uint8_t> row(rowSize, 0);
+			for (uint32_t rowIndex = 0; rowIndex < frameHeight; rowIndex++) {
+				const uint8_t *pRow = filtered.data() + rowIndex * (rowSize + 1);
+				if (pRow[0] != 2) {
+					return false;
+				}
+				for (size_t i = 0; i < rowSize; i++) {
+					row[i] = static_cast<uint8_t>(row[i] + pRow[1 + i]);
+				}
+				for (uint32_t column = 0; column < frameWidth; column++) {
+					const uint8_t *pSrc = &row[column * 4];
+					if (isBlendOver && pSrc[3] == 0) {
+						continue;
+					}
+					uint8_t *p = &canvas[((static_cast<size_t>(y) + rowIndex) * width + x + column) * 4];
+					p[0] = pSrc[2];
+					p[1] = pSrc[1];
+					p[2] = pSrc[0];
+					p[3] = pSrc[3];
+				}
+			}
+			frames.push_back(DECODED_FRAME{ time, canvas });
+			time += delay;
+		}
+		else if (type == "IEND") {
+			return frameCount == frames.size();
+		}
+		pos += 12 + length;
+	}
+	return false;
+}
+
+static void FillRect(vector<uint8_t> &pixels, uint32_t width, uint32_t height, int left, int top, int right, int bottom, uint32_t color)
+{
+	for (int y = max(top, 0); y < min(bottom, static_cast<int>(height)); y++) {
+		for (int x = max(left, 0); x < min(right, static_cast<int>(width)); x++) {
+			memcpy(&pixels[(static_cast<size_t>(y) * width + x) * 4], &color, 4);
+		}
+	}
+}
+
+/// <summary>
+/// Draws a line of text-like glyphs, like in ImageEncoderBenchmark.
+/// </summary>
+static void DrawText(vector<uint8_t> &pixels, uint32_t width, uint32_t height, int left, int top, int glyphCount, uint32_t seed)
+{
+	mt19937 random(seed);
+	for (int glyph = 0; glyph < glyphCount; glyph++) {
+		int x = left + glyph * 8;
+		uint32_t pattern = random();
+		for (int stroke = 0; stroke < 6; stroke++) {
+			int sx = x + static_cast<int>((pattern >> (stroke * 5)) % 6);
+			int sy = top + static_cast<int>((pattern >> (stroke * 3)) % 10);
+			bool isVertical = (pattern >> (stroke + 24)) & 1;
+			FillRect(pixels, width, height, sx, sy, sx + (isVertical ? 1 : 4), sy + (isVertical ? 5 : 1), 0xFF202020);
+		}
+	}
+}
+
+static vector<uint8_t> CreateDesktop(uint32_t width, uint32_t height)
+{
+	vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			uint8_t *p = &pixels[(static_cast<size_t>(y) * width + x) * 4];
+			p[0] = static_cast<uint8_t>(120 + 100 * y / height);
+			p[1] = static_cast<uint8_t>(60 + 80 * x / width);
+			p[2] = 40;
+			p[3] = 255;
+		}
+	}
+	FillRect(pixels, width, height, 99, 79, width - 99, height - 79, 0xFF505050);
+	FillRect(pixels, width, height, 100, 80, width - 100, height - 80, 0xFFFFFFFF);
+	FillRect(pixels, width, height, 100, 80, width - 100, 110, 0xFFE0E0E0);
+	return pixels;
+}
+
+/// <summary>
+/// Typing in an editor at 10 frames per second: a few glyphs appear per frame, and the caret blinks. Some frames have no changes.
+/// </summary>
+static ANIMATION_SOURCE CreateTypingAnimation(uint32_t width, uint32_t height, int frameCount)
+{
+	ANIMATION_SOURCE source{ "typing " + to_string(width) + "x" + to_string(height), width, height, {}, {} };
+	vector<uint8_t> pixels = CreateDesktop(width, height);
+	const int charsPerLine = static_cast<int>(width - 240) / 8;
+	int typed = 0;
+	for (int frame = 0; frame < frameCount; frame++) {
+		if (frame % 4 != 3) {
+			int count = 1 + frame % 3;
+			for (int i = 0; i < count; i++, typed++) {
+				int line = typed / charsPerLine;
+				int column = typed % charsPerLine;
+				DrawText(pixels, width, height, 110 + column * 8, 130 + line * 20, 1, typed);
+			}
+		}
+		vector<uint8_t> shown = pixels;
+		if ((frame / 5) % 2 == 0) {
+			int line = typed / charsPerLine;
+			int column = typed % charsPerLine;
+			FillRect(shown, width, height, 110 + column * 8, 130 + line * 20, 111 + column * 8, 144 + line * 20, 0xFF000000);
+		}
+		source.Frames.push_back(move(shown));
+		source.Timestamps.push_back(1000 + frame * 100);
+	}
+	source.EndTimestamp = 1000 + frameCount * 100;
+	return source;
+}
+
+/// <summary>
+/// Scrolling a document at 20 frames per second, which changes most of the window in every frame.
+/// </summary>
+static ANIMATION_SOURCE CreateScrollingAnimation(uint32_t width, uint32_t height, int frameCount)
+{
+	ANIMATION_SOURCE source{ "scrolling " + to_string(width) + "x" + to_string(height), width, height, {}, {} };
+	const vector<uint8_t> desktop = CreateDesktop(width, height);
+	const int lineCount = static_cast<int>(height) / 20 + frameCount;
+	const int glyphCount = static_cast<int>(width - 240) / 8;
+	for (int frame = 0; frame < frameCount; frame++) {
+		vector<uint8_t> pixels = desktop;
+		for (int line = 0; line < lineCount; line++) {
+			int top = 130 + line * 20 - frame * 7;
+			if (top >= 120 && top + 14 < static_cast<int>(height) - 90) {
+				DrawText(pixels, width, height, 110, top, glyphCount - line % 17, line);
+			}
+		}
+		source.Frames.push_back(move(pixels));
+		source.Timestamps.push_back(frame * 50);
+	}
+	source.EndTimestamp = frameCount * 50;
+	return source;
+}
+
+/// <summary>
+/// A video playing in a small part of the screen, with photo-like content that needs a new palette in most frames.
+/// </summary>
+static ANIMATION_SOURCE CreateVideoAnimation(uint32_t width, uint32_t height, int frameCount)
+{
+	ANIMATION_SOURCE source{ "video " + to_string(width) + "x" + to_string(height), width, height, {}, {} };
+	const vector<uint8_t> desktop = CreateDesktop(width, height);
+	const int videoLeft = static_cast<int>(width) / 3;
+	const int videoTop = static_cast<int>(height) / 3;
+	const int videoWidth = static_cast<int>(width) / 3;
+	const int videoHeight = static_cast<int>(height) / 3;
+	for (int frame = 0; frame < frameCount; frame++) {
+		vector<uint8_t> pixels = desktop;
+		for (int y = 0; y < videoHeight; y++) {
+			for (int x = 0; x < videoWidth; x++) {
+				uint8_t *p = &pixels[((static_cast<size_t>(videoTop) + y) * width + videoLeft + x) * 4];
+				double fx = static_cast<double>(x) / videoWidth + frame * 0.02;
+				double fy = static_cast<double>(y) / videoHeight;
+				p[0] = static_cast<uint8_t>(128 + 100 * sin(fx * 7 + fy * 3));
+				p[1] = static_cast<uint8_t>(128 + 90 * cos(fx * 5 - fy * 9));
+				p[2] = static_cast<uint8_t>(128 + 80 * sin(fx * fy * 20));
+			}
+		}
+		source.Frames.push_back(move(pixels));
+		source.Timestamps.push_back(frame * 40);
+	}
+	source.EndTimestamp = frameCount * 40;
+	return source;
+}
+
+/// <summary>
+/// Encodes the animation on one thread, the way AnimationWriter does on several.
+/// </summary>
+static bool EncodeAnimation(const ANIMATION_SOURCE &source, AnimationFormat format, bool isFrameDifferencingEnabled, vector<uint8_t> &output, ANIMATION_ENCODER_STATS &stats)
+{
+	output.clear();
+	AnimationEncoder encoder(format, source.Width, source.Height, isFrameDifferencingEnabled);
+	vector<uint8_t> body;
+	uint32_t frameCount = 0;
+	auto Encode([&](const unique_ptr<ANIMATION_FRAME> &pFrame) {
+		if (pFrame) {
+			frameCount++;
+			return AnimationEncoder::EncodeFrame(format, *pFrame, body);
+		}
+		return true;
+	});
+	for (size_t i = 0; i < source.Frames.size(); i++) {
+		IMAGE_BITMAP bitmap;
+		bitmap.pData = source.Frames[i].data();
+		bitmap.Width = source.Width;
+		bitmap.Height = source.Height;
+		bitmap.Stride = source.Width * 4;
+		bitmap.Layout = ImagePixelLayout::Bgra32;
+		unique_ptr<ANIMATION_FRAME> pCompleted;
+		if (!encoder.AddFrame(bitmap, source.Timestamps[i], pCompleted) || !Encode(pCompleted)) {
+			return false;
+		}
+	}
+	unique_ptr<ANIMATION_FRAME> pLast;
+	encoder.Finish(source.EndTimestamp, pLast);
+	if (!Encode(pLast) || !encoder.GetHeader(output)) {
+		return false;
+	}
+	output.insert(output.end(), body.begin(), body.end());
+	encoder.GetTrailer(output);
+	if (format == AnimationFormat::Apng) {
+		vector<uint8_t> frameCountChunk;
+		encoder.GetFrameCountChunk(frameCount, frameCountChunk);
+		memcpy(output.data() + AnimationEncoder::GetFrameCountChunkOffset(), frameCountChunk.data(), frameCountChunk.size());
+	}
+	stats = encoder.GetStats();
+	return true;
+}
+
+/// <summary>
+/// Decodes the animation and compares every decoded frame to the source frame that was captured when it starts showing, and the frames captured while it shows.
+/// </summary>
+/// <returns>The lowest PSNR of any frame, or a negative value if decoding failed or the timing is wrong.</returns>
+static double CheckRoundTrip(const ANIMATION_SOURCE &source, AnimationFormat format, const vector<uint8_t> &file)
+{
+	vector<DECODED_FRAME> frames;
+	bool isDecoded = format == AnimationFormat::Gif
+		? DecodeGif(file, source.Width, source.Height, frames)
+		: DecodeApng(file, source.Width, source.Height, frames);
+	if (!isDecoded || frames.empty()) {
+		return -1;
+	}
+	const uint64_t firstTimestamp = source.Timestamps[0];
+	double minPsnr = INFINITY;
+	size_t decodedIndex = 0;
+	for (size_t i = 0; i < source.Frames.size(); i++) {
+		uint64_t time = source.Timestamps[i] - firstTimestamp;
+		while (decodedIndex + 1 < frames.size() && frames[decodedIndex + 1].StartMillis <= time) {
+			decodedIndex++;
+		}
+		const vector<uint8_t> &decoded = frames[decodedIndex].Pixels;
+		double squaredError = 0;
+		for (size_t p = 0; p < decoded.size(); p += 4) {
+			if (decoded[p + 3] != 255) {
+				return -1;
+			}
+			for (int c = 0; c < 3; c++) {
+				double difference = static_cast<double>(decoded[p + c]) - source.Frames[i][p + c];
+				squaredError += difference * difference;
+			}
+		}
+		double meanSquaredError = squaredError / (decoded.size() / 4 * 3);
+		double psnr = meanSquaredError == 0 ? INFINITY : 10 * log10(255.0 * 255.0 / meanSquaredError);
+		minPsnr = min(minPsnr, psnr);
+	}
+	return minPsnr;
+}
+
+int main()
+{
+	vector<ANIMATION_SOURCE> sources;
+	sources.push_back(CreateTypingAnimation(1280, 720, 60));
+	sources.push_back(CreateScrollingAnimation(1280, 720, 40));
+	sources.push_back(CreateVideoAnimation(1280, 720, 40));
+	sources.push_back(CreateTypingAnimation(1920, 1080, 60));
+
+	int failures = 0;
+	printf("%-22s %-6s %-12s %10s %12s %9s %8s %8s %10s\n", "Animation", "Format", "Encoding", "Time (ms)", "Size (bytes)", "Frames", "Palettes", "Reused", "Min PSNR");
+	for (const ANIMATION_SOURCE &source : sources) {
+		for (AnimationFormat format : { AnimationFormat::Gif, AnimationFormat::Apng }) {
+			double naiveMillis = 0;
+			size_t naiveSize = 0;
+			for (bool isFrameDifferencingEnabled : { false, true }) {
+				vector<uint8_t> output;
+				ANIMATION_ENCODER_STATS stats;
+				auto start = chrono::steady_clock::now();
+				if (!EncodeAnimation(source, format, isFrameDifferencingEnabled, output, stats)) {
+					printf("%-22s encoding failed\n", source.Name.c_str());
+					failures++;
+					continue;
+				}
+				double millis = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+				double psnr = CheckRoundTrip(source, format, output);
+				bool isValid = format == AnimationFormat::Apng ? isinf(psnr) : psnr >= MIN_GIF_PSNR;
+				if (!isValid) {
+					failures++;
+				}
+				const char *formatName = format == AnimationFormat::Gif ? "GIF" : "APNG";
+				printf("%-22s %-6s %-12s %10.1f %12zu %9llu %8llu %8llu %10.1f%s\n",
+					source.Name.c_str(), formatName, isFrameDifferencingEnabled ? "differences" : "full frames",
+					millis, output.size(),
+					static_cast<unsigned long long>(stats.AddedFrames - stats.UnchangedFrames),
+					static_cast<unsigned long long>(stats.NewPalettes), static_cast<unsigned long long>(stats.ReusedPalettes),
+					psnr, isValid ? "" : "  ROUND TRIP FAILED");
+				if (!isFrameDifferencingEnabled) {
+					naiveMillis = millis;
+					naiveSize = output.size();
+				}
+				else {
+					printf("%-22s %-6s %-12s %9.1fx %11.1fx\n", "", formatName, "speedup", naiveMillis / millis, static_cast<double>(naiveSize) / output.size());
+				}
+			}
+		}
+	}
+	if (failures > 0) {
+		printf("%d round trip checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,278 @@
+//Checks the cursor blending kernels of CursorShape.h against the scalar loops MouseManager::ProcessMonoMask used before, and compares their speed.
+//The kernels don't depend on Windows, so the benchmark runs on Linux.
+//
+//Build and run from this directory:
+//  g++ -std=c++17 -O2 -msse2 -I.. CursorMaskBenchmark.cpp ../CursorShape.cpp -o cursor_mask_benchmark
+//  ./cursor_mask_benchmark
+//
+//The checks are exhaustive where the input space allows it:
+//every AND and XOR byte pair at every bit offset, every 32 bit value class of a masked color pixel against several backgrounds,
+//and every size up to 40 by 40 for each rotation. Random masks cover row widths up to 256 with every skipped pixel count up to 64.
+
+#include "CursorShape.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+static const uint32_t TRANSPARENT_WHITE = 0x00FFFFFF;
+static const uint32_t TRANSPARENT_BLACK = 0x00000000;
+static const uint32_t OPAQUE_WHITE = 0xFFFFFFFF;
+static const uint32_t OPAQUE_BLACK = 0xFF000000;
+
+/// <summary>
+/// The monochrome loop of ProcessMonoMask, for one row.
+/// </summary>
+static void ScalarMonochromeRow(const uint8_t *andRow, const uint8_t *xorRow, uint32_t skipX, const uint32_t *desktop, uint32_t *output, uint32_t width)
+{
+	uint8_t mask = 0x80;
+	mask = mask >> (skipX % 8);
+	for (uint32_t col = 0; col < width; ++col) {
+		uint8_t andMask = andRow[(col + skipX) / 8] & mask;
+		uint8_t xorMask = xorRow[(col + skipX) / 8] & mask;
+		uint32_t andMask32 = andMask ? OPAQUE_WHITE : OPAQUE_BLACK;
+		uint32_t xorMask32 = xorMask ? TRANSPARENT_WHITE : TRANSPARENT_BLACK;
+		if (andMask && !xorMask) {
+			output[col] = TRANSPARENT_WHITE;
+		}
+		else {
+			output[col] = (desktop[col] & andMask32) ^ xorMask32;
+		}
+		if (mask == 0x01) {
+			mask = 0x80;
+		}
+		else {
+			mask = mask >> 1;
+		}
+	}
+}
+
+/// <summary>
+/// The masked color loop of ProcessMonoMask, for one row.
+/// </summary>
+static void ScalarMaskedColorRow(const uint32_t *shape, const uint32_t *desktop, uint32_t *output, uint32_t width)
+{
+	for (uint32_t col = 0; col < width; ++col) {
+		uint32_t rgbValue = shape[col];
+		uint32_t maskVal = OPAQUE_BLACK & rgbValue;
+		if (maskVal) {
+			if (rgbValue == maskVal) {
+				output[col] = TRANSPARENT_WHITE;
+			}
+			else {
+				output[col] = (desktop[col] ^ rgbValue) | OPAQUE_BLACK;
+			}
+		}
+		else {
+			output[col] = rgbValue | OPAQUE_BLACK;
+		}
+	}
+}
+
+/// <summary>
+/// The rotation loop of ProcessMonoMask, with the destination pitch as a parameter.
+/// </summary>
+static void ScalarRotate(const uint32_t *desktop, uint32_t desktopPitch, uint32_t width, uint32_t height, CursorRotation rotation, uint32_t *output, uint32_t outputPitch)
+{
+	for (uint32_t row = 0; row < height; ++row) {
+		for (uint32_t col = 0; col < width; ++col) {
+			uint32_t rotatedRow = row;
+			uint32_t rotatedCol = col;
+			if (rotation == CursorRotation::Rotate90) {
+				rotatedRow = col;
+				rotatedCol = height - 1 - row;
+			}
+			else if (rotation == CursorRotation::Rotate180) {
+				rotatedRow = height - 1 - row;
+				rotatedCol = width - 1 - col;
+			}
+			else if (rotation == CursorRotation::Rotate270) {
+				rotatedRow = width - 1 - col;
+				rotatedCol = row;
+			}
+			output[rotatedRow * outputPitch + rotatedCol] = desktop[row * desktopPitch + col];
+		}
+	}
+}
+
+static bool CheckMonochrome(mt19937 &random)
+{
+	//Every AND and XOR byte pair, at every bit offset, in a row of 3 bytes so the 16 pixel kernel runs.
+	vector<uint32_t> background(24);
+	for (uint32_t &pixel : background) {
+		pixel = random();
+	}
+	vector<uint32_t> expected(24), actual(24);
+	for (uint32_t andByte = 0; andByte < 256; andByte++) {
+		for (uint32_t xorByte = 0; xorByte < 256; xorByte++) {
+			const uint8_t andRow[4] = { static_cast<uint8_t>(andByte), static_cast<uint8_t>(~andByte), static_cast<uint8_t>(andByte ^ 0x5A), 0 };
+			const uint8_t xorRow[4] = { static_cast<uint8_t>(xorByte), static_cast<uint8_t>(xorByte ^ 0xA5), static_cast<uint8_t>(~xorByte), 0 };
+			for (uint32_t skip = 0; skip < 8; skip++) {
+				const uint32_t width = 24 - skip;
+				ScalarMonochromeRow(andRow, xorRow, skip, background.data(), expected.data(), width);
+				BlendMonochromeRow(andRow, xorRow, skip, background.data(), actual.data(), width);
+				if (memcmp(expected.data(), actual.data(), width * 4) != 0) {
+					printf("FAIL monochrome: AND %02X, XOR %02X, skip %u\n", andByte, xorByte, skip);
+					return false;
+				}
+			}
+		}
+	}
+	//Random rows of every width up to 256, with up to 64 skipped pixels.
+	for (uint32_t width = 1; width <= 256; width++) {
+		for (uint32_t skip = 0; skip <= 64; skip++) {
+			const uint32_t rowBytes = (width + skip + 7) / 8;
+			//The row is exactly as long as the mask, so reading past it shows up with address sanitizer.
+			vector<uint8_t> andRow(rowBytes), xorRow(rowBytes);
+			for (uint32_t i = 0; i < rowBytes; i++) {
+				andRow[i] = static_cast<uint8_t>(random());
+				xorRow[i] = static_cast<uint8_t>(random());
+			}
+			background.resize(width);
+			for (uint32_t &pixel : background) {
+				pixel = random();
+			}
+			expected.assign(width, 0);
+			actual.assign(width, 0);
+			ScalarMonochromeRow(andRow.data(), xorRow.data(), skip, background.data(), expected.data(), width);
+			BlendMonochromeRow(andRow.data(), xorRow.data(), skip, background.data(), actual.data(), width);
+			if (expected != actual) {
+				printf("FAIL monochrome: width %u, skip %u\n", width, skip);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool CheckMaskedColor(mt19937 &random)
+{
+	//Every combination of alpha and color class that changes the result: alpha 0, 0xFF or partial, and color 0, one channel or all channels.
+	const uint32_t alphas[] = { 0x00, 0x01, 0x7F, 0x80, 0xFE, 0xFF };
+	const uint32_t colors[] = { 0x000000, 0x000001, 0x000100, 0x010000, 0x123456, 0xFFFFFF, 0x800000 };
+	vector<uint32_t> shape, background;
+	for (uint32_t alpha : alphas) {
+		for (uint32_t color : colors) {
+			for (int i = 0; i < 16; i++) {
+				shape.push_back((alpha << 24) | color);
+				background.push_back(random());
+			}
+		}
+	}
+	//Random pixels, with many fully transparent and fully opaque ones.
+	for (int i = 0; i < 100000; i++) {
+		uint32_t value = random();
+		switch (random() % 4) {
+			case 0: value &= 0x00FFFFFF; break;
+			case 1: value |= 0xFF000000; break;
+			case 2: value &= 0xFF000000; break;
+		}
+		shape.push_back(value);
+		background.push_back(random());
+	}
+	const uint32_t count = static_cast<uint32_t>(shape.size());
+	for (uint32_t offset = 0; offset < 8; offset++) {
+		vector<uint32_t> expected(count - offset), actual(count - offset);
+		ScalarMaskedColorRow(shape.data() + offset, background.data() + offset, expected.data(), count - offset);
+		BlendMaskedColorRow(shape.data() + offset, background.data() + offset, actual.data(), count - offset);
+		if (expected != actual) {
+			printf("FAIL masked color: offset %u\n", offset);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool CheckRotation(mt19937 &random)
+{
+	const CursorRotation rotations[] = { CursorRotation::Identity, CursorRotation::Rotate90, CursorRotation::Rotate180, CursorRotation::Rotate270 };
+	for (uint32_t width = 1; width <= 40; width++) {
+		for (uint32_t height = 1; height <= 40; height++) {
+			const uint32_t sourcePitch = width + 3;
+			vector<uint32_t> source(sourcePitch * height);
+			for (uint32_t &pixel : source) {
+				pixel = random();
+			}
+			const uint32_t outputPitch = max(width, height) + 1;
+			for (CursorRotation rotation : rotations) {
+				vector<uint32_t> expected(outputPitch * outputPitch, 0xDEADBEEF), actual(outputPitch * outputPitch, 0xDEADBEEF);
+				ScalarRotate(source.data(), sourcePitch, width, height, rotation, expected.data(), outputPitch);
+				RotateCursorBackground(source.data(), sourcePitch, width, height, rotation, actual.data(), outputPitch);
+				if (expected != actual) {
+					printf("FAIL rotation %d: %ux%u\n", static_cast<int>(rotation), width, height);
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+static double MeasureMicros(int iterations, const function<void()> &action)
+{
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		action();
+	}
+	return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main()
+{
+	mt19937 random(1234);
+	bool isOk = true;
+	bool isCheckOk = CheckMonochrome(random);
+	printf("monochrome rows   %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckMaskedColor(random);
+	printf("masked color rows %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckRotation(random);
+	printf("rotation          %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+
+	printf("\nTime per cursor, in microseconds:\n");
+	printf("%-8s %10s %10s %10s %10s %10s %10s\n", "size", "mono", "mono simd", "masked", "mskd simd", "rot90", "rot90 simd");
+	const uint32_t sizes[] = { 32, 48, 64, 128, 256 };
+	for (uint32_t size : sizes) {
+		const uint32_t maskPitch = (size + 7) / 8;
+		vector<uint8_t> masks(maskPitch * size * 2);
+		for (uint8_t &b : masks) {
+			b = static_cast<uint8_t>(random());
+		}
+		vector<uint32_t> shape(size * size), background(size * size), output(size * size), rotated(size * size);
+		for (size_t i = 0; i < shape.size(); i++) {
+			shape[i] = random();
+			background[i] = random();
+		}
+		const int iterations = size >= 128 ? 500 : 5000;
+		auto mono = [&](bool isSimd) {
+			for (uint32_t row = 0; row < size; row++) {
+				const uint8_t *andRow = &masks[row * maskPitch];
+				const uint8_t *xorRow = &masks[(row + size) * maskPitch];
+				if (isSimd) BlendMonochromeRow(andRow, xorRow, 0, &background[row * size], &output[row * size], size);
+				else ScalarMonochromeRow(andRow, xorRow, 0, &background[row * size], &output[row * size], size);
+			}
+		};
+		auto masked = [&](bool isSimd) {
+			for (uint32_t row = 0; row < size; row++) {
+				if (isSimd) BlendMaskedColorRow(&shape[row * size], &background[row * size], &output[row * size], size);
+				else ScalarMaskedColorRow(&shape[row * size], &background[row * size], &output[row * size], size);
+			}
+		};
+		double monoScalar = MeasureMicros(iterations, [&] { mono(false); });
+		double monoSimd = MeasureMicros(iterations, [&] { mono(true); });
+		double maskedScalar = MeasureMicros(iterations, [&] { masked(false); });
+		double maskedSimd = MeasureMicros(iterations, [&] { masked(true); });
+		double rotateScalar = MeasureMicros(iterations, [&] { ScalarRotate(background.data(), size, size, size, CursorRotation::Rotate90, rotated.data(), size); });
+		double rotateSimd = MeasureMicros(iterations, [&] { RotateCursorBackground(background.data(), size, size, size, CursorRotation::Rotate90, rotated.data(), size); });
+		printf("%3ux%-4u %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", size, size, monoScalar, monoSimd, maskedScalar, maskedSimd, rotateScalar, rotateSimd);
+	}
+	printf("\n%s\n", isOk ? "All checks passed" : "CHECKS FAILED");
+	return isOk ? 0 : 1;
+}
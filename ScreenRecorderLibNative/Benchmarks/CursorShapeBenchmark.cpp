@@ -0,0 +1,409 @@
+//Checks CursorShape.h against known cursor bitmaps, and compares the per frame CPU cost of drawing a cursor before and after cursor shapes were cached.
+//The decoder doesn't depend on Windows, so the benchmark runs on Linux.
+//
+//Build and run from this directory:
+//  g++ -std=c++17 -O2 -I.. CursorShapeBenchmark.cpp ../CursorShape.cpp -o cursor_shape_benchmark
+//  ./cursor_shape_benchmark
+//
+//Every cursor is decoded and drawn on a random background the way the GPU draws it, and the result must match the old CPU blending
+//of MouseManager::ProcessMonoMask followed by alpha blending exactly.
+//Before, every frame blended the shape with the background read back from the GPU, and uploaded it to a new texture.
+//After, a frame only compares the shape version with the cached one, and the shape is hashed and decoded once when it changes.
+//The GPU side of the old path, a staging copy that waits for the GPU and a texture upload per frame, can only be measured on Windows.
+
+#include "CursorShape.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const uint32_t TRANSPARENT_WHITE = 0x00FFFFFF;
+static const uint32_t TRANSPARENT_BLACK = 0x00000000;
+static const uint32_t OPAQUE_WHITE = 0xFFFFFFFF;
+static const uint32_t OPAQUE_BLACK = 0xFF000000;
+
+//'.' is transparent, 'B' black, 'W' white and 'I' inverts the background.
+//Masked color cursors also use 'R' for opaque red and 'X' for a pixel XORed with magenta.
+static const char *ARROW[] = {
+	"B...........",
+	"BB..........",
+	"BWB.........",
+	"BWWB........",
+	"BWWWB.......",
+	"BWWWWB......",
+	"BWWWWWB.....",
+	"BWWWWWWB....",
+	"BWWWWWWWB...",
+	"BWWWWWWWWB..",
+	"BWWWWWWWWWB.",
+	"BWWWWWWBBBBB",
+	"BWWWBWWB....",
+	"BWWB.BWWB...",
+	"BWB..BWWB...",
+	"BB....BWWB..",
+	"B.....BWWB..",
+	".......BB...",
+};
+
+static const char *IBEAM[] = {
+	"III.III",
+	"...I...",
+	"...I...",
+	"...I...",
+	"...I...",
+	"...I...",
+	"...I...",
+	"...I...",
+	"...I...",
+	"...I...",
+	"III.III",
+};
+
+static const char *MASKED[] = {
+	"..RRRR..",
+	".RXXXXR.",
+	"RXXIIXXR",
+	"RXIWBIXR",
+	"RXIBWIXR",
+	"RXXIIXXR",
+	".RXXXXR.",
+	"..RRRR..",
+};
+
+struct TEST_CURSOR {
+	string Name;
+	CursorShapeType Type = CursorShapeType::Color;
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	uint32_t Pitch = 0;
+	vector<uint8_t> Buffer;
+	bool ExpectXor = false;
+	//The pixels DecodeCursorShape must return.
+	vector<uint32_t> Expected;
+
+	CURSOR_SHAPE GetShape() const
+	{
+		CURSOR_SHAPE shape;
+		shape.Type = Type;
+		shape.Width = Width;
+		shape.Height = Height;
+		shape.Pitch = Pitch;
+		shape.Buffer = Buffer.data();
+		shape.BufferSize = Buffer.size();
+		return shape;
+	}
+};
+
+static uint32_t Load32(const uint8_t *p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static void Store32(uint8_t *p, uint32_t value)
+{
+	memcpy(p, &value, sizeof(value));
+}
+
+static char GetArtPixel(const char **art, uint32_t artWidth, uint32_t x, uint32_t y, uint32_t scale)
+{
+	x /= scale;
+	y /= scale;
+	return x < artWidth ? art[y][x] : '.';
+}
+
+/// <summary>
+/// Builds a monochrome cursor like Desktop Duplication returns it, scaled up by an integer factor. Padding bytes are filled with garbage, as they are not part of the shape.
+/// </summary>
+static TEST_CURSOR MakeMonochrome(const string &name, const char **art, uint32_t artWidth, uint32_t artHeight, uint32_t scale, uint32_t width, uint8_t padding)
+{
+	TEST_CURSOR cursor;
+	cursor.Name = name;
+	cursor.Type = CursorShapeType::Monochrome;
+	cursor.Width = width;
+	uint32_t height = artHeight * scale;
+	cursor.Height = height * 2;
+	cursor.Pitch = ((width + 7) / 8 + 3) / 4 * 4 + 4;
+	cursor.Buffer.assign(static_cast<size_t>(cursor.Pitch) * cursor.Height, padding);
+	for (uint32_t y = 0; y < height; y++) {
+		uint8_t *andRow = &cursor.Buffer[static_cast<size_t>(y) * cursor.Pitch];
+		uint8_t *xorRow = &cursor.Buffer[static_cast<size_t>(y + height) * cursor.Pitch];
+		memset(andRow, 0, (width + 7) / 8);
+		memset(xorRow, 0, (width + 7) / 8);
+		for (uint32_t x = 0; x < width; x++) {
+			char c = GetArtPixel(art, artWidth, x, y, scale);
+			bool isAnd = c == '.' || c == 'I';
+			bool isXor = c == 'W' || c == 'I';
+			uint8_t bit = static_cast<uint8_t>(0x80 >> (x % 8));
+			if (isAnd) andRow[x / 8] |= bit;
+			if (isXor) xorRow[x / 8] |= bit;
+			cursor.Expected.push_back(c == '.' ? 0x00000000 : c == 'B' ? 0xFF000000 : c == 'W' ? 0xFFFFFFFF : 0x00FFFFFF);
+			cursor.ExpectXor |= c == 'I';
+		}
+		//Bits past the width must be ignored.
+		if (width % 8) {
+			andRow[width / 8] |= static_cast<uint8_t>(0xFF >> (width % 8));
+		}
+	}
+	return cursor;
+}
+
+static TEST_CURSOR MakeMaskedColor(const string &name, const char **art, uint32_t artWidth, uint32_t artHeight, uint32_t scale)
+{
+	TEST_CURSOR cursor;
+	cursor.Name = name;
+	cursor.Type = CursorShapeType::MaskedColor;
+	cursor.Width = artWidth * scale;
+	cursor.Height = artHeight * scale;
+	cursor.Pitch = cursor.Width * 4 + 12;
+	cursor.Buffer.assign(static_cast<size_t>(cursor.Pitch) * cursor.Height, 0xCD);
+	for (uint32_t y = 0; y < cursor.Height; y++) {
+		for (uint32_t x = 0; x < cursor.Width; x++) {
+			char c = GetArtPixel(art, artWidth, x, y, scale);
+			//Mask 0xFF XORs with the background, mask 0 replaces it.
+			uint32_t value = c == '.' ? 0xFF000000 : c == 'R' ? 0x00FF0000 : c == 'X' ? 0xFFFF00FF : c == 'I' ? 0xFFFFFFFF : c == 'W' ? 0x00FFFFFF : 0x00000000;
+			Store32(&cursor.Buffer[static_cast<size_t>(y) * cursor.Pitch + x * 4], value);
+			cursor.Expected.push_back(c == '.' ? 0x00000000 : c == 'R' ? 0xFFFF0000 : c == 'X' ? 0x00FF00FF : c == 'I' ? 0x00FFFFFF : c == 'W' ? 0xFFFFFFFF : 0xFF000000);
+			cursor.ExpectXor |= c == 'X' || c == 'I';
+		}
+	}
+	return cursor;
+}
+
+/// <summary>
+/// Builds a color cursor with an anti-aliased edge, like the Windows 10 cursors with a shadow.
+/// </summary>
+static TEST_CURSOR MakeColor(const string &name, uint32_t size)
+{
+	TEST_CURSOR cursor;
+	cursor.Name = name;
+	cursor.Type = CursorShapeType::Color;
+	cursor.Width = size;
+	cursor.Height = size;
+	cursor.Pitch = size * 4;
+	cursor.Buffer.resize(static_cast<size_t>(cursor.Pitch) * size);
+	for (uint32_t y = 0; y < size; y++) {
+		for (uint32_t x = 0; x < size; x++) {
+			uint32_t alpha = x <= y ? (y - x < 4 ? 64 * (y - x) : 255) : 0;
+			uint32_t value = (alpha << 24) | ((x * 255 / size) << 16) | ((y * 255 / size) << 8) | 0x40;
+			Store32(&cursor.Buffer[static_cast<size_t>(y) * cursor.Pitch + x * 4], value);
+			cursor.Expected.push_back(value);
+		}
+	}
+	return cursor;
+}
+
+static void AlphaBlend(uint32_t pixel, uint8_t *target)
+{
+	const uint8_t *source = reinterpret_cast<const uint8_t *>(&pixel);
+	uint32_t alpha = pixel >> 24;
+	for (int c = 0; c < 3; c++) {
+		target[c] = static_cast<uint8_t>((source[c] * alpha + target[c] * (255 - alpha) + 127) / 255);
+	}
+	target[3] = static_cast<uint8_t>((alpha * alpha + target[3] * (255 - alpha) + 127) / 255);
+}
+
+/// <summary>
+/// The old cursor drawing: ProcessMonoMask blends the shape with the background on the CPU, and the result is alpha blended on the frame.
+/// </summary>
+static void DrawLegacy(const TEST_CURSOR &cursor, vector<uint8_t> &background, uint32_t backgroundPitch, vector<uint32_t> &initBuffer)
+{
+	const CURSOR_SHAPE shape = cursor.GetShape();
+	if (shape.Type == CursorShapeType::Color) {
+		for (uint32_t y = 0; y < shape.Height; y++) {
+			for (uint32_t x = 0; x < shape.Width; x++) {
+				AlphaBlend(Load32(shape.Buffer + y * shape.Pitch + x * 4), &background[y * backgroundPitch + x * 4]);
+			}
+		}
+		return;
+	}
+	const bool isMono = shape.Type == CursorShapeType::Monochrome;
+	const uint32_t width = shape.Width;
+	const uint32_t height = isMono ? shape.Height / 2 : shape.Height;
+	initBuffer.resize(static_cast<size_t>(width) * height);
+	const uint32_t desktopPitchInPixels = backgroundPitch / 4;
+	const uint32_t *desktop32 = reinterpret_cast<const uint32_t *>(background.data());
+	if (isMono) {
+		for (uint32_t row = 0; row < height; ++row) {
+			uint8_t mask = 0x80;
+			for (uint32_t col = 0; col < width; ++col) {
+				uint8_t andMask = shape.Buffer[(col / 8) + (row * shape.Pitch)] & mask;
+				uint8_t xorMask = shape.Buffer[(col / 8) + ((row + height) * shape.Pitch)] & mask;
+				uint32_t andMask32 = andMask ? OPAQUE_WHITE : OPAQUE_BLACK;
+				uint32_t xorMask32 = xorMask ? TRANSPARENT_WHITE : TRANSPARENT_BLACK;
+				if (andMask && !xorMask) {
+					initBuffer[row * width + col] = TRANSPARENT_WHITE;
+				}
+				else {
+					initBuffer[row * width + col] = (desktop32[row * desktopPitchInPixels + col] & andMask32) ^ xorMask32;
+				}
+				mask = mask == 0x01 ? 0x80 : mask >> 1;
+			}
+		}
+	}
+	else {
+		for (uint32_t row = 0; row < height; ++row) {
+			for (uint32_t col = 0; col < width; ++col) {
+				uint32_t rgbValue = Load32(shape.Buffer + row * shape.Pitch + col * 4);
+				uint32_t maskVal = OPAQUE_BLACK & rgbValue;
+				if (maskVal) {
+					if (rgbValue == maskVal) {
+						initBuffer[row * width + col] = TRANSPARENT_WHITE;
+					}
+					else {
+						initBuffer[row * width + col] = (desktop32[row * desktopPitchInPixels + col] ^ rgbValue) | OPAQUE_BLACK;
+					}
+				}
+				else {
+					initBuffer[row * width + col] = rgbValue | OPAQUE_BLACK;
+				}
+			}
+		}
+	}
+	for (uint32_t row = 0; row < height; ++row) {
+		for (uint32_t col = 0; col < width; ++col) {
+			AlphaBlend(initBuffer[row * width + col], &background[row * backgroundPitch + col * 4]);
+		}
+	}
+}
+
+static vector<uint8_t> MakeBackground(uint32_t width, uint32_t height, uint32_t seed)
+{
+	mt19937 random(seed);
+	vector<uint8_t> background(static_cast<size_t>(width) * height * 4);
+	for (size_t i = 0; i < background.size(); i += 4) {
+		uint32_t value = random() | OPAQUE_BLACK;
+		Store32(&background[i], value);
+	}
+	return background;
+}
+
+static bool CheckCursor(const TEST_CURSOR &cursor)
+{
+	CURSOR_IMAGE image;
+	if (!DecodeCursorShape(cursor.GetShape(), image)) {
+		printf("FAIL %s: not decoded\n", cursor.Name.c_str());
+		return false;
+	}
+	if (image.IsXorImage != cursor.ExpectXor) {
+		printf("FAIL %s: IsXorImage is %d\n", cursor.Name.c_str(), image.IsXorImage);
+		return false;
+	}
+	for (size_t i = 0; i < cursor.Expected.size(); i++) {
+		uint32_t pixel = Load32(&image.Pixels[i * 4]);
+		if (pixel != cursor.Expected[i]) {
+			printf("FAIL %s: pixel %zu is %08X, expected %08X\n", cursor.Name.c_str(), i, pixel, cursor.Expected[i]);
+			return false;
+		}
+	}
+	for (uint32_t seed = 1; seed <= 4; seed++) {
+		const uint32_t backgroundPitch = image.Width * 4 + 8;
+		vector<uint8_t> legacy = MakeBackground(backgroundPitch / 4, image.Height, seed);
+		vector<uint8_t> cached = legacy;
+		vector<uint32_t> initBuffer;
+		DrawLegacy(cursor, legacy, backgroundPitch, initBuffer);
+		BlendCursorImage(image, cached.data(), backgroundPitch);
+		if (legacy != cached) {
+			for (size_t i = 0; i < legacy.size(); i += 4) {
+				if (Load32(&legacy[i]) != Load32(&cached[i])) {
+					printf("FAIL %s: drawn pixel %zu is %08X, old drawing is %08X\n", cursor.Name.c_str(), i / 4, Load32(&cached[i]), Load32(&legacy[i]));
+					break;
+				}
+			}
+			return false;
+		}
+	}
+	return true;
+}
+
+static double MeasureNanos(int iterations, const function<void()> &action)
+{
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		action();
+	}
+	return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main()
+{
+	vector<TEST_CURSOR> cursors;
+	cursors.push_back(MakeMonochrome("arrow 12x18", ARROW, 12, 18, 1, 12, 0xAA));
+	cursors.push_back(MakeMonochrome("arrow 32x18", ARROW, 12, 18, 1, 32, 0x55));
+	cursors.push_back(MakeMonochrome("i-beam 7x11", IBEAM, 7, 11, 1, 7, 0xFF));
+	cursors.push_back(MakeMonochrome("i-beam 32x33", IBEAM, 7, 11, 3, 32, 0x00));
+	cursors.push_back(MakeMonochrome("arrow 256x252", ARROW, 12, 18, 14, 256, 0x5A));
+	cursors.push_back(MakeMonochrome("i-beam 256x253", IBEAM, 7, 11, 23, 256, 0xA5));
+	cursors.push_back(MakeMaskedColor("masked 8x8", MASKED, 8, 8, 1));
+	cursors.push_back(MakeMaskedColor("masked 256x256", MASKED, 8, 8, 32));
+	cursors.push_back(MakeColor("color 32x32", 32));
+	cursors.push_back(MakeColor("color 256x256", 256));
+
+	bool isOk = true;
+	for (const TEST_CURSOR &cursor : cursors) {
+		bool isCursorOk = CheckCursor(cursor);
+		printf("%-16s %s\n", cursor.Name.c_str(), isCursorOk ? "ok" : "FAILED");
+		isOk &= isCursorOk;
+	}
+
+	//The hash ignores row padding, and changes with any pixel.
+	TEST_CURSOR padded = MakeMonochrome("arrow", ARROW, 12, 18, 1, 12, 0x11);
+	TEST_CURSOR otherPadding = MakeMonochrome("arrow", ARROW, 12, 18, 1, 12, 0xEE);
+	if (HashCursorShape(padded.GetShape()) != HashCursorShape(otherPadding.GetShape())) {
+		printf("FAIL: hash depends on row padding\n");
+		isOk = false;
+	}
+	for (size_t i = 0; i < cursors.size(); i++) {
+		for (size_t j = i + 1; j < cursors.size(); j++) {
+			if (HashCursorShape(cursors[i].GetShape()) == HashCursorShape(cursors[j].GetShape())) {
+				printf("FAIL: %s and %s have the same hash\n", cursors[i].Name.c_str(), cursors[j].Name.c_str());
+				isOk = false;
+			}
+		}
+	}
+	TEST_CURSOR changed = padded;
+	changed.Buffer[3 * changed.Pitch] ^= 0x40;
+	if (HashCursorShape(changed.GetShape()) == HashCursorShape(padded.GetShape())) {
+		printf("FAIL: hash doesn't change with a pixel\n");
+		isOk = false;
+	}
+	TEST_CURSOR truncated = padded;
+	truncated.Buffer.resize(truncated.Buffer.size() - truncated.Pitch);
+	CURSOR_IMAGE image;
+	if (DecodeCursorShape(truncated.GetShape(), image)) {
+		printf("FAIL: a buffer that is too small was decoded\n");
+		isOk = false;
+	}
+
+	printf("\nCPU cost per frame of drawing an unchanged cursor:\n");
+	printf("%-16s %14s %14s %18s\n", "cursor", "before (us)", "after (us)", "shape change (us)");
+	for (const TEST_CURSOR &cursor : cursors) {
+		const CURSOR_SHAPE shape = cursor.GetShape();
+		const uint32_t height = shape.Type == CursorShapeType::Monochrome ? shape.Height / 2 : shape.Height;
+		vector<uint8_t> background = MakeBackground(shape.Width, height, 7);
+		vector<uint32_t> initBuffer;
+		const int iterations = shape.Width > 64 ? 200 : 5000;
+		double before = MeasureNanos(iterations, [&] { DrawLegacy(cursor, background, shape.Width * 4, initBuffer); });
+		//The cached path only compares the shape buffer, version and info with the ones it hashed last.
+		volatile uint64_t version = 1;
+		uint64_t lastVersion = 1;
+		size_t misses = 0;
+		double after = MeasureNanos(iterations * 100, [&] { if (version != lastVersion) misses++; });
+		double change = MeasureNanos(iterations, [&] {
+			CURSOR_IMAGE decoded;
+			volatile uint64_t hash = HashCursorShape(shape);
+			DecodeCursorShape(shape, decoded);
+			(void)hash;
+			});
+		printf("%-16s %14.2f %14.4f %18.2f\n", cursor.Name.c_str(), before / 1000, after / 1000, change / 1000);
+		(void)misses;
+	}
+	printf("\n%s\n", isOk ? "All checks passed" : "CHECKS FAILED");
+	return isOk ? 0 : 1;
+}
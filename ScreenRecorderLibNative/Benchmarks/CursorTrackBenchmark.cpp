@@ -0,0 +1,294 @@
+//Checks that a cursor track written by CursorTrackWriter is read back unchanged by CursorTrackReader, and drawn by CursorTrackRenderer
+//the same way the cursor is drawn into frames. Measures the cost of writing a pointer update and of drawing the pointer on a frame,
+//and the size of the track for a minute of pointer movement.
+//The track doesn't depend on Windows, so the benchmark runs on Linux.
+//
+//Build and run from this directory:
+//  g++ -std=c++17 -O2 -I.. CursorTrackBenchmark.cpp ../CursorTrack.cpp ../CursorShape.cpp -o cursor_track_benchmark
+//  ./cursor_track_benchmark
+
+#include "CursorTrack.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+struct TEST_SHAPE {
+	CursorShapeType Type = CursorShapeType::Color;
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	uint32_t Pitch = 0;
+	vector<uint8_t> Buffer;
+
+	CURSOR_SHAPE GetShape() const
+	{
+		CURSOR_SHAPE shape;
+		shape.Type = Type;
+		shape.Width = Width;
+		shape.Height = Height;
+		shape.Pitch = Pitch;
+		shape.Buffer = Buffer.data();
+		shape.BufferSize = Buffer.size();
+		return shape;
+	}
+};
+
+/// <summary>
+/// Returns a color shape with random pixels, with padding at the end of each row.
+/// </summary>
+static TEST_SHAPE MakeColorShape(uint32_t size, uint32_t seed)
+{
+	TEST_SHAPE shape;
+	shape.Type = CursorShapeType::Color;
+	shape.Width = size;
+	shape.Height = size;
+	shape.Pitch = size * 4 + 12;
+	shape.Buffer.resize(static_cast<size_t>(shape.Pitch) * size);
+	mt19937 random(seed);
+	for (uint8_t &value : shape.Buffer) {
+		value = static_cast<uint8_t>(random());
+	}
+	return shape;
+}
+
+/// <summary>
+/// Returns a monochrome shape with random masks.
+/// </summary>
+static TEST_SHAPE MakeMonochromeShape(uint32_t size, uint32_t seed)
+{
+	TEST_SHAPE shape;
+	shape.Type = CursorShapeType::Monochrome;
+	shape.Width = size;
+	shape.Height = size * 2;
+	shape.Pitch = (size + 7) / 8;
+	shape.Buffer.resize(static_cast<size_t>(shape.Pitch) * shape.Height);
+	mt19937 random(seed);
+	for (uint8_t &value : shape.Buffer) {
+		value = static_cast<uint8_t>(random());
+	}
+	return shape;
+}
+
+static wstring GetTrackPath()
+{
+	return (filesystem::temp_directory_path() / "cursor_track_benchmark.cursor").wstring();
+}
+
+static CURSOR_TRACK_POINTER MakePointer(int64_t timestamp, int32_t left, int32_t top, uint32_t size, bool isVisible)
+{
+	CURSOR_TRACK_POINTER pointer;
+	pointer.Timestamp = timestamp;
+	pointer.Left = left;
+	pointer.Top = top;
+	pointer.Width = size;
+	pointer.Height = size;
+	pointer.IsVisible = isVisible;
+	return pointer;
+}
+
+static bool CheckRoundTrip()
+{
+	TEST_SHAPE arrow = MakeColorShape(32, 1);
+	TEST_SHAPE ibeam = MakeMonochromeShape(32, 2);
+	CursorTrackWriter writer;
+	if (!writer.Open(GetTrackPath())) {
+		return false;
+	}
+	CURSOR_TRACK_VIEWPORT viewport;
+	viewport.SourceWidth = 1920;
+	viewport.SourceHeight = 1080;
+	viewport.DestinationWidth = 1920;
+	viewport.DestinationHeight = 1080;
+	viewport.OutputWidth = 1920;
+	viewport.OutputHeight = 1080;
+	writer.WriteViewport(viewport);
+	//The same viewport again is not written.
+	writer.WriteViewport(viewport);
+	writer.WritePointer(MakePointer(0, 10, 20, 32, true), arrow.GetShape(), 0, 0, 1);
+	//Unchanged, so not written.
+	writer.WritePointer(MakePointer(100, 10, 20, 32, true), arrow.GetShape(), 0, 0, 1);
+	writer.WritePointer(MakePointer(200, -5, 30, 32, true), ibeam.GetShape(), 16, 16, 2);
+	//The arrow again, with a new shape version. It is found by its hash, and gets its old id.
+	writer.WritePointer(MakePointer(300, 50, 60, 32, true), arrow.GetShape(), 0, 0, 3);
+	writer.WritePointer(MakePointer(400, 50, 60, 32, false), arrow.GetShape(), 0, 0, 3);
+	//The position of a hidden pointer is not written.
+	writer.WritePointer(MakePointer(500, 70, 80, 32, false), arrow.GetShape(), 0, 0, 3);
+	MOUSE_INPUT_EVENT click;
+	click.Timestamp = 250;
+	click.Type = MouseInputEventType::ButtonDown;
+	click.Button = MouseInputButton::Left;
+	click.X = -3;
+	click.Y = 46;
+	writer.WriteMouseEvent(click);
+	viewport.Timestamp = 600;
+	viewport.DestinationLeft = 240;
+	viewport.DestinationWidth = 1440;
+	writer.WriteViewport(viewport);
+	uint64_t size = writer.GetSize();
+	if (!writer.Close() || filesystem::file_size(GetTrackPath()) != size) {
+		return false;
+	}
+
+	CursorTrackReader reader;
+	if (!reader.Load(GetTrackPath())) {
+		return false;
+	}
+	const vector<CURSOR_TRACK_POINTER> &pointers = reader.GetPointers();
+	if (reader.GetViewports().size() != 2 || pointers.size() != 4 || reader.GetMouseEvents().size() != 1) {
+		return false;
+	}
+	if (pointers[0].Timestamp != 0 || pointers[1].Timestamp != 200 || pointers[1].Left != -5 || pointers[2].ShapeId != pointers[0].ShapeId
+		|| pointers[1].ShapeId == pointers[0].ShapeId || pointers[3].IsVisible) {
+		return false;
+	}
+	const CURSOR_TRACK_SHAPE *pShape = reader.GetShape(pointers[1].ShapeId);
+	if (!pShape || pShape->Type != CursorShapeType::Monochrome || pShape->Height != 64 || pShape->HotSpotX != 16 || pShape->Buffer != ibeam.Buffer) {
+		return false;
+	}
+	//Color rows are stored without their padding.
+	pShape = reader.GetShape(pointers[0].ShapeId);
+	if (!pShape || pShape->Pitch != 128 || memcmp(pShape->Buffer.data() + 128, arrow.Buffer.data() + arrow.Pitch, 128) != 0) {
+		return false;
+	}
+	const MOUSE_INPUT_EVENT &event = reader.GetMouseEvents()[0];
+	if (event.Timestamp != 250 || event.Button != MouseInputButton::Left || event.X != -3 || event.Y != 46) {
+		return false;
+	}
+	if (reader.GetPointerAt(-1) || reader.GetPointerAt(199)->Timestamp != 0 || reader.GetPointerAt(1000)->Timestamp != 400) {
+		return false;
+	}
+	if (reader.GetViewportAt(599)->DestinationLeft != 0 || reader.GetViewportAt(600)->DestinationLeft != 240) {
+		return false;
+	}
+
+	//A recording that did not finish leaves a truncated record, which is ignored.
+	vector<uint8_t> data(static_cast<size_t>(size));
+	FILE *pFile = fopen(filesystem::path(GetTrackPath()).c_str(), "rb");
+	bool isReadOk = pFile && fread(data.data(), 1, data.size(), pFile) == data.size();
+	if (pFile) {
+		fclose(pFile);
+	}
+	filesystem::remove(GetTrackPath());
+	CursorTrackReader truncated;
+	if (!isReadOk || !truncated.Parse(data.data(), data.size() - 3) || truncated.GetViewports().size() != 1 || truncated.GetPointers().size() != 4) {
+		return false;
+	}
+	data[0] = 'X';
+	return !truncated.Parse(data.data(), data.size());
+}
+
+/// <summary>
+/// Draws the pointer with the renderer, and compares it with the decoded shape drawn at the mapped position.
+/// </summary>
+static bool CheckRender()
+{
+	TEST_SHAPE shape = MakeColorShape(32, 3);
+	const vector<uint8_t> trackData = [&]() {
+		CursorTrackWriter writer;
+		writer.Open(GetTrackPath());
+		//A 1000x500 source letterboxed into a 1000x1000 video.
+		CURSOR_TRACK_VIEWPORT viewport;
+		viewport.SourceLeft = 100;
+		viewport.SourceWidth = 1000;
+		viewport.SourceHeight = 500;
+		viewport.DestinationTop = 250;
+		viewport.DestinationWidth = 1000;
+		viewport.DestinationHeight = 500;
+		viewport.OutputWidth = 1000;
+		viewport.OutputHeight = 1000;
+		writer.WriteViewport(viewport);
+		writer.WritePointer(MakePointer(0, 300, 100, 32, true), shape.GetShape(), 0, 0, 1);
+		writer.Close();
+		vector<uint8_t> data(static_cast<size_t>(filesystem::file_size(GetTrackPath())));
+		FILE *pFile = fopen(filesystem::path(GetTrackPath()).c_str(), "rb");
+		fread(data.data(), 1, data.size(), pFile);
+		fclose(pFile);
+		filesystem::remove(GetTrackPath());
+		return data;
+	}();
+	CursorTrackReader reader;
+	if (!reader.Parse(trackData.data(), trackData.size())) {
+		return false;
+	}
+	CURSOR_IMAGE image;
+	CURSOR_SHAPE unpadded = shape.GetShape();
+	unpadded.Pitch = reader.GetShape(1)->Pitch;
+	unpadded.Buffer = reader.GetShape(1)->Buffer.data();
+	unpadded.BufferSize = reader.GetShape(1)->Buffer.size();
+	if (!DecodeCursorShape(unpadded, image)) {
+		return false;
+	}
+	//Drawn on a half size frame, the pointer lands at (300 - 100) / 2, (100 + 250) / 2, at half size.
+	const uint32_t width = 500, height = 500, pitch = width * 4;
+	vector<uint8_t> background(static_cast<size_t>(pitch) * height);
+	mt19937 random(4);
+	for (uint8_t &value : background) {
+		value = static_cast<uint8_t>(random());
+	}
+	vector<uint8_t> rendered = background;
+	vector<uint8_t> expected = background;
+	CursorTrackRenderer renderer(reader);
+	if (!renderer.Render(10, rendered.data(), width, height, pitch)) {
+		return false;
+	}
+	DrawCursorImage(image, 100, 175, 16, 16, expected.data(), width, height, pitch);
+	if (rendered != expected || rendered == background) {
+		return false;
+	}
+	//Before the first pointer record there is nothing to draw.
+	return !renderer.Render(-1, rendered.data(), width, height, pitch);
+}
+
+int main()
+{
+	bool isOk = true;
+	bool isCheckOk = CheckRoundTrip();
+	printf("round trip  %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckRender();
+	printf("render      %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+
+	//A minute of the pointer moving at 60 updates per second, switching between two shapes every second, with a click every second.
+	TEST_SHAPE shapes[2] = { MakeColorShape(32, 5), MakeColorShape(48, 6) };
+	const int updates = 60 * 60;
+	CursorTrackWriter writer;
+	writer.Open(GetTrackPath());
+	CURSOR_TRACK_VIEWPORT viewport;
+	viewport.SourceWidth = viewport.DestinationWidth = viewport.OutputWidth = 1920;
+	viewport.SourceHeight = viewport.DestinationHeight = viewport.OutputHeight = 1080;
+	writer.WriteViewport(viewport);
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < updates; i++) {
+		int64_t timestamp = i * 166667LL;
+		const TEST_SHAPE &shape = shapes[(i / 60) % 2];
+		writer.WritePointer(MakePointer(timestamp, i % 1920, i % 1080, shape.Width, true), shape.GetShape(), 0, 0, 1 + i / 60);
+		if (i % 60 == 30) {
+			MOUSE_INPUT_EVENT click;
+			click.Timestamp = timestamp;
+			writer.WriteMouseEvent(click);
+		}
+	}
+	writer.Close();
+	double writeNanos = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / updates;
+	uint64_t trackSize = writer.GetSize();
+
+	CursorTrackReader reader;
+	reader.Load(GetTrackPath());
+	filesystem::remove(GetTrackPath());
+	CursorTrackRenderer renderer(reader);
+	vector<uint8_t> frame(1920 * 1080 * 4);
+	renderer.Render(0, frame.data(), 1920, 1080, 1920 * 4);
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < updates; i++) {
+		renderer.Render(i * 166667LL, frame.data(), 1920, 1080, 1920 * 4);
+	}
+	double renderNanos = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / updates;
+	printf("\nwrite %.0f ns per pointer update, render %.0f ns per 1080p frame\n", writeNanos, renderNanos);
+	printf("track size for a minute at 60 updates per second: %llu bytes\n", static_cast<unsigned long long>(trackSize));
+	return isOk ? 0 : 1;
+}
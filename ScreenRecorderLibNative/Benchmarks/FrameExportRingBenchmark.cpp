@@ -0,0 +1,301 @@
+//Checks the slot ownership protocol of the frame export ring, with a writer and readers in separate processes sharing the ring through POSIX shared memory,
+//and measures how fast frames are passed from one process to another. The ring builds against shm_open and mmap off Windows, so the benchmark runs on Linux.
+//
+//Build and run from this directory:
+//  g++ -std=c++17 -O2 -I.. FrameExportRingBenchmark.cpp ../FrameExportRing.cpp -o frame_export_ring_benchmark -lrt
+//  ./frame_export_ring_benchmark
+//
+//Every pixel of a frame is derived from its sequence number, so a reader can tell a frame that was torn or overwritten while it was held.
+
+#include "FrameExportLayout.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const uint32_t FRAME_WIDTH = 64;
+static const uint32_t FRAME_HEIGHT = 32;
+static const uint32_t FRAME_BYTES = FRAME_WIDTH * FRAME_HEIGHT * 4;
+
+static wstring GetRingName(const char *purpose)
+{
+	string name = "ScreenRecorderLibBenchmark_" + to_string(getpid()) + "_" + purpose;
+	return wstring(name.begin(), name.end());
+}
+
+static uint32_t GetPixel(uint64_t sequence, uint32_t index)
+{
+	return static_cast<uint32_t>(sequence * 0x9E3779B1) ^ index;
+}
+
+/// <summary>
+/// Returns the pixels of a frame, with a stride of stridePixels to check that the writer removes row padding.
+/// </summary>
+static vector<uint32_t> MakeFrame(uint64_t sequence, uint32_t stridePixels = FRAME_WIDTH)
+{
+	vector<uint32_t> pixels(static_cast<size_t>(stridePixels) * FRAME_HEIGHT, 0xDEADBEEF);
+	for (uint32_t y = 0; y < FRAME_HEIGHT; y++) {
+		for (uint32_t x = 0; x < FRAME_WIDTH; x++) {
+			pixels[y * stridePixels + x] = GetPixel(sequence, y * FRAME_WIDTH + x);
+		}
+	}
+	return pixels;
+}
+
+static bool WriteFrame(FrameExportWriter &writer, uint64_t sequence, uint32_t stridePixels = FRAME_WIDTH)
+{
+	vector<uint32_t> pixels = MakeFrame(sequence, stridePixels);
+	return writer.Write(static_cast<int64_t>(sequence) * 10000, FRAME_WIDTH, FRAME_HEIGHT, stridePixels * 4, FrameExportFormat::Bgra32, reinterpret_cast<const uint8_t *>(pixels.data()));
+}
+
+/// <summary>
+/// Returns true if the view holds a whole frame with the given sequence number, with tightly packed rows.
+/// </summary>
+static bool IsFrame(const FRAME_EXPORT_VIEW &view, uint64_t sequence)
+{
+	if (!view.pData
+		|| view.Sequence != sequence
+		|| view.Timestamp != static_cast<int64_t>(sequence) * 10000
+		|| view.Width != FRAME_WIDTH
+		|| view.Height != FRAME_HEIGHT
+		|| view.Stride != FRAME_WIDTH * 4
+		|| view.DataSize != FRAME_BYTES
+		|| view.Format != FrameExportFormat::Bgra32) {
+		return false;
+	}
+	const uint32_t *pPixels = reinterpret_cast<const uint32_t *>(view.pData);
+	for (uint32_t i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++) {
+		if (pPixels[i] != GetPixel(sequence, i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// <summary>
+/// A reader that falls behind gets the newest frame, and the frames in between are overwritten oldest first.
+/// Slots held by readers are skipped and left unchanged, and frames are only dropped when every slot is held.
+/// </summary>
+static bool CheckSlotOwnership()
+{
+	wstring name = GetRingName("slots");
+	FrameExportWriter writer;
+	FrameExportReader reader;
+	bool isOk = !reader.Open(name);
+	isOk &= writer.Create(name, 3, FRAME_BYTES) && reader.Open(name);
+	FRAME_EXPORT_VIEW view{};
+	isOk &= !reader.TryAcquireLatest(0, &view);
+	//Frames 1 to 5 go to slots 0, 1, 2, 0, 1, each overwriting the oldest frame.
+	for (uint64_t sequence = 1; sequence <= 5; sequence++) {
+		isOk &= WriteFrame(writer, sequence, FRAME_WIDTH + 3);
+	}
+	FRAME_EXPORT_VIEW held5{};
+	isOk &= reader.TryAcquireLatest(2, &held5) && IsFrame(held5, 5) && held5.SlotIndex == 1;
+	isOk &= !reader.TryAcquireLatest(5, &view);
+
+	//Slot 1 is held, so frames 6, 7 and 8 go to slots 2, 0 and 2.
+	for (uint64_t sequence = 6; sequence <= 8; sequence++) {
+		isOk &= WriteFrame(writer, sequence);
+	}
+	FRAME_EXPORT_VIEW held8{};
+	isOk &= reader.TryAcquireLatest(5, &held8) && IsFrame(held8, 8) && held8.SlotIndex == 2;
+	//With slots 1 and 2 held, every frame goes to slot 0.
+	isOk &= WriteFrame(writer, 9) && WriteFrame(writer, 10);
+	FRAME_EXPORT_VIEW held10{};
+	isOk &= reader.TryAcquireLatest(8, &held10) && IsFrame(held10, 10) && held10.SlotIndex == 0;
+	//A slot can be held by several readers at once.
+	FRAME_EXPORT_VIEW held10Again{};
+	isOk &= reader.TryAcquireLatest(0, &held10Again) && held10Again.SlotIndex == 0;
+	isOk &= !WriteFrame(writer, 11) && writer.GetStats().DroppedFrames == 1;
+	isOk &= IsFrame(held5, 5) && IsFrame(held8, 8) && IsFrame(held10, 10);
+
+	reader.Release(held5);
+	isOk &= WriteFrame(writer, 11);
+	isOk &= reader.TryAcquireLatest(10, &view) && IsFrame(view, 11) && view.SlotIndex == 1;
+	reader.Release(view);
+	reader.Release(held10);
+	isOk &= WriteFrame(writer, 12);
+	//Slot 0 is still held once.
+	isOk &= reader.TryAcquireLatest(11, &view) && IsFrame(view, 12) && view.SlotIndex == 1;
+	reader.Release(view);
+	reader.Release(held10Again);
+	reader.Release(held8);
+	isOk &= WriteFrame(writer, 13);
+	//Slot 2 has the oldest frame again.
+	isOk &= reader.TryAcquireLatest(12, &view) && IsFrame(view, 13) && view.SlotIndex == 2;
+	reader.Release(view);
+
+	//A frame that doesn't fit in a slot is dropped, and a ring that exists with a different layout is not reused.
+	vector<uint8_t> large(FRAME_BYTES * 2);
+	isOk &= !writer.Write(0, FRAME_WIDTH * 2, FRAME_HEIGHT, FRAME_WIDTH * 8, FrameExportFormat::Bgra32, large.data());
+	FrameExportWriter otherWriter;
+	isOk &= !otherWriter.Create(name, 4, FRAME_BYTES);
+	FRAME_EXPORT_STATS stats = writer.GetStats();
+	return isOk && stats.WrittenFrames == 13 && stats.DroppedFrames == 2;
+}
+
+/// <summary>
+/// More damage rects than fit in a slot are merged into their bounding rect.
+/// </summary>
+static bool CheckDamageRects()
+{
+	wstring name = GetRingName("damage");
+	FrameExportWriter writer;
+	FrameExportReader reader;
+	bool isOk = writer.Create(name, 2, FRAME_BYTES) && reader.Open(name);
+	vector<uint32_t> pixels = MakeFrame(1);
+	vector<FRAME_EXPORT_RECT> rects;
+	for (int32_t i = 0; i < 3; i++) {
+		rects.push_back(FRAME_EXPORT_RECT{ i, i, i + 2, i + 2 });
+	}
+	isOk &= writer.Write(10000, FRAME_WIDTH, FRAME_HEIGHT, FRAME_WIDTH * 4, FrameExportFormat::Bgra32, reinterpret_cast<const uint8_t *>(pixels.data()), rects.data(), 3);
+	FRAME_EXPORT_VIEW view{};
+	isOk &= reader.TryAcquireLatest(0, &view) && view.DamageRectCount == 3 && view.pDamageRects[2].Right == 4;
+	reader.Release(view);
+	for (int32_t i = 3; i < 20; i++) {
+		rects.push_back(FRAME_EXPORT_RECT{ i, 1, i + 2, 3 });
+	}
+	pixels = MakeFrame(2);
+	isOk &= writer.Write(20000, FRAME_WIDTH, FRAME_HEIGHT, FRAME_WIDTH * 4, FrameExportFormat::Bgra32, reinterpret_cast<const uint8_t *>(pixels.data()), rects.data(), static_cast<uint32_t>(rects.size()));
+	isOk &= reader.TryAcquireLatest(1, &view) && IsFrame(view, 2) && view.DamageRectCount == 1;
+	if (isOk) {
+		const FRAME_EXPORT_RECT &bounds = view.pDamageRects[0];
+		isOk &= bounds.Left == 0 && bounds.Top == 0 && bounds.Right == 21 && bounds.Bottom == 4;
+	}
+	reader.Release(view);
+	return isOk;
+}
+
+struct READER_RESULT {
+	uint64_t Frames = 0;
+	uint64_t Skipped = 0;
+};
+
+/// <summary>
+/// Reads frames until the last one, checking each frame when it is acquired and again after holding it for holdMicros, to catch a frame that was torn
+/// or overwritten while held. Runs in a child process, and reports through its exit code and a pipe.
+/// </summary>
+static int RunReader(const wstring &name, uint64_t lastSequence, int holdMicros, int resultFd)
+{
+	FrameExportReader reader;
+	auto start = chrono::steady_clock::now();
+	while (!reader.Open(name)) {
+		if (chrono::steady_clock::now() - start > chrono::seconds(10)) {
+			return 2;
+		}
+		this_thread::yield();
+	}
+	READER_RESULT result{};
+	uint64_t sequence = 0;
+	while (sequence < lastSequence) {
+		if (chrono::steady_clock::now() - start > chrono::seconds(60)) {
+			return 3;
+		}
+		FRAME_EXPORT_VIEW view{};
+		if (!reader.TryAcquireLatest(sequence, &view)) {
+			this_thread::yield();
+			continue;
+		}
+		bool isValid = view.Sequence > sequence && IsFrame(view, view.Sequence);
+		if (holdMicros > 0) {
+			this_thread::sleep_for(chrono::microseconds(holdMicros));
+			isValid &= IsFrame(view, view.Sequence);
+		}
+		reader.Release(view);
+		if (!isValid) {
+			return 1;
+		}
+		result.Frames++;
+		result.Skipped += view.Sequence - sequence - 1;
+		sequence = view.Sequence;
+	}
+	return write(resultFd, &result, sizeof(result)) == sizeof(result) ? 0 : 4;
+}
+
+/// <summary>
+/// Writes frames as fast as possible while readers in other processes acquire them. Every acquired frame must be whole, and the frames a reader skipped must
+/// add up with the ones it read. Frames may only be dropped when there are at least as many readers as slots.
+/// </summary>
+static bool CheckProcesses(const char *purpose, uint32_t slotCount, uint32_t readerCount, int holdMicros, uint64_t frameCount, double *pFramesPerSecond)
+{
+	wstring name = GetRingName(purpose);
+	FrameExportWriter writer;
+	if (!writer.Create(name, slotCount, FRAME_BYTES)) {
+		return false;
+	}
+	int pipeFds[2];
+	if (pipe(pipeFds) != 0) {
+		return false;
+	}
+	vector<pid_t> readers;
+	for (uint32_t r = 0; r < readerCount; r++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(pipeFds[0]);
+			//_exit skips the destructors, so the child doesn't unlink the ring of the parent's writer.
+			_exit(RunReader(name, frameCount, holdMicros, pipeFds[1]));
+		}
+		readers.push_back(pid);
+	}
+	close(pipeFds[1]);
+
+	auto start = chrono::steady_clock::now();
+	uint64_t sequence = 0;
+	while (sequence < frameCount) {
+		//The writer only numbers the frames it writes, so a dropped frame is written again to keep the content in step with the sequence.
+		if (WriteFrame(writer, sequence + 1)) {
+			sequence++;
+		}
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	*pFramesPerSecond = frameCount / seconds;
+
+	bool isOk = true;
+	for (pid_t pid : readers) {
+		int status = 0;
+		isOk &= waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+	for (uint32_t r = 0; r < readerCount && isOk; r++) {
+		READER_RESULT result{};
+		isOk &= read(pipeFds[0], &result, sizeof(result)) == sizeof(result) && result.Frames + result.Skipped == frameCount && result.Frames > 0;
+	}
+	close(pipeFds[0]);
+	FRAME_EXPORT_STATS stats = writer.GetStats();
+	isOk &= stats.WrittenFrames == frameCount;
+	if (readerCount < slotCount) {
+		isOk &= stats.DroppedFrames == 0;
+	}
+	return isOk;
+}
+
+int main()
+{
+	bool isOk = true;
+	bool isCheckOk = CheckSlotOwnership();
+	printf("slot ownership               %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckDamageRects();
+	printf("damage rects                 %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	double framesPerSecond = 0;
+	isCheckOk = CheckProcesses("one", 3, 1, 0, 200000, &framesPerSecond);
+	printf("one reader process           %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	double lappedFramesPerSecond = 0;
+	isCheckOk = CheckProcesses("lagging", 3, 2, 200, 100000, &lappedFramesPerSecond);
+	printf("two lagging reader processes %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	double heldFramesPerSecond = 0;
+	isCheckOk = CheckProcesses("held", 2, 4, 50, 50000, &heldFramesPerSecond);
+	printf("four readers of two slots    %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+
+	printf("\n%ux%u frames written at %.0f per second with one reader, and %.0f per second with two lagging readers\n",
+		FRAME_WIDTH, FRAME_HEIGHT, framesPerSecond, lappedFramesPerSecond);
+	return isOk ? 0 : 1;
+}
@@ -0,0 +1,318 @@
+//Checks the FramePoolPolicy that sizes the Windows Graphics Capture frame pool, and replays resize traces through it to count how often the pool is recreated,
+//compared to recreating it on every change of the content size. The policy doesn't depend on Windows, so the benchmark runs on Linux.
+//
+//Build and run from this directory:
+//  g++ -std=c++17 -O2 -I.. FramePoolPolicyBenchmark.cpp ../FramePoolPolicy.cpp -o frame_pool_policy_benchmark
+//  ./frame_pool_policy_benchmark [trace file]
+//
+//The built in traces follow a window being dragged, maximized and restored, and a display being rotated, at 60 frames per second.
+//A trace file has a line per frame with the present time and hold time in 100 nanosecond units and the content width and height:
+//  <present time> <hold time> <width> <height>
+
+#include "FramePoolPolicy.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+//100 nanosecond units, as in FramePoolPolicy.
+static const int64_t MILLISECOND = 10000;
+static const int64_t SECOND = 1000 * MILLISECOND;
+static const int64_t FRAME_INTERVAL = 166667;
+
+static FRAME_POOL_FRAME MakeFrame(int64_t presentTime, int32_t width, int32_t height, int64_t holdTime = 2 * MILLISECOND)
+{
+	FRAME_POOL_FRAME frame;
+	frame.ContentWidth = width;
+	frame.ContentHeight = height;
+	frame.PresentTime = presentTime;
+	frame.HoldTime = holdTime;
+	return frame;
+}
+
+static bool CheckGrowth()
+{
+	FRAME_POOL_STATE state = CreateFramePoolState(FRAME_POOL_LAYOUT{ 800, 600, 1 });
+	//Content that fits doesn't change the pool.
+	state = GetNextFramePoolState(state, MakeFrame(0, 790, 600));
+	if (state.Layout != FRAME_POOL_LAYOUT{ 800, 600, 1 }) {
+		return false;
+	}
+	//Content that is 10 pixels wider grows the width by a quarter of the content, aligned, and leaves the height alone.
+	state = GetNextFramePoolState(state, MakeFrame(FRAME_INTERVAL, 810, 600));
+	if (state.Layout != FRAME_POOL_LAYOUT{ 1024, 600, 1 }) {
+		return false;
+	}
+	//Growing the height shrinks the width too, as the pool is recreated anyway and the content has left the band between half and all of it.
+	state = GetNextFramePoolState(state, MakeFrame(2 * FRAME_INTERVAL, 400, 700));
+	return state.Layout == FRAME_POOL_LAYOUT{ 512, 896, 1 }
+		&& GetFramePoolDimension(0) == 32 && GetFramePoolDimension(FRAME_POOL_MAX_DIMENSION) == FRAME_POOL_MAX_DIMENSION
+		&& GetFramePoolDimension(FRAME_POOL_MAX_DIMENSION + 1) == FRAME_POOL_MAX_DIMENSION + 1;
+}
+
+static bool CheckShrinkHysteresis()
+{
+	FRAME_POOL_STATE state = CreateFramePoolState(FRAME_POOL_LAYOUT{ 1024, 1024, 1 });
+	int64_t time = 0;
+	//Content just over half the pool keeps it for good.
+	for (; time < 10 * SECOND; time += FRAME_INTERVAL) {
+		state = GetNextFramePoolState(state, MakeFrame(time, 513, 1024));
+		if (state.Layout != FRAME_POOL_LAYOUT{ 1024, 1024, 1 } || state.IsShrinkable) {
+			return false;
+		}
+	}
+	//Content under half the pool shrinks it with the first frame after it stayed there for the shrink delay.
+	int64_t shrinkableSince = time;
+	for (; state.Layout.Width == 1024; time += FRAME_INTERVAL) {
+		if (time - shrinkableSince >= FRAME_POOL_SHRINK_DELAY + FRAME_INTERVAL) {
+			return false;
+		}
+		state = GetNextFramePoolState(state, MakeFrame(time, 500, 1024));
+	}
+	if (time - shrinkableSince < FRAME_POOL_SHRINK_DELAY || state.Layout != FRAME_POOL_LAYOUT{ 640, 1024, 1 }) {
+		return false;
+	}
+	//Going back above half the pool before the delay is over starts the delay again.
+	state = CreateFramePoolState(FRAME_POOL_LAYOUT{ 1024, 1024, 1 });
+	for (int i = 0; i < 1000; i++) {
+		state = GetNextFramePoolState(state, MakeFrame(i * FRAME_INTERVAL, (i / 60) % 2 == 0 ? 500 : 600, 1024));
+		if (state.Layout.Width != 1024) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool CheckBufferCount()
+{
+	FRAME_POOL_STATE state = CreateFramePoolState(FRAME_POOL_LAYOUT{ 1024, 1024, 2 });
+	int64_t time = 0;
+	//Frames held for 20 ms at 60 frames per second overlap the next frame, so they need 2 buffers.
+	for (int i = 0; i < 60; i++, time += FRAME_INTERVAL) {
+		state = GetNextFramePoolState(state, MakeFrame(time, 1000, 1000, 20 * MILLISECOND));
+	}
+	if (state.Layout.BufferCount != 2) {
+		return false;
+	}
+	//A stall that holds a frame for 100 ms adds buffers at once, up to the max.
+	state = GetNextFramePoolState(state, MakeFrame(time, 1000, 1000, 100 * MILLISECOND));
+	time += FRAME_INTERVAL;
+	if (state.Layout.BufferCount != FRAME_POOL_MAX_BUFFERS) {
+		return false;
+	}
+	//Short holds return the pool to a single buffer, once the stall has decayed and the shrink delay is over.
+	int64_t recoveredAt = 0;
+	for (int i = 0; i < 1000 && state.Layout.BufferCount > 1; i++, time += FRAME_INTERVAL) {
+		state = GetNextFramePoolState(state, MakeFrame(time, 1000, 1000, MILLISECOND));
+		recoveredAt = time;
+	}
+	return state.Layout == FRAME_POOL_LAYOUT{ 1024, 1024, 1 } && recoveredAt >= FRAME_POOL_SHRINK_DELAY;
+}
+
+struct TRACE_RESULT {
+	uint64_t SizeChanges;
+	//Recreations of the pool by the policy, and by recreating it on every change of the content size.
+	uint64_t Recreations;
+	uint64_t NaiveRecreations;
+	//Frames whose content didn't fit in the pool, which are dropped.
+	uint64_t ClippedFrames;
+	uint64_t NaiveClippedFrames;
+	//The largest pool area in pixels per pixel of content, and the pool at the end of the trace.
+	double MaxAreaRatio;
+	FRAME_POOL_LAYOUT FinalLayout;
+};
+
+/// <summary>
+/// Replays the frames of a trace through the policy, starting from a pool the size of the first frame, as StartCapture creates it.
+/// The naive policy recreates the pool the size of the content after every frame of a new size, as the frame pool was handled before.
+/// </summary>
+static TRACE_RESULT Replay(const vector<FRAME_POOL_FRAME> &trace)
+{
+	TRACE_RESULT result{};
+	FRAME_POOL_STATE state = CreateFramePoolState(FRAME_POOL_LAYOUT{ trace[0].ContentWidth, trace[0].ContentHeight, 2 });
+	int32_t naiveWidth = trace[0].ContentWidth;
+	int32_t naiveHeight = trace[0].ContentHeight;
+	for (size_t i = 0; i < trace.size(); i++) {
+		const FRAME_POOL_FRAME &frame = trace[i];
+		if (i > 0 && (frame.ContentWidth != trace[i - 1].ContentWidth || frame.ContentHeight != trace[i - 1].ContentHeight)) {
+			result.SizeChanges++;
+		}
+		if (frame.ContentWidth > state.Layout.Width || frame.ContentHeight > state.Layout.Height) {
+			result.ClippedFrames++;
+		}
+		if (frame.ContentWidth > naiveWidth || frame.ContentHeight > naiveHeight) {
+			result.NaiveClippedFrames++;
+		}
+		if (frame.ContentWidth != naiveWidth || frame.ContentHeight != naiveHeight) {
+			naiveWidth = frame.ContentWidth;
+			naiveHeight = frame.ContentHeight;
+			result.NaiveRecreations++;
+		}
+		FRAME_POOL_STATE next = GetNextFramePoolState(state, frame);
+		if (next.Layout != state.Layout) {
+			result.Recreations++;
+		}
+		state = next;
+		if (frame.ContentWidth > 0 && frame.ContentHeight > 0) {
+			result.MaxAreaRatio = max(result.MaxAreaRatio, (double)state.Layout.Width * state.Layout.Height / ((double)frame.ContentWidth * frame.ContentHeight));
+		}
+	}
+	result.FinalLayout = state.Layout;
+	return result;
+}
+
+/// <summary>
+/// Adds frames at 60 frames per second for the given duration, with the content size moving in a straight line to the given size.
+/// The border wanders a few pixels off the line on the way, as when a window is dragged by hand.
+/// </summary>
+static void AddFrames(vector<FRAME_POOL_FRAME> &trace, mt19937 &random, int64_t duration, int32_t width, int32_t height)
+{
+	uniform_int_distribution<int> mouseJitter(-3, 3);
+	uniform_int_distribution<int64_t> holdTime(MILLISECOND, 4 * MILLISECOND);
+	int64_t startTime = trace.empty() ? 0 : trace.back().PresentTime + FRAME_INTERVAL;
+	int32_t startWidth = trace.empty() ? width : trace.back().ContentWidth;
+	int32_t startHeight = trace.empty() ? height : trace.back().ContentHeight;
+	int64_t frames = max<int64_t>(1, duration / FRAME_INTERVAL);
+	for (int64_t i = 1; i <= frames; i++) {
+		int32_t w = static_cast<int32_t>(startWidth + (width - startWidth) * i / frames);
+		int32_t h = static_cast<int32_t>(startHeight + (height - startHeight) * i / frames);
+		if (i < frames && (w != width || h != height)) {
+			w += mouseJitter(random);
+			h += mouseJitter(random);
+		}
+		trace.push_back(MakeFrame(startTime + (i - 1) * FRAME_INTERVAL, w, h, holdTime(random)));
+	}
+}
+
+static vector<FRAME_POOL_FRAME> ReadTrace(const char *path)
+{
+	vector<FRAME_POOL_FRAME> trace;
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		return trace;
+	}
+	long long presentTime, holdTime;
+	int width, height;
+	while (fscanf(file, "%lld %lld %d %d", &presentTime, &holdTime, &width, &height) == 4) {
+		trace.push_back(MakeFrame(presentTime, width, height, holdTime));
+	}
+	fclose(file);
+	return trace;
+}
+
+static void PrintResult(const char *name, const TRACE_RESULT &result)
+{
+	printf("%-30s %5llu %5llu vs %5llu %5llu vs %5llu  %5.2f  %dx%d with %d buffers\n", name, (unsigned long long)result.SizeChanges,
+		(unsigned long long)result.Recreations, (unsigned long long)result.NaiveRecreations,
+		(unsigned long long)result.ClippedFrames, (unsigned long long)result.NaiveClippedFrames,
+		result.MaxAreaRatio, result.FinalLayout.Width, result.FinalLayout.Height, result.FinalLayout.BufferCount);
+}
+
+int main(int argc, char *argv[])
+{
+	bool isOk = true;
+	bool isCheckOk = CheckGrowth();
+	printf("geometric growth               %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckShrinkHysteresis();
+	printf("shrink hysteresis              %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckBufferCount();
+	printf("buffer count from hold time    %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+
+	struct TRACE {
+		const char *Name;
+		vector<FRAME_POOL_FRAME> Frames;
+		//The most recreations the policy may use, as a fraction of the naive policy.
+		double MaxRecreationRatio;
+	};
+	vector<TRACE> traces;
+	mt19937 random(5);
+	{
+		TRACE trace{ "drag larger", {}, 0.1 };
+		AddFrames(trace.Frames, random, SECOND, 800, 600);
+		AddFrames(trace.Frames, random, 2 * SECOND, 1600, 1200);
+		AddFrames(trace.Frames, random, 3 * SECOND, 1600, 1200);
+		traces.push_back(trace);
+	}
+	{
+		TRACE trace{ "drag smaller", {}, 0.1 };
+		AddFrames(trace.Frames, random, SECOND, 1600, 1200);
+		AddFrames(trace.Frames, random, 2 * SECOND, 640, 480);
+		AddFrames(trace.Frames, random, 3 * SECOND, 640, 480);
+		traces.push_back(trace);
+	}
+	{
+		TRACE trace{ "drag back and forth", {}, 0.1 };
+		AddFrames(trace.Frames, random, SECOND, 1000, 700);
+		for (int i = 0; i < 5; i++) {
+			AddFrames(trace.Frames, random, SECOND, 1400, 900);
+			AddFrames(trace.Frames, random, SECOND, 900, 600);
+		}
+		AddFrames(trace.Frames, random, 3 * SECOND, 900, 600);
+		traces.push_back(trace);
+	}
+	{
+		//Maximize and restore are one step each, so only holding on to the larger pool saves recreations.
+		TRACE trace{ "maximize and restore", {}, 0.25 };
+		AddFrames(trace.Frames, random, SECOND, 1280, 720);
+		for (int i = 0; i < 5; i++) {
+			AddFrames(trace.Frames, random, FRAME_INTERVAL, 1920, 1040);
+			AddFrames(trace.Frames, random, SECOND, 1920, 1040);
+			AddFrames(trace.Frames, random, FRAME_INTERVAL, 1280, 720);
+			AddFrames(trace.Frames, random, SECOND, 1280, 720);
+		}
+		AddFrames(trace.Frames, random, 3 * SECOND, 1280, 720);
+		traces.push_back(trace);
+	}
+	{
+		//Windows 10 borders can make the content size of a window flicker by a pixel or two.
+		TRACE trace{ "border flicker", {}, 0.1 };
+		AddFrames(trace.Frames, random, SECOND, 1280, 720);
+		for (int i = 0; i < 300; i++) {
+			AddFrames(trace.Frames, random, FRAME_INTERVAL, 1280 + i % 3, 720 + i % 2);
+		}
+		traces.push_back(trace);
+	}
+	{
+		TRACE trace{ "display rotation", {}, 1 };
+		AddFrames(trace.Frames, random, SECOND, 1920, 1080);
+		AddFrames(trace.Frames, random, FRAME_INTERVAL, 1080, 1920);
+		AddFrames(trace.Frames, random, 3 * SECOND, 1080, 1920);
+		AddFrames(trace.Frames, random, FRAME_INTERVAL, 1920, 1080);
+		AddFrames(trace.Frames, random, 3 * SECOND, 1920, 1080);
+		traces.push_back(trace);
+	}
+	if (argc > 1) {
+		TRACE trace{ argv[1], ReadTrace(argv[1]), 1 };
+		if (trace.Frames.empty()) {
+			printf("could not read a trace from %s\n", argv[1]);
+			return 1;
+		}
+		traces.push_back(trace);
+	}
+
+	printf("\n%-30s %5s %14s %14s  %5s  %s\n", "trace", "sizes", "recreations", "clipped", "area", "final pool");
+	bool isFewerRecreations = true;
+	bool isFewerClipped = true;
+	bool isFinalPoolTight = true;
+	for (const TRACE &trace : traces) {
+		TRACE_RESULT result = Replay(trace.Frames);
+		PrintResult(trace.Name, result);
+		isFewerRecreations &= result.Recreations <= result.NaiveRecreations * trace.MaxRecreationRatio;
+		isFewerClipped &= result.ClippedFrames <= result.NaiveClippedFrames;
+		//Once the content has settled for longer than the shrink delay, the pool fits it with no more than the growth margin to spare.
+		const FRAME_POOL_FRAME &last = trace.Frames.back();
+		isFinalPoolTight &= result.FinalLayout.Width >= last.ContentWidth && result.FinalLayout.Height >= last.ContentHeight
+			&& result.FinalLayout.Width <= GetFramePoolDimension(last.ContentWidth) * 2 && result.FinalLayout.Height <= GetFramePoolDimension(last.ContentHeight) * 2
+			&& result.FinalLayout.BufferCount == 1;
+	}
+	printf("\nfewer recreations              %s\n", isFewerRecreations ? "ok" : "FAILED");
+	printf("no more clipped frames         %s\n", isFewerClipped ? "ok" : "FAILED");
+	printf("pool fits settled content      %s\n", isFinalPoolTight ? "ok" : "FAILED");
+	isOk &= isFewerRecreations && isFewerClipped && isFinalPoolTight;
+	return isOk ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+//Checks how FrameTiming maps presentation times onto the media clock, and compares the frame jitter of a recording timed by when the frames were
+//acquired with one timed by when their content was presented. FrameTiming doesn't depend on Windows, so the benchmark runs on Linux.
+//
+//Build and run from this directory:
+//  g++ -std=c++17 -O2 -I.. FrameTimingBenchmark.cpp ../FrameTiming.cpp -o frame_timing_benchmark
+//  ./frame_timing_benchmark
+//
+//The simulated source presents frames at a fixed rate, and the recorder acquires them on a timer that wakes up late, and then waits a random time
+//for the shared surface, like the capture loop does on a busy system.
+
+#include "FrameTiming.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+//100 nanosecond units, as in FrameTiming.
+static const int64_t MILLISECOND = 10000;
+static const int64_t SECOND = 1000 * MILLISECOND;
+
+static bool CheckMapping()
+{
+	FrameTiming timing(33 * MILLISECOND);
+	//The media clock started 100 seconds after the performance counter.
+	const int64_t clockOffset = 100 * SECOND;
+	int64_t now = clockOffset + SECOND;
+	int64_t mediaTime = now - clockOffset;
+	//Content presented 5 ms before the acquisition starts 5 ms earlier on the media clock.
+	if (timing.GetSampleTime(now - 5 * MILLISECOND, now, mediaTime, 0) != mediaTime - 5 * MILLISECOND) {
+		return false;
+	}
+	//Content is never newer than the acquisition.
+	if (timing.GetSampleTime(now + MILLISECOND, now, mediaTime, 0) != mediaTime) {
+		return false;
+	}
+	//Content presented long before is timed at the max presentation age.
+	if (timing.GetSampleTime(now - SECOND, now, mediaTime, 0) != mediaTime - 33 * MILLISECOND) {
+		return false;
+	}
+	//Content presented before the previous frame started is shown from the acquisition.
+	if (timing.GetSampleTime(now - 20 * MILLISECOND, now, mediaTime, mediaTime - 10 * MILLISECOND) != mediaTime) {
+		return false;
+	}
+	//Frames without new content are timed by the acquisition.
+	if (timing.GetSampleTime(nullopt, now, mediaTime, 0) != mediaTime) {
+		return false;
+	}
+	FRAME_TIMING_STATS stats = timing.GetStats();
+	return stats.Frames == 5 && stats.PresentationTimedFrames == 3 && stats.LateFrames == 1 && stats.StaleFrames == 1
+		&& stats.TotalPresentationAge == 38 * MILLISECOND && stats.MaxPresentationAge == 33 * MILLISECOND;
+}
+
+static bool CheckJitter()
+{
+	FrameTiming timing(SECOND);
+	//Frames acquired at 10, 20, 30, 35 and 40 ms, with content presented at 8, 19, 25, 38 ms and no new content at 35 ms.
+	//Written when acquired, the content would be shown at 0, 10, 20 and 35 ms, which is 8, 9, 5 and 3 ms early and changes by 1, 4 and 2 ms.
+	//Timed by presentation, it is shown at 8, 19, 25 and 38 ms, which is never early or late.
+	const int64_t acquisitionTimes[] = { 10, 20, 30, 35, 40 };
+	const int64_t presentationTimes[] = { 8, 19, 25, 0, 38 };
+	int64_t previousSampleTime = -1;
+	for (int i = 0; i < 5; i++) {
+		optional<int64_t> presentationTime = presentationTimes[i] > 0 ? optional<int64_t>(presentationTimes[i] * MILLISECOND) : nullopt;
+		int64_t sampleTime = timing.GetSampleTime(presentationTime, acquisitionTimes[i] * MILLISECOND, acquisitionTimes[i] * MILLISECOND, previousSampleTime);
+		if (sampleTime != (presentationTime.has_value() ? presentationTime.value() : acquisitionTimes[i] * MILLISECOND)) {
+			return false;
+		}
+		previousSampleTime = sampleTime;
+	}
+	FRAME_TIMING_STATS stats = timing.GetStats();
+	return stats.JitterSamples == 3 && stats.TotalAcquisitionJitter == 7 * MILLISECOND && stats.TotalSampleJitter == 0
+		&& FrameTiming::GetAverageJitter(stats.TotalAcquisitionJitter, stats.JitterSamples) == 7.0 * MILLISECOND / 3;
+}
+
+struct SIMULATION_RESULT {
+	FRAME_TIMING_STATS Stats;
+	//The longest time between content being presented and the recording showing it.
+	int64_t MaxTimingError;
+	//How far the end of the last frame is behind the media clock.
+	int64_t FinalLag;
+	bool IsMonotonic;
+};
+
+/// <summary>
+/// Records 60 seconds of a source presenting frames every sourcePeriod, at an output frame rate of outputPeriod.
+/// The recorder acquires a frame one outputPeriod after it acquired the previous one, as the capture loop does, and always gets the latest content the source had
+/// written to the shared surface by then. Each frame is shown from its sample time until the next one.
+/// </summary>
+static SIMULATION_RESULT Simulate(int64_t sourcePeriod, int64_t outputPeriod, int64_t maxWakeupLateness, int64_t maxAcquireDelay, unsigned seed)
+{
+	mt19937 random(seed);
+	uniform_int_distribution<int64_t> wakeupLateness(0, maxWakeupLateness);
+	uniform_int_distribution<int64_t> acquireDelay(0, maxAcquireDelay);
+	//The capture thread writes content to the shared surface up to 2 ms after it was presented.
+	uniform_int_distribution<int64_t> writeDelay(0, 2 * MILLISECOND);
+	//The media clock started when the performance counter was at 50 seconds.
+	const int64_t clockOffset = 50 * SECOND;
+	const int64_t duration = 60 * SECOND;
+
+	vector<pair<int64_t, int64_t>> writes;
+	for (int64_t presentationTime = clockOffset; presentationTime < clockOffset + duration + SECOND; presentationTime += sourcePeriod) {
+		writes.emplace_back(presentationTime + writeDelay(random), presentationTime);
+	}
+	sort(writes.begin(), writes.end());
+
+	FrameTiming timing(outputPeriod);
+	SIMULATION_RESULT result{};
+	result.IsMonotonic = true;
+	int64_t lastSampleTime = 0;
+	int64_t lastMediaTime = 0;
+	size_t nextWrite = 0;
+	while (lastMediaTime < duration) {
+		int64_t acquisitionTime = clockOffset + lastMediaTime + outputPeriod + wakeupLateness(random) + acquireDelay(random);
+		int64_t mediaTime = acquisitionTime - clockOffset;
+		optional<int64_t> presentationTime;
+		while (nextWrite < writes.size() && writes[nextWrite].first <= acquisitionTime) {
+			presentationTime = max(presentationTime.value_or(0), writes[nextWrite].second);
+			nextWrite++;
+		}
+		int64_t sampleTime = timing.GetSampleTime(presentationTime, acquisitionTime, mediaTime, lastSampleTime);
+		if (sampleTime <= lastSampleTime || sampleTime > mediaTime) {
+			result.IsMonotonic = false;
+		}
+		if (presentationTime.has_value()) {
+			int64_t timingError = sampleTime - (presentationTime.value() - clockOffset);
+			result.MaxTimingError = max(result.MaxTimingError, timingError > 0 ? timingError : -timingError);
+		}
+		lastSampleTime = sampleTime;
+		lastMediaTime = mediaTime;
+		result.FinalLag = mediaTime - sampleTime;
+	}
+	result.Stats = timing.GetStats();
+	return result;
+}
+
+int main()
+{
+	bool isOk = true;
+	bool isCheckOk = CheckMapping();
+	printf("presentation times on media clock  %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckJitter();
+	printf("jitter of timing errors            %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+
+	struct SCENARIO {
+		const char *Name;
+		int64_t SourcePeriod;
+		int64_t OutputPeriod;
+		int64_t MaxWakeupLateness;
+		int64_t MaxAcquireDelay;
+	};
+	const SCENARIO scenarios[] = {
+		{ "60 Hz source, 30 fps, idle", 166667, 333333, MILLISECOND, MILLISECOND },
+		{ "60 Hz source, 30 fps, busy", 166667, 333333, 4 * MILLISECOND, 6 * MILLISECOND },
+		{ "60 Hz source, 60 fps, busy", 166667, 166667, 2 * MILLISECOND, 4 * MILLISECOND },
+		{ "144 Hz source, 60 fps, busy", 69444, 166667, 2 * MILLISECOND, 4 * MILLISECOND },
+		{ "30 Hz video, 60 fps, busy", 333667, 166667, 2 * MILLISECOND, 4 * MILLISECOND },
+	};
+	printf("\naverage jitter in ms for 60 seconds, timed by acquisition vs by presentation\n");
+	bool isLowerJitter = true;
+	bool isMonotonic = true;
+	for (const SCENARIO &scenario : scenarios) {
+		SIMULATION_RESULT result = Simulate(scenario.SourcePeriod, scenario.OutputPeriod, scenario.MaxWakeupLateness, scenario.MaxAcquireDelay, 4);
+		const FRAME_TIMING_STATS &stats = result.Stats;
+		double acquisitionJitter = FrameTiming::GetAverageJitter(stats.TotalAcquisitionJitter, stats.JitterSamples) / MILLISECOND;
+		double sampleJitter = FrameTiming::GetAverageJitter(stats.TotalSampleJitter, stats.JitterSamples) / MILLISECOND;
+		printf("%-28s %6.3f vs %6.3f, %5llu of %5llu frames by presentation, %.2f ms average age\n",
+			scenario.Name, acquisitionJitter, sampleJitter, (unsigned long long)stats.PresentationTimedFrames, (unsigned long long)stats.Frames,
+			stats.PresentationTimedFrames > 0 ? (double)stats.TotalPresentationAge / stats.PresentationTimedFrames / MILLISECOND : 0);
+		isLowerJitter &= sampleJitter < acquisitionJitter;
+		isMonotonic &= result.IsMonotonic && result.FinalLag <= scenario.OutputPeriod && result.MaxTimingError <= scenario.OutputPeriod;
+	}
+	printf("\npresentation timing has less jitter %s\n", isLowerJitter ? "ok" : "FAILED");
+	printf("frames stay in order on the clock   %s\n", isMonotonic ? "ok" : "FAILED");
+	isOk &= isLowerJitter && isMonotonic;
+	return isOk ? 0 : 1;
+}
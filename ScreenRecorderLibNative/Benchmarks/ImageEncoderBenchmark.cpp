@@ -0,0 +1,418 @@
+//Compares the encode time and output size of the built-in snapshot encoders in ImageEncoder.h on screen content.
+//The encoders don't depend on Windows, so the benchmark runs on Linux. zlib is used to read the PNG test images, and as the reference PNG encoder.
+//
+//Build and run from this directory:
+//  g++ -std=c++17 -O2 -msse2 -I.. ImageEncoderBenchmark.cpp ../ImageEncoder.cpp -lz -o image_encoder_benchmark
+//  ./image_encoder_benchmark ../../Testmedia
+//
+//Arguments are PNG files, or directories whose PNG files are used. Synthetic screen content images are always included.
+//The lossless encoders are checked by decoding their output and comparing it to the source.
+
+#include "ImageEncoder.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+using namespace std;
+
+struct TEST_IMAGE {
+	string Name;
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	//Pixels in Bgra32 layout, as captured frames are.
+	vector<uint8_t> Pixels;
+
+	IMAGE_BITMAP GetBitmap() const
+	{
+		IMAGE_BITMAP bitmap;
+		bitmap.pData = Pixels.data();
+		bitmap.Width = Width;
+		bitmap.Height = Height;
+		bitmap.Stride = Width * 4;
+		bitmap.Layout = ImagePixelLayout::Bgra32;
+		return bitmap;
+	}
+};
+
+static uint32_t ReadBigEndian32(const uint8_t *p)
+{
+	return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static int PaethPredictor(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+	if (pa <= pb && pa <= pc) {
+		return a;
+	}
+	return pb <= pc ? b : c;
+}
+
+/// <summary>
+/// Decodes an 8 bit non-interlaced gray, RGB or RGBA PNG to Bgra32 pixels.
+/// </summary>
+static bool DecodePng(const vector<uint8_t> &file, uint32_t &width, uint32_t &height, vector<uint8_t> &pixels)
+{
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	if (file.size() < 8 || memcmp(file.data(), signature, 8) != 0) {
+		return false;
+	}
+	int colorType = -1;
+	vector<uint8_t> compressed;
+	for (size_t pos = 8; pos + 12 <= file.size();) {
+		uint32_t length = ReadBigEndian32(file.data() + pos);
+		string type(reinterpret_cast<const char *>(file.data() + pos + 4), 4);
+		const uint8_t *pData = file.data() + pos + 8;
+		if (pos + 12 + length > file.size()) {
+			return false;
+		}
+		if (type == "IHDR") {
+			width = ReadBigEndian32(pData);
+			height = ReadBigEndian32(pData + 4);
+			if (pData[8] != 8 || pData[12] != 0) {
+				return false;
+			}
+			colorType = pData[9];
+		}
+		else if (type == "IDAT") {
+			compressed.insert(compressed.end(), pData, pData + length);
+		}
+		pos += 12 + length;
+	}
+	int channels = colorType == 0 ? 1 : colorType == 2 ? 3 : colorType == 4 ? 2 : colorType == 6 ? 4 : 0;
+	if (channels == 0) {
+		return false;
+	}
+	size_t rowSize = static_cast<size_t>(width) * channels;
+	vector<uint8_t> filtered((rowSize + 1) * height);
+	uLongf filteredSize = static_cast<uLongf>(filtered.size());
+	if (uncompress(filtered.data(), &filteredSize, compressed.data(), static_cast<uLong>(compressed.size())) != Z_OK || filteredSize != filtered.size()) {
+		return false;
+	}
+	vector<uint8_t> previous(rowSize, 0);
+	vector<uint8_t> current(rowSize);
+	pixels.resize(static_cast<size_t>(width) * height * 4);
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t *pRow = filtered.data() + y * (rowSize + 1);
+		uint8_t filter = pRow[0];
+		for (size_t x = 0; x < rowSize; x++) {
+			int a = x >= static_cast<size_t>(channels) ? current[x - channels] : 0;
+			int b = previous[x];
+			int c = x >= static_cast<size_t>(channels) ? previous[x - channels] : 0;
+			int value = pRow[1 + x];
+			switch (filter) {
+			case 1: value += a; break;
+			case 2: value += b; break;
+			case 3: value += (a + b) / 2; break;
+			case 4: value += PaethPredictor(a, b, c); break;
+			default: break;
+			}
+			current[x] = static_cast<uint8_t>(value);
+		}
+		for (uint32_t x = 0; x < width; x++) {
+			const uint8_t *pSrc = current.data() + x * channels;
+			uint8_t *pDest = pixels.data() + (static_cast<size_t>(y) * width + x) * 4;
+			if (channels <= 2) {
+				pDest[0] = pDest[1] = pDest[2] = pSrc[0];
+				pDest[3] = channels == 2 ? pSrc[1] : 255;
+			}
+			else {
+				pDest[0] = pSrc[2];
+				pDest[1] = pSrc[1];
+				pDest[2] = pSrc[0];
+				pDest[3] = channels == 4 ? pSrc[3] : 255;
+			}
+		}
+		swap(previous, current);
+	}
+	return true;
+}
+
+/// <summary>
+/// Decodes a 3 channel QOI image to Bgra32 pixels.
+/// </summary>
+static bool DecodeQoi(const vector<uint8_t> &file, uint32_t &width, uint32_t &height, vector<uint8_t> &pixels)
+{
+	if (file.size() < 22 || memcmp(file.data(), "qoif", 4) != 0) {
+		return false;
+	}
+	width = ReadBigEndian32(file.data() + 4);
+	height = ReadBigEndian32(file.data() + 8);
+	uint8_t index[64][4] = {};
+	uint8_t pixel[4] = { 0, 0, 0, 255 };
+	size_t pos = 14;
+	int run = 0;
+	pixels.resize(static_cast<size_t>(width) * height * 4);
+	for (size_t i = 0; i < static_cast<size_t>(width) * height; i++) {
+		if (run > 0) {
+			run--;
+		}
+		else if (pos < file.size() - 8) {
+			uint8_t op = file[pos++];
+			if (op == 0xFE) {
+				pixel[0] = file[pos++];
+				pixel[1] = file[pos++];
+				pixel[2] = file[pos++];
+			}
+			else if (op == 0xFF) {
+				memcpy(pixel, &file[pos], 4);
+				pos += 4;
+			}
+			else if ((op & 0xC0) == 0x00) {
+				memcpy(pixel, index[op], 4);
+			}
+			else if ((op & 0xC0) == 0x40) {
+				pixel[0] += ((op >> 4) & 3) - 2;
+				pixel[1] += ((op >> 2) & 3) - 2;
+				pixel[2] += (op & 3) - 2;
+			}
+			else if ((op & 0xC0) == 0x80) {
+				uint8_t next = file[pos++];
+				int dg = (op & 0x3F) - 32;
+				pixel[0] += dg - 8 + ((next >> 4) & 0x0F);
+				pixel[1] += dg;
+				pixel[2] += dg - 8 + (next & 0x0F);
+			}
+			else {
+				run = op & 0x3F;
+			}
+			memcpy(index[(pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64], pixel, 4);
+		}
+		uint8_t *pDest = pixels.data() + i * 4;
+		pDest[0] = pixel[2];
+		pDest[1] = pixel[1];
+		pDest[2] = pixel[0];
+		pDest[3] = 255;
+	}
+	return true;
+}
+
+/// <summary>
+/// A reference PNG written with zlib at its default level and the same single filter, to compare against the fast deflate.
+/// </summary>
+static bool EncodeZlibPng(const IMAGE_BITMAP &bitmap, int level, vector<uint8_t> &output)
+{
+	size_t rowSize = static_cast<size_t>(bitmap.Width) * 3;
+	vector<uint8_t> filtered((rowSize + 1) * bitmap.Height);
+	for (uint32_t y = 0; y < bitmap.Height; y++) {
+		uint8_t *pDest = filtered.data() + y * (rowSize + 1);
+		pDest[0] = 2;
+		for (uint32_t x = 0; x < bitmap.Width; x++) {
+			for (int c = 0; c < 3; c++) {
+				uint8_t current = bitmap.pData[static_cast<size_t>(y) * bitmap.Stride + x * 4 + 2 - c];
+				uint8_t above = y > 0 ? bitmap.pData[static_cast<size_t>(y - 1) * bitmap.Stride + x * 4 + 2 - c] : 0;
+				pDest[1 + x * 3 + c] = static_cast<uint8_t>(current - above);
+			}
+		}
+	}
+	uLongf size = compressBound(static_cast<uLong>(filtered.size()));
+	output.resize(size);
+	if (compress2(output.data(), &size, filtered.data(), static_cast<uLong>(filtered.size()), level) != Z_OK) {
+		return false;
+	}
+	output.resize(size);
+	return true;
+}
+
+static bool IsSameRgb(const TEST_IMAGE &image, uint32_t width, uint32_t height, const vector<uint8_t> &pixels)
+{
+	if (width != image.Width || height != image.Height || pixels.size() != image.Pixels.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < pixels.size(); i += 4) {
+		if (memcmp(&pixels[i], &image.Pixels[i], 3) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void FillRect(TEST_IMAGE &image, int left, int top, int right, int bottom, uint32_t color)
+{
+	for (int y = max(top, 0); y < min(bottom, static_cast<int>(image.Height)); y++) {
+		for (int x = max(left, 0); x < min(right, static_cast<int>(image.Width)); x++) {
+			memcpy(&image.Pixels[(static_cast<size_t>(y) * image.Width + x) * 4], &color, 4);
+		}
+	}
+}
+
+/// <summary>
+/// A desktop-like image: a gradient wallpaper, windows with title bars, and lines of text-like glyphs.
+/// </summary>
+static TEST_IMAGE CreateDesktopImage(uint32_t width, uint32_t height)
+{
+	TEST_IMAGE image{ "synthetic desktop " + to_string(width) + "x" + to_string(height), width, height, {} };
+	image.Pixels.resize(static_cast<size_t>(width) * height * 4);
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			uint8_t *p = &image.Pixels[(static_cast<size_t>(y) * width + x) * 4];
+			p[0] = static_cast<uint8_t>(120 + 100 * y / height);
+			p[1] = static_cast<uint8_t>(60 + 80 * x / width);
+			p[2] = 40;
+			p[3] = 255;
+		}
+	}
+	mt19937 random(1234);
+	int scale = max(1, static_cast<int>(width / 1920));
+	for (int window = 0; window < 4; window++) {
+		int left = static_cast<int>(width) * window / 5 + 40 * scale;
+		int top = static_cast<int>(height) * window / 8 + 30 * scale;
+		int right = left + static_cast<int>(width) / 2;
+		int bottom = top + static_cast<int>(height) / 2;
+		FillRect(image, left - 1, top - 1, right + 1, bottom + 1, 0xFF505050);
+		FillRect(image, left, top, right, bottom, 0xFFFFFFFF);
+		FillRect(image, left, top, right, top + 30 * scale, 0xFFE0E0E0);
+		for (int line = top + 50 * scale; line + 14 * scale < bottom; line += 20 * scale) {
+			for (int x = left + 10 * scale; x + 8 * scale < right - 10 * scale;) {
+				int wordLength = 2 + random() % 8;
+				for (int glyph = 0; glyph < wordLength && x + 8 * scale < right - 10 * scale; glyph++, x += 8 * scale) {
+					//Glyphs are a few random strokes in a 7x12 cell.
+					uint32_t pattern = random();
+					for (int stroke = 0; stroke < 6; stroke++) {
+						int sx = x + static_cast<int>((pattern >> (stroke * 5)) % 6) * scale;
+						int sy = line + static_cast<int>((pattern >> (stroke * 3)) % 10) * scale;
+						bool isVertical = (pattern >> (stroke + 24)) & 1;
+						FillRect(image, sx, sy, sx + (isVertical ? 1 : 4) * scale, sy + (isVertical ? 5 : 1) * scale, 0xFF202020);
+					}
+				}
+				x += 6 * scale;
+			}
+		}
+	}
+	return image;
+}
+
+/// <summary>
+/// A photo-like image of smooth noise, the worst case for screen content encoders.
+/// </summary>
+static TEST_IMAGE CreatePhotoImage(uint32_t width, uint32_t height)
+{
+	TEST_IMAGE image{ "synthetic photo " + to_string(width) + "x" + to_string(height), width, height, {} };
+	image.Pixels.resize(static_cast<size_t>(width) * height * 4);
+	mt19937 random(5678);
+	uniform_int_distribution<int> noise(-6, 6);
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			uint8_t *p = &image.Pixels[(static_cast<size_t>(y) * width + x) * 4];
+			double fx = static_cast<double>(x) / width;
+			double fy = static_cast<double>(y) / height;
+			p[0] = static_cast<uint8_t>(clamp(128 + 100 * sin(fx * 7 + fy * 3) + noise(random), 0.0, 255.0));
+			p[1] = static_cast<uint8_t>(clamp(128 + 90 * cos(fx * 5 - fy * 9) + noise(random), 0.0, 255.0));
+			p[2] = static_cast<uint8_t>(clamp(128 + 80 * sin(fx * fy * 20) + noise(random), 0.0, 255.0));
+			p[3] = 255;
+		}
+	}
+	return image;
+}
+
+static bool LoadPngImage(const filesystem::path &path, TEST_IMAGE &image)
+{
+	ifstream stream(path, ios::binary);
+	vector<uint8_t> file((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+	image.Name = path.filename().string();
+	return DecodePng(file, image.Width, image.Height, image.Pixels);
+}
+
+/// <summary>
+/// Runs the encoder until at least the min duration has passed, and returns the fastest time in milliseconds.
+/// </summary>
+static double MeasureEncode(const function<bool(vector<uint8_t> &)> &encode, vector<uint8_t> &output)
+{
+	const auto MIN_DURATION = chrono::milliseconds(500);
+	double fastest = 1e30;
+	auto start = chrono::steady_clock::now();
+	int iterations = 0;
+	while (iterations < 3 || chrono::steady_clock::now() - start < MIN_DURATION) {
+		auto begin = chrono::steady_clock::now();
+		if (!encode(output)) {
+			return -1;
+		}
+		fastest = min(fastest, chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count());
+		iterations++;
+	}
+	return fastest;
+}
+
+int main(int argc, char **argv)
+{
+	vector<TEST_IMAGE> images;
+	images.push_back(CreateDesktopImage(1920, 1080));
+	images.push_back(CreateDesktopImage(3840, 2160));
+	images.push_back(CreatePhotoImage(1920, 1080));
+	for (int i = 1; i < argc; i++) {
+		vector<filesystem::path> paths;
+		if (filesystem::is_directory(argv[i])) {
+			for (const auto &entry : filesystem::directory_iterator(argv[i])) {
+				if (entry.path().extension() == ".png") {
+					paths.push_back(entry.path());
+				}
+			}
+			sort(paths.begin(), paths.end());
+		}
+		else {
+			paths.push_back(argv[i]);
+		}
+		for (const auto &path : paths) {
+			TEST_IMAGE image;
+			if (LoadPngImage(path, image)) {
+				images.push_back(move(image));
+			}
+			else {
+				fprintf(stderr, "Skipping %s, only 8 bit non-interlaced gray, RGB and RGBA PNGs are supported\n", path.string().c_str());
+			}
+		}
+	}
+
+	struct ENCODER {
+		const char *Name;
+		function<bool(const IMAGE_BITMAP &, vector<uint8_t> &)> Encode;
+		function<bool(const vector<uint8_t> &, uint32_t &, uint32_t &, vector<uint8_t> &)> Decode;
+	};
+	const ENCODER encoders[] = {
+		{ "zlib PNG level 6", [](const IMAGE_BITMAP &bitmap, vector<uint8_t> &output) { return EncodeZlibPng(bitmap, 6, output); }, nullptr },
+		{ "zlib PNG level 1", [](const IMAGE_BITMAP &bitmap, vector<uint8_t> &output) { return EncodeZlibPng(bitmap, 1, output); }, nullptr },
+		{ "Fast PNG", EncodeFastPng, DecodePng },
+		{ "QOI", EncodeQoi, DecodeQoi },
+		{ "Fast JPEG q90", [](const IMAGE_BITMAP &bitmap, vector<uint8_t> &output) { return EncodeFastJpeg(bitmap, DEFAULT_FAST_JPEG_QUALITY, output); }, nullptr },
+	};
+
+	int failures = 0;
+	printf("%-32s %-18s %10s %12s %8s %10s\n", "Image", "Encoder", "Time (ms)", "Size (bytes)", "Ratio", "MPixel/s");
+	for (const TEST_IMAGE &image : images) {
+		const IMAGE_BITMAP bitmap = image.GetBitmap();
+		const double rawSize = static_cast<double>(image.Width) * image.Height * 3;
+		const double megapixels = static_cast<double>(image.Width) * image.Height / 1e6;
+		for (const ENCODER &encoder : encoders) {
+			vector<uint8_t> output;
+			double millis = MeasureEncode([&](vector<uint8_t> &out) { return encoder.Encode(bitmap, out); }, output);
+			if (millis < 0) {
+				printf("%-32s %-18s failed to encode\n", image.Name.c_str(), encoder.Name);
+				failures++;
+				continue;
+			}
+			const char *verification = "";
+			if (encoder.Decode) {
+				uint32_t width = 0;
+				uint32_t height = 0;
+				vector<uint8_t> decoded;
+				bool isLossless = encoder.Decode(output, width, height, decoded) && IsSameRgb(image, width, height, decoded);
+				verification = isLossless ? "" : "  MISMATCH";
+				failures += isLossless ? 0 : 1;
+			}
+			printf("%-32s %-18s %10.2f %12zu %7.1f%% %10.1f%s\n", image.Name.c_str(), encoder.Name, millis, output.size(), 100.0 * output.size() / rawSize, megapixels / (millis / 1000.0), verification);
+		}
+	}
+	return failures > 0 ? 1 : 0;
+}
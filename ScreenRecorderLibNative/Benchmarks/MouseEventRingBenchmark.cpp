@@ -0,0 +1,159 @@
+//Checks that events written to a MouseEventRing by one thread are read in order, unchanged or reported as lost, by concurrent readers, and measures the cost of a write.
+//The ring doesn't depend on Windows, so the benchmark runs on Linux.
+//
+//Build and run from this directory:
+//  g++ -std=c++17 -O2 -pthread -I.. MouseEventRingBenchmark.cpp ../MouseEventRing.cpp -o mouse_event_ring_benchmark
+//  ./mouse_event_ring_benchmark
+//
+//Add -fsanitize=thread to check the ring for data races.
+
+#include "MouseEventRing.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/// <summary>
+/// Returns an event whose fields are all derived from its sequence number, so a reader can tell a torn or misplaced event from a valid one.
+/// </summary>
+static MOUSE_INPUT_EVENT MakeEvent(uint64_t sequence)
+{
+	MOUSE_INPUT_EVENT event;
+	event.Timestamp = static_cast<int64_t>(sequence * 10000);
+	event.Type = static_cast<MouseInputEventType>(1 + sequence % 4);
+	event.Button = static_cast<MouseInputButton>(sequence % 6);
+	event.X = static_cast<int32_t>(sequence);
+	event.Y = ~static_cast<int32_t>(sequence);
+	event.WheelDelta = static_cast<int32_t>(sequence * 120);
+	return event;
+}
+
+static bool IsEvent(const MOUSE_INPUT_EVENT &event, uint64_t sequence)
+{
+	MOUSE_INPUT_EVENT expected = MakeEvent(sequence);
+	return event.Timestamp == expected.Timestamp
+		&& event.Type == expected.Type
+		&& event.Button == expected.Button
+		&& event.X == expected.X
+		&& event.Y == expected.Y
+		&& event.WheelDelta == expected.WheelDelta;
+}
+
+static bool CheckSingleThreaded()
+{
+	MouseEventRing ring(5);
+	if (ring.GetCapacity() != 8) {
+		return false;
+	}
+	uint64_t sequence = ring.GetWriteSequence();
+	MOUSE_INPUT_EVENT events[16];
+	uint64_t lost = 0;
+	if (ring.Read(&sequence, events, 16, &lost) != 0 || lost != 0) {
+		return false;
+	}
+	for (uint64_t i = 0; i < 3; i++) {
+		ring.Write(MakeEvent(i));
+	}
+	if (ring.Read(&sequence, events, 2, &lost) != 2 || lost != 0 || sequence != 2 || !IsEvent(events[0], 0) || !IsEvent(events[1], 1)) {
+		return false;
+	}
+	//Lap the reader: events 2 to 12 are written, but only the last 8 are still in the ring.
+	for (uint64_t i = 3; i < 13; i++) {
+		ring.Write(MakeEvent(i));
+	}
+	uint32_t count = ring.Read(&sequence, events, 16, &lost);
+	if (count != 8 || lost != 3 || sequence != 13) {
+		return false;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		if (!IsEvent(events[i], 5 + i)) {
+			return false;
+		}
+	}
+	//A sequence from the future starts over at the newest event.
+	sequence = 100;
+	return ring.Read(&sequence, events, 16, &lost) == 0 && sequence == 13;
+}
+
+/// <summary>
+/// Reads while another thread writes as fast as it can. Every event that is read must be valid and newer than the one before it,
+/// and together with the lost events, every event must be accounted for.
+/// </summary>
+static bool CheckConcurrent(uint32_t capacity, uint64_t eventCount, uint32_t readerCount)
+{
+	MouseEventRing ring(capacity);
+	atomic<bool> isWriting{ true };
+	atomic<bool> isOk{ true };
+	vector<thread> readers;
+	for (uint32_t r = 0; r < readerCount; r++) {
+		readers.emplace_back([&]() {
+			uint64_t sequence = 0;
+			uint64_t accounted = 0;
+			int64_t lastTimestamp = -1;
+			MOUSE_INPUT_EVENT events[64];
+			while (true) {
+				bool isLast = !isWriting.load();
+				uint64_t lost = 0;
+				uint64_t first = sequence;
+				uint32_t count = ring.Read(&sequence, events, 64, &lost);
+				accounted += count + lost;
+				for (uint32_t i = 0; i < count; i++) {
+					uint64_t eventSequence = static_cast<uint64_t>(events[i].X);
+					if (eventSequence < first || !IsEvent(events[i], eventSequence) || events[i].Timestamp <= lastTimestamp) {
+						isOk = false;
+					}
+					lastTimestamp = events[i].Timestamp;
+				}
+				if (isLast && sequence == ring.GetWriteSequence()) {
+					break;
+				}
+			}
+			if (accounted != eventCount) {
+				isOk = false;
+			}
+			});
+	}
+	for (uint64_t i = 0; i < eventCount; i++) {
+		ring.Write(MakeEvent(i));
+	}
+	isWriting = false;
+	for (thread &reader : readers) {
+		reader.join();
+	}
+	return isOk;
+}
+
+int main()
+{
+	bool isOk = true;
+	bool isCheckOk = CheckSingleThreaded();
+	printf("single threaded       %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckConcurrent(1024, 2000000, 1);
+	printf("one reader            %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckConcurrent(8, 2000000, 3);
+	printf("three lapped readers  %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+
+	MouseEventRing ring;
+	const int iterations = 10000000;
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		ring.Write(MakeEvent(i));
+	}
+	double writeNanos = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / iterations;
+	MOUSE_INPUT_EVENT events[1024];
+	start = chrono::steady_clock::now();
+	uint64_t readCount = 0;
+	for (int i = 0; i < iterations / 1024; i++) {
+		uint64_t sequence = ring.GetWriteSequence() - 1024;
+		readCount += ring.Read(&sequence, events, 1024);
+	}
+	double readNanos = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / readCount;
+	printf("\nwrite %.1f ns per event, read %.1f ns per event\n", writeNanos, readNanos);
+	return isOk ? 0 : 1;
+}
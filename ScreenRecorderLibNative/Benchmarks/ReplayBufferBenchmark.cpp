@@ -0,0 +1,309 @@
+//Checks that a ReplayBuffer stays within its duration and size limits while always starting with a video keyframe, and measures the cost of adding a sample.
+//The buffer doesn't depend on Windows, so the benchmark runs on Linux.
+//
+//Build and run from this directory:
+//  g++ -std=c++17 -O2 -pthread -I.. ReplayBufferBenchmark.cpp ../ReplayBuffer.cpp -o replay_buffer_benchmark
+//  ./replay_buffer_benchmark
+
+#include "ReplayBuffer.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+//100 nanosecond units, as in ReplayBuffer.
+static const int64_t MILLISECOND = 10000;
+static const int64_t SECOND = 1000 * MILLISECOND;
+static const uint32_t VIDEO_STREAM = 0;
+static const uint32_t AUDIO_STREAM = 1;
+//30 frames per second, and AAC frames of 1024 samples at 48 kHz.
+static const int64_t VIDEO_FRAME_DURATION = 333333;
+static const int64_t AUDIO_FRAME_DURATION = 213333;
+
+static REPLAY_SAMPLE MakeSample(uint32_t streamIndex, int64_t time, int64_t duration, size_t size, bool isKeyframe = false)
+{
+	REPLAY_SAMPLE sample;
+	sample.StreamIndex = streamIndex;
+	sample.Time = time;
+	sample.Duration = duration;
+	sample.IsKeyframe = isKeyframe;
+	sample.Data.resize(size, static_cast<uint8_t>(time));
+	return sample;
+}
+
+/// <summary>
+/// Adds video and audio samples in the order an encoder delivers them, with each sample added once the other stream has caught up with it.
+/// </summary>
+class RecordingSimulator
+{
+public:
+	RecordingSimulator(ReplayBuffer &buffer, int64_t gopDuration, size_t keyframeSize, size_t frameSize, size_t audioFrameSize) :
+		m_Buffer(buffer),
+		m_GopDuration(gopDuration),
+		m_KeyframeSize(keyframeSize),
+		m_FrameSize(frameSize),
+		m_AudioFrameSize(audioFrameSize)
+	{
+	}
+
+	/// <summary>
+	/// Adds the next sample of whichever stream is behind.
+	/// </summary>
+	void AddNext()
+	{
+		if (m_AudioFrameSize > 0 && m_AudioTime < m_VideoTime) {
+			m_Buffer.AddSample(MakeSample(AUDIO_STREAM, m_AudioTime, AUDIO_FRAME_DURATION, m_AudioFrameSize));
+			m_AudioTime += AUDIO_FRAME_DURATION;
+			return;
+		}
+		bool isKeyframe = m_VideoTime >= m_NextKeyframeTime;
+		if (isKeyframe) {
+			m_NextKeyframeTime += m_GopDuration;
+		}
+		m_Buffer.AddSample(MakeSample(VIDEO_STREAM, m_VideoTime, VIDEO_FRAME_DURATION, isKeyframe ? m_KeyframeSize : m_FrameSize, isKeyframe));
+		m_VideoTime += VIDEO_FRAME_DURATION;
+	}
+
+	void SetKeyframeSize(size_t keyframeSize)
+	{
+		m_KeyframeSize = keyframeSize;
+	}
+
+	void AddUntil(int64_t time)
+	{
+		while (m_VideoTime < time) {
+			AddNext();
+		}
+	}
+
+	/// <summary>
+	/// The largest size of a group of pictures and the audio that plays along with it.
+	/// Keyframes are on the first frame at or after each multiple of the group duration, so groups vary by a frame.
+	/// </summary>
+	uint64_t GetMaxGopBytes() const
+	{
+		uint64_t frames = static_cast<uint64_t>(m_GopDuration / VIDEO_FRAME_DURATION) + 1;
+		uint64_t audioFrames = static_cast<uint64_t>(m_AudioFrameSize > 0 ? m_GopDuration / AUDIO_FRAME_DURATION + 2 : 0);
+		return m_KeyframeSize + (frames - 1) * m_FrameSize + audioFrames * m_AudioFrameSize;
+	}
+private:
+	ReplayBuffer &m_Buffer;
+	int64_t m_GopDuration;
+	size_t m_KeyframeSize;
+	size_t m_FrameSize;
+	size_t m_AudioFrameSize;
+	int64_t m_VideoTime = 0;
+	int64_t m_AudioTime = 0;
+	int64_t m_NextKeyframeTime = 0;
+};
+
+/// <summary>
+/// The buffered samples must start with a video keyframe, be in the order they were added, and contain no audio from before the first keyframe.
+/// The buffer size in the stats must match the samples, apart from an audio sample that started before the keyframe and plays into it.
+/// </summary>
+static bool IsValid(ReplayBuffer &buffer, size_t audioFrameSize)
+{
+	vector<shared_ptr<const REPLAY_SAMPLE>> samples = buffer.GetSamples();
+	REPLAY_BUFFER_STATS stats = buffer.GetStats();
+	if (samples.empty()) {
+		return stats.GopCount == 0;
+	}
+	const REPLAY_SAMPLE &first = *samples.front();
+	if (first.StreamIndex != VIDEO_STREAM || !first.IsKeyframe) {
+		return false;
+	}
+	uint64_t bytes = 0;
+	size_t gopCount = 0;
+	int64_t lastTime[2] = { INT64_MIN, INT64_MIN };
+	for (const shared_ptr<const REPLAY_SAMPLE> &pSample : samples) {
+		if (pSample->Time < first.Time || pSample->Time <= lastTime[pSample->StreamIndex]) {
+			return false;
+		}
+		lastTime[pSample->StreamIndex] = pSample->Time;
+		bytes += pSample->Data.size();
+		gopCount += pSample->IsKeyframe ? 1 : 0;
+	}
+	return stats.GopCount == gopCount && stats.Bytes >= bytes && stats.Bytes - bytes <= audioFrameSize;
+}
+
+/// <summary>
+/// The buffer keeps at least the max duration, and at most one group of pictures more.
+/// </summary>
+static bool CheckDurationLimit()
+{
+	const int64_t gopDuration = 2 * SECOND;
+	const int64_t maxDuration = 5 * SECOND;
+	ReplayBuffer buffer(VIDEO_STREAM, maxDuration, 0);
+	RecordingSimulator recording(buffer, gopDuration, 5000, 1000, 200);
+	bool isOk = true;
+	for (int64_t time = SECOND; time <= 30 * SECOND; time += SECOND / 2) {
+		recording.AddUntil(time);
+		REPLAY_BUFFER_STATS stats = buffer.GetStats();
+		int64_t expectedDuration = min(time, maxDuration);
+		isOk &= IsValid(buffer, 200) && stats.Duration >= expectedDuration;
+		//Groups start on the first frame at or after each multiple of the group duration, so they can be a frame longer.
+		isOk &= stats.Duration < expectedDuration + gopDuration + VIDEO_FRAME_DURATION;
+	}
+	REPLAY_BUFFER_STATS stats = buffer.GetStats();
+	//30 seconds are 15 groups of 2 seconds, of which 3 or 4 cover the last 5 seconds.
+	return isOk && stats.GopCount >= 3 && stats.GopCount <= 4 && stats.DroppedGops + stats.GopCount == 15;
+}
+
+/// <summary>
+/// The buffer stays within the max size, and drops no more groups of pictures than needed to, counting the audio that is dropped along with each group.
+/// </summary>
+static bool CheckSizeLimit(size_t keyframeSize, size_t frameSize, size_t audioFrameSize)
+{
+	const uint64_t maxBytes = 500000;
+	ReplayBuffer buffer(VIDEO_STREAM, 0, maxBytes);
+	RecordingSimulator recording(buffer, SECOND, keyframeSize, frameSize, audioFrameSize);
+	bool isOk = true;
+	for (int64_t time = SECOND; time <= 60 * SECOND; time += SECOND / 3) {
+		if (time >= 30 * SECOND) {
+			//A scene change makes the keyframes larger than the rest of their group. Dropping a group must still count its audio,
+			//or more groups are dropped to make room for a keyframe than needed.
+			recording.SetKeyframeSize(40000);
+		}
+		recording.AddUntil(time);
+		REPLAY_BUFFER_STATS stats = buffer.GetStats();
+		isOk &= IsValid(buffer, audioFrameSize) && stats.Bytes <= maxBytes;
+		if (stats.DroppedGops > 0) {
+			//Another group of pictures, with its audio, wouldn't have fitted.
+			isOk &= stats.Bytes + recording.GetMaxGopBytes() > maxBytes;
+		}
+	}
+	return isOk && buffer.GetStats().DroppedGops > 0;
+}
+
+/// <summary>
+/// The newest group of pictures is kept even when it alone exceeds the max size, as the buffer would otherwise have nothing to play.
+/// </summary>
+static bool CheckOversizedGop()
+{
+	ReplayBuffer buffer(VIDEO_STREAM, 0, 10000);
+	RecordingSimulator recording(buffer, 10 * SECOND, 5000, 1000, 200);
+	recording.AddUntil(25 * SECOND);
+	REPLAY_BUFFER_STATS stats = buffer.GetStats();
+	return IsValid(buffer, 200)
+		&& stats.GopCount == 1
+		&& stats.DroppedGops == 2
+		&& stats.Bytes > 10000
+		&& stats.Duration > 5 * SECOND - VIDEO_FRAME_DURATION
+		&& stats.Duration < 5 * SECOND + VIDEO_FRAME_DURATION;
+}
+
+/// <summary>
+/// Samples are returned interleaved in the order they were added. Video before the first keyframe is discarded,
+/// and audio from before it is dropped along with the first group of pictures that it plays with.
+/// </summary>
+static bool CheckInterleaving()
+{
+	ReplayBuffer buffer(VIDEO_STREAM, 3 * SECOND, 0);
+	bool isOk = true;
+	//A recording joined in the middle of a group of pictures, with audio starting first.
+	buffer.AddSample(MakeSample(AUDIO_STREAM, 0, AUDIO_FRAME_DURATION, 100));
+	buffer.AddSample(MakeSample(VIDEO_STREAM, 0, VIDEO_FRAME_DURATION, 1000));
+	buffer.AddSample(MakeSample(VIDEO_STREAM, VIDEO_FRAME_DURATION, VIDEO_FRAME_DURATION, 1000));
+	isOk &= buffer.GetSamples().empty() && buffer.GetStats().Bytes == 100;
+
+	vector<const REPLAY_SAMPLE *> added;
+	int64_t audioTime = AUDIO_FRAME_DURATION;
+	for (int64_t frame = 2; frame < 300; frame++) {
+		int64_t videoTime = frame * VIDEO_FRAME_DURATION;
+		buffer.AddSample(MakeSample(VIDEO_STREAM, videoTime, VIDEO_FRAME_DURATION, 1000, frame % 30 == 2));
+		while (audioTime < videoTime + VIDEO_FRAME_DURATION) {
+			buffer.AddSample(MakeSample(AUDIO_STREAM, audioTime, AUDIO_FRAME_DURATION, 100));
+			audioTime += AUDIO_FRAME_DURATION;
+		}
+		isOk &= IsValid(buffer, 100);
+	}
+	vector<shared_ptr<const REPLAY_SAMPLE>> samples = buffer.GetSamples();
+	//Each video frame is followed by the audio up to its end.
+	int64_t videoEndTime = 0;
+	size_t audioCount = 0;
+	for (const shared_ptr<const REPLAY_SAMPLE> &pSample : samples) {
+		if (pSample->StreamIndex == VIDEO_STREAM) {
+			videoEndTime = pSample->Time + pSample->Duration;
+		}
+		else {
+			isOk &= pSample->Time < videoEndTime;
+			audioCount++;
+		}
+	}
+	int64_t startTime = samples.front()->Time;
+	size_t expectedAudioCount = static_cast<size_t>((audioTime - startTime + AUDIO_FRAME_DURATION - 1) / AUDIO_FRAME_DURATION);
+	isOk &= audioCount + 1 >= expectedAudioCount && audioCount <= expectedAudioCount;
+
+	buffer.Clear();
+	REPLAY_BUFFER_STATS stats = buffer.GetStats();
+	return isOk && buffer.GetSamples().empty() && stats.Bytes == 0 && stats.GopCount == 0;
+}
+
+/// <summary>
+/// Groups of pictures of random length and frames of random size, with both limits set. Whichever limit is hit, the buffer stays valid.
+/// </summary>
+static bool CheckRandomGops(uint32_t seed)
+{
+	const uint64_t maxBytes = 500000;
+	const int64_t maxDuration = 4 * SECOND;
+	ReplayBuffer buffer(VIDEO_STREAM, maxDuration, maxBytes);
+	mt19937 random(seed);
+	bool isOk = true;
+	int64_t audioTime = 0;
+	for (int64_t frame = 0; frame < 3000; frame++) {
+		int64_t videoTime = frame * VIDEO_FRAME_DURATION;
+		bool isKeyframe = frame == 0 || random() % 40 == 0;
+		buffer.AddSample(MakeSample(VIDEO_STREAM, videoTime, VIDEO_FRAME_DURATION, isKeyframe ? 20000 : 500 + random() % 4000, isKeyframe));
+		while (audioTime < videoTime + VIDEO_FRAME_DURATION) {
+			buffer.AddSample(MakeSample(AUDIO_STREAM, audioTime, AUDIO_FRAME_DURATION, 300));
+			audioTime += AUDIO_FRAME_DURATION;
+		}
+		REPLAY_BUFFER_STATS stats = buffer.GetStats();
+		isOk &= IsValid(buffer, 300) && (stats.Bytes <= maxBytes || stats.GopCount == 1);
+	}
+	return isOk;
+}
+
+int main()
+{
+	bool isOk = true;
+	bool isCheckOk = CheckDurationLimit();
+	printf("duration limit  %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	//Mostly video, and mostly audio as when recording a slide show with music.
+	isCheckOk = CheckSizeLimit(5000, 1000, 400) && CheckSizeLimit(1000, 100, 2000);
+	printf("size limit      %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckOversizedGop();
+	printf("oversized gop   %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckInterleaving();
+	printf("interleaving    %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckRandomGops(1) && CheckRandomGops(2) && CheckRandomGops(3);
+	printf("random gops     %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+
+	//An hour of 60 frames per second video with a keyframe every 2 seconds and audio, replayed into a buffer of the last 30 seconds.
+	ReplayBuffer buffer(VIDEO_STREAM, 30 * SECOND, 0);
+	uint64_t sampleCount = 0;
+	int64_t audioTime = 0;
+	auto start = chrono::steady_clock::now();
+	for (int64_t frame = 0; frame < 60 * 60 * 60; frame++) {
+		int64_t videoTime = frame * SECOND / 60;
+		buffer.AddSample(MakeSample(VIDEO_STREAM, videoTime, SECOND / 60, 64, frame % 120 == 0));
+		sampleCount++;
+		while (audioTime < videoTime + SECOND / 60) {
+			buffer.AddSample(MakeSample(AUDIO_STREAM, audioTime, AUDIO_FRAME_DURATION, 64));
+			audioTime += AUDIO_FRAME_DURATION;
+			sampleCount++;
+		}
+	}
+	double nanos = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / static_cast<double>(sampleCount);
+	REPLAY_BUFFER_STATS stats = buffer.GetStats();
+	printf("\n%llu samples added in %.0f ns each, %zu groups of pictures buffered and %llu dropped\n",
+		static_cast<unsigned long long>(sampleCount), nanos, stats.GopCount, static_cast<unsigned long long>(stats.DroppedGops));
+	return isOk ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+//Checks the TimerSchedule that TimingService runs all timers on against a virtual clock, and counts the wakeups one shared timer thread needs
+//compared to a thread per timer. The schedule doesn't depend on Windows, so the benchmark runs on Linux.
+//
+//Build and run from this directory:
+//  g++ -std=c++17 -O2 -I.. TimerScheduleBenchmark.cpp ../TimerSchedule.cpp -o timer_schedule_benchmark
+//  ./timer_schedule_benchmark
+//
+//The virtual clock wakes the timer thread a random time after the next due time, like a real timer would, so the checks show
+//that periodic timers stay on their grid however late the wakeups are.
+
+#include "TimerSchedule.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+//100 nanosecond units, as in TimingService.
+static const int64_t MILLISECOND = 10000;
+static const int64_t SECOND = 1000 * MILLISECOND;
+
+static bool CheckNoDrift()
+{
+	TimerSchedule schedule;
+	//29.97 frames per second does not divide into whole milliseconds, which is what made millisecond timers drift.
+	const int64_t period = 333667;
+	TimerId id = schedule.Add(0, period);
+	mt19937 random(1);
+	uniform_int_distribution<int64_t> lateness(0, 2 * MILLISECOND);
+	vector<TimerId> dueTimers;
+	int64_t dueTime;
+	for (int i = 0; i < 3000; i++) {
+		if (!schedule.GetNextDueTime(&dueTime) || dueTime != i * period) {
+			return false;
+		}
+		dueTimers.clear();
+		schedule.Advance(dueTime + lateness(random), dueTimers);
+		if (dueTimers.size() != 1 || dueTimers[0] != id) {
+			return false;
+		}
+	}
+	TIMER_SCHEDULE_STATS stats = schedule.GetStats();
+	return schedule.GetDueTime(id, &dueTime) && dueTime == 3000 * period
+		&& stats.Wakeups == 3000 && stats.Ticks == 3000 && stats.MissedTicks == 0 && stats.MaxLateness <= 2 * MILLISECOND;
+}
+
+static bool CheckMissedTicks()
+{
+	TimerSchedule schedule;
+	TimerId id = schedule.Add(0, 10 * MILLISECOND);
+	vector<TimerId> dueTimers;
+	//A wakeup 35 ms late signals the timer once, skips the ticks at 10, 20 and 30 ms, and keeps the grid for the next one at 40 ms.
+	schedule.Advance(35 * MILLISECOND, dueTimers);
+	int64_t dueTime;
+	if (dueTimers.size() != 1 || !schedule.GetDueTime(id, &dueTime) || dueTime != 40 * MILLISECOND) {
+		return false;
+	}
+	//A wakeup exactly on the next due time is not a missed tick.
+	dueTimers.clear();
+	schedule.Advance(40 * MILLISECOND, dueTimers);
+	TIMER_SCHEDULE_STATS stats = schedule.GetStats();
+	return dueTimers.size() == 1 && schedule.GetDueTime(id, &dueTime) && dueTime == 50 * MILLISECOND
+		&& stats.MissedTicks == 3 && stats.Ticks == 2 && stats.MaxLateness == 35 * MILLISECOND;
+}
+
+static bool CheckOneShotAndRemove()
+{
+	TimerSchedule schedule;
+	TimerId oneShot = schedule.Add(5 * MILLISECOND, 0);
+	TimerId periodic = schedule.Add(5 * MILLISECOND, 20 * MILLISECOND);
+	vector<TimerId> dueTimers;
+	//Nothing is due before 5 ms, as when the waitable timer fires a little early.
+	schedule.Advance(4 * MILLISECOND, dueTimers);
+	if (!dueTimers.empty()) {
+		return false;
+	}
+	//Both timers are due at the same time, so they share one wakeup.
+	schedule.Advance(5 * MILLISECOND, dueTimers);
+	sort(dueTimers.begin(), dueTimers.end());
+	if (dueTimers.size() != 2 || dueTimers[0] != oneShot || dueTimers[1] != periodic) {
+		return false;
+	}
+	//The one shot timer is gone after it was due.
+	if (schedule.GetDueTime(oneShot, nullptr) || schedule.Remove(oneShot) || schedule.GetStats().ActiveTimers != 1) {
+		return false;
+	}
+	if (!schedule.Remove(periodic) || schedule.Remove(periodic)) {
+		return false;
+	}
+	int64_t dueTime;
+	dueTimers.clear();
+	schedule.Advance(100 * MILLISECOND, dueTimers);
+	TIMER_SCHEDULE_STATS stats = schedule.GetStats();
+	return dueTimers.empty() && !schedule.GetNextDueTime(&dueTime) && stats.ActiveTimers == 0 && stats.Wakeups == 3 && stats.Ticks == 2;
+}
+
+static bool CheckOrder()
+{
+	TimerSchedule schedule;
+	mt19937 random(2);
+	uniform_int_distribution<int64_t> time(0, SECOND);
+	vector<pair<int64_t, TimerId>> expected;
+	for (int i = 0; i < 1000; i++) {
+		int64_t dueTime = time(random);
+		expected.emplace_back(dueTime, schedule.Add(dueTime, 0));
+	}
+	sort(expected.begin(), expected.end());
+	vector<TimerId> dueTimers;
+	int64_t dueTime;
+	while (schedule.GetNextDueTime(&dueTime)) {
+		schedule.Advance(dueTime, dueTimers);
+	}
+	if (dueTimers.size() != expected.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < expected.size(); i++) {
+		if (dueTimers[i] != expected[i].second) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// <summary>
+/// Runs a recording with video and GIF overlays for the given time on the virtual clock, and returns the wakeups of the shared timer thread.
+/// Each overlay is also counted as if it had a timer thread of its own, which wakes up once for every tick.
+/// </summary>
+static void SimulateOverlays(int videoCount, int gifCount, int64_t duration, uint64_t *pSharedWakeups, uint64_t *pSeparateWakeups)
+{
+	TimerSchedule schedule;
+	mt19937 random(3);
+	uniform_int_distribution<int64_t> lateness(0, MILLISECOND / 2);
+	const int64_t videoPeriods[] = { 333667, 333333, 166667, 400000 };
+	for (int i = 0; i < videoCount; i++) {
+		schedule.Add(0, videoPeriods[i % 4]);
+	}
+	//GIF frames are one shot timers, scheduled again from the due time of the previous frame when they fire.
+	const int64_t gifDelay = 100 * MILLISECOND;
+	vector<TimerId> gifTimers;
+	for (int i = 0; i < gifCount; i++) {
+		gifTimers.push_back(schedule.Add(gifDelay, 0));
+	}
+	vector<TimerId> dueTimers;
+	int64_t dueTime;
+	while (schedule.GetNextDueTime(&dueTime) && dueTime < duration) {
+		dueTimers.clear();
+		schedule.Advance(dueTime + lateness(random), dueTimers);
+		for (TimerId id : dueTimers) {
+			auto gif = find(gifTimers.begin(), gifTimers.end(), id);
+			if (gif != gifTimers.end()) {
+				*gif = schedule.Add(dueTime + gifDelay, 0);
+			}
+		}
+	}
+	TIMER_SCHEDULE_STATS stats = schedule.GetStats();
+	*pSharedWakeups = stats.Wakeups;
+	*pSeparateWakeups = stats.Ticks;
+}
+
+int main()
+{
+	bool isOk = true;
+	bool isCheckOk = CheckNoDrift();
+	printf("no drift with late wakeups        %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckMissedTicks();
+	printf("missed ticks stay on the grid     %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckOneShotAndRemove();
+	printf("one shot and removed timers       %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckOrder();
+	printf("timers are due in order           %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+
+	printf("\nwakeups for 60 seconds of overlays, shared timer thread vs a timer thread per overlay\n");
+	const int overlayCounts[][2] = { { 1, 0 }, { 4, 0 }, { 4, 4 }, { 16, 16 } };
+	for (const auto &counts : overlayCounts) {
+		uint64_t sharedWakeups, separateWakeups;
+		SimulateOverlays(counts[0], counts[1], 60 * SECOND, &sharedWakeups, &separateWakeups);
+		printf("%2d videos, %2d GIFs: %7llu vs %7llu\n", counts[0], counts[1], (unsigned long long)sharedWakeups, (unsigned long long)separateWakeups);
+	}
+
+	TimerSchedule schedule;
+	const int timerCount = 256;
+	for (int i = 0; i < timerCount; i++) {
+		schedule.Add(i * 1000, 333667 + i);
+	}
+	vector<TimerId> dueTimers;
+	const int iterations = 1000000;
+	int64_t dueTime;
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < iterations && schedule.GetNextDueTime(&dueTime); i++) {
+		dueTimers.clear();
+		schedule.Advance(dueTime, dueTimers);
+	}
+	double advanceNanos = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / iterations;
+	printf("\nadvance %.1f ns per wakeup with %d timers\n", advanceNanos, timerCount);
+	return isOk ? 0 : 1;
+}
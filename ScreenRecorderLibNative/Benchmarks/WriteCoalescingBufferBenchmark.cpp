@@ -0,0 +1,464 @@
+//Checks that a WriteCoalescingBuffer leaves the target stream with the same bytes as writing to it directly, while forwarding far fewer calls,
+//and replays the write pattern of an MPEG-4 sink to count the calls saved. The buffer doesn't depend on Windows, so the benchmark runs on Linux.
+//
+//Build and run from this directory:
+//  g++ -std=c++17 -O2 -pthread -I.. WriteCoalescingBufferBenchmark.cpp ../WriteCoalescingBuffer.cpp -o write_coalescing_buffer_benchmark
+//  ./write_coalescing_buffer_benchmark
+//
+//ManagedIStream returns STG_E_WRITEFAULT or STG_E_READFAULT for every call the buffer fails, so a failing target is checked by the buffer calls returning false.
+
+#include "WriteCoalescingBuffer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/// <summary>
+/// An in-memory stream that counts the calls made on it, and can be set to fail a write or seek.
+/// Writes past the end of the stream fill the gap with zeros, like a FileStream.
+/// </summary>
+class MockTarget : public IWriteCoalescingTarget
+{
+public:
+	virtual bool Write(const uint8_t *pData, size_t cb) override
+	{
+		WriteCalls++;
+		if (FailingWriteCall == WriteCalls) {
+			return false;
+		}
+		MaxWriteSize = max(MaxWriteSize, cb);
+		size_t end = static_cast<size_t>(m_Position) + cb;
+		if (Contents.size() < end) {
+			Contents.resize(end);
+		}
+		memcpy(Contents.data() + m_Position, pData, cb);
+		m_Position = static_cast<int64_t>(end);
+		Calls += "W";
+		return true;
+	}
+	virtual bool Read(uint8_t *pData, size_t cb, size_t *pcbRead) override
+	{
+		ReadCalls++;
+		size_t available = m_Position < static_cast<int64_t>(Contents.size()) ? Contents.size() - static_cast<size_t>(m_Position) : 0;
+		*pcbRead = min(cb, available);
+		if (*pcbRead > 0) {
+			memcpy(pData, Contents.data() + m_Position, *pcbRead);
+		}
+		m_Position += static_cast<int64_t>(*pcbRead);
+		Calls += "R";
+		return true;
+	}
+	virtual bool Seek(int64_t position) override
+	{
+		SeekCalls++;
+		if (FailingSeekCall == SeekCalls) {
+			return false;
+		}
+		SeekPositions.push_back(position);
+		m_Position = position;
+		Calls += "S";
+		return true;
+	}
+	virtual bool SetLength(int64_t length) override
+	{
+		Contents.resize(static_cast<size_t>(length));
+		m_Position = min(m_Position, length);
+		Calls += "L";
+		return true;
+	}
+	virtual bool GetLength(int64_t *pLength) override
+	{
+		*pLength = static_cast<int64_t>(Contents.size());
+		return !IsFailingGetLength;
+	}
+	virtual bool GetPosition(int64_t *pPosition) override
+	{
+		*pPosition = m_Position;
+		return true;
+	}
+
+	vector<uint8_t> Contents;
+	vector<int64_t> SeekPositions;
+	/// <summary>The calls that succeeded, in order, as W(rite), R(ead), S(eek) and L(ength).</summary>
+	string Calls;
+	uint64_t WriteCalls = 0;
+	uint64_t ReadCalls = 0;
+	uint64_t SeekCalls = 0;
+	size_t MaxWriteSize = 0;
+	/// <summary>The number of the write call that fails, counting from 1, or 0 to never fail.</summary>
+	uint64_t FailingWriteCall = 0;
+	/// <summary>The number of the seek call that fails, counting from 1, or 0 to never fail.</summary>
+	uint64_t FailingSeekCall = 0;
+	bool IsFailingGetLength = false;
+private:
+	int64_t m_Position = 0;
+};
+
+/// <summary>
+/// Applies the same writes and seeks as the buffer to a plain byte vector, to compare the target contents against.
+/// </summary>
+struct ReferenceStream {
+	vector<uint8_t> Contents;
+	int64_t Position = 0;
+
+	void Write(const uint8_t *pData, size_t cb)
+	{
+		size_t end = static_cast<size_t>(Position) + cb;
+		if (Contents.size() < end) {
+			Contents.resize(end);
+		}
+		memcpy(Contents.data() + Position, pData, cb);
+		Position = static_cast<int64_t>(end);
+	}
+};
+
+static vector<uint8_t> MakeData(size_t size, uint8_t seed)
+{
+	vector<uint8_t> data(size);
+	for (size_t i = 0; i < size; i++) {
+		data[i] = static_cast<uint8_t>(seed + i * 7);
+	}
+	return data;
+}
+
+/// <summary>
+/// Writes the data to both the buffer and the reference.
+/// </summary>
+static bool WriteBoth(WriteCoalescingBuffer &buffer, ReferenceStream &reference, const vector<uint8_t> &data)
+{
+	reference.Write(data.data(), data.size());
+	return buffer.Write(data.data(), data.size());
+}
+
+static bool SeekBoth(WriteCoalescingBuffer &buffer, ReferenceStream &reference, int64_t position)
+{
+	reference.Position = position;
+	int64_t newPosition = -1;
+	return buffer.Seek(position, WriteCoalescingSeekOrigin::Begin, &newPosition) && newPosition == position;
+}
+
+/// <summary>
+/// Small sequential writes reach the target as writes of a full buffer, without any seeks.
+/// </summary>
+static bool CheckSequentialWrites()
+{
+	MockTarget target;
+	ReferenceStream reference;
+	WriteCoalescingBuffer buffer(&target, 64);
+	bool isOk = true;
+	for (uint8_t i = 0; i < 100; i++) {
+		isOk &= WriteBoth(buffer, reference, MakeData(8, i));
+	}
+	isOk &= buffer.Flush();
+	WRITE_COALESCING_STATS stats = buffer.GetStats();
+	//800 bytes are 12 full buffers of 64 bytes and the 32 bytes left for Flush.
+	return isOk
+		&& target.Contents == reference.Contents
+		&& target.WriteCalls == 13
+		&& target.SeekCalls == 0
+		&& target.MaxWriteSize == 64
+		&& stats.WriteCalls == 100
+		&& stats.TargetWriteCalls == 13
+		&& stats.BytesWritten == 800
+		&& stats.GetCallsSaved() == 87
+		&& buffer.GetLength() == 800
+		&& buffer.GetPosition() == 800;
+}
+
+/// <summary>
+/// A header that is rewritten while it is still in the buffer, like the size of an mdat box or a moov box in front of the data, is patched in place.
+/// The target then gets a single write, and never sees the placeholder or a seek.
+/// </summary>
+static bool CheckPatchInBuffer()
+{
+	MockTarget target;
+	ReferenceStream reference;
+	WriteCoalescingBuffer buffer(&target, 64);
+	bool isOk = WriteBoth(buffer, reference, vector<uint8_t>(8, 0));
+	isOk &= WriteBoth(buffer, reference, MakeData(40, 1));
+	isOk &= SeekBoth(buffer, reference, 0);
+	isOk &= WriteBoth(buffer, reference, MakeData(8, 2));
+	int64_t position = -1;
+	isOk &= buffer.Seek(0, WriteCoalescingSeekOrigin::End, &position) && position == 48;
+	reference.Position = 48;
+	isOk &= WriteBoth(buffer, reference, MakeData(8, 3));
+	//A write that starts inside the buffer and runs past its end is patched and appended.
+	isOk &= SeekBoth(buffer, reference, 50);
+	isOk &= WriteBoth(buffer, reference, MakeData(10, 4));
+	isOk &= buffer.Flush();
+	WRITE_COALESCING_STATS stats = buffer.GetStats();
+	return isOk
+		&& target.Contents == reference.Contents
+		&& target.Contents.size() == 60
+		&& target.WriteCalls == 1
+		&& target.SeekCalls == 0
+		&& stats.PatchedWrites == 2
+		&& stats.SeekCalls == 3
+		&& stats.TargetSeekCalls == 0;
+}
+
+/// <summary>
+/// Seeks alone never reach the target. A write outside the buffer flushes it, and its data is written after a seek to where it belongs,
+/// like a header rewritten at the start of the file after the data has been flushed.
+/// </summary>
+static bool CheckSeekOutsideBuffer()
+{
+	MockTarget target;
+	ReferenceStream reference;
+	WriteCoalescingBuffer buffer(&target, 64);
+	bool isOk = true;
+	for (uint8_t i = 0; i < 20; i++) {
+		isOk &= WriteBoth(buffer, reference, MakeData(10, i));
+	}
+	//200 bytes in writes of 10 are 3 full buffers of 60 bytes, and 20 bytes in the buffer.
+	for (int i = 0; i < 10; i++) {
+		isOk &= SeekBoth(buffer, reference, i * 10);
+	}
+	isOk &= buffer.Flush();
+	uint64_t writeCalls = target.WriteCalls;
+	isOk &= target.SeekCalls == 0 && writeCalls == 4;
+
+	isOk &= SeekBoth(buffer, reference, 0);
+	isOk &= WriteBoth(buffer, reference, MakeData(8, 100));
+	int64_t position = -1;
+	isOk &= buffer.Seek(0, WriteCoalescingSeekOrigin::End, &position) && position == 200;
+	reference.Position = 200;
+	isOk &= WriteBoth(buffer, reference, MakeData(16, 101));
+	//A seek relative to the current position within the buffer, back over the bytes just written.
+	isOk &= buffer.Seek(-8, WriteCoalescingSeekOrigin::Current, &position) && position == 208;
+	reference.Position = 208;
+	isOk &= WriteBoth(buffer, reference, MakeData(8, 102));
+	isOk &= buffer.Flush();
+	return isOk
+		&& target.Contents == reference.Contents
+		&& target.WriteCalls == writeCalls + 2
+		&& target.SeekPositions == vector<int64_t>{ 0, 200 }
+		&& buffer.GetStats().TargetSeekCalls == 2;
+}
+
+/// <summary>
+/// Writes of at least the buffer size are forwarded as a single write, after the data buffered before them.
+/// </summary>
+static bool CheckLargeWrites()
+{
+	MockTarget target;
+	ReferenceStream reference;
+	WriteCoalescingBuffer buffer(&target, 64);
+	bool isOk = WriteBoth(buffer, reference, MakeData(10, 1));
+	isOk &= WriteBoth(buffer, reference, MakeData(1000, 2));
+	isOk &= WriteBoth(buffer, reference, MakeData(10, 3));
+	isOk &= buffer.Flush();
+	isOk &= target.Contents == reference.Contents && target.WriteCalls == 3 && target.SeekCalls == 0 && target.MaxWriteSize == 1000;
+
+	//A large write that starts inside the buffer patches the buffer, and writes the rest after it.
+	isOk &= SeekBoth(buffer, reference, 1020);
+	isOk &= WriteBoth(buffer, reference, MakeData(20, 4));
+	isOk &= SeekBoth(buffer, reference, 1030);
+	isOk &= WriteBoth(buffer, reference, MakeData(300, 5));
+	isOk &= buffer.Flush();
+	return isOk
+		&& target.Contents == reference.Contents
+		&& target.Contents.size() == 1330
+		&& target.WriteCalls == 5
+		&& target.MaxWriteSize == 1000
+		&& buffer.GetStats().PatchedWrites == 1;
+}
+
+/// <summary>
+/// Read and SetLength write all buffered data to the target before they touch it, and read from the position the client seeked to.
+/// </summary>
+static bool CheckDrainOnReadAndSetLength()
+{
+	MockTarget target;
+	ReferenceStream reference;
+	WriteCoalescingBuffer buffer(&target, 64);
+	vector<uint8_t> data = MakeData(20, 1);
+	bool isOk = WriteBoth(buffer, reference, data);
+	isOk &= SeekBoth(buffer, reference, 4);
+	uint8_t read[32]{};
+	size_t readCount = 0;
+	isOk &= buffer.Read(read, 32, &readCount);
+	isOk &= readCount == 16 && memcmp(read, data.data() + 4, 16) == 0 && buffer.GetPosition() == 20;
+	isOk &= target.Calls == "WSR";
+	reference.Position = 20;
+
+	isOk &= WriteBoth(buffer, reference, MakeData(10, 2));
+	isOk &= buffer.SetLength(12);
+	reference.Contents.resize(12);
+	isOk &= target.Calls == "WSRWL" && target.Contents == reference.Contents && buffer.GetLength() == 12;
+
+	//The target position is unknown after SetLength, so the next write seeks to where it belongs.
+	isOk &= SeekBoth(buffer, reference, 12);
+	isOk &= WriteBoth(buffer, reference, MakeData(4, 3));
+	isOk &= buffer.Flush();
+	return isOk
+		&& target.Calls == "WSRWLSW"
+		&& target.Contents == reference.Contents
+		&& buffer.GetLength() == 16;
+}
+
+/// <summary>
+/// After a write to the target fails, the data still queued is discarded instead of written after the gap,
+/// and every later call on the buffer fails.
+/// </summary>
+static bool CheckWriteFailure()
+{
+	MockTarget target;
+	target.FailingWriteCall = 2;
+	WriteCoalescingBuffer buffer(&target, 16, 2);
+	vector<uint8_t> data = MakeData(8, 1);
+	bool isAnyWriteFailed = false;
+	for (int i = 0; i < 100; i++) {
+		isAnyWriteFailed |= !buffer.Write(data.data(), data.size());
+	}
+	bool isOk = !buffer.Flush();
+	isOk &= !buffer.Write(data.data(), data.size());
+	uint8_t read[8];
+	size_t readCount = 0;
+	isOk &= !buffer.Read(read, 8, &readCount) && readCount == 0;
+	isOk &= !buffer.SetLength(0);
+	//The queue holds 2 buffers, so the writes fail before all of them are queued.
+	return isOk
+		&& isAnyWriteFailed
+		&& target.WriteCalls == 2
+		&& target.Contents.size() == 16
+		&& target.Calls == "W";
+}
+
+/// <summary>
+/// A failed seek of the target fails the write that needed it, like a failed write.
+/// </summary>
+static bool CheckSeekFailure()
+{
+	MockTarget target;
+	target.FailingSeekCall = 1;
+	WriteCoalescingBuffer buffer(&target, 16);
+	vector<uint8_t> data = MakeData(8, 1);
+	bool isOk = buffer.Write(data.data(), data.size()) && buffer.Flush();
+	int64_t position = -1;
+	isOk &= buffer.Seek(100, WriteCoalescingSeekOrigin::Begin, &position) && position == 100;
+	isOk &= buffer.Write(data.data(), data.size());
+	isOk &= !buffer.Flush();
+	isOk &= !buffer.Write(data.data(), data.size());
+	//Invalid seeks fail without touching the target.
+	isOk &= !buffer.Seek(-1, WriteCoalescingSeekOrigin::Begin, &position) && position == 100;
+	return isOk
+		&& target.WriteCalls == 1
+		&& target.SeekCalls == 1
+		&& target.Contents == data;
+}
+
+/// <summary>
+/// If the length of the target can't be read, the buffer doesn't know where the stream ends, so every call fails without touching the target.
+/// </summary>
+static bool CheckGetLengthFailure()
+{
+	MockTarget target;
+	target.IsFailingGetLength = true;
+	WriteCoalescingBuffer buffer(&target, 16);
+	vector<uint8_t> data = MakeData(8, 1);
+	bool isOk = !buffer.Write(data.data(), data.size());
+	isOk &= !buffer.Flush();
+	isOk &= !buffer.SetLength(0);
+	return isOk
+		&& target.Calls.empty();
+}
+
+/// <summary>
+/// Random writes and seeks, mostly sequential with back-patches and jumps like a muxer makes, leave the target with the same bytes as the reference.
+/// </summary>
+static bool CheckRandomWrites(size_t bufferSize, uint32_t seed)
+{
+	MockTarget target;
+	ReferenceStream reference;
+	WriteCoalescingBuffer buffer(&target, bufferSize, 3);
+	mt19937 random(seed);
+	bool isOk = true;
+	for (int i = 0; i < 20000 && isOk; i++) {
+		uint32_t operation = random() % 100;
+		int64_t length = static_cast<int64_t>(reference.Contents.size());
+		if (operation < 10 && length > 0) {
+			isOk &= SeekBoth(buffer, reference, random() % length);
+		}
+		else if (operation < 12) {
+			//Past the end, leaving a gap.
+			isOk &= SeekBoth(buffer, reference, length + random() % 32);
+		}
+		else if (operation < 14) {
+			size_t size = random() % (4 * bufferSize);
+			isOk &= WriteBoth(buffer, reference, MakeData(size, static_cast<uint8_t>(i)));
+		}
+		else {
+			isOk &= WriteBoth(buffer, reference, MakeData(1 + random() % 24, static_cast<uint8_t>(i)));
+		}
+		isOk &= buffer.GetPosition() == reference.Position;
+	}
+	isOk &= buffer.Flush();
+	return isOk
+		&& target.Contents == reference.Contents
+		&& buffer.GetLength() == static_cast<int64_t>(reference.Contents.size());
+}
+
+int main()
+{
+	bool isOk = true;
+	bool isCheckOk = CheckSequentialWrites();
+	printf("sequential writes        %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckPatchInBuffer();
+	printf("patch in buffer          %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckSeekOutsideBuffer();
+	printf("seek outside buffer      %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckLargeWrites();
+	printf("large writes             %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckDrainOnReadAndSetLength();
+	printf("drain on read/set length %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckWriteFailure();
+	printf("write failure            %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckSeekFailure();
+	printf("seek failure             %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckGetLengthFailure();
+	printf("get length failure       %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+	isCheckOk = CheckRandomWrites(64, 1) && CheckRandomWrites(1000, 2) && CheckRandomWrites(1, 3);
+	printf("random writes            %s\n", isCheckOk ? "ok" : "FAILED");
+	isOk &= isCheckOk;
+
+	//The pattern of a fragmented MPEG-4 sink: a small box header and a sample per write, and a header fix-up after every fragment.
+	MockTarget target;
+	WriteCoalescingBuffer buffer(&target, 256 * 1024);
+	vector<uint8_t> header = MakeData(8, 1);
+	vector<uint8_t> sample = MakeData(1500, 2);
+	auto start = chrono::steady_clock::now();
+	for (int fragment = 0; fragment < 1000; fragment++) {
+		int64_t fragmentStart = buffer.GetPosition();
+		buffer.Write(header.data(), header.size());
+		for (int i = 0; i < 100; i++) {
+			buffer.Write(header.data(), header.size());
+			buffer.Write(sample.data(), sample.size());
+		}
+		int64_t fragmentEnd = buffer.GetPosition();
+		buffer.Seek(fragmentStart, WriteCoalescingSeekOrigin::Begin, nullptr);
+		buffer.Write(header.data(), header.size());
+		buffer.Seek(fragmentEnd, WriteCoalescingSeekOrigin::Begin, nullptr);
+	}
+	buffer.Flush();
+	double millis = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	WRITE_COALESCING_STATS stats = buffer.GetStats();
+	printf("\n%llu writes and %llu seeks coalesced into %llu writes and %llu seeks (%llu patched writes, %llu bytes) in %.1f ms\n",
+		static_cast<unsigned long long>(stats.WriteCalls), static_cast<unsigned long long>(stats.SeekCalls),
+		static_cast<unsigned long long>(stats.TargetWriteCalls), static_cast<unsigned long long>(stats.TargetSeekCalls),
+		static_cast<unsigned long long>(stats.PatchedWrites), static_cast<unsigned long long>(stats.BytesWritten), millis);
+	return isOk ? 0 : 1;
+}
@@ -0,0 +1,285 @@
+//Checks the YUV to Bgra32 kernels of YuvConverter.h against a floating point reference and against each other, and compares their speed.
+//The kernels don't depend on Windows, so the benchmark runs on Linux.
+//
+//Build and run from this directory:
+//  g++ -std=c++17 -O2 -msse2 -I.. YuvConverterBenchmark.cpp ../YuvConverter.cpp -o yuv_converter_benchmark
+//  ./yuv_converter_benchmark
+//
+//The AVX2 kernel is compiled in either way and only checked and timed when the CPU supports it.
+//Every kernel must give exactly the same pixels, and stay within 1 of the floating point reference for every Y, U and V value.
+//Random images cover every width up to 67 and odd heights, with padded pitches, for both formats, matrices and ranges.
+
+#include "YuvConverter.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+namespace {
+	int failures = 0;
+
+	void Check(bool condition, const char *name)
+	{
+		printf("%-70s %s\n", name, condition ? "ok" : "FAILED");
+		if (!condition) {
+			failures++;
+		}
+	}
+
+	const YuvKernel Kernels[] = { YuvKernel::Scalar, YuvKernel::Sse2, YuvKernel::Avx2 };
+	const char *KernelNames[] = { "scalar", "SSE2", "AVX2" };
+	const YuvColorMatrix Matrices[] = { YuvColorMatrix::BT601, YuvColorMatrix::BT709 };
+	const YuvColorRange Ranges[] = { YuvColorRange::Limited, YuvColorRange::Full };
+	const YuvFormat Formats[] = { YuvFormat::NV12, YuvFormat::YUY2 };
+
+	void ReferencePixel(int y, int u, int v, YuvColorMatrix matrix, YuvColorRange range, double bgr[3])
+	{
+		double kr = matrix == YuvColorMatrix::BT709 ? 0.2126 : 0.299;
+		double kb = matrix == YuvColorMatrix::BT709 ? 0.0722 : 0.114;
+		double kg = 1.0 - kr - kb;
+		double luma, pb, pr;
+		if (range == YuvColorRange::Limited) {
+			luma = (y - 16) * 255.0 / 219.0;
+			pb = (u - 128) * 255.0 / 224.0;
+			pr = (v - 128) * 255.0 / 224.0;
+		}
+		else {
+			luma = y;
+			pb = u - 128;
+			pr = v - 128;
+		}
+		bgr[0] = luma + 2.0 * (1.0 - kb) * pb;
+		bgr[1] = luma - 2.0 * (1.0 - kb) * kb / kg * pb - 2.0 * (1.0 - kr) * kr / kg * pr;
+		bgr[2] = luma + 2.0 * (1.0 - kr) * pr;
+	}
+
+	/// <summary>
+	/// Builds a YUY2 image with one pixel for every combination of Y, U and V.
+	/// Every kernel converts it, and every pixel must be within 1 of the reference.
+	/// </summary>
+	bool CheckAllValues(YuvKernel kernel, YuvColorMatrix matrix, YuvColorRange range)
+	{
+		const uint32_t width = 256 * 2;
+		const uint32_t height = 256 * 128;
+		vector<uint8_t> yuy2(static_cast<size_t>(width) * 2 * height);
+		for (uint32_t row = 0; row < height; row++) {
+			uint8_t *pairs = yuy2.data() + static_cast<size_t>(row) * width * 2;
+			for (uint32_t pair = 0; pair < 256; pair++) {
+				uint32_t index = row * 256 + pair;
+				pairs[pair * 4 + 0] = static_cast<uint8_t>(index * 2 % 256);
+				pairs[pair * 4 + 1] = static_cast<uint8_t>(index / 128 % 256);
+				pairs[pair * 4 + 2] = static_cast<uint8_t>((index * 2 + 1) % 256);
+				pairs[pair * 4 + 3] = static_cast<uint8_t>(index / 32768);
+			}
+		}
+		vector<uint8_t> bgra(static_cast<size_t>(width) * 4 * height);
+		YUV_IMAGE image = MakeYuvImage(YuvFormat::YUY2, width, height, yuy2.data(), width * 2);
+		if (!ConvertYuvToBgra(image, matrix, range, bgra.data(), width * 4, kernel)) {
+			return false;
+		}
+		for (uint32_t row = 0; row < height; row++) {
+			for (uint32_t x = 0; x < width; x++) {
+				const uint8_t *pair = yuy2.data() + static_cast<size_t>(row) * width * 2 + (x & ~1u) * 2;
+				int y = pair[(x & 1) * 2];
+				double reference[3];
+				ReferencePixel(y, pair[1], pair[3], matrix, range, reference);
+				const uint8_t *pixel = bgra.data() + (static_cast<size_t>(row) * width + x) * 4;
+				for (int channel = 0; channel < 3; channel++) {
+					double expected = min(255.0, max(0.0, reference[channel]));
+					if (fabs(pixel[channel] - expected) > 1.0) {
+						return false;
+					}
+				}
+				if (pixel[3] != 0xFF) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	struct TEST_IMAGE {
+		YUV_IMAGE Image;
+		vector<uint8_t> Data;
+		vector<uint8_t> ChromaData;
+	};
+
+	void MakeRandomImage(YuvFormat format, uint32_t width, uint32_t height, uint32_t padding, mt19937 &random, TEST_IMAGE &test)
+	{
+		uniform_int_distribution<int> byteDistribution(0, 255);
+		uint32_t evenWidth = (width + 1) & ~1u;
+		test.Image = YUV_IMAGE();
+		test.Image.Format = format;
+		test.Image.Width = width;
+		test.Image.Height = height;
+		test.Image.Pitch = (format == YuvFormat::NV12 ? width : evenWidth * 2) + padding;
+		test.Data.resize(static_cast<size_t>(test.Image.Pitch) * height);
+		for (auto &value : test.Data) {
+			value = static_cast<uint8_t>(byteDistribution(random));
+		}
+		test.Image.Data = test.Data.data();
+		if (format == YuvFormat::NV12) {
+			//A separate chroma plane with its own pitch, so reading past either plane is caught by the sanitizers.
+			test.Image.ChromaPitch = evenWidth + padding / 2 * 2;
+			test.ChromaData.resize(static_cast<size_t>(test.Image.ChromaPitch) * ((height + 1) / 2));
+			for (auto &value : test.ChromaData) {
+				value = static_cast<uint8_t>(byteDistribution(random));
+			}
+			test.Image.ChromaData = test.ChromaData.data();
+		}
+	}
+
+	bool CheckKernelsMatch(YuvKernel kernel)
+	{
+		mt19937 random(1234);
+		TEST_IMAGE test;
+		for (YuvFormat format : Formats) {
+			for (uint32_t width = 1; width <= 67; width++) {
+				for (uint32_t height : { 1u, 2u, 3u, 7u }) {
+					for (uint32_t padding : { 0u, 5u, 64u }) {
+						MakeRandomImage(format, width, height, padding, random, test);
+						for (YuvColorMatrix matrix : Matrices) {
+							for (YuvColorRange range : Ranges) {
+								//The output is padded too, and the padding must not be written.
+								uint32_t bgraPitch = width * 4 + padding * 4;
+								vector<uint8_t> expected(static_cast<size_t>(bgraPitch) * height, 0xCD);
+								vector<uint8_t> actual(expected.size(), 0xCD);
+								if (!ConvertYuvToBgra(test.Image, matrix, range, expected.data(), bgraPitch, YuvKernel::Scalar)
+									|| !ConvertYuvToBgra(test.Image, matrix, range, actual.data(), bgraPitch, kernel)
+									|| expected != actual) {
+									return false;
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	bool CheckKnownColors()
+	{
+		struct KNOWN_COLOR {
+			uint8_t Y, U, V;
+			YuvColorMatrix Matrix;
+			YuvColorRange Range;
+			uint8_t B, G, R;
+		};
+		const KNOWN_COLOR colors[] = {
+			{ 16, 128, 128, YuvColorMatrix::BT601, YuvColorRange::Limited, 0, 0, 0 },
+			{ 235, 128, 128, YuvColorMatrix::BT601, YuvColorRange::Limited, 255, 255, 255 },
+			{ 0, 128, 128, YuvColorMatrix::BT709, YuvColorRange::Full, 0, 0, 0 },
+			{ 255, 128, 128, YuvColorMatrix::BT709, YuvColorRange::Full, 255, 255, 255 },
+			{ 81, 90, 240, YuvColorMatrix::BT601, YuvColorRange::Limited, 0, 0, 255 },
+			{ 145, 54, 34, YuvColorMatrix::BT601, YuvColorRange::Limited, 0, 255, 0 },
+			{ 41, 240, 110, YuvColorMatrix::BT601, YuvColorRange::Limited, 255, 0, 0 },
+			{ 63, 102, 240, YuvColorMatrix::BT709, YuvColorRange::Limited, 0, 0, 255 },
+			{ 173, 42, 26, YuvColorMatrix::BT709, YuvColorRange::Limited, 0, 255, 0 },
+			{ 32, 240, 118, YuvColorMatrix::BT709, YuvColorRange::Limited, 255, 0, 0 },
+		};
+		for (const auto &color : colors) {
+			uint8_t y[2] = { color.Y, color.Y };
+			uint8_t uv[2] = { color.U, color.V };
+			YUV_IMAGE image;
+			image.Format = YuvFormat::NV12;
+			image.Width = 2;
+			image.Height = 1;
+			image.Data = y;
+			image.Pitch = 2;
+			image.ChromaData = uv;
+			image.ChromaPitch = 2;
+			uint8_t bgra[8];
+			if (!ConvertYuvToBgra(image, color.Matrix, color.Range, bgra, 8)) {
+				return false;
+			}
+			if (abs(bgra[0] - color.B) > 2 || abs(bgra[1] - color.G) > 2 || abs(bgra[2] - color.R) > 2) {
+				printf("  Y %d U %d V %d gave %d %d %d, expected %d %d %d\n", color.Y, color.U, color.V, bgra[0], bgra[1], bgra[2], color.B, color.G, color.R);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool CheckInvalidImages()
+	{
+		uint8_t data[64] = {};
+		uint8_t bgra[64] = {};
+		YUV_IMAGE image = MakeYuvImage(YuvFormat::NV12, 4, 2, data, 4);
+		bool isValid = ConvertYuvToBgra(image, YuvColorMatrix::BT601, YuvColorRange::Limited, bgra, 16);
+		YUV_IMAGE narrowPitch = MakeYuvImage(YuvFormat::NV12, 4, 2, data, 3);
+		YUV_IMAGE narrowPacked = MakeYuvImage(YuvFormat::YUY2, 3, 2, data, 6);
+		YUV_IMAGE empty = MakeYuvImage(YuvFormat::YUY2, 0, 2, data, 8);
+		return isValid
+			&& !ConvertYuvToBgra(narrowPitch, YuvColorMatrix::BT601, YuvColorRange::Limited, bgra, 16)
+			&& !ConvertYuvToBgra(narrowPacked, YuvColorMatrix::BT601, YuvColorRange::Limited, bgra, 16)
+			&& !ConvertYuvToBgra(empty, YuvColorMatrix::BT601, YuvColorRange::Limited, bgra, 16)
+			&& !ConvertYuvToBgra(image, YuvColorMatrix::BT601, YuvColorRange::Limited, bgra, 12)
+			&& GetYuvBufferSize(YuvFormat::NV12, 3, 8) == 40
+			&& GetYuvBufferSize(YuvFormat::YUY2, 3, 8) == 24;
+	}
+
+	double TimeKernel(YuvFormat format, YuvKernel kernel)
+	{
+		const uint32_t width = 1920;
+		const uint32_t height = 1080;
+		const int frames = 200;
+		uint32_t pitch = format == YuvFormat::NV12 ? width : width * 2;
+		vector<uint8_t> data(GetYuvBufferSize(format, height, pitch));
+		mt19937 random(42);
+		uniform_int_distribution<int> byteDistribution(0, 255);
+		for (auto &value : data) {
+			value = static_cast<uint8_t>(byteDistribution(random));
+		}
+		vector<uint8_t> bgra(static_cast<size_t>(width) * 4 * height);
+		YUV_IMAGE image = MakeYuvImage(format, width, height, data.data(), pitch);
+		auto start = chrono::steady_clock::now();
+		for (int frame = 0; frame < frames; frame++) {
+			ConvertYuvToBgra(image, YuvColorMatrix::BT709, YuvColorRange::Limited, bgra.data(), width * 4, kernel);
+		}
+		auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		return elapsed / frames;
+	}
+}
+
+int main()
+{
+	char name[128];
+	for (int kernel = 0; kernel < 3; kernel++) {
+		if (!IsYuvKernelSupported(Kernels[kernel])) {
+			printf("%s kernel not supported on this CPU, skipped\n", KernelNames[kernel]);
+			continue;
+		}
+		for (YuvColorMatrix matrix : Matrices) {
+			for (YuvColorRange range : Ranges) {
+				snprintf(name, sizeof(name), "%s %s %s range matches the reference for all values", KernelNames[kernel],
+					matrix == YuvColorMatrix::BT709 ? "BT.709" : "BT.601", range == YuvColorRange::Full ? "full" : "limited");
+				Check(CheckAllValues(Kernels[kernel], matrix, range), name);
+			}
+		}
+		if (Kernels[kernel] != YuvKernel::Scalar) {
+			snprintf(name, sizeof(name), "%s kernel matches the scalar kernel for odd sizes and pitches", KernelNames[kernel]);
+			Check(CheckKernelsMatch(Kernels[kernel]), name);
+		}
+	}
+	Check(CheckKnownColors(), "black, white and primaries convert to the expected colors");
+	Check(CheckInvalidImages(), "images that don't fit their pitch are rejected");
+
+	printf("\nConverting a 1920x1080 frame, BT.709 limited range:\n");
+	for (YuvFormat format : Formats) {
+		double scalar = TimeKernel(format, YuvKernel::Scalar);
+		for (int kernel = 0; kernel < 3; kernel++) {
+			if (!IsYuvKernelSupported(Kernels[kernel])) {
+				continue;
+			}
+			double milliseconds = kernel == 0 ? scalar : TimeKernel(format, Kernels[kernel]);
+			printf("  %s %-7s %7.3f ms (%.1fx)\n", format == YuvFormat::NV12 ? "NV12" : "YUY2", KernelNames[kernel], milliseconds, scalar / milliseconds);
+		}
+	}
+	return failures == 0 ? 0 : 1;
+}
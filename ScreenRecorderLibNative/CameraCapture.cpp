@@ -172,7 +172,18 @@ HRESULT CameraCapture::InitializeMediaSource(
 				//LogMediaType(pInputMediaType);
 				if (ppOutputMediaType) {
 					SafeRelease(&pMediaTransform);
-					hr = CreateIMFTransform(streamIndex, pInputMediaType, &pMediaTransform, &pOutputMediaType);
+					if (GetYuvFormat(inputSubType)) {
+						//NV12 and YUY2 samples are used as they are, and converted to Bgra with the SIMD kernels of YuvConverter.h.
+						pOutputMediaType = pInputMediaType;
+						hr = S_OK;
+					}
+					else if (inputSubType == MFVideoFormat_MJPG && SUCCEEDED(CreateYuvDecoderTransform(streamIndex, pInputMediaType, &pMediaTransform, &pOutputMediaType))) {
+						//MJPEG is only decoded, and the decoded YUV frames are converted the same way.
+						hr = S_OK;
+					}
+					else {
+						hr = CreateIMFTransform(streamIndex, pInputMediaType, &pMediaTransform, &pOutputMediaType);
+					}
 					if (FAILED(hr)) {
 						LOG_INFO("Failed to create a valid media output type for video reader, attempting to create an intermediate transform");
 						CComPtr<IMFActivate> pConverterActivate = NULL;
@@ -4,19 +4,21 @@
 
 CaptureBase::CaptureBase() :
 	m_LastGrabTimeStamp{},
+	m_LastFramePresentTime(0),
 	m_Device(nullptr),
 	m_DeviceContext(nullptr),
 	m_RecordingSource(nullptr),
 	m_TextureManager(nullptr),
-	m_FrameDataCallbackTexture(nullptr)
+	m_BitmapCallbackWorkerPool(nullptr),
+	m_BitmapReadback(nullptr)
 {
-	RtlZeroMemory(&m_FrameDataCallbackTextureDesc, sizeof(m_FrameDataCallbackTextureDesc));
 }
 CaptureBase::~CaptureBase()
 {
+	//Wait for a running bitmap callback before the recording source can go away.
+	m_BitmapReadback.reset();
 	SafeRelease(&m_Device);
 	SafeRelease(&m_DeviceContext);
-	SafeRelease(&m_FrameDataCallbackTexture);
 }
 SIZE CaptureBase::GetContentOffset(_In_ ContentAnchor anchor, _In_ RECT parentRect, _In_ RECT contentRect)
 {
@@ -55,53 +57,57 @@ SIZE CaptureBase::GetContentOffset(_In_ ContentAnchor anchor, _In_ RECT parentRe
 }
 
 HRESULT CaptureBase::SendBitmapCallback(_In_ ID3D11Texture2D *pTexture) {
-	HRESULT hr = S_FALSE;
-	CComPtr< ID3D11Texture2D> pProcessedTexture = nullptr;
-	if (m_RecordingSource->IsVideoFramePreviewEnabled.value_or(false) && m_RecordingSource->HasRegisteredCallbacks()) {
-		D3D11_TEXTURE2D_DESC textureDesc;
-		pTexture->GetDesc(&textureDesc);
-		if (m_RecordingSource->VideoFramePreviewSize.has_value()) {
-			long cx = m_RecordingSource->VideoFramePreviewSize.value().cx;
-			long cy = m_RecordingSource->VideoFramePreviewSize.value().cy;
-			if (cx > 0 && cy == 0) {
-				cy = static_cast<long>(round((static_cast<double>(textureDesc.Height) / static_cast<double>(textureDesc.Width)) * cx));
-			}
-			else if (cx == 0 && cy > 0) {
-				cx = static_cast<long>(round((static_cast<double>(textureDesc.Width) / static_cast<double>(textureDesc.Height)) * cy));
+	if (IsBitmapCallbackDue()) {
+		return ReadBackBitmap(pTexture);
+	}
+	return S_FALSE;
+}
+
+bool CaptureBase::IsBitmapCallbackDue() {
+	if (!m_RecordingSource->IsVideoFramePreviewEnabled.value_or(false) || !m_RecordingSource->HasRegisteredCallbacks()) {
+		return false;
+	}
+	if (!m_BitmapReadback) {
+		m_BitmapReadback = make_unique<TextureReadback>(m_BitmapCallbackWorkerPool);
+		HRESULT hr = m_BitmapReadback->Initialize(m_DeviceContext, m_Device, [this](int frameNumber, INT64 timestamp, FRAME_BITMAP_DATA *pBitmap) {
+			if (pBitmap) {
+				m_RecordingSource->NotifyNewFrameDataCallbacks(abs(pBitmap->Stride), pBitmap->Data, pBitmap->Length, pBitmap->Width, pBitmap->Height);
 			}
-			ID3D11Texture2D *pResizedTexture;
-			RETURN_ON_BAD_HR(hr = m_TextureManager->ResizeTexture(pTexture, SIZE{ cx,cy }, TextureStretchMode::Uniform, &pResizedTexture));
-			pProcessedTexture.Attach(pResizedTexture);
-			pResizedTexture->GetDesc(&textureDesc);
-		}
-		else {
-			pProcessedTexture.Attach(pTexture);
-			pTexture->AddRef();
+		});
+		if (FAILED(hr)) {
+			LOG_ERROR(L"Failed to initialize bitmap readback: hr = 0x%08x", hr);
+			m_BitmapReadback.reset();
+			return false;
 		}
-		int width = textureDesc.Width;
-		int height = textureDesc.Height;
+	}
+	m_BitmapReadback->SetMaxFramesPerSecond(m_RecordingSource->VideoFramePreviewFps.value_or(0));
+	return m_BitmapReadback->IsReadbackDue();
+}
 
-		if (m_FrameDataCallbackTextureDesc.Width != width || m_FrameDataCallbackTextureDesc.Height != height) {
-			SafeRelease(&m_FrameDataCallbackTexture);
-			textureDesc.Usage = D3D11_USAGE_STAGING;
-			textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-			textureDesc.MiscFlags = 0;
-			textureDesc.BindFlags = 0;
-			RETURN_ON_BAD_HR(m_Device->CreateTexture2D(&textureDesc, nullptr, &m_FrameDataCallbackTexture));
-			m_FrameDataCallbackTextureDesc = textureDesc;
+HRESULT CaptureBase::ReadBackBitmap(_In_ ID3D11Texture2D *pTexture) {
+	HRESULT hr = S_OK;
+	if (!m_BitmapReadback) {
+		return S_FALSE;
+	}
+	CComPtr<ID3D11Texture2D> pProcessedTexture = nullptr;
+	//Downscale on the GPU before the readback, to copy as little as possible to the CPU.
+	if (m_RecordingSource->VideoFramePreviewSize.has_value()) {
+		D3D11_TEXTURE2D_DESC textureDesc;
+		pTexture->GetDesc(&textureDesc);
+		long cx = m_RecordingSource->VideoFramePreviewSize.value().cx;
+		long cy = m_RecordingSource->VideoFramePreviewSize.value().cy;
+		if (cx > 0 && cy == 0) {
+			cy = static_cast<long>(round((static_cast<double>(textureDesc.Height) / static_cast<double>(textureDesc.Width)) * cx));
 		}
-
-		m_DeviceContext->CopyResource(m_FrameDataCallbackTexture, pProcessedTexture);
-		D3D11_MAPPED_SUBRESOURCE map;
-		m_DeviceContext->Map(m_FrameDataCallbackTexture, 0, D3D11_MAP_READ, 0, &map);
-
-		int bytesPerPixel = map.RowPitch / width;
-		int len = map.DepthPitch;
-		int stride = map.RowPitch;
-		BYTE *data = static_cast<BYTE *>(map.pData);
-
-		m_RecordingSource->NotifyNewFrameDataCallbacks(abs(stride), data, len, width, height);
-		m_DeviceContext->Unmap(m_FrameDataCallbackTexture, 0);
+		else if (cx == 0 && cy > 0) {
+			cx = static_cast<long>(round((static_cast<double>(textureDesc.Width) / static_cast<double>(textureDesc.Height)) * cy));
+		}
+		ID3D11Texture2D *pResizedTexture;
+		RETURN_ON_BAD_HR(hr = m_TextureManager->ResizeTexture(pTexture, SIZE{ cx,cy }, TextureStretchMode::Uniform, &pResizedTexture));
+		pProcessedTexture.Attach(pResizedTexture);
 	}
-	return hr;
-}
\ No newline at end of file
+	else {
+		pProcessedTexture = pTexture;
+	}
+	return m_BitmapReadback->Enqueue(0, 0, pProcessedTexture);
+}
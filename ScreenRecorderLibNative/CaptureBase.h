@@ -1,6 +1,7 @@
 #pragma once
 #include "CommonTypes.h"
 #include "TextureManager.h"
+#include "TextureReadback.h"
 class CaptureBase abstract
 {
 public:
@@ -15,6 +16,14 @@ public:
 	virtual std::wstring Name() abstract;
 	virtual HRESULT SendBitmapCallback(_In_ ID3D11Texture2D *pTexture);
 	/// <summary>
+	/// Sets the worker pool that delivers the frame bitmaps of this source. The pool can be shared with other sources. Must be called before the first frame is captured.
+	/// </summary>
+	void SetBitmapCallbackWorkerPool(_In_ std::shared_ptr<ReadbackWorkerPool> pWorkerPool) { m_BitmapCallbackWorkerPool = pWorkerPool; }
+	/// <summary>
+	/// Returns the time the content last written to the shared surface was presented, in 100 nanosecond units on the performance counter clock, or 0 if the source doesn't know.
+	/// </summary>
+	INT64 GetLastFramePresentTime() { return m_LastFramePresentTime; }
+	/// <summary>
 	/// Calculate the offset used to position the content withing the parent frame based on the given anchor.
 	/// </summary>
 	/// <param name="anchor"></param>
@@ -29,8 +38,18 @@ protected:
 	std::unique_ptr<TextureManager> m_TextureManager;
 	RECORDING_SOURCE_BASE *m_RecordingSource;
 	LARGE_INTEGER m_LastGrabTimeStamp;
+	INT64 m_LastFramePresentTime;
 
+	/// <summary>
+	/// Returns true if a bitmap should be sent for the current frame, based on the preview options and preview frame rate of the source.
+	/// Must be called once per frame, before preparing the bitmap.
+	/// </summary>
+	bool IsBitmapCallbackDue();
+	/// <summary>
+	/// Resizes the texture to the preview size of the source and queues it for readback. The bitmap callbacks are called asynchronously.
+	/// </summary>
+	HRESULT ReadBackBitmap(_In_ ID3D11Texture2D *pTexture);
 private:
-	ID3D11Texture2D *m_FrameDataCallbackTexture;
-	D3D11_TEXTURE2D_DESC m_FrameDataCallbackTextureDesc;
+	std::shared_ptr<ReadbackWorkerPool> m_BitmapCallbackWorkerPool;
+	std::unique_ptr<TextureReadback> m_BitmapReadback;
 };
\ No newline at end of file
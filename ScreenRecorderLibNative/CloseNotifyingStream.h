@@ -0,0 +1,86 @@
+#pragma once
+#include <objidl.h>
+#include <Shlwapi.h>
+/// <summary>
+/// Wraps an IStream and signals an event when the last reference is released and the inner stream has been released.
+/// Used to get notified when Media Foundation has released an output file, instead of polling the file for access.
+/// </summary>
+class CloseNotifyingStream : public IStream {
+
+public:
+	CloseNotifyingStream(_In_ IStream *pInner, _In_ HANDLE hClosedEvent) :
+		m_nRefCount(1),
+		m_BytesWritten(0),
+		m_pInner(pInner),
+		m_hClosedEvent(hClosedEvent)
+	{
+		m_pInner->AddRef();
+	}
+	virtual ~CloseNotifyingStream()
+	{
+		m_pInner->Release();
+		m_pInner = nullptr;
+		if (m_hClosedEvent != NULL) {
+			SetEvent(m_hClosedEvent);
+		}
+	}
+
+	// ISequentialStream methods
+	STDMETHODIMP Read(void *pv, ULONG cb, ULONG *pcbRead) { return m_pInner->Read(pv, cb, pcbRead); }
+	STDMETHODIMP Write(const void *pv, ULONG cb, ULONG *pcbWritten) {
+		ULONG written = 0;
+		HRESULT hr = m_pInner->Write(pv, cb, &written);
+		InterlockedExchangeAdd64(&m_BytesWritten, written);
+		if (pcbWritten) {
+			*pcbWritten = written;
+		}
+		return hr;
+	}
+
+	// IStream methods
+	STDMETHODIMP Seek(LARGE_INTEGER dlibMove, DWORD dwOrigin, ULARGE_INTEGER *plibNewPosition) { return m_pInner->Seek(dlibMove, dwOrigin, plibNewPosition); }
+	STDMETHODIMP SetSize(ULARGE_INTEGER libNewSize) { return m_pInner->SetSize(libNewSize); }
+	STDMETHODIMP CopyTo(IStream *pstm, ULARGE_INTEGER cb, ULARGE_INTEGER *pcbRead, ULARGE_INTEGER *pcbWritten) { return m_pInner->CopyTo(pstm, cb, pcbRead, pcbWritten); }
+	STDMETHODIMP Commit(DWORD grfCommitFlags) { return m_pInner->Commit(grfCommitFlags); }
+	STDMETHODIMP Revert() { return m_pInner->Revert(); }
+	STDMETHODIMP LockRegion(ULARGE_INTEGER libOffset, ULARGE_INTEGER cb, DWORD dwLockType) { return m_pInner->LockRegion(libOffset, cb, dwLockType); }
+	STDMETHODIMP UnlockRegion(ULARGE_INTEGER libOffset, ULARGE_INTEGER cb, DWORD dwLockType) { return m_pInner->UnlockRegion(libOffset, cb, dwLockType); }
+	STDMETHODIMP Stat(STATSTG *pstatstg, DWORD grfStatFlag) { return m_pInner->Stat(pstatstg, grfStatFlag); }
+	//Clones would keep the file open without being tracked, so they are not supported.
+	STDMETHODIMP Clone(IStream **ppstm) { return E_NOTIMPL; }
+
+	/// <summary>
+	/// The total number of bytes written through this stream. Rewrites of earlier data are counted again.
+	/// </summary>
+	LONGLONG GetBytesWritten() {
+		return InterlockedCompareExchange64(&m_BytesWritten, 0, 0);
+	}
+
+	// IUnknown methods
+	STDMETHODIMP QueryInterface(REFIID riid, void **ppv) {
+		static const QITAB qit[] = {
+			QITABENT(CloseNotifyingStream, IStream),
+			QITABENT(CloseNotifyingStream, ISequentialStream),
+		{0}
+		};
+		return QISearch(this, qit, riid, ppv);
+	}
+
+	STDMETHODIMP_(ULONG) AddRef() {
+		return InterlockedIncrement(&m_nRefCount);
+	}
+
+	STDMETHODIMP_(ULONG) Release() {
+		ULONG refCount = InterlockedDecrement(&m_nRefCount);
+		if (refCount == 0) {
+			delete this;
+		}
+		return refCount;
+	}
+
+private:
+	volatile long m_nRefCount;
+	volatile LONGLONG m_BytesWritten;
+	IStream *m_pInner;
+	HANDLE m_hClosedEvent;
+};
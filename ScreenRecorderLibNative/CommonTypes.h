@@ -11,6 +11,7 @@
 #include <optional>
 #include <wincodec.h>
 #include <chrono>
+#include <memory>
 #include "util.h"
 
 typedef void(__stdcall *CallbackNewFrameDataFunction)(int, byte *, int, int, int);
@@ -95,9 +96,13 @@ struct PTR_INFO
 	SIZE_F Scale;
 	bool Visible;
 	bool IsPointerShapeUpdated;
+	//Set to a new value every time a new shape is written to PtrShapeBuffer, so a cached copy of the shape can be reused until it changes.
+	UINT64 ShapeVersion;
 	UINT BufferSize;
 	RECT WhoUpdatedPositionLast;
 	LARGE_INTEGER LastTimeStamp;
+	//The position of the hotspot in screen coordinates when Position was last updated, to place mouse events relative to the pointer.
+	POINT ScreenPosition;
 
 	PTR_INFO() :
 		Position{},
@@ -105,9 +110,11 @@ struct PTR_INFO
 		Scale{ 1.0, 1.0 },
 		Visible(false),
 		IsPointerShapeUpdated(false),
+		ShapeVersion(0),
 		BufferSize(0),
 		WhoUpdatedPositionLast{},
 		LastTimeStamp{},
+		ScreenPosition{},
 		PtrShapeBuffer(nullptr)
 	{
 		RtlZeroMemory(&ShapeInfo, sizeof(ShapeInfo));
@@ -143,6 +150,8 @@ struct GRAPHICS_FRAME_DATA
 	ID3D11Texture2D *Frame;
 	SIZE ContentSize;
 	LARGE_INTEGER Timestamp;
+	//The Direct3D11CaptureFrame::SystemRelativeTime of the frame, which is when it was presented, in 100 nanosecond units on the performance counter clock.
+	INT64 PresentTime;
 };
 
 //
@@ -166,6 +175,17 @@ struct CAPTURED_FRAME
 	std::optional<PTR_INFO> PtrInfo;
 	//The number of updates written to the current frame since last fetch.
 	int FrameUpdateCount;
+	//The time the newest content written to the frame since last fetch was presented, in 100 nanosecond units on the performance counter clock. Not set if there is no new content.
+	std::optional<INT64> PresentationTime;
+};
+
+enum class VideoLoopModeInternal {
+	///<summary>Seek back to the start when the end of the video is reached. The last frame is shown until the first frame is decoded again.</summary>
+	Seek = 0,
+	///<summary>Cache the first frames of the video, and show them while the video is decoded from the start again.</summary>
+	Gapless = 1,
+	///<summary>Cache every frame of short videos and play them from the cache after the first pass. Longer videos are looped as with Gapless.</summary>
+	Cached = 2
 };
 
 enum class RecorderModeInternal {
@@ -174,7 +194,36 @@ enum class RecorderModeInternal {
 	///<summary>Record a slideshow of pictures. </summary>
 	Slideshow = 1,
 	///<summary>Create a single screenshot.</summary>
-	Screenshot = 2
+	Screenshot = 2,
+	///<summary>Record an animated GIF or APNG.</summary>
+	Animation = 3
+};
+
+enum class AnimationFormatInternal {
+	///<summary>Animated GIF, with up to 255 colors per frame.</summary>
+	Gif = 0,
+	///<summary>Lossless animated PNG.</summary>
+	Apng = 1
+};
+
+enum class ImageEncoderInternal {
+	///<summary>Encode images with the Windows Imaging Component, in the container format of the snapshot options.</summary>
+	Wic = 0,
+	///<summary>The built-in PNG encoder, tuned for speed on screen content.</summary>
+	FastPng = 1,
+	///<summary>The built-in QOI encoder.</summary>
+	Qoi = 2,
+	///<summary>The built-in JPEG encoder.</summary>
+	FastJpeg = 3
+};
+
+enum class SegmentManifestFormatInternal {
+	///<summary>No manifest is written.</summary>
+	None = 0,
+	///<summary>An HLS-style .m3u8 playlist of the segments.</summary>
+	M3U8 = 1,
+	///<summary>A .json file listing the segments.</summary>
+	Json = 2
 };
 
 enum class TextureStretchMode {
@@ -258,6 +307,14 @@ public:
 	/// The requested dimensions of the frame preview bitmap
 	/// </summary>
 	std::optional<SIZE> VideoFramePreviewSize;
+	/// <summary>
+	/// The max number of frame preview bitmaps per second for this source. 0 or nullopt sends a bitmap for every captured frame.
+	/// </summary>
+	std::optional<UINT32> VideoFramePreviewFps;
+	/// <summary>
+	/// How video sources restart when the end of the video is reached. nullopt seeks back to the start.
+	/// </summary>
+	std::optional<VideoLoopModeInternal> LoopMode;
 
 	RECORDING_SOURCE_BASE() :
 		Type(RecordingSourceType::Display),
@@ -273,6 +330,8 @@ public:
 		IsBorderRequired(std::nullopt),
 		IsVideoFramePreviewEnabled(std::nullopt),
 		VideoFramePreviewSize(std::nullopt),
+		VideoFramePreviewFps(std::nullopt),
+		LoopMode(std::nullopt),
 		m_NewFrameDataCallbacks{}
 	{
 
@@ -399,11 +458,16 @@ struct THREAD_DATA_BASE
 //
 // Structure to pass to a new thread
 //
+class ReadbackWorkerPool;
 struct CAPTURE_THREAD_DATA :THREAD_DATA_BASE
 {
 	RECORDING_SOURCE_DATA *RecordingSource{ nullptr };
 	INT64 TotalUpdatedFrameCount{};
+	//The time the content last written to the shared surface was presented, in 100 nanosecond units on the performance counter clock.
+	INT64 LastPresentTime{};
 	PTR_INFO *PtrInfo{ nullptr };
+	//Delivers the frame bitmaps of all sources.
+	std::shared_ptr<ReadbackWorkerPool> BitmapCallbackWorkerPool{ nullptr };
 };
 
 //
@@ -430,6 +494,7 @@ struct MOUSE_OPTIONS {
 protected:
 	bool m_IsMouseClicksDetected = false;
 	bool m_IsMousePointerEnabled = true;
+	bool m_IsMousePointerMetadataEnabled = false;
 	std::string m_MouseClickDetectionLMBColor = "#FFFF00";
 	std::string m_MouseClickDetectionRMBColor = "#FFFF00";
 	UINT32 m_MouseClickDetectionRadius = 20;
@@ -440,6 +505,7 @@ public:
 	static const UINT32 MOUSE_DETECTION_MODE_HOOK = 1;
 
 	void SetMousePointerEnabled(bool value) { m_IsMousePointerEnabled = value; }
+	void SetMousePointerMetadataEnabled(bool value) { m_IsMousePointerMetadataEnabled = value; }
 	void SetDetectMouseClicks(bool value) { m_IsMouseClicksDetected = value; }
 	void SetMouseClickDetectionLMBColor(std::string value) { m_MouseClickDetectionLMBColor = value; }
 	void SetMouseClickDetectionRMBColor(std::string value) { m_MouseClickDetectionRMBColor = value; }
@@ -449,6 +515,10 @@ public:
 
 	bool IsMouseClicksDetected() { return m_IsMouseClicksDetected; }
 	bool IsMousePointerEnabled() { return m_IsMousePointerEnabled; }
+	/// <summary>
+	/// Returns true if the pointer is recorded to a cursor track next to the recording.
+	/// </summary>
+	bool IsMousePointerMetadataEnabled() { return m_IsMousePointerMetadataEnabled; }
 	std::string GetMouseClickDetectionLMBColor() { return m_MouseClickDetectionLMBColor; }
 	std::string GetMouseClickDetectionRMBColor() { return m_MouseClickDetectionRMBColor; }
 	UINT32 GetMouseClickDetectionRadius() { return  m_MouseClickDetectionRadius; }
@@ -515,6 +585,21 @@ public:
 	UINT32 getInputMasterChannel() { return m_InputMasterChannel; }
 };
 
+/// <summary>
+/// An additional video output, encoded from the same composed frames and audio as the recording.
+/// </summary>
+struct OUTPUT_RENDITION {
+	std::wstring OutputPath;
+	//The frame size of the rendition. If one dimension is 0, it is calculated from the aspect ratio of the recording. If not set, the frame size of the recording is used.
+	std::optional<SIZE> FrameSize{};
+	//Only every Nth frame of the recording is encoded to the rendition.
+	UINT32 FramerateDivisor = 1;
+	//Bitrate in bits per second. If not set, the bitrate settings of the recording are used.
+	std::optional<UINT32> VideoBitrate{};
+	//If not set, the container setting of the recording is used.
+	std::optional<bool> IsFragmentedMp4Enabled{};
+};
+
 struct OUTPUT_OPTIONS {
 protected:
 	std::optional<SIZE> m_FrameSize{};
@@ -524,6 +609,20 @@ protected:
 	bool m_IsVideoCaptureEnabled = true;
 	bool m_IsVideoFramePreviewEnabled = false;
 	std::optional<SIZE> m_VideoFramePreviewSize{};
+	UINT32 m_VideoFramePreviewFps = 0;//Max number of frame preview bitmaps per second. 0 previews every frame.
+	UINT32 m_StreamWriteBufferSize = 0;//Size in bytes of the write buffer used when recording to a managed stream. 0 disables buffering.
+	std::chrono::milliseconds m_SegmentDuration = std::chrono::milliseconds(0);//Max duration of each output file when recording to a file. 0 disables duration based segmenting.
+	UINT64 m_SegmentMaxSize = 0;//Max size in bytes of each output file when recording to a file. 0 disables size based segmenting.
+	SegmentManifestFormatInternal m_SegmentManifestFormat = SegmentManifestFormatInternal::None;
+	std::chrono::milliseconds m_ReplayBufferDuration = std::chrono::milliseconds(0);//Duration of the most recent encoded video to keep in memory instead of writing it to the output. 0 disables duration based buffering.
+	UINT64 m_ReplayBufferMaxSize = 0;//Max size in bytes of the encoded samples kept in memory. 0 disables size based buffering.
+	std::wstring m_FrameExportName = L"";//Name of the shared memory ring that output frames are exported to. Empty disables frame export.
+	UINT32 m_FrameExportSlotCount = 4;
+	UINT32 m_FrameExportFps = 0;//Max number of exported frames per second. 0 exports every frame.
+	UINT32 m_SlideshowEncoderThreadCount = 0;//Number of threads encoding slideshow frames in parallel. 0 picks a count from the number of processors.
+	bool m_IsSlideshowManifestEnabled = false;//Streams the path and delay of each slideshow frame to a manifest in the output folder as it is written.
+	AnimationFormatInternal m_AnimationFormat = AnimationFormatInternal::Gif;
+	std::vector<OUTPUT_RENDITION> m_Renditions{};//Additional video outputs encoded from the same frames as the recording.
 public:
 	std::optional<SIZE> GetFrameSize() { return m_FrameSize; }
 	void SetFrameSize(SIZE size) { m_FrameSize = size; }
@@ -539,6 +638,38 @@ public:
 	void SetVideoFramePreviewSize(SIZE value) { m_VideoFramePreviewSize = value; }
 	bool IsVideoFramePreviewEnabled() { return m_IsVideoFramePreviewEnabled; }
 	std::optional<SIZE> GetVideoFramePreviewSize() { return m_VideoFramePreviewSize; }
+	void SetVideoFramePreviewFps(UINT32 value) { m_VideoFramePreviewFps = value; }
+	UINT32 GetVideoFramePreviewFps() { return m_VideoFramePreviewFps; }
+	void SetStreamWriteBufferSize(UINT32 value) { m_StreamWriteBufferSize = value; }
+	UINT32 GetStreamWriteBufferSize() { return m_StreamWriteBufferSize; }
+	void SetSegmentDuration(UINT32 millis) { m_SegmentDuration = std::chrono::milliseconds(millis); }
+	std::chrono::milliseconds GetSegmentDuration() { return m_SegmentDuration; }
+	void SetSegmentMaxSize(UINT64 bytes) { m_SegmentMaxSize = bytes; }
+	UINT64 GetSegmentMaxSize() { return m_SegmentMaxSize; }
+	void SetSegmentManifestFormat(SegmentManifestFormatInternal format) { m_SegmentManifestFormat = format; }
+	SegmentManifestFormatInternal GetSegmentManifestFormat() { return m_SegmentManifestFormat; }
+	bool IsSegmentedOutputEnabled() { return m_SegmentDuration.count() > 0 || m_SegmentMaxSize > 0; }
+	void SetReplayBufferDuration(UINT32 millis) { m_ReplayBufferDuration = std::chrono::milliseconds(millis); }
+	std::chrono::milliseconds GetReplayBufferDuration() { return m_ReplayBufferDuration; }
+	void SetReplayBufferMaxSize(UINT64 bytes) { m_ReplayBufferMaxSize = bytes; }
+	UINT64 GetReplayBufferMaxSize() { return m_ReplayBufferMaxSize; }
+	bool IsReplayBufferEnabled() { return m_ReplayBufferDuration.count() > 0 || m_ReplayBufferMaxSize > 0; }
+	void SetFrameExportName(std::wstring value) { m_FrameExportName = value; }
+	std::wstring GetFrameExportName() { return m_FrameExportName; }
+	void SetFrameExportSlotCount(UINT32 value) { m_FrameExportSlotCount = value; }
+	UINT32 GetFrameExportSlotCount() { return m_FrameExportSlotCount; }
+	void SetFrameExportFps(UINT32 value) { m_FrameExportFps = value; }
+	UINT32 GetFrameExportFps() { return m_FrameExportFps; }
+	bool IsFrameExportEnabled() { return !m_FrameExportName.empty(); }
+	void SetSlideshowEncoderThreadCount(UINT32 value) { m_SlideshowEncoderThreadCount = value; }
+	UINT32 GetSlideshowEncoderThreadCount() { return m_SlideshowEncoderThreadCount; }
+	void SetIsSlideshowManifestEnabled(bool value) { m_IsSlideshowManifestEnabled = value; }
+	bool IsSlideshowManifestEnabled() { return m_IsSlideshowManifestEnabled; }
+	void SetAnimationFormat(AnimationFormatInternal value) { m_AnimationFormat = value; }
+	AnimationFormatInternal GetAnimationFormat() { return m_AnimationFormat; }
+	std::wstring GetAnimationExtension() { return m_AnimationFormat == AnimationFormatInternal::Apng ? L".png" : L".gif"; }
+	void SetRenditions(std::vector<OUTPUT_RENDITION> value) { m_Renditions = value; }
+	std::vector<OUTPUT_RENDITION> GetRenditions() { return m_Renditions; }
 };
 
 struct ENCODER_OPTIONS abstract {
@@ -582,6 +713,7 @@ public:
 	UINT32 GetEncoderProfile() { return m_EncoderProfile; }
 
 	virtual GUID GetVideoEncoderFormat() abstract;
+	virtual std::shared_ptr<ENCODER_OPTIONS> Clone() abstract;
 	virtual std::wstring GetVideoExtension() {
 		return L".mp4";
 	}
@@ -593,6 +725,7 @@ struct H264_ENCODER_OPTIONS :ENCODER_OPTIONS {
 	}
 
 	virtual GUID GetVideoEncoderFormat() override { return MFVideoFormat_H264; }
+	virtual std::shared_ptr<ENCODER_OPTIONS> Clone() override { return std::make_shared<H264_ENCODER_OPTIONS>(*this); }
 };
 
 struct H265_ENCODER_OPTIONS :ENCODER_OPTIONS {
@@ -601,6 +734,7 @@ public:
 		SetEncoderProfile(eAVEncH265VProfile_Main_420_8);
 	}
 	virtual GUID GetVideoEncoderFormat() override { return MFVideoFormat_HEVC; }
+	virtual std::shared_ptr<ENCODER_OPTIONS> Clone() override { return std::make_shared<H265_ENCODER_OPTIONS>(*this); }
 };
 
 struct SNAPSHOT_OPTIONS {
@@ -609,11 +743,13 @@ protected:
 	std::chrono::milliseconds m_SnapshotsInterval = std::chrono::milliseconds(10000);
 	bool m_TakesSnapshotsWithVideo = false;
 	GUID m_ImageEncoderFormat = GUID_ContainerFormatPng;
+	ImageEncoderInternal m_ImageEncoder = ImageEncoderInternal::Wic;//The built-in encoders don't depend on WIC, and are much faster for screen content. See ImageEncoder.h.
 public:
 	void SetTakeSnapshotsWithVideo(bool isEnabled) { m_TakesSnapshotsWithVideo = isEnabled; }
 	void SetSnapshotsWithVideoInterval(UINT32 value) { m_SnapshotsInterval = std::chrono::milliseconds(value); }
 	void SetSnapshotDirectory(std::wstring string) { m_OutputSnapshotsFolderPath = string; }
 	void SetSnapshotSaveFormat(GUID value) { m_ImageEncoderFormat = value; }
+	void SetImageEncoder(ImageEncoderInternal value) { m_ImageEncoder = value; }
 
 	bool IsSnapshotWithVideoEnabled() {
 		return m_TakesSnapshotsWithVideo;
@@ -627,9 +763,23 @@ public:
 	GUID GetSnapshotEncoderFormat() {
 		return m_ImageEncoderFormat;
 	}
+	ImageEncoderInternal GetImageEncoder() {
+		return m_ImageEncoder;
+	}
 
 
 	std::wstring GetImageExtension() {
+		switch (m_ImageEncoder)
+		{
+			case ImageEncoderInternal::FastPng:
+				return L".png";
+			case ImageEncoderInternal::Qoi:
+				return L".qoi";
+			case ImageEncoderInternal::FastJpeg:
+				return L".jpg";
+			default:
+				break;
+		}
 		if (m_ImageEncoderFormat == GUID_ContainerFormatPng) {
 			return L".png";
 		}
@@ -0,0 +1,37 @@
+//--------------------------------------------------------------------------------------
+// Draws cursors that invert the background, without reading the frame back to the CPU.
+// The cursor is decoded by CursorShape.h: pixels with alpha 1 replace the background,
+// and pixels with alpha 0 are XORed with it. XOR needs integer instructions, so this
+// shader needs feature level 10_0.
+//--------------------------------------------------------------------------------------
+
+Texture2D tx : register(t0);
+// A copy of the part of the frame behind the cursor.
+Texture2D background : register(t1);
+SamplerState samLinear : register(s0);
+
+cbuffer CursorConstants : register(b0)
+{
+	// The position of the top left pixel of the background copy in the frame.
+	int2 BackgroundOrigin;
+	int2 Padding;
+};
+
+struct PS_INPUT
+{
+	float4 Pos : SV_POSITION;
+	float2 Tex : TEXCOORD;
+};
+
+float4 CursorPS(PS_INPUT input) : SV_Target
+{
+	float4 cursor = tx.Sample(samLinear, input.Tex);
+	if (cursor.a > 0.5)
+	{
+		return float4(cursor.rgb, 1);
+	}
+	float4 bg = background.Load(int3(int2(input.Pos.xy) - BackgroundOrigin, 0));
+	uint3 bgColor = uint3(bg.rgb * 255.0 + 0.5);
+	uint3 cursorColor = uint3(cursor.rgb * 255.0 + 0.5);
+	return float4(float3(bgColor ^ cursorColor) / 255.0, bg.a);
+}
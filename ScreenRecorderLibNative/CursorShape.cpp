@@ -0,0 +1,389 @@
+#include "CursorShape.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CURSOR_SHAPE_SSE2
+#endif
+
+using namespace std;
+
+namespace {
+	const uint32_t ALPHA_MASK = 0xFF000000;
+	const uint32_t COLOR_MASK = 0x00FFFFFF;
+	const uint32_t TRANSPARENT_WHITE = 0x00FFFFFF;
+	const uint64_t HASH_MULTIPLIER = 0x9E3779B97F4A7C15ull;
+
+	inline uint32_t Load32(const uint8_t *p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	inline void Store32(uint8_t *p, uint32_t value)
+	{
+		memcpy(p, &value, sizeof(value));
+	}
+
+	/// <summary>
+	/// Returns all ones if value is not 0, else 0.
+	/// </summary>
+	inline uint32_t ToMask(uint32_t value)
+	{
+		return 0u - static_cast<uint32_t>(value != 0);
+	}
+
+	/// <summary>
+	/// Reads 16 bits of a mask starting at firstBit, with the first bit as the most significant bit. Only reads the bytes that hold the 16 bits.
+	/// </summary>
+	inline uint32_t Read16Bits(const uint8_t *mask, uint32_t firstBit)
+	{
+		const uint8_t *p = mask + firstBit / 8;
+		const uint32_t shift = firstBit % 8;
+		uint32_t bits = (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | (shift ? p[2] : 0);
+		return (bits << shift) >> 8 & 0xFFFF;
+	}
+
+	inline uint32_t BlendMonochromePixel(bool isAnd, bool isXor, uint32_t background)
+	{
+		const uint32_t andMask = ToMask(isAnd);
+		const uint32_t xorMask = ToMask(isXor);
+		const uint32_t transparent = andMask & ~xorMask;
+		const uint32_t blended = (background & (andMask | ALPHA_MASK)) ^ (xorMask & COLOR_MASK);
+		return (transparent & TRANSPARENT_WHITE) | (~transparent & blended);
+	}
+
+	inline uint32_t BlendMaskedColorPixel(uint32_t value, uint32_t background)
+	{
+		const uint32_t hasMask = ToMask(value & ALPHA_MASK);
+		const uint32_t transparent = hasMask & ~ToMask(value & COLOR_MASK);
+		const uint32_t blended = ((background & hasMask) ^ value) | ALPHA_MASK;
+		return (transparent & TRANSPARENT_WHITE) | (~transparent & blended);
+	}
+
+#ifdef CURSOR_SHAPE_SSE2
+	inline __m128i Select(__m128i mask, __m128i ifSet, __m128i ifClear)
+	{
+		return _mm_or_si128(_mm_and_si128(mask, ifSet), _mm_andnot_si128(mask, ifClear));
+	}
+
+	/// <summary>
+	/// Transposes a block of 4 by 4 pixels.
+	/// </summary>
+	inline void Transpose4x4(__m128i &row0, __m128i &row1, __m128i &row2, __m128i &row3)
+	{
+		__m128i t0 = _mm_unpacklo_epi32(row0, row1);
+		__m128i t1 = _mm_unpacklo_epi32(row2, row3);
+		__m128i t2 = _mm_unpackhi_epi32(row0, row1);
+		__m128i t3 = _mm_unpackhi_epi32(row2, row3);
+		row0 = _mm_unpacklo_epi64(t0, t1);
+		row1 = _mm_unpackhi_epi64(t0, t1);
+		row2 = _mm_unpacklo_epi64(t2, t3);
+		row3 = _mm_unpackhi_epi64(t2, t3);
+	}
+
+	inline __m128i Reverse4(__m128i pixels)
+	{
+		return _mm_shuffle_epi32(pixels, _MM_SHUFFLE(0, 1, 2, 3));
+	}
+#endif
+
+	inline uint64_t MixHash(uint64_t hash, uint64_t value)
+	{
+		hash = (hash ^ value) * HASH_MULTIPLIER;
+		return hash ^ (hash >> 29);
+	}
+
+	/// <summary>
+	/// The number of bytes per row that hold pixels, excluding padding.
+	/// </summary>
+	uint32_t GetRowBytes(const CURSOR_SHAPE &shape)
+	{
+		return shape.Type == CursorShapeType::Monochrome ? (shape.Width + 7) / 8 : shape.Width * 4;
+	}
+
+	bool IsValidShape(const CURSOR_SHAPE &shape)
+	{
+		if (shape.Type != CursorShapeType::Monochrome && shape.Type != CursorShapeType::Color && shape.Type != CursorShapeType::MaskedColor) {
+			return false;
+		}
+		if (shape.Width == 0 || shape.Height == 0 || !shape.Buffer || shape.Pitch < GetRowBytes(shape)) {
+			return false;
+		}
+		if (shape.Type == CursorShapeType::Monochrome && shape.Height < 2) {
+			return false;
+		}
+		return static_cast<uint64_t>(shape.Pitch) * (shape.Height - 1) + GetRowBytes(shape) <= shape.BufferSize;
+	}
+}
+
+uint64_t HashCursorShape(const CURSOR_SHAPE &shape)
+{
+	uint64_t hash = MixHash(0, static_cast<uint64_t>(shape.Type));
+	hash = MixHash(hash, (static_cast<uint64_t>(shape.Width) << 32) | shape.Height);
+	if (!IsValidShape(shape)) {
+		return hash;
+	}
+	const uint32_t rowBytes = GetRowBytes(shape);
+	for (uint32_t y = 0; y < shape.Height; y++) {
+		const uint8_t *row = shape.Buffer + static_cast<size_t>(y) * shape.Pitch;
+		uint32_t x = 0;
+		for (; x + 8 <= rowBytes; x += 8) {
+			uint64_t value;
+			memcpy(&value, row + x, sizeof(value));
+			hash = MixHash(hash, value);
+		}
+		if (x < rowBytes) {
+			uint64_t value = 0;
+			memcpy(&value, row + x, rowBytes - x);
+			hash = MixHash(hash, value);
+		}
+	}
+	return hash;
+}
+
+bool DecodeCursorShape(const CURSOR_SHAPE &shape, CURSOR_IMAGE &image)
+{
+	if (!IsValidShape(shape)) {
+		return false;
+	}
+	image.Width = shape.Width;
+	image.Height = shape.Type == CursorShapeType::Monochrome ? shape.Height / 2 : shape.Height;
+	image.Pixels.resize(static_cast<size_t>(image.Width) * image.Height * 4);
+	image.IsXorImage = false;
+	uint8_t *output = image.Pixels.data();
+
+	switch (shape.Type)
+	{
+		case CursorShapeType::Monochrome: {
+			//https://docs.microsoft.com/en-us/windows-hardware/drivers/display/drawing-monochrome-pointers
+			//AND 1, XOR 0 is transparent, AND 1, XOR 1 inverts the background, and AND 0 is black or white.
+			for (uint32_t y = 0; y < image.Height; y++) {
+				const uint8_t *andRow = shape.Buffer + static_cast<size_t>(y) * shape.Pitch;
+				const uint8_t *xorRow = andRow + static_cast<size_t>(image.Height) * shape.Pitch;
+				for (uint32_t x = 0; x < image.Width; x++) {
+					const uint8_t bit = static_cast<uint8_t>(0x80 >> (x % 8));
+					const bool isAnd = (andRow[x / 8] & bit) != 0;
+					const bool isXor = (xorRow[x / 8] & bit) != 0;
+					uint32_t pixel = (isAnd ? 0 : ALPHA_MASK) | (isXor ? COLOR_MASK : 0);
+					image.IsXorImage |= isAnd && isXor;
+					Store32(output, pixel);
+					output += 4;
+				}
+			}
+			break;
+		}
+		case CursorShapeType::MaskedColor: {
+			//https://docs.microsoft.com/en-us/windows-hardware/drivers/display/drawing-color-pointers
+			//The mask alpha is the inverse of the alpha of the image: 0xFF is XORed with the background, 0 replaces it.
+			for (uint32_t y = 0; y < image.Height; y++) {
+				const uint8_t *row = shape.Buffer + static_cast<size_t>(y) * shape.Pitch;
+				for (uint32_t x = 0; x < image.Width; x++) {
+					uint32_t value = Load32(row + x * 4);
+					uint32_t pixel = (value & COLOR_MASK) | ((value & ALPHA_MASK) ? 0 : ALPHA_MASK);
+					image.IsXorImage |= (value & ALPHA_MASK) && (value & COLOR_MASK);
+					Store32(output, pixel);
+					output += 4;
+				}
+			}
+			break;
+		}
+		case CursorShapeType::Color:
+		default: {
+			const uint32_t rowBytes = image.Width * 4;
+			for (uint32_t y = 0; y < image.Height; y++) {
+				memcpy(output + static_cast<size_t>(y) * rowBytes, shape.Buffer + static_cast<size_t>(y) * shape.Pitch, rowBytes);
+			}
+			break;
+		}
+	}
+	return true;
+}
+
+/// <summary>
+/// Blends one pixel of a decoded image onto the background.
+/// </summary>
+static void BlendCursorPixel(const uint8_t *cursor, uint8_t *target, bool isXorImage)
+{
+	uint32_t pixel = Load32(cursor);
+	if (isXorImage) {
+		uint32_t bg = Load32(target);
+		Store32(target, (pixel & ALPHA_MASK) ? (pixel | ALPHA_MASK) : (bg ^ (pixel & COLOR_MASK)));
+	}
+	else {
+		uint32_t alpha = pixel >> 24;
+		for (int c = 0; c < 3; c++) {
+			target[c] = static_cast<uint8_t>((cursor[c] * alpha + target[c] * (255 - alpha) + 127) / 255);
+		}
+		target[3] = static_cast<uint8_t>((alpha * alpha + target[3] * (255 - alpha) + 127) / 255);
+	}
+}
+
+void BlendCursorImage(const CURSOR_IMAGE &image, uint8_t *background, uint32_t backgroundPitch)
+{
+	for (uint32_t y = 0; y < image.Height; y++) {
+		const uint8_t *cursor = image.Pixels.data() + static_cast<size_t>(y) * image.Width * 4;
+		uint8_t *target = background + static_cast<size_t>(y) * backgroundPitch;
+		for (uint32_t x = 0; x < image.Width; x++, cursor += 4, target += 4) {
+			BlendCursorPixel(cursor, target, image.IsXorImage);
+		}
+	}
+}
+
+void DrawCursorImage(const CURSOR_IMAGE &image, int32_t left, int32_t top, uint32_t width, uint32_t height, uint8_t *background, uint32_t backgroundWidth, uint32_t backgroundHeight, uint32_t backgroundPitch)
+{
+	if (image.Width == 0 || image.Height == 0 || width == 0 || height == 0) {
+		return;
+	}
+	//Clip in 64 bits, so positions far outside the background can't overflow.
+	const int64_t firstX = std::max<int64_t>(0, -static_cast<int64_t>(left));
+	const int64_t firstY = std::max<int64_t>(0, -static_cast<int64_t>(top));
+	const int64_t endX = std::min<int64_t>(width, static_cast<int64_t>(backgroundWidth) - left);
+	const int64_t endY = std::min<int64_t>(height, static_cast<int64_t>(backgroundHeight) - top);
+	for (int64_t y = firstY; y < endY; y++) {
+		const uint8_t *cursorRow = image.Pixels.data() + static_cast<size_t>(y * image.Height / height) * image.Width * 4;
+		uint8_t *target = background + static_cast<size_t>(top + y) * backgroundPitch + static_cast<size_t>(left + firstX) * 4;
+		for (int64_t x = firstX; x < endX; x++, target += 4) {
+			BlendCursorPixel(cursorRow + static_cast<size_t>(x * image.Width / width) * 4, target, image.IsXorImage);
+		}
+	}
+}
+
+void BlendMonochromeRow(const uint8_t *andMask, const uint8_t *xorMask, uint32_t firstBit, const uint32_t *background, uint32_t *output, uint32_t width)
+{
+	uint32_t x = 0;
+#ifdef CURSOR_SHAPE_SSE2
+	//Each group of 4 pixels tests its own 4 bits of the 16 bits that are read at once.
+	const __m128i bits[4] = {
+		_mm_setr_epi32(1 << 15, 1 << 14, 1 << 13, 1 << 12),
+		_mm_setr_epi32(1 << 11, 1 << 10, 1 << 9, 1 << 8),
+		_mm_setr_epi32(1 << 7, 1 << 6, 1 << 5, 1 << 4),
+		_mm_setr_epi32(1 << 3, 1 << 2, 1 << 1, 1 << 0)
+	};
+	const __m128i alpha = _mm_set1_epi32(static_cast<int>(ALPHA_MASK));
+	const __m128i color = _mm_set1_epi32(COLOR_MASK);
+	for (; x + 16 <= width; x += 16) {
+		const __m128i andBits = _mm_set1_epi32(static_cast<int>(Read16Bits(andMask, firstBit + x)));
+		const __m128i xorBits = _mm_set1_epi32(static_cast<int>(Read16Bits(xorMask, firstBit + x)));
+		for (int group = 0; group < 4; group++) {
+			const __m128i isAnd = _mm_cmpeq_epi32(_mm_and_si128(andBits, bits[group]), bits[group]);
+			const __m128i isXor = _mm_cmpeq_epi32(_mm_and_si128(xorBits, bits[group]), bits[group]);
+			const __m128i bg = _mm_loadu_si128(reinterpret_cast<const __m128i *>(background + x + group * 4));
+			const __m128i blended = _mm_xor_si128(_mm_and_si128(bg, _mm_or_si128(isAnd, alpha)), _mm_and_si128(isXor, color));
+			const __m128i transparent = _mm_andnot_si128(isXor, isAnd);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(output + x + group * 4), Select(transparent, color, blended));
+		}
+	}
+#endif
+	for (; x < width; x++) {
+		const uint32_t bit = firstBit + x;
+		const uint8_t mask = static_cast<uint8_t>(0x80 >> (bit % 8));
+		output[x] = BlendMonochromePixel((andMask[bit / 8] & mask) != 0, (xorMask[bit / 8] & mask) != 0, background[x]);
+	}
+}
+
+void BlendMaskedColorRow(const uint32_t *shape, const uint32_t *background, uint32_t *output, uint32_t width)
+{
+	uint32_t x = 0;
+#ifdef CURSOR_SHAPE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi32(static_cast<int>(ALPHA_MASK));
+	const __m128i color = _mm_set1_epi32(COLOR_MASK);
+	for (; x + 4 <= width; x += 4) {
+		const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(shape + x));
+		const __m128i bg = _mm_loadu_si128(reinterpret_cast<const __m128i *>(background + x));
+		const __m128i noMask = _mm_cmpeq_epi32(_mm_and_si128(value, alpha), zero);
+		const __m128i noColor = _mm_cmpeq_epi32(_mm_and_si128(value, color), zero);
+		const __m128i blended = _mm_or_si128(_mm_xor_si128(_mm_andnot_si128(noMask, bg), value), alpha);
+		const __m128i transparent = _mm_andnot_si128(noMask, noColor);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(output + x), Select(transparent, color, blended));
+	}
+#endif
+	for (; x < width; x++) {
+		output[x] = BlendMaskedColorPixel(shape[x], background[x]);
+	}
+}
+
+void RotateCursorBackground(const uint32_t *source, uint32_t sourcePitch, uint32_t width, uint32_t height, CursorRotation rotation, uint32_t *destination, uint32_t destinationPitch)
+{
+	switch (rotation)
+	{
+		case CursorRotation::Rotate90:
+		case CursorRotation::Rotate270: {
+			const bool is90 = rotation == CursorRotation::Rotate90;
+			uint32_t row = 0;
+#ifdef CURSOR_SHAPE_SSE2
+			for (; row + 4 <= height; row += 4) {
+				const uint32_t *sourceRow = source + static_cast<size_t>(row) * sourcePitch;
+				uint32_t col = 0;
+				for (; col + 4 <= width; col += 4) {
+					__m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sourceRow + col));
+					__m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sourceRow + sourcePitch + col));
+					__m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sourceRow + sourcePitch * 2 + col));
+					__m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sourceRow + sourcePitch * 3 + col));
+					Transpose4x4(r0, r1, r2, r3);
+					//After the transpose, each register holds a source column, which is a destination row.
+					const __m128i columns[4] = { r0, r1, r2, r3 };
+					for (uint32_t i = 0; i < 4; i++) {
+						if (is90) {
+							_mm_storeu_si128(reinterpret_cast<__m128i *>(destination + static_cast<size_t>(col + i) * destinationPitch + (height - 4 - row)), Reverse4(columns[i]));
+						}
+						else {
+							_mm_storeu_si128(reinterpret_cast<__m128i *>(destination + static_cast<size_t>(width - 1 - col - i) * destinationPitch + row), columns[i]);
+						}
+					}
+				}
+				for (; col < width; col++) {
+					for (uint32_t i = 0; i < 4; i++) {
+						const uint32_t pixel = sourceRow[static_cast<size_t>(i) * sourcePitch + col];
+						if (is90) {
+							destination[static_cast<size_t>(col) * destinationPitch + (height - 1 - row - i)] = pixel;
+						}
+						else {
+							destination[static_cast<size_t>(width - 1 - col) * destinationPitch + row + i] = pixel;
+						}
+					}
+				}
+			}
+#endif
+			for (; row < height; row++) {
+				const uint32_t *sourceRow = source + static_cast<size_t>(row) * sourcePitch;
+				for (uint32_t col = 0; col < width; col++) {
+					if (is90) {
+						destination[static_cast<size_t>(col) * destinationPitch + (height - 1 - row)] = sourceRow[col];
+					}
+					else {
+						destination[static_cast<size_t>(width - 1 - col) * destinationPitch + row] = sourceRow[col];
+					}
+				}
+			}
+			break;
+		}
+		case CursorRotation::Rotate180: {
+			for (uint32_t row = 0; row < height; row++) {
+				const uint32_t *sourceRow = source + static_cast<size_t>(row) * sourcePitch;
+				uint32_t *destinationRow = destination + static_cast<size_t>(height - 1 - row) * destinationPitch;
+				uint32_t col = 0;
+#ifdef CURSOR_SHAPE_SSE2
+				for (; col + 4 <= width; col += 4) {
+					const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sourceRow + col));
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(destinationRow + (width - 4 - col)), Reverse4(pixels));
+				}
+#endif
+				for (; col < width; col++) {
+					destinationRow[width - 1 - col] = sourceRow[col];
+				}
+			}
+			break;
+		}
+		case CursorRotation::Identity:
+		default: {
+			for (uint32_t row = 0; row < height; row++) {
+				memcpy(destination + static_cast<size_t>(row) * destinationPitch, source + static_cast<size_t>(row) * sourcePitch, static_cast<size_t>(width) * sizeof(uint32_t));
+			}
+			break;
+		}
+	}
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Decodes mouse cursor shapes into images that can be uploaded to the GPU once and drawn without reading back the frame behind the cursor.
+//Like ImageEncoder.h, it doesn't depend on any platform API, so it can be tested on any platform.
+
+/// <summary>
+/// The layout of a cursor shape. The values match DXGI_OUTDUPL_POINTER_SHAPE_TYPE.
+/// </summary>
+enum class CursorShapeType : uint32_t {
+	/// <summary>A 1 bit per pixel AND mask, followed by a 1 bit per pixel XOR mask of the same size.</summary>
+	Monochrome = 1,
+	/// <summary>32 bit Bgra pixels with straight alpha.</summary>
+	Color = 2,
+	/// <summary>32 bit Bgr pixels, where an alpha of 0xFF means the color is XORed with the background, and 0 means it replaces it.</summary>
+	MaskedColor = 4
+};
+
+/// <summary>
+/// A cursor shape as returned by Desktop Duplication, or read from an HCURSOR.
+/// </summary>
+struct CURSOR_SHAPE {
+	CursorShapeType Type = CursorShapeType::Color;
+	uint32_t Width = 0;
+	/// <summary>The height of the buffer. For monochrome shapes this is twice the height of the cursor, as it holds both masks.</summary>
+	uint32_t Height = 0;
+	/// <summary>The number of bytes per row in Buffer.</summary>
+	uint32_t Pitch = 0;
+	const uint8_t *Buffer = nullptr;
+	size_t BufferSize = 0;
+};
+
+/// <summary>
+/// A decoded cursor in Bgra32 layout, Width * 4 bytes per row.
+/// </summary>
+struct CURSOR_IMAGE {
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	std::vector<uint8_t> Pixels;
+	/// <summary>
+	/// If false, the pixels have straight alpha and are drawn with alpha blending.
+	/// If true, some pixels invert the background. A pixel with alpha 0xFF then replaces the background, and a pixel with alpha 0 XORs its color with it, so black pixels with alpha 0 are transparent.
+	/// </summary>
+	bool IsXorImage = false;
+};
+
+/// <summary>
+/// Returns a hash of the size, type and pixels of the shape, so identical shapes can share a decoded image. The padding at the end of each row is ignored.
+/// </summary>
+uint64_t HashCursorShape(const CURSOR_SHAPE &shape);
+/// <summary>
+/// Decodes the shape into an image with one 32 bit pixel per cursor pixel.
+/// </summary>
+/// <returns>false if the type is unknown or the buffer is too small for the size and pitch.</returns>
+bool DecodeCursorShape(const CURSOR_SHAPE &shape, CURSOR_IMAGE &image);
+/// <summary>
+/// Draws a decoded image on a Bgra32 background the same way the GPU does, with the top left pixel of the image at the start of the background. Used to test the decoding.
+/// </summary>
+void BlendCursorImage(const CURSOR_IMAGE &image, uint8_t *background, uint32_t backgroundPitch);
+/// <summary>
+/// Draws a decoded image the same way, scaled to width by height pixels with nearest neighbor sampling, with its top left pixel at left, top of the background.
+/// The parts outside the background are clipped.
+/// </summary>
+void DrawCursorImage(const CURSOR_IMAGE &image, int32_t left, int32_t top, uint32_t width, uint32_t height, uint8_t *background, uint32_t backgroundWidth, uint32_t backgroundHeight, uint32_t backgroundPitch);
+
+//The CPU blending of MouseManager::ProcessMonoMask, used for cursors that invert the background when the device can't run the cursor pixel shader.
+//The blended pixels are alpha blended on the frame: TRANSPARENT_WHITE where the background shows through, else the final color.
+
+enum class CursorRotation {
+	Identity,
+	/// <summary>Rotated 90 degrees clockwise.</summary>
+	Rotate90,
+	Rotate180,
+	/// <summary>Rotated 270 degrees clockwise.</summary>
+	Rotate270
+};
+
+/// <summary>
+/// Blends one row of a monochrome cursor with the background behind it. The masks are expanded 16 pixels at a time without branches.
+/// </summary>
+/// <param name="andMask">The row of the AND mask.</param>
+/// <param name="xorMask">The row of the XOR mask.</param>
+/// <param name="firstBit">The bit of the first pixel in the masks, counted from the most significant bit of the first byte. Pixels left of the frame are skipped this way.</param>
+/// <param name="background">The pixels behind the cursor.</param>
+/// <param name="output">Receives width blended pixels.</param>
+void BlendMonochromeRow(const uint8_t *andMask, const uint8_t *xorMask, uint32_t firstBit, const uint32_t *background, uint32_t *output, uint32_t width);
+/// <summary>
+/// Blends one row of a masked color cursor with the background behind it, without branches.
+/// </summary>
+/// <param name="shape">The first pixel of the row to blend.</param>
+void BlendMaskedColorRow(const uint32_t *shape, const uint32_t *background, uint32_t *output, uint32_t width);
+/// <summary>
+/// Rotates the background behind a cursor, so it lines up with the cursor shape on a rotated display.
+/// The pixel at row, column moves to column, height - 1 - row when rotated 90 degrees, to height - 1 - row, width - 1 - column when rotated 180 degrees,
+/// and to width - 1 - column, row when rotated 270 degrees. It is done in blocks of 4 by 4 pixels that are transposed in registers.
+/// </summary>
+/// <param name="sourcePitch">The number of pixels per row of the source.</param>
+/// <param name="destinationPitch">The number of pixels per row of the destination. It must hold the rotated width, which is height for 90 and 270 degrees.</param>
+void RotateCursorBackground(const uint32_t *source, uint32_t sourcePitch, uint32_t width, uint32_t height, CursorRotation rotation, uint32_t *destination, uint32_t destinationPitch);
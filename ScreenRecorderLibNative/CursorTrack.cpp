@@ -0,0 +1,420 @@
+#include "CursorTrack.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+using namespace std;
+
+namespace {
+	const char FILE_MAGIC[8] = { 'S', 'R', 'C', 'U', 'R', 'S', 'O', 'R' };
+	const uint32_t FILE_VERSION = 1;
+	//The size of the type and payload size of a record.
+	const size_t RECORD_HEADER_SIZE = 5;
+	const size_t VIEWPORT_SIZE = 48;
+	const size_t SHAPE_HEADER_SIZE = 28;
+	const size_t POINTER_SIZE = 29;
+	const size_t MOUSE_EVENT_SIZE = 28;
+
+	void Append32(vector<uint8_t> &buffer, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++) {
+			buffer.push_back(static_cast<uint8_t>(value >> (8 * i)));
+		}
+	}
+
+	void Append64(vector<uint8_t> &buffer, uint64_t value)
+	{
+		for (int i = 0; i < 8; i++) {
+			buffer.push_back(static_cast<uint8_t>(value >> (8 * i)));
+		}
+	}
+
+	uint32_t Read32(const uint8_t *pData)
+	{
+		return static_cast<uint32_t>(pData[0]) | static_cast<uint32_t>(pData[1]) << 8 | static_cast<uint32_t>(pData[2]) << 16 | static_cast<uint32_t>(pData[3]) << 24;
+	}
+
+	uint64_t Read64(const uint8_t *pData)
+	{
+		return static_cast<uint64_t>(Read32(pData)) | static_cast<uint64_t>(Read32(pData + 4)) << 32;
+	}
+
+	bool IsSameViewport(const CURSOR_TRACK_VIEWPORT &a, const CURSOR_TRACK_VIEWPORT &b)
+	{
+		return a.SourceLeft == b.SourceLeft && a.SourceTop == b.SourceTop && a.SourceWidth == b.SourceWidth && a.SourceHeight == b.SourceHeight
+			&& a.DestinationLeft == b.DestinationLeft && a.DestinationTop == b.DestinationTop && a.DestinationWidth == b.DestinationWidth && a.DestinationHeight == b.DestinationHeight
+			&& a.OutputWidth == b.OutputWidth && a.OutputHeight == b.OutputHeight;
+	}
+
+	bool IsSamePointer(const CURSOR_TRACK_POINTER &a, const CURSOR_TRACK_POINTER &b)
+	{
+		return a.IsVisible == b.IsVisible && a.ShapeId == b.ShapeId
+			//The position of a hidden pointer doesn't matter.
+			&& (!a.IsVisible || (a.Left == b.Left && a.Top == b.Top && a.Width == b.Width && a.Height == b.Height));
+	}
+
+	/// <summary>
+	/// Returns the last item at or before the timestamp, or nullptr if all items are after it.
+	/// </summary>
+	template <typename T>
+	const T *FindAt(const vector<T> &items, int64_t timestamp)
+	{
+		auto next = upper_bound(items.begin(), items.end(), timestamp, [](int64_t time, const T &item) {
+			return time < item.Timestamp;
+		});
+		return next == items.begin() ? nullptr : &*(next - 1);
+	}
+}
+
+CursorTrackWriter::~CursorTrackWriter()
+{
+	Close();
+}
+
+bool CursorTrackWriter::Open(const wstring &path)
+{
+	Close();
+#ifdef _WIN32
+	if (_wfopen_s(&m_File, path.c_str(), L"wb") != 0) {
+		m_File = nullptr;
+	}
+#else
+	m_File = fopen(filesystem::path(path).c_str(), "wb");
+#endif
+	if (!m_File) {
+		return false;
+	}
+	m_IsFailed = false;
+	m_Size = 0;
+	m_HasViewport = false;
+	m_HasPointer = false;
+	m_ShapeIds.clear();
+	m_LastShapeVersion = 0;
+	m_LastShapeId = 0;
+	m_Record.assign(FILE_MAGIC, FILE_MAGIC + sizeof(FILE_MAGIC));
+	Append32(m_Record, FILE_VERSION);
+	if (fwrite(m_Record.data(), 1, m_Record.size(), m_File) != m_Record.size()) {
+		m_IsFailed = true;
+	}
+	m_Size += m_Record.size();
+	return true;
+}
+
+bool CursorTrackWriter::Close()
+{
+	if (!m_File) {
+		return !m_IsFailed;
+	}
+	if (fclose(m_File) != 0) {
+		m_IsFailed = true;
+	}
+	m_File = nullptr;
+	return !m_IsFailed;
+}
+
+void CursorTrackWriter::BeginRecord(CursorTrackRecordType type)
+{
+	m_Record.clear();
+	m_Record.push_back(static_cast<uint8_t>(type));
+	//The payload size is filled in by EndRecord.
+	Append32(m_Record, 0);
+}
+
+void CursorTrackWriter::EndRecord()
+{
+	uint32_t payloadSize = static_cast<uint32_t>(m_Record.size() - RECORD_HEADER_SIZE);
+	for (int i = 0; i < 4; i++) {
+		m_Record[1 + i] = static_cast<uint8_t>(payloadSize >> (8 * i));
+	}
+	if (fwrite(m_Record.data(), 1, m_Record.size(), m_File) != m_Record.size()) {
+		m_IsFailed = true;
+	}
+	m_Size += m_Record.size();
+}
+
+void CursorTrackWriter::WriteViewport(const CURSOR_TRACK_VIEWPORT &viewport)
+{
+	if (!m_File || (m_HasViewport && IsSameViewport(viewport, m_LastViewport))) {
+		return;
+	}
+	BeginRecord(CursorTrackRecordType::Viewport);
+	Append64(m_Record, static_cast<uint64_t>(viewport.Timestamp));
+	Append32(m_Record, static_cast<uint32_t>(viewport.SourceLeft));
+	Append32(m_Record, static_cast<uint32_t>(viewport.SourceTop));
+	Append32(m_Record, viewport.SourceWidth);
+	Append32(m_Record, viewport.SourceHeight);
+	Append32(m_Record, static_cast<uint32_t>(viewport.DestinationLeft));
+	Append32(m_Record, static_cast<uint32_t>(viewport.DestinationTop));
+	Append32(m_Record, viewport.DestinationWidth);
+	Append32(m_Record, viewport.DestinationHeight);
+	Append32(m_Record, viewport.OutputWidth);
+	Append32(m_Record, viewport.OutputHeight);
+	EndRecord();
+	m_LastViewport = viewport;
+	m_HasViewport = true;
+}
+
+uint32_t CursorTrackWriter::GetShapeId(const CURSOR_SHAPE &shape, int32_t hotSpotX, int32_t hotSpotY, uint64_t shapeVersion)
+{
+	if (!shape.Buffer || shape.BufferSize == 0) {
+		return 0;
+	}
+	if (shapeVersion != 0 && shapeVersion == m_LastShapeVersion) {
+		return m_LastShapeId;
+	}
+	//The hotspot is part of the shape, as the same image can be used with different hotspots.
+	uint64_t hash = HashCursorShape(shape) ^ ((static_cast<uint64_t>(static_cast<uint32_t>(hotSpotX)) << 32 | static_cast<uint32_t>(hotSpotY)) * 0x9E3779B97F4A7C15ull);
+	auto existing = m_ShapeIds.find(hash);
+	uint32_t id = 0;
+	if (existing != m_ShapeIds.end()) {
+		id = existing->second;
+	}
+	else {
+		id = static_cast<uint32_t>(m_ShapeIds.size() + 1);
+		size_t rowBytes = min<size_t>(shape.Pitch, shape.Type == CursorShapeType::Monochrome ? (shape.Width + 7) / 8 : static_cast<size_t>(shape.Width) * 4);
+		if (static_cast<size_t>(shape.Pitch) * shape.Height > shape.BufferSize || rowBytes == 0) {
+			return 0;
+		}
+		//Rows are stored without padding.
+		BeginRecord(CursorTrackRecordType::Shape);
+		Append32(m_Record, id);
+		Append32(m_Record, static_cast<uint32_t>(shape.Type));
+		Append32(m_Record, shape.Width);
+		Append32(m_Record, shape.Height);
+		Append32(m_Record, static_cast<uint32_t>(rowBytes));
+		Append32(m_Record, static_cast<uint32_t>(hotSpotX));
+		Append32(m_Record, static_cast<uint32_t>(hotSpotY));
+		for (uint32_t y = 0; y < shape.Height; y++) {
+			const uint8_t *pRow = shape.Buffer + static_cast<size_t>(y) * shape.Pitch;
+			m_Record.insert(m_Record.end(), pRow, pRow + rowBytes);
+		}
+		EndRecord();
+		m_ShapeIds[hash] = id;
+	}
+	m_LastShapeVersion = shapeVersion;
+	m_LastShapeId = id;
+	return id;
+}
+
+void CursorTrackWriter::WritePointer(const CURSOR_TRACK_POINTER &pointer, const CURSOR_SHAPE &shape, int32_t hotSpotX, int32_t hotSpotY, uint64_t shapeVersion)
+{
+	if (!m_File) {
+		return;
+	}
+	CURSOR_TRACK_POINTER newPointer = pointer;
+	newPointer.ShapeId = GetShapeId(shape, hotSpotX, hotSpotY, shapeVersion);
+	if (m_HasPointer && IsSamePointer(newPointer, m_LastPointer)) {
+		return;
+	}
+	BeginRecord(CursorTrackRecordType::Pointer);
+	Append64(m_Record, static_cast<uint64_t>(newPointer.Timestamp));
+	Append32(m_Record, static_cast<uint32_t>(newPointer.Left));
+	Append32(m_Record, static_cast<uint32_t>(newPointer.Top));
+	Append32(m_Record, newPointer.Width);
+	Append32(m_Record, newPointer.Height);
+	Append32(m_Record, newPointer.ShapeId);
+	m_Record.push_back(newPointer.IsVisible ? 1 : 0);
+	EndRecord();
+	m_LastPointer = newPointer;
+	m_HasPointer = true;
+}
+
+void CursorTrackWriter::WriteMouseEvent(const CURSOR_TRACK_MOUSE_EVENT &event)
+{
+	if (!m_File) {
+		return;
+	}
+	BeginRecord(CursorTrackRecordType::MouseEvent);
+	Append64(m_Record, static_cast<uint64_t>(event.Timestamp));
+	Append32(m_Record, static_cast<uint32_t>(event.Type));
+	Append32(m_Record, static_cast<uint32_t>(event.Button));
+	Append32(m_Record, static_cast<uint32_t>(event.X));
+	Append32(m_Record, static_cast<uint32_t>(event.Y));
+	Append32(m_Record, static_cast<uint32_t>(event.WheelDelta));
+	EndRecord();
+}
+
+bool CursorTrackReader::Load(const wstring &path)
+{
+	FILE *pFile = nullptr;
+#ifdef _WIN32
+	if (_wfopen_s(&pFile, path.c_str(), L"rb") != 0) {
+		pFile = nullptr;
+	}
+#else
+	pFile = fopen(filesystem::path(path).c_str(), "rb");
+#endif
+	if (!pFile) {
+		return false;
+	}
+	vector<uint8_t> data;
+	uint8_t buffer[65536];
+	size_t read = 0;
+	while ((read = fread(buffer, 1, sizeof(buffer), pFile)) > 0) {
+		data.insert(data.end(), buffer, buffer + read);
+	}
+	bool isReadOk = !ferror(pFile);
+	fclose(pFile);
+	return isReadOk && Parse(data.data(), data.size());
+}
+
+bool CursorTrackReader::Parse(const uint8_t *pData, size_t size)
+{
+	m_Viewports.clear();
+	m_Pointers.clear();
+	m_MouseEvents.clear();
+	m_Shapes.clear();
+	if (size < sizeof(FILE_MAGIC) + 4 || memcmp(pData, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || Read32(pData + sizeof(FILE_MAGIC)) != FILE_VERSION) {
+		return false;
+	}
+	size_t offset = sizeof(FILE_MAGIC) + 4;
+	while (size - offset >= RECORD_HEADER_SIZE) {
+		CursorTrackRecordType type = static_cast<CursorTrackRecordType>(pData[offset]);
+		size_t payloadSize = Read32(pData + offset + 1);
+		if (payloadSize > size - offset - RECORD_HEADER_SIZE) {
+			//The last record was not completely written.
+			break;
+		}
+		const uint8_t *p = pData + offset + RECORD_HEADER_SIZE;
+		offset += RECORD_HEADER_SIZE + payloadSize;
+		switch (type)
+		{
+			case CursorTrackRecordType::Viewport: {
+				if (payloadSize < VIEWPORT_SIZE) {
+					return false;
+				}
+				CURSOR_TRACK_VIEWPORT viewport;
+				viewport.Timestamp = static_cast<int64_t>(Read64(p));
+				viewport.SourceLeft = static_cast<int32_t>(Read32(p + 8));
+				viewport.SourceTop = static_cast<int32_t>(Read32(p + 12));
+				viewport.SourceWidth = Read32(p + 16);
+				viewport.SourceHeight = Read32(p + 20);
+				viewport.DestinationLeft = static_cast<int32_t>(Read32(p + 24));
+				viewport.DestinationTop = static_cast<int32_t>(Read32(p + 28));
+				viewport.DestinationWidth = Read32(p + 32);
+				viewport.DestinationHeight = Read32(p + 36);
+				viewport.OutputWidth = Read32(p + 40);
+				viewport.OutputHeight = Read32(p + 44);
+				m_Viewports.push_back(viewport);
+				break;
+			}
+			case CursorTrackRecordType::Shape: {
+				if (payloadSize < SHAPE_HEADER_SIZE) {
+					return false;
+				}
+				CURSOR_TRACK_SHAPE shape;
+				shape.Id = Read32(p);
+				shape.Type = static_cast<CursorShapeType>(Read32(p + 4));
+				shape.Width = Read32(p + 8);
+				shape.Height = Read32(p + 12);
+				shape.Pitch = Read32(p + 16);
+				shape.HotSpotX = static_cast<int32_t>(Read32(p + 20));
+				shape.HotSpotY = static_cast<int32_t>(Read32(p + 24));
+				if (static_cast<uint64_t>(shape.Pitch) * shape.Height != payloadSize - SHAPE_HEADER_SIZE) {
+					return false;
+				}
+				shape.Buffer.assign(p + SHAPE_HEADER_SIZE, p + payloadSize);
+				m_Shapes[shape.Id] = std::move(shape);
+				break;
+			}
+			case CursorTrackRecordType::Pointer: {
+				if (payloadSize < POINTER_SIZE) {
+					return false;
+				}
+				CURSOR_TRACK_POINTER pointer;
+				pointer.Timestamp = static_cast<int64_t>(Read64(p));
+				pointer.Left = static_cast<int32_t>(Read32(p + 8));
+				pointer.Top = static_cast<int32_t>(Read32(p + 12));
+				pointer.Width = Read32(p + 16);
+				pointer.Height = Read32(p + 20);
+				pointer.ShapeId = Read32(p + 24);
+				pointer.IsVisible = p[28] != 0;
+				m_Pointers.push_back(pointer);
+				break;
+			}
+			case CursorTrackRecordType::MouseEvent: {
+				if (payloadSize < MOUSE_EVENT_SIZE) {
+					return false;
+				}
+				CURSOR_TRACK_MOUSE_EVENT event;
+				event.Timestamp = static_cast<int64_t>(Read64(p));
+				event.Type = static_cast<MouseInputEventType>(Read32(p + 8));
+				event.Button = static_cast<MouseInputButton>(Read32(p + 12));
+				event.X = static_cast<int32_t>(Read32(p + 16));
+				event.Y = static_cast<int32_t>(Read32(p + 20));
+				event.WheelDelta = static_cast<int32_t>(Read32(p + 24));
+				m_MouseEvents.push_back(event);
+				break;
+			}
+			default:
+				//Records added in later versions.
+				break;
+		}
+	}
+	return true;
+}
+
+const CURSOR_TRACK_SHAPE *CursorTrackReader::GetShape(uint32_t id) const
+{
+	auto shape = m_Shapes.find(id);
+	return shape == m_Shapes.end() ? nullptr : &shape->second;
+}
+
+const CURSOR_TRACK_VIEWPORT *CursorTrackReader::GetViewportAt(int64_t timestamp) const
+{
+	const CURSOR_TRACK_VIEWPORT *pViewport = FindAt(m_Viewports, timestamp);
+	return pViewport || m_Viewports.empty() ? pViewport : &m_Viewports.front();
+}
+
+const CURSOR_TRACK_POINTER *CursorTrackReader::GetPointerAt(int64_t timestamp) const
+{
+	return FindAt(m_Pointers, timestamp);
+}
+
+CursorTrackRenderer::CursorTrackRenderer(const CursorTrackReader &reader) :
+	m_Reader(reader)
+{
+}
+
+bool CursorTrackRenderer::Render(int64_t timestamp, uint8_t *pFrame, uint32_t width, uint32_t height, uint32_t pitch)
+{
+	const CURSOR_TRACK_POINTER *pPointer = m_Reader.GetPointerAt(timestamp);
+	const CURSOR_TRACK_VIEWPORT *pViewport = m_Reader.GetViewportAt(timestamp);
+	if (!pPointer || !pPointer->IsVisible || !pViewport || pViewport->SourceWidth == 0 || pViewport->SourceHeight == 0 || pViewport->OutputWidth == 0 || pViewport->OutputHeight == 0) {
+		return false;
+	}
+	auto image = m_Images.find(pPointer->ShapeId);
+	if (image == m_Images.end()) {
+		const CURSOR_TRACK_SHAPE *pShape = m_Reader.GetShape(pPointer->ShapeId);
+		if (!pShape) {
+			return false;
+		}
+		CURSOR_SHAPE shape;
+		shape.Type = pShape->Type;
+		shape.Width = pShape->Width;
+		shape.Height = pShape->Height;
+		shape.Pitch = pShape->Pitch;
+		shape.Buffer = pShape->Buffer.data();
+		shape.BufferSize = pShape->Buffer.size();
+		CURSOR_IMAGE decoded;
+		if (!DecodeCursorShape(shape, decoded)) {
+			return false;
+		}
+		image = m_Images.emplace(pPointer->ShapeId, std::move(decoded)).first;
+	}
+	//From captured frame coordinates to the recorded video, and from there to the frame to draw on.
+	const double scaleX = static_cast<double>(pViewport->DestinationWidth) / pViewport->SourceWidth * width / pViewport->OutputWidth;
+	const double scaleY = static_cast<double>(pViewport->DestinationHeight) / pViewport->SourceHeight * height / pViewport->OutputHeight;
+	const double left = (pPointer->Left - pViewport->SourceLeft) * scaleX + static_cast<double>(pViewport->DestinationLeft) * width / pViewport->OutputWidth;
+	const double top = (pPointer->Top - pViewport->SourceTop) * scaleY + static_cast<double>(pViewport->DestinationTop) * height / pViewport->OutputHeight;
+	const int64_t drawLeft = static_cast<int64_t>(floor(left + 0.5));
+	const int64_t drawTop = static_cast<int64_t>(floor(top + 0.5));
+	const int64_t drawWidth = static_cast<int64_t>(floor(pPointer->Width * scaleX + 0.5));
+	const int64_t drawHeight = static_cast<int64_t>(floor(pPointer->Height * scaleY + 0.5));
+	if (drawWidth <= 0 || drawHeight <= 0 || drawLeft >= width || drawTop >= height || drawLeft + drawWidth <= 0 || drawTop + drawHeight <= 0) {
+		return false;
+	}
+	DrawCursorImage(image->second, static_cast<int32_t>(drawLeft), static_cast<int32_t>(drawTop), static_cast<uint32_t>(drawWidth), static_cast<uint32_t>(drawHeight), pFrame, width, height, pitch);
+	return true;
+}
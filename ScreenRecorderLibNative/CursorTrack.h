@@ -0,0 +1,189 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "CursorShape.h"
+#include "MouseEventRing.h"
+
+//A timestamped track of the mouse pointer of a recording, stored in a sidecar file next to it instead of being drawn into the frames,
+//so the video only changes when the screen does. The reader and renderer overlay the pointer onto decoded frames for playback and export.
+//Like FrameManifest.h, it doesn't depend on any platform API, so it can be tested and used on any platform.
+//
+//File layout, all values little endian:
+//  "SRCURSOR", uint32 version
+//  records of uint8 type, uint32 payload size, payload. Readers skip records of unknown type.
+//Shapes are stored once in a dictionary, and referenced by id from pointer records.
+
+enum class CursorTrackRecordType : uint8_t {
+	Viewport = 1,
+	Shape = 2,
+	Pointer = 3,
+	MouseEvent = 4
+};
+
+/// <summary>
+/// Maps the coordinates of the captured frame, which the track positions are in, to the frames of the video.
+/// A new viewport is written when the capture is restarted with a different size.
+/// </summary>
+struct CURSOR_TRACK_VIEWPORT {
+	/// <summary>The position in the recording the viewport applies from, in 100 nanosecond units.</summary>
+	int64_t Timestamp = 0;
+	/// <summary>The part of the captured frame that is recorded.</summary>
+	int32_t SourceLeft = 0;
+	int32_t SourceTop = 0;
+	uint32_t SourceWidth = 0;
+	uint32_t SourceHeight = 0;
+	/// <summary>Where the recorded part is drawn in the video frame.</summary>
+	int32_t DestinationLeft = 0;
+	int32_t DestinationTop = 0;
+	uint32_t DestinationWidth = 0;
+	uint32_t DestinationHeight = 0;
+	/// <summary>The size of the video frame.</summary>
+	uint32_t OutputWidth = 0;
+	uint32_t OutputHeight = 0;
+};
+
+struct CURSOR_TRACK_SHAPE {
+	uint32_t Id = 0;
+	CursorShapeType Type = CursorShapeType::Color;
+	uint32_t Width = 0;
+	/// <summary>The height of Buffer. For monochrome shapes this is twice the height of the cursor, as it holds both masks.</summary>
+	uint32_t Height = 0;
+	uint32_t Pitch = 0;
+	int32_t HotSpotX = 0;
+	int32_t HotSpotY = 0;
+	std::vector<uint8_t> Buffer;
+};
+
+/// <summary>
+/// The state of the pointer from Timestamp until the next pointer record.
+/// </summary>
+struct CURSOR_TRACK_POINTER {
+	/// <summary>The position in the recording, in 100 nanosecond units.</summary>
+	int64_t Timestamp = 0;
+	/// <summary>The top left corner of the pointer in captured frame coordinates.</summary>
+	int32_t Left = 0;
+	int32_t Top = 0;
+	/// <summary>The size the pointer is drawn with in captured frame coordinates, which differs from the shape size if the source is scaled.</summary>
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	/// <summary>The id of the shape, or 0 if the shape is not known.</summary>
+	uint32_t ShapeId = 0;
+	bool IsVisible = false;
+};
+
+/// <summary>
+/// A mouse button or wheel event. Timestamp is the position in the recording, and X and Y are the hotspot position in captured frame coordinates.
+/// </summary>
+typedef MOUSE_INPUT_EVENT CURSOR_TRACK_MOUSE_EVENT;
+
+/// <summary>
+/// Writes a cursor track file. Records must be written in timestamp order. Not thread safe.
+/// </summary>
+class CursorTrackWriter
+{
+public:
+	CursorTrackWriter() = default;
+	CursorTrackWriter(const CursorTrackWriter &) = delete;
+	CursorTrackWriter &operator=(const CursorTrackWriter &) = delete;
+	~CursorTrackWriter();
+
+	/// <summary>
+	/// Creates the file and writes the file header.
+	/// </summary>
+	/// <returns>false if the file could not be created.</returns>
+	bool Open(const std::wstring &path);
+	/// <summary>
+	/// Flushes and closes the file, if any.
+	/// </summary>
+	/// <returns>false if any record could not be written.</returns>
+	bool Close();
+	bool IsOpen() const { return m_File != nullptr; }
+	/// <summary>
+	/// Writes the viewport if it differs from the last one written.
+	/// </summary>
+	void WriteViewport(const CURSOR_TRACK_VIEWPORT &viewport);
+	/// <summary>
+	/// Writes the pointer if it differs from the last one written. A shape that was not written before is added to the shape dictionary first.
+	/// </summary>
+	/// <param name="pointer">The pointer. ShapeId is ignored, and set from the shape.</param>
+	/// <param name="shape">The shape of the pointer. If it has no buffer, the pointer is written without a shape.</param>
+	/// <param name="hotSpotX">The hotspot of the shape, in shape pixels.</param>
+	/// <param name="shapeVersion">Changes whenever the shape changes, so unchanged shapes are not hashed again. Use 0 to always hash the shape.</param>
+	void WritePointer(const CURSOR_TRACK_POINTER &pointer, const CURSOR_SHAPE &shape, int32_t hotSpotX, int32_t hotSpotY, uint64_t shapeVersion);
+	void WriteMouseEvent(const CURSOR_TRACK_MOUSE_EVENT &event);
+	/// <summary>
+	/// Returns the number of bytes written to the file so far, including buffered bytes.
+	/// </summary>
+	uint64_t GetSize() const { return m_Size; }
+private:
+	FILE *m_File = nullptr;
+	bool m_IsFailed = false;
+	uint64_t m_Size = 0;
+	std::vector<uint8_t> m_Record;
+	bool m_HasViewport = false;
+	CURSOR_TRACK_VIEWPORT m_LastViewport;
+	bool m_HasPointer = false;
+	CURSOR_TRACK_POINTER m_LastPointer;
+	//Shape ids by the hash of the shape.
+	std::unordered_map<uint64_t, uint32_t> m_ShapeIds;
+	uint64_t m_LastShapeVersion = 0;
+	uint32_t m_LastShapeId = 0;
+
+	uint32_t GetShapeId(const CURSOR_SHAPE &shape, int32_t hotSpotX, int32_t hotSpotY, uint64_t shapeVersion);
+	void BeginRecord(CursorTrackRecordType type);
+	void EndRecord();
+};
+
+/// <summary>
+/// Reads a cursor track file into memory.
+/// </summary>
+class CursorTrackReader
+{
+public:
+	/// <summary>
+	/// Reads and parses a cursor track file.
+	/// </summary>
+	/// <returns>false if the file could not be read or is not a cursor track.</returns>
+	bool Load(const std::wstring &path);
+	/// <summary>
+	/// Parses a cursor track from memory. A truncated last record, e.g. from a recording that did not finish, is ignored.
+	/// </summary>
+	/// <returns>false if the data is not a cursor track, or a record is malformed.</returns>
+	bool Parse(const uint8_t *pData, size_t size);
+
+	const std::vector<CURSOR_TRACK_VIEWPORT> &GetViewports() const { return m_Viewports; }
+	const std::vector<CURSOR_TRACK_POINTER> &GetPointers() const { return m_Pointers; }
+	const std::vector<CURSOR_TRACK_MOUSE_EVENT> &GetMouseEvents() const { return m_MouseEvents; }
+	/// <returns>The shape with the id, or nullptr if there is none.</returns>
+	const CURSOR_TRACK_SHAPE *GetShape(uint32_t id) const;
+	/// <returns>The last viewport at or before the timestamp, or the first viewport if the timestamp is before it. nullptr if there are no viewports.</returns>
+	const CURSOR_TRACK_VIEWPORT *GetViewportAt(int64_t timestamp) const;
+	/// <returns>The last pointer at or before the timestamp, or nullptr if there is none.</returns>
+	const CURSOR_TRACK_POINTER *GetPointerAt(int64_t timestamp) const;
+private:
+	std::vector<CURSOR_TRACK_VIEWPORT> m_Viewports;
+	std::vector<CURSOR_TRACK_POINTER> m_Pointers;
+	std::vector<CURSOR_TRACK_MOUSE_EVENT> m_MouseEvents;
+	std::unordered_map<uint32_t, CURSOR_TRACK_SHAPE> m_Shapes;
+};
+
+/// <summary>
+/// Draws the pointer of a cursor track onto decoded Bgra32 video frames. Decoded shapes are cached, so each shape is only decoded once.
+/// </summary>
+class CursorTrackRenderer
+{
+public:
+	/// <param name="reader">The track to draw. It must outlive the renderer.</param>
+	explicit CursorTrackRenderer(const CursorTrackReader &reader);
+	/// <summary>
+	/// Draws the pointer as it was at the timestamp. The frame may be scaled from the size of the recorded video, e.g. for a thumbnail.
+	/// </summary>
+	/// <returns>true if the pointer was drawn, false if it was hidden, outside the frame, or unknown at the timestamp.</returns>
+	bool Render(int64_t timestamp, uint8_t *pFrame, uint32_t width, uint32_t height, uint32_t pitch);
+private:
+	const CursorTrackReader &m_Reader;
+	std::unordered_map<uint32_t, CURSOR_IMAGE> m_Images;
+};
@@ -226,13 +226,18 @@ HRESULT DesktopDuplicationCapture::WriteNextFrameToSharedSurface(_In_ DWORD time
 
 		if (hr == S_OK) {
 			QueryPerformanceCounter(&m_LastGrabTimeStamp);
+			//LastPresentTime is 0 if only the mouse pointer was updated, or if the frame was restored from pTexture.
+			if (!pTexture && m_CurrentData.FrameInfo.LastPresentTime.QuadPart > 0) {
+				m_LastFramePresentTime = PerformanceCounterToHundredNanos(m_CurrentData.FrameInfo.LastPresentTime.QuadPart);
+			}
 		}
 	}
 	return hr;
 }
 
 HRESULT DesktopDuplicationCapture::SendBitmapCallback(_In_ ID3D11Texture2D *pSharedSurf, _In_ SIZE frameOffset, _In_ SIZE contentOffset, _In_ RECT destinationRect) {
-	if (m_RecordingSource->IsVideoFramePreviewEnabled.value_or(false) && m_RecordingSource->HasRegisteredCallbacks())
+	//Frames skipped by the preview frame rate don't need the copy and mouse pointer below.
+	if (IsBitmapCallbackDue())
 	{
 		int width = MakeEven(RectWidth(destinationRect));
 		int height = MakeEven(RectHeight(destinationRect));
@@ -257,7 +262,7 @@ HRESULT DesktopDuplicationCapture::SendBitmapCallback(_In_ ID3D11Texture2D *pSha
 		if (SUCCEEDED(hr)) {
 			LOG_ON_BAD_HR(hr = m_MouseManager->ProcessMousePointer(m_BitmapDataCallbackTexture, &m_BitmapDataCallbackPtrInfo));
 		}
-		return CaptureBase::SendBitmapCallback(m_BitmapDataCallbackTexture);
+		return ReadBackBitmap(m_BitmapDataCallbackTexture);
 	}
 	else {
 		return S_FALSE;
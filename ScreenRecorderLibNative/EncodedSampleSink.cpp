@@ -0,0 +1,452 @@
+#include "EncodedSampleSink.h"
+#include "cleanup.h"
+#include "Log.h"
+
+using namespace std;
+
+class EncodedSampleSink::StreamSink : public IMFStreamSink, public IMFMediaTypeHandler {
+
+public:
+	StreamSink(_In_ EncodedSampleSink *pParent, _In_ DWORD identifier, _In_ IMFMediaType *pMediaType, _In_ IMFMediaEventQueue *pEventQueue, _In_ EncodedSampleCallback callback) :
+		m_nRefCount(1),
+		m_pParent(pParent),
+		m_Identifier(identifier),
+		m_MediaType(pMediaType),
+		m_EventQueue(pEventQueue),
+		m_Callback(callback),
+		m_IsShutdown(false)
+	{
+		InitializeCriticalSection(&m_CriticalSection);
+	}
+
+	/// <summary>
+	/// Detaches the stream from its parent sink and shuts down the event queue. Called by the parent sink when it is shut down or destroyed.
+	/// </summary>
+	void Shutdown()
+	{
+		EnterCriticalSection(&m_CriticalSection);
+		LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
+		if (m_IsShutdown) {
+			return;
+		}
+		m_IsShutdown = true;
+		m_pParent = nullptr;
+		m_Callback = nullptr;
+		m_EventQueue->Shutdown();
+	}
+
+	// IMFStreamSink methods
+	STDMETHODIMP GetMediaSink(IMFMediaSink **ppMediaSink) {
+		if (!ppMediaSink) {
+			return E_POINTER;
+		}
+		EnterCriticalSection(&m_CriticalSection);
+		LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
+		if (m_IsShutdown) {
+			return MF_E_STREAMSINK_REMOVED;
+		}
+		*ppMediaSink = m_pParent;
+		(*ppMediaSink)->AddRef();
+		return S_OK;
+	}
+
+	STDMETHODIMP GetIdentifier(DWORD *pdwIdentifier) {
+		if (!pdwIdentifier) {
+			return E_POINTER;
+		}
+		if (m_IsShutdown) {
+			return MF_E_STREAMSINK_REMOVED;
+		}
+		*pdwIdentifier = m_Identifier;
+		return S_OK;
+	}
+
+	STDMETHODIMP GetMediaTypeHandler(IMFMediaTypeHandler **ppHandler) {
+		if (m_IsShutdown) {
+			return MF_E_STREAMSINK_REMOVED;
+		}
+		return QueryInterface(IID_PPV_ARGS(ppHandler));
+	}
+
+	STDMETHODIMP ProcessSample(IMFSample *pSample) {
+		if (!pSample) {
+			return E_POINTER;
+		}
+		EnterCriticalSection(&m_CriticalSection);
+		LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
+		if (m_IsShutdown) {
+			return MF_E_STREAMSINK_REMOVED;
+		}
+		if (m_Callback) {
+			m_Callback(m_Identifier, pSample);
+		}
+		//Samples are consumed synchronously, so the next one can be requested right away.
+		return m_EventQueue->QueueEventParamVar(MEStreamSinkRequestSample, GUID_NULL, S_OK, nullptr);
+	}
+
+	STDMETHODIMP PlaceMarker(MFSTREAMSINK_MARKER_TYPE eMarkerType, const PROPVARIANT *pvarMarkerValue, const PROPVARIANT *pvarContextValue) {
+		if (m_IsShutdown) {
+			return MF_E_STREAMSINK_REMOVED;
+		}
+		//All samples before the marker have already been consumed, so the marker is reached immediately.
+		return m_EventQueue->QueueEventParamVar(MEStreamSinkMarker, GUID_NULL, S_OK, pvarContextValue);
+	}
+
+	STDMETHODIMP Flush() {
+		return m_IsShutdown ? MF_E_STREAMSINK_REMOVED : S_OK;
+	}
+
+	// IMFMediaEventGenerator methods
+	STDMETHODIMP GetEvent(DWORD dwFlags, IMFMediaEvent **ppEvent) {
+		//Not delegated while holding a lock, as it blocks until an event is queued.
+		CComPtr<IMFMediaEventQueue> pQueue = m_EventQueue;
+		if (m_IsShutdown) {
+			return MF_E_SHUTDOWN;
+		}
+		return pQueue->GetEvent(dwFlags, ppEvent);
+	}
+
+	STDMETHODIMP BeginGetEvent(IMFAsyncCallback *pCallback, IUnknown *punkState) {
+		if (m_IsShutdown) {
+			return MF_E_SHUTDOWN;
+		}
+		return m_EventQueue->BeginGetEvent(pCallback, punkState);
+	}
+
+	STDMETHODIMP EndGetEvent(IMFAsyncResult *pResult, IMFMediaEvent **ppEvent) {
+		if (m_IsShutdown) {
+			return MF_E_SHUTDOWN;
+		}
+		return m_EventQueue->EndGetEvent(pResult, ppEvent);
+	}
+
+	STDMETHODIMP QueueEvent(MediaEventType met, REFGUID guidExtendedType, HRESULT hrStatus, const PROPVARIANT *pvValue) {
+		if (m_IsShutdown) {
+			return MF_E_SHUTDOWN;
+		}
+		return m_EventQueue->QueueEventParamVar(met, guidExtendedType, hrStatus, pvValue);
+	}
+
+	// IMFMediaTypeHandler methods
+	STDMETHODIMP IsMediaTypeSupported(IMFMediaType *pMediaType, IMFMediaType **ppMediaType) {
+		if (!pMediaType) {
+			return E_POINTER;
+		}
+		if (ppMediaType) {
+			*ppMediaType = nullptr;
+		}
+		GUID majorType = GUID_NULL, subtype = GUID_NULL;
+		GUID currentMajorType = GUID_NULL, currentSubtype = GUID_NULL;
+		pMediaType->GetGUID(MF_MT_MAJOR_TYPE, &majorType);
+		pMediaType->GetGUID(MF_MT_SUBTYPE, &subtype);
+		m_MediaType->GetGUID(MF_MT_MAJOR_TYPE, &currentMajorType);
+		m_MediaType->GetGUID(MF_MT_SUBTYPE, &currentSubtype);
+		//The samples are passed on as is, so any type with the same format is supported.
+		if (majorType != currentMajorType || subtype != currentSubtype) {
+			return MF_E_INVALIDMEDIATYPE;
+		}
+		return S_OK;
+	}
+
+	STDMETHODIMP GetMediaTypeCount(DWORD *pdwTypeCount) {
+		if (!pdwTypeCount) {
+			return E_POINTER;
+		}
+		*pdwTypeCount = 1;
+		return S_OK;
+	}
+
+	STDMETHODIMP GetMediaTypeByIndex(DWORD dwIndex, IMFMediaType **ppType) {
+		if (!ppType) {
+			return E_POINTER;
+		}
+		if (dwIndex > 0) {
+			return MF_E_NO_MORE_TYPES;
+		}
+		return GetCurrentMediaType(ppType);
+	}
+
+	STDMETHODIMP SetCurrentMediaType(IMFMediaType *pMediaType) {
+		HRESULT hr = IsMediaTypeSupported(pMediaType, nullptr);
+		if (SUCCEEDED(hr)) {
+			m_MediaType = pMediaType;
+		}
+		return hr;
+	}
+
+	STDMETHODIMP GetCurrentMediaType(IMFMediaType **ppMediaType) {
+		if (!ppMediaType) {
+			return E_POINTER;
+		}
+		*ppMediaType = m_MediaType;
+		(*ppMediaType)->AddRef();
+		return S_OK;
+	}
+
+	STDMETHODIMP GetMajorType(GUID *pguidMajorType) {
+		if (!pguidMajorType) {
+			return E_POINTER;
+		}
+		return m_MediaType->GetGUID(MF_MT_MAJOR_TYPE, pguidMajorType);
+	}
+
+	// IUnknown methods
+	STDMETHODIMP QueryInterface(REFIID riid, void **ppv) {
+		static const QITAB qit[] = {
+			QITABENT(StreamSink, IMFStreamSink),
+			QITABENT(StreamSink, IMFMediaEventGenerator),
+			QITABENT(StreamSink, IMFMediaTypeHandler),
+		{0}
+		};
+		return QISearch(this, qit, riid, ppv);
+	}
+
+	STDMETHODIMP_(ULONG) AddRef() {
+		return InterlockedIncrement(&m_nRefCount);
+	}
+
+	STDMETHODIMP_(ULONG) Release() {
+		ULONG refCount = InterlockedDecrement(&m_nRefCount);
+		if (refCount == 0) {
+			delete this;
+		}
+		return refCount;
+	}
+
+private:
+	virtual ~StreamSink()
+	{
+		DeleteCriticalSection(&m_CriticalSection);
+	}
+
+	volatile long m_nRefCount;
+	//Not reference counted, as the parent holds a reference to the stream. Cleared when the parent is shut down or destroyed.
+	EncodedSampleSink *m_pParent;
+	DWORD m_Identifier;
+	CComPtr<IMFMediaType> m_MediaType;
+	CComPtr<IMFMediaEventQueue> m_EventQueue;
+	EncodedSampleCallback m_Callback;
+	CRITICAL_SECTION m_CriticalSection;
+	volatile bool m_IsShutdown;
+};
+
+EncodedSampleSink::EncodedSampleSink() :
+	m_nRefCount(1),
+	m_IsShutdown(false),
+	m_StreamSinks{},
+	m_PresentationClock(nullptr)
+{
+	InitializeCriticalSection(&m_CriticalSection);
+}
+
+EncodedSampleSink::~EncodedSampleSink()
+{
+	//The stream sinks can outlive this sink, so they must not keep a pointer to it.
+	for (CComPtr<IMFStreamSink> &pStreamSink : m_StreamSinks) {
+		static_cast<StreamSink *>(pStreamSink.p)->Shutdown();
+	}
+	DeleteCriticalSection(&m_CriticalSection);
+}
+
+HRESULT EncodedSampleSink::CreateInstance(_In_ const std::vector<IMFMediaType *> &mediaTypes, _In_ EncodedSampleCallback callback, _Outptr_ IMFMediaSink **ppSink)
+{
+	*ppSink = nullptr;
+	CComPtr<IMFMediaSink> pSink;
+	EncodedSampleSink *pEncodedSampleSink = new (std::nothrow)EncodedSampleSink();
+	if (!pEncodedSampleSink) {
+		return E_OUTOFMEMORY;
+	}
+	pSink.Attach(pEncodedSampleSink);
+	for (DWORD i = 0; i < mediaTypes.size(); i++) {
+		CComPtr<IMFMediaEventQueue> pEventQueue;
+		RETURN_ON_BAD_HR(MFCreateEventQueue(&pEventQueue));
+		CComPtr<IMFStreamSink> pStreamSink;
+		pStreamSink.Attach(new (std::nothrow)StreamSink(pEncodedSampleSink, i, mediaTypes[i], pEventQueue, callback));
+		if (!pStreamSink) {
+			return E_OUTOFMEMORY;
+		}
+		pEncodedSampleSink->m_StreamSinks.push_back(pStreamSink);
+	}
+	*ppSink = pSink.Detach();
+	return S_OK;
+}
+
+HRESULT EncodedSampleSink::QueueStreamEvents(_In_ MediaEventType eventType, _In_ bool requestSample)
+{
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
+	if (m_IsShutdown) {
+		return MF_E_SHUTDOWN;
+	}
+	for (CComPtr<IMFStreamSink> &pStreamSink : m_StreamSinks) {
+		RETURN_ON_BAD_HR(pStreamSink->QueueEvent(eventType, GUID_NULL, S_OK, nullptr));
+		if (requestSample) {
+			RETURN_ON_BAD_HR(pStreamSink->QueueEvent(MEStreamSinkRequestSample, GUID_NULL, S_OK, nullptr));
+		}
+	}
+	return S_OK;
+}
+
+STDMETHODIMP EncodedSampleSink::GetCharacteristics(DWORD *pdwCharacteristics)
+{
+	if (!pdwCharacteristics) {
+		return E_POINTER;
+	}
+	if (m_IsShutdown) {
+		return MF_E_SHUTDOWN;
+	}
+	//Samples are consumed as fast as they arrive, so the sink does not need a clock to pace them.
+	*pdwCharacteristics = MEDIASINK_FIXED_STREAMS | MEDIASINK_RATELESS;
+	return S_OK;
+}
+
+STDMETHODIMP EncodedSampleSink::AddStreamSink(DWORD dwStreamSinkIdentifier, IMFMediaType *pMediaType, IMFStreamSink **ppStreamSink)
+{
+	return MF_E_STREAMSINKS_FIXED;
+}
+
+STDMETHODIMP EncodedSampleSink::RemoveStreamSink(DWORD dwStreamSinkIdentifier)
+{
+	return MF_E_STREAMSINKS_FIXED;
+}
+
+STDMETHODIMP EncodedSampleSink::GetStreamSinkCount(DWORD *pcStreamSinkCount)
+{
+	if (!pcStreamSinkCount) {
+		return E_POINTER;
+	}
+	if (m_IsShutdown) {
+		return MF_E_SHUTDOWN;
+	}
+	*pcStreamSinkCount = static_cast<DWORD>(m_StreamSinks.size());
+	return S_OK;
+}
+
+STDMETHODIMP EncodedSampleSink::GetStreamSinkByIndex(DWORD dwIndex, IMFStreamSink **ppStreamSink)
+{
+	if (!ppStreamSink) {
+		return E_POINTER;
+	}
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
+	if (m_IsShutdown) {
+		return MF_E_SHUTDOWN;
+	}
+	if (dwIndex >= m_StreamSinks.size()) {
+		return MF_E_INVALIDINDEX;
+	}
+	*ppStreamSink = m_StreamSinks[dwIndex];
+	(*ppStreamSink)->AddRef();
+	return S_OK;
+}
+
+STDMETHODIMP EncodedSampleSink::GetStreamSinkById(DWORD dwStreamSinkIdentifier, IMFStreamSink **ppStreamSink)
+{
+	//The stream identifiers are the same as the indexes.
+	HRESULT hr = GetStreamSinkByIndex(dwStreamSinkIdentifier, ppStreamSink);
+	return hr == MF_E_INVALIDINDEX ? MF_E_INVALIDSTREAMNUMBER : hr;
+}
+
+STDMETHODIMP EncodedSampleSink::SetPresentationClock(IMFPresentationClock *pPresentationClock)
+{
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
+	if (m_IsShutdown) {
+		return MF_E_SHUTDOWN;
+	}
+	if (m_PresentationClock) {
+		RETURN_ON_BAD_HR(m_PresentationClock->RemoveClockStateSink(this));
+	}
+	if (pPresentationClock) {
+		RETURN_ON_BAD_HR(pPresentationClock->AddClockStateSink(this));
+	}
+	m_PresentationClock = pPresentationClock;
+	return S_OK;
+}
+
+STDMETHODIMP EncodedSampleSink::GetPresentationClock(IMFPresentationClock **ppPresentationClock)
+{
+	if (!ppPresentationClock) {
+		return E_POINTER;
+	}
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
+	if (m_IsShutdown) {
+		return MF_E_SHUTDOWN;
+	}
+	if (!m_PresentationClock) {
+		return MF_E_NO_CLOCK;
+	}
+	*ppPresentationClock = m_PresentationClock;
+	(*ppPresentationClock)->AddRef();
+	return S_OK;
+}
+
+STDMETHODIMP EncodedSampleSink::Shutdown()
+{
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
+	if (m_IsShutdown) {
+		return MF_E_SHUTDOWN;
+	}
+	m_IsShutdown = true;
+	for (CComPtr<IMFStreamSink> &pStreamSink : m_StreamSinks) {
+		static_cast<StreamSink *>(pStreamSink.p)->Shutdown();
+	}
+	m_StreamSinks.clear();
+	if (m_PresentationClock) {
+		//The clock holds a reference to this sink, which must be released to break the cycle.
+		m_PresentationClock->RemoveClockStateSink(this);
+		m_PresentationClock.Release();
+	}
+	return S_OK;
+}
+
+STDMETHODIMP EncodedSampleSink::OnClockStart(MFTIME hnsSystemTime, LONGLONG llClockStartOffset)
+{
+	return QueueStreamEvents(MEStreamSinkStarted, true);
+}
+
+STDMETHODIMP EncodedSampleSink::OnClockStop(MFTIME hnsSystemTime)
+{
+	return QueueStreamEvents(MEStreamSinkStopped, false);
+}
+
+STDMETHODIMP EncodedSampleSink::OnClockPause(MFTIME hnsSystemTime)
+{
+	return QueueStreamEvents(MEStreamSinkPaused, false);
+}
+
+STDMETHODIMP EncodedSampleSink::OnClockRestart(MFTIME hnsSystemTime)
+{
+	return QueueStreamEvents(MEStreamSinkStarted, true);
+}
+
+STDMETHODIMP EncodedSampleSink::OnClockSetRate(MFTIME hnsSystemTime, float flRate)
+{
+	return S_OK;
+}
+
+STDMETHODIMP EncodedSampleSink::QueryInterface(REFIID riid, void **ppv)
+{
+	static const QITAB qit[] = {
+		QITABENT(EncodedSampleSink, IMFMediaSink),
+		QITABENT(EncodedSampleSink, IMFClockStateSink),
+	{0}
+	};
+	return QISearch(this, qit, riid, ppv);
+}
+
+STDMETHODIMP_(ULONG) EncodedSampleSink::AddRef()
+{
+	return InterlockedIncrement(&m_nRefCount);
+}
+
+STDMETHODIMP_(ULONG) EncodedSampleSink::Release()
+{
+	ULONG refCount = InterlockedDecrement(&m_nRefCount);
+	if (refCount == 0) {
+		delete this;
+	}
+	return refCount;
+}
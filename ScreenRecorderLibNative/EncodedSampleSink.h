@@ -0,0 +1,58 @@
+#pragma once
+#include <mfapi.h>
+#include <mfidl.h>
+#include <Shlwapi.h>
+#include <atlbase.h>
+#include <functional>
+#include <vector>
+
+/// <summary>
+/// Called with every encoded sample that reaches the sink. Called on a Media Foundation work queue thread.
+/// </summary>
+typedef std::function<void(DWORD streamIndex, IMFSample *pSample)> EncodedSampleCallback;
+
+/// <summary>
+/// A media sink that hands the encoded samples from a sink writer to a callback instead of writing them to a container.
+/// Has one stream sink per media type, with the stream indexes in the order the types are given.
+/// </summary>
+class EncodedSampleSink : public IMFMediaSink, public IMFClockStateSink {
+
+public:
+	static HRESULT CreateInstance(_In_ const std::vector<IMFMediaType *> &mediaTypes, _In_ EncodedSampleCallback callback, _Outptr_ IMFMediaSink **ppSink);
+
+	// IMFMediaSink methods
+	STDMETHODIMP GetCharacteristics(DWORD *pdwCharacteristics);
+	STDMETHODIMP AddStreamSink(DWORD dwStreamSinkIdentifier, IMFMediaType *pMediaType, IMFStreamSink **ppStreamSink);
+	STDMETHODIMP RemoveStreamSink(DWORD dwStreamSinkIdentifier);
+	STDMETHODIMP GetStreamSinkCount(DWORD *pcStreamSinkCount);
+	STDMETHODIMP GetStreamSinkByIndex(DWORD dwIndex, IMFStreamSink **ppStreamSink);
+	STDMETHODIMP GetStreamSinkById(DWORD dwStreamSinkIdentifier, IMFStreamSink **ppStreamSink);
+	STDMETHODIMP SetPresentationClock(IMFPresentationClock *pPresentationClock);
+	STDMETHODIMP GetPresentationClock(IMFPresentationClock **ppPresentationClock);
+	STDMETHODIMP Shutdown();
+
+	// IMFClockStateSink methods
+	STDMETHODIMP OnClockStart(MFTIME hnsSystemTime, LONGLONG llClockStartOffset);
+	STDMETHODIMP OnClockStop(MFTIME hnsSystemTime);
+	STDMETHODIMP OnClockPause(MFTIME hnsSystemTime);
+	STDMETHODIMP OnClockRestart(MFTIME hnsSystemTime);
+	STDMETHODIMP OnClockSetRate(MFTIME hnsSystemTime, float flRate);
+
+	// IUnknown methods
+	STDMETHODIMP QueryInterface(REFIID riid, void **ppv);
+	STDMETHODIMP_(ULONG) AddRef();
+	STDMETHODIMP_(ULONG) Release();
+
+private:
+	class StreamSink;
+
+	EncodedSampleSink();
+	virtual ~EncodedSampleSink();
+	HRESULT QueueStreamEvents(_In_ MediaEventType eventType, _In_ bool requestSample);
+
+	volatile long m_nRefCount;
+	bool m_IsShutdown;
+	CRITICAL_SECTION m_CriticalSection;
+	std::vector<CComPtr<IMFStreamSink>> m_StreamSinks;
+	CComPtr<IMFPresentationClock> m_PresentationClock;
+};
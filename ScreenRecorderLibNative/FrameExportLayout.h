@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "FrameExportRing.h"
+
+//The memory layout of a frame export ring. Consumers in other languages can read the ring using the offsets below.
+//
+//The ring starts with a FRAME_EXPORT_RING_HEADER, followed by SlotCount slots of SlotStride bytes.
+//Each slot starts with a FRAME_EXPORT_SLOT_HEADER, followed by the frame data at FRAME_EXPORT_SLOT_HEADER_SIZE.
+//
+//Slot ownership is lock free through the Owner field of each slot:
+// - 0 means the slot is free.
+// - FRAME_EXPORT_WRITER_FLAG means the writer is filling the slot.
+// - Any other value is the number of readers holding the slot.
+//The writer claims the slot with the lowest Sequence that is free with a compare and swap of Owner from 0 to FRAME_EXPORT_WRITER_FLAG,
+//fills it, sets Sequence, stores 0 in Owner, and then stores the Sequence in LatestSequence.
+//A reader finds the slot whose Sequence equals LatestSequence and increments Owner with a compare and swap, unless the writer flag is set.
+//It then checks that Sequence has not changed, reads the frame in place, and decrements Owner when done.
+
+static const uint32_t FRAME_EXPORT_MAGIC = 0x58465253;//"SRFX"
+static const uint32_t FRAME_EXPORT_VERSION = 1;
+static const uint32_t FRAME_EXPORT_WRITER_FLAG = 0x80000000;
+static const uint32_t FRAME_EXPORT_MAX_DAMAGE_RECTS = 16;
+static const uint32_t FRAME_EXPORT_SLOT_HEADER_SIZE = 320;
+static const uint32_t FRAME_EXPORT_RING_HEADER_SIZE = 64;
+
+struct FRAME_EXPORT_RING_HEADER {
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t HeaderSize;
+	uint32_t SlotCount;
+	uint64_t SlotStride;
+	uint64_t SlotDataCapacity;
+	std::atomic<uint64_t> LatestSequence;
+	std::atomic<uint64_t> DroppedFrames;
+	uint8_t Reserved[16];
+};
+
+struct FRAME_EXPORT_SLOT_HEADER {
+	std::atomic<uint32_t> Owner;
+	uint32_t Format;
+	std::atomic<uint64_t> Sequence;
+	int64_t Timestamp;
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t Stride;
+	uint32_t DataSize;
+	uint32_t DamageRectCount;
+	uint32_t Reserved;
+	FRAME_EXPORT_RECT DamageRects[FRAME_EXPORT_MAX_DAMAGE_RECTS];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free, "Shared memory atomics must be lock free");
+static_assert(sizeof(std::atomic<uint64_t>) == 8 && sizeof(std::atomic<uint32_t>) == 4, "Shared memory atomics must have the size of their value");
+static_assert(sizeof(FRAME_EXPORT_RING_HEADER) == FRAME_EXPORT_RING_HEADER_SIZE, "Unexpected ring header size");
+static_assert(offsetof(FRAME_EXPORT_RING_HEADER, LatestSequence) == 32, "Unexpected ring header layout");
+static_assert(offsetof(FRAME_EXPORT_SLOT_HEADER, Sequence) == 8, "Unexpected slot header layout");
+static_assert(offsetof(FRAME_EXPORT_SLOT_HEADER, DamageRects) == 48, "Unexpected slot header layout");
+static_assert(sizeof(FRAME_EXPORT_SLOT_HEADER) <= FRAME_EXPORT_SLOT_HEADER_SIZE, "Slot header does not fit");
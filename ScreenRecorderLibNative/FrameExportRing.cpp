@@ -0,0 +1,495 @@
+#include "FrameExportLayout.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+	const uint32_t BYTES_PER_PIXEL = 4;
+	const uint64_t SLOT_ALIGNMENT = 64;
+
+	/// <summary>
+	/// A named block of memory that can be mapped by several processes. A file mapping on Windows, and POSIX shared memory elsewhere.
+	/// </summary>
+	class SharedMemory {
+	public:
+		~SharedMemory()
+		{
+			Close();
+		}
+
+		bool Create(const wstring &name, size_t size, bool *pIsCreated)
+		{
+			Close();
+			*pIsCreated = false;
+#ifdef _WIN32
+			m_Handle = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size & 0xFFFFFFFF), name.c_str());
+			if (!m_Handle) {
+				return false;
+			}
+			*pIsCreated = GetLastError() != ERROR_ALREADY_EXISTS;
+			return Map();
+#else
+			m_Name = ToPosixName(name);
+			m_Fd = shm_open(m_Name.c_str(), O_RDWR | O_CREAT, 0600);
+			if (m_Fd < 0) {
+				return false;
+			}
+			struct stat info {};
+			if (fstat(m_Fd, &info) != 0) {
+				Close();
+				return false;
+			}
+			if (info.st_size == 0) {
+				if (ftruncate(m_Fd, static_cast<off_t>(size)) != 0) {
+					Close();
+					return false;
+				}
+				*pIsCreated = true;
+				m_IsOwner = true;
+			}
+			return Map();
+#endif
+		}
+
+		bool Open(const wstring &name)
+		{
+			Close();
+#ifdef _WIN32
+			m_Handle = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+			if (!m_Handle) {
+				return false;
+			}
+#else
+			m_Name = ToPosixName(name);
+			m_Fd = shm_open(m_Name.c_str(), O_RDWR, 0600);
+			if (m_Fd < 0) {
+				return false;
+			}
+#endif
+			return Map();
+		}
+
+		void Close()
+		{
+#ifdef _WIN32
+			if (m_pData) {
+				UnmapViewOfFile(m_pData);
+			}
+			if (m_Handle) {
+				CloseHandle(m_Handle);
+				m_Handle = nullptr;
+			}
+#else
+			if (m_pData) {
+				munmap(m_pData, m_Size);
+			}
+			if (m_Fd >= 0) {
+				close(m_Fd);
+				m_Fd = -1;
+			}
+			//Readers keep their mapping, so this only removes the name, like closing the last handle to a file mapping on Windows.
+			if (m_IsOwner) {
+				shm_unlink(m_Name.c_str());
+				m_IsOwner = false;
+			}
+#endif
+			m_pData = nullptr;
+			m_Size = 0;
+		}
+
+		uint8_t *GetData() { return m_pData; }
+		size_t GetSize() { return m_Size; }
+	private:
+		uint8_t *m_pData = nullptr;
+		size_t m_Size = 0;
+#ifdef _WIN32
+		HANDLE m_Handle = nullptr;
+
+		bool Map()
+		{
+			m_pData = static_cast<uint8_t *>(MapViewOfFile(m_Handle, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+			if (!m_pData) {
+				Close();
+				return false;
+			}
+			MEMORY_BASIC_INFORMATION info{};
+			VirtualQuery(m_pData, &info, sizeof(info));
+			m_Size = info.RegionSize;
+			return true;
+		}
+#else
+		int m_Fd = -1;
+		string m_Name;
+		bool m_IsOwner = false;
+
+		static string ToPosixName(const wstring &name)
+		{
+			string posixName = "/";
+			for (wchar_t c : name) {
+				posixName += (c == L'\\' || c == L'/' || c > 0x7F) ? '_' : static_cast<char>(c);
+			}
+			return posixName;
+		}
+
+		bool Map()
+		{
+			struct stat info {};
+			if (fstat(m_Fd, &info) != 0 || info.st_size <= 0) {
+				Close();
+				return false;
+			}
+			m_Size = static_cast<size_t>(info.st_size);
+			void *pData = mmap(nullptr, m_Size, PROT_READ | PROT_WRITE, MAP_SHARED, m_Fd, 0);
+			if (pData == MAP_FAILED) {
+				m_Size = 0;
+				Close();
+				return false;
+			}
+			m_pData = static_cast<uint8_t *>(pData);
+			return true;
+		}
+#endif
+	};
+
+	uint64_t GetSlotStride(uint64_t maxFrameBytes)
+	{
+		uint64_t size = FRAME_EXPORT_SLOT_HEADER_SIZE + maxFrameBytes;
+		return (size + SLOT_ALIGNMENT - 1) / SLOT_ALIGNMENT * SLOT_ALIGNMENT;
+	}
+
+	FRAME_EXPORT_RING_HEADER *GetRingHeader(SharedMemory &memory)
+	{
+		return reinterpret_cast<FRAME_EXPORT_RING_HEADER *>(memory.GetData());
+	}
+
+	FRAME_EXPORT_SLOT_HEADER *GetSlotHeader(SharedMemory &memory, uint32_t index)
+	{
+		FRAME_EXPORT_RING_HEADER *pHeader = GetRingHeader(memory);
+		return reinterpret_cast<FRAME_EXPORT_SLOT_HEADER *>(memory.GetData() + pHeader->HeaderSize + pHeader->SlotStride * index);
+	}
+
+	uint8_t *GetSlotData(SharedMemory &memory, uint32_t index)
+	{
+		return reinterpret_cast<uint8_t *>(GetSlotHeader(memory, index)) + FRAME_EXPORT_SLOT_HEADER_SIZE;
+	}
+
+	bool IsValidRing(SharedMemory &memory)
+	{
+		if (memory.GetSize() < FRAME_EXPORT_RING_HEADER_SIZE) {
+			return false;
+		}
+		FRAME_EXPORT_RING_HEADER *pHeader = GetRingHeader(memory);
+		return pHeader->Magic == FRAME_EXPORT_MAGIC
+			&& pHeader->Version == FRAME_EXPORT_VERSION
+			&& pHeader->HeaderSize >= FRAME_EXPORT_RING_HEADER_SIZE
+			&& pHeader->SlotCount > 0
+			&& pHeader->SlotStride >= FRAME_EXPORT_SLOT_HEADER_SIZE + pHeader->SlotDataCapacity
+			&& pHeader->HeaderSize + pHeader->SlotStride * pHeader->SlotCount <= memory.GetSize();
+	}
+}
+
+struct FrameExportWriter::Impl {
+	SharedMemory m_Memory;
+	uint64_t m_Sequence = 0;
+	FRAME_EXPORT_STATS m_Stats{};
+
+	bool Create(const wstring &name, uint32_t slotCount, uint32_t maxFrameBytes)
+	{
+		m_Memory.Close();
+		m_Stats = {};
+		slotCount = max<uint32_t>(slotCount, 1);
+		uint64_t slotStride = GetSlotStride(maxFrameBytes);
+		size_t size = static_cast<size_t>(FRAME_EXPORT_RING_HEADER_SIZE + slotStride * slotCount);
+		bool isCreated = false;
+		if (!m_Memory.Create(name, size, &isCreated)) {
+			return false;
+		}
+		if (m_Memory.GetSize() < size) {
+			m_Memory.Close();
+			return false;
+		}
+		if (!isCreated && (!IsValidRing(m_Memory) || GetRingHeader(m_Memory)->SlotCount != slotCount || GetRingHeader(m_Memory)->SlotStride != slotStride)) {
+			if (GetRingHeader(m_Memory)->Magic == FRAME_EXPORT_MAGIC) {
+				m_Memory.Close();
+				return false;
+			}
+			//Created by another process that has not initialized it yet, or left uninitialized.
+			isCreated = true;
+		}
+		FRAME_EXPORT_RING_HEADER *pHeader = GetRingHeader(m_Memory);
+		if (isCreated) {
+			new (pHeader) FRAME_EXPORT_RING_HEADER{};
+			pHeader->Version = FRAME_EXPORT_VERSION;
+			pHeader->HeaderSize = FRAME_EXPORT_RING_HEADER_SIZE;
+			pHeader->SlotCount = slotCount;
+			pHeader->SlotStride = slotStride;
+			pHeader->SlotDataCapacity = slotStride - FRAME_EXPORT_SLOT_HEADER_SIZE;
+			for (uint32_t i = 0; i < slotCount; i++) {
+				new (GetSlotHeader(m_Memory, i)) FRAME_EXPORT_SLOT_HEADER{};
+			}
+			atomic_thread_fence(memory_order_release);
+			pHeader->Magic = FRAME_EXPORT_MAGIC;
+		}
+		else {
+			//A previous writer may have stopped while filling a slot. Slots held by readers are left alone.
+			for (uint32_t i = 0; i < slotCount; i++) {
+				uint32_t writerOwned = FRAME_EXPORT_WRITER_FLAG;
+				GetSlotHeader(m_Memory, i)->Owner.compare_exchange_strong(writerOwned, 0);
+			}
+		}
+		m_Sequence = pHeader->LatestSequence.load(memory_order_acquire);
+		return true;
+	}
+
+	bool Write(int64_t timestamp, uint32_t width, uint32_t height, uint32_t stride, FrameExportFormat format, const uint8_t *pData, const FRAME_EXPORT_RECT *pDamageRects, uint32_t damageRectCount)
+	{
+		if (!m_Memory.GetData()) {
+			return false;
+		}
+		FRAME_EXPORT_RING_HEADER *pHeader = GetRingHeader(m_Memory);
+		uint64_t rowBytes = static_cast<uint64_t>(width) * BYTES_PER_PIXEL;
+		uint64_t dataSize = rowBytes * height;
+		FRAME_EXPORT_SLOT_HEADER *pSlot = nullptr;
+		uint32_t slotIndex = 0;
+		if (rowBytes <= stride && dataSize <= pHeader->SlotDataCapacity) {
+			pSlot = ClaimOldestFreeSlot(&slotIndex);
+		}
+		if (!pSlot) {
+			pHeader->DroppedFrames.fetch_add(1, memory_order_relaxed);
+			m_Stats.DroppedFrames++;
+			return false;
+		}
+		uint8_t *pSlotData = GetSlotData(m_Memory, slotIndex);
+		if (rowBytes == stride) {
+			memcpy(pSlotData, pData, static_cast<size_t>(dataSize));
+		}
+		else {
+			for (uint32_t row = 0; row < height; row++) {
+				memcpy(pSlotData + row * rowBytes, pData + static_cast<size_t>(row) * stride, static_cast<size_t>(rowBytes));
+			}
+		}
+		pSlot->Format = static_cast<uint32_t>(format);
+		pSlot->Timestamp = timestamp;
+		pSlot->Width = width;
+		pSlot->Height = height;
+		pSlot->Stride = static_cast<uint32_t>(rowBytes);
+		pSlot->DataSize = static_cast<uint32_t>(dataSize);
+		SetDamageRects(pSlot, pDamageRects, damageRectCount);
+		pSlot->Sequence.store(++m_Sequence, memory_order_relaxed);
+		pSlot->Owner.store(0, memory_order_release);
+		pHeader->LatestSequence.store(m_Sequence, memory_order_release);
+		m_Stats.WrittenFrames++;
+		return true;
+	}
+
+private:
+	FRAME_EXPORT_SLOT_HEADER *ClaimOldestFreeSlot(uint32_t *pIndex)
+	{
+		uint32_t slotCount = GetRingHeader(m_Memory)->SlotCount;
+		//Slots that failed to be claimed are skipped on the next attempt.
+		uint64_t skippedSlots = 0;
+		for (uint32_t attempt = 0; attempt < slotCount; attempt++) {
+			FRAME_EXPORT_SLOT_HEADER *pOldest = nullptr;
+			uint32_t oldestIndex = 0;
+			for (uint32_t i = 0; i < slotCount; i++) {
+				FRAME_EXPORT_SLOT_HEADER *pSlot = GetSlotHeader(m_Memory, i);
+				if ((i < 64 && (skippedSlots & (1ULL << i))) || pSlot->Owner.load(memory_order_relaxed) != 0) {
+					continue;
+				}
+				if (!pOldest || pSlot->Sequence.load(memory_order_relaxed) < pOldest->Sequence.load(memory_order_relaxed)) {
+					pOldest = pSlot;
+					oldestIndex = i;
+				}
+			}
+			if (!pOldest) {
+				return nullptr;
+			}
+			uint32_t free = 0;
+			if (pOldest->Owner.compare_exchange_strong(free, FRAME_EXPORT_WRITER_FLAG, memory_order_acquire)) {
+				*pIndex = oldestIndex;
+				return pOldest;
+			}
+			if (oldestIndex < 64) {
+				skippedSlots |= 1ULL << oldestIndex;
+			}
+		}
+		return nullptr;
+	}
+
+	static void SetDamageRects(FRAME_EXPORT_SLOT_HEADER *pSlot, const FRAME_EXPORT_RECT *pDamageRects, uint32_t damageRectCount)
+	{
+		if (!pDamageRects || damageRectCount == 0) {
+			pSlot->DamageRectCount = 0;
+		}
+		else if (damageRectCount <= FRAME_EXPORT_MAX_DAMAGE_RECTS) {
+			memcpy(pSlot->DamageRects, pDamageRects, damageRectCount * sizeof(FRAME_EXPORT_RECT));
+			pSlot->DamageRectCount = damageRectCount;
+		}
+		else {
+			FRAME_EXPORT_RECT bounds = pDamageRects[0];
+			for (uint32_t i = 1; i < damageRectCount; i++) {
+				bounds.Left = min(bounds.Left, pDamageRects[i].Left);
+				bounds.Top = min(bounds.Top, pDamageRects[i].Top);
+				bounds.Right = max(bounds.Right, pDamageRects[i].Right);
+				bounds.Bottom = max(bounds.Bottom, pDamageRects[i].Bottom);
+			}
+			pSlot->DamageRects[0] = bounds;
+			pSlot->DamageRectCount = 1;
+		}
+	}
+};
+
+FrameExportWriter::FrameExportWriter() :
+	m_Impl(make_unique<Impl>())
+{
+}
+
+FrameExportWriter::~FrameExportWriter()
+{
+}
+
+bool FrameExportWriter::Create(const std::wstring &name, uint32_t slotCount, uint32_t maxFrameBytes)
+{
+	return m_Impl->Create(name, slotCount, maxFrameBytes);
+}
+
+bool FrameExportWriter::Write(int64_t timestamp, uint32_t width, uint32_t height, uint32_t stride, FrameExportFormat format, const uint8_t *pData, const FRAME_EXPORT_RECT *pDamageRects, uint32_t damageRectCount)
+{
+	return m_Impl->Write(timestamp, width, height, stride, format, pData, pDamageRects, damageRectCount);
+}
+
+FRAME_EXPORT_STATS FrameExportWriter::GetStats()
+{
+	return m_Impl->m_Stats;
+}
+
+void FrameExportWriter::Close()
+{
+	m_Impl->m_Memory.Close();
+}
+
+bool FrameExportWriter::IsOpen()
+{
+	return m_Impl->m_Memory.GetData() != nullptr;
+}
+
+struct FrameExportReader::Impl {
+	SharedMemory m_Memory;
+
+	bool Open(const wstring &name)
+	{
+		if (!m_Memory.Open(name)) {
+			return false;
+		}
+		if (!IsValidRing(m_Memory)) {
+			m_Memory.Close();
+			return false;
+		}
+		atomic_thread_fence(memory_order_acquire);
+		return true;
+	}
+
+	bool TryAcquireLatest(uint64_t afterSequence, FRAME_EXPORT_VIEW *pView)
+	{
+		if (!m_Memory.GetData()) {
+			return false;
+		}
+		FRAME_EXPORT_RING_HEADER *pHeader = GetRingHeader(m_Memory);
+		//The writer can overwrite the slot between finding and claiming it, in which case a newer frame is available, so try again.
+		for (int attempt = 0; attempt < 8; attempt++) {
+			uint64_t latest = pHeader->LatestSequence.load(memory_order_acquire);
+			if (latest == 0 || latest <= afterSequence) {
+				return false;
+			}
+			for (uint32_t i = 0; i < pHeader->SlotCount; i++) {
+				FRAME_EXPORT_SLOT_HEADER *pSlot = GetSlotHeader(m_Memory, i);
+				if (pSlot->Sequence.load(memory_order_acquire) != latest) {
+					continue;
+				}
+				if (!TryHold(pSlot)) {
+					break;
+				}
+				if (pSlot->Sequence.load(memory_order_acquire) != latest) {
+					pSlot->Owner.fetch_sub(1, memory_order_release);
+					break;
+				}
+				pView->Sequence = latest;
+				pView->Timestamp = pSlot->Timestamp;
+				pView->Width = pSlot->Width;
+				pView->Height = pSlot->Height;
+				pView->Stride = pSlot->Stride;
+				pView->Format = static_cast<FrameExportFormat>(pSlot->Format);
+				pView->pData = GetSlotData(m_Memory, i);
+				pView->DataSize = pSlot->DataSize;
+				pView->DamageRectCount = min(pSlot->DamageRectCount, FRAME_EXPORT_MAX_DAMAGE_RECTS);
+				pView->pDamageRects = pView->DamageRectCount > 0 ? pSlot->DamageRects : nullptr;
+				pView->SlotIndex = i;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Release(const FRAME_EXPORT_VIEW &view)
+	{
+		if (m_Memory.GetData() && view.pData && view.SlotIndex < GetRingHeader(m_Memory)->SlotCount) {
+			GetSlotHeader(m_Memory, view.SlotIndex)->Owner.fetch_sub(1, memory_order_release);
+		}
+	}
+
+private:
+	static bool TryHold(FRAME_EXPORT_SLOT_HEADER *pSlot)
+	{
+		uint32_t owner = pSlot->Owner.load(memory_order_relaxed);
+		while (!(owner & FRAME_EXPORT_WRITER_FLAG)) {
+			if (pSlot->Owner.compare_exchange_weak(owner, owner + 1, memory_order_acquire, memory_order_relaxed)) {
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+FrameExportReader::FrameExportReader() :
+	m_Impl(make_unique<Impl>())
+{
+}
+
+FrameExportReader::~FrameExportReader()
+{
+}
+
+bool FrameExportReader::Open(const std::wstring &name)
+{
+	return m_Impl->Open(name);
+}
+
+bool FrameExportReader::TryAcquireLatest(uint64_t afterSequence, FRAME_EXPORT_VIEW *pView)
+{
+	return m_Impl->TryAcquireLatest(afterSequence, pView);
+}
+
+void FrameExportReader::Release(const FRAME_EXPORT_VIEW &view)
+{
+	m_Impl->Release(view);
+}
+
+void FrameExportReader::Close()
+{
+	m_Impl->m_Memory.Close();
+}
+
+bool FrameExportReader::IsOpen()
+{
+	return m_Impl->m_Memory.GetData() != nullptr;
+}
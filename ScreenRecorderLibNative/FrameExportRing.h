@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+enum class FrameExportFormat : uint32_t {
+	/// <summary>32 bits per pixel, blue, green, red, alpha byte order.</summary>
+	Bgra32 = 1
+};
+
+struct FRAME_EXPORT_RECT {
+	int32_t Left;
+	int32_t Top;
+	int32_t Right;
+	int32_t Bottom;
+};
+
+/// <summary>
+/// A frame in the shared memory ring, acquired by a FrameExportReader. The pointers point directly into the shared memory,
+/// and stay valid and unchanged until the frame is released.
+/// </summary>
+struct FRAME_EXPORT_VIEW {
+	/// <summary>Increases by one for every exported frame. Gaps mean frames were overwritten before they were read.</summary>
+	uint64_t Sequence = 0;
+	/// <summary>The position of the frame in the recording, in 100 nanosecond units.</summary>
+	int64_t Timestamp = 0;
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	uint32_t Stride = 0;
+	FrameExportFormat Format = FrameExportFormat::Bgra32;
+	const uint8_t *pData = nullptr;
+	uint32_t DataSize = 0;
+	/// <summary>The areas that changed since the previous exported frame. No rects means the whole frame may have changed.</summary>
+	const FRAME_EXPORT_RECT *pDamageRects = nullptr;
+	uint32_t DamageRectCount = 0;
+	uint32_t SlotIndex = 0;
+};
+
+struct FRAME_EXPORT_STATS {
+	uint64_t WrittenFrames = 0;
+	/// <summary>Frames not exported because every slot was held by readers, or because the frame did not fit in a slot.</summary>
+	uint64_t DroppedFrames = 0;
+};
+
+/// <summary>
+/// Writes frames to a named shared memory ring, so other processes can read them without copying. See FrameExportLayout.h for the memory layout and protocol.
+/// There must be only one writer per ring. Each frame overwrites the oldest slot that is not held by a reader.
+/// </summary>
+class FrameExportWriter
+{
+public:
+	FrameExportWriter();
+	~FrameExportWriter();
+	/// <summary>
+	/// Creates the ring, or opens it if it exists with the same slot count and size, e.g. from a previous recording that a reader still has open.
+	/// </summary>
+	/// <param name="name">The name of the shared memory. On Windows this is the name of a file mapping, e.g. Local\MyRecorderFrames.</param>
+	/// <param name="slotCount">The number of frames in the ring.</param>
+	/// <param name="maxFrameBytes">The max size in bytes of a frame with tightly packed rows.</param>
+	/// <returns>false if the ring could not be created, or exists with a different layout.</returns>
+	bool Create(const std::wstring &name, uint32_t slotCount, uint32_t maxFrameBytes);
+	/// <summary>
+	/// Copies a frame into the oldest free slot and publishes it. Rows are packed tightly, without the padding of the source stride.
+	/// </summary>
+	/// <param name="pDamageRects">Optional changed areas. If there are more than fit in a slot, they are merged into their bounding rect.</param>
+	/// <returns>false if the frame was dropped.</returns>
+	bool Write(int64_t timestamp, uint32_t width, uint32_t height, uint32_t stride, FrameExportFormat format, const uint8_t *pData, const FRAME_EXPORT_RECT *pDamageRects = nullptr, uint32_t damageRectCount = 0);
+	FRAME_EXPORT_STATS GetStats();
+	void Close();
+	bool IsOpen();
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_Impl;
+};
+
+/// <summary>
+/// Reads frames from a shared memory ring created by a FrameExportWriter, usually in another process.
+/// A held frame is never overwritten, so readers should release frames quickly, or the writer runs out of slots and drops frames.
+/// </summary>
+class FrameExportReader
+{
+public:
+	FrameExportReader();
+	~FrameExportReader();
+	bool Open(const std::wstring &name);
+	/// <summary>
+	/// Acquires the newest frame, if it is newer than the given sequence number. Must be followed by a call to Release.
+	/// </summary>
+	/// <param name="afterSequence">The sequence of the last frame the caller has seen, or 0 for any frame.</param>
+	/// <returns>false if there is no newer frame.</returns>
+	bool TryAcquireLatest(uint64_t afterSequence, FRAME_EXPORT_VIEW *pView);
+	void Release(const FRAME_EXPORT_VIEW &view);
+	void Close();
+	bool IsOpen();
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_Impl;
+};
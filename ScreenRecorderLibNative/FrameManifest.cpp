@@ -0,0 +1,136 @@
+#include "FrameManifest.h"
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+
+static size_t GetFileNameOffset(const std::wstring &path)
+{
+	size_t separator = path.find_last_of(L"\\/");
+	return separator == std::wstring::npos ? 0 : separator + 1;
+}
+
+static std::string ToUtf8(const std::wstring &value)
+{
+	std::string utf8;
+	utf8.reserve(value.size());
+	for (size_t i = 0; i < value.size(); i++) {
+		uint32_t codePoint = static_cast<uint32_t>(value[i]);
+		if (sizeof(wchar_t) == 2 && codePoint >= 0xD800 && codePoint < 0xDC00 && i + 1 < value.size()) {
+			uint32_t low = static_cast<uint32_t>(value[i + 1]);
+			if (low >= 0xDC00 && low < 0xE000) {
+				codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+				i++;
+			}
+		}
+		if (codePoint < 0x80) {
+			utf8 += static_cast<char>(codePoint);
+		}
+		else if (codePoint < 0x800) {
+			utf8 += static_cast<char>(0xC0 | (codePoint >> 6));
+			utf8 += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		else if (codePoint < 0x10000) {
+			utf8 += static_cast<char>(0xE0 | (codePoint >> 12));
+			utf8 += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+			utf8 += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		else {
+			utf8 += static_cast<char>(0xF0 | (codePoint >> 18));
+			utf8 += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+			utf8 += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+			utf8 += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+	}
+	return utf8;
+}
+
+FrameManifest::~FrameManifest()
+{
+	CloseSidecar();
+}
+
+bool FrameManifest::OpenSidecar(const std::wstring &path)
+{
+	CloseSidecar();
+#ifdef _WIN32
+	if (_wfopen_s(&m_Sidecar, path.c_str(), L"wb") != 0) {
+		m_Sidecar = nullptr;
+	}
+#else
+	m_Sidecar = fopen(ToUtf8(path).c_str(), "wb");
+#endif
+	if (!m_Sidecar) {
+		return false;
+	}
+	m_SidecarDirectory = path.substr(0, GetFileNameOffset(path));
+	m_IsSidecarFailed = false;
+	return true;
+}
+
+bool FrameManifest::CloseSidecar()
+{
+	if (!m_Sidecar) {
+		return !m_IsSidecarFailed;
+	}
+	if (fclose(m_Sidecar) != 0) {
+		m_IsSidecarFailed = true;
+	}
+	m_Sidecar = nullptr;
+	return !m_IsSidecarFailed;
+}
+
+void FrameManifest::Append(const std::wstring &path, int delayMillis)
+{
+	size_t nameOffset = GetFileNameOffset(path);
+	m_Entries.push_back(ENTRY{ InternDirectory(path.substr(0, nameOffset)), path.substr(nameOffset), delayMillis });
+	if (m_Sidecar) {
+		WriteSidecarEntry(path, delayMillis);
+	}
+}
+
+void FrameManifest::Clear()
+{
+	m_Entries.clear();
+	m_Directories.clear();
+}
+
+std::wstring FrameManifest::GetPath(size_t index) const
+{
+	const ENTRY &entry = m_Entries[index];
+	return m_Directories[entry.DirectoryIndex] + entry.Name;
+}
+
+void FrameManifest::ForEach(const std::function<void(const std::wstring &path, int delayMillis)> &func) const
+{
+	std::wstring path;
+	for (const ENTRY &entry : m_Entries) {
+		path.assign(m_Directories[entry.DirectoryIndex]).append(entry.Name);
+		func(path, entry.Delay);
+	}
+}
+
+size_t FrameManifest::InternDirectory(const std::wstring &directory)
+{
+	//Nearly every entry is in the directory of the previous one, so check that before searching.
+	if (!m_Entries.empty() && m_Directories[m_Entries.back().DirectoryIndex] == directory) {
+		return m_Entries.back().DirectoryIndex;
+	}
+	auto existing = find(m_Directories.begin(), m_Directories.end(), directory);
+	if (existing != m_Directories.end()) {
+		return static_cast<size_t>(existing - m_Directories.begin());
+	}
+	m_Directories.push_back(directory);
+	return m_Directories.size() - 1;
+}
+
+void FrameManifest::WriteSidecarEntry(const std::wstring &path, int delayMillis)
+{
+	//Entries in the directory of the sidecar are written relative to it, so the folder can be moved as a whole.
+	bool isInSidecarDirectory = path.size() > m_SidecarDirectory.size() && path.compare(0, m_SidecarDirectory.size(), m_SidecarDirectory) == 0;
+	std::string line = std::to_string(delayMillis) + '\t' + ToUtf8(isInSidecarDirectory ? path.substr(m_SidecarDirectory.size()) : path) + '\n';
+	//Flushed per entry, so readers and a crashed recording see every frame that was written.
+	if (fwrite(line.data(), 1, line.size(), m_Sidecar) != line.size() || fflush(m_Sidecar) != 0) {
+		m_IsSidecarFailed = true;
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// The paths and delays of the frames of a slideshow, or the paths and durations of the files of a segmented recording, in the order they were written.
+/// Entries are only ever appended, so a day long slideshow costs one vector push per frame instead of the map inserts of a keyed container.
+/// The directory of each path is stored once, as all frames of a recording normally share it.
+/// Entries can also be streamed to a sidecar file as they are appended, so the manifest survives a crash and can be read while the recording runs.
+/// Not thread safe. Writers must serialize appends, and readers must only read once the writer is done.
+/// </summary>
+class FrameManifest
+{
+public:
+	FrameManifest() = default;
+	FrameManifest(const FrameManifest &) = delete;
+	FrameManifest &operator=(const FrameManifest &) = delete;
+	~FrameManifest();
+
+	/// <summary>
+	/// Creates the sidecar file, and writes all entries appended from now on to it. Each line holds the delay in milliseconds and the file name relative to the sidecar, separated by a tab, in UTF-8.
+	/// </summary>
+	/// <returns>false if the file could not be created.</returns>
+	bool OpenSidecar(const std::wstring &path);
+	/// <summary>
+	/// Flushes and closes the sidecar file, if any.
+	/// </summary>
+	/// <returns>false if any entry could not be written to it.</returns>
+	bool CloseSidecar();
+	void Append(const std::wstring &path, int delayMillis);
+	void Clear();
+
+	size_t Size() const { return m_Entries.size(); }
+	bool IsEmpty() const { return m_Entries.empty(); }
+	std::wstring GetPath(size_t index) const;
+	int GetDelay(size_t index) const { return m_Entries[index].Delay; }
+	/// <summary>
+	/// Calls the function with the full path and delay of each entry, in order.
+	/// </summary>
+	void ForEach(const std::function<void(const std::wstring &path, int delayMillis)> &func) const;
+private:
+	struct ENTRY {
+		//Index in m_Directories.
+		size_t DirectoryIndex;
+		//File name, without the directory.
+		std::wstring Name;
+		int Delay;
+	};
+	//Directories of the entries, including the trailing separator.
+	std::vector<std::wstring> m_Directories;
+	std::vector<ENTRY> m_Entries;
+	FILE *m_Sidecar = nullptr;
+	std::wstring m_SidecarDirectory;
+	bool m_IsSidecarFailed = false;
+
+	size_t InternDirectory(const std::wstring &directory);
+	void WriteSidecarEntry(const std::wstring &path, int delayMillis);
+};
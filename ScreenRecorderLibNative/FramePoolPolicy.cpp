@@ -0,0 +1,77 @@
+#include "FramePoolPolicy.h"
+#include <algorithm>
+
+using namespace std;
+
+FRAME_POOL_STATE CreateFramePoolState(const FRAME_POOL_LAYOUT &layout)
+{
+	FRAME_POOL_STATE state{};
+	state.Layout = layout;
+	return state;
+}
+
+FRAME_POOL_STATE GetNextFramePoolState(const FRAME_POOL_STATE &state, const FRAME_POOL_FRAME &frame)
+{
+	FRAME_POOL_STATE next = state;
+	//A single long hold, like a frame waiting out a stall of the capture loop, raises the estimate at once and then decays over a few dozen frames.
+	next.HoldTime = max(frame.HoldTime, state.HoldTime - state.HoldTime / 16);
+	if (state.HasFrame && frame.PresentTime > state.LastPresentTime) {
+		int64_t interval = frame.PresentTime - state.LastPresentTime;
+		//Sources only present frames when their content changes, so the shortest recent interval is what the pool must keep up with.
+		next.FrameInterval = state.FrameInterval > 0 ? min(interval, state.FrameInterval + state.FrameInterval / 16) : interval;
+	}
+	next.LastPresentTime = max(frame.PresentTime, state.LastPresentTime);
+	next.HasFrame = true;
+
+	//Every frame presented while one is held needs a buffer of its own, with a quarter of the hold time to spare.
+	int32_t bufferCount = state.Layout.BufferCount;
+	if (next.FrameInterval > 0) {
+		int64_t heldFrames = (next.HoldTime + next.HoldTime / 4) / next.FrameInterval;
+		bufferCount = static_cast<int32_t>(clamp<int64_t>(1 + heldFrames, FRAME_POOL_MIN_BUFFERS, FRAME_POOL_MAX_BUFFERS));
+	}
+	if (frame.ContentWidth <= 0 || frame.ContentHeight <= 0) {
+		//Minimized windows have no content, and keep the pool they had.
+		return next;
+	}
+
+	bool isTooSmall = frame.ContentWidth > state.Layout.Width
+		|| frame.ContentHeight > state.Layout.Height
+		|| bufferCount > state.Layout.BufferCount;
+	bool isTooLarge = frame.ContentWidth < state.Layout.Width / 2
+		|| frame.ContentHeight < state.Layout.Height / 2
+		|| bufferCount < state.Layout.BufferCount;
+	if (isTooLarge && !isTooSmall) {
+		if (!state.IsShrinkable) {
+			next.IsShrinkable = true;
+			next.ShrinkableSince = frame.PresentTime;
+		}
+		if (frame.PresentTime - next.ShrinkableSince < FRAME_POOL_SHRINK_DELAY) {
+			return next;
+		}
+	}
+	else if (!isTooSmall) {
+		next.IsShrinkable = false;
+		return next;
+	}
+
+	//The pool is recreated anyway, so every dimension that is outside the band between half the pool and the whole pool is resized along with the one that caused it.
+	auto getDimension = [](int32_t contentDimension, int32_t poolDimension) {
+		if (contentDimension > poolDimension || contentDimension < poolDimension / 2) {
+			return GetFramePoolDimension(contentDimension);
+		}
+		return poolDimension;
+	};
+	next.Layout.Width = getDimension(frame.ContentWidth, state.Layout.Width);
+	next.Layout.Height = getDimension(frame.ContentHeight, state.Layout.Height);
+	next.Layout.BufferCount = bufferCount;
+	next.IsShrinkable = false;
+	return next;
+}
+
+int32_t GetFramePoolDimension(int32_t contentDimension)
+{
+	int64_t dimension = max(contentDimension, 1);
+	dimension += dimension / 4;
+	dimension = (dimension + FRAME_POOL_SIZE_ALIGNMENT - 1) / FRAME_POOL_SIZE_ALIGNMENT * FRAME_POOL_SIZE_ALIGNMENT;
+	return static_cast<int32_t>(min<int64_t>(dimension, max(contentDimension, FRAME_POOL_MAX_DIMENSION)));
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstdint>
+
+//Decides the size and buffer count of the Windows Graphics Capture frame pool, from the size of the captured content and how long frames are held.
+//Like TimerSchedule.h, it doesn't depend on any platform API, so it can be tested against recorded resize traces on any platform.
+//
+//Recreating the frame pool discards the frames in it, so the pool grows by at least a quarter when the content outgrows it, and only shrinks after the content
+//has used less than half of it for a while. Dragging the border of a window then recreates the pool a few times, instead of on every step of the drag.
+//Times are in 100 nanosecond units.
+
+//The shortest time the content must be less than half the frame pool, or need fewer buffers, before the pool is recreated smaller.
+static const int64_t FRAME_POOL_SHRINK_DELAY = 20000000;
+static const int32_t FRAME_POOL_MIN_BUFFERS = 1;
+static const int32_t FRAME_POOL_MAX_BUFFERS = 3;
+//Frame pool sizes are rounded up to this, so small changes in the content size fall within the pool.
+static const int32_t FRAME_POOL_SIZE_ALIGNMENT = 32;
+//The largest size of a Direct3D 11 texture.
+static const int32_t FRAME_POOL_MAX_DIMENSION = 16384;
+
+struct FRAME_POOL_LAYOUT {
+	int32_t Width = 0;
+	int32_t Height = 0;
+	int32_t BufferCount = 0;
+};
+
+inline bool operator==(const FRAME_POOL_LAYOUT &a, const FRAME_POOL_LAYOUT &b)
+{
+	return a.Width == b.Width && a.Height == b.Height && a.BufferCount == b.BufferCount;
+}
+
+inline bool operator!=(const FRAME_POOL_LAYOUT &a, const FRAME_POOL_LAYOUT &b)
+{
+	return !(a == b);
+}
+
+struct FRAME_POOL_FRAME {
+	int32_t ContentWidth = 0;
+	int32_t ContentHeight = 0;
+	/// <summary>The time the frame was presented.</summary>
+	int64_t PresentTime = 0;
+	/// <summary>The time from the frame being presented until it was returned to the pool. The pool needs another buffer for every frame presented in that time.</summary>
+	int64_t HoldTime = 0;
+};
+
+struct FRAME_POOL_STATE {
+	FRAME_POOL_LAYOUT Layout;
+	/// <summary>The longest recent hold time, which decays by a sixteenth with every frame.</summary>
+	int64_t HoldTime = 0;
+	/// <summary>The shortest recent time between frames, which grows by a sixteenth with every frame. 0 until the second frame.</summary>
+	int64_t FrameInterval = 0;
+	int64_t LastPresentTime = 0;
+	bool HasFrame = false;
+	/// <summary>Set while the content is less than half the frame pool, or needs fewer buffers than it has.</summary>
+	bool IsShrinkable = false;
+	int64_t ShrinkableSince = 0;
+};
+
+struct FRAME_POOL_STATS {
+	/// <summary>The number of times the frame pool was recreated, for a new size or buffer count.</summary>
+	uint64_t Recreations = 0;
+	/// <summary>Changes in content size that arrived in a frame pool that already fit them, so it didn't need to be recreated.</summary>
+	uint64_t AbsorbedResizes = 0;
+	/// <summary>Frames that arrived in the frame pool.</summary>
+	uint64_t ArrivedFrames = 0;
+	/// <summary>Frames that were taken from the frame pool and drawn.</summary>
+	uint64_t DeliveredFrames = 0;
+	/// <summary>Frames that were taken from the frame pool and skipped, because a newer frame was already waiting.</summary>
+	uint64_t StaleFrames = 0;
+	/// <summary>Frames that were never drawn, because they were discarded when the frame pool was recreated or had outgrown it.</summary>
+	uint64_t DroppedFrames = 0;
+	/// <summary>The longest time a frame was held, from being presented until it was returned to the pool.</summary>
+	int64_t MaxHoldTime = 0;
+};
+
+/// <summary>
+/// Returns the state of a frame pool that was just created with the given layout.
+/// </summary>
+FRAME_POOL_STATE CreateFramePoolState(const FRAME_POOL_LAYOUT &layout);
+/// <summary>
+/// Returns the state of the frame pool after the given frame. If the layout of the returned state differs from the layout of state, the pool must be
+/// recreated with it before the next frame. The content of the frame doesn't fit in the pool if it is larger than the layout of state.
+/// </summary>
+FRAME_POOL_STATE GetNextFramePoolState(const FRAME_POOL_STATE &state, const FRAME_POOL_FRAME &frame);
+/// <summary>
+/// Returns the frame pool dimension for content of the given size, with a quarter added for it to grow into.
+/// </summary>
+int32_t GetFramePoolDimension(int32_t contentDimension);
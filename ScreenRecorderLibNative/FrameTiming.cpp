@@ -0,0 +1,65 @@
+#include "FrameTiming.h"
+#include <algorithm>
+
+using namespace std;
+
+FrameTiming::FrameTiming(int64_t maxPresentationAge) :
+	m_MaxPresentationAge(max<int64_t>(maxPresentationAge, 0)),
+	m_LastMediaTime(0),
+	m_AcquisitionJitter{},
+	m_SampleJitter{},
+	m_Stats{}
+{
+}
+
+int64_t FrameTiming::GetSampleTime(std::optional<int64_t> presentationTime, int64_t acquisitionTime, int64_t mediaTime, int64_t previousSampleTime)
+{
+	m_Stats.Frames++;
+	int64_t sampleTime = mediaTime;
+	if (presentationTime.has_value()) {
+		//Content presented after the acquisition belongs to the next frame, which only happens if the clocks are read in a different order, so it is timed at the acquisition.
+		int64_t age = max<int64_t>(0, acquisitionTime - presentationTime.value());
+		//Timed by acquisition, a frame is written as soon as it is acquired, and starts where the previous one ended, at the acquisition before it.
+		//Frames without new content repeat the previous one, so they don't change what the recording shows and are not measured.
+		int64_t presentationMediaTime = mediaTime - age;
+		m_AcquisitionJitter.Add(m_LastMediaTime - presentationMediaTime, &m_Stats.TotalAcquisitionJitter, &m_Stats.JitterSamples);
+		if (age > m_MaxPresentationAge) {
+			m_Stats.LateFrames++;
+			age = m_MaxPresentationAge;
+		}
+		if (mediaTime - age > previousSampleTime) {
+			sampleTime = mediaTime - age;
+			m_Stats.PresentationTimedFrames++;
+			m_Stats.TotalPresentationAge += age;
+			m_Stats.MaxPresentationAge = max(m_Stats.MaxPresentationAge, age);
+		}
+		else {
+			//The frames before already show content from after this was presented, so the best we can do is to show it from now on.
+			m_Stats.StaleFrames++;
+		}
+		uint64_t sampleJitterSamples = 0;
+		m_SampleJitter.Add(sampleTime - presentationMediaTime, &m_Stats.TotalSampleJitter, &sampleJitterSamples);
+	}
+	m_LastMediaTime = mediaTime;
+	return sampleTime;
+}
+
+FRAME_TIMING_STATS FrameTiming::GetStats() const
+{
+	return m_Stats;
+}
+
+double FrameTiming::GetAverageJitter(int64_t totalJitter, uint64_t jitterSamples)
+{
+	return jitterSamples > 0 ? (double)totalJitter / jitterSamples : 0;
+}
+
+void FrameTiming::JITTER_METER::Add(int64_t error, int64_t *pTotalJitter, uint64_t *pJitterSamples)
+{
+	if (HasError) {
+		*pTotalJitter += error > LastError ? error - LastError : LastError - error;
+		(*pJitterSamples)++;
+	}
+	LastError = error;
+	HasError = true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+
+//Times the frames of a recording by when their content was presented, instead of by when the recorder acquired them.
+//Like TimerSchedule.h, it doesn't depend on any platform API, so it can be tested on any platform with a virtual clock.
+//
+//Times are in 100 nanosecond units. Presentation and acquisition times are on the performance counter clock, as returned by GetPerformanceCounterTime,
+//and sample times are on the media clock of the recording, which stops while the recording is paused.
+
+struct FRAME_TIMING_STATS {
+	/// <summary>The number of frames that were timed.</summary>
+	uint64_t Frames = 0;
+	/// <summary>Frames that were timed by when their content was presented. The others had no new content, and were timed by when they were acquired.</summary>
+	uint64_t PresentationTimedFrames = 0;
+	/// <summary>Frames with content presented more than the max presentation age before they were acquired, which were timed at the max age instead.</summary>
+	uint64_t LateFrames = 0;
+	/// <summary>Frames with content presented before the previous frame, which were timed by when they were acquired.</summary>
+	uint64_t StaleFrames = 0;
+	/// <summary>The sum of the time between the content being presented and the frame being acquired, for the frames timed by presentation time.</summary>
+	int64_t TotalPresentationAge = 0;
+	/// <summary>The longest time between the content being presented and the frame being acquired.</summary>
+	int64_t MaxPresentationAge = 0;
+	/// <summary>The number of frames with new content whose timing error was compared to the frame with new content before.
+	/// The timing error is the time between the content being shown in the recording and it being presented.</summary>
+	uint64_t JitterSamples = 0;
+	/// <summary>The sum of the change in timing error from one frame with new content to the next, had the frames been written when they were acquired,
+	/// each starting at the acquisition of the frame before.</summary>
+	int64_t TotalAcquisitionJitter = 0;
+	/// <summary>The sum of the change in timing error from one frame with new content to the next, with the frames timed by GetSampleTime.</summary>
+	int64_t TotalSampleJitter = 0;
+};
+
+class FrameTiming
+{
+public:
+	/// <summary>
+	/// Content older than maxPresentationAge when it is acquired is timed as if it was presented maxPresentationAge before, so a stalled source
+	/// doesn't push the samples far behind the media clock. One frame duration of the output is a good value.
+	/// </summary>
+	FrameTiming(int64_t maxPresentationAge);
+	/// <summary>
+	/// Returns the media time at which a frame starts. That is the latest presentation time of its content mapped onto the media clock,
+	/// but never later than the media time it was acquired at, and always after the start of the previous frame.
+	/// The frame lasts until the next one starts, so it can only be written when the next one is acquired.
+	/// </summary>
+	/// <param name="presentationTime">The time the newest content of the frame was presented, or nullopt if the frame has no new content.</param>
+	/// <param name="acquisitionTime">The time the frame was acquired.</param>
+	/// <param name="mediaTime">The media clock at acquisitionTime.</param>
+	/// <param name="previousSampleTime">The media time at which the previous frame started.</param>
+	int64_t GetSampleTime(std::optional<int64_t> presentationTime, int64_t acquisitionTime, int64_t mediaTime, int64_t previousSampleTime);
+	FRAME_TIMING_STATS GetStats() const;
+	/// <summary>
+	/// Returns the average change in timing error from one frame to the next in 100 nanosecond units. It is 0 if the recording shows all content
+	/// with the same delay, however long that is.
+	/// </summary>
+	static double GetAverageJitter(int64_t totalJitter, uint64_t jitterSamples);
+private:
+	//Sums the change in timing error of consecutive frames.
+	struct JITTER_METER {
+		bool HasError = false;
+		int64_t LastError = 0;
+		void Add(int64_t error, int64_t *pTotalJitter, uint64_t *pJitterSamples);
+	};
+	int64_t m_MaxPresentationAge;
+	//The media time of the previous acquisition, which the previous frame would start at if timed by acquisition.
+	int64_t m_LastMediaTime;
+	JITTER_METER m_AcquisitionJitter;
+	JITTER_METER m_SampleJitter;
+	FRAME_TIMING_STATS m_Stats;
+};
@@ -911,6 +911,7 @@ HRESULT GifReader::StartCaptureLoop()
 		if (!m_FramerateTimer) {
 			m_FramerateTimer = make_unique<HighresTimer>();
 		}
+		INT64 nextFrameTime = GetPerformanceCounterTime();
 		do
 		{
 			EnterCriticalSection(&m_CriticalSection);
@@ -927,7 +928,10 @@ HRESULT GifReader::StartCaptureLoop()
 			//Update timestamp and notify that there is a new sample available
 			QueryPerformanceCounter(&m_LastSampleReceivedTimeStamp);
 			SetEvent(m_NewFrameEvent);
-			hr = m_FramerateTimer->WaitFor(MillisToHundredNanos(m_uFrameDelay));
+			//The delay is counted from when this frame was due rather than from now, so the time spent composing doesn't slow the animation down.
+			//If the reader fell more than a frame behind, it continues from now instead of catching up.
+			nextFrameTime = max(nextFrameTime + MillisToHundredNanos(m_uFrameDelay), GetPerformanceCounterTime());
+			hr = m_FramerateTimer->WaitUntil(nextFrameTime);
 			if (FAILED(hr)) {
 				LOG_ERROR(L"StartCaptureLoop wait for frame failed: hr = 0x%08x", hr);
 				return;
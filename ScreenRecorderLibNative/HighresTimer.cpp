@@ -1,32 +1,20 @@
 #include "HighresTimer.h"
+#include "Cleanup.h"
 #include "Log.h"
 
-using namespace std::chrono;
 HighresTimer::HighresTimer() :
-	m_TimerResolution(0),
 	m_TickEvent(nullptr),
 	m_StopEvent(nullptr),
 	m_EventArray{},
-	m_LastTick{},
-	m_Interval(0),
+	m_RecurringTimerId(0),
 	m_TickCount(0),
 	m_IsActive(false)
 {
-	TIMECAPS tc;
-	UINT targetResolutionMs = 1;
-	if (timeGetDevCaps(&tc, sizeof(TIMECAPS)) == TIMERR_NOERROR)
-	{
-		m_TimerResolution = min(max(tc.wPeriodMin, targetResolutionMs), tc.wPeriodMax);
-		timeBeginPeriod(m_TimerResolution);
-	}
-	//CREATE_WAITABLE_TIMER_HIGH_RESOLUTION is an undocumented flag introduced in Windows 10 1803.
-	//CreateWaitableTimerEx returns NULL if not available.
-	m_TickEvent = CreateWaitableTimerEx(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
-	if (m_TickEvent == NULL) {
-		m_TickEvent = CreateWaitableTimer(NULL, false, NULL);
-	}
+	InitializeCriticalSection(&m_CriticalSection);
+	m_TimingService = TimingService::Acquire();
+	//Auto reset, as a synchronization waitable timer, so each tick releases one wait.
+	m_TickEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 	m_StopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
-	HANDLE eventArray[2]{ m_StopEvent ,m_TickEvent };
 
 	m_EventArray[0] = m_StopEvent;
 	m_EventArray[1] = m_TickEvent;
@@ -34,39 +22,40 @@ HighresTimer::HighresTimer() :
 
 HighresTimer::~HighresTimer()
 {
-	if (m_TimerResolution > 0) {
-		timeEndPeriod(m_TimerResolution);
+	EnterCriticalSection(&m_CriticalSection);
+	if (m_RecurringTimerId) {
+		m_TimingService->RemoveTimer(m_RecurringTimerId);
+		m_RecurringTimerId = 0;
 	}
+	LeaveCriticalSection(&m_CriticalSection);
+	DeleteCriticalSection(&m_CriticalSection);
 	CloseHandle(m_TickEvent);
 	CloseHandle(m_StopEvent);
 }
 
-HRESULT HighresTimer::StartRecurringTimer(INT64 msInterval)
+HRESULT HighresTimer::StartRecurringTimer(INT64 interval100Nanos)
 {
 	if (NULL == m_TickEvent) {
 		DWORD dwErr = GetLastError();
-		LOG_ERROR(L"CreateWaitableTimer failed: last error = %u", dwErr);
+		LOG_ERROR(L"CreateEvent failed: last error = %u", dwErr);
 		return HRESULT_FROM_WIN32(dwErr);
 	}
-
-	m_Interval = msInterval;
+	if (interval100Nanos <= 0) {
+		LOG_ERROR(L"Invalid timer interval: %lld", interval100Nanos);
+		return E_INVALIDARG;
+	}
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"StartRecurringTimer");
+	if (m_RecurringTimerId) {
+		m_TimingService->RemoveTimer(m_RecurringTimerId);
+	}
 	ResetEvent(m_TickEvent);
 	ResetEvent(m_StopEvent);
 
-	m_LastTick = std::chrono::steady_clock::now();
-
-	LARGE_INTEGER liFirstFire;
-	liFirstFire.QuadPart = -0; // negative means relative time
-	BOOL bOK = SetWaitableTimer(
-		m_TickEvent,
-		&liFirstFire,
-		static_cast<LONG>(msInterval),
-		NULL, NULL, FALSE
-	);
-	if (!bOK) {
-		DWORD dwErr = GetLastError();
-		LOG_ERROR(L"SetWaitableTimer failed on OnReadSample: last error = %u", dwErr);
-		return HRESULT_FROM_WIN32(dwErr);
+	m_RecurringTimerId = m_TimingService->AddTimer(m_TickEvent, GetPerformanceCounterTime(), interval100Nanos);
+	if (!m_RecurringTimerId) {
+		LOG_ERROR(L"Failed to schedule recurring timer");
+		return E_FAIL;
 	}
 	m_IsActive = true;
 	return S_OK;
@@ -75,14 +64,19 @@ HRESULT HighresTimer::StartRecurringTimer(INT64 msInterval)
 HRESULT HighresTimer::StopTimer(bool waitForCompletion)
 {
 	SetEvent(m_StopEvent);
-	if (waitForCompletion && m_IsActive) {
-		if (WaitForSingleObject(m_TickEvent, INFINITE) != WAIT_OBJECT_0) {
-			LOG_ERROR("Failed to wait for timer tick");
-			return E_FAIL;
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"StopTimer");
+	if (m_RecurringTimerId) {
+		INT64 dueTime;
+		if (waitForCompletion && m_IsActive && m_TimingService->GetDueTime(m_RecurringTimerId, &dueTime)) {
+			//Let the pending tick complete. The wait is bounded, as another thread waiting for the tick may take it first.
+			DWORD waitMillis = (DWORD)HundredNanosToMillis(max(0LL, dueTime - GetPerformanceCounterTime())) + 100;
+			WaitForSingleObject(m_TickEvent, waitMillis);
 		}
+		m_TimingService->RemoveTimer(m_RecurringTimerId);
+		m_RecurringTimerId = 0;
 	}
 	m_IsActive = false;
-	CancelWaitableTimer(m_TickEvent);
 	LOG_DEBUG("Stopped HighresTimer");
 	return S_OK;
 }
@@ -94,42 +88,43 @@ HRESULT HighresTimer::WaitForNextTick()
 		LOG_TRACE("HighresTimer was canceled");
 		return E_FAIL;
 	}
-
-	m_LastTick = std::chrono::steady_clock::now();
 	m_TickCount++;
 	return S_OK;
 }
 
 HRESULT HighresTimer::WaitFor(INT64 interval100Nanos)
 {
-	LARGE_INTEGER liFirstFire;
-	liFirstFire.QuadPart = -interval100Nanos; // negative means relative time
-	BOOL bOK = SetWaitableTimer(
-		m_TickEvent,
-		&liFirstFire,
-		0,
-		NULL, NULL, FALSE
-	);
-	if (!bOK) {
-		LOG_ERROR(L"HighresTimer::WaitFor failed setting timer");
+	return WaitUntil(GetPerformanceCounterTime() + interval100Nanos);
+}
+
+HRESULT HighresTimer::WaitUntil(INT64 dueTime100Nanos)
+{
+	ResetEvent(m_TickEvent);
+	TimerId timerId = m_TimingService->AddTimer(m_TickEvent, dueTime100Nanos, 0);
+	if (!timerId) {
+		LOG_ERROR(L"HighresTimer::WaitUntil failed setting timer");
 		return E_FAIL;
 	}
 	m_IsActive = true;
 	//WAIT_OBJECT_0 means the first handle in the array, the stop event, signaled the stop, so exit.
 	if (WaitForMultipleObjects(ARRAYSIZE(m_EventArray), m_EventArray, FALSE, INFINITE) == WAIT_OBJECT_0) {
 		LOG_TRACE("HighresTimer was canceled");
+		m_TimingService->RemoveTimer(timerId);
 		m_IsActive = false;
 		return E_FAIL;
 	}
 	m_IsActive = false;
-	m_LastTick = std::chrono::steady_clock::now();
 	m_TickCount++;
 	return S_OK;
 }
 
 double HighresTimer::GetMillisUntilNextTick()
 {
-	if (m_TickCount == 0)
+	INT64 dueTime;
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"GetMillisUntilNextTick");
+	if (!m_RecurringTimerId || !m_TimingService->GetDueTime(m_RecurringTimerId, &dueTime)) {
 		return 0;
-	return max(0, (m_Interval - std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_LastTick).count()));
+	}
+	return max(0, HundredNanosToMillisDouble(dueTime - GetPerformanceCounterTime()));
 }
\ No newline at end of file
@@ -1,24 +1,34 @@
 #pragma once
 #include "CommonTypes.h"
 #include "Util.h"
+#include "TimingService.h"
+//A timer that a thread can wait on. The ticks are scheduled on the shared TimingService, so timers don't raise the system timer resolution or own a waitable timer each.
 class HighresTimer
 {
 public:
 	HighresTimer();
 	~HighresTimer();
 	inline HANDLE GetTickEvent() { return m_TickEvent; }
-	HRESULT StartRecurringTimer(INT64 msInterval);
+	/// <summary>
+	/// Ticks now and every interval after it. Each tick is due one interval after the previous one was due, so the ticks don't drift.
+	/// </summary>
+	HRESULT StartRecurringTimer(INT64 interval100Nanos);
 	HRESULT StopTimer(bool waitForCompletion);
 	HRESULT WaitForNextTick();
 	HRESULT WaitFor(INT64 interval100Nanos);
+	/// <summary>
+	/// Waits until the performance counter time in 100 nanosecond units, as returned by GetPerformanceCounterTime, or until the timer is stopped.
+	/// </summary>
+	HRESULT WaitUntil(INT64 dueTime100Nanos);
 	double GetMillisUntilNextTick();
 	inline INT64 GetTickCount() { return m_TickCount; }
 private:
 	bool m_IsActive;
 	INT64 m_TickCount;
-	std::chrono::steady_clock::time_point m_LastTick;
-	INT64 m_Interval;
-	UINT m_TimerResolution;
+	std::shared_ptr<TimingService> m_TimingService;
+	CRITICAL_SECTION m_CriticalSection;
+	//The recurring timer on the timing service, or 0 if it is not started.
+	TimerId m_RecurringTimerId;
 	HANDLE m_TickEvent;
 	HANDLE m_StopEvent;
 	HANDLE m_EventArray[2];
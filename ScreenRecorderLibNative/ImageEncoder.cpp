@@ -0,0 +1,1176 @@
+#include "ImageEncoder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define IMAGE_ENCODER_SSE2
+#endif
+
+using namespace std;
+
+namespace {
+	bool IsValidBitmap(const IMAGE_BITMAP &bitmap)
+	{
+		return bitmap.pData
+			&& bitmap.Width > 0
+			&& bitmap.Height > 0
+			&& bitmap.Stride >= bitmap.Width * 4;
+	}
+
+	inline uint32_t Load32(const uint8_t *p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	inline uint64_t Load64(const uint8_t *p)
+	{
+		uint64_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	void AppendBigEndian32(vector<uint8_t> &output, uint32_t value)
+	{
+		output.push_back(static_cast<uint8_t>(value >> 24));
+		output.push_back(static_cast<uint8_t>(value >> 16));
+		output.push_back(static_cast<uint8_t>(value >> 8));
+		output.push_back(static_cast<uint8_t>(value));
+	}
+
+	void AppendBigEndian16(vector<uint8_t> &output, uint32_t value)
+	{
+		output.push_back(static_cast<uint8_t>(value >> 8));
+		output.push_back(static_cast<uint8_t>(value));
+	}
+
+	/// <summary>
+	/// Converts a row of the bitmap to packed 24 bit RGB.
+	/// </summary>
+	void ConvertRowToRgb(const IMAGE_BITMAP &bitmap, uint32_t y, uint8_t *pRgb)
+	{
+		const uint8_t *pSrc = bitmap.pData + static_cast<size_t>(y) * bitmap.Stride;
+		const int red = bitmap.Layout == ImagePixelLayout::Bgra32 ? 2 : 0;
+		const int blue = 2 - red;
+		for (uint32_t x = 0; x < bitmap.Width; x++) {
+			pRgb[0] = pSrc[red];
+			pRgb[1] = pSrc[1];
+			pRgb[2] = pSrc[blue];
+			pSrc += 4;
+			pRgb += 3;
+		}
+	}
+
+	//Lengths and distances of the deflate format, RFC 1951 section 3.2.5.
+	const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	//The order the code length code lengths are written in.
+	const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	const int LITERAL_LENGTH_SYMBOLS = 286;
+	const int DISTANCE_SYMBOLS = 30;
+	const int CODE_LENGTH_SYMBOLS = 19;
+	const int END_OF_BLOCK = 256;
+	const int MIN_MATCH = 4;
+	const int MAX_MATCH = 258;
+	const uint32_t WINDOW_SIZE = 32768;
+	const int HASH_BITS = 16;
+	const size_t MAX_BLOCK_TOKENS = 1 << 16;
+	//A token is a literal byte, or a match with MATCH_FLAG set, the length minus 3 in bits 16-23 and the distance minus 1 in bits 0-15.
+	const uint32_t MATCH_FLAG = 0x80000000;
+
+	/// <summary>
+	/// Maps match lengths and distances to their deflate symbols.
+	/// </summary>
+	struct SYMBOL_TABLES {
+		uint8_t LengthSymbol[256];
+		uint8_t DistanceSymbol[512];
+		uint8_t LargeDistanceSymbol[256];
+
+		SYMBOL_TABLES()
+		{
+			for (int length = 3, symbol = 0; length <= MAX_MATCH; length++) {
+				while (symbol < 28 && LENGTH_BASE[symbol + 1] <= length) {
+					symbol++;
+				}
+				LengthSymbol[length - 3] = static_cast<uint8_t>(symbol);
+			}
+			for (int distance = 1, symbol = 0; distance <= static_cast<int>(WINDOW_SIZE); distance++) {
+				while (symbol < 29 && DISTANCE_BASE[symbol + 1] <= distance) {
+					symbol++;
+				}
+				if (distance <= 512) {
+					DistanceSymbol[distance - 1] = static_cast<uint8_t>(symbol);
+				}
+				else {
+					LargeDistanceSymbol[(distance - 1) >> 7] = static_cast<uint8_t>(symbol);
+				}
+			}
+		}
+
+		inline int GetDistanceSymbol(uint32_t distanceMinusOne) const
+		{
+			return distanceMinusOne < 512 ? DistanceSymbol[distanceMinusOne] : LargeDistanceSymbol[distanceMinusOne >> 7];
+		}
+	};
+
+	const SYMBOL_TABLES &GetSymbolTables()
+	{
+		static const SYMBOL_TABLES tables;
+		return tables;
+	}
+
+	/// <summary>
+	/// Computes length limited Huffman code lengths for the given symbol frequencies.
+	/// </summary>
+	void BuildCodeLengths(const uint32_t *pFrequencies, int symbolCount, int maxLength, uint8_t *pLengths)
+	{
+		memset(pLengths, 0, symbolCount);
+		vector<int> symbols;
+		for (int i = 0; i < symbolCount; i++) {
+			if (pFrequencies[i] > 0) {
+				symbols.push_back(i);
+			}
+		}
+		if (symbols.empty()) {
+			return;
+		}
+		if (symbols.size() == 1) {
+			//A code needs two symbols to be complete, so give the lone symbol a partner.
+			pLengths[symbols[0]] = 1;
+			pLengths[symbols[0] == 0 ? 1 : 0] = 1;
+			return;
+		}
+		stable_sort(symbols.begin(), symbols.end(), [pFrequencies](int a, int b) { return pFrequencies[a] < pFrequencies[b]; });
+
+		//Build the Huffman tree with the two queue method. Leaves are the sorted symbols, internal nodes are created in increasing weight order.
+		const size_t leafCount = symbols.size();
+		vector<uint64_t> weights(leafCount * 2 - 1);
+		vector<size_t> parents(leafCount * 2 - 1, 0);
+		for (size_t i = 0; i < leafCount; i++) {
+			weights[i] = pFrequencies[symbols[i]];
+		}
+		size_t nextLeaf = 0;
+		size_t nextNode = leafCount;
+		for (size_t node = leafCount; node < leafCount * 2 - 1; node++) {
+			size_t children[2];
+			for (size_t &child : children) {
+				if (nextLeaf < leafCount && (nextNode >= node || weights[nextLeaf] <= weights[nextNode])) {
+					child = nextLeaf++;
+				}
+				else {
+					child = nextNode++;
+				}
+			}
+			weights[node] = weights[children[0]] + weights[children[1]];
+			parents[children[0]] = node;
+			parents[children[1]] = node;
+		}
+		vector<int> depths(leafCount * 2 - 1, 0);
+		for (size_t node = leafCount * 2 - 2; node-- > 0;) {
+			depths[node] = depths[parents[node]] + 1;
+		}
+
+		//Move leaves deeper than the max length up to it, then lengthen the shortest codes that still can be until the code is valid again.
+		vector<uint32_t> lengthCounts(maxLength + 1, 0);
+		for (size_t i = 0; i < leafCount; i++) {
+			lengthCounts[min(depths[i], maxLength)]++;
+		}
+		uint64_t total = 0;
+		for (int length = 1; length <= maxLength; length++) {
+			total += static_cast<uint64_t>(lengthCounts[length]) << (maxLength - length);
+		}
+		while (total > (1ULL << maxLength)) {
+			lengthCounts[maxLength]--;
+			for (int length = maxLength - 1; length > 0; length--) {
+				if (lengthCounts[length] > 0) {
+					lengthCounts[length]--;
+					lengthCounts[length + 1] += 2;
+					break;
+				}
+			}
+			total--;
+		}
+
+		//The least frequent symbols get the longest codes.
+		size_t leaf = 0;
+		for (int length = maxLength; length > 0; length--) {
+			for (uint32_t i = 0; i < lengthCounts[length]; i++) {
+				pLengths[symbols[leaf++]] = static_cast<uint8_t>(length);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Assigns canonical Huffman codes for the code lengths, bit reversed as deflate writes codes starting with the most significant bit.
+	/// </summary>
+	void BuildCodes(const uint8_t *pLengths, int symbolCount, uint16_t *pCodes)
+	{
+		uint16_t lengthCounts[16] = {};
+		for (int i = 0; i < symbolCount; i++) {
+			lengthCounts[pLengths[i]]++;
+		}
+		lengthCounts[0] = 0;
+		uint16_t nextCodes[16] = {};
+		uint16_t code = 0;
+		for (int length = 1; length < 16; length++) {
+			code = static_cast<uint16_t>((code + lengthCounts[length - 1]) << 1);
+			nextCodes[length] = code;
+		}
+		for (int i = 0; i < symbolCount; i++) {
+			int length = pLengths[i];
+			if (length == 0) {
+				pCodes[i] = 0;
+				continue;
+			}
+			uint16_t value = nextCodes[length]++;
+			uint16_t reversed = 0;
+			for (int bit = 0; bit < length; bit++) {
+				reversed = static_cast<uint16_t>((reversed << 1) | ((value >> bit) & 1));
+			}
+			pCodes[i] = reversed;
+		}
+	}
+
+	/// <summary>
+	/// Writes bits starting with the least significant bit, as deflate does.
+	/// </summary>
+	class DeflateBitWriter
+	{
+	public:
+		DeflateBitWriter(vector<uint8_t> &output) : m_Output(output) {}
+
+		inline void Write(uint32_t bits, int count)
+		{
+			m_Buffer |= static_cast<uint64_t>(bits) << m_Count;
+			m_Count += count;
+			if (m_Count >= 32) {
+				uint8_t bytes[4] = { static_cast<uint8_t>(m_Buffer), static_cast<uint8_t>(m_Buffer >> 8), static_cast<uint8_t>(m_Buffer >> 16), static_cast<uint8_t>(m_Buffer >> 24) };
+				m_Output.insert(m_Output.end(), bytes, bytes + 4);
+				m_Buffer >>= 32;
+				m_Count -= 32;
+			}
+		}
+
+		void FlushToByte()
+		{
+			while (m_Count > 0) {
+				m_Output.push_back(static_cast<uint8_t>(m_Buffer));
+				m_Buffer >>= 8;
+				m_Count = max(m_Count - 8, 0);
+			}
+			m_Buffer = 0;
+		}
+	private:
+		vector<uint8_t> &m_Output;
+		uint64_t m_Buffer = 0;
+		int m_Count = 0;
+	};
+
+	/// <summary>
+	/// A fast single pass deflate compressor. Matches are found with a single entry hash table and taken greedily, and each block gets its own Huffman code.
+	/// </summary>
+	class FastDeflate
+	{
+	public:
+		FastDeflate(vector<uint8_t> &output) :
+			m_Writer(output),
+			m_HashTable(1 << HASH_BITS, 0)
+		{
+			m_Tokens.reserve(MAX_BLOCK_TOKENS + 1);
+		}
+
+		void Compress(const uint8_t *pData, size_t size)
+		{
+			size_t pos = 0;
+			//Skip ahead faster in data that does not compress, like photos.
+			uint32_t misses = 0;
+			while (pos + MIN_MATCH <= size) {
+				uint32_t value = Load32(pData + pos);
+				uint32_t hash = (value * 2654435761u) >> (32 - HASH_BITS);
+				uint32_t candidate = m_HashTable[hash];
+				m_HashTable[hash] = static_cast<uint32_t>(pos + 1);
+				if (candidate > 0
+					&& pos - (candidate - 1) <= WINDOW_SIZE
+					&& Load32(pData + candidate - 1) == value) {
+					const uint8_t *pMatch = pData + candidate - 1;
+					size_t maxLength = min<size_t>(MAX_MATCH, size - pos);
+					size_t length = MIN_MATCH;
+					while (length + 8 <= maxLength && Load64(pMatch + length) == Load64(pData + pos + length)) {
+						length += 8;
+					}
+					while (length < maxLength && pMatch[length] == pData[pos + length]) {
+						length++;
+					}
+					AddToken(MATCH_FLAG | static_cast<uint32_t>((length - 3) << 16) | static_cast<uint32_t>(pData + pos - pMatch - 1));
+					pos += length;
+					misses = 0;
+				}
+				else {
+					size_t step = 1 + (misses++ >> 6);
+					for (size_t end = min(pos + step, size); pos < end; pos++) {
+						AddToken(pData[pos]);
+					}
+				}
+			}
+			while (pos < size) {
+				AddToken(pData[pos++]);
+			}
+			WriteBlock(true);
+			m_Writer.FlushToByte();
+		}
+	private:
+		DeflateBitWriter m_Writer;
+		vector<uint32_t> m_HashTable;
+		vector<uint32_t> m_Tokens;
+
+		inline void AddToken(uint32_t token)
+		{
+			m_Tokens.push_back(token);
+			if (m_Tokens.size() >= MAX_BLOCK_TOKENS) {
+				WriteBlock(false);
+			}
+		}
+
+		void WriteBlock(bool isFinal)
+		{
+			const SYMBOL_TABLES &tables = GetSymbolTables();
+			uint32_t literalFrequencies[LITERAL_LENGTH_SYMBOLS] = {};
+			uint32_t distanceFrequencies[DISTANCE_SYMBOLS] = {};
+			for (uint32_t token : m_Tokens) {
+				if (token & MATCH_FLAG) {
+					literalFrequencies[257 + tables.LengthSymbol[(token >> 16) & 0xFF]]++;
+					distanceFrequencies[tables.GetDistanceSymbol(token & 0xFFFF)]++;
+				}
+				else {
+					literalFrequencies[token]++;
+				}
+			}
+			literalFrequencies[END_OF_BLOCK]++;
+
+			uint8_t literalLengths[LITERAL_LENGTH_SYMBOLS];
+			uint8_t distanceLengths[DISTANCE_SYMBOLS];
+			BuildCodeLengths(literalFrequencies, LITERAL_LENGTH_SYMBOLS, 15, literalLengths);
+			BuildCodeLengths(distanceFrequencies, DISTANCE_SYMBOLS, 15, distanceLengths);
+			uint16_t literalCodes[LITERAL_LENGTH_SYMBOLS];
+			uint16_t distanceCodes[DISTANCE_SYMBOLS];
+			BuildCodes(literalLengths, LITERAL_LENGTH_SYMBOLS, literalCodes);
+			BuildCodes(distanceLengths, DISTANCE_SYMBOLS, distanceCodes);
+
+			int literalCount = LITERAL_LENGTH_SYMBOLS;
+			while (literalCount > 257 && literalLengths[literalCount - 1] == 0) {
+				literalCount--;
+			}
+			int distanceCount = DISTANCE_SYMBOLS;
+			while (distanceCount > 1 && distanceLengths[distanceCount - 1] == 0) {
+				distanceCount--;
+			}
+
+			//Run length encode the code lengths of both alphabets as one sequence, RFC 1951 section 3.2.7.
+			vector<uint8_t> allLengths(literalLengths, literalLengths + literalCount);
+			allLengths.insert(allLengths.end(), distanceLengths, distanceLengths + distanceCount);
+			//Each entry is a code length symbol in the low byte, and the value of its extra bits in the high byte.
+			vector<uint16_t> lengthSymbols;
+			uint32_t lengthFrequencies[CODE_LENGTH_SYMBOLS] = {};
+			for (size_t i = 0; i < allLengths.size();) {
+				uint8_t length = allLengths[i];
+				size_t run = 1;
+				while (i + run < allLengths.size() && allLengths[i + run] == length) {
+					run++;
+				}
+				i += run;
+				if (length == 0) {
+					while (run >= 11) {
+						size_t count = min<size_t>(run, 138);
+						lengthSymbols.push_back(static_cast<uint16_t>(18 | ((count - 11) << 8)));
+						lengthFrequencies[18]++;
+						run -= count;
+					}
+					if (run >= 3) {
+						lengthSymbols.push_back(static_cast<uint16_t>(17 | ((run - 3) << 8)));
+						lengthFrequencies[17]++;
+						run = 0;
+					}
+				}
+				else {
+					lengthSymbols.push_back(length);
+					lengthFrequencies[length]++;
+					run--;
+					while (run >= 3) {
+						size_t count = min<size_t>(run, 6);
+						lengthSymbols.push_back(static_cast<uint16_t>(16 | ((count - 3) << 8)));
+						lengthFrequencies[16]++;
+						run -= count;
+					}
+				}
+				for (; run > 0; run--) {
+					lengthSymbols.push_back(length);
+					lengthFrequencies[length]++;
+				}
+			}
+			uint8_t codeLengthLengths[CODE_LENGTH_SYMBOLS];
+			uint16_t codeLengthCodes[CODE_LENGTH_SYMBOLS];
+			BuildCodeLengths(lengthFrequencies, CODE_LENGTH_SYMBOLS, 7, codeLengthLengths);
+			BuildCodes(codeLengthLengths, CODE_LENGTH_SYMBOLS, codeLengthCodes);
+			int codeLengthCount = CODE_LENGTH_SYMBOLS;
+			while (codeLengthCount > 4 && codeLengthLengths[CODE_LENGTH_ORDER[codeLengthCount - 1]] == 0) {
+				codeLengthCount--;
+			}
+
+			//Block header with dynamic Huffman codes.
+			m_Writer.Write(isFinal ? 1 : 0, 1);
+			m_Writer.Write(2, 2);
+			m_Writer.Write(literalCount - 257, 5);
+			m_Writer.Write(distanceCount - 1, 5);
+			m_Writer.Write(codeLengthCount - 4, 4);
+			for (int i = 0; i < codeLengthCount; i++) {
+				m_Writer.Write(codeLengthLengths[CODE_LENGTH_ORDER[i]], 3);
+			}
+			for (uint16_t entry : lengthSymbols) {
+				int symbol = entry & 0xFF;
+				m_Writer.Write(codeLengthCodes[symbol], codeLengthLengths[symbol]);
+				if (symbol == 16) {
+					m_Writer.Write(entry >> 8, 2);
+				}
+				else if (symbol == 17) {
+					m_Writer.Write(entry >> 8, 3);
+				}
+				else if (symbol == 18) {
+					m_Writer.Write(entry >> 8, 7);
+				}
+			}
+
+			for (uint32_t token : m_Tokens) {
+				if (token & MATCH_FLAG) {
+					uint32_t lengthMinusThree = (token >> 16) & 0xFF;
+					int lengthSymbol = tables.LengthSymbol[lengthMinusThree];
+					m_Writer.Write(literalCodes[257 + lengthSymbol], literalLengths[257 + lengthSymbol]);
+					if (LENGTH_EXTRA[lengthSymbol] > 0) {
+						m_Writer.Write(lengthMinusThree + 3 - LENGTH_BASE[lengthSymbol], LENGTH_EXTRA[lengthSymbol]);
+					}
+					uint32_t distanceMinusOne = token & 0xFFFF;
+					int distanceSymbol = tables.GetDistanceSymbol(distanceMinusOne);
+					m_Writer.Write(distanceCodes[distanceSymbol], distanceLengths[distanceSymbol]);
+					if (DISTANCE_EXTRA[distanceSymbol] > 0) {
+						m_Writer.Write(distanceMinusOne + 1 - DISTANCE_BASE[distanceSymbol], DISTANCE_EXTRA[distanceSymbol]);
+					}
+				}
+				else {
+					m_Writer.Write(literalCodes[token], literalLengths[token]);
+				}
+			}
+			m_Writer.Write(literalCodes[END_OF_BLOCK], literalLengths[END_OF_BLOCK]);
+			m_Tokens.clear();
+		}
+	};
+
+	uint32_t Adler32(const uint8_t *pData, size_t size)
+	{
+		//The largest number of bytes that can be summed before the sums must be reduced to avoid overflow.
+		const size_t NMAX = 5552;
+		uint32_t a = 1;
+		uint32_t b = 0;
+		while (size > 0) {
+			size_t count = min(size, NMAX);
+			size -= count;
+			for (; count > 0; count--) {
+				a += *pData++;
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+		return (b << 16) | a;
+	}
+
+	uint32_t Crc32(const uint8_t *pData, size_t size, uint32_t crc = 0)
+	{
+		struct CRC_TABLE {
+			uint32_t Values[256];
+			CRC_TABLE()
+			{
+				for (uint32_t i = 0; i < 256; i++) {
+					uint32_t value = i;
+					for (int bit = 0; bit < 8; bit++) {
+						value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+					}
+					Values[i] = value;
+				}
+			}
+		};
+		static const CRC_TABLE table;
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++) {
+			crc = table.Values[(crc ^ pData[i]) & 0xFF] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	void AppendPngChunk(vector<uint8_t> &output, const char *type, const uint8_t *pData, size_t size)
+	{
+		AppendBigEndian32(output, static_cast<uint32_t>(size));
+		size_t start = output.size();
+		output.insert(output.end(), type, type + 4);
+		if (size > 0) {
+			output.insert(output.end(), pData, pData + size);
+		}
+		AppendBigEndian32(output, Crc32(output.data() + start, output.size() - start));
+	}
+
+	const uint8_t JPEG_ZIGZAG[64] = {
+		0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+		12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+		35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+		58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+
+	//The example quantization tables of the JPEG standard, Annex K, in natural order.
+	const uint8_t JPEG_LUMINANCE_QUANTIZATION[64] = {
+		16, 11, 10, 16, 24, 40, 51, 61,
+		12, 12, 14, 19, 26, 58, 60, 55,
+		14, 13, 16, 24, 40, 57, 69, 56,
+		14, 17, 22, 29, 51, 87, 80, 62,
+		18, 22, 37, 56, 68, 109, 103, 77,
+		24, 35, 55, 64, 81, 104, 113, 92,
+		49, 64, 78, 87, 103, 121, 120, 101,
+		72, 92, 95, 98, 112, 100, 103, 99 };
+	const uint8_t JPEG_CHROMINANCE_QUANTIZATION[64] = {
+		17, 18, 24, 47, 99, 99, 99, 99,
+		18, 21, 26, 66, 99, 99, 99, 99,
+		24, 26, 56, 99, 99, 99, 99, 99,
+		47, 66, 99, 99, 99, 99, 99, 99,
+		99, 99, 99, 99, 99, 99, 99, 99,
+		99, 99, 99, 99, 99, 99, 99, 99,
+		99, 99, 99, 99, 99, 99, 99, 99,
+		99, 99, 99, 99, 99, 99, 99, 99 };
+
+	//The example Huffman tables of the JPEG standard, Annex K. Each is the number of codes of length 1 to 16, followed by the symbols.
+	const uint8_t JPEG_DC_LUMINANCE_BITS[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+	const uint8_t JPEG_DC_LUMINANCE_VALUES[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+	const uint8_t JPEG_DC_CHROMINANCE_BITS[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+	const uint8_t JPEG_DC_CHROMINANCE_VALUES[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+	const uint8_t JPEG_AC_LUMINANCE_BITS[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+	const uint8_t JPEG_AC_LUMINANCE_VALUES[162] = {
+		0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+		0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+		0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+		0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+		0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+		0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+		0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+		0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+		0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+		0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+		0xf9, 0xfa };
+	const uint8_t JPEG_AC_CHROMINANCE_BITS[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+	const uint8_t JPEG_AC_CHROMINANCE_VALUES[162] = {
+		0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+		0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+		0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+		0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+		0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+		0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+		0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+		0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+		0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+		0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+		0xf9, 0xfa };
+
+	//Scale factors of the AAN DCT, which are folded into the quantization.
+	const float AAN_SCALE[8] = { 1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f };
+
+	struct JPEG_HUFFMAN_TABLE {
+		uint16_t Codes[256] = {};
+		uint8_t Lengths[256] = {};
+
+		JPEG_HUFFMAN_TABLE(const uint8_t *pBits, const uint8_t *pValues)
+		{
+			uint16_t code = 0;
+			int index = 0;
+			for (int length = 1; length <= 16; length++) {
+				for (int i = 0; i < pBits[length - 1]; i++) {
+					Codes[pValues[index]] = code++;
+					Lengths[pValues[index]] = static_cast<uint8_t>(length);
+					index++;
+				}
+				code <<= 1;
+			}
+		}
+	};
+
+	/// <summary>
+	/// Writes JPEG entropy coded data, starting with the most significant bit, and stuffs a zero byte after every 0xFF byte.
+	/// </summary>
+	class JpegBitWriter
+	{
+	public:
+		JpegBitWriter(vector<uint8_t> &output) : m_Output(output) {}
+
+		inline void Write(uint32_t bits, int count)
+		{
+			m_Buffer = (m_Buffer << count) | (bits & ((1u << count) - 1));
+			m_Count += count;
+			while (m_Count >= 8) {
+				uint8_t byte = static_cast<uint8_t>(m_Buffer >> (m_Count - 8));
+				m_Output.push_back(byte);
+				if (byte == 0xFF) {
+					m_Output.push_back(0);
+				}
+				m_Count -= 8;
+			}
+		}
+
+		void Flush()
+		{
+			//Pad the last byte with ones.
+			if (m_Count > 0) {
+				Write(0x7F, 8 - m_Count);
+			}
+		}
+	private:
+		vector<uint8_t> &m_Output;
+		uint64_t m_Buffer = 0;
+		int m_Count = 0;
+	};
+
+	/// <summary>
+	/// One dimensional AAN forward DCT of 8 values, from the IJG jfdctflt.c. T is float, or a vector of floats to transform several rows at once.
+	/// </summary>
+	template <typename T>
+	inline void ForwardDct8(T *d)
+	{
+		T tmp0 = d[0] + d[7];
+		T tmp7 = d[0] - d[7];
+		T tmp1 = d[1] + d[6];
+		T tmp6 = d[1] - d[6];
+		T tmp2 = d[2] + d[5];
+		T tmp5 = d[2] - d[5];
+		T tmp3 = d[3] + d[4];
+		T tmp4 = d[3] - d[4];
+
+		T tmp10 = tmp0 + tmp3;
+		T tmp13 = tmp0 - tmp3;
+		T tmp11 = tmp1 + tmp2;
+		T tmp12 = tmp1 - tmp2;
+		d[0] = tmp10 + tmp11;
+		d[4] = tmp10 - tmp11;
+		T z1 = (tmp12 + tmp13) * 0.707106781f;
+		d[2] = tmp13 + z1;
+		d[6] = tmp13 - z1;
+
+		tmp10 = tmp4 + tmp5;
+		tmp11 = tmp5 + tmp6;
+		tmp12 = tmp6 + tmp7;
+		T z5 = (tmp10 - tmp12) * 0.382683433f;
+		T z2 = tmp10 * 0.541196100f + z5;
+		T z4 = tmp12 * 1.306562965f + z5;
+		T z3 = tmp11 * 0.707106781f;
+		T z11 = tmp7 + z3;
+		T z13 = tmp7 - z3;
+		d[5] = z13 + z2;
+		d[3] = z13 - z2;
+		d[1] = z11 + z4;
+		d[7] = z11 - z4;
+	}
+
+#ifdef IMAGE_ENCODER_SSE2
+	struct Float4 {
+		__m128 Value;
+		Float4() = default;
+		Float4(__m128 value) : Value(value) {}
+		inline Float4 operator+(const Float4 &other) const { return _mm_add_ps(Value, other.Value); }
+		inline Float4 operator-(const Float4 &other) const { return _mm_sub_ps(Value, other.Value); }
+		inline Float4 operator*(float factor) const { return _mm_mul_ps(Value, _mm_set1_ps(factor)); }
+	};
+
+	/// <summary>
+	/// Transposes an 8x8 block held as the left and right 4 columns of each row.
+	/// </summary>
+	inline void Transpose8x8(Float4 *pLeft, Float4 *pRight)
+	{
+		_MM_TRANSPOSE4_PS(pLeft[0].Value, pLeft[1].Value, pLeft[2].Value, pLeft[3].Value);
+		_MM_TRANSPOSE4_PS(pRight[0].Value, pRight[1].Value, pRight[2].Value, pRight[3].Value);
+		_MM_TRANSPOSE4_PS(pLeft[4].Value, pLeft[5].Value, pLeft[6].Value, pLeft[7].Value);
+		_MM_TRANSPOSE4_PS(pRight[4].Value, pRight[5].Value, pRight[6].Value, pRight[7].Value);
+		for (int i = 0; i < 4; i++) {
+			swap(pRight[i], pLeft[i + 4]);
+		}
+	}
+#endif
+
+	/// <summary>
+	/// Two dimensional forward DCT of an 8x8 block in natural order, scaled by the AAN factors.
+	/// </summary>
+	void ForwardDct(float *pBlock)
+	{
+#ifdef IMAGE_ENCODER_SSE2
+		//Transform 4 columns at a time, transpose, and transform the columns of the transposed block, which are the rows.
+		Float4 left[8];
+		Float4 right[8];
+		for (int row = 0; row < 8; row++) {
+			left[row] = _mm_loadu_ps(pBlock + row * 8);
+			right[row] = _mm_loadu_ps(pBlock + row * 8 + 4);
+		}
+		ForwardDct8(left);
+		ForwardDct8(right);
+		Transpose8x8(left, right);
+		ForwardDct8(left);
+		ForwardDct8(right);
+		Transpose8x8(left, right);
+		for (int row = 0; row < 8; row++) {
+			_mm_storeu_ps(pBlock + row * 8, left[row].Value);
+			_mm_storeu_ps(pBlock + row * 8 + 4, right[row].Value);
+		}
+#else
+		for (int row = 0; row < 8; row++) {
+			ForwardDct8(pBlock + row * 8);
+		}
+		float column[8];
+		for (int col = 0; col < 8; col++) {
+			for (int row = 0; row < 8; row++) {
+				column[row] = pBlock[row * 8 + col];
+			}
+			ForwardDct8(column);
+			for (int row = 0; row < 8; row++) {
+				pBlock[row * 8 + col] = column[row];
+			}
+		}
+#endif
+	}
+
+	/// <summary>
+	/// Quantizes a transformed block and returns the coefficients in zigzag order.
+	/// </summary>
+	void Quantize(const float *pBlock, const float *pDivisors, int *pCoefficients)
+	{
+		int natural[64];
+#ifdef IMAGE_ENCODER_SSE2
+		for (int i = 0; i < 64; i += 4) {
+			__m128 scaled = _mm_mul_ps(_mm_loadu_ps(pBlock + i), _mm_loadu_ps(pDivisors + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(natural + i), _mm_cvtps_epi32(scaled));
+		}
+#else
+		for (int i = 0; i < 64; i++) {
+			natural[i] = static_cast<int>(lrintf(pBlock[i] * pDivisors[i]));
+		}
+#endif
+		for (int i = 0; i < 64; i++) {
+			pCoefficients[i] = natural[JPEG_ZIGZAG[i]];
+		}
+	}
+
+	/// <summary>
+	/// Converts a row of pixels to level shifted Y, Cb and Cr samples.
+	/// </summary>
+	void ConvertRowToYCbCr(const IMAGE_BITMAP &bitmap, uint32_t y, float *pY, float *pCb, float *pCr)
+	{
+		const uint8_t *pSrc = bitmap.pData + static_cast<size_t>(y) * bitmap.Stride;
+		const int redShift = bitmap.Layout == ImagePixelLayout::Bgra32 ? 16 : 0;
+		const int blueShift = 16 - redShift;
+		uint32_t x = 0;
+#ifdef IMAGE_ENCODER_SSE2
+		const __m128i byteMask = _mm_set1_epi32(0xFF);
+		const __m128i redShiftCount = _mm_cvtsi32_si128(redShift);
+		const __m128i blueShiftCount = _mm_cvtsi32_si128(blueShift);
+		for (; x + 4 <= bitmap.Width; x += 4) {
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc + x * 4));
+			__m128 r = _mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(pixels, redShiftCount), byteMask));
+			__m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 8), byteMask));
+			__m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(pixels, blueShiftCount), byteMask));
+			__m128 luma = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.299f)), _mm_mul_ps(g, _mm_set1_ps(0.587f))), _mm_mul_ps(b, _mm_set1_ps(0.114f)));
+			_mm_storeu_ps(pY + x, _mm_sub_ps(luma, _mm_set1_ps(128.0f)));
+			_mm_storeu_ps(pCb + x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(-0.168736f)), _mm_mul_ps(g, _mm_set1_ps(-0.331264f))), _mm_mul_ps(b, _mm_set1_ps(0.5f))));
+			_mm_storeu_ps(pCr + x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.5f)), _mm_mul_ps(g, _mm_set1_ps(-0.418688f))), _mm_mul_ps(b, _mm_set1_ps(-0.081312f))));
+		}
+#endif
+		for (; x < bitmap.Width; x++) {
+			uint32_t pixel = Load32(pSrc + x * 4);
+			float r = static_cast<float>((pixel >> redShift) & 0xFF);
+			float g = static_cast<float>((pixel >> 8) & 0xFF);
+			float b = static_cast<float>((pixel >> blueShift) & 0xFF);
+			pY[x] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+			pCb[x] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+			pCr[x] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+		}
+	}
+
+	class JpegEncoder
+	{
+	public:
+		JpegEncoder(int quality) :
+			m_DcLuminance(JPEG_DC_LUMINANCE_BITS, JPEG_DC_LUMINANCE_VALUES),
+			m_AcLuminance(JPEG_AC_LUMINANCE_BITS, JPEG_AC_LUMINANCE_VALUES),
+			m_DcChrominance(JPEG_DC_CHROMINANCE_BITS, JPEG_DC_CHROMINANCE_VALUES),
+			m_AcChrominance(JPEG_AC_CHROMINANCE_BITS, JPEG_AC_CHROMINANCE_VALUES)
+		{
+			quality = clamp(quality, 1, 100);
+			int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+			for (int i = 0; i < 64; i++) {
+				m_LuminanceTable[i] = static_cast<uint8_t>(clamp((JPEG_LUMINANCE_QUANTIZATION[i] * scale + 50) / 100, 1, 255));
+				m_ChrominanceTable[i] = static_cast<uint8_t>(clamp((JPEG_CHROMINANCE_QUANTIZATION[i] * scale + 50) / 100, 1, 255));
+			}
+			for (int row = 0; row < 8; row++) {
+				for (int col = 0; col < 8; col++) {
+					int i = row * 8 + col;
+					float scaleFactor = AAN_SCALE[row] * AAN_SCALE[col] * 8.0f;
+					m_LuminanceDivisors[i] = 1.0f / (m_LuminanceTable[i] * scaleFactor);
+					m_ChrominanceDivisors[i] = 1.0f / (m_ChrominanceTable[i] * scaleFactor);
+				}
+			}
+		}
+
+		void Encode(const IMAGE_BITMAP &bitmap, vector<uint8_t> &output)
+		{
+			WriteHeaders(bitmap.Width, bitmap.Height, output);
+
+			//Samples of one row of 16x16 pixel MCUs, padded to whole MCUs by repeating the last column and row.
+			const uint32_t paddedWidth = (bitmap.Width + 15) & ~15u;
+			vector<float> yPlane(paddedWidth * 16);
+			vector<float> cbPlane(paddedWidth * 16);
+			vector<float> crPlane(paddedWidth * 16);
+			vector<float> cbSubsampled(paddedWidth / 2 * 8);
+			vector<float> crSubsampled(paddedWidth / 2 * 8);
+
+			JpegBitWriter writer(output);
+			int previousDc[3] = {};
+			float block[64];
+			int coefficients[64];
+			for (uint32_t mcuY = 0; mcuY < bitmap.Height; mcuY += 16) {
+				for (uint32_t row = 0; row < 16; row++) {
+					uint32_t sourceRow = min(mcuY + row, bitmap.Height - 1);
+					float *pY = yPlane.data() + row * paddedWidth;
+					float *pCb = cbPlane.data() + row * paddedWidth;
+					float *pCr = crPlane.data() + row * paddedWidth;
+					ConvertRowToYCbCr(bitmap, sourceRow, pY, pCb, pCr);
+					for (uint32_t x = bitmap.Width; x < paddedWidth; x++) {
+						pY[x] = pY[bitmap.Width - 1];
+						pCb[x] = pCb[bitmap.Width - 1];
+						pCr[x] = pCr[bitmap.Width - 1];
+					}
+				}
+				Subsample(cbPlane.data(), paddedWidth, cbSubsampled.data());
+				Subsample(crPlane.data(), paddedWidth, crSubsampled.data());
+
+				for (uint32_t mcuX = 0; mcuX < paddedWidth; mcuX += 16) {
+					for (uint32_t blockIndex = 0; blockIndex < 4; blockIndex++) {
+						uint32_t blockX = mcuX + (blockIndex & 1) * 8;
+						uint32_t blockY = (blockIndex >> 1) * 8;
+						for (int row = 0; row < 8; row++) {
+							memcpy(block + row * 8, yPlane.data() + (blockY + row) * paddedWidth + blockX, 8 * sizeof(float));
+						}
+						EncodeBlock(writer, block, m_LuminanceDivisors, m_DcLuminance, m_AcLuminance, previousDc[0], coefficients);
+					}
+					const uint32_t chromaStride = paddedWidth / 2;
+					for (int row = 0; row < 8; row++) {
+						memcpy(block + row * 8, cbSubsampled.data() + row * chromaStride + mcuX / 2, 8 * sizeof(float));
+					}
+					EncodeBlock(writer, block, m_ChrominanceDivisors, m_DcChrominance, m_AcChrominance, previousDc[1], coefficients);
+					for (int row = 0; row < 8; row++) {
+						memcpy(block + row * 8, crSubsampled.data() + row * chromaStride + mcuX / 2, 8 * sizeof(float));
+					}
+					EncodeBlock(writer, block, m_ChrominanceDivisors, m_DcChrominance, m_AcChrominance, previousDc[2], coefficients);
+				}
+			}
+			writer.Flush();
+			output.push_back(0xFF);
+			output.push_back(0xD9);
+		}
+	private:
+		uint8_t m_LuminanceTable[64];
+		uint8_t m_ChrominanceTable[64];
+		float m_LuminanceDivisors[64];
+		float m_ChrominanceDivisors[64];
+		const JPEG_HUFFMAN_TABLE m_DcLuminance;
+		const JPEG_HUFFMAN_TABLE m_AcLuminance;
+		const JPEG_HUFFMAN_TABLE m_DcChrominance;
+		const JPEG_HUFFMAN_TABLE m_AcChrominance;
+
+		/// <summary>
+		/// Averages each 2x2 pixels of 16 rows of a chroma plane into 8 rows.
+		/// </summary>
+		static void Subsample(const float *pPlane, uint32_t width, float *pSubsampled)
+		{
+			for (uint32_t row = 0; row < 8; row++) {
+				const float *pTop = pPlane + row * 2 * width;
+				const float *pBottom = pTop + width;
+				float *pDest = pSubsampled + row * (width / 2);
+				uint32_t x = 0;
+#ifdef IMAGE_ENCODER_SSE2
+				const __m128 quarter = _mm_set1_ps(0.25f);
+				for (; x + 8 <= width; x += 8) {
+					__m128 sum0 = _mm_add_ps(_mm_loadu_ps(pTop + x), _mm_loadu_ps(pBottom + x));
+					__m128 sum1 = _mm_add_ps(_mm_loadu_ps(pTop + x + 4), _mm_loadu_ps(pBottom + x + 4));
+					__m128 even = _mm_shuffle_ps(sum0, sum1, _MM_SHUFFLE(2, 0, 2, 0));
+					__m128 odd = _mm_shuffle_ps(sum0, sum1, _MM_SHUFFLE(3, 1, 3, 1));
+					_mm_storeu_ps(pDest + x / 2, _mm_mul_ps(_mm_add_ps(even, odd), quarter));
+				}
+#endif
+				for (; x < width; x += 2) {
+					pDest[x / 2] = (pTop[x] + pTop[x + 1] + pBottom[x] + pBottom[x + 1]) * 0.25f;
+				}
+			}
+		}
+
+		static inline int GetBitCount(int value)
+		{
+			unsigned int magnitude = static_cast<unsigned int>(value < 0 ? -value : value);
+			int count = 0;
+			while (magnitude) {
+				count++;
+				magnitude >>= 1;
+			}
+			return count;
+		}
+
+		static void EncodeBlock(JpegBitWriter &writer, float *pBlock, const float *pDivisors, const JPEG_HUFFMAN_TABLE &dcTable, const JPEG_HUFFMAN_TABLE &acTable, int &previousDc, int *pCoefficients)
+		{
+			ForwardDct(pBlock);
+			Quantize(pBlock, pDivisors, pCoefficients);
+
+			int difference = pCoefficients[0] - previousDc;
+			previousDc = pCoefficients[0];
+			int bitCount = GetBitCount(difference);
+			writer.Write(dcTable.Codes[bitCount], dcTable.Lengths[bitCount]);
+			if (bitCount > 0) {
+				writer.Write(difference < 0 ? difference - 1 : difference, bitCount);
+			}
+
+			int zeroRun = 0;
+			for (int i = 1; i < 64; i++) {
+				int coefficient = pCoefficients[i];
+				if (coefficient == 0) {
+					zeroRun++;
+					continue;
+				}
+				while (zeroRun > 15) {
+					writer.Write(acTable.Codes[0xF0], acTable.Lengths[0xF0]);
+					zeroRun -= 16;
+				}
+				bitCount = GetBitCount(coefficient);
+				int symbol = (zeroRun << 4) | bitCount;
+				writer.Write(acTable.Codes[symbol], acTable.Lengths[symbol]);
+				writer.Write(coefficient < 0 ? coefficient - 1 : coefficient, bitCount);
+				zeroRun = 0;
+			}
+			if (zeroRun > 0) {
+				writer.Write(acTable.Codes[0x00], acTable.Lengths[0x00]);
+			}
+		}
+
+		static void WriteHuffmanTable(vector<uint8_t> &output, uint8_t classAndId, const uint8_t *pBits, const uint8_t *pValues, size_t valueCount)
+		{
+			output.push_back(classAndId);
+			output.insert(output.end(), pBits, pBits + 16);
+			output.insert(output.end(), pValues, pValues + valueCount);
+		}
+
+		void WriteHeaders(uint32_t width, uint32_t height, vector<uint8_t> &output)
+		{
+			const uint8_t startAndJfif[] = {
+				0xFF, 0xD8,
+				0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00 };
+			output.insert(output.end(), startAndJfif, startAndJfif + sizeof(startAndJfif));
+
+			output.push_back(0xFF);
+			output.push_back(0xDB);
+			AppendBigEndian16(output, 2 + 65 * 2);
+			output.push_back(0x00);
+			for (int i = 0; i < 64; i++) {
+				output.push_back(m_LuminanceTable[JPEG_ZIGZAG[i]]);
+			}
+			output.push_back(0x01);
+			for (int i = 0; i < 64; i++) {
+				output.push_back(m_ChrominanceTable[JPEG_ZIGZAG[i]]);
+			}
+
+			//Baseline frame with Y sampled 2x2 and Cb and Cr sampled 1x1.
+			const uint8_t frameComponents[] = { 3, 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 };
+			output.push_back(0xFF);
+			output.push_back(0xC0);
+			AppendBigEndian16(output, 8 + 3 * 3);
+			output.push_back(8);
+			AppendBigEndian16(output, height);
+			AppendBigEndian16(output, width);
+			output.insert(output.end(), frameComponents, frameComponents + sizeof(frameComponents));
+
+			output.push_back(0xFF);
+			output.push_back(0xC4);
+			AppendBigEndian16(output, static_cast<uint32_t>(2 + 4 * 17 + sizeof(JPEG_DC_LUMINANCE_VALUES) + sizeof(JPEG_AC_LUMINANCE_VALUES) + sizeof(JPEG_DC_CHROMINANCE_VALUES) + sizeof(JPEG_AC_CHROMINANCE_VALUES)));
+			WriteHuffmanTable(output, 0x00, JPEG_DC_LUMINANCE_BITS, JPEG_DC_LUMINANCE_VALUES, sizeof(JPEG_DC_LUMINANCE_VALUES));
+			WriteHuffmanTable(output, 0x10, JPEG_AC_LUMINANCE_BITS, JPEG_AC_LUMINANCE_VALUES, sizeof(JPEG_AC_LUMINANCE_VALUES));
+			WriteHuffmanTable(output, 0x01, JPEG_DC_CHROMINANCE_BITS, JPEG_DC_CHROMINANCE_VALUES, sizeof(JPEG_DC_CHROMINANCE_VALUES));
+			WriteHuffmanTable(output, 0x11, JPEG_AC_CHROMINANCE_BITS, JPEG_AC_CHROMINANCE_VALUES, sizeof(JPEG_AC_CHROMINANCE_VALUES));
+
+			const uint8_t scanHeader[] = { 0xFF, 0xDA, 0x00, 0x0C, 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+			output.insert(output.end(), scanHeader, scanHeader + sizeof(scanHeader));
+		}
+	};
+}
+
+void CompressZlibFast(const uint8_t *pData, size_t size, std::vector<uint8_t> &output)
+{
+	//zlib stream with a header for the fastest compression level, the deflate data and the Adler-32 checksum of the uncompressed data.
+	output.push_back(0x78);
+	output.push_back(0x01);
+	FastDeflate(output).Compress(pData, size);
+	AppendBigEndian32(output, Adler32(pData, size));
+}
+
+void WritePngChunk(std::vector<uint8_t> &output, const char *type, const uint8_t *pData, size_t size)
+{
+	AppendPngChunk(output, type, pData, size);
+}
+
+bool EncodeFastPng(const IMAGE_BITMAP &bitmap, std::vector<uint8_t> &output)
+{
+	if (!IsValidBitmap(bitmap)) {
+		return false;
+	}
+	//Every row is the Up filter type followed by the difference to the row above. The first row is compared to zeros, as the PNG format defines.
+	const size_t rowSize = static_cast<size_t>(bitmap.Width) * 3;
+	vector<uint8_t> filtered((rowSize + 1) * bitmap.Height);
+	vector<uint8_t> previousRow(rowSize, 0);
+	vector<uint8_t> currentRow(rowSize);
+	for (uint32_t y = 0; y < bitmap.Height; y++) {
+		ConvertRowToRgb(bitmap, y, currentRow.data());
+		uint8_t *pDest = filtered.data() + y * (rowSize + 1);
+		*pDest++ = 2;
+		size_t x = 0;
+#ifdef IMAGE_ENCODER_SSE2
+		for (; x + 16 <= rowSize; x += 16) {
+			__m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i *>(currentRow.data() + x));
+			__m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i *>(previousRow.data() + x));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(pDest + x), _mm_sub_epi8(current, previous));
+		}
+#endif
+		for (; x < rowSize; x++) {
+			pDest[x] = static_cast<uint8_t>(currentRow[x] - previousRow[x]);
+		}
+		swap(previousRow, currentRow);
+	}
+
+	vector<uint8_t> compressed;
+	compressed.reserve(filtered.size() / 4);
+	CompressZlibFast(filtered.data(), filtered.size(), compressed);
+
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	uint8_t header[13];
+	header[0] = static_cast<uint8_t>(bitmap.Width >> 24);
+	header[1] = static_cast<uint8_t>(bitmap.Width >> 16);
+	header[2] = static_cast<uint8_t>(bitmap.Width >> 8);
+	header[3] = static_cast<uint8_t>(bitmap.Width);
+	header[4] = static_cast<uint8_t>(bitmap.Height >> 24);
+	header[5] = static_cast<uint8_t>(bitmap.Height >> 16);
+	header[6] = static_cast<uint8_t>(bitmap.Height >> 8);
+	header[7] = static_cast<uint8_t>(bitmap.Height);
+	header[8] = 8;//Bit depth
+	header[9] = 2;//Truecolor
+	header[10] = 0;//Deflate
+	header[11] = 0;//Adaptive filtering
+	header[12] = 0;//Not interlaced
+	output.clear();
+	output.reserve(compressed.size() + 64);
+	output.insert(output.end(), signature, signature + sizeof(signature));
+	AppendPngChunk(output, "IHDR", header, sizeof(header));
+	AppendPngChunk(output, "IDAT", compressed.data(), compressed.size());
+	AppendPngChunk(output, "IEND", nullptr, 0);
+	return true;
+}
+
+bool EncodeQoi(const IMAGE_BITMAP &bitmap, std::vector<uint8_t> &output)
+{
+	if (!IsValidBitmap(bitmap)) {
+		return false;
+	}
+	const uint8_t QOI_OP_INDEX = 0x00;
+	const uint8_t QOI_OP_DIFF = 0x40;
+	const uint8_t QOI_OP_LUMA = 0x80;
+	const uint8_t QOI_OP_RUN = 0xC0;
+	const uint8_t QOI_OP_RGB = 0xFE;
+	const int QOI_MAX_RUN = 62;
+
+	output.clear();
+	output.reserve(static_cast<size_t>(bitmap.Width) * bitmap.Height + 32);
+	const char magic[] = { 'q', 'o', 'i', 'f' };
+	output.insert(output.end(), magic, magic + 4);
+	AppendBigEndian32(output, bitmap.Width);
+	AppendBigEndian32(output, bitmap.Height);
+	output.push_back(3);//Channels
+	output.push_back(0);//sRGB with linear alpha
+
+	//Pixels are kept as 0xRRGGBB. Alpha is always 255, so it is left out.
+	//The decoder starts with a transparent black index, which never matches an opaque pixel, so the index starts with a value that matches no pixel.
+	uint32_t index[64];
+	fill(begin(index), end(index), 0xFFFFFFFF);
+	uint32_t previous = 0;
+	int run = 0;
+	vector<uint8_t> rgbRow(static_cast<size_t>(bitmap.Width) * 3);
+	for (uint32_t y = 0; y < bitmap.Height; y++) {
+		ConvertRowToRgb(bitmap, y, rgbRow.data());
+		const uint8_t *pRgb = rgbRow.data();
+		for (uint32_t x = 0; x < bitmap.Width; x++, pRgb += 3) {
+			uint8_t r = pRgb[0];
+			uint8_t g = pRgb[1];
+			uint8_t b = pRgb[2];
+			uint32_t pixel = (static_cast<uint32_t>(r) << 16) | (static_cast<uint32_t>(g) << 8) | b;
+			if (pixel == previous) {
+				if (++run == QOI_MAX_RUN) {
+					output.push_back(static_cast<uint8_t>(QOI_OP_RUN | (run - 1)));
+					run = 0;
+				}
+				continue;
+			}
+			if (run > 0) {
+				output.push_back(static_cast<uint8_t>(QOI_OP_RUN | (run - 1)));
+				run = 0;
+			}
+			int hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+			if (index[hash] == pixel) {
+				output.push_back(static_cast<uint8_t>(QOI_OP_INDEX | hash));
+			}
+			else {
+				index[hash] = pixel;
+				int8_t dr = static_cast<int8_t>(r - static_cast<uint8_t>(previous >> 16));
+				int8_t dg = static_cast<int8_t>(g - static_cast<uint8_t>(previous >> 8));
+				int8_t db = static_cast<int8_t>(b - static_cast<uint8_t>(previous));
+				int8_t drg = static_cast<int8_t>(dr - dg);
+				int8_t dbg = static_cast<int8_t>(db - dg);
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+					output.push_back(static_cast<uint8_t>(QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+				}
+				else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+					output.push_back(static_cast<uint8_t>(QOI_OP_LUMA | (dg + 32)));
+					output.push_back(static_cast<uint8_t>(((drg + 8) << 4) | (dbg + 8)));
+				}
+				else {
+					output.push_back(QOI_OP_RGB);
+					output.push_back(r);
+					output.push_back(g);
+					output.push_back(b);
+				}
+			}
+			previous = pixel;
+		}
+	}
+	if (run > 0) {
+		output.push_back(static_cast<uint8_t>(QOI_OP_RUN | (run - 1)));
+	}
+	const uint8_t end[] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	output.insert(output.end(), end, end + sizeof(end));
+	return true;
+}
+
+bool EncodeFastJpeg(const IMAGE_BITMAP &bitmap, int quality, std::vector<uint8_t> &output)
+{
+	if (!IsValidBitmap(bitmap) || bitmap.Width > 65535 || bitmap.Height > 65535) {
+		return false;
+	}
+	output.clear();
+	output.reserve(static_cast<size_t>(bitmap.Width) * bitmap.Height / 4 + 1024);
+	JpegEncoder(quality).Encode(bitmap, output);
+	return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+//Built-in image encoders for snapshots and slideshow frames. They don't depend on WIC or any other platform API, so they can be tuned for screen content and benchmarked on any platform.
+//All encoders drop the alpha channel, like the WIC snapshot path, as captured screen content has no meaningful alpha.
+
+enum class ImagePixelLayout {
+	/// <summary>32 bits per pixel, blue, green, red, alpha byte order.</summary>
+	Bgra32,
+	/// <summary>32 bits per pixel, red, green, blue, alpha byte order.</summary>
+	Rgba32
+};
+
+struct IMAGE_BITMAP {
+	const uint8_t *pData = nullptr;
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	/// <summary>The number of bytes between the start of two rows.</summary>
+	uint32_t Stride = 0;
+	ImagePixelLayout Layout = ImagePixelLayout::Bgra32;
+};
+
+static const int DEFAULT_FAST_JPEG_QUALITY = 90;
+
+/// <summary>
+/// Encodes a 24 bit RGB PNG. Every row uses the Up filter, and the image data is compressed with a single pass greedy LZ77 and a dynamic Huffman code per block.
+/// This is many times faster than a default zlib or WIC PNG, and compresses screen content nearly as well, as unchanged areas become long runs of zeros.
+/// </summary>
+/// <returns>false if the bitmap is empty or invalid.</returns>
+bool EncodeFastPng(const IMAGE_BITMAP &bitmap, std::vector<uint8_t> &output);
+/// <summary>
+/// Encodes a 3 channel QOI image (https://qoiformat.org). QOI encodes in a single pass without entropy coding, so it is the fastest lossless format, at the cost of larger files than PNG.
+/// </summary>
+/// <returns>false if the bitmap is empty or invalid.</returns>
+bool EncodeQoi(const IMAGE_BITMAP &bitmap, std::vector<uint8_t> &output);
+/// <summary>
+/// Encodes a baseline JPEG with 4:2:0 chroma subsampling and the standard Huffman tables. Color conversion and the DCT use SSE2 when available.
+/// </summary>
+/// <param name="quality">1 to 100, with the same scale as libjpeg.</param>
+/// <returns>false if the bitmap is empty or invalid.</returns>
+bool EncodeFastJpeg(const IMAGE_BITMAP &bitmap, int quality, std::vector<uint8_t> &output);
+/// <summary>
+/// Compresses data to a zlib stream with the deflate compressor of EncodeFastPng.
+/// </summary>
+/// <param name="output">The stream is appended to this.</param>
+void CompressZlibFast(const uint8_t *pData, size_t size, std::vector<uint8_t> &output);
+/// <summary>
+/// Appends a PNG chunk with its length and CRC to the output.
+/// </summary>
+/// <param name="type">The 4 character chunk type.</param>
+void WritePngChunk(std::vector<uint8_t> &output, const char *type, const uint8_t *pData, size_t size);
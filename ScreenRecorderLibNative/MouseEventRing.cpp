@@ -0,0 +1,117 @@
+#include "MouseEventRing.h"
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+namespace {
+	const size_t EVENT_WORDS = sizeof(MOUSE_INPUT_EVENT) / sizeof(uint64_t);
+	static_assert(sizeof(MOUSE_INPUT_EVENT) % sizeof(uint64_t) == 0, "Events are copied as whole 64 bit words");
+
+	/// <summary>
+	/// An event in the ring. The version is odd while the event is written, and 2 * (sequence + 1) once it is published,
+	/// so a reader can tell if the event it copied was overwritten while it was copying it.
+	/// The event is stored in atomic words, so a copy that races with the writer is detected by the version instead of being undefined.
+	/// </summary>
+	struct alignas(64) EVENT_SLOT {
+		atomic<uint64_t> Version{ 0 };
+		atomic<uint64_t> Words[EVENT_WORDS]{};
+	};
+
+	uint32_t RoundUpToPowerOfTwo(uint32_t value)
+	{
+		uint32_t result = 1;
+		while (result < value && result < 0x80000000u) {
+			result <<= 1;
+		}
+		return result;
+	}
+}
+
+struct MouseEventRing::Impl {
+	explicit Impl(uint32_t capacity) :
+		Slots(capacity),
+		Mask(capacity - 1)
+	{
+	}
+	vector<EVENT_SLOT> Slots;
+	const uint64_t Mask;
+	//The sequence number of the next event to write. Only the writer changes it.
+	alignas(64) atomic<uint64_t> WriteSequence{ 0 };
+};
+
+MouseEventRing::MouseEventRing(uint32_t capacity) :
+	m_Impl(make_unique<Impl>(RoundUpToPowerOfTwo(capacity)))
+{
+}
+
+MouseEventRing::~MouseEventRing()
+{
+}
+
+void MouseEventRing::Write(const MOUSE_INPUT_EVENT &event)
+{
+	uint64_t sequence = m_Impl->WriteSequence.load(memory_order_relaxed);
+	EVENT_SLOT &slot = m_Impl->Slots[sequence & m_Impl->Mask];
+	uint64_t words[EVENT_WORDS];
+	memcpy(words, &event, sizeof(words));
+
+	slot.Version.store(2 * sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	for (size_t i = 0; i < EVENT_WORDS; i++) {
+		slot.Words[i].store(words[i], memory_order_relaxed);
+	}
+	slot.Version.store(2 * (sequence + 1), memory_order_release);
+	m_Impl->WriteSequence.store(sequence + 1, memory_order_release);
+}
+
+uint32_t MouseEventRing::Read(uint64_t *pSequence, MOUSE_INPUT_EVENT *pEvents, uint32_t maxEvents, uint64_t *pLostEvents) const
+{
+	uint64_t lostEvents = 0;
+	uint32_t count = 0;
+	uint64_t sequence = *pSequence;
+	const uint64_t capacity = m_Impl->Mask + 1;
+	uint64_t writeSequence = m_Impl->WriteSequence.load(memory_order_acquire);
+	if (sequence > writeSequence) {
+		//The sequence is from before the ring was recreated, or was never valid. Start over from the newest event.
+		sequence = writeSequence;
+	}
+	if (writeSequence - sequence > capacity) {
+		lostEvents += writeSequence - sequence - capacity;
+		sequence = writeSequence - capacity;
+	}
+	while (sequence < writeSequence && count < maxEvents) {
+		const EVENT_SLOT &slot = m_Impl->Slots[sequence & m_Impl->Mask];
+		const uint64_t expectedVersion = 2 * (sequence + 1);
+		uint64_t words[EVENT_WORDS];
+		uint64_t version = slot.Version.load(memory_order_acquire);
+		for (size_t i = 0; i < EVENT_WORDS; i++) {
+			words[i] = slot.Words[i].load(memory_order_relaxed);
+		}
+		atomic_thread_fence(memory_order_acquire);
+		if (version == expectedVersion && slot.Version.load(memory_order_relaxed) == expectedVersion) {
+			memcpy(&pEvents[count++], words, sizeof(words));
+		}
+		else {
+			//The writer lapped this reader while it was reading.
+			lostEvents++;
+		}
+		sequence++;
+	}
+	*pSequence = sequence;
+	if (pLostEvents) {
+		*pLostEvents = lostEvents;
+	}
+	return count;
+}
+
+uint64_t MouseEventRing::GetWriteSequence() const
+{
+	return m_Impl->WriteSequence.load(memory_order_acquire);
+}
+
+uint32_t MouseEventRing::GetCapacity() const
+{
+	return static_cast<uint32_t>(m_Impl->Mask + 1);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+
+//A lock free ring of timestamped mouse button and wheel events, written by the mouse hook or raw input thread and read by the frame renderer and any number of other readers.
+//Like FrameExportRing.h, it doesn't depend on any platform API, so it can be tested on any platform.
+
+enum class MouseInputEventType : uint32_t {
+	ButtonDown = 1,
+	ButtonUp = 2,
+	/// <summary>The vertical wheel was rotated by WheelDelta.</summary>
+	Wheel = 3,
+	/// <summary>The horizontal wheel was tilted by WheelDelta.</summary>
+	HorizontalWheel = 4
+};
+
+enum class MouseInputButton : uint32_t {
+	None = 0,
+	Left = 1,
+	Right = 2,
+	Middle = 3,
+	X1 = 4,
+	X2 = 5
+};
+
+struct MOUSE_INPUT_EVENT {
+	/// <summary>The time of the event in 100 nanosecond units, on the performance counter clock that frames are timed with.</summary>
+	int64_t Timestamp = 0;
+	MouseInputEventType Type = MouseInputEventType::ButtonDown;
+	/// <summary>The button that was pressed or released. None for wheel events.</summary>
+	MouseInputButton Button = MouseInputButton::None;
+	/// <summary>The position of the cursor hotspot in screen coordinates.</summary>
+	int32_t X = 0;
+	int32_t Y = 0;
+	/// <summary>The wheel rotation in multiples of 120. Positive is forward, or to the right for the horizontal wheel.</summary>
+	int32_t WheelDelta = 0;
+};
+
+/// <summary>
+/// A fixed size ring of mouse events. Writing never blocks or allocates, so it is safe to call from a low level mouse hook.
+/// There must be only one writer at a time. Readers keep their own sequence number, so several readers can read the same events independently.
+/// When the writer laps a reader, the oldest events are overwritten and reported as lost.
+/// </summary>
+class MouseEventRing
+{
+public:
+	/// <param name="capacity">The number of events in the ring, rounded up to a power of two.</param>
+	explicit MouseEventRing(uint32_t capacity = 1024);
+	~MouseEventRing();
+	/// <summary>
+	/// Publishes an event, overwriting the oldest event if the ring is full.
+	/// </summary>
+	void Write(const MOUSE_INPUT_EVENT &event);
+	/// <summary>
+	/// Copies the events from pSequence up to the newest, or until maxEvents are copied.
+	/// </summary>
+	/// <param name="pSequence">The sequence number of the next event to read. Start with GetWriteSequence() to only read new events. It is advanced past the events that were read or lost.</param>
+	/// <param name="pLostEvents">Optional. Receives the number of events that were overwritten before they could be read.</param>
+	/// <returns>The number of events copied to pEvents.</returns>
+	uint32_t Read(uint64_t *pSequence, MOUSE_INPUT_EVENT *pEvents, uint32_t maxEvents, uint64_t *pLostEvents = nullptr) const;
+	/// <summary>
+	/// Returns the sequence number the next written event will get.
+	/// </summary>
+	uint64_t GetWriteSequence() const;
+	uint32_t GetCapacity() const;
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_Impl;
+};
@@ -3,11 +3,11 @@
 #include "Log.h"
 #include "Util.h"
 #include "Cleanup.h"
-#include <concrt.h>
-#include <ppltasks.h>
+#include "CursorPixelShader.h"
+#include <algorithm>
+#include <hidusage.h>
 
 using namespace DirectX;
-using namespace Concurrency;
 using namespace std;
 
 #pragma comment(lib, "comctl32.lib")
@@ -15,50 +15,243 @@ using namespace std;
 
 #define ET_QUITLOOP WM_USER+1
 
-INT64 g_LastMouseClickDurationRemaining = 0;
-INT g_MouseClickDetectionDurationMillis = 50;
-UINT g_LastMouseClickButton = 0;
+//Shape versions are unique across all pointer infos, so a cached shape is never mistaken for a new one in another buffer.
+volatile LONG64 g_LastPointerShapeVersion = 0;
+//The ring the low level mouse hook writes to. Hook procedures have no context parameter, and only one input thread runs at a time.
+MouseEventRing *g_MouseHookEvents = nullptr;
 
+static const wchar_t *RAW_MOUSE_INPUT_WINDOW_CLASS = L"ScreenRecorderLibRawMouseInput";
 
-DWORD WINAPI MouseHookThreadProc(_In_ void *Param) {
-	HHOOK mouseHook = SetWindowsHookEx(WH_MOUSE_LL, MouseHookProc, nullptr, 0);
+struct MOUSE_INPUT_THREAD_PARAMS {
+	MouseEventRing *pEvents;
+	UINT32 DetectionMode;
+};
+
+LRESULT CALLBACK MouseHookProc(int nCode, WPARAM wParam, LPARAM lParam)
+{
+	if (nCode == HC_ACTION && g_MouseHookEvents) {
+		const MSLLHOOKSTRUCT *pHookData = reinterpret_cast<const MSLLHOOKSTRUCT *>(lParam);
+		MOUSE_INPUT_EVENT event;
+		bool isEvent = true;
+		switch (wParam)
+		{
+			case WM_LBUTTONDOWN:
+			case WM_LBUTTONUP:
+				event.Type = wParam == WM_LBUTTONDOWN ? MouseInputEventType::ButtonDown : MouseInputEventType::ButtonUp;
+				event.Button = MouseInputButton::Left;
+				break;
+			case WM_RBUTTONDOWN:
+			case WM_RBUTTONUP:
+				event.Type = wParam == WM_RBUTTONDOWN ? MouseInputEventType::ButtonDown : MouseInputEventType::ButtonUp;
+				event.Button = MouseInputButton::Right;
+				break;
+			case WM_MBUTTONDOWN:
+			case WM_MBUTTONUP:
+				event.Type = wParam == WM_MBUTTONDOWN ? MouseInputEventType::ButtonDown : MouseInputEventType::ButtonUp;
+				event.Button = MouseInputButton::Middle;
+				break;
+			case WM_XBUTTONDOWN:
+			case WM_XBUTTONUP:
+				event.Type = wParam == WM_XBUTTONDOWN ? MouseInputEventType::ButtonDown : MouseInputEventType::ButtonUp;
+				event.Button = HIWORD(pHookData->mouseData) == XBUTTON1 ? MouseInputButton::X1 : MouseInputButton::X2;
+				break;
+			case WM_MOUSEWHEEL:
+			case WM_MOUSEHWHEEL:
+				event.Type = wParam == WM_MOUSEWHEEL ? MouseInputEventType::Wheel : MouseInputEventType::HorizontalWheel;
+				event.WheelDelta = static_cast<SHORT>(HIWORD(pHookData->mouseData));
+				break;
+			default:
+				//Mouse moves are most of the hook calls, and are not recorded.
+				isEvent = false;
+				break;
+		}
+		if (isEvent) {
+			event.Timestamp = GetPerformanceCounterTime();
+			event.X = pHookData->pt.x;
+			event.Y = pHookData->pt.y;
+			g_MouseHookEvents->Write(event);
+		}
+	}
+	return CallNextHookEx(0, nCode, wParam, lParam);
+}
+
+/// <summary>
+/// Writes the button and wheel transitions of a raw mouse input report to the ring. One report can hold several transitions.
+/// </summary>
+static void WriteRawMouseEvents(_In_ MouseEventRing *pEvents, _In_ const RAWMOUSE &mouse)
+{
+	static const struct {
+		USHORT Flag;
+		MouseInputEventType Type;
+		MouseInputButton Button;
+	} ButtonFlags[] = {
+		{ RI_MOUSE_LEFT_BUTTON_DOWN, MouseInputEventType::ButtonDown, MouseInputButton::Left },
+		{ RI_MOUSE_LEFT_BUTTON_UP, MouseInputEventType::ButtonUp, MouseInputButton::Left },
+		{ RI_MOUSE_RIGHT_BUTTON_DOWN, MouseInputEventType::ButtonDown, MouseInputButton::Right },
+		{ RI_MOUSE_RIGHT_BUTTON_UP, MouseInputEventType::ButtonUp, MouseInputButton::Right },
+		{ RI_MOUSE_MIDDLE_BUTTON_DOWN, MouseInputEventType::ButtonDown, MouseInputButton::Middle },
+		{ RI_MOUSE_MIDDLE_BUTTON_UP, MouseInputEventType::ButtonUp, MouseInputButton::Middle },
+		{ RI_MOUSE_BUTTON_4_DOWN, MouseInputEventType::ButtonDown, MouseInputButton::X1 },
+		{ RI_MOUSE_BUTTON_4_UP, MouseInputEventType::ButtonUp, MouseInputButton::X1 },
+		{ RI_MOUSE_BUTTON_5_DOWN, MouseInputEventType::ButtonDown, MouseInputButton::X2 },
+		{ RI_MOUSE_BUTTON_5_UP, MouseInputEventType::ButtonUp, MouseInputButton::X2 },
+	};
+	const USHORT flags = mouse.usButtonFlags;
+	if (flags == 0) {
+		return;
+	}
+	MOUSE_INPUT_EVENT event;
+	event.Timestamp = GetPerformanceCounterTime();
+	//Raw input has no cursor position, only device movement.
+	POINT position{};
+	GetCursorPos(&position);
+	event.X = position.x;
+	event.Y = position.y;
+	for (const auto &buttonFlag : ButtonFlags) {
+		if (flags & buttonFlag.Flag) {
+			event.Type = buttonFlag.Type;
+			event.Button = buttonFlag.Button;
+			pEvents->Write(event);
+		}
+	}
+	if (flags & (RI_MOUSE_WHEEL | RI_MOUSE_HWHEEL)) {
+		event.Type = (flags & RI_MOUSE_WHEEL) ? MouseInputEventType::Wheel : MouseInputEventType::HorizontalWheel;
+		event.Button = MouseInputButton::None;
+		event.WheelDelta = static_cast<SHORT>(mouse.usButtonData);
+		pEvents->Write(event);
+	}
+}
+
+static LRESULT CALLBACK RawMouseInputWindowProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+	if (message == WM_CREATE) {
+		SetWindowLongPtr(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(reinterpret_cast<CREATESTRUCT *>(lParam)->lpCreateParams));
+	}
+	else if (message == WM_INPUT) {
+		MouseEventRing *pEvents = reinterpret_cast<MouseEventRing *>(GetWindowLongPtr(hwnd, GWLP_USERDATA));
+		RAWINPUT input;
+		UINT size = sizeof(input);
+		if (pEvents
+			&& GetRawInputData(reinterpret_cast<HRAWINPUT>(lParam), RID_INPUT, &input, &size, sizeof(RAWINPUTHEADER)) != static_cast<UINT>(-1)
+			&& input.header.dwType == RIM_TYPEMOUSE) {
+			WriteRawMouseEvents(pEvents, input.data.mouse);
+		}
+	}
+	return DefWindowProc(hwnd, message, wParam, lParam);
+}
+
+/// <summary>
+/// Creates a message only window that receives raw mouse input, also when the application is in the background.
+/// </summary>
+/// <returns>nullptr if raw mouse input could not be registered, or the application already receives raw mouse input, as only one window per process can.</returns>
+static HWND CreateRawMouseInputWindow(_In_ MouseEventRing *pEvents)
+{
+	UINT deviceCount = 0;
+	GetRegisteredRawInputDevices(nullptr, &deviceCount, sizeof(RAWINPUTDEVICE));
+	if (deviceCount > 0) {
+		std::vector<RAWINPUTDEVICE> devices(deviceCount);
+		if (GetRegisteredRawInputDevices(devices.data(), &deviceCount, sizeof(RAWINPUTDEVICE)) != static_cast<UINT>(-1)) {
+			for (UINT i = 0; i < deviceCount; i++) {
+				if (devices[i].usUsagePage == HID_USAGE_PAGE_GENERIC && devices[i].usUsage == HID_USAGE_GENERIC_MOUSE) {
+					LOG_WARN(L"The application already receives raw mouse input");
+					return nullptr;
+				}
+			}
+		}
+	}
+	HINSTANCE instance = GetModuleHandle(nullptr);
+	WNDCLASSEXW windowClass = { 0 };
+	windowClass.cbSize = sizeof(windowClass);
+	windowClass.lpfnWndProc = RawMouseInputWindowProc;
+	windowClass.hInstance = instance;
+	windowClass.lpszClassName = RAW_MOUSE_INPUT_WINDOW_CLASS;
+	if (!RegisterClassExW(&windowClass) && GetLastError() != ERROR_CLASS_ALREADY_EXISTS) {
+		LOG_ERROR(L"Failed to register raw mouse input window class: %ls", GetLastErrorStdWstr().c_str());
+		return nullptr;
+	}
+	HWND window = CreateWindowExW(0, RAW_MOUSE_INPUT_WINDOW_CLASS, L"", 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr, instance, pEvents);
+	if (!window) {
+		LOG_ERROR(L"Failed to create raw mouse input window: %ls", GetLastErrorStdWstr().c_str());
+		return nullptr;
+	}
+	RAWINPUTDEVICE device = { 0 };
+	device.usUsagePage = HID_USAGE_PAGE_GENERIC;
+	device.usUsage = HID_USAGE_GENERIC_MOUSE;
+	device.dwFlags = RIDEV_INPUTSINK;
+	device.hwndTarget = window;
+	if (!RegisterRawInputDevices(&device, 1, sizeof(device))) {
+		LOG_ERROR(L"Failed to register for raw mouse input: %ls", GetLastErrorStdWstr().c_str());
+		DestroyWindow(window);
+		return nullptr;
+	}
+	return window;
+}
+
+/// <summary>
+/// Writes mouse button and wheel events to a MouseEventRing until ET_QUITLOOP is posted to the thread.
+/// Events come from raw input, or from a low level mouse hook in MOUSE_DETECTION_MODE_HOOK or when raw input is not available.
+/// Either way the thread only wakes up for mouse input.
+/// </summary>
+DWORD WINAPI MouseInputThreadProc(_In_ void *Param) {
+	std::unique_ptr<MOUSE_INPUT_THREAD_PARAMS> pParams(static_cast<MOUSE_INPUT_THREAD_PARAMS *>(Param));
+	HWND rawInputWindow = nullptr;
+	if (pParams->DetectionMode != MOUSE_OPTIONS::MOUSE_DETECTION_MODE_HOOK) {
+		rawInputWindow = CreateRawMouseInputWindow(pParams->pEvents);
+	}
+	HHOOK mouseHook = nullptr;
+	if (!rawInputWindow) {
+		g_MouseHookEvents = pParams->pEvents;
+		mouseHook = SetWindowsHookEx(WH_MOUSE_LL, MouseHookProc, nullptr, 0);
+		if (!mouseHook) {
+			LOG_ERROR(L"Failed to set mouse click hook: %ls", GetLastErrorStdWstr().c_str());
+		}
+	}
+	LOG_INFO(L"Started mouse click detection with %ls", rawInputWindow ? L"raw input" : L"low level mouse hook");
 	MSG msg;
-	while (true) {
-		GetMessage(&msg, NULL, 0, 0);
+	while (GetMessage(&msg, NULL, 0, 0) > 0) {
 		if (msg.message == ET_QUITLOOP) {
 			break;
 		}
+		DispatchMessage(&msg);
 	}
-	UnhookWindowsHookEx(mouseHook);
-	LOG_INFO("Exiting mouse click hook thread");
-	return 0;
-}
-LRESULT CALLBACK MouseHookProc(int nCode, WPARAM wParam, LPARAM lParam)
-{
-	// MB1 click
-	if (wParam == WM_LBUTTONDOWN)
-	{
-		g_LastMouseClickButton = VK_LBUTTON;
-		g_LastMouseClickDurationRemaining = g_MouseClickDetectionDurationMillis;
+	if (mouseHook) {
+		UnhookWindowsHookEx(mouseHook);
+		g_MouseHookEvents = nullptr;
 	}
-	else if (wParam == WM_RBUTTONDOWN)
-	{
-		g_LastMouseClickButton = VK_RBUTTON;
-		g_LastMouseClickDurationRemaining = g_MouseClickDetectionDurationMillis;
+	if (rawInputWindow) {
+		RAWINPUTDEVICE device = { 0 };
+		device.usUsagePage = HID_USAGE_PAGE_GENERIC;
+		device.usUsage = HID_USAGE_GENERIC_MOUSE;
+		device.dwFlags = RIDEV_REMOVE;
+		device.hwndTarget = nullptr;
+		RegisterRawInputDevices(&device, 1, sizeof(device));
+		DestroyWindow(rawInputWindow);
 	}
-	return CallNextHookEx(0, nCode, wParam, lParam);
+	LOG_INFO("Exiting mouse click detection thread");
+	return 0;
 }
 
 MouseManager::MouseManager() :
 	m_MouseOptions(nullptr),
 	m_DeviceContext(nullptr),
 	m_Device(nullptr),
-	m_StopPollingTaskEvent(nullptr),
-	m_LastMouseDrawTimeStamp(std::chrono::steady_clock::now()),
 	m_IsCapturingMouseClicks(false),
-	m_MouseHookThread(nullptr),
-	m_MouseHookThreadId(0),
-	m_TextureManager(nullptr)
+	m_IsMouseClickDetectionEnabled(true),
+	m_MouseEvents(make_unique<MouseEventRing>()),
+	m_MouseInputThread(nullptr),
+	m_MouseInputThreadId(0),
+	m_MouseEventReadSequence(0),
+	m_LastMouseClickDrawTime(0),
+	m_TextureManager(nullptr),
+	m_CursorTextureUseCount(0),
+	m_LastShapeBuffer(nullptr),
+	m_LastShapeVersion(0),
+	m_LastShapeInfo{},
+	m_LastShapeHash(0),
+	m_LastCursorHandle(nullptr),
+	m_LastCursorShapeInfo{},
+	m_LastCursorShapeBuffer(nullptr),
+	m_LastCursorShapeVersion(0)
 {
 	InitializeCriticalSection(&m_CriticalSection);
 }
@@ -67,7 +260,6 @@ MouseManager::~MouseManager()
 {
 	CleanDX();
 	StopMouseClickDetection();
-	CloseHandle(m_StopPollingTaskEvent);
 	DeleteCriticalSection(&m_CriticalSection);
 }
 
@@ -107,61 +299,51 @@ HRESULT MouseManager::Initialize(_In_ ID3D11DeviceContext *pDeviceContext, _In_
 	RETURN_ON_BAD_HR(hr = m_TextureManager->Initialize(pDeviceContext, pDevice));
 	// Initialize shaders
 	hr = InitShaders(pDevice, &m_PixelShader, &m_VertexShader, &m_InputLayout);
+	if (pDevice->GetFeatureLevel() >= D3D_FEATURE_LEVEL_10_0) {
+		// Cursors that invert the background are blended with integer XOR in a pixel shader. On older devices they are blended on the CPU.
+		LOG_ON_BAD_HR(pDevice->CreatePixelShader(g_CursorPS, ARRAYSIZE(g_CursorPS), nullptr, &m_CursorPixelShader));
+		D3D11_BUFFER_DESC ConstantBufferDesc = { 0 };
+		ConstantBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		ConstantBufferDesc.ByteWidth = 4 * sizeof(INT);
+		ConstantBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		if (m_CursorPixelShader && FAILED(pDevice->CreateBuffer(&ConstantBufferDesc, nullptr, &m_CursorConstantBuffer))) {
+			m_CursorPixelShader.Release();
+		}
+	}
+	D3D11_BUFFER_DESC VertexBufferDesc = { 0 };
+	VertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	VertexBufferDesc.ByteWidth = sizeof(VERTEX) * NUMVERTICES;
+	VertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	RETURN_ON_BAD_HR(hr = pDevice->CreateBuffer(&VertexBufferDesc, nullptr, &m_CursorVertexBuffer));
 	hr = InitMouseClickTexture(pDeviceContext, pDevice);
 	m_Device = pDevice;
 	m_DeviceContext = pDeviceContext;
-	m_MouseOptions = pOptions;
+	SetOptions(pOptions);
+	return hr;
+}
 
+void MouseManager::SetOptions(_In_ std::shared_ptr<MOUSE_OPTIONS> &pOptions)
+{
+	m_MouseOptions = pOptions;
 	StopMouseClickDetection();
-	CloseHandle(m_StopPollingTaskEvent);
-	m_StopPollingTaskEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
 	InitializeMouseClickDetection();
-	return hr;
 }
 
 void MouseManager::InitializeMouseClickDetection()
 {
-	if (m_MouseOptions->IsMouseClicksDetected()) {
+	//The events are also needed to record clicks to the cursor track.
+	if (m_IsMouseClickDetectionEnabled && (m_MouseOptions->IsMouseClicksDetected() || m_MouseOptions->IsMousePointerMetadataEnabled())) {
 		if (!m_IsCapturingMouseClicks) {
-			switch (m_MouseOptions->GetMouseClickDetectionMode())
-			{
-				default:
-				case MOUSE_OPTIONS::MOUSE_DETECTION_MODE_POLLING: {
-					ResetEvent(m_StopPollingTaskEvent);
-					m_MousePollingThread = std::thread([this] {
-						LOG_INFO("Starting mouse click polling task");
-						while (true) {
-							if (GetKeyState(VK_LBUTTON) < 0)
-							{
-								//If left mouse button is held, reset the duration of click duration
-								g_LastMouseClickButton = VK_LBUTTON;
-								g_LastMouseClickDurationRemaining = g_MouseClickDetectionDurationMillis;
-							}
-							else if (GetKeyState(VK_RBUTTON) < 0)
-							{
-								//If right mouse button is held, reset the duration of click duration
-								g_LastMouseClickButton = VK_RBUTTON;
-								g_LastMouseClickDurationRemaining = g_MouseClickDetectionDurationMillis;
-							}
-
-							if (WaitForSingleObjectEx(m_StopPollingTaskEvent, 0, FALSE) == WAIT_OBJECT_0) {
-								break;
-							}
-							wait(1);
-						}
-						LOG_INFO("Exiting mouse click polling task");
-
-						});
-					m_IsCapturingMouseClicks = true;
-					break;
-				}
-				case MOUSE_OPTIONS::MOUSE_DETECTION_MODE_HOOK: {
-					m_MouseHookThread = CreateThread(nullptr, 0, MouseHookThreadProc, nullptr, 0, &m_MouseHookThreadId);
-					m_IsCapturingMouseClicks = true;
-					LOG_INFO("Created mouse click detection hook");
-					break;
-				}
+			//Only clicks made while detection runs are drawn.
+			m_MouseEventReadSequence = m_MouseEvents->GetWriteSequence();
+			m_MouseClicks.clear();
+			MOUSE_INPUT_THREAD_PARAMS *pParams = new MOUSE_INPUT_THREAD_PARAMS{ m_MouseEvents.get(), m_MouseOptions->GetMouseClickDetectionMode() };
+			m_MouseInputThread = CreateThread(nullptr, 0, MouseInputThreadProc, pParams, 0, &m_MouseInputThreadId);
+			if (!m_MouseInputThread) {
+				delete pParams;
+				LOG_ERROR(L"Failed to create mouse click detection thread: %ls", GetLastErrorStdWstr().c_str());
 			}
+			m_IsCapturingMouseClicks = true;
 		}
 	}
 	else if (m_IsCapturingMouseClicks) {
@@ -169,24 +351,41 @@ void MouseManager::InitializeMouseClickDetection()
 	}
 }
 
+void MouseManager::SetMouseClickDetectionEnabled(_In_ bool isEnabled)
+{
+	m_IsMouseClickDetectionEnabled = isEnabled;
+	if (!isEnabled) {
+		StopMouseClickDetection();
+	}
+}
+
 void MouseManager::StopMouseClickDetection()
 {
-	if (m_MouseHookThread) {
-		PostThreadMessageA(m_MouseHookThreadId, ET_QUITLOOP, 0, 0);
-		DWORD dwWaitResult = WaitForSingleObjectEx(m_MouseHookThread, 5000, false);
+	if (m_MouseInputThread) {
+		//The thread may not have created its message queue yet, so posting is retried until it succeeds or the thread has exited.
+		while (!PostThreadMessage(m_MouseInputThreadId, ET_QUITLOOP, 0, 0)
+			&& WaitForSingleObjectEx(m_MouseInputThread, 10, false) == WAIT_TIMEOUT);
+		DWORD dwWaitResult = WaitForSingleObjectEx(m_MouseInputThread, 5000, false);
 		if (dwWaitResult != WAIT_OBJECT_0) {
-			LOG_ERROR("Timeout waiting for mouse hook thread to exit.");
+			LOG_ERROR("Timeout waiting for mouse click detection thread to exit.");
 		}
-		m_MouseHookThread = nullptr;
-		m_MouseHookThreadId = 0;
-	}
-	if (m_MousePollingThread.joinable()) {
-		SetEvent(m_StopPollingTaskEvent);
-		m_MousePollingThread.join();
+		CloseHandle(m_MouseInputThread);
+		m_MouseInputThread = nullptr;
+		m_MouseInputThreadId = 0;
 	}
 	m_IsCapturingMouseClicks = false;
 }
 
+UINT32 MouseManager::ReadMouseEvents(_Inout_ UINT64 *pSequence, _Out_writes_to_(maxEvents, return) MOUSE_INPUT_EVENT *pEvents, _In_ UINT32 maxEvents)
+{
+	return m_MouseEvents->Read(pSequence, pEvents, maxEvents);
+}
+
+UINT64 MouseManager::GetMouseEventSequence()
+{
+	return m_MouseEvents->GetWriteSequence();
+}
+
 HRESULT MouseManager::InitMouseClickTexture(_In_ ID3D11DeviceContext *pDeviceContext, _In_ ID3D11Device *pDevice) {
 	HRESULT hr = D2D1CreateFactory(D2D1_FACTORY_TYPE_SINGLE_THREADED, __uuidof(ID2D1Factory), (void **)&m_D2DFactory);
 	return hr;
@@ -238,30 +437,80 @@ HRESULT MouseManager::ProcessMousePointer(_In_ ID3D11Texture2D *pFrame, _In_ PTR
 	EnterCriticalSection(&m_CriticalSection);
 	LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
 	InitializeMouseClickDetection();
-	if (g_LastMouseClickDurationRemaining > 0
-		&& m_MouseOptions->IsMouseClicksDetected())
+	if (m_MouseOptions->IsMouseClicksDetected())
 	{
-		if (g_LastMouseClickButton == VK_LBUTTON)
-		{
-			hr = DrawMouseClick(pPtrInfo, pFrame, m_MouseOptions->GetMouseClickDetectionLMBColor(), (float)m_MouseOptions->GetMouseClickDetectionRadius(), DXGI_MODE_ROTATION_UNSPECIFIED);
+		std::vector<MOUSE_CLICK> clicks;
+		GetVisibleMouseClicks(GetPerformanceCounterTime(), &clicks);
+		if (!clicks.empty()) {
+			hr = DrawMouseClicks(pPtrInfo, pFrame, clicks, (float)m_MouseOptions->GetMouseClickDetectionRadius(), DXGI_MODE_ROTATION_UNSPECIFIED);
+			LOG_TRACE("Drawing %u mouse clicks", (UINT)clicks.size());
 		}
-		if (g_LastMouseClickButton == VK_RBUTTON)
-		{
-			hr = DrawMouseClick(pPtrInfo, pFrame, m_MouseOptions->GetMouseClickDetectionRMBColor(), (float)m_MouseOptions->GetMouseClickDetectionRadius(), DXGI_MODE_ROTATION_UNSPECIFIED);
-		}
-		INT64 millisSinceLastMouseDraw = (INT64)max(0, (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_LastMouseDrawTimeStamp).count()));
-		g_LastMouseClickDurationRemaining = max(g_LastMouseClickDurationRemaining - millisSinceLastMouseDraw, 0);
-		LOG_TRACE("Drawing mouse click, duration remaining on click is %u ms", g_LastMouseClickDurationRemaining);
 	}
 
 	if (m_MouseOptions->IsMousePointerEnabled()) {
 		hr = DrawMousePointer(pPtrInfo, pFrame, DXGI_MODE_ROTATION_UNSPECIFIED);
 	}
-	m_LastMouseDrawTimeStamp = std::chrono::steady_clock::now();
 	return hr;
 }
 
-HRESULT MouseManager::DrawMouseClick(_In_ PTR_INFO *pPtrInfo, _In_ ID3D11Texture2D *pBgTexture, std::string colorStr, float radius, DXGI_MODE_ROTATION rotation)
+void MouseManager::GetVisibleMouseClicks(_In_ INT64 frameTime, _Out_ std::vector<MOUSE_CLICK> *pClicks)
+{
+	pClicks->clear();
+	MOUSE_INPUT_EVENT events[64];
+	UINT32 count = 0;
+	UINT64 lostEvents = 0;
+	do {
+		UINT64 lost = 0;
+		count = m_MouseEvents->Read(&m_MouseEventReadSequence, events, ARRAYSIZE(events), &lost);
+		lostEvents += lost;
+		for (UINT32 i = 0; i < count; i++) {
+			const MOUSE_INPUT_EVENT &event = events[i];
+			//Only the left and right buttons have click colors.
+			if (event.Button != MouseInputButton::Left && event.Button != MouseInputButton::Right) {
+				continue;
+			}
+			if (event.Type == MouseInputEventType::ButtonDown) {
+				if (m_MouseClicks.size() >= MAX_TRACKED_MOUSE_CLICKS) {
+					m_MouseClicks.erase(m_MouseClicks.begin());
+				}
+				MOUSE_CLICK click;
+				click.Button = event.Button;
+				click.Position = POINT{ event.X, event.Y };
+				click.DownTime = event.Timestamp;
+				m_MouseClicks.push_back(click);
+			}
+			else if (event.Type == MouseInputEventType::ButtonUp) {
+				auto held = std::find_if(m_MouseClicks.rbegin(), m_MouseClicks.rend(), [&](const MOUSE_CLICK &click) {
+					return click.Button == event.Button && click.UpTime == INT64_MAX;
+				});
+				if (held != m_MouseClicks.rend()) {
+					held->UpTime = max(event.Timestamp, held->DownTime);
+				}
+			}
+		}
+	} while (count == ARRAYSIZE(events));
+	if (lostEvents > 0) {
+		LOG_WARN(L"%llu mouse events were overwritten before they were drawn", lostEvents);
+	}
+
+	INT64 duration = MillisToHundredNanos(m_MouseOptions->GetMouseClickDetectionDurationMillis());
+	INT64 previousFrameTime = max(m_LastMouseClickDrawTime, frameTime - MillisToHundredNanos(MAX_MOUSE_CLICK_CATCH_UP_MILLIS));
+	auto getEndTime = [&](const MOUSE_CLICK &click) {
+		return max(click.UpTime, click.DownTime + duration);
+	};
+	for (const MOUSE_CLICK &click : m_MouseClicks) {
+		//A click is drawn if it was visible at any time since the previous frame, so a click that starts and ends between two frames is still drawn once.
+		if (click.DownTime <= frameTime && getEndTime(click) > previousFrameTime) {
+			pClicks->push_back(click);
+		}
+	}
+	m_MouseClicks.erase(std::remove_if(m_MouseClicks.begin(), m_MouseClicks.end(), [&](const MOUSE_CLICK &click) {
+		return getEndTime(click) <= frameTime;
+	}), m_MouseClicks.end());
+	m_LastMouseClickDrawTime = frameTime;
+}
+
+HRESULT MouseManager::DrawMouseClicks(_In_ PTR_INFO *pPtrInfo, _In_ ID3D11Texture2D *pBgTexture, _In_ const std::vector<MOUSE_CLICK> &clicks, float radius, DXGI_MODE_ROTATION rotation)
 {
 	ATL::CComPtr<IDXGISurface> pSharedSurface;
 	HRESULT hr = pBgTexture->QueryInterface(__uuidof(IDXGISurface), (void **)&pSharedSurface);
@@ -279,16 +528,19 @@ HRESULT MouseManager::DrawMouseClick(_In_ PTR_INFO *pPtrInfo, _In_ ID3D11Texture
 	ATL::CComPtr<ID2D1RenderTarget> pRenderTarget;
 	hr = m_D2DFactory->CreateDxgiSurfaceRenderTarget(pSharedSurface, RenderTargetProperties, &pRenderTarget);
 
-	long colorValue = ParseColorString(colorStr);
-
-	ATL::CComPtr<ID2D1SolidColorBrush> color;
-
-	if (FAILED(pRenderTarget->CreateSolidColorBrush(
-		D2D1::ColorF(colorValue, 0.7f), &color))) {
+	auto createBrush = [&](std::string colorStr) {
+		long colorValue = ParseColorString(colorStr);
+		ATL::CComPtr<ID2D1SolidColorBrush> color;
+		if (FAILED(pRenderTarget->CreateSolidColorBrush(
+			D2D1::ColorF(colorValue, 0.7f), &color))) {
 
-		pRenderTarget->CreateSolidColorBrush(
-			D2D1::ColorF(D2D1::ColorF::Yellow, 0.7f), &color);
-	}
+			pRenderTarget->CreateSolidColorBrush(
+				D2D1::ColorF(D2D1::ColorF::Yellow, 0.7f), &color);
+		}
+		return color;
+	};
+	ATL::CComPtr<ID2D1SolidColorBrush> leftColor = createBrush(m_MouseOptions->GetMouseClickDetectionLMBColor());
+	ATL::CComPtr<ID2D1SolidColorBrush> rightColor = createBrush(m_MouseOptions->GetMouseClickDetectionRMBColor());
 	DXGI_SURFACE_DESC desc;
 	pSharedSurface->GetDesc(&desc);
 	D2D1_ELLIPSE ellipse;
@@ -309,15 +561,16 @@ HRESULT MouseManager::DrawMouseClick(_In_ PTR_INFO *pPtrInfo, _In_ ID3D11Texture
 	}
 	ptrLeft += static_cast<int>(round(pPtrInfo->ShapeInfo.HotSpot.x * pPtrInfo->Scale.cx));
 	ptrTop += static_cast<int>(round(pPtrInfo->ShapeInfo.HotSpot.y * pPtrInfo->Scale.cy));
-	mousePoint.x = ptrLeft / dpiScale;
-	mousePoint.y = ptrTop / dpiScale;
-
-	ellipse.point = mousePoint;
 	ellipse.radiusX = radius * pPtrInfo->Scale.cx;
 	ellipse.radiusY = radius * pPtrInfo->Scale.cy;
 	pRenderTarget->BeginDraw();
-
-	pRenderTarget->FillEllipse(ellipse, color);
+	for (const MOUSE_CLICK &click : clicks) {
+		//Each click is drawn where it happened, relative to where the pointer is now.
+		mousePoint.x = (ptrLeft + static_cast<int>(round((click.Position.x - pPtrInfo->ScreenPosition.x) * pPtrInfo->Scale.cx))) / dpiScale;
+		mousePoint.y = (ptrTop + static_cast<int>(round((click.Position.y - pPtrInfo->ScreenPosition.y) * pPtrInfo->Scale.cy))) / dpiScale;
+		ellipse.point = mousePoint;
+		pRenderTarget->FillEllipse(ellipse, click.Button == MouseInputButton::Left ? leftColor : rightColor);
+	}
 	pRenderTarget->EndDraw();
 
 	return S_OK;
@@ -330,32 +583,212 @@ HRESULT MouseManager::DrawMousePointer(_In_ PTR_INFO *pPtrInfo, _Inout_ ID3D11Te
 {
 	if (!pPtrInfo || !pPtrInfo->Visible || pPtrInfo->PtrShapeBuffer == nullptr)
 		return S_FALSE;
-	// Vars to be used
-	ID3D11Texture2D *MouseTex = nullptr;
-	ID3D11ShaderResourceView *ShaderRes = nullptr;
-	ID3D11Buffer *VertexBufferMouse = nullptr;
-	D3D11_SUBRESOURCE_DATA InitData = { 0 };
-	D3D11_TEXTURE2D_DESC Desc = { 0 };
-	D3D11_SHADER_RESOURCE_VIEW_DESC SDesc;
+	CURSOR_TEXTURE *pCursor = nullptr;
+	HRESULT hr = GetCursorTexture(pPtrInfo, &pCursor);
+	if (FAILED(hr)) {
+		return hr;
+	}
+	if (pCursor->IsXorImage && !m_CursorPixelShader) {
+		return DrawMonoMaskPointer(pPtrInfo, pBgTexture, rotation);
+	}
+
 	D3D11_TEXTURE2D_DESC DesktopDesc = { 0 };
 	pBgTexture->GetDesc(&DesktopDesc);
-	// Position will be changed based on mouse position
-	VERTEX Vertices[NUMVERTICES] =
-	{
-		{ XMFLOAT3(-1.0f, -1.0f, 0), XMFLOAT2(0.0f, 1.0f) },
-		{ XMFLOAT3(-1.0f, 1.0f, 0), XMFLOAT2(0.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, -1.0f, 0), XMFLOAT2(1.0f, 1.0f) },
-		{ XMFLOAT3(1.0f, -1.0f, 0), XMFLOAT2(1.0f, 1.0f) },
-		{ XMFLOAT3(-1.0f, 1.0f, 0), XMFLOAT2(0.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, 1.0f, 0), XMFLOAT2(1.0f, 0.0f) },
-	};
-
 	INT DesktopWidth = DesktopDesc.Width;
 	INT DesktopHeight = DesktopDesc.Height;
 
-	// Center of desktop dimensions
-	INT CenterX = (DesktopWidth / 2);
-	INT CenterY = (DesktopHeight / 2);
+	INT PtrLeft = 0;
+	INT PtrTop = 0;
+	GetPointerPosition(pPtrInfo, rotation, DesktopWidth, DesktopHeight, &PtrLeft, &PtrTop);
+	// Scaled width and height
+	INT PtrWidth = static_cast<int>(round(pCursor->Width * pPtrInfo->Scale.cx));
+	INT PtrHeight = static_cast<int>(round(pCursor->Height * pPtrInfo->Scale.cy));
+	if (PtrWidth <= 0 || PtrHeight <= 0 || unsigned(PtrWidth) > DesktopDesc.Width || unsigned(PtrHeight) > DesktopDesc.Height) {
+		return S_FALSE;
+	}
+
+	ID3D11ShaderResourceView *pCursorView = pCursor->ShaderResource;
+	ID3D11ShaderResourceView *pBackgroundView = nullptr;
+	if (pCursor->IsXorImage) {
+		// The background is copied on the GPU and blended in the cursor pixel shader. The cursor is scaled with point sampling, like Windows does with these cursors.
+		RETURN_ON_BAD_HR(hr = CopyCursorBackground(pBgTexture, RECT{ PtrLeft, PtrTop, PtrLeft + PtrWidth, PtrTop + PtrHeight }));
+		if (hr == S_FALSE) {
+			return S_FALSE;
+		}
+		pBackgroundView = m_CursorBackgroundView;
+	}
+	else if (unsigned(PtrWidth) != pCursor->Width || unsigned(PtrHeight) != pCursor->Height) {
+		// Resize the cursor once for each scale it is drawn with, instead of every frame.
+		if (!pCursor->ScaledShaderResource || pCursor->ScaledSize.cx != PtrWidth || pCursor->ScaledSize.cy != PtrHeight) {
+			pCursor->ScaledShaderResource.Release();
+			CComPtr<ID3D11Resource> pCursorResource;
+			pCursor->ShaderResource->GetResource(&pCursorResource);
+			CComQIPtr<ID3D11Texture2D> pCursorTexture = pCursorResource;
+			CComPtr<ID3D11Texture2D> pResizedTexture;
+			RETURN_ON_BAD_HR(hr = m_TextureManager->ResizeTexture(pCursorTexture, SIZE{ PtrWidth,PtrHeight }, TextureStretchMode::Uniform, &pResizedTexture));
+			// The texture manager reuses its textures for the next resize of the same size, so the cached cursor needs its own copy.
+			D3D11_TEXTURE2D_DESC ScaledDesc;
+			pResizedTexture->GetDesc(&ScaledDesc);
+			ScaledDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+			ScaledDesc.MiscFlags = 0;
+			CComPtr<ID3D11Texture2D> pScaledTexture;
+			RETURN_ON_BAD_HR(hr = m_Device->CreateTexture2D(&ScaledDesc, nullptr, &pScaledTexture));
+			m_DeviceContext->CopyResource(pScaledTexture, pResizedTexture);
+			hr = m_Device->CreateShaderResourceView(pScaledTexture, nullptr, &pCursor->ScaledShaderResource);
+			if (FAILED(hr))
+			{
+				_com_error err(hr);
+				LOG_ERROR(L"Failed to create shader resource from mouse pointer texture: %ls", err.ErrorMessage());
+				return hr;
+			}
+			pCursor->ScaledSize = SIZE{ PtrWidth, PtrHeight };
+		}
+		pCursorView = pCursor->ScaledShaderResource;
+	}
+
+	VERTEX Vertices[NUMVERTICES];
+	GetPointerVertices(rotation, PtrLeft, PtrTop, PtrWidth, PtrHeight, DesktopWidth, DesktopHeight, Vertices);
+	return DrawPointerQuad(pBgTexture, Vertices, pCursorView, pBackgroundView);
+}
+
+HRESULT MouseManager::GetCursorTexture(_In_ PTR_INFO *pPtrInfo, _Outptr_ CURSOR_TEXTURE **ppCursor)
+{
+	*ppCursor = nullptr;
+	CURSOR_SHAPE shape;
+	shape.Type = static_cast<CursorShapeType>(pPtrInfo->ShapeInfo.Type);
+	shape.Width = pPtrInfo->ShapeInfo.Width;
+	shape.Height = pPtrInfo->ShapeInfo.Height;
+	shape.Pitch = pPtrInfo->ShapeInfo.Pitch;
+	shape.Buffer = pPtrInfo->PtrShapeBuffer;
+	shape.BufferSize = pPtrInfo->BufferSize;
+
+	// The shape is only hashed when it has changed since the last frame.
+	if (pPtrInfo->PtrShapeBuffer != m_LastShapeBuffer
+		|| pPtrInfo->ShapeVersion != m_LastShapeVersion
+		|| memcmp(&pPtrInfo->ShapeInfo, &m_LastShapeInfo, sizeof(m_LastShapeInfo)) != 0) {
+		m_LastShapeHash = HashCursorShape(shape);
+		m_LastShapeBuffer = pPtrInfo->PtrShapeBuffer;
+		m_LastShapeVersion = pPtrInfo->ShapeVersion;
+		m_LastShapeInfo = pPtrInfo->ShapeInfo;
+	}
+
+	auto cached = m_CursorTextures.find(m_LastShapeHash);
+	if (cached == m_CursorTextures.end()) {
+		CURSOR_IMAGE image;
+		if (!DecodeCursorShape(shape, image)) {
+			LOG_ERROR("Unrecognized mouse pointer type");
+			return E_FAIL;
+		}
+		D3D11_TEXTURE2D_DESC Desc = { 0 };
+		Desc.Width = image.Width;
+		Desc.Height = image.Height;
+		Desc.MipLevels = 1;
+		Desc.ArraySize = 1;
+		Desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+		Desc.SampleDesc.Count = 1;
+		Desc.Usage = D3D11_USAGE_IMMUTABLE;
+		Desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		D3D11_SUBRESOURCE_DATA InitData = { 0 };
+		InitData.pSysMem = image.Pixels.data();
+		InitData.SysMemPitch = image.Width * BPP;
+
+		CComPtr<ID3D11Texture2D> pTexture;
+		HRESULT hr = m_Device->CreateTexture2D(&Desc, &InitData, &pTexture);
+		if (FAILED(hr))
+		{
+			_com_error err(hr);
+			LOG_ERROR(L"Failed to create mouse pointer texture: %ls", err.ErrorMessage());
+			return hr;
+		}
+		CURSOR_TEXTURE cursor;
+		hr = m_Device->CreateShaderResourceView(pTexture, nullptr, &cursor.ShaderResource);
+		if (FAILED(hr))
+		{
+			_com_error err(hr);
+			LOG_ERROR(L"Failed to create shader resource from mouse pointer texture: %ls", err.ErrorMessage());
+			return hr;
+		}
+		cursor.Width = image.Width;
+		cursor.Height = image.Height;
+		cursor.IsXorImage = image.IsXorImage;
+
+		if (m_CursorTextures.size() >= MAX_CACHED_CURSORS) {
+			auto leastRecentlyUsed = min_element(m_CursorTextures.begin(), m_CursorTextures.end(), [](const auto &a, const auto &b) { return a.second.LastUsed < b.second.LastUsed; });
+			m_CursorTextures.erase(leastRecentlyUsed);
+		}
+		cached = m_CursorTextures.emplace(m_LastShapeHash, cursor).first;
+		LOG_DEBUG(L"Cached new mouse pointer shape: %ux%u, type %u, %ls", image.Width, image.Height, pPtrInfo->ShapeInfo.Type, image.IsXorImage ? L"inverting" : L"alpha blended");
+	}
+	cached->second.LastUsed = ++m_CursorTextureUseCount;
+	*ppCursor = &cached->second;
+	return S_OK;
+}
+
+HRESULT MouseManager::CopyCursorBackground(_In_ ID3D11Texture2D *pBgTexture, _In_ RECT cursorRect)
+{
+	D3D11_TEXTURE2D_DESC DesktopDesc;
+	pBgTexture->GetDesc(&DesktopDesc);
+	RECT clippedRect;
+	RECT desktopRect{ 0, 0, static_cast<LONG>(DesktopDesc.Width), static_cast<LONG>(DesktopDesc.Height) };
+	if (!IntersectRect(&clippedRect, &cursorRect, &desktopRect)) {
+		return S_FALSE;
+	}
+	D3D11_BOX Box{};
+	Box.left = clippedRect.left;
+	Box.top = clippedRect.top;
+	Box.right = clippedRect.right;
+	Box.bottom = clippedRect.bottom;
+	Box.back = 1;
+
+	D3D11_TEXTURE2D_DESC BackgroundDesc = { 0 };
+	if (m_CursorBackground) {
+		m_CursorBackground->GetDesc(&BackgroundDesc);
+	}
+	if (!m_CursorBackground
+		|| BackgroundDesc.Format != DesktopDesc.Format
+		|| BackgroundDesc.Width < Box.right - Box.left
+		|| BackgroundDesc.Height < Box.bottom - Box.top) {
+		m_CursorBackgroundView.Release();
+		m_CursorBackground.Release();
+		BackgroundDesc.Width = max(BackgroundDesc.Width, Box.right - Box.left);
+		BackgroundDesc.Height = max(BackgroundDesc.Height, Box.bottom - Box.top);
+		BackgroundDesc.MipLevels = 1;
+		BackgroundDesc.ArraySize = 1;
+		BackgroundDesc.Format = DesktopDesc.Format;
+		BackgroundDesc.SampleDesc.Count = 1;
+		BackgroundDesc.SampleDesc.Quality = 0;
+		BackgroundDesc.Usage = D3D11_USAGE_DEFAULT;
+		BackgroundDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		BackgroundDesc.CPUAccessFlags = 0;
+		BackgroundDesc.MiscFlags = 0;
+		HRESULT hr = m_Device->CreateTexture2D(&BackgroundDesc, nullptr, &m_CursorBackground);
+		if (FAILED(hr))
+		{
+			_com_error err(hr);
+			LOG_ERROR(L"Failed to create mouse pointer background texture: %ls", err.ErrorMessage());
+			return hr;
+		}
+		hr = m_Device->CreateShaderResourceView(m_CursorBackground, nullptr, &m_CursorBackgroundView);
+		if (FAILED(hr))
+		{
+			m_CursorBackground.Release();
+			_com_error err(hr);
+			LOG_ERROR(L"Failed to create shader resource from mouse pointer background texture: %ls", err.ErrorMessage());
+			return hr;
+		}
+	}
+	m_DeviceContext->CopySubresourceRegion(m_CursorBackground, 0, 0, 0, 0, pBgTexture, 0, &Box);
+	INT BackgroundOrigin[4] = { static_cast<INT>(Box.left), static_cast<INT>(Box.top), 0, 0 };
+	m_DeviceContext->UpdateSubresource(m_CursorConstantBuffer, 0, nullptr, BackgroundOrigin, 0, 0);
+	return S_OK;
+}
+
+HRESULT MouseManager::DrawMonoMaskPointer(_In_ PTR_INFO *pPtrInfo, _Inout_ ID3D11Texture2D *pBgTexture, DXGI_MODE_ROTATION rotation)
+{
+	D3D11_TEXTURE2D_DESC DesktopDesc = { 0 };
+	pBgTexture->GetDesc(&DesktopDesc);
+	INT DesktopWidth = DesktopDesc.Width;
+	INT DesktopHeight = DesktopDesc.Height;
 
 	// Clipping adjusted coordinates / dimensions
 	INT PtrWidth = 0;
@@ -363,9 +796,18 @@ HRESULT MouseManager::DrawMousePointer(_In_ PTR_INFO *pPtrInfo, _Inout_ ID3D11Te
 	INT PtrLeft = 0;
 	INT PtrTop = 0;
 
-	// Buffer used if necessary (in case of monochrome or masked pointer)
+	// Buffer used for the blended monochrome or masked pointer
 	BYTE *InitBuffer = nullptr;
+	bool isMono = pPtrInfo->ShapeInfo.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME;
+	RETURN_ON_BAD_HR(ProcessMonoMask(pBgTexture, rotation, isMono, pPtrInfo, &PtrWidth, &PtrHeight, &PtrLeft, &PtrTop, &InitBuffer));
+
+	if (PtrWidth <= 0 || PtrHeight <= 0 || unsigned(PtrWidth) > DesktopDesc.Width || unsigned(PtrHeight) > DesktopDesc.Height) {
+		return S_FALSE;
+	}
 
+	D3D11_TEXTURE2D_DESC Desc = { 0 };
+	Desc.Width = PtrWidth;
+	Desc.Height = PtrHeight;
 	Desc.MipLevels = 1;
 	Desc.ArraySize = 1;
 	Desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
@@ -376,52 +818,62 @@ HRESULT MouseManager::DrawMousePointer(_In_ PTR_INFO *pPtrInfo, _Inout_ ID3D11Te
 	Desc.CPUAccessFlags = 0;
 	Desc.MiscFlags = 0;
 
-	// Set shader resource properties
-	SDesc.Format = Desc.Format;
-	SDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	SDesc.Texture2D.MostDetailedMip = Desc.MipLevels - 1;
-	SDesc.Texture2D.MipLevels = Desc.MipLevels;
+	D3D11_SUBRESOURCE_DATA InitData = { 0 };
+	InitData.pSysMem = InitBuffer;
+	InitData.SysMemPitch = PtrWidth * BPP;
+	InitData.SysMemSlicePitch = 0;
+
+	// Scaled width and height
+	PtrWidth = static_cast<int>(round(PtrWidth * pPtrInfo->Scale.cx));
+	PtrHeight = static_cast<int>(round(PtrHeight * pPtrInfo->Scale.cy));
 
-	switch (pPtrInfo->ShapeInfo.Type)
+	// Create mouseshape as texture
+	CComPtr<ID3D11Texture2D> MouseTex;
+	HRESULT hr = m_Device->CreateTexture2D(&Desc, &InitData, &MouseTex);
+	if (FAILED(hr))
 	{
-		case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR:
-		{
-			PtrWidth = static_cast<INT>(pPtrInfo->ShapeInfo.Width);
-			PtrHeight = static_cast<INT>(pPtrInfo->ShapeInfo.Height);
-			GetPointerPosition(pPtrInfo, rotation, DesktopWidth, DesktopHeight, &PtrLeft, &PtrTop);
-			break;
-		}
-		case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME:
-		{
-			ProcessMonoMask(pBgTexture, rotation, true, pPtrInfo, &PtrWidth, &PtrHeight, &PtrLeft, &PtrTop, &InitBuffer);
-			break;
-		}
-		case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MASKED_COLOR:
-		{
-			ProcessMonoMask(pBgTexture, rotation, false, pPtrInfo, &PtrWidth, &PtrHeight, &PtrLeft, &PtrTop, &InitBuffer);
-			break;
-		}
-		default:
-			LOG_ERROR("Unrecognized mouse pointer type");
-			return E_FAIL;
+		_com_error err(hr);
+		LOG_ERROR(L"Failed to create mouse pointer texture: %ls", err.ErrorMessage());
+		return hr;
 	}
 
-	if (PtrWidth <= 0 || PtrHeight <= 0 || unsigned(PtrWidth) > DesktopDesc.Width || unsigned(PtrHeight) > DesktopDesc.Height) {
-		return S_FALSE;
+	if (pPtrInfo->Scale.cx != 1.0 || pPtrInfo->Scale.cy != 1.0) {
+		CComPtr<ID3D11Texture2D> pResizedTexture;
+		RETURN_ON_BAD_HR(hr = m_TextureManager->ResizeTexture(MouseTex, SIZE{ PtrWidth,PtrHeight }, TextureStretchMode::Uniform, &pResizedTexture));
+		MouseTex = pResizedTexture;
+	}
+	// Create shader resource from texture
+	CComPtr<ID3D11ShaderResourceView> ShaderRes;
+	hr = m_Device->CreateShaderResourceView(MouseTex, nullptr, &ShaderRes);
+	if (FAILED(hr))
+	{
+		_com_error err(hr);
+		LOG_ERROR(L"Failed to create shader resource from mouse pointer texture: %ls", err.ErrorMessage());
+		return hr;
 	}
 
-	// Set original texture properties
-	Desc.Width = PtrWidth;
-	Desc.Height = PtrHeight;
+	VERTEX Vertices[NUMVERTICES];
+	GetPointerVertices(rotation, PtrLeft, PtrTop, PtrWidth, PtrHeight, DesktopWidth, DesktopHeight, Vertices);
+	return DrawPointerQuad(pBgTexture, Vertices, ShaderRes, nullptr);
+}
 
-	// Set up init data
-	InitData.pSysMem = (pPtrInfo->ShapeInfo.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR) ? pPtrInfo->PtrShapeBuffer : InitBuffer;
-	InitData.SysMemPitch = (pPtrInfo->ShapeInfo.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR) ? pPtrInfo->ShapeInfo.Pitch : PtrWidth * BPP;
-	InitData.SysMemSlicePitch = 0;
+void MouseManager::GetPointerVertices(DXGI_MODE_ROTATION rotation, INT PtrLeft, INT PtrTop, INT PtrWidth, INT PtrHeight, INT DesktopWidth, INT DesktopHeight, _Out_writes_(NUMVERTICES) VERTEX *Vertices)
+{
+	// Position will be changed based on mouse position
+	const VERTEX DefaultVertices[NUMVERTICES] =
+	{
+		{ XMFLOAT3(-1.0f, -1.0f, 0), XMFLOAT2(0.0f, 1.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, 0), XMFLOAT2(0.0f, 0.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, 0), XMFLOAT2(1.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, 0), XMFLOAT2(1.0f, 1.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, 0), XMFLOAT2(0.0f, 0.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, 0), XMFLOAT2(1.0f, 0.0f) },
+	};
+	memcpy(Vertices, DefaultVertices, sizeof(DefaultVertices));
 
-	// Scaled width and height
-	PtrWidth = static_cast<int>(round(PtrWidth * pPtrInfo->Scale.cx));
-	PtrHeight = static_cast<int>(round(PtrHeight * pPtrInfo->Scale.cy));
+	// Center of desktop dimensions
+	INT CenterX = (DesktopWidth / 2);
+	INT CenterY = (DesktopHeight / 2);
 
 	// VERTEX creation
 	if (rotation == DXGI_MODE_ROTATION_UNSPECIFIED
@@ -470,69 +922,44 @@ HRESULT MouseManager::DrawMousePointer(_In_ PTR_INFO *pPtrInfo, _Inout_ ID3D11Te
 	Vertices[3].Pos.y = Vertices[2].Pos.y;
 	Vertices[4].Pos.x = Vertices[1].Pos.x;
 	Vertices[4].Pos.y = Vertices[1].Pos.y;
+}
 
-	// Create mouseshape as texture
-	HRESULT hr = m_Device->CreateTexture2D(&Desc, &InitData, &MouseTex);
-	if (FAILED(hr))
-	{
-		_com_error err(hr);
-		LOG_ERROR(L"Failed to create mouse pointer texture: %ls", err.ErrorMessage());
-		return hr;
-	}
-
-	if (pPtrInfo->Scale.cx != 1.0 || pPtrInfo->Scale.cy != 1.0) {
-		ID3D11Texture2D *pResizedTexture;
-		RETURN_ON_BAD_HR(hr = m_TextureManager->ResizeTexture(MouseTex, SIZE{ PtrWidth,PtrHeight }, TextureStretchMode::Uniform, &pResizedTexture));
-		SafeRelease(&MouseTex);
-		MouseTex = pResizedTexture;
-	}
-	// Create shader resource from texture
-	hr = m_Device->CreateShaderResourceView(MouseTex, &SDesc, &ShaderRes);
-	if (FAILED(hr))
-	{
-		MouseTex->Release();
-		MouseTex = nullptr;
-		_com_error err(hr);
-		LOG_ERROR(L"Failed to create shader resource from mouse pointer texture: %ls", err.ErrorMessage());
-		return hr;
-	}
-
-	D3D11_BUFFER_DESC BDesc;
-	ZeroMemory(&BDesc, sizeof(D3D11_BUFFER_DESC));
-	BDesc.Usage = D3D11_USAGE_DEFAULT;
-	BDesc.ByteWidth = sizeof(VERTEX) * NUMVERTICES;
-	BDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	BDesc.CPUAccessFlags = 0;
-
-	ZeroMemory(&InitData, sizeof(D3D11_SUBRESOURCE_DATA));
-	InitData.pSysMem = Vertices;
+HRESULT MouseManager::DrawPointerQuad(_Inout_ ID3D11Texture2D *pBgTexture, _In_reads_(NUMVERTICES) VERTEX *pVertices, _In_ ID3D11ShaderResourceView *pCursor, _In_opt_ ID3D11ShaderResourceView *pBackground)
+{
+	D3D11_TEXTURE2D_DESC DesktopDesc = { 0 };
+	pBgTexture->GetDesc(&DesktopDesc);
+	m_DeviceContext->UpdateSubresource(m_CursorVertexBuffer, 0, nullptr, pVertices, 0, 0);
 
-	// Create vertex buffer
-	hr = m_Device->CreateBuffer(&BDesc, &InitData, &VertexBufferMouse);
+	CComPtr<ID3D11RenderTargetView> RTV;
+	// Create a render target view
+	HRESULT hr = m_Device->CreateRenderTargetView(pBgTexture, nullptr, &RTV);
 	if (FAILED(hr))
 	{
-		ShaderRes->Release();
-		ShaderRes = nullptr;
-		MouseTex->Release();
-		MouseTex = nullptr;
-
 		_com_error err(hr);
-		LOG_ERROR(L"Failed to create mouse pointer vertex buffer: %ls", err.ErrorMessage());
+		LOG_ERROR(L"Failed to create render target view for mouse pointer: %ls", err.ErrorMessage());
 		return hr;
 	}
-	ID3D11RenderTargetView *RTV;
-	// Create a render target view
-	hr = m_Device->CreateRenderTargetView(pBgTexture, nullptr, &RTV);
 	// Set resources
 	FLOAT BlendFactor[4] = { 0.f, 0.f, 0.f, 0.f };
 	UINT Stride = sizeof(VERTEX);
 	UINT Offset = 0;
-	m_DeviceContext->IASetVertexBuffers(0, 1, &VertexBufferMouse, &Stride, &Offset);
-	m_DeviceContext->OMSetBlendState(m_BlendState.p, BlendFactor, 0xFFFFFFFF);
-	m_DeviceContext->OMSetRenderTargets(1, &RTV, nullptr);
+	ID3D11ShaderResourceView *ShaderResources[] = { pCursor, pBackground };
+	m_DeviceContext->IASetVertexBuffers(0, 1, &m_CursorVertexBuffer.p, &Stride, &Offset);
+	m_DeviceContext->IASetInputLayout(m_InputLayout);
+	m_DeviceContext->OMSetRenderTargets(1, &RTV.p, nullptr);
 	m_DeviceContext->VSSetShader(m_VertexShader, nullptr, 0);
-	m_DeviceContext->PSSetShader(m_PixelShader, nullptr, 0);
-	m_DeviceContext->PSSetShaderResources(0, 1, &ShaderRes);
+	if (pBackground) {
+		// The cursor pixel shader writes the final color, so it is drawn without blending.
+		m_DeviceContext->OMSetBlendState(nullptr, BlendFactor, 0xFFFFFFFF);
+		m_DeviceContext->PSSetShader(m_CursorPixelShader, nullptr, 0);
+		m_DeviceContext->PSSetConstantBuffers(0, 1, &m_CursorConstantBuffer.p);
+		m_DeviceContext->PSSetShaderResources(0, 2, ShaderResources);
+	}
+	else {
+		m_DeviceContext->OMSetBlendState(m_BlendState.p, BlendFactor, 0xFFFFFFFF);
+		m_DeviceContext->PSSetShader(m_PixelShader, nullptr, 0);
+		m_DeviceContext->PSSetShaderResources(0, 1, ShaderResources);
+	}
 	m_DeviceContext->PSSetSamplers(0, 1, &m_SamplerLinear.p);
 	m_DeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
@@ -545,31 +972,9 @@ HRESULT MouseManager::DrawMousePointer(_In_ PTR_INFO *pPtrInfo, _Inout_ ID3D11Te
 	m_DeviceContext->Draw(NUMVERTICES, 0);
 	// Restore view port
 	m_DeviceContext->RSSetViewports(1, &VP);
-	// Clean
-	if (RTV) {
-		RTV->Release();
-		RTV = nullptr;
-	}
 	// Clear shader resource
 	ID3D11ShaderResourceView *null[] = { nullptr, nullptr };
-	m_DeviceContext->PSSetShaderResources(0, 1, null);
-
-	if (VertexBufferMouse)
-	{
-		VertexBufferMouse->Release();
-		VertexBufferMouse = nullptr;
-	}
-	if (ShaderRes)
-	{
-		ShaderRes->Release();
-		ShaderRes = nullptr;
-	}
-	if (MouseTex)
-	{
-		MouseTex->Release();
-		MouseTex = nullptr;
-	}
-
+	m_DeviceContext->PSSetShaderResources(0, 2, null);
 	return hr;
 }
 
@@ -695,21 +1100,24 @@ HRESULT MouseManager::ProcessMonoMask(
 		LOG_ERROR(L"Failed to map surface for pointer: %lls", err.ErrorMessage());
 		return hr;
 	}
+	// The rotated background is square, so it holds the cursor area in any orientation.
+	UINT RotatedPitchInPixels = max(*ptrWidth, *ptrHeight);
 	auto bufSize = *ptrWidth * *ptrHeight * BPP;
 	if ((int)_InitBuffer.size() < bufSize)
 	{
 		_InitBuffer.resize(bufSize);
-		_DesktopBuffer.resize(bufSize);
+	}
+	if (rotation != DXGI_MODE_ROTATION_UNSPECIFIED && rotation != DXGI_MODE_ROTATION_IDENTITY
+		&& _DesktopBuffer.size() < RotatedPitchInPixels * RotatedPitchInPixels * BPP)
+	{
+		_DesktopBuffer.resize(RotatedPitchInPixels * RotatedPitchInPixels * BPP);
 	}
 
 	// New mouseshape buffer
 	*pInitBuffer = &(_InitBuffer[0]);
 
-	// New temp mouseshape buffer for rotation
-	BYTE *DesktopBuffer = &(_DesktopBuffer[0]);
-
 	UINT *InitBuffer32 = reinterpret_cast<UINT *>(*pInitBuffer);
-	UINT *DesktopBuffer32 = reinterpret_cast<UINT *>(DesktopBuffer);
+	UINT *DesktopBuffer32 = reinterpret_cast<UINT *>(MappedSurface.pBits);
 	UINT  DesktopPitchInPixels = MappedSurface.Pitch / sizeof(UINT);
 
 	// What to skip (pixel offset)
@@ -720,104 +1128,35 @@ HRESULT MouseManager::ProcessMonoMask(
 	if (rotation == DXGI_MODE_ROTATION_ROTATE90
 		|| rotation == DXGI_MODE_ROTATION_ROTATE180
 		|| rotation == DXGI_MODE_ROTATION_ROTATE270) {
-		UINT *Desktop32 = reinterpret_cast<UINT *>(MappedSurface.pBits);
-		for (INT Row = 0; Row < *ptrHeight; ++Row)
-		{
-			for (INT Col = 0; Col < *ptrWidth; ++Col)
-			{
-				int	rotatedRow = Row;
-				int rotatedCol = Col;
-
-				if (rotation == DXGI_MODE_ROTATION_ROTATE90) {
-					rotatedRow = Col;
-					rotatedCol = *ptrHeight - 1 - Row;
-				}
-				else if (rotation == DXGI_MODE_ROTATION_ROTATE180) {
-					rotatedRow = *ptrHeight - 1 - Row;
-					rotatedCol = *ptrWidth - 1 - Col;
-				}
-				else if (rotation == DXGI_MODE_ROTATION_ROTATE270) {
-					rotatedRow = *ptrWidth - 1 - Col;
-					rotatedCol = Row;
-				}
-				// Set new pixel
-				DesktopBuffer32[(rotatedRow * *ptrWidth) + rotatedCol] = Desktop32[(Row * DesktopPitchInPixels) + Col];
-			}
-		}
-	}
-	else {
-		DesktopBuffer32 = reinterpret_cast<UINT *>(MappedSurface.pBits);
+		CursorRotation cursorRotation = rotation == DXGI_MODE_ROTATION_ROTATE90 ? CursorRotation::Rotate90
+			: rotation == DXGI_MODE_ROTATION_ROTATE180 ? CursorRotation::Rotate180
+			: CursorRotation::Rotate270;
+		RotateCursorBackground(DesktopBuffer32, DesktopPitchInPixels, *ptrWidth, *ptrHeight, cursorRotation, reinterpret_cast<UINT *>(&(_DesktopBuffer[0])), RotatedPitchInPixels);
+		DesktopBuffer32 = reinterpret_cast<UINT *>(&(_DesktopBuffer[0]));
+		DesktopPitchInPixels = RotatedPitchInPixels;
 	}
 
 	if (IsMono)
 	{
 		//https://docs.microsoft.com/en-us/windows-hardware/drivers/display/drawing-monochrome-pointers
+		UINT MaskHeight = pPtrInfo->ShapeInfo.Height / 2;
 		for (INT Row = 0; Row < *ptrHeight; ++Row)
 		{
-			// Set mask
-			BYTE Mask = 0x80;
-			Mask = Mask >> (SkipX % 8);
-			for (INT Col = 0; Col < *ptrWidth; ++Col)
-			{
-				// Get masks using appropriate offsets
-				BYTE AndMask = pPtrInfo->PtrShapeBuffer[((Col + SkipX) / 8) + ((Row + SkipY) * (pPtrInfo->ShapeInfo.Pitch))] & Mask;
-				BYTE XorMask = pPtrInfo->PtrShapeBuffer[((Col + SkipX) / 8) + ((Row + SkipY + (pPtrInfo->ShapeInfo.Height / 2)) * (pPtrInfo->ShapeInfo.Pitch))] & Mask;
-				UINT AndMask32 = (AndMask) ? OPAQUE_WHITE : OPAQUE_BLACK;
-				UINT XorMask32 = (XorMask) ? TRANSPARENT_WHITE : TRANSPARENT_BLACK;
-
-				if (AndMask && !XorMask) {
-					// Instead of copying the desktop pixel for parts where the cursor is not visible, transparent white is used instead,
-					// to enable the pointer texture to be resized independently of the background and drawn on top of it.
-					InitBuffer32[(Row * *ptrWidth) + Col] = TRANSPARENT_WHITE;
-				}
-				else {
-					// Set new pixel with background from desktop
-					InitBuffer32[(Row * *ptrWidth) + Col] = (DesktopBuffer32[(Row * DesktopPitchInPixels) + Col] & AndMask32) ^ XorMask32;
-				}
-
-				// Adjust mask
-				if (Mask == 0x01)
-				{
-					Mask = 0x80;
-				}
-				else
-				{
-					Mask = Mask >> 1;
-				}
-			}
+			// Instead of copying the desktop pixel for parts where the cursor is not visible, transparent white is used instead,
+			// to enable the pointer texture to be resized independently of the background and drawn on top of it.
+			const BYTE *AndMask = pPtrInfo->PtrShapeBuffer + (Row + SkipY) * pPtrInfo->ShapeInfo.Pitch;
+			const BYTE *XorMask = pPtrInfo->PtrShapeBuffer + (Row + SkipY + MaskHeight) * pPtrInfo->ShapeInfo.Pitch;
+			BlendMonochromeRow(AndMask, XorMask, SkipX, DesktopBuffer32 + Row * DesktopPitchInPixels, InitBuffer32 + Row * *ptrWidth, *ptrWidth);
 		}
 	}
 	else
 	{
 		//https://docs.microsoft.com/en-us/windows-hardware/drivers/display/drawing-color-pointers
 		UINT *Buffer32 = reinterpret_cast<UINT *>(pPtrInfo->PtrShapeBuffer);
-
-		// Iterate through pixels
 		for (INT Row = 0; Row < *ptrHeight; ++Row)
 		{
-			for (INT Col = 0; Col < *ptrWidth; ++Col)
-			{
-				UINT RgbValue = Buffer32[(Col + SkipX) + ((Row + SkipY) * (pPtrInfo->ShapeInfo.Pitch / sizeof(UINT)))];
-				// Set up mask
-				UINT MaskVal = OPAQUE_BLACK & RgbValue;
-				if (MaskVal)
-				{
-					// Mask was 0xFF
-					if (RgbValue == MaskVal) {
-						// Instead of copying the desktop pixel for parts where the cursor is not visible, we use transparent white,
-						// to enable the pointer texture to be resized independently of the background and drawn on top of it.
-						InitBuffer32[(Row * *ptrWidth) + Col] = TRANSPARENT_WHITE;
-					}
-					else {
-						InitBuffer32[(Row * *ptrWidth) + Col] = (DesktopBuffer32[(Row * DesktopPitchInPixels) + Col] ^ RgbValue) | OPAQUE_BLACK;
-					}
-				}
-				else
-				{
-					// Mask was 0x00
-					InitBuffer32[(Row * *ptrWidth) + Col] = RgbValue | OPAQUE_BLACK;
-				}
-			}
+			const UINT *ShapeRow = Buffer32 + SkipX + (Row + SkipY) * (pPtrInfo->ShapeInfo.Pitch / sizeof(UINT));
+			BlendMaskedColorRow(ShapeRow, DesktopBuffer32 + Row * DesktopPitchInPixels, InitBuffer32 + Row * *ptrWidth, *ptrWidth);
 		}
 	}
 
@@ -895,6 +1234,7 @@ HRESULT MouseManager::GetMouse(_Inout_ PTR_INFO *pPtrInfo, _In_ bool getShapeBuf
 		pPtrInfo->Position.y = pFrameInfo->PointerPosition.Position.y + screenRect.top + offsetY;
 		pPtrInfo->WhoUpdatedPositionLast = screenRect;
 		pPtrInfo->LastTimeStamp = pFrameInfo->LastMouseUpdateTime;
+		GetCursorPos(&pPtrInfo->ScreenPosition);
 		pPtrInfo->Visible = pFrameInfo->PointerPosition.Visible != 0;
 	}
 
@@ -920,6 +1260,7 @@ HRESULT MouseManager::GetMouse(_Inout_ PTR_INFO *pPtrInfo, _In_ bool getShapeBuf
 		return hr;
 	}
 	pPtrInfo->IsPointerShapeUpdated = true;
+	pPtrInfo->ShapeVersion = InterlockedIncrement64(&g_LastPointerShapeVersion);
 	return S_OK;
 }
 
@@ -936,13 +1277,40 @@ HRESULT MouseManager::GetMouse(_Inout_ PTR_INFO *pPtrInfo, _In_ bool getShapeBuf
 		return E_FAIL;
 	}
 
+	if (!cursorInfo.hCursor) {
+		LOG_ERROR(L"GetCursorInfo returned no cursor");
+		return E_FAIL;
+	}
+	bool isVisible = cursorInfo.flags == CURSOR_SHOWING;
+	// The shape is only read when the cursor changes, or when the shape is needed in a buffer that doesn't hold it yet.
+	bool isShapeCached = cursorInfo.hCursor == m_LastCursorHandle
+		&& (!getShapeBuffer || (pPtrInfo->PtrShapeBuffer && pPtrInfo->PtrShapeBuffer == m_LastCursorShapeBuffer && pPtrInfo->ShapeVersion == m_LastCursorShapeVersion));
+	if (!isShapeCached) {
+		m_LastCursorHandle = nullptr;
+		RETURN_ON_BAD_HR(GetCursorShape(cursorInfo.hCursor, pPtrInfo, getShapeBuffer, &m_LastCursorShapeInfo));
+		m_LastCursorHandle = cursorInfo.hCursor;
+		m_LastCursorShapeBuffer = getShapeBuffer ? pPtrInfo->PtrShapeBuffer : nullptr;
+		m_LastCursorShapeVersion = getShapeBuffer ? pPtrInfo->ShapeVersion : 0;
+	}
+	POINT hotSpot = m_LastCursorShapeInfo.HotSpot;
+	pPtrInfo->ScreenPosition = cursorInfo.ptScreenPos;
+	cursorInfo.ptScreenPos.x = cursorInfo.ptScreenPos.x + offsetX - hotSpot.x;
+	cursorInfo.ptScreenPos.y = cursorInfo.ptScreenPos.y + offsetY - hotSpot.y;
+	pPtrInfo->Position = cursorInfo.ptScreenPos;
+	pPtrInfo->ShapeInfo = m_LastCursorShapeInfo;
+	pPtrInfo->Visible = isVisible;
+	QueryPerformanceCounter(&pPtrInfo->LastTimeStamp);
+	return S_OK;
+}
+
+HRESULT MouseManager::GetCursorShape(_In_ HCURSOR cursor, _Inout_ PTR_INFO *pPtrInfo, _In_ bool getShapeBuffer, _Out_ DXGI_OUTDUPL_POINTER_SHAPE_INFO *pShapeInfo)
+{
 	ICONINFO iconInfo = { 0 };
-	if (!cursorInfo.hCursor || !GetIconInfo(cursorInfo.hCursor, &iconInfo)) {
+	if (!GetIconInfo(cursor, &iconInfo)) {
 		DWORD dwErr = GetLastError();
 		LOG_ERROR(L"GetIconInfo failed: last error = %u", dwErr);
 		return E_FAIL;
 	}
-	bool isVisible = cursorInfo.flags == CURSOR_SHOWING;
 	LONG width = 0;
 	LONG height = 0;
 	LONG widthBytes = 0;
@@ -1002,6 +1370,7 @@ HRESULT MouseManager::GetMouse(_Inout_ PTR_INFO *pPtrInfo, _In_ bool getShapeBuf
 				return E_FAIL;
 			}
 			pPtrInfo->IsPointerShapeUpdated = true;
+			pPtrInfo->ShapeVersion = InterlockedIncrement64(&g_LastPointerShapeVersion);
 		}
 	}
 	else {
@@ -1047,6 +1416,7 @@ HRESULT MouseManager::GetMouse(_Inout_ PTR_INFO *pPtrInfo, _In_ bool getShapeBuf
 				return E_FAIL;
 			}
 			pPtrInfo->IsPointerShapeUpdated = true;
+			pPtrInfo->ShapeVersion = InterlockedIncrement64(&g_LastPointerShapeVersion);
 		}
 	}
 
@@ -1060,13 +1430,7 @@ HRESULT MouseManager::GetMouse(_Inout_ PTR_INFO *pPtrInfo, _In_ bool getShapeBuf
 	shapeInfo.Height = height;
 	shapeInfo.Type = cursorType;
 	shapeInfo.Pitch = widthBytes;
-
-	cursorInfo.ptScreenPos.x = cursorInfo.ptScreenPos.x + offsetX - hotSpot.x;
-	cursorInfo.ptScreenPos.y = cursorInfo.ptScreenPos.y + offsetY - hotSpot.y;
-	pPtrInfo->Position = cursorInfo.ptScreenPos;
-	pPtrInfo->ShapeInfo = shapeInfo;
-	pPtrInfo->Visible = isVisible;
-	QueryPerformanceCounter(&pPtrInfo->LastTimeStamp);
+	*pShapeInfo = shapeInfo;
 	return S_OK;
 }
 
@@ -1084,4 +1448,12 @@ void MouseManager::CleanDX()
 		m_PixelShader.Release();
 	if (m_D2DFactory)
 		m_D2DFactory.Release();
+	m_CursorPixelShader.Release();
+	m_CursorConstantBuffer.Release();
+	m_CursorVertexBuffer.Release();
+	m_CursorBackgroundView.Release();
+	m_CursorBackground.Release();
+	m_CursorTextures.clear();
+	m_LastShapeBuffer = nullptr;
+	m_LastShapeVersion = 0;
 }
@@ -3,10 +3,11 @@
 #include <d2d1.h>
 #include <atlbase.h>
 #include <memory>
+#include <unordered_map>
 #include "CommonTypes.h"
 #include "TextureManager.h"
-#include <thread>
-LRESULT CALLBACK MouseHookProc(int nCode, WPARAM wParam, LPARAM lParam);
+#include "CursorShape.h"
+#include "MouseEventRing.h"
 
 class MouseManager
 {
@@ -15,16 +16,67 @@ public:
 	~MouseManager();
 
 	HRESULT Initialize(_In_ ID3D11DeviceContext *pDeviceContext, _In_ ID3D11Device *pDevice, _In_ std::shared_ptr<MOUSE_OPTIONS> &pOptions);
+	/// <summary>
+	/// Replaces the mouse options without recreating any DirectX resources, and restarts click detection with the new options.
+	/// </summary>
+	void SetOptions(_In_ std::shared_ptr<MOUSE_OPTIONS> &pOptions);
 	void InitializeMouseClickDetection();
 	void StopMouseClickDetection();
+	/// <summary>
+	/// Click detection runs an input thread with a system wide mouse hook, so it is only enabled while recording.
+	/// While it is disabled, InitializeMouseClickDetection does nothing.
+	/// </summary>
+	void SetMouseClickDetectionEnabled(_In_ bool isEnabled);
+	/// <summary>
+	/// Copies the mouse button and wheel events captured since pSequence, so they can be stored as metadata alongside the recording.
+	/// Events are only captured while mouse click detection or pointer metadata is enabled.
+	/// </summary>
+	/// <param name="pSequence">The sequence number of the next event to read. Start with GetMouseEventSequence() to only read new events.</param>
+	/// <returns>The number of events copied to pEvents.</returns>
+	UINT32 ReadMouseEvents(_Inout_ UINT64 *pSequence, _Out_writes_to_(maxEvents, return) MOUSE_INPUT_EVENT *pEvents, _In_ UINT32 maxEvents);
+	UINT64 GetMouseEventSequence();
 	HRESULT ProcessMousePointer(_In_ ID3D11Texture2D *pFrame, _In_ PTR_INFO *pPtrInfo);
 	HRESULT GetMouse(_Inout_ PTR_INFO *pPtrInfo, _In_ bool getShapeBuffer, _In_ DXGI_OUTDUPL_FRAME_INFO *pFrameInfo, _In_ RECT screenRect, _In_ IDXGIOutputDuplication *pDeskDupl, _In_ int offsetX, _In_ int offsetY);
 	HRESULT GetMouse(_Inout_ PTR_INFO *pPtrInfo, _In_ bool getShapeBuffer, _In_ int offsetX, _In_ int offsetY);
 	void CleanDX();
 protected:
 	HRESULT DrawMousePointer(_In_ PTR_INFO *pPtrInfo, _Inout_ ID3D11Texture2D *pBbgTexture, DXGI_MODE_ROTATION rotation);
-	HRESULT DrawMouseClick(_In_ PTR_INFO *pPtrInfo, _In_ ID3D11Texture2D *pBgTexture, std::string colorStr, float radius, DXGI_MODE_ROTATION rotation);
 private:
+	/// <summary>
+	/// A mouse button press, drawn on every frame from the time the button went down until it was released, and for at least the click detection duration.
+	/// </summary>
+	struct MOUSE_CLICK {
+		MouseInputButton Button = MouseInputButton::None;
+		/// <summary>The position of the click in screen coordinates.</summary>
+		POINT Position{};
+		INT64 DownTime = 0;
+		/// <summary>The time the button was released, or INT64_MAX while it is held.</summary>
+		INT64 UpTime = INT64_MAX;
+	};
+	HRESULT DrawMouseClicks(_In_ PTR_INFO *pPtrInfo, _In_ ID3D11Texture2D *pBgTexture, _In_ const std::vector<MOUSE_CLICK> &clicks, float radius, DXGI_MODE_ROTATION rotation);
+	/// <summary>
+	/// Reads the new events from the event ring into the list of clicks, and returns the clicks that were visible at any time since the previous frame, so clicks between frames are never lost.
+	/// </summary>
+	void GetVisibleMouseClicks(_In_ INT64 frameTime, _Out_ std::vector<MOUSE_CLICK> *pClicks);
+	/// <summary>
+	/// A decoded cursor shape, kept on the GPU until the cache is full or the device changes.
+	/// </summary>
+	struct CURSOR_TEXTURE {
+		ATL::CComPtr<ID3D11ShaderResourceView> ShaderResource;
+		UINT Width = 0;
+		UINT Height = 0;
+		/// <summary>True if the cursor inverts the background, so it must be drawn with the cursor pixel shader.</summary>
+		bool IsXorImage = false;
+		/// <summary>The cursor resized to the last scaled size it was drawn with. Only used for cursors that are alpha blended.</summary>
+		ATL::CComPtr<ID3D11ShaderResourceView> ScaledShaderResource;
+		SIZE ScaledSize{};
+		UINT64 LastUsed = 0;
+	};
+	static const UINT MAX_CACHED_CURSORS = 16;
+	//Clicks that were never released, e.g. because the button up event was lost, are dropped when there are more than this.
+	static const UINT MAX_TRACKED_MOUSE_CLICKS = 32;
+	//A frame drawn after a long pause only shows the clicks from this long before it.
+	static const UINT MAX_MOUSE_CLICK_CATCH_UP_MILLIS = 500;
 	static const UINT TRANSPARENT_WHITE = 0x00FFFFFF;
 	static const UINT TRANSPARENT_BLACK = 0x00000000;
 	static const UINT OPAQUE_WHITE = 0xFFFFFFFF;
@@ -38,6 +90,27 @@ private:
 	ATL::CComPtr<ID3D11PixelShader> m_PixelShader;
 	ATL::CComPtr<ID3D11InputLayout> m_InputLayout;
 	ATL::CComPtr<ID2D1Factory> m_D2DFactory;
+	//Only created on feature level 10_0 and above. Without it, cursors that invert the background are blended on the CPU.
+	ATL::CComPtr<ID3D11PixelShader> m_CursorPixelShader;
+	ATL::CComPtr<ID3D11Buffer> m_CursorConstantBuffer;
+	ATL::CComPtr<ID3D11Buffer> m_CursorVertexBuffer;
+	//A copy of the part of the frame behind a cursor that inverts the background. It grows to the largest cursor drawn.
+	ATL::CComPtr<ID3D11Texture2D> m_CursorBackground;
+	ATL::CComPtr<ID3D11ShaderResourceView> m_CursorBackgroundView;
+
+	//Decoded cursors by the hash of their shape.
+	std::unordered_map<UINT64, CURSOR_TEXTURE> m_CursorTextures;
+	UINT64 m_CursorTextureUseCount;
+	//The shape that was hashed last, so it is only hashed again when it changes.
+	BYTE *m_LastShapeBuffer;
+	UINT64 m_LastShapeVersion;
+	DXGI_OUTDUPL_POINTER_SHAPE_INFO m_LastShapeInfo;
+	UINT64 m_LastShapeHash;
+	//The cursor that was read with GetIconInfo last, so the shape is only read again when the cursor changes.
+	HCURSOR m_LastCursorHandle;
+	DXGI_OUTDUPL_POINTER_SHAPE_INFO m_LastCursorShapeInfo;
+	BYTE *m_LastCursorShapeBuffer;
+	UINT64 m_LastCursorShapeVersion;
 
 	std::unique_ptr<TextureManager> m_TextureManager;
 	std::shared_ptr<MOUSE_OPTIONS> m_MouseOptions;
@@ -46,15 +119,42 @@ private:
 
 	CRITICAL_SECTION m_CriticalSection;
 	bool m_IsCapturingMouseClicks;
-	std::chrono::steady_clock::time_point m_LastMouseDrawTimeStamp;
-	HANDLE m_MouseHookThread;
-	DWORD m_MouseHookThreadId;
+	bool m_IsMouseClickDetectionEnabled;
+	//Receives the mouse events from the input thread, which runs a low level mouse hook or listens for raw input depending on the click detection mode.
+	std::unique_ptr<MouseEventRing> m_MouseEvents;
+	HANDLE m_MouseInputThread;
+	DWORD m_MouseInputThreadId;
+	//The sequence number of the next event in m_MouseEvents to draw.
+	UINT64 m_MouseEventReadSequence;
+	std::vector<MOUSE_CLICK> m_MouseClicks;
+	//The time the clicks were last drawn, in 100 nanosecond units on the performance counter clock.
+	INT64 m_LastMouseClickDrawTime;
 	std::vector<BYTE> _InitBuffer;
 	std::vector<BYTE> _DesktopBuffer;
-	HANDLE m_StopPollingTaskEvent;
-	std::thread m_MousePollingThread;
 	long ParseColorString(std::string color);
 	void GetPointerPosition(_In_ PTR_INFO *pPtrInfo, DXGI_MODE_ROTATION rotation, int desktopWidth, int desktopHeight, _Out_ INT *PtrLeft, _Out_ INT *PtrTop);
+	/// <summary>
+	/// Returns the cached texture for the shape in pPtrInfo, and decodes and uploads the shape if it is not cached.
+	/// </summary>
+	HRESULT GetCursorTexture(_In_ PTR_INFO *pPtrInfo, _Outptr_ CURSOR_TEXTURE **ppCursor);
+	/// <summary>
+	/// Copies the part of the frame behind the cursor to m_CursorBackground on the GPU, and sets its position for the cursor pixel shader.
+	/// </summary>
+	/// <returns>S_FALSE if the cursor is outside the frame.</returns>
+	HRESULT CopyCursorBackground(_In_ ID3D11Texture2D *pBgTexture, _In_ RECT cursorRect);
+	/// <summary>
+	/// Draws a cursor with the CPU blended mask of ProcessMonoMask. Used when the device has no cursor pixel shader.
+	/// </summary>
+	HRESULT DrawMonoMaskPointer(_In_ PTR_INFO *pPtrInfo, _Inout_ ID3D11Texture2D *pBgTexture, DXGI_MODE_ROTATION rotation);
+	void GetPointerVertices(DXGI_MODE_ROTATION rotation, INT ptrLeft, INT ptrTop, INT ptrWidth, INT ptrHeight, INT desktopWidth, INT desktopHeight, _Out_writes_(NUMVERTICES) VERTEX *pVertices);
+	/// <summary>
+	/// Draws a cursor quad on the frame. If pBackground is set, the cursor pixel shader is used with it, else the cursor is alpha blended.
+	/// </summary>
+	HRESULT DrawPointerQuad(_Inout_ ID3D11Texture2D *pBgTexture, _In_reads_(NUMVERTICES) VERTEX *pVertices, _In_ ID3D11ShaderResourceView *pCursor, _In_opt_ ID3D11ShaderResourceView *pBackground);
+	/// <summary>
+	/// Reads the shape of a cursor with GetIconInfo and GetDIBits.
+	/// </summary>
+	HRESULT GetCursorShape(_In_ HCURSOR cursor, _Inout_ PTR_INFO *pPtrInfo, _In_ bool getShapeBuffer, _Out_ DXGI_OUTDUPL_POINTER_SHAPE_INFO *pShapeInfo);
 	HRESULT ProcessMonoMask(_In_ ID3D11Texture2D *pBgTexture, _In_ DXGI_MODE_ROTATION rotation, _In_ bool IsMono, _Inout_ PTR_INFO *PtrInfo, _Out_ INT *PtrWidth, _Out_ INT *PtrHeight, _Out_ INT *PtrLeft, _Out_ INT *PtrTop, _Outptr_result_bytebuffer_(*PtrHeight **PtrWidth *BPP) BYTE **pInitBuffer);
 
 	HRESULT InitMouseClickTexture(_In_ ID3D11DeviceContext *pDeviceContext, _In_ ID3D11Device *pDevice);
@@ -0,0 +1,107 @@
+#include "OutputFinalizer.h"
+#include <ppltasks.h>
+#include <concrt.h>
+
+using namespace std;
+using namespace concurrency;
+
+OutputFinalizer::OutputFinalizer(_In_ LONG maxConcurrentFinalizations) :
+	m_SlotSemaphore(nullptr),
+	m_IdleEvent(nullptr),
+	m_PendingCount(0)
+{
+	LONG slots = max(maxConcurrentFinalizations, 1L);
+	m_SlotSemaphore = CreateSemaphore(nullptr, slots, slots, nullptr);
+	m_IdleEvent = CreateEvent(nullptr, TRUE, TRUE, nullptr);
+	InitializeCriticalSection(&m_PendingCriticalSection);
+}
+
+OutputFinalizer::~OutputFinalizer()
+{
+	LONG pendingCount = GetPendingCount();
+	if (pendingCount > 0) {
+		LOG_DEBUG(L"Waiting for %d pending finalizations", pendingCount);
+	}
+	WaitForAll(INFINITE);
+	//The last task sets the idle event while it holds the critical section, so wait for it to leave before deleting it.
+	EnterCriticalSection(&m_PendingCriticalSection);
+	LeaveCriticalSection(&m_PendingCriticalSection);
+	DeleteCriticalSection(&m_PendingCriticalSection);
+	CloseHandle(m_SlotSemaphore);
+	CloseHandle(m_IdleEvent);
+}
+
+HRESULT OutputFinalizer::Finalize(_In_ std::unique_ptr<OutputManager> pOutputManager, _In_opt_ FinalizeCompleteFunction onComplete)
+{
+	if (!pOutputManager) {
+		return E_INVALIDARG;
+	}
+	if (!m_SlotSemaphore || !m_IdleEvent) {
+		LOG_ERROR(L"Output finalizer is not initialized, finalizing synchronously");
+		HRESULT hr = pOutputManager->FinalizeRecording();
+		std::shared_ptr<FrameManifest> pFrameManifest = pOutputManager->GetFrameManifest();
+		pOutputManager.reset();
+		if (onComplete) {
+			onComplete(hr, pFrameManifest);
+		}
+		return hr;
+	}
+	if (WaitForSingleObject(m_SlotSemaphore, 0) == WAIT_TIMEOUT) {
+		LOG_DEBUG(L"Maximum number of concurrent finalizations reached, waiting for a free slot");
+		WaitForSingleObject(m_SlotSemaphore, INFINITE);
+	}
+	{
+		EnterCriticalSection(&m_PendingCriticalSection);
+		LeaveCriticalSectionOnExit leaveOnExit(&m_PendingCriticalSection);
+		if (++m_PendingCount == 1) {
+			ResetEvent(m_IdleEvent);
+		}
+	}
+	OutputManager *pOutput = pOutputManager.release();
+	create_task([this, pOutput, onComplete]() {
+		HRESULT hr = CoInitializeEx(nullptr, COINITBASE_MULTITHREADED | COINIT_DISABLE_OLE1DDE);
+		bool isCoInitialized = SUCCEEDED(hr);
+		HRESULT finalizeResult = E_FAIL;
+		std::shared_ptr<FrameManifest> pFrameManifest;
+		{
+			MeasureExecutionTime measure(L"Finalize output");
+			finalizeResult = pOutput->FinalizeRecording();
+			//The manifest outlives the output manager, so the frames are handed over without copying them.
+			pFrameManifest = pOutput->GetFrameManifest();
+			//Releasing the output manager releases the sink writer and output stream.
+			delete pOutput;
+		}
+		if (isCoInitialized) {
+			CoUninitialize();
+		}
+		ReleaseSemaphore(m_SlotSemaphore, 1, nullptr);
+		if (onComplete) {
+			onComplete(finalizeResult, pFrameManifest);
+		}
+		EnterCriticalSection(&m_PendingCriticalSection);
+		LeaveCriticalSectionOnExit leaveOnExit(&m_PendingCriticalSection);
+		if (--m_PendingCount == 0) {
+			SetEvent(m_IdleEvent);
+		}
+	});
+	return S_OK;
+}
+
+LONG OutputFinalizer::GetPendingCount()
+{
+	EnterCriticalSection(&m_PendingCriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_PendingCriticalSection);
+	return m_PendingCount;
+}
+
+HRESULT OutputFinalizer::WaitForAll(_In_ DWORD timeoutMillis)
+{
+	if (!m_IdleEvent) {
+		return S_OK;
+	}
+	DWORD result = WaitForSingleObject(m_IdleEvent, timeoutMillis);
+	if (result == WAIT_OBJECT_0) {
+		return S_OK;
+	}
+	return result == WAIT_TIMEOUT ? HRESULT_FROM_WIN32(ERROR_TIMEOUT) : HRESULT_FROM_WIN32(GetLastError());
+}
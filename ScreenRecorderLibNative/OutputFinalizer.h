@@ -0,0 +1,35 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include "OutputManager.h"
+
+typedef std::function<void(HRESULT finalizeResult, std::shared_ptr<FrameManifest> pFrameManifest)> FinalizeCompleteFunction;
+
+/// <summary>
+/// Finalizes recordings in the background, so a new recording can start capturing while the previous output is still being written.
+/// Takes ownership of the OutputManager of a finished recording, finalizes and releases it on a worker task, and reports the result through a callback.
+/// At most a fixed number of finalizations run at the same time, further requests wait for a free slot.
+/// </summary>
+class OutputFinalizer
+{
+public:
+	OutputFinalizer(_In_ LONG maxConcurrentFinalizations);
+	~OutputFinalizer();
+	/// <summary>
+	/// Queues the output for finalization. Blocks while the maximum number of finalizations are running.
+	/// </summary>
+	/// <param name="pOutputManager">The output of a finished recording.</param>
+	/// <param name="onComplete">Called on the worker task when the output is finalized and released.</param>
+	HRESULT Finalize(_In_ std::unique_ptr<OutputManager> pOutputManager, _In_opt_ FinalizeCompleteFunction onComplete);
+	/// <summary>
+	/// Waits until all queued finalizations and their completion callbacks have finished.
+	/// </summary>
+	HRESULT WaitForAll(_In_ DWORD timeoutMillis = INFINITE);
+	LONG GetPendingCount();
+private:
+	HANDLE m_SlotSemaphore;
+	//Set while no finalization is pending. Only changed together with m_PendingCount, under m_PendingCriticalSection, so a finishing task can't set it after a new finalization has reset it.
+	HANDLE m_IdleEvent;
+	CRITICAL_SECTION m_PendingCriticalSection;
+	LONG m_PendingCount;
+};
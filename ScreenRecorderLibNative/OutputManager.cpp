@@ -1,18 +1,38 @@
 #include "OutputManager.h"
 #include "screengrab.h"
+#include "SnapshotEncoder.h"
 #include <ppltasks.h> 
 #include <concrt.h>
 #include <filesystem>
 using namespace std;
 using namespace concurrency;
 
+struct OutputManager::TaskWrapper {
+	//Creates the sink writer for the next segment.
+	concurrency::task<void> PrepareTask = concurrency::task_from_result();
+	bool IsPreparing = false;
+	HRESULT PrepareResult = S_OK;
+	std::unique_ptr<SEGMENT_WRITER> PreparedWriter;
+	//Finalizes previous segments.
+	std::vector<concurrency::task<void>> FinalizeTasks;
+};
+
+template <class T>
+static void SwapComPtr(_Inout_ CComPtr<T> &a, _Inout_ CComPtr<T> &b) {
+	T *p = a.Detach();
+	a.Attach(b.Detach());
+	b.Attach(p);
+}
+
 OutputManager::OutputManager() :
+	m_TaskWrapperImpl(make_unique<TaskWrapper>()),
 	m_Device(nullptr),
 	m_DeviceContext(nullptr),
 	m_PresentationClock(nullptr),
 	m_TimeSrc(nullptr),
 	m_CallBack(nullptr),
 	m_FinalizeEvent(nullptr),
+	m_OutputClosedEvent(nullptr),
 	m_SinkWriter(nullptr),
 	m_OutStream(nullptr),
 	m_EncoderOptions(nullptr),
@@ -28,17 +48,43 @@ OutputManager::OutputManager() :
 	m_MediaTransform(nullptr),
 	m_DeviceManager(nullptr),
 	m_ResetToken(0),
-	m_UseManualNV12Converter(false)
+	m_UseManualNV12Converter(false),
+	m_SegmentStream(nullptr),
+	m_IsSegmentedOutput(false),
+	m_VideoOutputFrameSize{},
+	m_SegmentIndex(0),
+	m_SegmentFrameCount(0),
+	m_SegmentStartPos(0),
+	m_LastFrameEndPos(0),
+	m_FinishedSegments{},
+	m_SegmentFinalizeResult(S_OK),
+	m_ReplayBuffer(nullptr),
+	m_ReplaySink(nullptr),
+	m_ReplayMediaTypes{},
+	m_SlideshowWriter(nullptr),
+	m_AnimationWriter(nullptr),
+	m_FrameManifest(std::make_shared<FrameManifest>())
 {
 	m_FinalizeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	m_OutputClosedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
 	InitializeCriticalSection(&m_CriticalSection);
+	InitializeCriticalSection(&m_SegmentCriticalSection);
 }
 
 OutputManager::~OutputManager()
 {
+	//Background segment tasks reference this instance.
+	WaitForSegmentTasks();
+	if (m_ReplaySink) {
+		//The replay sink calls back into this instance, so it must not receive any more samples.
+		m_ReplaySink->Shutdown();
+	}
 	CloseHandle(m_FinalizeEvent);
 	m_FinalizeEvent = nullptr;
+	CloseHandle(m_OutputClosedEvent);
+	m_OutputClosedEvent = nullptr;
 	DeleteCriticalSection(&m_CriticalSection);
+	DeleteCriticalSection(&m_SegmentCriticalSection);
 }
 
 HRESULT OutputManager::Initialize(
@@ -75,6 +121,12 @@ HRESULT OutputManager::Initialize(
 		RETURN_ON_BAD_HR(m_PresentationClock->SetTimeSource(m_TimeSrc));
 	}
 	RETURN_ON_BAD_HR(m_DeviceManager->ResetDevice(pDevice, m_ResetToken));
+	if (m_SlideshowWriter) {
+		RETURN_ON_BAD_HR(m_SlideshowWriter->Initialize(pDeviceContext, pDevice, GetSnapshotOptions()->GetImageEncoder(), GetSnapshotOptions()->GetSnapshotEncoderFormat()));
+	}
+	if (m_AnimationWriter) {
+		RETURN_ON_BAD_HR(m_AnimationWriter->Initialize(pDeviceContext, pDevice));
+	}
 	return S_OK;
 }
 
@@ -90,23 +142,46 @@ HRESULT OutputManager::BeginRecording(_In_ std::wstring outputPath, _In_ SIZE vi
 	m_OutputFolder = filePath.has_extension() ? filePath.parent_path().wstring() : filePath.wstring();
 	ResetEvent(m_FinalizeEvent);
 
-	if (GetOutputOptions()->GetRecorderMode() == RecorderModeInternal::Video) {
-		if (m_FinalizeEvent) {
-			m_CallBack.Attach(new (std::nothrow)CMFSinkWriterCallback(m_FinalizeEvent, nullptr));
+	if (GetOutputOptions()->GetRecorderMode() == RecorderModeInternal::Video && GetOutputOptions()->IsReplayBufferEnabled()) {
+		if (GetOutputOptions()->IsSegmentedOutputEnabled()) {
+			LOG_WARN(L"Segmented output is not supported with the replay buffer, the replay is written as a single file");
+		}
+		RETURN_ON_BAD_HR(hr = BeginReplayBuffer(videoOutputFrameSize));
+	}
+	else if (GetOutputOptions()->GetRecorderMode() == RecorderModeInternal::Video) {
+		SEGMENT_WRITER writer{};
+		writer.UseManualNV12Converter = m_UseManualNV12Converter;
+		RETURN_ON_BAD_HR(hr = CreateFileSinkWriter(outputPath, videoOutputFrameSize, &writer));
+		SwapSinkWriter(&writer);
+		m_VideoOutputFrameSize = videoOutputFrameSize;
+		m_IsSegmentedOutput = GetOutputOptions()->IsSegmentedOutputEnabled();
+		if (m_IsSegmentedOutput) {
+			LOG_INFO(L"Segmented output enabled with max duration %lld ms and max size %llu bytes", GetOutputOptions()->GetSegmentDuration().count(), GetOutputOptions()->GetSegmentMaxSize());
 		}
+	}
+	else if (GetOutputOptions()->GetRecorderMode() == RecorderModeInternal::Slideshow) {
+		m_FrameManifest = make_shared<FrameManifest>();
+		if (GetOutputOptions()->IsSlideshowManifestEnabled()) {
+			wstring manifestPath = m_OutputFolder + L"\\" + SLIDESHOW_MANIFEST_FILE_NAME;
+			if (!m_FrameManifest->OpenSidecar(manifestPath)) {
+				LOG_ERROR(L"Failed to create slideshow manifest %ls", manifestPath.c_str());
+				return E_ACCESSDENIED;
+			}
+		}
+		m_SlideshowWriter = make_unique<SlideshowWriter>(m_FrameManifest, GetOutputOptions()->GetSlideshowEncoderThreadCount());
+		RETURN_ON_BAD_HR(hr = m_SlideshowWriter->Initialize(m_DeviceContext, m_Device, GetSnapshotOptions()->GetImageEncoder(), GetSnapshotOptions()->GetSnapshotEncoderFormat()));
+	}
+	else if (GetOutputOptions()->GetRecorderMode() == RecorderModeInternal::Animation) {
 		CComPtr<IStream> pStream = nullptr;
-		HRESULT hr = SHCreateStreamOnFileEx(
+		RETURN_ON_BAD_HR(hr = SHCreateStreamOnFileEx(
 			outputPath.c_str(),
 			STGM_READWRITE | STGM_SHARE_EXCLUSIVE,
 			FILE_ATTRIBUTE_NORMAL,
 			TRUE,
 			nullptr,
 			&pStream
-		);
-		RECT inputMediaFrameRect = RECT{ 0,0,videoOutputFrameSize.cx,videoOutputFrameSize.cy };
-		CComPtr<IMFByteStream> mfByteStream = nullptr;
-		RETURN_ON_BAD_HR(hr = MFCreateMFByteStreamOnStream(pStream, &mfByteStream));
-		RETURN_ON_BAD_HR(hr = InitializeVideoSinkWriter(mfByteStream, inputMediaFrameRect, videoOutputFrameSize, DXGI_MODE_ROTATION_UNSPECIFIED, m_CallBack, &m_SinkWriter, &m_VideoStreamIndex, &m_AudioStreamIndex));
+		));
+		RETURN_ON_BAD_HR(hr = BeginAnimation(pStream));
 	}
 	StartMediaClock();
 	LOG_DEBUG("Sink Writer initialized");
@@ -122,7 +197,13 @@ HRESULT OutputManager::BeginRecording(_In_ IStream *pStream, _In_ SIZE videoOutp
 	}
 	m_OutStream = pStream;
 	ResetEvent(m_FinalizeEvent);
-	if (GetOutputOptions()->GetRecorderMode() == RecorderModeInternal::Video) {
+	if (GetOutputOptions()->GetRecorderMode() == RecorderModeInternal::Video && GetOutputOptions()->IsReplayBufferEnabled()) {
+		RETURN_ON_BAD_HR(hr = BeginReplayBuffer(videoOutputFrameSize));
+	}
+	else if (GetOutputOptions()->GetRecorderMode() == RecorderModeInternal::Video) {
+		if (GetOutputOptions()->IsSegmentedOutputEnabled()) {
+			LOG_WARN(L"Segmented output is only supported when recording to a file, the recording is written as a single stream");
+		}
 		CComPtr<IMFByteStream> mfByteStream = nullptr;
 		RETURN_ON_BAD_HR(hr = MFCreateMFByteStreamOnStream(pStream, &mfByteStream));
 
@@ -130,64 +211,486 @@ HRESULT OutputManager::BeginRecording(_In_ IStream *pStream, _In_ SIZE videoOutp
 			m_CallBack.Attach(new (std::nothrow)CMFSinkWriterCallback(m_FinalizeEvent, nullptr));
 		}
 		RECT inputMediaFrameRect = RECT{ 0,0,videoOutputFrameSize.cx,videoOutputFrameSize.cy };
-		RETURN_ON_BAD_HR(hr = InitializeVideoSinkWriter(mfByteStream, inputMediaFrameRect, videoOutputFrameSize, DXGI_MODE_ROTATION_UNSPECIFIED, m_CallBack, &m_SinkWriter, &m_VideoStreamIndex, &m_AudioStreamIndex));
+		RETURN_ON_BAD_HR(hr = InitializeVideoSinkWriter(mfByteStream, inputMediaFrameRect, videoOutputFrameSize, DXGI_MODE_ROTATION_UNSPECIFIED, m_CallBack, &m_UseManualNV12Converter, &m_MediaTransform, &m_SinkWriter, &m_VideoStreamIndex, &m_AudioStreamIndex));
+	}
+	else if (GetOutputOptions()->GetRecorderMode() == RecorderModeInternal::Animation) {
+		RETURN_ON_BAD_HR(hr = BeginAnimation(pStream));
 	}
 	StartMediaClock();
 	LOG_DEBUG("Sink Writer initialized");
 	return hr;
 }
 
+HRESULT OutputManager::CreateFileSinkWriter(_In_ std::wstring path, _In_ SIZE videoOutputFrameSize, _Inout_ SEGMENT_WRITER *pWriter)
+{
+	pWriter->Path = path;
+	pWriter->FinalizeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	pWriter->OutputClosedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (!pWriter->FinalizeEvent || !pWriter->OutputClosedEvent) {
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+	pWriter->Callback.Attach(new (std::nothrow)CMFSinkWriterCallback(pWriter->FinalizeEvent, nullptr));
+	if (!pWriter->Callback) {
+		return E_OUTOFMEMORY;
+	}
+	CComPtr<IStream> pStream = nullptr;
+	HRESULT hr = SHCreateStreamOnFileEx(
+		path.c_str(),
+		STGM_READWRITE | STGM_SHARE_EXCLUSIVE,
+		FILE_ATTRIBUTE_NORMAL,
+		TRUE,
+		nullptr,
+		&pStream
+	);
+	RETURN_ON_BAD_HR(hr);
+	pWriter->Stream.Attach(new (std::nothrow)CloseNotifyingStream(pStream, pWriter->OutputClosedEvent));
+	if (!pWriter->Stream) {
+		return E_OUTOFMEMORY;
+	}
+	RECT inputMediaFrameRect = RECT{ 0,0,videoOutputFrameSize.cx,videoOutputFrameSize.cy };
+	CComPtr<IMFByteStream> mfByteStream = nullptr;
+	RETURN_ON_BAD_HR(hr = MFCreateMFByteStreamOnStream(pWriter->Stream, &mfByteStream));
+	RETURN_ON_BAD_HR(hr = InitializeVideoSinkWriter(
+		mfByteStream,
+		inputMediaFrameRect,
+		videoOutputFrameSize,
+		DXGI_MODE_ROTATION_UNSPECIFIED,
+		pWriter->Callback,
+		&pWriter->UseManualNV12Converter,
+		&pWriter->MediaTransform,
+		&pWriter->SinkWriter,
+		&pWriter->VideoStreamIndex,
+		&pWriter->AudioStreamIndex));
+	return hr;
+}
+
+void OutputManager::SwapSinkWriter(_Inout_ SEGMENT_WRITER *pWriter)
+{
+	SwapComPtr(m_SinkWriter, pWriter->SinkWriter);
+	SwapComPtr(m_CallBack, pWriter->Callback);
+	SwapComPtr(m_MediaTransform, pWriter->MediaTransform);
+	SwapComPtr(m_SegmentStream, pWriter->Stream);
+	std::swap(m_VideoStreamIndex, pWriter->VideoStreamIndex);
+	std::swap(m_AudioStreamIndex, pWriter->AudioStreamIndex);
+	std::swap(m_UseManualNV12Converter, pWriter->UseManualNV12Converter);
+	std::swap(m_FinalizeEvent, pWriter->FinalizeEvent);
+	std::swap(m_OutputClosedEvent, pWriter->OutputClosedEvent);
+}
+
+HRESULT OutputManager::ShutdownMediaSink(_Inout_ CComPtr<IMFSinkWriter> &pSinkWriter)
+{
+	HRESULT hr = S_FALSE;
+	//Dispose of MPEG4MediaSink 
+	IMFMediaSink *pSink;
+	if (SUCCEEDED(pSinkWriter->GetServiceForStream(MF_SINK_WRITER_MEDIASINK, GUID_NULL, IID_PPV_ARGS(&pSink)))) {
+		//Release the sink writer before calling Shutdown on the media sink. 
+		//https://learn.microsoft.com/en-us/windows/win32/api/mfreadwrite/nf-mfreadwrite-mfcreatesinkwriterfrommediasink
+		pSinkWriter.Release();
+		hr = pSink->Shutdown();
+		SafeRelease(&pSink);
+		if (FAILED(hr)) {
+			LOG_ERROR("Failed to shut down IMFMediaSink");
+		}
+		else {
+			LOG_DEBUG("Shut down IMFMediaSink");
+		}
+	};
+	return hr;
+}
+
+HRESULT OutputManager::FinalizeSinkWriter(_Inout_ CComPtr<IMFSinkWriter> &pSinkWriter, _In_ HANDLE hFinalizeEvent, _In_opt_ HANDLE hOutputClosedEvent)
+{
+	HRESULT finalizeResult = pSinkWriter->Finalize();
+	if (SUCCEEDED(finalizeResult) && hFinalizeEvent) {
+		WaitForSingleObject(hFinalizeEvent, INFINITE);
+	}
+	if (FAILED(finalizeResult)) {
+		LOG_ERROR("Failed to finalize sink writer");
+	}
+	HRESULT shutdownResult = ShutdownMediaSink(pSinkWriter);
+	if (shutdownResult != S_FALSE) {
+		finalizeResult = shutdownResult;
+	}
+	if (hOutputClosedEvent) {
+		//The media sink may release the output file asynchronously after shutdown.
+		if (WaitForSingleObject(hOutputClosedEvent, OUTPUT_CLOSE_TIMEOUT_MILLIS) == WAIT_OBJECT_0) {
+			LOG_TRACE(L"Output file is ready");
+		}
+		else {
+			LOG_WARN("Output file was not released within %d ms", OUTPUT_CLOSE_TIMEOUT_MILLIS);
+		}
+	}
+	return finalizeResult;
+}
+
 HRESULT OutputManager::FinalizeRecording()
 {
 	LOG_INFO("Cleaning up resources");
 	LOG_INFO("Finalizing recording");
 	HRESULT finalizeResult = S_OK;
 	if (m_SinkWriter) {
-
-		finalizeResult = m_SinkWriter->Finalize();
-		if (SUCCEEDED(finalizeResult) && m_FinalizeEvent) {
-			WaitForSingleObject(m_FinalizeEvent, INFINITE);
-		}
-		if (FAILED(finalizeResult)) {
-			LOG_ERROR("Failed to finalize sink writer");
-		}
-		//Dispose of MPEG4MediaSink 
-		IMFMediaSink *pSink;
-		if (SUCCEEDED(m_SinkWriter->GetServiceForStream(MF_SINK_WRITER_MEDIASINK, GUID_NULL, IID_PPV_ARGS(&pSink)))) {
-			//Release the sink writer before calling Shutdown on the media sink. 
-			//https://learn.microsoft.com/en-us/windows/win32/api/mfreadwrite/nf-mfreadwrite-mfcreatesinkwriterfrommediasink
-			m_SinkWriter.Release();
-			finalizeResult = pSink->Shutdown();
-			SafeRelease(&pSink);
-			if (FAILED(finalizeResult)) {
-				LOG_ERROR("Failed to shut down IMFMediaSink");
-			}
-			else {
-				LOG_DEBUG("Shut down IMFMediaSink");
-			}
-		};
-		if (!m_OutputFullPath.empty()) {
-			bool isFileAvailable = false;
-			for (int i = 0; i < 10; i++) {
-				isFileAvailable = IsFileAvailableForReading(m_OutputFullPath);
-				if (isFileAvailable) {
-					LOG_TRACE(L"Output file is ready");
-					break;
-				}
-				else {
-					Sleep(100);
-					LOG_TRACE(L"Output file is still locked for reading, waiting..");
+		//The output closed event is signaled when the last reference to the file stream is released.
+		m_SegmentStream.Release();
+		bool isFileOutput = !m_OutputFullPath.empty() && !m_ReplayBuffer;
+		finalizeResult = FinalizeSinkWriter(m_SinkWriter, m_FinalizeEvent, isFileOutput ? m_OutputClosedEvent : nullptr);
+		if (m_ReplayBuffer && SUCCEEDED(finalizeResult)) {
+			//Finalizing drains the encoder, so the buffer now holds the last frames of the recording.
+			finalizeResult = m_OutStream ? SaveReplay(m_OutStream) : SaveReplay(m_OutputFullPath);
+		}
+		if (m_OutStream) {
+			//Output streams may buffer writes, so make sure everything has reached the stream before reporting completion.
+			HRESULT commitResult = m_OutStream->Commit(STGC_DEFAULT);
+			if (FAILED(commitResult) && commitResult != E_NOTIMPL) {
+				LOG_ERROR(L"Failed to commit output stream: hr = 0x%08x", commitResult);
+				if (SUCCEEDED(finalizeResult)) {
+					finalizeResult = commitResult;
 				}
 			}
-			if (!isFileAvailable) {
-				LOG_WARN("Output file is still locked after maximum retries");
-			}
 		}
 	}
+	if (m_IsSegmentedOutput) {
+		finalizeResult = FinalizeSegments(finalizeResult);
+	}
+	if (m_SlideshowWriter) {
+		finalizeResult = m_SlideshowWriter->Flush();
+		SLIDESHOW_WRITER_STATS stats = m_SlideshowWriter->GetStats();
+		LOG_INFO(L"Slideshow writer wrote %llu frames, %llu failed, waited %llu times for the GPU or encoders", stats.WrittenFrames, stats.FailedFrames, stats.BlockingWaits);
+		m_SlideshowWriter.reset();
+		if (!m_FrameManifest->CloseSidecar()) {
+			LOG_WARN(L"Failed to write all frames to the slideshow manifest");
+		}
+	}
+	if (m_AnimationWriter) {
+		finalizeResult = m_AnimationWriter->Finish(static_cast<UINT64>(max(HundredNanosToMillis(m_LastFrameEndPos), 0LL)));
+		ANIMATION_WRITER_STATS stats = m_AnimationWriter->GetStats();
+		LOG_INFO(L"Animation writer wrote %llu frames, %llu unchanged frames merged into the previous, %llu new and %llu reused palettes, waited %llu times for the GPU or encoders",
+			stats.WrittenFrames, stats.UnchangedFrames, stats.NewPalettes, stats.ReusedPalettes, stats.BlockingWaits);
+		m_AnimationWriter.reset();
+	}
 	StopMediaClock();
 	return finalizeResult;
 }
 
+std::wstring OutputManager::GetSegmentPath(_In_ UINT segmentIndex)
+{
+	if (segmentIndex == 0) {
+		return m_OutputFullPath;
+	}
+	std::filesystem::path path = m_OutputFullPath;
+	std::wstring fileName = path.stem().wstring() + L"_" + to_wstring(segmentIndex) + path.extension().wstring();
+	return path.replace_filename(fileName).wstring();
+}
+
+bool OutputManager::IsSegmentLimitReached(_In_ INT64 frameStartPos, _In_ double fraction)
+{
+	//A segment always has at least one frame, else a too short limit would create empty segments.
+	if (m_SegmentFrameCount == 0) {
+		return false;
+	}
+	INT64 maxDuration = MillisToHundredNanos(static_cast<double>(GetOutputOptions()->GetSegmentDuration().count()));
+	if (maxDuration > 0 && frameStartPos - m_SegmentStartPos >= static_cast<INT64>(maxDuration * fraction)) {
+		return true;
+	}
+	UINT64 maxSize = GetOutputOptions()->GetSegmentMaxSize();
+	if (maxSize > 0 && m_SegmentStream && static_cast<UINT64>(m_SegmentStream->GetBytesWritten()) >= static_cast<UINT64>(maxSize * fraction)) {
+		return true;
+	}
+	return false;
+}
+
+void OutputManager::PrepareNextSegment()
+{
+	if (m_TaskWrapperImpl->IsPreparing) {
+		return;
+	}
+	m_TaskWrapperImpl->IsPreparing = true;
+	std::wstring path = GetSegmentPath(m_SegmentIndex + 1);
+	SIZE frameSize = m_VideoOutputFrameSize;
+	bool useManualNV12Converter = m_UseManualNV12Converter;
+	LOG_DEBUG(L"Preparing output segment %ls", path.c_str());
+	//Creating a sink writer loads the encoder, which can take long enough to cause a visible stutter if done between two frames.
+	m_TaskWrapperImpl->PrepareTask = create_task([this, path, frameSize, useManualNV12Converter]() {
+		HRESULT hr = CoInitializeEx(nullptr, COINITBASE_MULTITHREADED | COINIT_DISABLE_OLE1DDE);
+		bool isCoInitialized = SUCCEEDED(hr);
+		auto pWriter = make_unique<SEGMENT_WRITER>();
+		pWriter->UseManualNV12Converter = useManualNV12Converter;
+		hr = CreateFileSinkWriter(path, frameSize, pWriter.get());
+		m_TaskWrapperImpl->PrepareResult = hr;
+		if (SUCCEEDED(hr)) {
+			m_TaskWrapperImpl->PreparedWriter = std::move(pWriter);
+		}
+		else {
+			LOG_ERROR(L"Failed to create sink writer for output segment %ls: hr = 0x%08x", path.c_str(), hr);
+		}
+		if (isCoInitialized) {
+			CoUninitialize();
+		}
+	});
+}
+
+HRESULT OutputManager::StartNextSegment(_In_ INT64 frameStartPos)
+{
+	PrepareNextSegment();
+	{
+		MeasureExecutionTime measure(L"Wait for next output segment");
+		m_TaskWrapperImpl->PrepareTask.wait();
+	}
+	m_TaskWrapperImpl->IsPreparing = false;
+	std::unique_ptr<SEGMENT_WRITER> pWriter = std::move(m_TaskWrapperImpl->PreparedWriter);
+	if (FAILED(m_TaskWrapperImpl->PrepareResult) || !pWriter) {
+		return FAILED(m_TaskWrapperImpl->PrepareResult) ? m_TaskWrapperImpl->PrepareResult : E_FAIL;
+	}
+	//After the swap, pWriter holds the writer of the segment that just ended.
+	SwapSinkWriter(pWriter.get());
+	OUTPUT_SEGMENT finishedSegment{ GetSegmentPath(m_SegmentIndex), m_SegmentStartPos, frameStartPos - m_SegmentStartPos };
+	m_SegmentIndex++;
+	m_SegmentStartPos = frameStartPos;
+	m_SegmentFrameCount = 0;
+	//The new sink writer must get audio from its first frame, or it will throttle video while waiting for it.
+	m_LastFrameHadAudio = false;
+	LOG_INFO(L"Started output segment %ls", GetSegmentPath(m_SegmentIndex).c_str());
+
+	//The output closed event is signaled when the last reference to the file stream is released.
+	pWriter->Stream.Release();
+	SEGMENT_WRITER *pFinishedWriter = pWriter.release();
+	auto &finalizeTasks = m_TaskWrapperImpl->FinalizeTasks;
+	finalizeTasks.erase(std::remove_if(finalizeTasks.begin(), finalizeTasks.end(), [](const task<void> &t) { return t.is_done(); }), finalizeTasks.end());
+	finalizeTasks.push_back(create_task([this, pFinishedWriter, finishedSegment]() {
+		HRESULT hr = CoInitializeEx(nullptr, COINITBASE_MULTITHREADED | COINIT_DISABLE_OLE1DDE);
+		bool isCoInitialized = SUCCEEDED(hr);
+		{
+			MeasureExecutionTime measure(L"Finalize output segment");
+			hr = FinalizeSinkWriter(pFinishedWriter->SinkWriter, pFinishedWriter->FinalizeEvent, pFinishedWriter->OutputClosedEvent);
+			delete pFinishedWriter;
+		}
+		OnSegmentFinalized(finishedSegment, hr);
+		if (isCoInitialized) {
+			CoUninitialize();
+		}
+	}));
+	return S_OK;
+}
+
+void OutputManager::OnSegmentFinalized(_In_ OUTPUT_SEGMENT segment, _In_ HRESULT finalizeResult)
+{
+	EnterCriticalSection(&m_SegmentCriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_SegmentCriticalSection);
+	if (FAILED(finalizeResult)) {
+		LOG_ERROR(L"Failed to finalize output segment %ls: hr = 0x%08x", segment.Path.c_str(), finalizeResult);
+		if (SUCCEEDED(m_SegmentFinalizeResult)) {
+			m_SegmentFinalizeResult = finalizeResult;
+		}
+		return;
+	}
+	LOG_DEBUG(L"Finalized output segment %ls", segment.Path.c_str());
+	//Segments can finish finalizing out of order.
+	auto position = std::upper_bound(m_FinishedSegments.begin(), m_FinishedSegments.end(), segment, [](const OUTPUT_SEGMENT &a, const OUTPUT_SEGMENT &b) { return a.StartPos < b.StartPos; });
+	m_FinishedSegments.insert(position, segment);
+	SegmentManifestFormatInternal manifestFormat = GetOutputOptions()->GetSegmentManifestFormat();
+	if (manifestFormat != SegmentManifestFormatInternal::None) {
+		//The manifest is kept up to date while recording, so the finished segments are usable even if the recording never completes.
+		LOG_ON_BAD_HR(WriteSegmentManifest(GetSegmentManifestPath(m_OutputFullPath, manifestFormat), manifestFormat, m_FinishedSegments, false));
+	}
+}
+
+void OutputManager::WaitForSegmentTasks()
+{
+	m_TaskWrapperImpl->PrepareTask.wait();
+	m_TaskWrapperImpl->IsPreparing = false;
+	for (task<void> &finalizeTask : m_TaskWrapperImpl->FinalizeTasks) {
+		finalizeTask.wait();
+	}
+	m_TaskWrapperImpl->FinalizeTasks.clear();
+	std::unique_ptr<SEGMENT_WRITER> pUnusedWriter = std::move(m_TaskWrapperImpl->PreparedWriter);
+	if (pUnusedWriter) {
+		//The recording ended before the prepared segment was used, so it has no samples and can't be finalized.
+		pUnusedWriter->Stream.Release();
+		ShutdownMediaSink(pUnusedWriter->SinkWriter);
+		pUnusedWriter->SinkWriter.Release();
+		pUnusedWriter->Callback.Release();
+		pUnusedWriter->MediaTransform.Release();
+		if (WaitForSingleObject(pUnusedWriter->OutputClosedEvent, OUTPUT_CLOSE_TIMEOUT_MILLIS) != WAIT_OBJECT_0) {
+			LOG_WARN("Unused output segment was not released within %d ms", OUTPUT_CLOSE_TIMEOUT_MILLIS);
+		}
+		if (!DeleteFileW(pUnusedWriter->Path.c_str())) {
+			LOG_WARN(L"Failed to delete unused output segment %ls", pUnusedWriter->Path.c_str());
+		}
+	}
+}
+
+HRESULT OutputManager::FinalizeSegments(_In_ HRESULT lastSegmentResult)
+{
+	WaitForSegmentTasks();
+	OnSegmentFinalized(OUTPUT_SEGMENT{ GetSegmentPath(m_SegmentIndex), m_SegmentStartPos, m_LastFrameEndPos - m_SegmentStartPos }, lastSegmentResult);
+
+	EnterCriticalSection(&m_SegmentCriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_SegmentCriticalSection);
+	SegmentManifestFormatInternal manifestFormat = GetOutputOptions()->GetSegmentManifestFormat();
+	if (manifestFormat != SegmentManifestFormatInternal::None) {
+		LOG_ON_BAD_HR(WriteSegmentManifest(GetSegmentManifestPath(m_OutputFullPath, manifestFormat), manifestFormat, m_FinishedSegments, true));
+	}
+	//The segments are reported in the completion callback, in the same way as slideshow frames.
+	m_FrameManifest->Clear();
+	for (const OUTPUT_SEGMENT &segment : m_FinishedSegments) {
+		m_FrameManifest->Append(segment.Path, static_cast<int>(HundredNanosToMillis(segment.Duration)));
+	}
+	LOG_INFO(L"Recording was written to %zu segments", m_FinishedSegments.size());
+	return m_SegmentFinalizeResult;
+}
+
+HRESULT OutputManager::BeginReplayBuffer(_In_ SIZE videoOutputFrameSize)
+{
+	//The video stream is always the first stream of the sink writer.
+	m_ReplayBuffer = make_unique<ReplayBuffer>(0, MillisToHundredNanos(static_cast<double>(GetOutputOptions()->GetReplayBufferDuration().count())), GetOutputOptions()->GetReplayBufferMaxSize());
+	if (m_FinalizeEvent) {
+		m_CallBack.Attach(new (std::nothrow)CMFSinkWriterCallback(m_FinalizeEvent, nullptr));
+	}
+	RECT inputMediaFrameRect = RECT{ 0,0,videoOutputFrameSize.cx,videoOutputFrameSize.cy };
+	RETURN_ON_BAD_HR(InitializeVideoSinkWriter(nullptr, inputMediaFrameRect, videoOutputFrameSize, DXGI_MODE_ROTATION_UNSPECIFIED, m_CallBack, &m_UseManualNV12Converter, &m_MediaTransform, &m_SinkWriter, &m_VideoStreamIndex, &m_AudioStreamIndex));
+
+	//The sink writer has now set the encoder output types on the stream sinks. They are needed to write the samples to a container.
+	DWORD streamCount = 0;
+	RETURN_ON_BAD_HR(m_ReplaySink->GetStreamSinkCount(&streamCount));
+	for (DWORD i = 0; i < streamCount; i++) {
+		CComPtr<IMFStreamSink> pStreamSink = nullptr;
+		CComPtr<IMFMediaTypeHandler> pMediaTypeHandler = nullptr;
+		CComPtr<IMFMediaType> pMediaType = nullptr;
+		RETURN_ON_BAD_HR(m_ReplaySink->GetStreamSinkByIndex(i, &pStreamSink));
+		RETURN_ON_BAD_HR(pStreamSink->GetMediaTypeHandler(&pMediaTypeHandler));
+		RETURN_ON_BAD_HR(pMediaTypeHandler->GetCurrentMediaType(&pMediaType));
+		m_ReplayMediaTypes.push_back(pMediaType);
+	}
+	LOG_INFO(L"Replay buffer enabled with max duration %lld ms and max size %llu bytes", GetOutputOptions()->GetReplayBufferDuration().count(), GetOutputOptions()->GetReplayBufferMaxSize());
+	return S_OK;
+}
+
+HRESULT OutputManager::BeginAnimation(_In_ IStream *pStream)
+{
+	AnimationFormat format = GetOutputOptions()->GetAnimationFormat() == AnimationFormatInternal::Apng ? AnimationFormat::Apng : AnimationFormat::Gif;
+	m_LastFrameEndPos = 0;
+	m_AnimationWriter = make_unique<AnimationWriter>();
+	RETURN_ON_BAD_HR(m_AnimationWriter->Initialize(m_DeviceContext, m_Device));
+	RETURN_ON_BAD_HR(m_AnimationWriter->Begin(pStream, format));
+	LOG_INFO(L"Recording animation as %ls", format == AnimationFormat::Apng ? L"APNG" : L"GIF");
+	return S_OK;
+}
+
+void OutputManager::AddReplaySample(_In_ DWORD streamIndex, _In_ IMFSample *pSample)
+{
+	REPLAY_SAMPLE sample{};
+	sample.StreamIndex = streamIndex;
+	LOG_ON_BAD_HR(pSample->GetSampleTime(&sample.Time));
+	LOG_ON_BAD_HR(pSample->GetSampleDuration(&sample.Duration));
+	sample.IsKeyframe = MFGetAttributeUINT32(pSample, MFSampleExtension_CleanPoint, FALSE) != FALSE;
+
+	CComPtr<IMFMediaBuffer> pBuffer = nullptr;
+	BYTE *pData = nullptr;
+	DWORD cbData = 0;
+	if (FAILED(pSample->ConvertToContiguousBuffer(&pBuffer)) || FAILED(pBuffer->Lock(&pData, nullptr, &cbData))) {
+		LOG_ERROR(L"Failed to read encoded sample for the replay buffer");
+		return;
+	}
+	sample.Data.assign(pData, pData + cbData);
+	pBuffer->Unlock();
+	m_ReplayBuffer->AddSample(std::move(sample));
+}
+
+HRESULT OutputManager::SaveReplay(_In_ std::wstring path)
+{
+	if (!m_ReplayBuffer) {
+		return E_NOT_VALID_STATE;
+	}
+	CComPtr<IMFByteStream> pByteStream = nullptr;
+	RETURN_ON_BAD_HR(MFCreateFile(MF_ACCESSMODE_READWRITE, MF_OPENMODE_DELETE_IF_EXIST, MF_FILEFLAGS_NONE, path.c_str(), &pByteStream));
+	HRESULT hr = WriteReplay(pByteStream);
+	pByteStream->Close();
+	if (SUCCEEDED(hr)) {
+		LOG_INFO(L"Saved replay to %ls", path.c_str());
+	}
+	return hr;
+}
+
+HRESULT OutputManager::SaveReplay(_In_ IStream *pStream)
+{
+	if (!m_ReplayBuffer) {
+		return E_NOT_VALID_STATE;
+	}
+	CComPtr<IMFByteStream> pByteStream = nullptr;
+	RETURN_ON_BAD_HR(MFCreateMFByteStreamOnStream(pStream, &pByteStream));
+	return WriteReplay(pByteStream);
+}
+
+HRESULT OutputManager::WriteReplay(_In_ IMFByteStream *pByteStream)
+{
+	MeasureExecutionTime measure(L"WriteReplay");
+	//The samples are shared with the buffer, so the recording can keep adding samples while they are written.
+	std::vector<std::shared_ptr<const REPLAY_SAMPLE>> samples = m_ReplayBuffer->GetSamples();
+	if (samples.empty() || m_ReplayMediaTypes.empty()) {
+		LOG_WARN(L"Replay buffer is empty, nothing to save");
+		return E_NOT_VALID_STATE;
+	}
+	IMFMediaType *pAudioMediaType = m_ReplayMediaTypes.size() > m_AudioStreamIndex ? m_ReplayMediaTypes[m_AudioStreamIndex].p : nullptr;
+	CComPtr<IMFMediaSink> pMp4StreamSink = nullptr;
+	RETURN_ON_BAD_HR(MFCreateMPEG4MediaSink(pByteStream, m_ReplayMediaTypes[m_VideoStreamIndex], pAudioMediaType, &pMp4StreamSink));
+
+	CComPtr<IMFAttributes> pAttributes = nullptr;
+	RETURN_ON_BAD_HR(MFCreateAttributes(&pAttributes, 2));
+	RETURN_ON_BAD_HR(pAttributes->SetUINT32(MF_MPEG4SINK_MOOV_BEFORE_MDAT, GetEncoderOptions()->GetIsFastStartEnabled()));
+	//The samples are already encoded, so there is nothing to pace.
+	RETURN_ON_BAD_HR(pAttributes->SetUINT32(MF_SINK_WRITER_DISABLE_THROTTLING, TRUE));
+	CComPtr<IMFSinkWriter> pSinkWriter = nullptr;
+	RETURN_ON_BAD_HR(MFCreateSinkWriterFromMediaSink(pMp4StreamSink, pAttributes, &pSinkWriter));
+	pMp4StreamSink.Release();
+	//The input types are the same as the output types, so the samples are muxed as is without being encoded again.
+	for (DWORD i = 0; i < m_ReplayMediaTypes.size(); i++) {
+		RETURN_ON_BAD_HR(pSinkWriter->SetInputMediaType(i, m_ReplayMediaTypes[i], nullptr));
+	}
+	RETURN_ON_BAD_HR(pSinkWriter->BeginWriting());
+
+	//The buffer always starts with a video keyframe, which becomes the start of the replay.
+	INT64 startTime = samples.front()->Time;
+	auto WriteReplaySample([&](const REPLAY_SAMPLE &replaySample)->HRESULT {
+		DWORD cbData = static_cast<DWORD>(replaySample.Data.size());
+		CComPtr<IMFMediaBuffer> pBuffer = nullptr;
+		BYTE *pData = nullptr;
+		RETURN_ON_BAD_HR(MFCreateMemoryBuffer(cbData, &pBuffer));
+		RETURN_ON_BAD_HR(pBuffer->Lock(&pData, nullptr, nullptr));
+		memcpy(pData, replaySample.Data.data(), cbData);
+		pBuffer->Unlock();
+		RETURN_ON_BAD_HR(pBuffer->SetCurrentLength(cbData));
+		CComPtr<IMFSample> pSample = nullptr;
+		RETURN_ON_BAD_HR(MFCreateSample(&pSample));
+		RETURN_ON_BAD_HR(pSample->AddBuffer(pBuffer));
+		RETURN_ON_BAD_HR(pSample->SetSampleTime(replaySample.Time - startTime));
+		RETURN_ON_BAD_HR(pSample->SetSampleDuration(replaySample.Duration));
+		if (replaySample.IsKeyframe) {
+			RETURN_ON_BAD_HR(pSample->SetUINT32(MFSampleExtension_CleanPoint, TRUE));
+		}
+		return pSinkWriter->WriteSample(replaySample.StreamIndex, pSample);
+	});
+
+	HRESULT hr = S_OK;
+	for (const std::shared_ptr<const REPLAY_SAMPLE> &pReplaySample : samples) {
+		hr = WriteReplaySample(*pReplaySample);
+		if (FAILED(hr)) {
+			_com_error err(hr);
+			LOG_ERROR(L"Writing of replay sample with start pos %lld ms failed: %s", HundredNanosToMillis(pReplaySample->Time - startTime), err.ErrorMessage());
+			break;
+		}
+	}
+	if (SUCCEEDED(hr)) {
+		//Without an async callback, Finalize blocks until the file is complete.
+		hr = pSinkWriter->Finalize();
+	}
+	HRESULT shutdownResult = ShutdownMediaSink(pSinkWriter);
+	if (SUCCEEDED(hr) && FAILED(shutdownResult)) {
+		hr = shutdownResult;
+	}
+	REPLAY_BUFFER_STATS stats = m_ReplayBuffer->GetStats();
+	LOG_DEBUG(L"Wrote %zu replay samples, buffer holds %lld ms in %zu GOPs (%llu bytes), %llu GOPs dropped", samples.size(), HundredNanosToMillis(stats.Duration), stats.GopCount, stats.Bytes, stats.DroppedGops);
+	return hr;
+}
+
 HRESULT OutputManager::RenderFrame(_In_ FrameWriteModel &model) {
 	HRESULT hr(S_OK);
 	EnterCriticalSection(&m_CriticalSection);
@@ -195,7 +698,24 @@ HRESULT OutputManager::RenderFrame(_In_ FrameWriteModel &model) {
 	MeasureExecutionTime measure(L"RenderFrame");
 	auto recorderMode = GetOutputOptions()->GetRecorderMode();
 	if (recorderMode == RecorderModeInternal::Video) {
-		hr = WriteFrameToVideo(model.StartPos, model.Duration, m_VideoStreamIndex, model.Frame);
+		if (m_IsSegmentedOutput) {
+			if (IsSegmentLimitReached(model.StartPos, 1.0)) {
+				hr = StartNextSegment(model.StartPos);
+				if (FAILED(hr)) {
+					_com_error err(hr);
+					LOG_ERROR(L"Starting a new output segment at %lld ms failed: %s", (HundredNanosToMillis(model.StartPos)), err.ErrorMessage());
+					return hr;//Stop recording if we fail
+				}
+			}
+			else if (IsSegmentLimitReached(model.StartPos, SEGMENT_PREPARE_THRESHOLD)) {
+				PrepareNextSegment();
+			}
+		}
+		//Each segment is a separate file with timestamps starting at zero.
+		INT64 startPos = model.StartPos - m_SegmentStartPos;
+		if (model.Frame) {
+			hr = WriteFrameToVideo(startPos, model.Duration, m_VideoStreamIndex, model.Frame, model.IsFrameExclusive);
+		}
 		bool wroteAudioSample = false;
 		if (FAILED(hr)) {
 			_com_error err(hr);
@@ -222,7 +742,7 @@ HRESULT OutputManager::RenderFrame(_In_ FrameWriteModel &model) {
 		}
 
 		if (model.Audio.size() > 0) {
-			hr = WriteAudioSamplesToVideo(model.StartPos, model.Duration, m_AudioStreamIndex, &(model.Audio)[0], (DWORD)model.Audio.size());
+			hr = WriteAudioSamplesToVideo(startPos, model.Duration, m_AudioStreamIndex, &(model.Audio)[0], (DWORD)model.Audio.size());
 			if (FAILED(hr)) {
 				_com_error err(hr);
 				LOG_ERROR(L"Writing of audio sample with start pos %lld ms failed: %s", (HundredNanosToMillis(model.StartPos)), err.ErrorMessage());
@@ -232,24 +752,39 @@ HRESULT OutputManager::RenderFrame(_In_ FrameWriteModel &model) {
 				wroteAudioSample = true;
 			}
 		}
-		auto frameInfoStr = wroteAudioSample ? (paddedAudio ? L"video sample and audio padding" : L"video and audio sample") : L"video sample";
+		m_SegmentFrameCount++;
+		m_LastFrameEndPos = model.StartPos + model.Duration;
+		auto frameInfoStr = !model.Frame ? L"audio sample" : wroteAudioSample ? (paddedAudio ? L"video sample and audio padding" : L"video and audio sample") : L"video sample";
 		LOG_TRACE(L"Wrote %s with duration %.2f ms", frameInfoStr, HundredNanosToMillisDouble(model.Duration));
 	}
 	else if (recorderMode == RecorderModeInternal::Slideshow) {
 		wstring	path = m_OutputFolder + L"\\" + to_wstring(m_RenderedFrameCount) + GetSnapshotOptions()->GetImageExtension();
-		hr = WriteFrameToImage(model.Frame, path);
 		INT64 startposMs = HundredNanosToMillis(model.StartPos);
 		INT64 durationMs = HundredNanosToMillis(model.Duration);
+		//The frame is encoded in the background. Its delay is added to the frame delays once it is written, and an encoding error is returned by a later frame.
+		hr = m_SlideshowWriter ? m_SlideshowWriter->WriteFrame(path, m_RenderedFrameCount == 0 ? 0 : (int)durationMs, model.Frame) : E_NOT_VALID_STATE;
 		if (FAILED(hr)) {
 			_com_error err(hr);
 			LOG_ERROR(L"Writing of slideshow frame with start pos %lld ms failed: %s", startposMs, err.ErrorMessage());
 			return hr; //Stop recording if we fail
 		}
 		else {
-
-			m_FrameDelays.insert(std::pair<wstring, int>(path, m_RenderedFrameCount == 0 ? 0 : (int)durationMs));
-			LOG_TRACE(L"Wrote video slideshow frame with start pos %lld ms and with duration %lld ms", startposMs, durationMs);
+			LOG_TRACE(L"Queued video slideshow frame with start pos %lld ms and with duration %lld ms", startposMs, durationMs);
+		}
+	}
+	else if (recorderMode == RecorderModeInternal::Animation) {
+		INT64 startposMs = HundredNanosToMillis(model.StartPos);
+		if (model.Frame) {
+			//The frame is compared and encoded in the background, and an encoding error is returned by a later frame.
+			hr = m_AnimationWriter ? m_AnimationWriter->WriteFrame(static_cast<UINT64>(max(startposMs, 0LL)), model.Frame) : E_NOT_VALID_STATE;
+		}
+		if (FAILED(hr)) {
+			_com_error err(hr);
+			LOG_ERROR(L"Writing of animation frame with start pos %lld ms failed: %s", startposMs, err.ErrorMessage());
+			return hr; //Stop recording if we fail
 		}
+		m_LastFrameEndPos = model.StartPos + model.Duration;
+		LOG_TRACE(L"Queued animation frame with start pos %lld ms", startposMs);
 	}
 	else if (recorderMode == RecorderModeInternal::Screenshot) {
 		if (m_OutStream) {
@@ -268,11 +803,11 @@ HRESULT OutputManager::RenderFrame(_In_ FrameWriteModel &model) {
 
 HRESULT OutputManager::WriteFrameToImage(_In_ ID3D11Texture2D *pAcquiredDesktopImage, _In_ std::wstring filePath)
 {
-	return SaveWICTextureToFile(m_DeviceContext, pAcquiredDesktopImage, GetSnapshotOptions()->GetSnapshotEncoderFormat(), filePath.c_str());
+	return SaveSnapshotTextureToFile(m_DeviceContext, pAcquiredDesktopImage, GetSnapshotOptions()->GetImageEncoder(), GetSnapshotOptions()->GetSnapshotEncoderFormat(), filePath.c_str());
 }
 HRESULT OutputManager::WriteFrameToImage(_In_ ID3D11Texture2D *pAcquiredDesktopImage, _In_ IStream *pStream)
 {
-	return SaveWICTextureToStream(m_DeviceContext, pAcquiredDesktopImage, GetSnapshotOptions()->GetSnapshotEncoderFormat(), pStream);
+	return SaveSnapshotTextureToStream(m_DeviceContext, pAcquiredDesktopImage, GetSnapshotOptions()->GetImageEncoder(), GetSnapshotOptions()->GetSnapshotEncoderFormat(), pStream);
 }
 HRESULT OutputManager::StartMediaClock()
 {
@@ -406,11 +941,14 @@ HRESULT OutputManager::InitializeVideoSinkWriter(
 	_In_ SIZE outputFrameSize,
 	_In_ DXGI_MODE_ROTATION rotation,
 	_In_ IMFSinkWriterCallback *pCallback,
+	_Inout_ bool *pUseManualNV12Converter,
+	_Outptr_ IMFTransform **ppMediaTransform,
 	_Outptr_ IMFSinkWriter **ppWriter,
 	_Out_ DWORD *pVideoStreamIndex,
 	_Out_ DWORD *pAudioStreamIndex)
 {
 	*ppWriter = nullptr;
+	*ppMediaTransform = nullptr;
 	*pVideoStreamIndex = 0;
 	*pAudioStreamIndex = 0;
 
@@ -422,6 +960,7 @@ HRESULT OutputManager::InitializeVideoSinkWriter(
 	CComPtr<IMFMediaType>		  pVideoMediaTypeTransform = nullptr;
 	CComPtr<IMFMediaType>         pAudioMediaTypeIn = nullptr;
 	CComPtr<IMFAttributes>        pAttributes = nullptr;
+	CComPtr<IMFTransform>         pMediaTransform = nullptr;
 
 	MFVideoRotationFormat rotationFormat = MFVideoRotationFormat_0;
 	if (rotation == DXGI_MODE_ROTATION_ROTATE90) {
@@ -452,25 +991,34 @@ HRESULT OutputManager::InitializeVideoSinkWriter(
 	CopyMediaType(pVideoMediaTypeIntermediate, &pVideoMediaTypeTransform);
 	pVideoMediaTypeTransform->DeleteItem(MF_MT_FRAME_RATE);
 
-	RETURN_ON_BAD_HR(CreateIMFTransform(videoStreamIndex, pVideoMediaTypeIn, pVideoMediaTypeTransform, &m_MediaTransform));
+	RETURN_ON_BAD_HR(CreateIMFTransform(videoStreamIndex, pVideoMediaTypeIn, pVideoMediaTypeTransform, &pMediaTransform));
 
 	CComPtr<IMFAttributes> pTransformAttributes;
-	if (SUCCEEDED(m_MediaTransform->GetAttributes(&pTransformAttributes))) {
+	if (SUCCEEDED(pMediaTransform->GetAttributes(&pTransformAttributes))) {
 		UINT32 d3d11Aware = 0;
 		pTransformAttributes->GetUINT32(MF_SA_D3D11_AWARE, &d3d11Aware);
 		if (d3d11Aware > 0) {
-			HRESULT hr = m_MediaTransform->ProcessMessage(MFT_MESSAGE_SET_D3D_MANAGER, reinterpret_cast<ULONG_PTR>(m_DeviceManager.p));
+			HRESULT hr = pMediaTransform->ProcessMessage(MFT_MESSAGE_SET_D3D_MANAGER, reinterpret_cast<ULONG_PTR>(m_DeviceManager.p));
 			LOG_ON_BAD_HR(hr);
 		}
 	}
 
 	//Creates a streaming writer
-	CComPtr<IMFMediaSink> pMp4StreamSink = nullptr;
-	if (GetEncoderOptions()->GetIsFragmentedMp4Enabled()) {
-		RETURN_ON_BAD_HR(MFCreateFMPEG4MediaSink(pOutStream, pVideoMediaTypeOut, pAudioMediaTypeOut, &pMp4StreamSink));
+	CComPtr<IMFMediaSink> pMediaSink = nullptr;
+	if (m_ReplayBuffer) {
+		//The encoded samples are kept in memory instead of being written to a container.
+		std::vector<IMFMediaType *> mediaTypes{ pVideoMediaTypeOut };
+		if (pAudioMediaTypeOut) {
+			mediaTypes.push_back(pAudioMediaTypeOut);
+		}
+		RETURN_ON_BAD_HR(EncodedSampleSink::CreateInstance(mediaTypes, [this](DWORD streamIndex, IMFSample *pSample) { AddReplaySample(streamIndex, pSample); }, &pMediaSink));
+		m_ReplaySink = pMediaSink;
+	}
+	else if (GetEncoderOptions()->GetIsFragmentedMp4Enabled()) {
+		RETURN_ON_BAD_HR(MFCreateFMPEG4MediaSink(pOutStream, pVideoMediaTypeOut, pAudioMediaTypeOut, &pMediaSink));
 	}
 	else {
-		RETURN_ON_BAD_HR(MFCreateMPEG4MediaSink(pOutStream, pVideoMediaTypeOut, pAudioMediaTypeOut, &pMp4StreamSink));
+		RETURN_ON_BAD_HR(MFCreateMPEG4MediaSink(pOutStream, pVideoMediaTypeOut, pAudioMediaTypeOut, &pMediaSink));
 	}
 	pAudioMediaTypeOut.Release();
 
@@ -488,12 +1036,16 @@ HRESULT OutputManager::InitializeVideoSinkWriter(
 		default:
 			break;
 	}
+	if (m_ReplayBuffer) {
+		//The replay buffer is trimmed one group of pictures at a time, so keyframes must be frequent. Some encoders only insert keyframes on scene changes by default.
+		RETURN_ON_BAD_HR(pAttributes->SetUINT32(CODECAPI_AVEncMPVGOPSize, max(1U, GetEncoderOptions()->GetVideoFps())));
+	}
 	// Add device manager to attributes. This enables hardware encoding.
 	RETURN_ON_BAD_HR(pAttributes->SetUnknown(MF_SINK_WRITER_D3D_MANAGER, m_DeviceManager));
 	RETURN_ON_BAD_HR(pAttributes->SetUnknown(MF_SINK_WRITER_ASYNC_CALLBACK, pCallback));
 
-	RETURN_ON_BAD_HR(MFCreateSinkWriterFromMediaSink(pMp4StreamSink, pAttributes, &pSinkWriter));
-	pMp4StreamSink.Release();
+	RETURN_ON_BAD_HR(MFCreateSinkWriterFromMediaSink(pMediaSink, pAttributes, &pSinkWriter));
+	pMediaSink.Release();
 
 	LOG_TRACE("Input video format:")
 		LogMediaType(pVideoMediaTypeIn);
@@ -502,12 +1054,11 @@ HRESULT OutputManager::InitializeVideoSinkWriter(
 	LOG_TRACE("Output video format:")
 		LogMediaType(pVideoMediaTypeOut);
 
-	HRESULT hr = pSinkWriter->SetInputMediaType(videoStreamIndex, m_UseManualNV12Converter ? pVideoMediaTypeIntermediate : pVideoMediaTypeIn, nullptr);
-	if ((FAILED(hr) && !m_UseManualNV12Converter)) {
-		m_UseManualNV12Converter = true;
-		m_MediaTransform.Release();
+	HRESULT hr = pSinkWriter->SetInputMediaType(videoStreamIndex, *pUseManualNV12Converter ? pVideoMediaTypeIntermediate : pVideoMediaTypeIn, nullptr);
+	if ((FAILED(hr) && !*pUseManualNV12Converter)) {
+		*pUseManualNV12Converter = true;
 
-		return InitializeVideoSinkWriter(pOutStream, sourceRect, outputFrameSize, rotation, pCallback, ppWriter, pVideoStreamIndex, pAudioStreamIndex);
+		return InitializeVideoSinkWriter(pOutStream, sourceRect, outputFrameSize, rotation, pCallback, pUseManualNV12Converter, ppMediaTransform, ppWriter, pVideoStreamIndex, pAudioStreamIndex);
 	}
 	RETURN_ON_BAD_HR(hr);
 	if (pAudioMediaTypeIn) {
@@ -520,19 +1071,26 @@ HRESULT OutputManager::InitializeVideoSinkWriter(
 	// Return the pointer to the caller.
 	*ppWriter = pSinkWriter;
 	(*ppWriter)->AddRef();
+	*ppMediaTransform = pMediaTransform;
+	(*ppMediaTransform)->AddRef();
 	*pVideoStreamIndex = videoStreamIndex;
 	*pAudioStreamIndex = audioStreamIndex;
 	return S_OK;
 }
 
-HRESULT OutputManager::WriteFrameToVideo(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ DWORD streamIndex, _In_ ID3D11Texture2D *pAcquiredDesktopImage)
+HRESULT OutputManager::WriteFrameToVideo(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ DWORD streamIndex, _In_ ID3D11Texture2D *pAcquiredDesktopImage, _In_ bool isFrameExclusive)
 {
 	//The encoder works async, so the input frame has to be copied, else it can be overwritten before the encoder uses it. See issue #277.
 	CComPtr<ID3D11Texture2D> pFrameCopy;
-	D3D11_TEXTURE2D_DESC desc;
-	pAcquiredDesktopImage->GetDesc(&desc);
-	m_Device->CreateTexture2D(&desc, nullptr, &pFrameCopy);
-	m_DeviceContext->CopyResource(pFrameCopy, pAcquiredDesktopImage);
+	if (isFrameExclusive) {
+		pFrameCopy = pAcquiredDesktopImage;
+	}
+	else {
+		D3D11_TEXTURE2D_DESC desc;
+		pAcquiredDesktopImage->GetDesc(&desc);
+		m_Device->CreateTexture2D(&desc, nullptr, &pFrameCopy);
+		m_DeviceContext->CopyResource(pFrameCopy, pAcquiredDesktopImage);
+	}
 
 	IMFMediaBuffer *pMediaBuffer;
 	HRESULT hr = MFCreateDXGISurfaceBuffer(__uuidof(ID3D11Texture2D), pFrameCopy, 0, FALSE, &pMediaBuffer);
@@ -4,8 +4,14 @@
 #include "Util.h"
 #include "MF.util.h"
 #include "CMFSinkWriterCallback.h"
+#include "CloseNotifyingStream.h"
+#include "SegmentManifest.h"
+#include "EncodedSampleSink.h"
+#include "ReplayBuffer.h"
+#include "SlideshowWriter.h"
+#include "AnimationWriter.h"
 #include "cleanup.h"
-#include "fifo_map.h"
+#include "FrameManifest.h"
 #include <mfreadwrite.h>
 
 struct FrameWriteModel
@@ -16,8 +22,10 @@ struct FrameWriteModel
 	INT64 Duration;
 	//The audio sample bytes for this frame.
 	std::vector<BYTE> Audio;
-	//The frame texture.
+	//The frame texture. Can be null for outputs that skip frames, in which case only the audio is written.
 	CComPtr<ID3D11Texture2D> Frame;
+	//True if the frame texture is not used by anything else after it is written, so the encoder can use it without a copy.
+	bool IsFrameExclusive = false;
 };
 
 class OutputManager
@@ -39,8 +47,21 @@ public:
 	HRESULT RenderFrame(_In_ FrameWriteModel &model);
 	HRESULT WriteFrameToImage(_In_ ID3D11Texture2D *pAcquiredDesktopImage, _In_ std::wstring filePath);
 	HRESULT WriteFrameToImage(_In_ ID3D11Texture2D *pAcquiredDesktopImage, _In_ IStream *pStream);
-	inline nlohmann::fifo_map<std::wstring, int> GetFrameDelays() { return m_FrameDelays; }
+	/// <summary>
+	/// Returns the frames of a slideshow or the files of a segmented recording. Only complete once the recording is finalized.
+	/// </summary>
+	inline std::shared_ptr<FrameManifest> GetFrameManifest() { return m_FrameManifest; }
 	inline UINT64 GetRenderedFrameCount() { return m_RenderedFrameCount; }
+	/// <summary>
+	/// Writes the contents of the replay buffer to a new MP4 file while the recording continues.
+	/// </summary>
+	/// <returns>S_OK if successful, E_NOT_VALID_STATE if the replay buffer is not enabled or empty, else an error code.</returns>
+	HRESULT SaveReplay(_In_ std::wstring path);
+	/// <summary>
+	/// Writes the contents of the replay buffer as MP4 to a stream while the recording continues.
+	/// </summary>
+	/// <returns>S_OK if successful, E_NOT_VALID_STATE if the replay buffer is not enabled or empty, else an error code.</returns>
+	HRESULT SaveReplay(_In_ IStream *pStream);
 	HRESULT StartMediaClock();
 	HRESULT ResumeMediaClock();
 	HRESULT PauseMediaClock();
@@ -49,8 +70,44 @@ public:
 	bool isMediaClockRunning();
 	bool isMediaClockPaused();
 private:
-	ID3D11DeviceContext *m_DeviceContext = nullptr;
-	ID3D11Device *m_Device = nullptr;
+	//Max time to wait for the media sink to release the output file after finalizing.
+	static const DWORD OUTPUT_CLOSE_TIMEOUT_MILLIS = 5000;
+	//The fraction of the segment duration or size at which the sink writer for the next segment is created in the background.
+	static constexpr double SEGMENT_PREPARE_THRESHOLD = 0.8;
+	//File name of the slideshow manifest in the output folder.
+	static constexpr const wchar_t *SLIDESHOW_MANIFEST_FILE_NAME = L"frames.tsv";
+
+	/// <summary>
+	/// A sink writer and the resources it owns. Used to prepare the next segment of a segmented recording, and to hand a finished segment over to be finalized in the background.
+	/// </summary>
+	struct SEGMENT_WRITER
+	{
+		std::wstring Path;
+		CComPtr<IMFSinkWriter> SinkWriter;
+		CComPtr<IMFSinkWriterCallback> Callback;
+		CComPtr<IMFTransform> MediaTransform;
+		CComPtr<CloseNotifyingStream> Stream;
+		DWORD VideoStreamIndex = 0;
+		DWORD AudioStreamIndex = 0;
+		bool UseManualNV12Converter = false;
+		HANDLE FinalizeEvent = nullptr;
+		HANDLE OutputClosedEvent = nullptr;
+		~SEGMENT_WRITER()
+		{
+			if (FinalizeEvent) {
+				CloseHandle(FinalizeEvent);
+			}
+			if (OutputClosedEvent) {
+				CloseHandle(OutputClosedEvent);
+			}
+		}
+	};
+	struct TaskWrapper;
+	std::unique_ptr<TaskWrapper> m_TaskWrapperImpl;
+
+	//Owning references, as the output is finalized in the background after the recording has released its device.
+	CComPtr<ID3D11DeviceContext> m_DeviceContext;
+	CComPtr<ID3D11Device> m_Device;
 
 	CComPtr<IMFPresentationTimeSource> m_TimeSrc;
 	CComPtr<IMFPresentationClock> m_PresentationClock;
@@ -60,17 +117,19 @@ private:
 	std::shared_ptr<SNAPSHOT_OPTIONS> m_SnapshotOptions;
 	std::shared_ptr<OUTPUT_OPTIONS> m_OutputOptions;
 
-	nlohmann::fifo_map<std::wstring, int> m_FrameDelays;
+	std::shared_ptr<FrameManifest> m_FrameManifest;
 
 	CComPtr<IMFSinkWriter> m_SinkWriter;
 	CComPtr<IMFSinkWriterCallback> m_CallBack;
 	CComPtr<IMFTransform> m_MediaTransform;
 	CComPtr<IMFDXGIDeviceManager> m_DeviceManager;
 	UINT m_ResetToken;
-	IStream *m_OutStream;
+	CComPtr<IStream> m_OutStream;
 	DWORD m_VideoStreamIndex;
 	DWORD m_AudioStreamIndex;
 	HANDLE m_FinalizeEvent;
+	//Signaled when the output file has been released by the media sink.
+	HANDLE m_OutputClosedEvent;
 	std::wstring m_OutputFolder;
 	std::wstring m_OutputFullPath;
 	bool m_LastFrameHadAudio;
@@ -79,6 +138,31 @@ private:
 	CRITICAL_SECTION m_CriticalSection;
 	bool m_UseManualNV12Converter;
 
+	//The output file stream of the current segment, used to track its size.
+	CComPtr<CloseNotifyingStream> m_SegmentStream;
+	bool m_IsSegmentedOutput;
+	SIZE m_VideoOutputFrameSize;
+	//Index of the current segment. Segment 0 is written to the output path.
+	UINT m_SegmentIndex;
+	UINT64 m_SegmentFrameCount;
+	INT64 m_SegmentStartPos;
+	INT64 m_LastFrameEndPos;
+	//Segments that have been finalized. Guarded by m_SegmentCriticalSection, as segments are finalized in the background.
+	std::vector<OUTPUT_SEGMENT> m_FinishedSegments;
+	HRESULT m_SegmentFinalizeResult;
+	CRITICAL_SECTION m_SegmentCriticalSection;
+
+	//Holds the most recent encoded samples when the replay buffer is enabled. The sink writer then writes to m_ReplaySink instead of a file.
+	std::unique_ptr<ReplayBuffer> m_ReplayBuffer;
+	CComPtr<IMFMediaSink> m_ReplaySink;
+	//The media types of the encoded streams, in stream index order.
+	std::vector<CComPtr<IMFMediaType>> m_ReplayMediaTypes;
+
+	//Encodes slideshow frames on a pool of worker threads, so the recording thread only copies the frame.
+	std::unique_ptr<SlideshowWriter> m_SlideshowWriter;
+	//Compares and encodes animation frames on a pool of worker threads, so the recording thread only copies the frame.
+	std::unique_ptr<AnimationWriter> m_AnimationWriter;
+
 	std::shared_ptr<AUDIO_OPTIONS> GetAudioOptions() { return m_AudioOptions; }
 	std::shared_ptr<ENCODER_OPTIONS> GetEncoderOptions() { return m_EncoderOptions; }
 	std::shared_ptr<SNAPSHOT_OPTIONS> GetSnapshotOptions() { return m_SnapshotOptions; }
@@ -86,8 +170,61 @@ private:
 
 	HRESULT ConfigureOutputMediaTypes(_In_ UINT destWidth, _In_ UINT destHeight, _Outptr_ IMFMediaType **pVideoMediaTypeOut, _Outptr_result_maybenull_ IMFMediaType **pAudioMediaTypeOut);
 	HRESULT ConfigureInputMediaTypes(_In_ UINT sourceWidth, _In_ UINT sourceHeight, _In_ MFVideoRotationFormat rotationFormat, _In_ IMFMediaType *pVideoMediaTypeOut, _Outptr_ IMFMediaType **pVideoMediaTypeIn, _Outptr_result_maybenull_ IMFMediaType **pAudioMediaTypeIn);
-	HRESULT InitializeVideoSinkWriter(_In_ IMFByteStream *pOutStream, _In_ RECT sourceRect, _In_ SIZE outputFrameSize, _In_ DXGI_MODE_ROTATION rotation, _In_ IMFSinkWriterCallback *pCallback, _Outptr_ IMFSinkWriter **ppWriter, _Out_ DWORD *pVideoStreamIndex, _Out_ DWORD *pAudioStreamIndex);
-	HRESULT WriteFrameToVideo(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ DWORD streamIndex, _In_ ID3D11Texture2D *pAcquiredDesktopImage);
+	HRESULT InitializeVideoSinkWriter(_In_ IMFByteStream *pOutStream, _In_ RECT sourceRect, _In_ SIZE outputFrameSize, _In_ DXGI_MODE_ROTATION rotation, _In_ IMFSinkWriterCallback *pCallback, _Inout_ bool *pUseManualNV12Converter, _Outptr_ IMFTransform **ppMediaTransform, _Outptr_ IMFSinkWriter **ppWriter, _Out_ DWORD *pVideoStreamIndex, _Out_ DWORD *pAudioStreamIndex);
+	/// <summary>
+	/// Creates a file and a sink writer that writes to it.
+	/// </summary>
+	HRESULT CreateFileSinkWriter(_In_ std::wstring path, _In_ SIZE videoOutputFrameSize, _Inout_ SEGMENT_WRITER *pWriter);
+	/// <summary>
+	/// Exchanges the active sink writer with the one in pWriter.
+	/// </summary>
+	void SwapSinkWriter(_Inout_ SEGMENT_WRITER *pWriter);
+	/// <summary>
+	/// Finalizes the sink writer and shuts down its media sink.
+	/// </summary>
+	/// <param name="hOutputClosedEvent">If set, waits for this event to be signaled after shutting down, i.e. until the output file is released.</param>
+	HRESULT FinalizeSinkWriter(_Inout_ CComPtr<IMFSinkWriter> &pSinkWriter, _In_ HANDLE hFinalizeEvent, _In_opt_ HANDLE hOutputClosedEvent);
+	HRESULT ShutdownMediaSink(_Inout_ CComPtr<IMFSinkWriter> &pSinkWriter);
+	/// <summary>
+	/// Returns true if the current segment has reached the given fraction of the segment duration or size limit.
+	/// </summary>
+	bool IsSegmentLimitReached(_In_ INT64 frameStartPos, _In_ double fraction);
+	std::wstring GetSegmentPath(_In_ UINT segmentIndex);
+	/// <summary>
+	/// Starts creating the sink writer for the next segment in the background, if not already started.
+	/// </summary>
+	void PrepareNextSegment();
+	/// <summary>
+	/// Switches to the sink writer for the next segment, and finalizes the current segment in the background.
+	/// </summary>
+	/// <param name="frameStartPos">The start of the first frame in the new segment.</param>
+	HRESULT StartNextSegment(_In_ INT64 frameStartPos);
+	void OnSegmentFinalized(_In_ OUTPUT_SEGMENT segment, _In_ HRESULT finalizeResult);
+	/// <summary>
+	/// Waits for all background segment work, and deletes the file of a prepared segment that was never used.
+	/// </summary>
+	void WaitForSegmentTasks();
+	/// <summary>
+	/// Waits for all segments to be finalized, and writes the final manifest.
+	/// </summary>
+	HRESULT FinalizeSegments(_In_ HRESULT lastSegmentResult);
+	/// <summary>
+	/// Creates the replay buffer and a sink writer that writes encoded samples to it.
+	/// </summary>
+	HRESULT BeginReplayBuffer(_In_ SIZE videoOutputFrameSize);
+	/// <summary>
+	/// Creates the animation writer and starts an animation in the format of the output options.
+	/// </summary>
+	HRESULT BeginAnimation(_In_ IStream *pStream);
+	/// <summary>
+	/// Copies an encoded sample into the replay buffer. Called by the replay sink.
+	/// </summary>
+	void AddReplaySample(_In_ DWORD streamIndex, _In_ IMFSample *pSample);
+	/// <summary>
+	/// Remuxes the encoded samples in the replay buffer to an MP4 byte stream.
+	/// </summary>
+	HRESULT WriteReplay(_In_ IMFByteStream *pByteStream);
+	HRESULT WriteFrameToVideo(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ DWORD streamIndex, _In_ ID3D11Texture2D *pAcquiredDesktopImage, _In_ bool isFrameExclusive = false);
 
 	HRESULT WriteAudioSamplesToVideo(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ DWORD streamIndex, _In_ BYTE *pSrc, _In_ DWORD cbData);
 };
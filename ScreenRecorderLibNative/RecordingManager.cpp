@@ -1,6 +1,7 @@
 #include <ppltasks.h> 
 #include <concrt.h>
 #include <mfidl.h>
+#include <dxgi1_4.h>
 #include <VersionHelpers.h>
 #include <filesystem>
 #include <WinSDKVer.h>
@@ -12,8 +13,10 @@
 #include "WindowsGraphicsCapture.util.h"
 #include "Cleanup.h"
 #include "Screengrab.h"
+#include "SnapshotEncoder.h"
 #include "DynamicWait.h"
 #include "HighresTimer.h"
+#include "FrameTiming.h"
 
 #pragma comment(lib, "dxguid.lib")
 #pragma comment(lib, "D3D11.lib")
@@ -75,7 +78,10 @@ RecordingManager::RecordingManager() :
 	m_TextureManager(nullptr),
 	m_OutputManager(nullptr),
 	m_CaptureManager(nullptr),
+	m_ScreenshotCaptureManager(nullptr),
 	m_MouseManager(nullptr),
+	m_AudioManager(nullptr),
+	m_OutputFinalizer(make_unique<OutputFinalizer>(MAX_CONCURRENT_FINALIZATIONS)),
 	m_EncoderOptions(new H264_ENCODER_OPTIONS()),
 	m_AudioOptions(new AUDIO_OPTIONS),
 	m_MouseOptions(new MOUSE_OPTIONS),
@@ -84,18 +90,17 @@ RecordingManager::RecordingManager() :
 	m_IsDestructing(false),
 	m_RecordingSources{},
 	m_DxResources{},
-	m_FrameDataCallbackTexture(nullptr)
+	m_FrameReadback(nullptr),
+	m_FrameExportWriter(nullptr),
+	m_FrameExportReadback(nullptr),
+	m_VideoSnapshotWriter(nullptr),
+	m_Renditions{}
 {
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
+	InitializeCriticalSection(&m_DeviceResourcesCriticalSection);
+	InitializeCriticalSection(&m_OutputManagerCriticalSection);
 	m_MfStartupResult = MFStartup(MF_VERSION, MFSTARTUP_LITE);
-	TIMECAPS tc;
-	UINT targetResolutionMs = 1;
-	if (timeGetDevCaps(&tc, sizeof(TIMECAPS)) == TIMERR_NOERROR)
-	{
-		m_TimerResolution = min(max(tc.wPeriodMin, targetResolutionMs), tc.wPeriodMax);
-		timeBeginPeriod(m_TimerResolution);
-	}
-	RtlZeroMemory(&m_FrameDataCallbackTextureDesc, sizeof(m_FrameDataCallbackTextureDesc));
+	m_TimingService = TimingService::Acquire();
 }
 
 RecordingManager::~RecordingManager()
@@ -107,14 +112,15 @@ RecordingManager::~RecordingManager()
 		m_TaskWrapperImpl->m_RecordTask.wait();
 		LOG_DEBUG("Wait for recording task completed.");
 	}
+	//Completion callbacks are not sent for recordings that are still finalizing when destructing.
+	m_IsDestructing = true;
+	m_OutputFinalizer.reset();
 
-	if (m_TimerResolution > 0) {
-		timeEndPeriod(m_TimerResolution);
-	}
-	SafeRelease(&m_FrameDataCallbackTexture);
 	ClearRecordingSources();
 	ClearOverlays();
-	CleanDx(&m_DxResources);
+	ReleaseDeviceResources();
+	DeleteCriticalSection(&m_DeviceResourcesCriticalSection);
+	DeleteCriticalSection(&m_OutputManagerCriticalSection);
 	MFShutdown();
 	LOG_INFO(L"Media Foundation shut down");
 }
@@ -156,8 +162,10 @@ HRESULT RecordingManager::ConfigureOutputDir(_In_ std::wstring path) {
 			return E_FAIL;
 		}
 
-		if (recorderMode == RecorderModeInternal::Video || recorderMode == RecorderModeInternal::Screenshot) {
-			wstring ext = recorderMode == RecorderModeInternal::Video ? m_EncoderOptions->GetVideoExtension() : m_SnapshotOptions->GetImageExtension();
+		if (recorderMode == RecorderModeInternal::Video || recorderMode == RecorderModeInternal::Screenshot || recorderMode == RecorderModeInternal::Animation) {
+			wstring ext = recorderMode == RecorderModeInternal::Video ? m_EncoderOptions->GetVideoExtension()
+				: recorderMode == RecorderModeInternal::Animation ? GetOutputOptions()->GetAnimationExtension()
+				: m_SnapshotOptions->GetImageExtension();
 			LPWSTR pStrExtension = PathFindExtension(path.c_str());
 			if (pStrExtension == nullptr || pStrExtension[0] == 0)
 			{
@@ -189,6 +197,31 @@ HRESULT RecordingManager::TakeSnapshot(_In_ IStream *stream)
 	return TakeSnapshot(L"", stream);
 }
 
+HRESULT RecordingManager::SaveReplay(_In_ std::wstring path)
+{
+	if (path.empty()) {
+		LOG_ERROR(L"Failed to save replay due to path parameter being empty");
+		return E_INVALIDARG;
+	}
+	//Held for the whole write, so the output isn't handed over for finalization and deleted while the replay is written from it.
+	EnterCriticalSection(&m_OutputManagerCriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_OutputManagerCriticalSection);
+	if (!m_IsRecording || !m_OutputManager) {
+		return E_NOT_VALID_STATE;
+	}
+	return m_OutputManager->SaveReplay(path);
+}
+
+HRESULT RecordingManager::SaveReplay(_In_ IStream *stream)
+{
+	EnterCriticalSection(&m_OutputManagerCriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_OutputManagerCriticalSection);
+	if (!m_IsRecording || !m_OutputManager) {
+		return E_NOT_VALID_STATE;
+	}
+	return m_OutputManager->SaveReplay(stream);
+}
+
 HRESULT RecordingManager::TakeSnapshot(_In_opt_ std::wstring path, _In_opt_ IStream *stream, _In_opt_ ID3D11Texture2D *pTexture) {
 	if (!m_IsRecording) {
 		return E_NOT_VALID_STATE;
@@ -252,6 +285,218 @@ HRESULT RecordingManager::TakeSnapshot(_In_opt_ std::wstring path, _In_opt_ IStr
 	return hr;
 }
 
+HRESULT RecordingManager::TakeScreenshot(_In_ std::wstring path)
+{
+	if (path.empty()) {
+		if (GetSnapshotOptions()->GetSnapshotsDirectory().empty()) {
+			LOG_ERROR(L"Failed to take screenshot due to path parameter being empty");
+			return E_INVALIDARG;
+		}
+		path = GetSnapshotOptions()->GetSnapshotsDirectory() + L"\\" + s2ws(CurrentTimeToFormattedString(true)) + GetSnapshotOptions()->GetImageExtension();
+	}
+	return TakeScreenshot(path, nullptr);
+}
+
+HRESULT RecordingManager::TakeScreenshot(_In_ IStream *stream)
+{
+	if (!stream) {
+		LOG_ERROR(L"Failed to take screenshot due to stream parameter being null");
+		return E_INVALIDARG;
+	}
+	return TakeScreenshot(L"", stream);
+}
+
+HRESULT RecordingManager::TakeScreenshot(_In_opt_ std::wstring path, _In_opt_ IStream *pStream)
+{
+	if (m_IsRecording) {
+		LOG_ERROR(L"Screenshots can not be taken while recording, use TakeSnapshot instead");
+		return E_NOT_VALID_STATE;
+	}
+	if (m_RecordingSources.size() == 0) {
+		LOG_ERROR(L"No valid recording sources found in recorder parameters.");
+		return E_INVALIDARG;
+	}
+	if (!m_Overlays.empty()) {
+		LOG_WARN(L"Overlays are not drawn on screenshots taken with TakeScreenshot");
+	}
+	MeasureExecutionTime measure(L"TakeScreenshot");
+	HRESULT hr = CoInitializeEx(nullptr, COINITBASE_MULTITHREADED | COINIT_DISABLE_OLE1DDE);
+	//The calling thread may already be initialized with another apartment model, which works just as well.
+	bool isComInitialized = SUCCEEDED(hr);
+	ExecuteFuncOnExit uninitializeOnExit([&]() {
+		if (isComInitialized) {
+			CoUninitialize();
+		}
+	});
+	//Cool must not release the device while the screenshot uses it.
+	EnterCriticalSection(&m_DeviceResourcesCriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_DeviceResourcesCriticalSection);
+	//Unless the recorder is warm, the device only lives for this screenshot.
+	ExecuteFuncOnExit releaseResourcesOnExit([&]() {
+		if (!m_IsWarm) {
+			ReleaseDeviceResources();
+		}
+	});
+	//A screenshot shows no clicks, so the mouse hook is not installed for it.
+	RETURN_ON_BAD_HR(hr = InitializeDeviceResources(false));
+
+	//While the recorder is warm, the capture manager is kept with the captures of the sources for the next screenshot.
+	std::unique_ptr<ScreenCaptureManager> pCaptureManager = std::move(m_ScreenshotCaptureManager);
+	if (!pCaptureManager) {
+		pCaptureManager = make_unique<ScreenCaptureManager>();
+	}
+	ExecuteFuncOnExit keepCaptureManagerOnExit([&]() {
+		if (m_IsWarm) {
+			m_ScreenshotCaptureManager = std::move(pCaptureManager);
+		}
+	});
+	RETURN_ON_BAD_HR(hr = pCaptureManager->Initialize(m_DxResources.Context, m_DxResources.Device, GetOutputOptions(), GetEncoderOptions(), GetMouseOptions()));
+	CAPTURED_FRAME capturedFrame{};
+	RETURN_ON_BAD_HR(hr = pCaptureManager->CaptureSingleFrame(m_RecordingSources, MAX_SCREENSHOT_FRAME_WAIT_MILLIS, &capturedFrame));
+
+	RECT videoInputFrameRect{};
+	SIZE videoOutputFrameSize{};
+	RETURN_ON_BAD_HR(hr = InitializeRects(pCaptureManager->GetOutputSize(), &videoInputFrameRect, &videoOutputFrameSize));
+	SetViewPort(m_DxResources.Context, static_cast<float>(videoOutputFrameSize.cx), static_cast<float>(videoOutputFrameSize.cy));
+	if (capturedFrame.PtrInfo) {
+		hr = m_MouseManager->ProcessMousePointer(capturedFrame.Frame, &capturedFrame.PtrInfo.value());
+		if (FAILED(hr)) {
+			_com_error err(hr);
+			LOG_ERROR(L"Error drawing mouse pointer: %s", err.ErrorMessage());
+		}
+	}
+	CComPtr<ID3D11Texture2D> pProcessedTexture;
+	RETURN_ON_BAD_HR(hr = ProcessTextureTransforms(capturedFrame.Frame, &pProcessedTexture, videoInputFrameRect, videoOutputFrameSize));
+
+	if (!path.empty()) {
+		std::wstring directory = std::filesystem::path(path).parent_path().wstring();
+		if (!directory.empty() && !std::filesystem::exists(directory))
+		{
+			std::error_code ec;
+			if (!std::filesystem::create_directories(directory, ec)) {
+				LOG_ERROR(L"failed to create screenshot output folder");
+				return E_FAIL;
+			}
+		}
+		RETURN_ON_BAD_HR(hr = SaveSnapshotTextureToFile(m_DxResources.Context, pProcessedTexture, GetSnapshotOptions()->GetImageEncoder(), GetSnapshotOptions()->GetSnapshotEncoderFormat(), path.c_str()));
+		LOG_TRACE(L"Wrote screenshot to %s", path.c_str());
+	}
+	else if (pStream) {
+		RETURN_ON_BAD_HR(hr = SaveSnapshotTextureToStream(m_DxResources.Context, pProcessedTexture, GetSnapshotOptions()->GetImageEncoder(), GetSnapshotOptions()->GetSnapshotEncoderFormat(), pStream));
+		LOG_TRACE(L"Wrote screenshot to stream");
+	}
+	else {
+		LOG_ERROR("Screenshot failed: No valid stream or path provided.");
+		hr = E_INVALIDARG;
+	}
+	return hr;
+}
+
+HRESULT RecordingManager::Warm(_In_ UINT64 maxVideoMemoryBytes)
+{
+	EnterCriticalSection(&m_DeviceResourcesCriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_DeviceResourcesCriticalSection);
+	m_WarmMaxVideoMemoryBytes = maxVideoMemoryBytes;
+	if (m_IsWarm) {
+		return S_FALSE;
+	}
+	m_IsWarm = true;
+	if (m_IsRecording) {
+		//The resources of the current recording are kept when it ends.
+		return S_OK;
+	}
+	MeasureExecutionTime measure(L"Warm");
+	HRESULT hr = InitializeDeviceResources(false);
+	if (FAILED(hr)) {
+		LOG_ERROR(L"Failed to warm up recorder: hr = 0x%08x", hr);
+		m_IsWarm = false;
+		ReleaseDeviceResources();
+		return hr;
+	}
+	LOG_INFO(L"Recorder is warm");
+	return hr;
+}
+
+void RecordingManager::Cool()
+{
+	EnterCriticalSection(&m_DeviceResourcesCriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_DeviceResourcesCriticalSection);
+	if (!m_IsWarm) {
+		return;
+	}
+	m_IsWarm = false;
+	if (!m_IsRecording) {
+		ReleaseDeviceResources();
+	}
+	LOG_INFO(L"Recorder is cool");
+}
+
+HRESULT RecordingManager::InitializeDeviceResources(_In_ bool isMouseClickDetectionEnabled)
+{
+	EnterCriticalSection(&m_DeviceResourcesCriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_DeviceResourcesCriticalSection);
+	HRESULT hr = S_OK;
+	if (m_DxResources.Device) {
+		//The device may have been removed since it was warmed up, e.g. by a driver update or GPU reset.
+		hr = m_DxResources.Device->GetDeviceRemovedReason();
+		if (SUCCEEDED(hr) && m_TextureManager && m_MouseManager) {
+			m_MouseManager->SetMouseClickDetectionEnabled(isMouseClickDetectionEnabled);
+			m_MouseManager->SetOptions(GetMouseOptions());
+			LOG_DEBUG(L"Reusing warm DirectX resources");
+			return S_OK;
+		}
+		LOG_WARN(L"Warm DirectX resources are not usable, recreating: hr = 0x%08x", hr);
+		ReleaseDeviceResources();
+	}
+	RETURN_ON_BAD_HR(hr = InitializeDx(nullptr, &m_DxResources));
+	m_TextureManager = make_unique<TextureManager>();
+	RETURN_ON_BAD_HR(hr = m_TextureManager->Initialize(m_DxResources.Context, m_DxResources.Device));
+	m_MouseManager = make_unique<MouseManager>();
+	m_MouseManager->SetMouseClickDetectionEnabled(isMouseClickDetectionEnabled);
+	RETURN_ON_BAD_HR(hr = m_MouseManager->Initialize(m_DxResources.Context, m_DxResources.Device, GetMouseOptions()));
+	return hr;
+}
+
+void RecordingManager::ReleaseDeviceResources()
+{
+	EnterCriticalSection(&m_DeviceResourcesCriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_DeviceResourcesCriticalSection);
+	m_ScreenshotCaptureManager.reset(nullptr);
+	m_AudioManager.reset(nullptr);
+	m_MouseManager.reset(nullptr);
+	m_TextureManager.reset(nullptr);
+	CleanupDxResources();
+}
+
+void RecordingManager::ReleaseScreenshotCaptures()
+{
+	EnterCriticalSection(&m_DeviceResourcesCriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_DeviceResourcesCriticalSection);
+	m_ScreenshotCaptureManager.reset(nullptr);
+}
+
+bool RecordingManager::IsWarmMemoryLimitExceeded()
+{
+	if (m_WarmMaxVideoMemoryBytes == 0 || !m_DxResources.Device) {
+		return false;
+	}
+	CComPtr<IDXGIAdapter> pAdapter;
+	CComPtr<IDXGIAdapter3> pAdapter3;
+	if (FAILED(GetAdapterForDevice(m_DxResources.Device, &pAdapter))
+		|| FAILED(pAdapter->QueryInterface(__uuidof(IDXGIAdapter3), reinterpret_cast<void **>(&pAdapter3)))) {
+		return false;
+	}
+	DXGI_QUERY_VIDEO_MEMORY_INFO memoryInfo{};
+	if (FAILED(pAdapter3->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &memoryInfo))) {
+		return false;
+	}
+	if (memoryInfo.CurrentUsage > m_WarmMaxVideoMemoryBytes) {
+		LOG_INFO(L"Video memory usage of %llu bytes exceeds the warm limit of %llu bytes", memoryInfo.CurrentUsage, m_WarmMaxVideoMemoryBytes);
+		return true;
+	}
+	return false;
+}
+
 HRESULT RecordingManager::BeginRecording(_In_ IStream *stream) {
 	return BeginRecording(L"", stream);
 }
@@ -290,39 +535,71 @@ HRESULT RecordingManager::BeginRecording(_In_opt_ std::wstring path, _In_opt_ IS
 			RecordingFailedCallback(error, L"");
 		return S_FALSE;
 	}
+	//The recording starts captures of its own, which would otherwise run alongside the screenshot captures of the same sources.
+	ReleaseScreenshotCaptures();
 	m_IsRecording = true;
+	m_BeginRecordingTime = steady_clock::now();
+	m_LastStartupLatencyMillis = -1;
+	if (stream) {
+		//The stream is owned by the recording until it is finalized.
+		stream->AddRef();
+	}
+	//The output of the recording is handed over from the recording task to its continuation, which queues it for finalization.
+	auto pFinishedOutput = make_shared<unique_ptr<OutputManager>>(nullptr);
 	m_TaskWrapperImpl->m_RecordTaskCts = cancellation_token_source();
-	m_TaskWrapperImpl->m_RecordTask = concurrency::create_task([this, stream]() {
+	m_TaskWrapperImpl->m_RecordTask = concurrency::create_task([this, stream, pFinishedOutput]() {
 		LOG_INFO(L"Starting recording task");
+		ReleaseOnExit releaseStream(stream);
 		REC_RESULT result{};
 		HRESULT hr = CoInitializeEx(nullptr, COINITBASE_MULTITHREADED | COINIT_DISABLE_OLE1DDE);
 		RETURN_RESULT_ON_BAD_HR(hr, L"CoInitializeEx failed");
-		RETURN_RESULT_ON_BAD_HR(hr = InitializeDx(nullptr, &m_DxResources), L"Failed to initialize DirectX");
+		RETURN_RESULT_ON_BAD_HR(hr = InitializeDeviceResources(true), L"Failed to initialize DirectX resources");
 
-		m_TextureManager = make_unique<TextureManager>();
-		RETURN_RESULT_ON_BAD_HR(hr = m_TextureManager->Initialize(m_DxResources.Context, m_DxResources.Device), L"Failed to initialize TextureManager");
-		m_OutputManager = make_unique<OutputManager>();
+		{
+			EnterCriticalSection(&m_OutputManagerCriticalSection);
+			LeaveCriticalSectionOnExit leaveOnExit(&m_OutputManagerCriticalSection);
+			m_OutputManager = make_unique<OutputManager>();
+		}
 		RETURN_RESULT_ON_BAD_HR(hr = m_OutputManager->Initialize(m_DxResources.Context, m_DxResources.Device, GetEncoderOptions(), GetAudioOptions(), GetSnapshotOptions(), GetOutputOptions()), L"Failed to initialize OutputManager");
 		m_CaptureManager = make_unique<ScreenCaptureManager>();
 		RETURN_RESULT_ON_BAD_HR(m_CaptureManager->Initialize(m_DxResources.Context, m_DxResources.Device, GetOutputOptions(), GetEncoderOptions(), GetMouseOptions()), L"Failed to initialize ScreenCaptureManager");
-		m_MouseManager = make_unique<MouseManager>();
-		RETURN_RESULT_ON_BAD_HR(hr = m_MouseManager->Initialize(m_DxResources.Context, m_DxResources.Device, GetMouseOptions()), L"Failed to initialize mouse manager");
 
+		TIMER_SCHEDULE_STATS timingStatsAtStart = m_TimingService->GetStats();
 		result = StartRecorderLoop(m_RecordingSources, m_Overlays, stream);
-		if (RecordingStatusChangedCallback != nullptr && !m_IsDestructing) {
-			RecordingStatusChangedCallback(STATUS_FINALIZING);
+		TIMER_SCHEDULE_STATS timingStats = m_TimingService->GetStats();
+		UINT64 timerTicks = timingStats.Ticks - timingStatsAtStart.Ticks;
+		LOG_INFO(L"Timing service: %llu timer wakeups for %llu ticks of %llu timers, %llu ticks missed, %.3f ms average lateness",
+			timingStats.Wakeups - timingStatsAtStart.Wakeups, timerTicks, timingStats.ActiveTimers, timingStats.MissedTicks - timingStatsAtStart.MissedTicks,
+			timerTicks > 0 ? HundredNanosToMillisDouble((timingStats.TotalLateness - timingStatsAtStart.TotalLateness) / (INT64)timerTicks) : 0);
+		if (m_FrameReadback) {
+			//Deliver the last previewed frames before the recording status changes.
+			if (!m_IsDestructing) {
+				m_FrameReadback->Flush();
+			}
+			TEXTURE_READBACK_STATS stats = m_FrameReadback->GetStats();
+			LOG_INFO(L"Frame preview readback: %llu frames read back, %llu skipped by max fps, %llu dropped by slow consumer, %llu waits for GPU", stats.ReadbackFrames, stats.SkippedFrames, stats.DroppedFrames, stats.BlockingMaps);
+			m_FrameReadback.reset();
+		}
+		EndFrameExport();
+		EndCursorTrack();
+		EndRenditions();
+		EndVideoSnapshots();
+		{
+			//Waits for a replay that is being saved from the output.
+			EnterCriticalSection(&m_OutputManagerCriticalSection);
+			LeaveCriticalSectionOnExit leaveOnExit(&m_OutputManagerCriticalSection);
+			*pFinishedOutput = std::move(m_OutputManager);
+		}
+		if (m_AudioManager) {
+			m_AudioManager->StopCapture();
 		}
-		result.FinalizeResult = m_OutputManager->FinalizeRecording();
 		CoUninitialize();
 
 		LOG_INFO("Exiting recording task");
 		return result;
-		}).then([this](concurrency::task<REC_RESULT> t)
+		}).then([this, pFinishedOutput](concurrency::task<REC_RESULT> t)
 				{
 					m_CaptureManager.reset(nullptr);
-					m_MouseManager.reset(nullptr);
-					m_IsRecording = false;
-					m_IsPaused = false;
 					REC_RESULT result{ };
 					try {
 						result = t.get();
@@ -331,13 +608,57 @@ HRESULT RecordingManager::BeginRecording(_In_opt_ std::wstring path, _In_opt_ IS
 					catch (...) {
 						LOG_ERROR(L"Exception in RecordTask");
 					}
-					CleanupDxResources();
-					if (!m_IsDestructing) {
-						nlohmann::fifo_map<std::wstring, int> delays{};
-						if (m_OutputManager) {
-							delays = m_OutputManager->GetFrameDelays();
+					{
+						//Warm and Cool may be called while the recording ends, and must see the resources either kept or released.
+						EnterCriticalSection(&m_DeviceResourcesCriticalSection);
+						LeaveCriticalSectionOnExit leaveOnExit(&m_DeviceResourcesCriticalSection);
+						if (m_IsWarm && !m_IsDestructing && !IsWarmMemoryLimitExceeded()) {
+							if (m_MouseManager) {
+								m_MouseManager->SetMouseClickDetectionEnabled(false);
+							}
+						}
+						else {
+							if (m_IsWarm) {
+								m_IsWarm = false;
+								LOG_INFO(L"Recorder is cool");
+							}
+							ReleaseDeviceResources();
+						}
+					}
+					std::wstring outputPath = m_OutputFullPath;
+					HRESULT encoderResult = m_EncoderResult;
+					if (*pFinishedOutput) {
+						//Finalizing can take seconds for large recordings, so it is done in the background and a new recording can start right away.
+						m_IsRecording = false;
+						m_IsPaused = false;
+						if (RecordingStatusChangedCallback != nullptr && !m_IsDestructing) {
+							RecordingStatusChangedCallback(STATUS_FINALIZING);
+						}
+						m_OutputFinalizer->Finalize(std::move(*pFinishedOutput), [this, result, outputPath, encoderResult](HRESULT finalizeResult, std::shared_ptr<FrameManifest> pFrameManifest)
+							{
+								if (!m_IsDestructing) {
+									REC_RESULT finalizedResult = result;
+									finalizedResult.FinalizeResult = finalizeResult;
+									SetRecordingCompleteStatus(finalizedResult, outputPath, encoderResult, pFrameManifest);
+								}
+							});
+					}
+					else {
+						//The recording failed before it started writing output, so there is nothing to finalize.
+						std::shared_ptr<FrameManifest> pFrameManifest;
+						{
+							EnterCriticalSection(&m_OutputManagerCriticalSection);
+							LeaveCriticalSectionOnExit leaveOnExit(&m_OutputManagerCriticalSection);
+							if (m_OutputManager) {
+								pFrameManifest = m_OutputManager->GetFrameManifest();
+								m_OutputManager.reset(nullptr);
+							}
+						}
+						m_IsRecording = false;
+						m_IsPaused = false;
+						if (!m_IsDestructing) {
+							SetRecordingCompleteStatus(result, outputPath, encoderResult, pFrameManifest);
 						}
-						SetRecordingCompleteStatus(result, delays);
 					}
 				});
 		return S_OK;
@@ -392,13 +713,16 @@ void RecordingManager::CleanupDxResources()
 #if _DEBUG
 	if (m_DxResources.Debug) {
 		const std::lock_guard<std::mutex> lock(m_DxDebugMutex);
-		m_DxResources.Debug->ReportLiveDeviceObjects(D3D11_RLDO_DETAIL | D3D11_RLDO_IGNORE_INTERNAL);
+		//Outputs that are still being finalized hold the device, so its objects would all be reported as leaked.
+		if (!m_OutputFinalizer || m_OutputFinalizer->GetPendingCount() == 0) {
+			m_DxResources.Debug->ReportLiveDeviceObjects(D3D11_RLDO_DETAIL | D3D11_RLDO_IGNORE_INTERNAL);
+		}
 		SafeRelease(&m_DxResources.Debug);
 	}
 #endif
 }
 
-void RecordingManager::SetRecordingCompleteStatus(_In_ REC_RESULT result, nlohmann::fifo_map<std::wstring, int> frameDelays)
+void RecordingManager::SetRecordingCompleteStatus(_In_ REC_RESULT result, _In_ std::wstring outputPath, _In_ HRESULT encoderResult, _In_opt_ std::shared_ptr<FrameManifest> pFrameManifest)
 {
 	std::wstring errMsg = L"";
 	bool isSuccess = SUCCEEDED(result.RecordingResult) && SUCCEEDED(result.FinalizeResult);
@@ -416,20 +740,21 @@ void RecordingManager::SetRecordingCompleteStatus(_In_ REC_RESULT result, nlohma
 		}
 	}
 
-	if (RecordingStatusChangedCallback) {
+	//A new recording may have started while this one was finalizing, and then the recorder is not idle.
+	if (RecordingStatusChangedCallback && !m_IsRecording) {
 		RecordingStatusChangedCallback(STATUS_IDLE);
 		LOG_DEBUG("Changed Recording Status to Idle");
 	}
 	if (isSuccess) {
 		if (RecordingCompleteCallback)
-			RecordingCompleteCallback(m_OutputFullPath, frameDelays);
+			RecordingCompleteCallback(outputPath, pFrameManifest.get());
 		LOG_DEBUG("Sent Recording Complete callback");
 	}
 	else {
 		if (RecordingFailedCallback) {
-			if (FAILED(m_EncoderResult)) {
-				_com_error encoderFailure(m_EncoderResult);
-				errMsg = string_format(L"Write error (0x%lx) in video encoder: %s", m_EncoderResult, encoderFailure.ErrorMessage());
+			if (FAILED(encoderResult)) {
+				_com_error encoderFailure(encoderResult);
+				errMsg = string_format(L"Write error (0x%lx) in video encoder: %s", encoderResult, encoderFailure.ErrorMessage());
 				if (GetEncoderOptions()->GetIsHardwareEncodingEnabled()) {
 					errMsg += L" If the problem persists, disabling hardware encoding may improve stability.";
 				}
@@ -440,7 +765,7 @@ void RecordingManager::SetRecordingCompleteStatus(_In_ REC_RESULT result, nlohma
 				}
 			}
 			if (SUCCEEDED(result.FinalizeResult)) {
-				RecordingFailedCallback(errMsg, m_OutputFullPath);
+				RecordingFailedCallback(errMsg, outputPath);
 			}
 			else {
 				RecordingFailedCallback(errMsg, L"");
@@ -477,8 +802,11 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 
 	SetViewPort(m_DxResources.Context, static_cast<float>(videoOutputFrameSize.cx), static_cast<float>(videoOutputFrameSize.cy));
 
-	std::unique_ptr<AudioManager> pAudioManager = make_unique<AudioManager>();
-
+	//A warm audio manager is only reused if the options select the same devices and format, as its capture devices are bound to them.
+	if (!m_AudioManager || !m_AudioManager->IsUsingOptions(GetAudioOptions())) {
+		m_AudioManager = make_unique<AudioManager>();
+	}
+	AudioManager *pAudioManager = m_AudioManager.get();
 
 	if (recorderMode == RecorderModeInternal::Video) {
 		hr = pAudioManager->Initialize(GetAudioOptions());
@@ -496,10 +824,29 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 		RETURN_RESULT_ON_BAD_HR(hr = m_OutputManager->BeginRecording(m_OutputFullPath, videoOutputFrameSize), L"Failed to initialize video sink writer");
 	}
 	pAudioManager->ClearRecordedBytes();
+	if (GetOutputOptions()->IsFrameExportEnabled()) {
+		//The recording itself is more important than the export, so carry on without it if it fails.
+		LOG_ON_BAD_HR(BeginFrameExport(videoOutputFrameSize));
+	}
+	if (GetOutputOptions()->GetRecorderMode() == RecorderModeInternal::Video && !GetOutputOptions()->GetRenditions().empty()) {
+		BeginRenditions(videoOutputFrameSize);
+	}
+	if (recorderMode == RecorderModeInternal::Video && GetMouseOptions()->IsMousePointerMetadataEnabled()) {
+		if (pStream) {
+			LOG_WARN(L"Mouse pointer metadata is not supported when recording to a stream");
+		}
+		else if (SUCCEEDED(BeginCursorTrack())) {
+			WriteCursorTrackViewport(videoInputFrameRect, videoOutputFrameSize);
+		}
+	}
+	if (recorderMode == RecorderModeInternal::Video && GetSnapshotOptions()->IsSnapshotWithVideoEnabled()) {
+		m_VideoSnapshotWriter = make_unique<VideoSnapshotWriter>();
+		RETURN_RESULT_ON_BAD_HR(hr = InitializeVideoSnapshotWriter(), L"Failed to initialize video snapshot writer");
+	}
 
 	std::chrono::steady_clock::time_point previousSnapshotTaken = (std::chrono::steady_clock::time_point::min)();
 	double videoFrameDurationMillis = 0;
-	if (recorderMode == RecorderModeInternal::Video) {
+	if (recorderMode == RecorderModeInternal::Video || recorderMode == RecorderModeInternal::Animation) {
 		videoFrameDurationMillis = (double)1000 / GetEncoderOptions()->GetVideoFps();
 	}
 	else if (recorderMode == RecorderModeInternal::Slideshow) {
@@ -507,8 +854,26 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 	}
 	INT64 videoFrameDuration100Nanos = MillisToHundredNanos(videoFrameDurationMillis);
 
+	//Video and animation frames start when their content was presented, and last until the next frame starts. That is only known when the next frame
+	//is acquired, so each frame is held until then. Screenshots and slideshows are written as soon as they are acquired.
+	bool isFrameHeld = recorderMode == RecorderModeInternal::Video || recorderMode == RecorderModeInternal::Animation;
+	CComPtr<ID3D11Texture2D> pHeldFrame = nullptr;
+	FrameTiming frameTiming(videoFrameDuration100Nanos);
+	ExecuteFuncOnExit logFrameTimingOnExit([&]() {
+		FRAME_TIMING_STATS stats = frameTiming.GetStats();
+		if (stats.Frames > 0) {
+			LOG_INFO(L"Frame timing: %llu of %llu frames timed by presentation, %llu late, %llu stale, %.2f ms average presentation age, %.3f ms average jitter vs %.3f ms if timed by acquisition",
+				stats.PresentationTimedFrames, stats.Frames, stats.LateFrames, stats.StaleFrames,
+				stats.PresentationTimedFrames > 0 ? HundredNanosToMillisDouble(stats.TotalPresentationAge / (INT64)stats.PresentationTimedFrames) : 0,
+				FrameTiming::GetAverageJitter(stats.TotalSampleJitter, stats.JitterSamples) / 10000,
+				FrameTiming::GetAverageJitter(stats.TotalAcquisitionJitter, stats.JitterSamples) / 10000);
+		}
+	});
+
 	int frameNr = 0;
 	INT64 lastFrameStartPos100Nanos = 0;
+	//The frame interval is kept from when the frames are acquired, not from when they start, so the acquisitions don't follow the sources.
+	INT64 lastFrameAcquiredPos100Nanos = 0;
 	cancellation_token token = m_TaskWrapperImpl->m_RecordTaskCts.get_token();
 	DynamicWait retryWait{};
 	INT64 totalDiff = 0;
@@ -527,7 +892,7 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 	auto GetTimeUntilNextFrameMillis([&]() {
 		INT64 timestamp;
 		m_OutputManager->GetMediaTimeStamp(&timestamp);
-		INT64 durationSinceLastFrame100Nanos = timestamp - lastFrameStartPos100Nanos;
+		INT64 durationSinceLastFrame100Nanos = timestamp - lastFrameAcquiredPos100Nanos;
 		INT64 nanosRemaining = max(0, videoFrameDuration100Nanos - durationSinceLastFrame100Nanos);
 		return HundredNanosToMillisDouble(nanosRemaining);
 		});
@@ -539,7 +904,8 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 			(std::chrono::steady_clock::now() - previousSnapshotTaken) > GetSnapshotOptions()->GetSnapshotsInterval();
 	});
 
-	auto PrepareAndRenderFrame([&](CComPtr<ID3D11Texture2D> pTextureToRender, INT64 duration100Nanos)->HRESULT {
+	auto PrepareFrame([&](CComPtr<ID3D11Texture2D> pTextureToRender, _Outptr_ ID3D11Texture2D **ppPreparedFrame)->HRESULT {
+		*ppPreparedFrame = nullptr;
 		CComPtr<ID3D11Texture2D> processedTexture;
 		HRESULT renderHr = ProcessTexture(pTextureToRender, &processedTexture, pPtrInfo);
 		if (renderHr == S_OK) {
@@ -548,15 +914,29 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 			(*pTextureToRender).AddRef();
 		}
 		if (recorderMode == RecorderModeInternal::Video) {
+			if (m_VideoSnapshotWriter) {
+				m_VideoSnapshotWriter->ReadPendingSnapshots();
+			}
 			if (GetSnapshotOptions()->IsSnapshotWithVideoEnabled() && IsTimeToTakeSnapshot()) {
 				if (GetSnapshotOptions()->GetSnapshotsDirectory().empty())
 					return S_FALSE;
 				wstring snapshotPath = GetSnapshotOptions()->GetSnapshotsDirectory() + L"\\" + s2ws(CurrentTimeToFormattedString(true)) + GetSnapshotOptions()->GetImageExtension();
-				TakeSnapshot(snapshotPath, nullptr, pTextureToRender);
+				RECT videoInputFrameRect{};
+				if (SUCCEEDED(InitializeRects(m_CaptureManager->GetOutputSize(), &videoInputFrameRect, nullptr))) {
+					//Only the GPU copy is queued here, the snapshot is encoded and written on a worker thread.
+					LOG_ON_BAD_HR(m_VideoSnapshotWriter->WriteSnapshot(snapshotPath, pTextureToRender, videoInputFrameRect));
+				}
+				//Also when the snapshot was skipped, so a busy writer doesn't get a new snapshot on every frame.
 				previousSnapshotTaken = steady_clock::now();
 			}
 		}
+		*ppPreparedFrame = pTextureToRender;
+		(*ppPreparedFrame)->AddRef();
+		return S_OK;
+	});
 
+	auto RenderFrame([&](CComPtr<ID3D11Texture2D> pTextureToRender, INT64 duration100Nanos)->HRESULT {
+		HRESULT renderHr = S_OK;
 		INT64 diff = 0;
 		auto audioBytes = pAudioManager->GrabAudioFrame(duration100Nanos);
 		if (audioBytes.size() > 0) {
@@ -570,16 +950,59 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 		model.Duration = duration100Nanos + diff;
 		model.StartPos = lastFrameStartPos100Nanos + totalDiff;
 		model.Audio = audioBytes;
+		if (!m_Renditions.empty()) {
+			WriteRenditionFrames(model);
+		}
 		RETURN_ON_BAD_HR(renderHr = m_EncoderResult = m_OutputManager->RenderFrame(model));
 		frameNr++;
+		if (frameNr == 1) {
+			m_LastStartupLatencyMillis = duration<double, std::milli>(steady_clock::now() - m_BeginRecordingTime).count();
+			LOG_INFO(L"Startup latency to first encoded frame: %.2f ms (%ls)", m_LastStartupLatencyMillis, m_IsWarm ? L"warm" : L"cold");
+		}
 		totalDiff += diff;
 		if (RecordingFrameNumberChangedCallback != nullptr && !m_IsDestructing) {
 			SendNewFrameCallback(frameNr, pTextureToRender);
 		}
+		if (m_FrameExportReadback && m_FrameExportReadback->IsReadbackDue()) {
+			LOG_ON_BAD_HR(m_FrameExportReadback->Enqueue(frameNr, model.StartPos, pTextureToRender));
+		}
 		lastFrameStartPos100Nanos += duration100Nanos;
 		return renderHr;
 	});
 
+	auto PrepareAndRenderFrame([&](CComPtr<ID3D11Texture2D> pTextureToRender, INT64 duration100Nanos)->HRESULT {
+		CComPtr<ID3D11Texture2D> pPreparedFrame;
+		HRESULT renderHr = PrepareFrame(pTextureToRender, &pPreparedFrame);
+		if (renderHr != S_OK) {
+			return renderHr;
+		}
+		return RenderFrame(pPreparedFrame, duration100Nanos);
+	});
+
+	auto PrepareAndHoldFrame([&](const CAPTURED_FRAME &capturedFrame, INT64 acquisitionTime, INT64 timestamp)->HRESULT {
+		CComPtr<ID3D11Texture2D> pPreparedFrame;
+		HRESULT renderHr = PrepareFrame(capturedFrame.Frame, &pPreparedFrame);
+		if (renderHr != S_OK) {
+			return renderHr;
+		}
+		//The captured frame is overwritten by the next one, so it is copied unless processing already made a texture of its own.
+		if (pPreparedFrame == capturedFrame.Frame) {
+			D3D11_TEXTURE2D_DESC desc;
+			pPreparedFrame->GetDesc(&desc);
+			CComPtr<ID3D11Texture2D> pFrameCopy;
+			RETURN_ON_BAD_HR(renderHr = m_DxResources.Device->CreateTexture2D(&desc, nullptr, &pFrameCopy));
+			m_DxResources.Context->CopyResource(pFrameCopy, pPreparedFrame);
+			pPreparedFrame = pFrameCopy;
+		}
+		INT64 sampleTime = frameTiming.GetSampleTime(capturedFrame.PresentationTime, acquisitionTime, timestamp, lastFrameStartPos100Nanos);
+		//The first frame, and the first after the capture restarted, start where the recording left off.
+		if (pHeldFrame) {
+			RETURN_ON_BAD_HR(renderHr = RenderFrame(pHeldFrame, sampleTime - lastFrameStartPos100Nanos));
+		}
+		pHeldFrame = pPreparedFrame;
+		return renderHr;
+	});
+
 	auto RestartCapture([&](CAPTURE_RESULT result) {
 		//Stop existing capture
 		hr = m_CaptureManager->StopCapture();
@@ -608,7 +1031,21 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 					GetSnapshotOptions(),
 					GetOutputOptions());
 			}
+			if (SUCCEEDED(hr) && m_FrameReadback) {
+				hr = InitializeFrameReadback();
+			}
+			if (SUCCEEDED(hr) && m_FrameExportReadback) {
+				hr = InitializeFrameExportReadback();
+			}
+			if (SUCCEEDED(hr)) {
+				hr = InitializeRenditions();
+			}
+			if (SUCCEEDED(hr) && m_VideoSnapshotWriter) {
+				hr = InitializeVideoSnapshotWriter();
+			}
 		}
+		//The held frame may be from the device that was just recreated, and shows what the capture had before it failed.
+		pHeldFrame.Release();
 		//Recreate capture manager and restart capture
 		if (SUCCEEDED(hr)) {
 			m_CaptureManager.reset(new ScreenCaptureManager());
@@ -633,6 +1070,10 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 			hr = InitializeRects(m_CaptureManager->GetOutputSize(), &videoInputFrameRect, nullptr);
 			LOG_TRACE(L"Reinitialized input frame rect: [%d,%d,%d,%d]", videoInputFrameRect.left, videoInputFrameRect.top, videoInputFrameRect.right, videoInputFrameRect.bottom);
 		}
+		if (SUCCEEDED(hr)) {
+			ConnectCursorTrack();
+			WriteCursorTrackViewport(videoInputFrameRect, videoOutputFrameSize);
+		}
 		pPtrInfo.reset();
 
 		return hr;
@@ -692,6 +1133,10 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 			if (m_OutputManager->isMediaClockRunning()) {
 				m_OutputManager->PauseMediaClock();
 			}
+			if (m_CursorTrackWriter) {
+				//Clicks made while paused are not part of the recording.
+				m_CursorTrackMouseEventSequence = m_MouseManager->GetMouseEventSequence();
+			}
 			ExecuteFuncOnExit clearDataOnExit([&]() {
 				previousSnapshotTaken = steady_clock::now();
 				if (pAudioManager)
@@ -717,47 +1162,347 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 			}
 			if (capturedFrame.PtrInfo) {
 				pPtrInfo = capturedFrame.PtrInfo.value();
+				//Clicks don't always move the pointer, so they are also written with every frame.
+				WriteCursorTrackMouseEvents(pPtrInfo.value());
 			}
 		}
 		else if (hr != DXGI_ERROR_WAIT_TIMEOUT) {
 			RETURN_RESULT_ON_BAD_HR(hr, L"");
 		}
+		INT64 acquisitionTime = GetPerformanceCounterTime();
 		INT64 timestamp;
 		RETURN_ON_BAD_HR(m_OutputManager->GetMediaTimeStamp(&timestamp));
-		INT64 durationSinceLastFrame100Nanos = timestamp - lastFrameStartPos100Nanos;
-
-
+		lastFrameAcquiredPos100Nanos = timestamp;
 
 		if (token.is_canceled()) {
 			LOG_DEBUG("Recording task was cancelled");
 			hr = S_OK;
 			break;
 		}
-		if (frameNr == 0) {
+		if (frameNr == 0 && !pHeldFrame) {
 			if (RecordingStatusChangedCallback != nullptr) {
 				RecordingStatusChangedCallback(STATUS_RECORDING);
 				LOG_DEBUG("Changed Recording Status to Recording");
 			}
 		}
-		RETURN_RESULT_ON_BAD_HR(hr = PrepareAndRenderFrame(capturedFrame.Frame, durationSinceLastFrame100Nanos), L"Failed to render frame");
+		if (isFrameHeld) {
+			RETURN_RESULT_ON_BAD_HR(hr = PrepareAndHoldFrame(capturedFrame, acquisitionTime, timestamp), L"Failed to render frame");
+		}
+		else {
+			RETURN_RESULT_ON_BAD_HR(hr = PrepareAndRenderFrame(capturedFrame.Frame, timestamp - lastFrameStartPos100Nanos), L"Failed to render frame");
+		}
 		if (recorderMode == RecorderModeInternal::Screenshot) {
 			break;
 		}
 	}
+	//The last frame lasts until the recording stopped.
+	if (pHeldFrame) {
+		INT64 timestamp;
+		if (SUCCEEDED(m_OutputManager->GetMediaTimeStamp(&timestamp)) && timestamp > lastFrameStartPos100Nanos) {
+			RETURN_RESULT_ON_BAD_HR(hr = RenderFrame(pHeldFrame, timestamp - lastFrameStartPos100Nanos), L"Failed to render last frame");
+		}
+	}
 
 	return CAPTURE_RESULT(hr);
 }
 
+HRESULT RecordingManager::InitializeFrameReadback()
+{
+	if (!m_FrameReadback) {
+		m_FrameReadback = make_unique<TextureReadback>();
+	}
+	return m_FrameReadback->Initialize(m_DxResources.Context, m_DxResources.Device, [this](int frameNumber, INT64 timestamp, FRAME_BITMAP_DATA *pBitmap) {
+		if (RecordingFrameNumberChangedCallback != nullptr && !m_IsDestructing) {
+			RecordingFrameNumberChangedCallback(frameNumber, timestamp, pBitmap);
+		}
+	});
+}
+
+HRESULT RecordingManager::BeginFrameExport(_In_ SIZE frameSize)
+{
+	std::wstring name = GetOutputOptions()->GetFrameExportName();
+	UINT32 maxFrameBytes = static_cast<UINT32>(frameSize.cx * frameSize.cy * 4);
+	m_FrameExportWriter = make_unique<FrameExportWriter>();
+	if (!m_FrameExportWriter->Create(name, GetOutputOptions()->GetFrameExportSlotCount(), maxFrameBytes)) {
+		LOG_ERROR(L"Failed to create frame export ring %ls, it may exist with a different size", name.c_str());
+		m_FrameExportWriter.reset();
+		return E_FAIL;
+	}
+	m_FrameExportReadback = make_unique<TextureReadback>();
+	m_FrameExportReadback->SetMaxFramesPerSecond(GetOutputOptions()->GetFrameExportFps());
+	HRESULT hr = InitializeFrameExportReadback();
+	if (FAILED(hr)) {
+		EndFrameExport();
+		return hr;
+	}
+	LOG_INFO(L"Exporting frames to shared memory ring %ls", name.c_str());
+	return hr;
+}
+
+HRESULT RecordingManager::InitializeFrameExportReadback()
+{
+	return m_FrameExportReadback->Initialize(m_DxResources.Context, m_DxResources.Device, [this](int frameNumber, INT64 timestamp, FRAME_BITMAP_DATA *pBitmap) {
+		if (pBitmap) {
+			m_FrameExportWriter->Write(timestamp, pBitmap->Width, pBitmap->Height, pBitmap->Stride, FrameExportFormat::Bgra32, pBitmap->Data);
+		}
+	});
+}
+
+void RecordingManager::EndFrameExport()
+{
+	if (m_FrameExportReadback) {
+		m_FrameExportReadback->Flush();
+		m_FrameExportReadback.reset();
+	}
+	if (m_FrameExportWriter) {
+		FRAME_EXPORT_STATS stats = m_FrameExportWriter->GetStats();
+		LOG_INFO(L"Frame export: %llu frames exported, %llu dropped", stats.WrittenFrames, stats.DroppedFrames);
+		m_FrameExportWriter.reset();
+	}
+}
+
+HRESULT RecordingManager::BeginCursorTrack()
+{
+	std::wstring path = m_OutputFullPath + L".cursor";
+	m_CursorTrackWriter = make_unique<CursorTrackWriter>();
+	if (!m_CursorTrackWriter->Open(path)) {
+		LOG_ERROR(L"Failed to create cursor track %ls: %ls", path.c_str(), GetLastErrorStdWstr().c_str());
+		m_CursorTrackWriter.reset();
+		return E_FAIL;
+	}
+	m_CursorTrackMouseEventSequence = m_MouseManager->GetMouseEventSequence();
+	m_LastCursorTrackPointerTimestamp = 0;
+	ConnectCursorTrack();
+	LOG_INFO(L"Recording mouse pointer to %ls", path.c_str());
+	return S_OK;
+}
+
+void RecordingManager::ConnectCursorTrack()
+{
+	if (m_CursorTrackWriter) {
+		m_CaptureManager->SetPointerUpdatedCallback([this](const PTR_INFO &ptrInfo) {
+			WriteCursorTrackPointer(ptrInfo);
+		});
+	}
+}
+
+void RecordingManager::WriteCursorTrackPointer(_In_ const PTR_INFO &ptrInfo)
+{
+	if (!m_CursorTrackWriter || m_IsPaused) {
+		return;
+	}
+	INT64 mediaTime;
+	if (FAILED(m_OutputManager->GetMediaTimeStamp(&mediaTime))) {
+		return;
+	}
+	//The pointer is timed with the performance counter, so it is moved back from the current position in the recording by how long ago it changed.
+	INT64 pointerAge = max(0, GetPerformanceCounterTime() - PerformanceCounterToHundredNanos(ptrInfo.LastTimeStamp.QuadPart));
+	CURSOR_TRACK_POINTER pointer;
+	pointer.Timestamp = max(m_LastCursorTrackPointerTimestamp, max(0, mediaTime - pointerAge));
+	pointer.Left = static_cast<INT32>(round((ptrInfo.Position.x + ptrInfo.Offset.x) * ptrInfo.Scale.cx));
+	pointer.Top = static_cast<INT32>(round((ptrInfo.Position.y + ptrInfo.Offset.y) * ptrInfo.Scale.cy));
+	//Monochrome shapes hold both masks, so the cursor is half the height of the shape.
+	UINT shapeHeight = ptrInfo.ShapeInfo.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME ? ptrInfo.ShapeInfo.Height / 2 : ptrInfo.ShapeInfo.Height;
+	pointer.Width = static_cast<UINT32>(round(ptrInfo.ShapeInfo.Width * ptrInfo.Scale.cx));
+	pointer.Height = static_cast<UINT32>(round(shapeHeight * ptrInfo.Scale.cy));
+	pointer.IsVisible = ptrInfo.Visible;
+	CURSOR_SHAPE shape;
+	if (ptrInfo.PtrShapeBuffer) {
+		shape.Type = static_cast<CursorShapeType>(ptrInfo.ShapeInfo.Type);
+		shape.Width = ptrInfo.ShapeInfo.Width;
+		shape.Height = ptrInfo.ShapeInfo.Height;
+		shape.Pitch = ptrInfo.ShapeInfo.Pitch;
+		shape.Buffer = ptrInfo.PtrShapeBuffer;
+		shape.BufferSize = ptrInfo.BufferSize;
+	}
+	m_CursorTrackWriter->WritePointer(pointer, shape, ptrInfo.ShapeInfo.HotSpot.x, ptrInfo.ShapeInfo.HotSpot.y, ptrInfo.ShapeVersion);
+	m_LastCursorTrackPointerTimestamp = pointer.Timestamp;
+	WriteCursorTrackMouseEvents(ptrInfo);
+}
+
+void RecordingManager::WriteCursorTrackMouseEvents(_In_ const PTR_INFO &ptrInfo)
+{
+	if (!m_CursorTrackWriter || m_IsPaused) {
+		return;
+	}
+	INT64 mediaTime;
+	if (FAILED(m_OutputManager->GetMediaTimeStamp(&mediaTime))) {
+		return;
+	}
+	INT64 now = GetPerformanceCounterTime();
+	//Events are in screen coordinates, so they are placed relative to the hotspot of the pointer, the same way clicks are drawn.
+	INT32 hotSpotLeft = static_cast<INT32>(round((ptrInfo.Position.x + ptrInfo.Offset.x + ptrInfo.ShapeInfo.HotSpot.x) * ptrInfo.Scale.cx));
+	INT32 hotSpotTop = static_cast<INT32>(round((ptrInfo.Position.y + ptrInfo.Offset.y + ptrInfo.ShapeInfo.HotSpot.y) * ptrInfo.Scale.cy));
+	MOUSE_INPUT_EVENT events[64];
+	UINT32 count = 0;
+	while ((count = m_MouseManager->ReadMouseEvents(&m_CursorTrackMouseEventSequence, events, ARRAYSIZE(events))) > 0) {
+		for (UINT32 i = 0; i < count; i++) {
+			CURSOR_TRACK_MOUSE_EVENT event = events[i];
+			event.Timestamp = max(0, mediaTime - max(0, now - events[i].Timestamp));
+			event.X = hotSpotLeft + static_cast<INT32>(round((events[i].X - ptrInfo.ScreenPosition.x) * ptrInfo.Scale.cx));
+			event.Y = hotSpotTop + static_cast<INT32>(round((events[i].Y - ptrInfo.ScreenPosition.y) * ptrInfo.Scale.cy));
+			m_CursorTrackWriter->WriteMouseEvent(event);
+		}
+	}
+}
+
+void RecordingManager::WriteCursorTrackViewport(_In_ RECT videoInputFrameRect, _In_ SIZE videoOutputFrameSize)
+{
+	if (!m_CursorTrackWriter) {
+		return;
+	}
+	CURSOR_TRACK_VIEWPORT viewport;
+	INT64 timestamp = 0;
+	if (SUCCEEDED(m_OutputManager->GetMediaTimeStamp(&timestamp))) {
+		viewport.Timestamp = max(0, timestamp);
+	}
+	viewport.SourceLeft = videoInputFrameRect.left;
+	viewport.SourceTop = videoInputFrameRect.top;
+	viewport.SourceWidth = RectWidth(videoInputFrameRect);
+	viewport.SourceHeight = RectHeight(videoInputFrameRect);
+	//The same layout as ProcessTextureTransforms gives the frame.
+	SIZE contentSize{ RectWidth(videoInputFrameRect), RectHeight(videoInputFrameRect) };
+	if (contentSize.cx != videoOutputFrameSize.cx || contentSize.cy != videoOutputFrameSize.cy) {
+		contentSize = TextureManager::GetResizedSize(contentSize, videoOutputFrameSize, GetOutputOptions()->GetStretch());
+	}
+	viewport.DestinationLeft = (INT32)max(0, round(((double)videoOutputFrameSize.cx - (double)contentSize.cx)) / 2);
+	viewport.DestinationTop = (INT32)max(0, round(((double)videoOutputFrameSize.cy - (double)contentSize.cy)) / 2);
+	viewport.DestinationWidth = contentSize.cx;
+	viewport.DestinationHeight = contentSize.cy;
+	viewport.OutputWidth = videoOutputFrameSize.cx;
+	viewport.OutputHeight = videoOutputFrameSize.cy;
+	m_CursorTrackWriter->WriteViewport(viewport);
+}
+
+void RecordingManager::EndCursorTrack()
+{
+	if (m_CaptureManager) {
+		m_CaptureManager->SetPointerUpdatedCallback(nullptr);
+	}
+	if (m_CursorTrackWriter) {
+		UINT64 size = m_CursorTrackWriter->GetSize();
+		if (m_CursorTrackWriter->Close()) {
+			LOG_INFO(L"Cursor track: %llu bytes written", size);
+		}
+		else {
+			LOG_ERROR(L"Failed to write cursor track");
+		}
+		m_CursorTrackWriter.reset();
+	}
+}
+
+HRESULT RecordingManager::InitializeVideoSnapshotWriter()
+{
+	return m_VideoSnapshotWriter->Initialize(m_DxResources.Context, m_DxResources.Device, GetSnapshotOptions()->GetImageEncoder(), GetSnapshotOptions()->GetSnapshotEncoderFormat(), [this](const std::wstring &path) {
+		if (RecordingSnapshotCreatedCallback != nullptr && !m_IsDestructing) {
+			RecordingSnapshotCreatedCallback(path);
+		}
+	});
+}
+
+void RecordingManager::EndVideoSnapshots()
+{
+	if (m_VideoSnapshotWriter) {
+		m_VideoSnapshotWriter->Flush();
+		VIDEO_SNAPSHOT_WRITER_STATS stats = m_VideoSnapshotWriter->GetStats();
+		LOG_INFO(L"Video snapshots: %llu written, %llu skipped while busy, %llu failed", stats.WrittenSnapshots, stats.SkippedSnapshots, stats.FailedSnapshots);
+		m_VideoSnapshotWriter.reset();
+	}
+}
+
+void RecordingManager::BeginRenditions(_In_ SIZE frameSize)
+{
+	for (const OUTPUT_RENDITION &rendition : GetOutputOptions()->GetRenditions()) {
+		auto pRendition = make_unique<RenditionWriter>(rendition);
+		HRESULT hr = pRendition->Initialize(m_DxResources.Context, m_DxResources.Device, GetEncoderOptions(), GetAudioOptions(), GetSnapshotOptions());
+		if (SUCCEEDED(hr)) {
+			hr = pRendition->BeginRecording(frameSize);
+		}
+		if (FAILED(hr)) {
+			LOG_ERROR(L"Failed to start rendition %ls, the recording continues without it: hr = 0x%08x", rendition.OutputPath.c_str(), hr);
+			continue;
+		}
+		m_Renditions.push_back(std::move(pRendition));
+	}
+}
+
+HRESULT RecordingManager::InitializeRenditions()
+{
+	for (std::unique_ptr<RenditionWriter> &pRendition : m_Renditions) {
+		RETURN_ON_BAD_HR(pRendition->Initialize(m_DxResources.Context, m_DxResources.Device, GetEncoderOptions(), GetAudioOptions(), GetSnapshotOptions()));
+	}
+	return S_OK;
+}
+
+void RecordingManager::WriteRenditionFrames(_In_ const FrameWriteModel &model)
+{
+	D3D11_TEXTURE2D_DESC desc;
+	model.Frame->GetDesc(&desc);
+	RECT frameRect{ 0, 0, static_cast<LONG>(desc.Width), static_cast<LONG>(desc.Height) };
+	for (std::unique_ptr<RenditionWriter> &pRendition : m_Renditions) {
+		if (FAILED(pRendition->GetResult())) {
+			continue;
+		}
+		FrameWriteModel renditionModel{};
+		renditionModel.StartPos = model.StartPos;
+		renditionModel.Duration = model.Duration;
+		renditionModel.Audio = model.Audio;
+		if (pRendition->IsFrameDue()) {
+			CComPtr<ID3D11Texture2D> pRenditionFrame = nullptr;
+			HRESULT hr = ProcessTextureTransforms(model.Frame, &pRenditionFrame, frameRect, pRendition->GetFrameSize());
+			if (SUCCEEDED(hr) && pRenditionFrame == model.Frame) {
+				//The rendition has the frame size of the recording. It is written on another thread, so it needs a copy the recording doesn't touch.
+				pRenditionFrame.Release();
+				hr = m_DxResources.Device->CreateTexture2D(&desc, nullptr, &pRenditionFrame);
+				if (SUCCEEDED(hr)) {
+					m_DxResources.Context->CopyResource(pRenditionFrame, model.Frame);
+				}
+			}
+			if (SUCCEEDED(hr)) {
+				//Resized frames are drawn on a new texture, so the rendition has the only reference to it.
+				renditionModel.Frame = pRenditionFrame;
+				renditionModel.IsFrameExclusive = true;
+			}
+			else {
+				LOG_ERROR(L"Failed to create frame for rendition %ls: hr = 0x%08x", pRendition->GetOutputPath().c_str(), hr);
+			}
+		}
+		pRendition->WriteFrame(std::move(renditionModel));
+	}
+}
+
+void RecordingManager::EndRenditions()
+{
+	for (std::unique_ptr<RenditionWriter> &pRendition : m_Renditions) {
+		pRendition->EndRecording();
+	}
+	for (std::unique_ptr<RenditionWriter> &pRendition : m_Renditions) {
+		HRESULT hr = pRendition->WaitForFinalize();
+		RENDITION_STATS stats = pRendition->GetStats();
+		if (SUCCEEDED(hr)) {
+			LOG_INFO(L"Rendition %ls: %llu frames written, %llu skipped by framerate divisor, %llu dropped by slow encoder", pRendition->GetOutputPath().c_str(), stats.WrittenFrames, stats.SkippedFrames, stats.DroppedFrames);
+		}
+		else {
+			LOG_ERROR(L"Rendition %ls failed: hr = 0x%08x", pRendition->GetOutputPath().c_str(), hr);
+		}
+	}
+	m_Renditions.clear();
+}
+
 HRESULT RecordingManager::SendNewFrameCallback(_In_ const int frameNumber, _In_ ID3D11Texture2D *pTexture) {
 	HRESULT hr = S_FALSE;
 	if (RecordingFrameNumberChangedCallback != nullptr) {
 		INT64 timestamp = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
-		if (m_OutputOptions->IsVideoFramePreviewEnabled()) {
-			CComPtr< ID3D11Texture2D> pProcessedTexture = nullptr;
-			unique_ptr<FRAME_BITMAP_DATA> pFramePreviewData = nullptr;
-			D3D11_TEXTURE2D_DESC textureDesc;
-			pTexture->GetDesc(&textureDesc);
+		if (!m_FrameReadback) {
+			RETURN_ON_BAD_HR(hr = InitializeFrameReadback());
+		}
+		m_FrameReadback->SetMaxFramesPerSecond(m_OutputOptions->GetVideoFramePreviewFps());
+		//Frames that are not previewed are still delivered through the readback, so frame numbers arrive in order.
+		CComPtr<ID3D11Texture2D> pProcessedTexture = nullptr;
+		if (m_OutputOptions->IsVideoFramePreviewEnabled() && m_FrameReadback->IsReadbackDue()) {
 			if (m_OutputOptions->GetVideoFramePreviewSize().has_value()) {
+				D3D11_TEXTURE2D_DESC textureDesc;
+				pTexture->GetDesc(&textureDesc);
 				long cx = m_OutputOptions->GetVideoFramePreviewSize().value().cx;
 				long cy = m_OutputOptions->GetVideoFramePreviewSize().value().cy;
 				if (cx > 0 && cy == 0) {
@@ -769,46 +1514,12 @@ HRESULT RecordingManager::SendNewFrameCallback(_In_ const int frameNumber, _In_
 				ID3D11Texture2D *pResizedTexture;
 				RETURN_ON_BAD_HR(hr = m_TextureManager->ResizeTexture(pTexture, SIZE{ cx,cy }, TextureStretchMode::Uniform, &pResizedTexture));
 				pProcessedTexture.Attach(pResizedTexture);
-				pResizedTexture->GetDesc(&textureDesc);
 			}
 			else {
-				pProcessedTexture.Attach(pTexture);
-				pTexture->AddRef();
-			}
-			int width = textureDesc.Width;
-			int height = textureDesc.Height;
-
-			if (m_FrameDataCallbackTextureDesc.Width != width || m_FrameDataCallbackTextureDesc.Height != height) {
-				SafeRelease(&m_FrameDataCallbackTexture);
-				textureDesc.Usage = D3D11_USAGE_STAGING;
-				textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-				textureDesc.MiscFlags = 0;
-				textureDesc.BindFlags = 0;
-				RETURN_ON_BAD_HR(m_DxResources.Device->CreateTexture2D(&textureDesc, nullptr, &m_FrameDataCallbackTexture));
-
-				m_FrameDataCallbackTextureDesc = textureDesc;
-			}
-
-			m_DxResources.Context->CopyResource(m_FrameDataCallbackTexture, pProcessedTexture);
-			D3D11_MAPPED_SUBRESOURCE map;
-			m_DxResources.Context->Map(m_FrameDataCallbackTexture, 0, D3D11_MAP_READ, 0, &map);
-
-			int bytesPerPixel = map.RowPitch / width;
-			int len = map.DepthPitch;
-			int stride = map.RowPitch;
-			BYTE *data = static_cast<BYTE *>(map.pData);
-			pFramePreviewData = make_unique<FRAME_BITMAP_DATA>();
-			pFramePreviewData->Data = data;
-			pFramePreviewData->Stride = stride;
-			pFramePreviewData->Width = width;
-			pFramePreviewData->Height = height;
-			pFramePreviewData->Length = len;
-			RecordingFrameNumberChangedCallback(frameNumber, timestamp, pFramePreviewData.get());
-			m_DxResources.Context->Unmap(m_FrameDataCallbackTexture, 0);
-		}
-		else {
-			RecordingFrameNumberChangedCallback(frameNumber, timestamp, nullptr);
+				pProcessedTexture = pTexture;
+			}
 		}
+		hr = m_FrameReadback->Enqueue(frameNumber, timestamp, pProcessedTexture);
 	}
 	return hr;
 }
@@ -912,34 +1623,6 @@ bool RecordingManager::CheckDependencies(_Out_ std::wstring *error)
 	*error = errorText;
 	return result;
 }
-void RecordingManager::SaveTextureAsVideoSnapshotAsync(_In_ ID3D11Texture2D *pTexture, _In_ std::wstring snapshotPath, _In_ RECT destRect, _In_opt_ std::function<void(HRESULT)> onCompletion)
-{
-	pTexture->AddRef();
-	auto token = m_TaskWrapperImpl->m_RecordTaskCts.get_token();
-	Concurrency::create_task([this, pTexture, snapshotPath, destRect, onCompletion, token]() {
-		return SaveTextureAsVideoSnapshot(pTexture, snapshotPath, destRect);
-	   }, token).then([this, snapshotPath, pTexture, destRect, onCompletion, token](concurrency::task<HRESULT> t)
-		   {
-			   HRESULT hr;
-			   try {
-				   hr = t.get();
-				   // if .get() didn't throw and the HRESULT succeeded, there are no errors.
-			   }
-			   catch (...) {
-				   // handle error
-				   LOG_ERROR(L"Exception saving snapshot", );
-				   hr = E_FAIL;
-			   }
-			   if (token.is_canceled()) {
-				   cancel_current_task();
-			   };
-			   if (onCompletion) {
-				   std::invoke(onCompletion, hr);
-			   }
-			   return hr;
-		   }, token);
-}
-
 HRESULT RecordingManager::SaveTextureAsVideoSnapshot(_In_ ID3D11Texture2D *pTexture, _In_ std::wstring snapshotPath, _In_ RECT destRect)
 {
 	CComPtr<ID3D11Texture2D> pProcessedTexture = nullptr;
@@ -957,6 +1640,10 @@ HRESULT RecordingManager::SaveTextureAsVideoSnapshot(_In_ ID3D11Texture2D *pText
 		// Copy the current frame for a separate thread to write it to a file asynchronously.
 		m_DxResources.Context->CopyResource(pProcessedTexture, pTexture);
 	}
+	if (!m_OutputManager) {
+		//The recording has ended and its output was handed over for finalization.
+		return E_ABORT;
+	}
 	return m_OutputManager->WriteFrameToImage(pProcessedTexture, snapshotPath.c_str());
 }
 
@@ -977,6 +1664,10 @@ HRESULT RecordingManager::SaveTextureAsVideoSnapshot(_In_ ID3D11Texture2D *pText
 		// Copy the current frame for a separate thread to write it to a file asynchronously.
 		m_DxResources.Context->CopyResource(pProcessedTexture, pTexture);
 	}
+	if (!m_OutputManager) {
+		//The recording has ended and its output was handed over for finalization.
+		return E_ABORT;
+	}
 	return m_OutputManager->WriteFrameToImage(pProcessedTexture, pStream);
 }
 
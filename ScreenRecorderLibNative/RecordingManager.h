@@ -3,11 +3,19 @@
 #include "MouseManager.h"
 #include "AudioManager.h"
 #include "OutputManager.h"
+#include "OutputFinalizer.h"
+#include "TextureReadback.h"
+#include "FrameExportRing.h"
+#include "CursorTrack.h"
+#include "RenditionWriter.h"
+#include "VideoSnapshotWriter.h"
 #include "ScreenCaptureManager.h"
+#include "TimingService.h"
 #include "Log.h"
-#include "fifo_map.h"
+#include "FrameManifest.h"
 #include "CommonTypes.h"
-typedef void(__stdcall *CallbackCompleteFunction)(std::wstring, nlohmann::fifo_map<std::wstring, int>);
+#include <atomic>
+typedef void(__stdcall *CallbackCompleteFunction)(std::wstring, _In_ const FrameManifest *);
 typedef void(__stdcall *CallbackStatusChangedFunction)(int);
 typedef void(__stdcall *CallbackErrorFunction)(std::wstring, std::wstring);
 typedef void(__stdcall *CallbackSnapshotFunction)(std::wstring);
@@ -33,6 +41,26 @@ public:
 	CallbackFrameNumberChangedFunction RecordingFrameNumberChangedCallback;
 	HRESULT TakeSnapshot(_In_ std::wstring path);
 	HRESULT TakeSnapshot(_In_ IStream *stream);
+	/// <summary>
+	/// Captures a screenshot of the recording sources synchronously on the calling thread, without starting a recording.
+	/// Only the capture sources are created, there are no capture threads, media clock, encoder or audio capture. Overlays are not drawn.
+	/// The device is reused between screenshots if the recorder is warm, else it is created and released for each screenshot.
+	/// </summary>
+	/// <param name="path">The file to write the screenshot to. If empty, a file named after the current time is created in the snapshot directory.</param>
+	/// <returns>S_OK if successful, E_NOT_VALID_STATE if a recording is in progress, else an error code.</returns>
+	HRESULT TakeScreenshot(_In_ std::wstring path);
+	/// <summary>
+	/// Captures a screenshot of the recording sources synchronously on the calling thread, without starting a recording, and writes it to the stream.
+	/// </summary>
+	HRESULT TakeScreenshot(_In_ IStream *stream);
+	/// <summary>
+	/// Writes the replay buffer of the current recording to an MP4 file, without interrupting the recording.
+	/// </summary>
+	HRESULT SaveReplay(_In_ std::wstring path);
+	/// <summary>
+	/// Writes the replay buffer of the current recording as MP4 to a stream, without interrupting the recording.
+	/// </summary>
+	HRESULT SaveReplay(_In_ IStream *stream);
 	HRESULT BeginRecording(_In_ std::wstring path);
 	HRESULT BeginRecording(_In_ IStream *stream);
 	void EndRecording();
@@ -40,10 +68,27 @@ public:
 	void ResumeRecording();
 
 	bool IsRecording() { return m_IsRecording; }
+	/// <summary>
+	/// Keeps the DirectX device, shaders, texture caches, mouse manager and audio manager alive between recordings, so a new recording can start without recreating them.
+	/// </summary>
+	/// <param name="maxVideoMemoryBytes">If the video memory used by the process exceeds this after a recording, the warm resources are released. 0 means no limit.</param>
+	/// <returns>S_OK if successful, else an error code. The recorder stays cold on failure.</returns>
+	HRESULT Warm(_In_ UINT64 maxVideoMemoryBytes);
+	/// <summary>
+	/// Leaves warm mode. Resources are released immediately if idle, or when the current recording ends.
+	/// </summary>
+	void Cool();
+	bool IsWarm() { return m_IsWarm; }
+	/// <summary>
+	/// The time in milliseconds from the last call to BeginRecording until the first frame was written to the encoder, or -1 if no frame has been written yet.
+	/// </summary>
+	double GetLastStartupLatencyMillis() { return m_LastStartupLatencyMillis; }
 
 	static bool SetExcludeFromCapture(HWND hwnd, bool isExcluded);
 
 	inline void ClearRecordingSources() {
+		//The screenshot captures refer to the sources.
+		ReleaseScreenshotCaptures();
 		for each (RECORDING_SOURCE * source in m_RecordingSources)
 		{
 			delete source;
@@ -124,17 +169,32 @@ public:
 	void SetOutputOptions(OUTPUT_OPTIONS *options) { m_OutputOptions.reset(options); }
 	std::shared_ptr<OUTPUT_OPTIONS> GetOutputOptions() { return m_OutputOptions; }
 private:
+	//Max number of previous recordings that can be finalizing in the background at the same time.
+	static const LONG MAX_CONCURRENT_FINALIZATIONS = 2;
+	//Max time to wait for the first frame of each source when taking a screenshot with TakeScreenshot.
+	static const DWORD MAX_SCREENSHOT_FRAME_WAIT_MILLIS = 2000;
+
 	bool m_IsDestructing;
-	UINT m_TimerResolution;
+	//Holds the system timer resolution raised for the frame loop, and keeps the timers of the readers on one thread.
+	std::shared_ptr<TimingService> m_TimingService;
 	struct TaskWrapper;
 	std::unique_ptr<TaskWrapper> m_TaskWrapperImpl;
 
+	//Serializes creating, reusing and releasing the device resources, which happens on the calling thread for Warm, Cool and TakeScreenshot,
+	//and on the recording task when a recording starts and ends.
+	CRITICAL_SECTION m_DeviceResourcesCriticalSection;
 	DX_RESOURCES m_DxResources;
 
 	std::unique_ptr<TextureManager> m_TextureManager;
+	//Guards replacing m_OutputManager against SaveReplay, which writes from it on the calling thread while the recording task may hand it over for finalization.
+	CRITICAL_SECTION m_OutputManagerCriticalSection;
 	std::unique_ptr<OutputManager> m_OutputManager;
 	std::unique_ptr<ScreenCaptureManager> m_CaptureManager;
+	//Kept while the recorder is warm, so the captures of the sources keep running between screenshots.
+	std::unique_ptr<ScreenCaptureManager> m_ScreenshotCaptureManager;
 	std::unique_ptr<MouseManager> m_MouseManager;
+	std::unique_ptr<AudioManager> m_AudioManager;
+	std::unique_ptr<OutputFinalizer> m_OutputFinalizer;
 
 	HRESULT m_EncoderResult = E_FAIL;
 	HRESULT m_MfStartupResult = E_FAIL;
@@ -147,6 +207,11 @@ private:
 	std::vector<RECORDING_OVERLAY *> m_Overlays;
 	bool m_IsPaused = false;
 	bool m_IsRecording = false;
+	//Set from the calling thread by Warm and Cool, and read by the recording task when a recording ends.
+	std::atomic<bool> m_IsWarm = false;
+	UINT64 m_WarmMaxVideoMemoryBytes = 0;
+	std::chrono::steady_clock::time_point m_BeginRecordingTime;
+	double m_LastStartupLatencyMillis = -1;
 
 	std::shared_ptr<ENCODER_OPTIONS> m_EncoderOptions;
 	std::shared_ptr<AUDIO_OPTIONS> m_AudioOptions;
@@ -154,15 +219,68 @@ private:
 	std::shared_ptr<SNAPSHOT_OPTIONS> m_SnapshotOptions;
 	std::shared_ptr<OUTPUT_OPTIONS> m_OutputOptions;
 
-	ID3D11Texture2D *m_FrameDataCallbackTexture;
-	D3D11_TEXTURE2D_DESC m_FrameDataCallbackTextureDesc;
+	std::unique_ptr<TextureReadback> m_FrameReadback;
+	std::unique_ptr<FrameExportWriter> m_FrameExportWriter;
+	std::unique_ptr<TextureReadback> m_FrameExportReadback;
+	std::unique_ptr<VideoSnapshotWriter> m_VideoSnapshotWriter;
+	std::vector<std::unique_ptr<RenditionWriter>> m_Renditions;
+	std::unique_ptr<CursorTrackWriter> m_CursorTrackWriter;
+	UINT64 m_CursorTrackMouseEventSequence = 0;
+	INT64 m_LastCursorTrackPointerTimestamp = 0;
 
 	bool CheckDependencies(_Out_ std::wstring *error);
 	HRESULT ConfigureOutputDir(_In_ std::wstring path);
 	REC_RESULT StartRecorderLoop(_In_ const std::vector<RECORDING_SOURCE *> &sources, _In_ const std::vector<RECORDING_OVERLAY *> &overlays, _In_opt_ IStream *pStream);
 
+	HRESULT InitializeFrameReadback();
+	/// <summary>
+	/// Creates the shared memory ring that output frames are exported to, and the readback that fills it.
+	/// </summary>
+	HRESULT BeginFrameExport(_In_ SIZE frameSize);
+	HRESULT InitializeFrameExportReadback();
+	void EndFrameExport();
+	/// <summary>
+	/// Creates the additional outputs of the recording. Renditions that fail to start are logged and left out, the recording continues without them.
+	/// </summary>
+	void BeginRenditions(_In_ SIZE frameSize);
+	HRESULT InitializeRenditions();
+	/// <summary>
+	/// Resizes the frame for each rendition it is due for, and queues it with the audio of the frame.
+	/// </summary>
+	void WriteRenditionFrames(_In_ const FrameWriteModel &model);
+	/// <summary>
+	/// Finalizes all renditions in parallel and waits for them.
+	/// </summary>
+	void EndRenditions();
+	HRESULT InitializeVideoSnapshotWriter();
+	/// <summary>
+	/// Waits for the snapshots taken during the video recording to be written.
+	/// </summary>
+	void EndVideoSnapshots();
+	/// <summary>
+	/// Creates the cursor track next to the recording. The recording continues without it if it can't be created.
+	/// </summary>
+	HRESULT BeginCursorTrack();
+	/// <summary>
+	/// Sends the pointer updates of the capture manager to the cursor track. Must be called again when the capture manager is recreated.
+	/// </summary>
+	void ConnectCursorTrack();
+	/// <summary>
+	/// Writes the pointer, and the mouse events since the last call, to the cursor track.
+	/// </summary>
+	void WriteCursorTrackPointer(_In_ const PTR_INFO &ptrInfo);
+	/// <summary>
+	/// Writes the mouse events since the last call to the cursor track, placed relative to the pointer. The pointer shape is not read, so it may be called without the shared surface locked.
+	/// </summary>
+	void WriteCursorTrackMouseEvents(_In_ const PTR_INFO &ptrInfo);
+	/// <summary>
+	/// Writes how the captured frame maps to the video frame to the cursor track.
+	/// </summary>
+	void WriteCursorTrackViewport(_In_ RECT videoInputFrameRect, _In_ SIZE videoOutputFrameSize);
+	void EndCursorTrack();
 	HRESULT SendNewFrameCallback(_In_ const int frameNumber, _In_ ID3D11Texture2D *pTexture);
 	HRESULT TakeSnapshot(_In_opt_ std::wstring path, _In_opt_ IStream *pStream, _In_opt_ ID3D11Texture2D *pTexture = nullptr);
+	HRESULT TakeScreenshot(_In_opt_ std::wstring path, _In_opt_ IStream *pStream);
 	HRESULT BeginRecording(_In_opt_ std::wstring path, _In_opt_ IStream *pStream);
 
 	/// <summary>
@@ -190,13 +308,6 @@ private:
 	/// <param name="destRect">The area of the texture to save. If the texture is larger, it will be cropped to these coordinates.</param>
 	/// <returns></returns>
 	HRESULT SaveTextureAsVideoSnapshot(_In_ ID3D11Texture2D *pTexture, _In_ IStream *pStream, _In_ RECT destRect);
-	/// <summary>
-	/// Save texture as snapshot image async.
-	/// </summary>
-	/// <param name="pTexture">The texture to save to a snapshot</param>
-	/// <param name="destRect">The area of the texture to save. If the texture is larger, it will be cropped to these coordinates.</param>
-	/// <returns></returns>
-	void RecordingManager::SaveTextureAsVideoSnapshotAsync(_In_ ID3D11Texture2D *pTexture, _In_ std::wstring snapshotPath, _In_ RECT destRect, _In_opt_ std::function<void(HRESULT)> onCompletion);
 
 	/// <summary>
 	/// Adds overlays, mouse cursors, and texture transforms.
@@ -217,6 +328,23 @@ private:
 	/// <returns>S_OK if any processing has been done, S_FALSE if no changes, else an error code</returns>
 	HRESULT ProcessTextureTransforms(_In_ ID3D11Texture2D *pTexture, _Out_ ID3D11Texture2D **ppProcessedTexture, RECT videoInputFrameRect, SIZE videoOutputFrameSize);
 
+	/// <summary>
+	/// Creates the DirectX device and the managers that depend on it, or reuses them if the recorder is warm and the device is still valid.
+	/// </summary>
+	/// <param name="isMouseClickDetectionEnabled">True to start mouse click detection, which is only needed while recording.</param>
+	HRESULT InitializeDeviceResources(_In_ bool isMouseClickDetectionEnabled);
+	/// <summary>
+	/// Releases the DirectX device and all managers kept alive between recordings.
+	/// </summary>
+	void ReleaseDeviceResources();
+	/// <summary>
+	/// Releases the captures kept by TakeScreenshot while the recorder is warm.
+	/// </summary>
+	void ReleaseScreenshotCaptures();
+	/// <summary>
+	/// Returns true if the video memory used by the process exceeds the limit given to Warm.
+	/// </summary>
+	bool IsWarmMemoryLimitExceeded();
 	/// <summary>
 	/// Releases DirectX resources and reports any leaks
 	/// </summary>
@@ -227,5 +355,5 @@ private:
 	/// </summary>
 	/// <param name="result">The recording result.</param>
 	/// <param name="frameDelays">A map of paths to saved frames with corresponding delay between them. Only used for Slideshow mode.</param>
-	void SetRecordingCompleteStatus(_In_ REC_RESULT result, nlohmann::fifo_map<std::wstring, int> frameDelays);
+	void SetRecordingCompleteStatus(_In_ REC_RESULT result, _In_ std::wstring outputPath, _In_ HRESULT encoderResult, _In_opt_ std::shared_ptr<FrameManifest> pFrameManifest);
 };
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include "RenditionWriter.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+struct RenditionWriter::Impl {
+	Impl(const OUTPUT_RENDITION &rendition) :
+		m_Rendition(rendition),
+		m_Output(make_unique<OutputManager>()),
+		m_OutputOptions(make_shared<OUTPUT_OPTIONS>())
+	{
+	}
+
+	~Impl()
+	{
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			m_Queue.clear();
+			m_IsStopping = true;
+		}
+		m_QueueChangedCondition.notify_all();
+		if (m_Thread.joinable()) {
+			m_Thread.join();
+		}
+	}
+
+	HRESULT Initialize(ID3D11DeviceContext *pDeviceContext, ID3D11Device *pDevice, shared_ptr<ENCODER_OPTIONS> pEncoderOptions, shared_ptr<AUDIO_OPTIONS> pAudioOptions, shared_ptr<SNAPSHOT_OPTIONS> pSnapshotOptions)
+	{
+		m_EncoderOptions = pEncoderOptions->Clone();
+		if (m_Rendition.FramerateDivisor > 1) {
+			m_EncoderOptions->SetVideoFps(max(1U, pEncoderOptions->GetVideoFps() / m_Rendition.FramerateDivisor));
+		}
+		if (m_Rendition.VideoBitrate.has_value()) {
+			m_EncoderOptions->SetVideoBitrate(m_Rendition.VideoBitrate.value());
+			if (m_EncoderOptions->GetVideoBitrateMode() == eAVEncCommonRateControlMode_Quality) {
+				//The quality mode ignores the bitrate.
+				m_EncoderOptions->SetVideoBitrateMode(eAVEncCommonRateControlMode_UnconstrainedVBR);
+			}
+		}
+		if (m_Rendition.IsFragmentedMp4Enabled.has_value()) {
+			m_EncoderOptions->SetFragmentedMp4Enabled(m_Rendition.IsFragmentedMp4Enabled.value());
+		}
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			//Queued frames belong to the previous device, so only their audio can still be written.
+			for (FrameWriteModel &model : m_Queue) {
+				if (model.Frame) {
+					model.Frame.Release();
+					m_Stats.DroppedFrames++;
+				}
+			}
+		}
+		return m_Output->Initialize(pDeviceContext, pDevice, m_EncoderOptions, pAudioOptions, pSnapshotOptions, m_OutputOptions);
+	}
+
+	HRESULT BeginRecording(SIZE recordingFrameSize)
+	{
+		m_FrameSize = recordingFrameSize;
+		if (m_Rendition.FrameSize.has_value()) {
+			LONG cx = m_Rendition.FrameSize.value().cx;
+			LONG cy = m_Rendition.FrameSize.value().cy;
+			if (cx > 0 && cy <= 0) {
+				cy = static_cast<LONG>(round((static_cast<double>(recordingFrameSize.cy) / static_cast<double>(recordingFrameSize.cx)) * cx));
+			}
+			else if (cx <= 0 && cy > 0) {
+				cx = static_cast<LONG>(round((static_cast<double>(recordingFrameSize.cx) / static_cast<double>(recordingFrameSize.cy)) * cy));
+			}
+			if (cx > 0 && cy > 0) {
+				//The encoders require even dimensions.
+				m_FrameSize = SIZE{ MakeEven(cx), MakeEven(cy) };
+			}
+		}
+		HRESULT hr = m_Output->BeginRecording(m_Rendition.OutputPath, m_FrameSize);
+		if (FAILED(hr)) {
+			lock_guard<mutex> lock(m_Mutex);
+			m_Result = hr;
+			return hr;
+		}
+		m_Thread = thread([this]() { WriteLoop(); });
+		LOG_INFO(L"Started rendition %ls with frame size %dx%d, %u fps and bitrate %u", m_Rendition.OutputPath.c_str(), m_FrameSize.cx, m_FrameSize.cy, m_EncoderOptions->GetVideoFps(), m_EncoderOptions->GetVideoBitrate());
+		return hr;
+	}
+
+	bool IsFrameDue()
+	{
+		bool isDue = m_FrameCount % max(1U, m_Rendition.FramerateDivisor) == 0;
+		m_FrameCount++;
+		if (!isDue) {
+			lock_guard<mutex> lock(m_Mutex);
+			m_Stats.SkippedFrames++;
+		}
+		return isDue;
+	}
+
+	HRESULT WriteFrame(FrameWriteModel &&model)
+	{
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			if (FAILED(m_Result)) {
+				return m_Result;
+			}
+			if (m_IsStopping || !m_Thread.joinable()) {
+				return E_NOT_VALID_STATE;
+			}
+			if (model.Frame) {
+				size_t queuedFrameCount = count_if(m_Queue.begin(), m_Queue.end(), [](const FrameWriteModel &queued) { return queued.Frame != nullptr; });
+				if (queuedFrameCount >= MAX_QUEUED_FRAMES) {
+					//The encoder can't keep up, so drop the video of the oldest waiting frame. Its audio must still be written, else the audio of the rendition gets gaps.
+					auto oldest = find_if(m_Queue.begin(), m_Queue.end(), [](const FrameWriteModel &queued) { return queued.Frame != nullptr; });
+					oldest->Frame.Release();
+					m_Stats.DroppedFrames++;
+				}
+			}
+			m_Queue.push_back(std::move(model));
+		}
+		m_QueueChangedCondition.notify_one();
+		return S_OK;
+	}
+
+	void EndRecording()
+	{
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			m_IsStopping = true;
+		}
+		m_QueueChangedCondition.notify_all();
+	}
+
+	HRESULT WaitForFinalize()
+	{
+		if (m_Thread.joinable()) {
+			m_Thread.join();
+		}
+		lock_guard<mutex> lock(m_Mutex);
+		return FAILED(m_Result) ? m_Result : m_FinalizeResult;
+	}
+
+	HRESULT GetResult()
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		return m_Result;
+	}
+
+	RENDITION_STATS GetStats()
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		return m_Stats;
+	}
+
+	SIZE GetFrameSize() { return m_FrameSize; }
+	wstring GetOutputPath() { return m_Rendition.OutputPath; }
+
+private:
+	const OUTPUT_RENDITION m_Rendition;
+	unique_ptr<OutputManager> m_Output;
+	shared_ptr<OUTPUT_OPTIONS> m_OutputOptions;
+	shared_ptr<ENCODER_OPTIONS> m_EncoderOptions;
+	SIZE m_FrameSize{};
+	UINT64 m_FrameCount = 0;
+
+	mutex m_Mutex;
+	condition_variable m_QueueChangedCondition;
+	deque<FrameWriteModel> m_Queue;
+	thread m_Thread;
+	bool m_IsStopping = false;
+	HRESULT m_Result = S_OK;
+	HRESULT m_FinalizeResult = S_OK;
+	RENDITION_STATS m_Stats{};
+
+	void WriteLoop()
+	{
+		HRESULT hr = CoInitializeEx(nullptr, COINITBASE_MULTITHREADED | COINIT_DISABLE_OLE1DDE);
+		bool isCoInitialized = SUCCEEDED(hr);
+		unique_lock<mutex> lock(m_Mutex);
+		while (true) {
+			m_QueueChangedCondition.wait(lock, [this]() { return m_IsStopping || !m_Queue.empty(); });
+			if (m_Queue.empty()) {
+				break;
+			}
+			FrameWriteModel model = std::move(m_Queue.front());
+			m_Queue.pop_front();
+			if (FAILED(m_Result)) {
+				continue;
+			}
+			lock.unlock();
+			bool hasFrame = model.Frame != nullptr;
+			hr = m_Output->RenderFrame(model);
+			lock.lock();
+			if (FAILED(hr)) {
+				LOG_ERROR(L"Failed to write to rendition %ls, no more frames are written to it: hr = 0x%08x", m_Rendition.OutputPath.c_str(), hr);
+				m_Result = hr;
+				m_Queue.clear();
+			}
+			else if (hasFrame) {
+				m_Stats.WrittenFrames++;
+			}
+		}
+		lock.unlock();
+		{
+			MeasureExecutionTime measure(L"Finalize rendition");
+			hr = m_Output->FinalizeRecording();
+		}
+		lock.lock();
+		m_FinalizeResult = hr;
+		lock.unlock();
+		if (isCoInitialized) {
+			CoUninitialize();
+		}
+	}
+};
+
+RenditionWriter::RenditionWriter(_In_ const OUTPUT_RENDITION &rendition) :
+	m_Impl(make_unique<Impl>(rendition))
+{
+}
+
+RenditionWriter::~RenditionWriter()
+{
+}
+
+HRESULT RenditionWriter::Initialize(
+	_In_ ID3D11DeviceContext *pDeviceContext,
+	_In_ ID3D11Device *pDevice,
+	_In_ std::shared_ptr<ENCODER_OPTIONS> pEncoderOptions,
+	_In_ std::shared_ptr<AUDIO_OPTIONS> pAudioOptions,
+	_In_ std::shared_ptr<SNAPSHOT_OPTIONS> pSnapshotOptions)
+{
+	return m_Impl->Initialize(pDeviceContext, pDevice, pEncoderOptions, pAudioOptions, pSnapshotOptions);
+}
+
+HRESULT RenditionWriter::BeginRecording(_In_ SIZE recordingFrameSize)
+{
+	return m_Impl->BeginRecording(recordingFrameSize);
+}
+
+bool RenditionWriter::IsFrameDue()
+{
+	return m_Impl->IsFrameDue();
+}
+
+HRESULT RenditionWriter::WriteFrame(_In_ FrameWriteModel &&model)
+{
+	return m_Impl->WriteFrame(std::move(model));
+}
+
+void RenditionWriter::EndRecording()
+{
+	m_Impl->EndRecording();
+}
+
+HRESULT RenditionWriter::WaitForFinalize()
+{
+	return m_Impl->WaitForFinalize();
+}
+
+HRESULT RenditionWriter::GetResult()
+{
+	return m_Impl->GetResult();
+}
+
+SIZE RenditionWriter::GetFrameSize()
+{
+	return m_Impl->GetFrameSize();
+}
+
+std::wstring RenditionWriter::GetOutputPath()
+{
+	return m_Impl->GetOutputPath();
+}
+
+RENDITION_STATS RenditionWriter::GetStats()
+{
+	return m_Impl->GetStats();
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <memory>
+#include "CommonTypes.h"
+#include "OutputManager.h"
+
+struct RENDITION_STATS {
+	/// <summary>Frames encoded to the rendition.</summary>
+	UINT64 WrittenFrames = 0;
+	/// <summary>Frames of the recording that were not encoded because of the framerate divisor.</summary>
+	UINT64 SkippedFrames = 0;
+	/// <summary>Frames whose video was dropped because the encoder of the rendition could not keep up.</summary>
+	UINT64 DroppedFrames = 0;
+};
+
+/// <summary>
+/// Encodes the composed frames of a recording to an additional video output with its own frame size, frame rate, bitrate and container.
+/// Each rendition has its own OutputManager, fed through a short queue by a thread of its own, so a slow rendition never stalls the recording or the other renditions.
+/// If the queue is full, the video of the oldest waiting frame is dropped, but its audio is still written so the rendition stays in sync.
+/// </summary>
+class RenditionWriter
+{
+public:
+	static const UINT MAX_QUEUED_FRAMES = 3;
+
+	RenditionWriter(_In_ const OUTPUT_RENDITION &rendition);
+	/// <summary>
+	/// Discards the frames that are not written yet, finalizes the output and stops the thread.
+	/// </summary>
+	~RenditionWriter();
+	/// <summary>
+	/// Sets up the encoder settings of the rendition from the settings of the recording. Can be called again with a new device after a device loss.
+	/// </summary>
+	HRESULT Initialize(
+		_In_ ID3D11DeviceContext *pDeviceContext,
+		_In_ ID3D11Device *pDevice,
+		_In_ std::shared_ptr<ENCODER_OPTIONS> pEncoderOptions,
+		_In_ std::shared_ptr<AUDIO_OPTIONS> pAudioOptions,
+		_In_ std::shared_ptr<SNAPSHOT_OPTIONS> pSnapshotOptions);
+	/// <summary>
+	/// Creates the output file of the rendition and starts the thread that writes to it.
+	/// </summary>
+	/// <param name="recordingFrameSize">The frame size of the recording, used for any dimension of the rendition frame size that is not set.</param>
+	HRESULT BeginRecording(_In_ SIZE recordingFrameSize);
+	/// <summary>
+	/// Returns true if the next frame of the recording should be encoded to the rendition, according to the framerate divisor. Frames that are not due should be written without a texture.
+	/// </summary>
+	bool IsFrameDue();
+	/// <summary>
+	/// Queues a frame to be written to the rendition. The texture must have the frame size of the rendition, and must not be modified afterwards.
+	/// </summary>
+	/// <returns>The error of the rendition if it has failed, else S_OK.</returns>
+	HRESULT WriteFrame(_In_ FrameWriteModel &&model);
+	/// <summary>
+	/// Stops accepting frames. The queued frames are written and the output is finalized on the rendition thread, so several renditions finalize at the same time.
+	/// </summary>
+	void EndRecording();
+	/// <summary>
+	/// Waits for the output to be finalized after EndRecording.
+	/// </summary>
+	/// <returns>The first error of the rendition, or the result of finalizing the output.</returns>
+	HRESULT WaitForFinalize();
+	/// <summary>
+	/// Returns the first error encountered by the rendition, or S_OK. A failed rendition ignores further frames.
+	/// </summary>
+	HRESULT GetResult();
+	SIZE GetFrameSize();
+	std::wstring GetOutputPath();
+	RENDITION_STATS GetStats();
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_Impl;
+};
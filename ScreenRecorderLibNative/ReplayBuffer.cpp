@@ -0,0 +1,187 @@
+#include "ReplayBuffer.h"
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+struct ReplayBuffer::Impl {
+	struct ENTRY {
+		//Order in which the sample was added, used to keep the original interleaving of the streams.
+		uint64_t Sequence;
+		shared_ptr<const REPLAY_SAMPLE> Sample;
+	};
+
+	Impl(uint32_t videoStreamIndex, int64_t maxDuration, uint64_t maxBytes) :
+		m_VideoStreamIndex(videoStreamIndex),
+		m_MaxDuration(max<int64_t>(maxDuration, 0)),
+		m_MaxBytes(maxBytes)
+	{
+	}
+
+	void AddSample(REPLAY_SAMPLE &&sample)
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		deque<ENTRY> &stream = m_Streams[sample.StreamIndex];
+		bool isVideo = sample.StreamIndex == m_VideoStreamIndex;
+		if (isVideo) {
+			if (stream.empty() && !sample.IsKeyframe) {
+				return;
+			}
+			m_VideoEndTime = max(m_VideoEndTime, sample.Time + sample.Duration);
+		}
+		m_Bytes += sample.Data.size();
+		stream.push_back(ENTRY{ m_NextSequence++, make_shared<const REPLAY_SAMPLE>(std::move(sample)) });
+		Trim();
+	}
+
+	vector<shared_ptr<const REPLAY_SAMPLE>> GetSamples()
+	{
+		vector<ENTRY> entries;
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			const deque<ENTRY> *pVideo = GetVideoStream();
+			if (!pVideo || pVideo->empty()) {
+				return {};
+			}
+			int64_t startTime = pVideo->front().Sample->Time;
+			for (auto const &[streamIndex, stream] : m_Streams) {
+				for (const ENTRY &entry : stream) {
+					if (streamIndex == m_VideoStreamIndex || entry.Sample->Time >= startTime) {
+						entries.push_back(entry);
+					}
+				}
+			}
+		}
+		sort(entries.begin(), entries.end(), [](const ENTRY &a, const ENTRY &b) { return a.Sequence < b.Sequence; });
+		vector<shared_ptr<const REPLAY_SAMPLE>> samples;
+		samples.reserve(entries.size());
+		for (ENTRY &entry : entries) {
+			samples.push_back(std::move(entry.Sample));
+		}
+		return samples;
+	}
+
+	REPLAY_BUFFER_STATS GetStats()
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		REPLAY_BUFFER_STATS stats{};
+		stats.Bytes = m_Bytes;
+		stats.DroppedGops = m_DroppedGops;
+		const deque<ENTRY> *pVideo = GetVideoStream();
+		if (pVideo && !pVideo->empty()) {
+			stats.Duration = m_VideoEndTime - pVideo->front().Sample->Time;
+			stats.GopCount = count_if(pVideo->begin(), pVideo->end(), [](const ENTRY &entry) { return entry.Sample->IsKeyframe; });
+		}
+		return stats;
+	}
+
+	void Clear()
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		m_Streams.clear();
+		m_Bytes = 0;
+		m_VideoEndTime = INT64_MIN;
+	}
+
+private:
+	const uint32_t m_VideoStreamIndex;
+	const int64_t m_MaxDuration;
+	const uint64_t m_MaxBytes;
+
+	mutex m_Mutex;
+	map<uint32_t, deque<ENTRY>> m_Streams;
+	uint64_t m_NextSequence = 0;
+	uint64_t m_Bytes = 0;
+	uint64_t m_DroppedGops = 0;
+	//End of the latest video sample. Not necessarily the last added sample, as frames can be encoded out of presentation order.
+	int64_t m_VideoEndTime = INT64_MIN;
+
+	const deque<ENTRY> *GetVideoStream() const
+	{
+		auto it = m_Streams.find(m_VideoStreamIndex);
+		return it == m_Streams.end() ? nullptr : &it->second;
+	}
+
+	void Trim()
+	{
+		auto videoIt = m_Streams.find(m_VideoStreamIndex);
+		if (videoIt == m_Streams.end() || videoIt->second.empty()) {
+			return;
+		}
+		deque<ENTRY> &video = videoIt->second;
+		while (true) {
+			//The oldest group of pictures ends where the next one starts. The newest group is never dropped.
+			auto nextGop = find_if(video.begin() + 1, video.end(), [](const ENTRY &entry) { return entry.Sample->IsKeyframe; });
+			if (nextGop == video.end()) {
+				break;
+			}
+			bool isExceeded = false;
+			if (m_MaxDuration > 0) {
+				//Only drop the group if the remaining ones still cover the max duration.
+				isExceeded = m_VideoEndTime - nextGop->Sample->Time >= m_MaxDuration;
+			}
+			if (!isExceeded && m_MaxBytes > 0) {
+				isExceeded = m_Bytes > m_MaxBytes;
+			}
+			if (!isExceeded) {
+				break;
+			}
+			for (auto it = video.begin(); it != nextGop; it++) {
+				m_Bytes -= it->Sample->Data.size();
+			}
+			video.erase(video.begin(), nextGop);
+			m_DroppedGops++;
+			//The other streams' samples from the dropped group count towards the size limit until they are dropped too.
+			TrimOtherStreams(video.front().Sample->Time);
+		}
+		TrimOtherStreams(video.front().Sample->Time);
+	}
+
+	/// <summary>
+	/// Drops the samples of the streams other than video that end before the given time.
+	/// Samples of other streams from before the first keyframe can't be played back with any video.
+	/// </summary>
+	void TrimOtherStreams(int64_t startTime)
+	{
+		for (auto &[streamIndex, stream] : m_Streams) {
+			if (streamIndex == m_VideoStreamIndex) {
+				continue;
+			}
+			while (!stream.empty() && stream.front().Sample->Time + stream.front().Sample->Duration <= startTime) {
+				m_Bytes -= stream.front().Sample->Data.size();
+				stream.pop_front();
+			}
+		}
+	}
+};
+
+ReplayBuffer::ReplayBuffer(uint32_t videoStreamIndex, int64_t maxDuration, uint64_t maxBytes) :
+	m_Impl(make_unique<Impl>(videoStreamIndex, maxDuration, maxBytes))
+{
+}
+
+ReplayBuffer::~ReplayBuffer()
+{
+}
+
+void ReplayBuffer::AddSample(REPLAY_SAMPLE sample)
+{
+	m_Impl->AddSample(std::move(sample));
+}
+
+vector<shared_ptr<const REPLAY_SAMPLE>> ReplayBuffer::GetSamples()
+{
+	return m_Impl->GetSamples();
+}
+
+REPLAY_BUFFER_STATS ReplayBuffer::GetStats()
+{
+	return m_Impl->GetStats();
+}
+
+void ReplayBuffer::Clear()
+{
+	m_Impl->Clear();
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/// <summary>
+/// An encoded sample, e.g. an H.264 access unit or an AAC frame. All times are in 100 nanosecond units.
+/// </summary>
+struct REPLAY_SAMPLE {
+	uint32_t StreamIndex = 0;
+	int64_t Time = 0;
+	int64_t Duration = 0;
+	/// <summary>true if the sample can be decoded without any preceding samples. Only used for the video stream.</summary>
+	bool IsKeyframe = false;
+	std::vector<uint8_t> Data;
+};
+
+struct REPLAY_BUFFER_STATS {
+	/// <summary>The duration of the buffered video, in 100 nanosecond units.</summary>
+	int64_t Duration = 0;
+	/// <summary>The size in bytes of all buffered samples.</summary>
+	uint64_t Bytes = 0;
+	/// <summary>The number of buffered groups of pictures, i.e. video keyframes.</summary>
+	size_t GopCount = 0;
+	/// <summary>The number of groups of pictures dropped to stay within the limits.</summary>
+	uint64_t DroppedGops = 0;
+};
+
+/// <summary>
+/// Keeps the most recent encoded samples of a recording in memory, bounded by duration and/or size.
+/// Samples are dropped a whole group of pictures at a time, so the buffer always starts with a video keyframe and can be written to a playable file at any time.
+/// The buffer keeps at least the max duration, and at most one extra group of pictures. The size limit is a hard limit, except that the newest group of pictures is never dropped.
+/// Samples of other streams, e.g. audio, are dropped when they are older than the first buffered video keyframe.
+/// All methods are thread safe.
+/// </summary>
+class ReplayBuffer
+{
+public:
+	/// <param name="videoStreamIndex">The stream whose keyframes delimit the groups of pictures.</param>
+	/// <param name="maxDuration">The duration to keep, in 100 nanosecond units. 0 means no duration limit.</param>
+	/// <param name="maxBytes">The max size in bytes of the buffered samples. 0 means no size limit.</param>
+	ReplayBuffer(uint32_t videoStreamIndex, int64_t maxDuration, uint64_t maxBytes);
+	~ReplayBuffer();
+
+	/// <summary>
+	/// Adds a sample and drops the oldest groups of pictures that are no longer needed to stay within the limits.
+	/// Video samples before the first keyframe are discarded, as they can't be decoded.
+	/// </summary>
+	void AddSample(REPLAY_SAMPLE sample);
+	/// <summary>
+	/// Returns the buffered samples in the order they were added, starting with the first video keyframe.
+	/// The samples are shared with the buffer and must not be modified. Adding samples while the returned samples are in use is safe.
+	/// </summary>
+	std::vector<std::shared_ptr<const REPLAY_SAMPLE>> GetSamples();
+	REPLAY_BUFFER_STATS GetStats();
+	void Clear();
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_Impl;
+};
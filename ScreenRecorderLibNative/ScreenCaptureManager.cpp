@@ -8,6 +8,7 @@
 #include "ImageReader.h"
 #include "GifReader.h"
 #include <typeinfo>
+#include <algorithm>
 #include "DynamicWait.h"
 #include "Exception.h"
 
@@ -33,8 +34,14 @@ ScreenCaptureManager::ScreenCaptureManager() :
 	m_EncoderOptions(nullptr),
 	m_MouseOptions(nullptr),
 	m_FrameCopy(nullptr),
+	m_BitmapCallbackWorkerPool(nullptr),
+	m_SingleFrameCaptures{},
 	m_IsInitialFrameWriteComplete(false),
-	m_IsInitialOverlayWriteComplete(false)
+	m_IsInitialOverlayWriteComplete(false),
+	m_PointerUpdatedCallback(nullptr),
+	m_LastReportedPointerTimeStamp{},
+	m_LastReportedPointerShapeVersion(0),
+	m_LastReportedPointerVisible(false)
 {
 	// Event to tell spawned threads to quit
 	m_TerminateThreadsEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
@@ -46,6 +53,7 @@ ScreenCaptureManager::~ScreenCaptureManager()
 	if (m_IsCapturing) {
 		StopCapture();
 	}
+	ReleaseSingleFrameCaptures();
 	Clean();
 	DeleteCriticalSection(&m_CriticalSection);
 }
@@ -61,12 +69,15 @@ HRESULT ScreenCaptureManager::Initialize(
 	_In_ std::shared_ptr<MOUSE_OPTIONS> pMouseOptions)
 {
 	HRESULT hr = S_OK;
-	m_Device = pDevice;
-	m_DeviceContext = pDeviceContext;
-
 	m_OutputOptions = pOutputOptions;
 	m_EncoderOptions = pEncoderOptions;
 	m_MouseOptions = pMouseOptions;
+	//Called again with the same device, only the options are replaced.
+	if (m_TextureManager && m_Device == pDevice && m_DeviceContext == pDeviceContext) {
+		return hr;
+	}
+	m_Device = pDevice;
+	m_DeviceContext = pDeviceContext;
 
 	m_TextureManager = make_unique<TextureManager>();
 	RETURN_ON_BAD_HR(hr = m_TextureManager->Initialize(m_DeviceContext, m_Device));
@@ -97,6 +108,8 @@ HRESULT ScreenCaptureManager::InitializeRecordingSources(_In_ const std::vector<
 	HRESULT hr = S_FALSE;
 	UINT sourceCount = static_cast<UINT>(recordingSources.size());
 	std::vector<HANDLE> startedEventHandles{};
+	//The bitmap callbacks of all sources share a few threads, instead of stalling each capture thread.
+	m_BitmapCallbackWorkerPool = make_shared<ReadbackWorkerPool>(max(1u, min(sourceCount, MAX_BITMAP_CALLBACK_THREADS)));
 	for (UINT i = 0; i < sourceCount; i++)
 	{
 		// Event for when a thread has started
@@ -119,6 +132,7 @@ HRESULT ScreenCaptureManager::InitializeRecordingSources(_In_ const std::vector<
 		threadData->TerminateThreadsEvent = m_TerminateThreadsEvent;
 		threadData->CanvasTexSharedHandle = sharedHandle;
 		threadData->PtrInfo = &m_PtrInfo;
+		threadData->BitmapCallbackWorkerPool = m_BitmapCallbackWorkerPool;
 
 		threadData->RecordingSource = data;
 		RtlZeroMemory(&threadData->RecordingSource->DxRes, sizeof(DX_RESOURCES));
@@ -233,7 +247,7 @@ HRESULT ScreenCaptureManager::CopyCurrentFrame(_Out_ CAPTURED_FRAME *pFrame)
 	RETURN_ON_BAD_HR(m_Device->CreateTexture2D(&desc, nullptr, &pFrameCopy));
 
 	m_DeviceContext->CopyResource(pFrameCopy, m_FrameCopy);
-	RtlZeroMemory(pFrame, sizeof(pFrame));
+	*pFrame = CAPTURED_FRAME{};
 	pFrame->Frame = pFrameCopy;
 	pFrame->PtrInfo = m_PtrInfo;
 	pFrame->FrameUpdateCount = 0;
@@ -309,7 +323,11 @@ HRESULT ScreenCaptureManager::AcquireNextFrame(_In_  double timeUntilNextFrame,
 			return E_FAIL;
 		}
 		else if (SUCCEEDED(hr)) {
-			haveNewFrame = true;
+			ReportPointerUpdate();
+			//A pointer that is not drawn doesn't change the frame, so it only counts as a new frame if something else was updated too.
+			if (!IsHiddenPointerOnlyUpdate()) {
+				haveNewFrame = true;
+			}
 			if (ShouldDelay()) {
 				m_KeyMutex->ReleaseSync(0);
 				syncTimeout = GetNextSyncTimeout();
@@ -327,6 +345,7 @@ HRESULT ScreenCaptureManager::AcquireNextFrame(_In_  double timeUntilNextFrame,
 		MeasureExecutionTime measure(L"AcquireNextFrame lock");
 		int updatedFrameCount = GetUpdatedSourceCount();
 		int updatedOverlaysCount = GetUpdatedOverlayCount();
+		std::optional<INT64> presentationTime = GetUpdatedPresentationTime();
 
 		if (!m_FrameCopy) {
 			D3D11_TEXTURE2D_DESC desc;
@@ -342,14 +361,150 @@ HRESULT ScreenCaptureManager::AcquireNextFrame(_In_  double timeUntilNextFrame,
 			QueryPerformanceCounter(&m_LastAcquiredFrameTimeStamp);
 		}
 		m_PtrInfo.IsPointerShapeUpdated = false;
-		RtlZeroMemory(pFrame, sizeof(pFrame));
+		*pFrame = CAPTURED_FRAME{};
 		pFrame->Frame = m_FrameCopy;
 		pFrame->PtrInfo = m_PtrInfo;
 		pFrame->FrameUpdateCount = updatedFrameCount;
+		pFrame->PresentationTime = presentationTime;
 	}
 	return hr;
 }
 
+HRESULT ScreenCaptureManager::CaptureSingleFrame(_In_ const std::vector<RECORDING_SOURCE *> &sources, _In_ DWORD timeoutMillis, _Out_ CAPTURED_FRAME *pFrame)
+{
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
+	if (m_IsCapturing) {
+		LOG_ERROR(L"CaptureSingleFrame can not be called while capture threads are running");
+		return E_NOT_VALID_STATE;
+	}
+	HRESULT hr = E_FAIL;
+	std::vector<RECORDING_SOURCE_DATA *> createdOutputs{};
+	ExecuteFuncOnExit deleteOutputsOnExit([&]() {
+		for each (RECORDING_SOURCE_DATA * data in createdOutputs)
+		{
+			delete data;
+		}
+	});
+	RETURN_ON_BAD_HR(hr = GetRecordingSourceLayout(sources, &createdOutputs, &m_OutputRect));
+
+	//All sources are drawn on the calling thread with this device, so the canvas needs no sharing or keyed mutex.
+	D3D11_TEXTURE2D_DESC canvasDesc;
+	RtlZeroMemory(&canvasDesc, sizeof(D3D11_TEXTURE2D_DESC));
+	canvasDesc.Width = RectWidth(m_OutputRect);
+	canvasDesc.Height = RectHeight(m_OutputRect);
+	canvasDesc.MipLevels = 1;
+	canvasDesc.ArraySize = 1;
+	canvasDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+	canvasDesc.SampleDesc.Count = 1;
+	canvasDesc.Usage = D3D11_USAGE_DEFAULT;
+	canvasDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+	m_FrameCopy.Release();
+	RETURN_ON_BAD_HR(hr = m_Device->CreateTexture2D(&canvasDesc, nullptr, &m_FrameCopy));
+
+	//Captures of sources that are no longer recorded are stopped.
+	for (auto it = m_SingleFrameCaptures.begin(); it != m_SingleFrameCaptures.end();) {
+		if (std::find(sources.begin(), sources.end(), it->first) == sources.end()) {
+			it = m_SingleFrameCaptures.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	int updatedFrameCount = 0;
+	for each (RECORDING_SOURCE_DATA * pSourceData in createdOutputs)
+	{
+		RECORDING_SOURCE *pSource = pSourceData->RecordingSource;
+		if (!pSource->IsVideoCaptureEnabled.value_or(true)) {
+			continue;
+		}
+		//Cameras and video files are started for each frame, as keeping them running would keep the camera on or the video decoding between captures.
+		bool isCached = pSource->Type == RecordingSourceType::Display || pSource->Type == RecordingSourceType::Window;
+		SINGLE_FRAME_CAPTURE uncachedCapture{};
+		SINGLE_FRAME_CAPTURE &capture = isCached ? m_SingleFrameCaptures[pSource] : uncachedCapture;
+		if (!capture.Capture) {
+			std::unique_ptr<CaptureBase> pRecordingSourceCapture(CreateCaptureInstance(pSource));
+			if (!pRecordingSourceCapture) {
+				LOG_ERROR(L"Failed to create recording source");
+				m_SingleFrameCaptures.erase(pSource);
+				return E_FAIL;
+			}
+			hr = pRecordingSourceCapture->Initialize(m_DeviceContext, m_Device);
+			if (SUCCEEDED(hr)) {
+				hr = pRecordingSourceCapture->StartCapture(*pSource);
+			}
+			if (FAILED(hr)) {
+				m_SingleFrameCaptures.erase(pSource);
+				return hr;
+			}
+			capture.Capture = std::move(pRecordingSourceCapture);
+			capture.LastFrame.Release();
+		}
+		CaptureBase *pRecordingSourceCapture = capture.Capture.get();
+
+		//Most sources deliver their first frame right away, but e.g. Windows Graphics Capture and video files need a few milliseconds to start.
+		//A running capture has no new frame if nothing changed since the last one, which is then used again.
+		CComPtr<ID3D11Texture2D> pSourceFrame = nullptr;
+		auto waitStart = steady_clock::now();
+		while (true) {
+			hr = pRecordingSourceCapture->AcquireNextFrame(capture.LastFrame ? 0 : 10, &pSourceFrame);
+			if (hr == S_OK) {
+				capture.LastFrame = pSourceFrame;
+				break;
+			}
+			else if (FAILED(hr) && hr != DXGI_ERROR_WAIT_TIMEOUT) {
+				LOG_ERROR(L"Failed to acquire frame from %ls: hr = 0x%08x", pRecordingSourceCapture->Name().c_str(), hr);
+				m_SingleFrameCaptures.erase(pSource);
+				return hr;
+			}
+			pSourceFrame.Release();
+			if (capture.LastFrame) {
+				pSourceFrame = capture.LastFrame;
+				break;
+			}
+			if (duration_cast<milliseconds>(steady_clock::now() - waitStart).count() >= timeoutMillis) {
+				LOG_ERROR(L"Timed out waiting for a frame from %ls", pRecordingSourceCapture->Name().c_str());
+				m_SingleFrameCaptures.erase(pSource);
+				return DXGI_ERROR_WAIT_TIMEOUT;
+			}
+			if (hr == S_FALSE) {
+				Sleep(1);
+			}
+		}
+		if (pSource->IsCursorCaptureEnabled.value_or(true)) {
+			hr = pRecordingSourceCapture->GetMouse(&m_PtrInfo, pSourceData->FrameCoordinates, pSourceData->OffsetX, pSourceData->OffsetY);
+			if (FAILED(hr)) {
+				LOG_ERROR("Failed to get mouse data");
+			}
+		}
+		RECT adjustedFrameCoordinates = pSourceData->FrameCoordinates;
+		if (pSource->OutputSize.has_value()) {
+			adjustedFrameCoordinates = MakeRectEven(RECT
+				{
+					pSourceData->FrameCoordinates.left,
+					pSourceData->FrameCoordinates.top,
+					pSourceData->FrameCoordinates.left + pSource->OutputSize.value().cx,
+					pSourceData->FrameCoordinates.top + pSource->OutputSize.value().cy
+				});
+		}
+		RETURN_ON_BAD_HR(hr = pRecordingSourceCapture->WriteNextFrameToSharedSurface(0, m_FrameCopy, pSourceData->OffsetX, pSourceData->OffsetY, adjustedFrameCoordinates, pSourceFrame));
+		updatedFrameCount++;
+	}
+	*pFrame = CAPTURED_FRAME{};
+	pFrame->Frame = m_FrameCopy;
+	pFrame->PtrInfo = m_PtrInfo;
+	pFrame->FrameUpdateCount = updatedFrameCount;
+	return S_OK;
+}
+
+void ScreenCaptureManager::ReleaseSingleFrameCaptures()
+{
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
+	m_SingleFrameCaptures.clear();
+}
+
 //
 // Clean up resources
 //
@@ -390,6 +545,7 @@ void ScreenCaptureManager::Clean()
 		delete threadObject;
 	}
 	m_CaptureThreads.clear();
+	m_BitmapCallbackWorkerPool.reset();
 
 
 	for each (OVERLAY_THREAD * threadObject in m_OverlayThreads)
@@ -515,6 +671,34 @@ bool ScreenCaptureManager::IsInitialOverlayWriteComplete()
 	return true;
 }
 
+void ScreenCaptureManager::ReportPointerUpdate()
+{
+	if (!m_PointerUpdatedCallback) {
+		return;
+	}
+	if (m_PtrInfo.LastTimeStamp.QuadPart == m_LastReportedPointerTimeStamp.QuadPart
+		&& m_PtrInfo.ShapeVersion == m_LastReportedPointerShapeVersion
+		&& m_PtrInfo.Visible == m_LastReportedPointerVisible) {
+		return;
+	}
+	m_LastReportedPointerTimeStamp = m_PtrInfo.LastTimeStamp;
+	m_LastReportedPointerShapeVersion = m_PtrInfo.ShapeVersion;
+	m_LastReportedPointerVisible = m_PtrInfo.Visible;
+	m_PointerUpdatedCallback(m_PtrInfo);
+}
+
+bool ScreenCaptureManager::IsHiddenPointerOnlyUpdate()
+{
+	if (m_MouseOptions->IsMousePointerEnabled()
+		|| m_EncoderOptions->GetIsFixedFramerate()
+		|| m_OutputOptions->GetRecorderMode() != RecorderModeInternal::Video
+		|| !IsInitialFrameWriteComplete()
+		|| m_LastAcquiredFrameTimeStamp.QuadPart == 0) {
+		return false;
+	}
+	return GetUpdatedSourceCount() == 0 && GetUpdatedOverlayCount() == 0;
+}
+
 UINT ScreenCaptureManager::GetUpdatedSourceCount()
 {
 	int updatedFrameCount = 0;
@@ -541,6 +725,24 @@ UINT ScreenCaptureManager::GetUpdatedOverlayCount()
 	return updatedFrameCount;
 }
 
+std::optional<INT64> ScreenCaptureManager::GetUpdatedPresentationTime()
+{
+	std::optional<INT64> presentationTime = std::nullopt;
+	for each (CAPTURE_THREAD * threadObject in m_CaptureThreads)
+	{
+		if (threadObject->ThreadData && threadObject->ThreadData->LastUpdateTimeStamp.QuadPart > m_LastAcquiredFrameTimeStamp.QuadPart) {
+			presentationTime = max(presentationTime.value_or(0), threadObject->ThreadData->LastPresentTime);
+		}
+	}
+	for each (OVERLAY_THREAD * thread in m_OverlayThreads)
+	{
+		if (thread->ThreadData && thread->ThreadData->LastUpdateTimeStamp.QuadPart > m_LastAcquiredFrameTimeStamp.QuadPart) {
+			presentationTime = max(presentationTime.value_or(0), PerformanceCounterToHundredNanos(thread->ThreadData->LastUpdateTimeStamp.QuadPart));
+		}
+	}
+	return presentationTime;
+}
+
 void ScreenCaptureManager::InvalidateCaptureSources()
 {
 	m_IsInitialFrameWriteComplete = false;
@@ -681,6 +883,13 @@ HRESULT ScreenCaptureManager::ProcessOverlays(_Inout_ ID3D11Texture2D *pCanvasTe
 }
 
 HRESULT ScreenCaptureManager::CreateSharedSurf(_In_ const std::vector<RECORDING_SOURCE *> &sources, _Out_ std::vector<RECORDING_SOURCE_DATA *> *pCreatedOutputs, _Out_ RECT *pDeskBounds, _Outptr_ ID3D11Texture2D **ppSharedTexture, _Outptr_ IDXGIKeyedMutex **ppKeyedMutex)
+{
+	RETURN_ON_BAD_HR(GetRecordingSourceLayout(sources, pCreatedOutputs, pDeskBounds));
+	// Set created outputs
+	return ScreenCaptureManager::CreateSharedSurf(*pDeskBounds, ppSharedTexture, ppKeyedMutex);
+}
+
+HRESULT ScreenCaptureManager::GetRecordingSourceLayout(_In_ const std::vector<RECORDING_SOURCE *> &sources, _Out_ std::vector<RECORDING_SOURCE_DATA *> *pCreatedOutputs, _Out_ RECT *pDeskBounds)
 {
 	*pCreatedOutputs = std::vector<RECORDING_SOURCE_DATA *>();
 	std::vector<std::pair<RECORDING_SOURCE *, RECT>> validOutputs;
@@ -716,9 +925,6 @@ HRESULT ScreenCaptureManager::CreateSharedSurf(_In_ const std::vector<RECORDING_
 		data->FrameCoordinates = sourceRect;
 		pCreatedOutputs->push_back(data);
 	}
-
-	// Set created outputs
-	hr = ScreenCaptureManager::CreateSharedSurf(*pDeskBounds, ppSharedTexture, ppKeyedMutex);
 	return hr;
 }
 
@@ -813,6 +1019,7 @@ Start:
 				hr = E_FAIL;
 				goto Exit;
 			}
+			pRecordingSourceCapture->SetBitmapCallbackWorkerPool(pData->BitmapCallbackWorkerPool);
 
 			// Obtain handle to sync shared Surface
 			hr = pSourceData->DxRes.Device->OpenSharedResource(pData->CanvasTexSharedHandle, __uuidof(ID3D11Texture2D), reinterpret_cast<void **>(&SharedSurf));
@@ -1016,6 +1223,9 @@ Start:
 				}
 				pData->TotalUpdatedFrameCount++;
 				QueryPerformanceCounter(&pData->LastUpdateTimeStamp);
+				//Sources that don't know when their content was presented, like files and cameras, are timed by when it was written.
+				INT64 presentTime = pRecordingSourceCapture->GetLastFramePresentTime();
+				pData->LastPresentTime = presentTime > 0 ? presentTime : PerformanceCounterToHundredNanos(pData->LastUpdateTimeStamp.QuadPart);
 			}
 		}
 		catch (const AccessViolationException &ex) {
@@ -1,11 +1,14 @@
 #pragma once
 #include "CommonTypes.h"
+#include "CaptureBase.h"
 #include "Log.h"
 #include "DX.util.h"
 #include "Screengrab.h"
 #include "TextureManager.h"
 #include "Util.h"
 #include <atlbase.h>
+#include <functional>
+#include <map>
 
 void ProcessCaptureHRESULT(_In_ HRESULT hr, _Inout_ CAPTURE_RESULT *pResult, _In_opt_ ID3D11Device *pDevice);
 
@@ -29,12 +32,36 @@ public:
 	virtual HRESULT AcquireNextFrame(_In_  double timeUntilNextFrame, _In_ double maxFrameLength, _Out_ CAPTURED_FRAME *pFrame);
 	virtual HRESULT StartCapture(_In_ const std::vector<RECORDING_SOURCE *> &sources, _In_ const std::vector<RECORDING_OVERLAY *> &overlays, _In_  HANDLE hErrorEvent);
 	virtual HRESULT StopCapture();
+	/// <summary>
+	/// Captures one frame of each source and composes them on a new canvas, synchronously on the calling thread and with the device given to Initialize. No capture threads are started, and overlays are not drawn.
+	/// Must not be called while the capture threads are running.
+	/// The captures of displays and windows are kept running until ReleaseSingleFrameCaptures is called, so the next call doesn't set them up again.
+	/// They refer to the sources, so they must be released before the sources are deleted.
+	/// </summary>
+	/// <param name="timeoutMillis">The max time to wait for the first frame of each source.</param>
+	/// <param name="pFrame">Receives the composed frame and the mouse pointer info. The frame is owned by the capture manager and is valid until the next capture.</param>
+	/// <returns>S_OK if successful, DXGI_ERROR_WAIT_TIMEOUT if a source delivered no frame in time, else an error code.</returns>
+	virtual HRESULT CaptureSingleFrame(_In_ const std::vector<RECORDING_SOURCE *> &sources, _In_ DWORD timeoutMillis, _Out_ CAPTURED_FRAME *pFrame);
+	/// <summary>
+	/// Stops the captures kept running by CaptureSingleFrame.
+	/// </summary>
+	virtual void ReleaseSingleFrameCaptures();
 	virtual bool IsUpdatedFramesAvailable();
 	virtual bool IsInitialFrameWriteComplete();
 	virtual bool IsInitialOverlayWriteComplete();
 	virtual bool IsCapturing() { return m_IsCapturing; }
+	/// <summary>
+	/// Sets a callback that receives the mouse pointer whenever its position, shape or visibility changes, also when the change doesn't result in a new frame.
+	/// It is called on the thread that calls AcquireNextFrame, while the shared surface is locked, so it must return quickly.
+	/// </summary>
+	virtual void SetPointerUpdatedCallback(_In_ std::function<void(const PTR_INFO &)> callback) { m_PointerUpdatedCallback = callback; }
 	virtual UINT GetUpdatedSourceCount();
 	virtual UINT GetUpdatedOverlayCount();
+	/// <summary>
+	/// Returns the time the newest content written to the shared surface since the last acquired frame was presented, or nullopt if nothing was written.
+	/// Overlays are timed by when they were written, as they don't know when their content was presented.
+	/// </summary>
+	virtual std::optional<INT64> GetUpdatedPresentationTime();
 	virtual void InvalidateCaptureSources();
 	std::vector<CAPTURE_RESULT *> GetCaptureResults();
 	std::vector<CAPTURE_THREAD_DATA> GetCaptureThreadData();
@@ -52,7 +79,15 @@ protected:
 
 	virtual HRESULT CreateSharedSurf(_In_ RECT desktopRect, _Outptr_ ID3D11Texture2D **ppSharedTexture, _Outptr_ IDXGIKeyedMutex **ppKeyedMutex);
 	virtual HRESULT CreateSharedSurf(_In_ const std::vector<RECORDING_SOURCE *> &sources, _Out_ std::vector<RECORDING_SOURCE_DATA *> *pCreatedOutputs, _Out_ RECT *pDeskBounds, _Outptr_ ID3D11Texture2D **ppSharedTexture, _Outptr_ IDXGIKeyedMutex **ppKeyedMutex);
+	/// <summary>
+	/// Calculates the position of each source on the canvas, and the bounds of the canvas.
+	/// </summary>
+	/// <param name="pCreatedOutputs">Receives the layout of each source. The caller owns the returned objects.</param>
+	virtual HRESULT GetRecordingSourceLayout(_In_ const std::vector<RECORDING_SOURCE *> &sources, _Out_ std::vector<RECORDING_SOURCE_DATA *> *pCreatedOutputs, _Out_ RECT *pDeskBounds);
 private:
+	//Max number of threads that run the frame bitmap callbacks of the recording sources.
+	static const UINT MAX_BITMAP_CALLBACK_THREADS = 2;
+
 	bool m_IsInitialFrameWriteComplete;
 	bool m_IsInitialOverlayWriteComplete;
 	bool m_IsCapturing;
@@ -63,11 +98,31 @@ private:
 	std::shared_ptr<MOUSE_OPTIONS> m_MouseOptions;
 	std::unique_ptr<TextureManager> m_TextureManager;
 	CComPtr<ID3D11Texture2D> m_FrameCopy;
+	std::shared_ptr<ReadbackWorkerPool> m_BitmapCallbackWorkerPool;
+	struct SINGLE_FRAME_CAPTURE {
+		std::unique_ptr<CaptureBase> Capture;
+		//The last frame the capture delivered. Displays and windows only deliver frames when their content changes, so it is used again until then.
+		CComPtr<ID3D11Texture2D> LastFrame;
+	};
+	std::map<RECORDING_SOURCE *, SINGLE_FRAME_CAPTURE> m_SingleFrameCaptures;
 
 	std::vector<CAPTURE_THREAD *> m_CaptureThreads;
 	std::vector<OVERLAY_THREAD *> m_OverlayThreads;
 
+	std::function<void(const PTR_INFO &)> m_PointerUpdatedCallback;
+	LARGE_INTEGER m_LastReportedPointerTimeStamp;
+	UINT64 m_LastReportedPointerShapeVersion;
+	bool m_LastReportedPointerVisible;
+
 	void Clean();
+	/// <summary>
+	/// Calls the pointer updated callback if the pointer changed since the last call. The shared surface must be locked.
+	/// </summary>
+	void ReportPointerUpdate();
+	/// <summary>
+	/// Returns true if the last update of the shared surface only moved or changed the pointer, and the pointer is not drawn on the frames. The shared surface must be locked.
+	/// </summary>
+	bool IsHiddenPointerOnlyUpdate();
 	HRESULT WaitForThreadTermination();
 	_Ret_maybenull_ CAPTURE_THREAD_DATA *GetCaptureDataForRect(RECT rect);
 	RECT GetSourceRect(_In_ SIZE canvasSize, _In_ RECORDING_SOURCE_DATA *pSource);
@@ -0,0 +1,140 @@
+#include "SegmentManifest.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+
+static std::string GetRelativeSegmentName(_In_ const std::wstring &segmentPath)
+{
+	return ws2s(std::filesystem::path(segmentPath).filename().wstring());
+}
+
+static std::string EscapeJsonString(_In_ const std::string &value)
+{
+	std::string escaped;
+	escaped.reserve(value.size());
+	for (char c : value) {
+		switch (c) {
+			case '"': escaped += "\\\""; break;
+			case '\\': escaped += "\\\\"; break;
+			case '\n': escaped += "\\n"; break;
+			case '\r': escaped += "\\r"; break;
+			case '\t': escaped += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) {
+					char buffer[8];
+					snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+					escaped += buffer;
+				}
+				else {
+					escaped += c;
+				}
+				break;
+		}
+	}
+	return escaped;
+}
+
+static std::string FormatSeconds(_In_ INT64 hundredNanos)
+{
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.3f", HundredNanosToSeconds(hundredNanos));
+	return buffer;
+}
+
+std::wstring GetSegmentManifestPath(_In_ const std::wstring &outputPath, _In_ SegmentManifestFormatInternal format)
+{
+	std::filesystem::path path = outputPath;
+	switch (format)
+	{
+		case SegmentManifestFormatInternal::M3U8:
+			return path.replace_extension(L".m3u8").wstring();
+		case SegmentManifestFormatInternal::Json:
+			return path.replace_extension(L".json").wstring();
+		default:
+			return L"";
+	}
+}
+
+std::string CreateSegmentPlaylist(_In_ const std::vector<OUTPUT_SEGMENT> &segments, _In_ bool isComplete)
+{
+	INT64 maxDuration = 0;
+	for (const OUTPUT_SEGMENT &segment : segments) {
+		maxDuration = max(maxDuration, segment.Duration);
+	}
+	//The target duration must be an integer no smaller than any segment duration.
+	long long targetDuration = max(1LL, static_cast<long long>(ceil(HundredNanosToSeconds(maxDuration))));
+
+	std::string playlist = "#EXTM3U\n";
+	playlist += "#EXT-X-VERSION:3\n";
+	playlist += "#EXT-X-TARGETDURATION:" + to_string(targetDuration) + "\n";
+	playlist += "#EXT-X-MEDIA-SEQUENCE:0\n";
+	playlist += isComplete ? "#EXT-X-PLAYLIST-TYPE:VOD\n" : "#EXT-X-PLAYLIST-TYPE:EVENT\n";
+	for (size_t i = 0; i < segments.size(); i++) {
+		//Every segment is a self-contained file with timestamps starting at zero.
+		if (i > 0) {
+			playlist += "#EXT-X-DISCONTINUITY\n";
+		}
+		playlist += "#EXTINF:" + FormatSeconds(segments[i].Duration) + ",\n";
+		playlist += GetRelativeSegmentName(segments[i].Path) + "\n";
+	}
+	if (isComplete) {
+		playlist += "#EXT-X-ENDLIST\n";
+	}
+	return playlist;
+}
+
+std::string CreateSegmentJsonManifest(_In_ const std::vector<OUTPUT_SEGMENT> &segments, _In_ bool isComplete)
+{
+	std::string manifest = "{\n";
+	manifest += std::string("\t\"complete\": ") + (isComplete ? "true" : "false") + ",\n";
+	manifest += "\t\"segments\": [";
+	for (size_t i = 0; i < segments.size(); i++) {
+		manifest += i == 0 ? "\n" : ",\n";
+		manifest += "\t\t{ \"index\": " + to_string(i)
+			+ ", \"file\": \"" + EscapeJsonString(GetRelativeSegmentName(segments[i].Path))
+			+ "\", \"start\": " + FormatSeconds(segments[i].StartPos)
+			+ ", \"duration\": " + FormatSeconds(segments[i].Duration) + " }";
+	}
+	manifest += segments.empty() ? "]\n" : "\n\t]\n";
+	manifest += "}\n";
+	return manifest;
+}
+
+HRESULT WriteSegmentManifest(_In_ const std::wstring &manifestPath, _In_ SegmentManifestFormatInternal format, _In_ const std::vector<OUTPUT_SEGMENT> &segments, _In_ bool isComplete)
+{
+	std::string content;
+	switch (format)
+	{
+		case SegmentManifestFormatInternal::M3U8:
+			content = CreateSegmentPlaylist(segments, isComplete);
+			break;
+		case SegmentManifestFormatInternal::Json:
+			content = CreateSegmentJsonManifest(segments, isComplete);
+			break;
+		default:
+			return S_FALSE;
+	}
+	std::wstring tempPath = manifestPath + L".tmp";
+	{
+		std::ofstream file(tempPath, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		if (!file.is_open()) {
+			LOG_ERROR(L"Failed to open segment manifest %ls for writing", tempPath.c_str());
+			return E_ACCESSDENIED;
+		}
+		file.write(content.data(), content.size());
+		if (!file.good()) {
+			LOG_ERROR(L"Failed to write segment manifest %ls", tempPath.c_str());
+			return E_FAIL;
+		}
+	}
+	if (!MoveFileExW(tempPath.c_str(), manifestPath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+		LOG_ERROR(L"Failed to replace segment manifest %ls: hr = 0x%08x", manifestPath.c_str(), hr);
+		return hr;
+	}
+	return S_OK;
+}
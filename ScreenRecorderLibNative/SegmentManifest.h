@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "CommonTypes.h"
+
+struct OUTPUT_SEGMENT
+{
+	//Full path of the segment file.
+	std::wstring Path;
+	//Start of the segment on the recording timeline, in 100 nanosecond units.
+	INT64 StartPos;
+	//Duration of the segment, in 100 nanosecond units.
+	INT64 Duration;
+};
+
+/// <summary>
+/// Returns the path of the manifest for a segmented recording, which is the output path with the extension of the manifest format.
+/// </summary>
+std::wstring GetSegmentManifestPath(_In_ const std::wstring &outputPath, _In_ SegmentManifestFormatInternal format);
+/// <summary>
+/// Creates an HLS-style playlist of the segments, with segment file names relative to the playlist.
+/// </summary>
+/// <param name="isComplete">true if no more segments will be added. Incomplete playlists have no end tag, so players keep polling for new segments.</param>
+std::string CreateSegmentPlaylist(_In_ const std::vector<OUTPUT_SEGMENT> &segments, _In_ bool isComplete);
+/// <summary>
+/// Creates a JSON manifest of the segments, with segment file names relative to the manifest.
+/// </summary>
+/// <param name="isComplete">true if no more segments will be added.</param>
+std::string CreateSegmentJsonManifest(_In_ const std::vector<OUTPUT_SEGMENT> &segments, _In_ bool isComplete);
+/// <summary>
+/// Writes the manifest to a temporary file and moves it in place, so readers never see a partially written manifest.
+/// </summary>
+HRESULT WriteSegmentManifest(_In_ const std::wstring &manifestPath, _In_ SegmentManifestFormatInternal format, _In_ const std::vector<OUTPUT_SEGMENT> &segments, _In_ bool isComplete);
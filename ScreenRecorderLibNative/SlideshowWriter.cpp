@@ -0,0 +1,297 @@
+#include "SlideshowWriter.h"
+#include "SnapshotEncoder.h"
+#include "TextureReadback.h"
+#include <algorithm>
+#include <atlbase.h>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct SlideshowWriter::Impl {
+	struct STAGING_TEXTURE {
+		CComPtr<ID3D11Texture2D> Texture;
+		D3D11_TEXTURE2D_DESC Desc{};
+		bool IsInUse = false;
+	};
+	struct PENDING_FRAME {
+		wstring Path;
+		int FrameDelay;
+		int StagingIndex;
+	};
+	struct COMPLETED_FRAME {
+		wstring Path;
+		int FrameDelay;
+		HRESULT Result;
+	};
+
+	Impl(shared_ptr<FrameManifest> pFrameManifest, UINT threadCount, UINT maxQueuedFrames) :
+		m_ThreadCount(threadCount > 0 ? threadCount : clamp<UINT>(thread::hardware_concurrency() / 2, 1, MAX_DEFAULT_THREAD_COUNT)),
+		m_MaxQueuedFrames(maxQueuedFrames > 0 ? maxQueuedFrames : m_ThreadCount * 2),
+		m_FrameManifest(pFrameManifest),
+		m_WorkerPool(make_unique<ReadbackWorkerPool>(m_ThreadCount))
+	{
+	}
+
+	~Impl()
+	{
+		//Encodes that are already submitted to the pool reference this instance.
+		unique_lock<mutex> lock(m_Mutex);
+		m_FrameEncodedCondition.wait(lock, [this]() { return m_EncodingCount == 0; });
+	}
+
+	HRESULT Initialize(ID3D11DeviceContext *pDeviceContext, ID3D11Device *pDevice, ImageEncoderInternal encoder, REFGUID guidContainerFormat)
+	{
+		if (!m_PendingFrames.empty()) {
+			//Staging textures from a previous device can't be mapped on the new one.
+			LOG_WARN(L"Discarding %zu slideshow frames that were not read back before the device was reinitialized", m_PendingFrames.size());
+			lock_guard<mutex> lock(m_Mutex);
+			m_Stats.FailedFrames += m_PendingFrames.size();
+			m_PendingFrames.clear();
+		}
+		m_StagingTextures.clear();
+		m_StagingTextures.resize(DEFAULT_RING_SIZE);
+		m_DeviceContext = pDeviceContext;
+		m_Device = pDevice;
+		m_Encoder = encoder;
+		m_ContainerFormat = guidContainerFormat;
+		LOG_DEBUG(L"Slideshow writer initialized with %u encoder threads and %u queued frames", m_ThreadCount, m_MaxQueuedFrames);
+		return S_OK;
+	}
+
+	HRESULT WriteFrame(wstring path, int frameDelayMillis, ID3D11Texture2D *pTexture)
+	{
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			if (FAILED(m_Result)) {
+				return m_Result;
+			}
+		}
+		if (!pTexture || !m_Device) {
+			return E_INVALIDARG;
+		}
+		int stagingIndex = GetFreeStagingIndex();
+		while (stagingIndex < 0 && !m_PendingFrames.empty()) {
+			//All staging textures are still in use, so wait for the oldest copy to finish.
+			{
+				lock_guard<mutex> lock(m_Mutex);
+				m_Stats.BlockingWaits++;
+			}
+			RETURN_ON_BAD_HR(ReadNextPendingFrame(true));
+			stagingIndex = GetFreeStagingIndex();
+		}
+		RETURN_ON_BAD_HR(CopyToStagingTexture(pTexture, m_StagingTextures[stagingIndex]));
+		m_StagingTextures[stagingIndex].IsInUse = true;
+		m_PendingFrames.push_back(PENDING_FRAME{ path, frameDelayMillis, stagingIndex });
+		return ReadPendingFrames(false);
+	}
+
+	HRESULT Flush()
+	{
+		HRESULT hr = ReadPendingFrames(true);
+		unique_lock<mutex> lock(m_Mutex);
+		m_FrameEncodedCondition.wait(lock, [this]() { return m_EncodingCount == 0; });
+		return FAILED(m_Result) ? m_Result : hr;
+	}
+
+	SLIDESHOW_WRITER_STATS GetStats()
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		return m_Stats;
+	}
+
+private:
+	const UINT m_ThreadCount;
+	const UINT m_MaxQueuedFrames;
+	CComPtr<ID3D11DeviceContext> m_DeviceContext;
+	CComPtr<ID3D11Device> m_Device;
+	ImageEncoderInternal m_Encoder = ImageEncoderInternal::Wic;
+	GUID m_ContainerFormat{};
+	vector<STAGING_TEXTURE> m_StagingTextures;
+	//Frames copied to a staging texture but not yet mapped, in frame order.
+	deque<PENDING_FRAME> m_PendingFrames;
+	//Sequence number of the next frame handed to the encoders.
+	UINT64 m_NextSequence = 0;
+
+	//Guards everything below, which is shared with the worker pool.
+	mutex m_Mutex;
+	condition_variable m_FrameEncodedCondition;
+	UINT m_EncodingCount = 0;
+	vector<vector<BYTE>> m_FreeBuffers;
+	//Frames that finished encoding before an earlier frame, keyed by sequence number.
+	map<UINT64, COMPLETED_FRAME> m_CompletedFrames;
+	UINT64 m_NextPublishSequence = 0;
+	shared_ptr<FrameManifest> m_FrameManifest;
+	HRESULT m_Result = S_OK;
+	SLIDESHOW_WRITER_STATS m_Stats{};
+
+	//Declared last, so the pool is stopped before the members its work uses are destroyed.
+	unique_ptr<ReadbackWorkerPool> m_WorkerPool;
+
+	int GetFreeStagingIndex()
+	{
+		for (size_t i = 0; i < m_StagingTextures.size(); i++) {
+			if (!m_StagingTextures[i].IsInUse) {
+				return static_cast<int>(i);
+			}
+		}
+		return -1;
+	}
+
+	HRESULT CopyToStagingTexture(ID3D11Texture2D *pTexture, STAGING_TEXTURE &staging)
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		pTexture->GetDesc(&desc);
+		if (!staging.Texture
+			|| staging.Desc.Width != desc.Width
+			|| staging.Desc.Height != desc.Height
+			|| staging.Desc.Format != desc.Format) {
+			staging.Texture.Release();
+			desc.Usage = D3D11_USAGE_STAGING;
+			desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+			desc.MiscFlags = 0;
+			desc.BindFlags = 0;
+			RETURN_ON_BAD_HR(m_Device->CreateTexture2D(&desc, nullptr, &staging.Texture));
+			staging.Desc = desc;
+		}
+		m_DeviceContext->CopyResource(staging.Texture, pTexture);
+		//Submit the copy now, so it is likely finished by the time the frame is mapped.
+		m_DeviceContext->Flush();
+		return S_OK;
+	}
+
+	HRESULT ReadPendingFrames(bool wait)
+	{
+		while (!m_PendingFrames.empty()) {
+			HRESULT hr = ReadNextPendingFrame(wait);
+			if (hr == DXGI_ERROR_WAS_STILL_DRAWING) {
+				return S_OK;
+			}
+			RETURN_ON_BAD_HR(hr);
+		}
+		return S_OK;
+	}
+
+	/// <summary>
+	/// Maps the oldest pending frame into a buffer and submits it to the encoders. Waits for a free encoder slot if the queue is full.
+	/// </summary>
+	/// <returns>DXGI_ERROR_WAS_STILL_DRAWING if wait is false and the GPU has not finished copying the frame.</returns>
+	HRESULT ReadNextPendingFrame(bool wait)
+	{
+		PENDING_FRAME &pending = m_PendingFrames.front();
+		STAGING_TEXTURE &staging = m_StagingTextures[pending.StagingIndex];
+		D3D11_MAPPED_SUBRESOURCE map;
+		HRESULT hr = m_DeviceContext->Map(staging.Texture, 0, D3D11_MAP_READ, wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, &map);
+		if (hr == DXGI_ERROR_WAS_STILL_DRAWING && !wait) {
+			return hr;
+		}
+		if (FAILED(hr)) {
+			LOG_ERROR(L"Failed to map slideshow staging texture: hr = 0x%08x", hr);
+			staging.IsInUse = false;
+			m_PendingFrames.pop_front();
+			lock_guard<mutex> lock(m_Mutex);
+			m_Stats.FailedFrames++;
+			return hr;
+		}
+		vector<BYTE> buffer;
+		{
+			unique_lock<mutex> lock(m_Mutex);
+			if (m_EncodingCount >= m_MaxQueuedFrames) {
+				//The encoders can't keep up. Wait rather than drop the frame, as every slideshow frame must be written.
+				m_Stats.BlockingWaits++;
+				m_FrameEncodedCondition.wait(lock, [this]() { return m_EncodingCount < m_MaxQueuedFrames; });
+			}
+			if (!m_FreeBuffers.empty()) {
+				buffer = std::move(m_FreeBuffers.back());
+				m_FreeBuffers.pop_back();
+			}
+			m_EncodingCount++;
+		}
+		buffer.resize(map.DepthPitch);
+		memcpy(buffer.data(), map.pData, map.DepthPitch);
+		m_DeviceContext->Unmap(staging.Texture, 0);
+		staging.IsInUse = false;
+
+		UINT64 sequence = m_NextSequence++;
+		UINT rowPitch = map.RowPitch;
+		UINT width = staging.Desc.Width;
+		UINT height = staging.Desc.Height;
+		DXGI_FORMAT format = staging.Desc.Format;
+		ImageEncoderInternal encoder = m_Encoder;
+		GUID containerFormat = m_ContainerFormat;
+		wstring path = std::move(pending.Path);
+		int frameDelay = pending.FrameDelay;
+		m_PendingFrames.pop_front();
+		m_WorkerPool->Submit([this, sequence, rowPitch, width, height, format, containerFormat, path, frameDelay, buffer = std::move(buffer)]() mutable {
+			HRESULT hr = CoInitializeEx(nullptr, COINITBASE_MULTITHREADED | COINIT_DISABLE_OLE1DDE);
+			bool isCoInitialized = SUCCEEDED(hr);
+			hr = SaveSnapshotBitmapToFile(buffer.data(), rowPitch, width, height, format, encoder, containerFormat, path.c_str());
+			if (isCoInitialized) {
+				CoUninitialize();
+			}
+			OnFrameEncoded(sequence, COMPLETED_FRAME{ std::move(path), frameDelay, hr }, std::move(buffer));
+		});
+		return S_OK;
+	}
+
+	/// <summary>
+	/// Runs on the worker pool. Publishes the frame, and any later frames that were waiting for it, in frame order.
+	/// </summary>
+	void OnFrameEncoded(UINT64 sequence, COMPLETED_FRAME &&frame, vector<BYTE> &&buffer)
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		m_FreeBuffers.push_back(std::move(buffer));
+		m_CompletedFrames.insert(make_pair(sequence, std::move(frame)));
+		for (auto next = m_CompletedFrames.find(m_NextPublishSequence); next != m_CompletedFrames.end(); next = m_CompletedFrames.find(++m_NextPublishSequence)) {
+			COMPLETED_FRAME &completed = next->second;
+			if (SUCCEEDED(completed.Result)) {
+				m_FrameManifest->Append(completed.Path, completed.FrameDelay);
+				m_Stats.WrittenFrames++;
+			}
+			else {
+				LOG_ERROR(L"Writing of slideshow frame %ls failed: hr = 0x%08x", completed.Path.c_str(), completed.Result);
+				m_Stats.FailedFrames++;
+				if (SUCCEEDED(m_Result)) {
+					m_Result = completed.Result;
+				}
+			}
+			m_CompletedFrames.erase(next);
+		}
+		m_EncodingCount--;
+		m_FrameEncodedCondition.notify_all();
+	}
+};
+
+SlideshowWriter::SlideshowWriter(_In_ std::shared_ptr<FrameManifest> pFrameManifest, _In_ UINT threadCount, _In_ UINT maxQueuedFrames) :
+	m_Impl(make_unique<Impl>(pFrameManifest, threadCount, maxQueuedFrames))
+{
+}
+
+SlideshowWriter::~SlideshowWriter()
+{
+}
+
+HRESULT SlideshowWriter::Initialize(_In_ ID3D11DeviceContext *pDeviceContext, _In_ ID3D11Device *pDevice, _In_ ImageEncoderInternal encoder, _In_ REFGUID guidContainerFormat)
+{
+	return m_Impl->Initialize(pDeviceContext, pDevice, encoder, guidContainerFormat);
+}
+
+HRESULT SlideshowWriter::WriteFrame(_In_ std::wstring path, _In_ int frameDelayMillis, _In_ ID3D11Texture2D *pTexture)
+{
+	return m_Impl->WriteFrame(std::move(path), frameDelayMillis, pTexture);
+}
+
+HRESULT SlideshowWriter::Flush()
+{
+	return m_Impl->Flush();
+}
+
+SLIDESHOW_WRITER_STATS SlideshowWriter::GetStats()
+{
+	return m_Impl->GetStats();
+}
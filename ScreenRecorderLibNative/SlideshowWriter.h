@@ -0,0 +1,59 @@
+#pragma once
+#include <d3d11.h>
+#include <memory>
+#include <string>
+#include "CommonTypes.h"
+#include "FrameManifest.h"
+
+struct SLIDESHOW_WRITER_STATS {
+	/// <summary>Frames encoded and written to their file.</summary>
+	UINT64 WrittenFrames = 0;
+	/// <summary>Frames that could not be read back or encoded.</summary>
+	UINT64 FailedFrames = 0;
+	/// <summary>Times the caller had to wait, either for the GPU to finish a copy or for an encoder thread to become free.</summary>
+	UINT64 BlockingWaits = 0;
+};
+
+/// <summary>
+/// Writes slideshow frames to image files without encoding them on the recording thread.
+/// Each texture is copied to a ring of staging textures, and mapped into a pooled buffer once the GPU has finished the copy. The buffers are encoded with the snapshot encoder in parallel on a pool of worker threads.
+/// Frames are never dropped. If all encoder threads are busy and the queue is full, WriteFrame waits, so a slow disk slows down the recording instead of losing frames.
+/// The frames are appended to the frame manifest in frame order as they complete, regardless of the order the encoders finish in.
+/// All methods except GetStats must be called from one thread at a time.
+/// </summary>
+class SlideshowWriter
+{
+public:
+	static const UINT DEFAULT_RING_SIZE = 3;
+	static const UINT MAX_DEFAULT_THREAD_COUNT = 4;
+
+	/// <param name="pFrameManifest">Receives the paths and delays of the written frames. It must not be read until Flush returns.</param>
+	/// <param name="threadCount">The number of encoder threads. 0 uses half the processor count, up to MAX_DEFAULT_THREAD_COUNT.</param>
+	/// <param name="maxQueuedFrames">The number of frames that can be read back and waiting for or being encoded before WriteFrame waits. 0 uses twice the thread count.</param>
+	SlideshowWriter(_In_ std::shared_ptr<FrameManifest> pFrameManifest, _In_ UINT threadCount = 0, _In_ UINT maxQueuedFrames = 0);
+	/// <summary>
+	/// Discards frames that are not read back yet, and waits for the frames being encoded.
+	/// </summary>
+	~SlideshowWriter();
+	/// <summary>
+	/// Sets up the writer for a device. Can be called again with a new device, e.g. after a device loss. Frames that were still being copied on the previous device are lost.
+	/// </summary>
+	HRESULT Initialize(_In_ ID3D11DeviceContext *pDeviceContext, _In_ ID3D11Device *pDevice, _In_ ImageEncoderInternal encoder, _In_ REFGUID guidContainerFormat);
+	/// <summary>
+	/// Copies the texture to the staging ring and queues it to be encoded to the given file.
+	/// </summary>
+	/// <param name="path">The file to write the frame to.</param>
+	/// <param name="frameDelayMillis">The delay of the frame in the frame delay manifest.</param>
+	/// <param name="pTexture">The frame. It can be reused by the caller when this returns.</param>
+	/// <returns>The error of an earlier frame if one has failed, so the recording stops, else the result of queuing this frame.</returns>
+	HRESULT WriteFrame(_In_ std::wstring path, _In_ int frameDelayMillis, _In_ ID3D11Texture2D *pTexture);
+	/// <summary>
+	/// Waits for all frames to be written.
+	/// </summary>
+	/// <returns>The first error of any frame, or S_OK.</returns>
+	HRESULT Flush();
+	SLIDESHOW_WRITER_STATS GetStats();
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_Impl;
+};
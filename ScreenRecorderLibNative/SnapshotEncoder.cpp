@@ -0,0 +1,174 @@
+#include "SnapshotEncoder.h"
+#include "ImageEncoder.h"
+#include "Util.h"
+#include "screengrab.h"
+#include <algorithm>
+#include <atlbase.h>
+#include <fstream>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+static bool TryGetPixelLayout(_In_ DXGI_FORMAT format, _Out_ ImagePixelLayout *pLayout)
+{
+	switch (format)
+	{
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		case DXGI_FORMAT_B8G8R8X8_UNORM:
+		case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+			*pLayout = ImagePixelLayout::Bgra32;
+			return true;
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+			*pLayout = ImagePixelLayout::Rgba32;
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// <summary>
+/// Encodes the bitmap with a built-in encoder.
+/// </summary>
+/// <returns>S_FALSE if the bitmap should be encoded with WIC instead.</returns>
+static HRESULT EncodeBitmap(_In_ const BYTE *pData, _In_ UINT rowPitch, _In_ UINT width, _In_ UINT height, _In_ DXGI_FORMAT format, _In_ ImageEncoderInternal encoder, _Inout_ std::vector<uint8_t> &output)
+{
+	if (encoder == ImageEncoderInternal::Wic) {
+		return S_FALSE;
+	}
+	IMAGE_BITMAP bitmap;
+	if (!TryGetPixelLayout(format, &bitmap.Layout)) {
+		if (encoder == ImageEncoderInternal::Qoi) {
+			LOG_ERROR(L"The QOI encoder does not support the pixel format %d", format);
+			return WINCODEC_ERR_UNSUPPORTEDPIXELFORMAT;
+		}
+		LOG_DEBUG(L"The built-in encoders do not support the pixel format %d, encoding with WIC", format);
+		return S_FALSE;
+	}
+	bitmap.pData = pData;
+	bitmap.Width = width;
+	bitmap.Height = height;
+	bitmap.Stride = rowPitch;
+	bool isEncoded = false;
+	try {
+		switch (encoder)
+		{
+			case ImageEncoderInternal::FastPng:
+				isEncoded = EncodeFastPng(bitmap, output);
+				break;
+			case ImageEncoderInternal::Qoi:
+				isEncoded = EncodeQoi(bitmap, output);
+				break;
+			case ImageEncoderInternal::FastJpeg:
+				isEncoded = EncodeFastJpeg(bitmap, DEFAULT_FAST_JPEG_QUALITY, output);
+				break;
+			default:
+				return S_FALSE;
+		}
+	}
+	catch (const std::bad_alloc &) {
+		return E_OUTOFMEMORY;
+	}
+	return isEncoded ? S_OK : E_INVALIDARG;
+}
+
+HRESULT SaveSnapshotBitmapToFile(
+	_In_ const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_ DXGI_FORMAT format,
+	_In_ ImageEncoderInternal encoder,
+	_In_ REFGUID guidContainerFormat,
+	_In_z_ const wchar_t *filePath)
+{
+	std::vector<uint8_t> output;
+	HRESULT hr = EncodeBitmap(pData, rowPitch, width, height, format, encoder, output);
+	if (hr == S_FALSE) {
+		return SaveWICBitmapToFile(pData, rowPitch, width, height, format, guidContainerFormat, filePath);
+	}
+	RETURN_ON_BAD_HR(hr);
+	{
+		std::ofstream file(filePath, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		if (!file.is_open()) {
+			LOG_ERROR(L"Failed to open %ls for writing", filePath);
+			return E_ACCESSDENIED;
+		}
+		file.write(reinterpret_cast<const char *>(output.data()), output.size());
+		if (file.good()) {
+			return S_OK;
+		}
+	}
+	LOG_ERROR(L"Failed to write %ls", filePath);
+	DeleteFileW(filePath);
+	return E_FAIL;
+}
+
+HRESULT SaveSnapshotBitmapToStream(
+	_In_ const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_ DXGI_FORMAT format,
+	_In_ ImageEncoderInternal encoder,
+	_In_ REFGUID guidContainerFormat,
+	_In_ IStream *pStream)
+{
+	if (!pStream) {
+		return E_INVALIDARG;
+	}
+	std::vector<uint8_t> output;
+	HRESULT hr = EncodeBitmap(pData, rowPitch, width, height, format, encoder, output);
+	if (hr == S_FALSE) {
+		CComPtr<IWICImagingFactory> pWIC;
+		RETURN_ON_BAD_HR(CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&pWIC)));
+		CComPtr<IWICStream> wicStream;
+		RETURN_ON_BAD_HR(pWIC->CreateStream(&wicStream));
+		RETURN_ON_BAD_HR(wicStream->InitializeFromIStream(pStream));
+		return SaveWICBitmapToWicStream(pData, rowPitch, width, height, format, guidContainerFormat, wicStream);
+	}
+	RETURN_ON_BAD_HR(hr);
+	size_t written = 0;
+	while (written < output.size()) {
+		ULONG chunkWritten = 0;
+		ULONG chunkSize = static_cast<ULONG>((std::min)(output.size() - written, static_cast<size_t>(MAXLONG)));
+		RETURN_ON_BAD_HR(pStream->Write(output.data() + written, chunkSize, &chunkWritten));
+		if (chunkWritten == 0) {
+			return STG_E_MEDIUMFULL;
+		}
+		written += chunkWritten;
+	}
+	return S_OK;
+}
+
+HRESULT SaveSnapshotTextureToFile(
+	_In_ ID3D11DeviceContext *pContext,
+	_In_ ID3D11Texture2D *pTexture,
+	_In_ ImageEncoderInternal encoder,
+	_In_ REFGUID guidContainerFormat,
+	_In_z_ const wchar_t *filePath)
+{
+	if (encoder == ImageEncoderInternal::Wic) {
+		return SaveWICTextureToFile(pContext, pTexture, guidContainerFormat, filePath);
+	}
+	return ReadTextureBitmap(pContext, pTexture, [&](const BYTE *pData, UINT rowPitch, const D3D11_TEXTURE2D_DESC &desc) {
+		return SaveSnapshotBitmapToFile(pData, rowPitch, desc.Width, desc.Height, desc.Format, encoder, guidContainerFormat, filePath);
+	});
+}
+
+HRESULT SaveSnapshotTextureToStream(
+	_In_ ID3D11DeviceContext *pContext,
+	_In_ ID3D11Texture2D *pTexture,
+	_In_ ImageEncoderInternal encoder,
+	_In_ REFGUID guidContainerFormat,
+	_In_ IStream *pStream)
+{
+	if (encoder == ImageEncoderInternal::Wic) {
+		return SaveWICTextureToStream(pContext, pTexture, guidContainerFormat, pStream);
+	}
+	return ReadTextureBitmap(pContext, pTexture, [&](const BYTE *pData, UINT rowPitch, const D3D11_TEXTURE2D_DESC &desc) {
+		return SaveSnapshotBitmapToStream(pData, rowPitch, desc.Width, desc.Height, desc.Format, encoder, guidContainerFormat, pStream);
+	});
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <d3d11.h>
+#include "CommonTypes.h"
+
+//Encodes snapshots and slideshow frames with the encoder selected in the snapshot options: WIC in the container format of the options, or one of the built-in encoders in ImageEncoder.h.
+//The built-in encoders only handle 8 bit RGB formats. Other formats fall back to WIC in the same container format, except QOI, which WIC can't write.
+
+/// <summary>
+/// Encodes a bitmap in memory to a file. Safe to call from any thread.
+/// </summary>
+HRESULT SaveSnapshotBitmapToFile(
+	_In_ const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_ DXGI_FORMAT format,
+	_In_ ImageEncoderInternal encoder,
+	_In_ REFGUID guidContainerFormat,
+	_In_z_ const wchar_t *filePath);
+
+/// <summary>
+/// Encodes a bitmap in memory to a stream. Safe to call from any thread.
+/// </summary>
+HRESULT SaveSnapshotBitmapToStream(
+	_In_ const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_ DXGI_FORMAT format,
+	_In_ ImageEncoderInternal encoder,
+	_In_ REFGUID guidContainerFormat,
+	_In_ IStream *pStream);
+
+HRESULT SaveSnapshotTextureToFile(
+	_In_ ID3D11DeviceContext *pContext,
+	_In_ ID3D11Texture2D *pTexture,
+	_In_ ImageEncoderInternal encoder,
+	_In_ REFGUID guidContainerFormat,
+	_In_z_ const wchar_t *filePath);
+
+HRESULT SaveSnapshotTextureToStream(
+	_In_ ID3D11DeviceContext *pContext,
+	_In_ ID3D11Texture2D *pTexture,
+	_In_ ImageEncoderInternal encoder,
+	_In_ REFGUID guidContainerFormat,
+	_In_ IStream *pStream);
@@ -1,8 +1,14 @@
 #include "SourceReaderBase.h"
 #include <Mferror.h>
 #include "Cleanup.h"
+#include <algorithm>
 using namespace std;
 
+//How much of the start of the video is cached for gapless looping, in 100 nanosecond units. It covers the time the source reader needs to seek back and decode the first frames again.
+static const LONGLONG LOOP_PREROLL_DURATION = 5000000;
+//The most memory the loop cache may use for decoded Bgra frames.
+static const UINT64 MAX_LOOP_CACHE_BYTES = 256ull * 1024 * 1024;
+
 SourceReaderBase::SourceReaderBase() :
 	m_Sample{ nullptr },
 	m_LastSampleReceivedTimeStamp{ 0 },
@@ -20,7 +26,22 @@ SourceReaderBase::SourceReaderBase() :
 	m_BufferSize(0),
 	m_PtrFrameBuffer(nullptr),
 	m_DeviceManager(nullptr),
-	m_ResetToken(0)
+	m_ResetToken(0),
+	m_YuvColorMatrix(YuvColorMatrix::BT601),
+	m_YuvColorRange(YuvColorRange::Limited),
+	m_LoopMode(VideoLoopModeInternal::Seek),
+	m_LoopCache{},
+	m_IsLoopCacheFilling(false),
+	m_IsLoopCacheComplete(false),
+	m_LoopCacheStartTime(0),
+	m_LoopCacheStartLoop(0),
+	m_LoopCacheServedFrame(-1),
+	m_LoopCount(0),
+	m_LoopDuration(0),
+	m_FirstSampleTimestamp(std::nullopt),
+	m_LastSampleTimestamp(0),
+	m_LastFrameTime(0),
+	m_IsWaitingForFirstLoopFrame(false)
 {
 	InitializeCriticalSection(&m_CriticalSection);
 	m_NewFrameEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
@@ -47,6 +68,10 @@ HRESULT SourceReaderBase::StartCapture(_In_ RECORDING_SOURCE_BASE &recordingSour
 	EnterCriticalSection(&m_CriticalSection);
 	LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"StartCapture");
 	m_RecordingSource = &recordingSource;
+	m_SourceName = recordingSource.SourceStream ? L"stream" : recordingSource.SourcePath;
+	ResetLoopCache();
+	m_LoopMode = recordingSource.LoopMode.value_or(VideoLoopModeInternal::Seek);
+	m_IsLoopCacheFilling = m_LoopMode != VideoLoopModeInternal::Seek;
 	long streamIndex;
 
 	if (recordingSource.SourceStream) {
@@ -59,6 +84,24 @@ HRESULT SourceReaderBase::StartCapture(_In_ RECORDING_SOURCE_BASE &recordingSour
 	RETURN_ON_BAD_HR(GetDefaultStride(m_OutputMediaType, &m_Stride));
 	RETURN_ON_BAD_HR(GetFrameRate(m_InputMediaType, &m_FrameRate));
 	RETURN_ON_BAD_HR(GetFrameSize(m_InputMediaType, &m_FrameSize));
+
+	GUID outputSubtype;
+	RETURN_ON_BAD_HR(m_OutputMediaType->GetGUID(MF_MT_SUBTYPE, &outputSubtype));
+	YuvFormat yuvFormat;
+	if (GetYuvFormat(outputSubtype, &yuvFormat)) {
+		m_YuvFormat = yuvFormat;
+		m_YuvColorMatrix = MFGetAttributeUINT32(m_OutputMediaType, MF_MT_YUV_MATRIX, MFVideoTransferMatrix_BT601) == MFVideoTransferMatrix_BT709 ? YuvColorMatrix::BT709 : YuvColorMatrix::BT601;
+		//JPEG uses the full range, so MJPEG decoded to YUV does too unless the decoder says otherwise.
+		GUID inputSubtype = GUID_NULL;
+		m_InputMediaType->GetGUID(MF_MT_SUBTYPE, &inputSubtype);
+		UINT32 defaultRange = inputSubtype == MFVideoFormat_MJPG ? MFNominalRange_0_255 : MFNominalRange_16_235;
+		m_YuvColorRange = MFGetAttributeUINT32(m_OutputMediaType, MF_MT_VIDEO_NOMINAL_RANGE, defaultRange) == MFNominalRange_0_255 ? YuvColorRange::Full : YuvColorRange::Limited;
+		LOG_DEBUG(L"Converting %ls frames to Bgra with %ls %ls range", yuvFormat == YuvFormat::NV12 ? L"NV12" : L"YUY2",
+			m_YuvColorMatrix == YuvColorMatrix::BT709 ? L"BT.709" : L"BT.601", m_YuvColorRange == YuvColorRange::Full ? L"full" : L"limited");
+	}
+	else {
+		m_YuvFormat.reset();
+	}
 	if (SUCCEEDED(hr))
 	{
 		ResetEvent(m_StopCaptureEvent);
@@ -93,6 +136,18 @@ void SourceReaderBase::Close()
 {
 	EnterCriticalSection(&m_CriticalSection);
 	SafeRelease(&m_Sample);
+	m_TransformSample.Release();
+	m_GpuFrameTexture.Release();
+	if (m_Stats.GpuFrames > 0 || m_Stats.CopiedFrames > 0) {
+		LOG_INFO(L"Source %ls: %llu frames copied on the GPU, %llu frames copied through system memory with %llu bytes per frame", m_SourceName.c_str(),
+			m_Stats.GpuFrames, m_Stats.CopiedFrames, m_Stats.CopiedFrames > 0 ? m_Stats.CopiedBytes / m_Stats.CopiedFrames : 0);
+		if (m_Stats.Loops > 0) {
+			LOG_INFO(L"Source %ls: looped %u times, %llu frames shown from the loop cache, longest loop gap %.1f ms", m_SourceName.c_str(),
+				m_Stats.Loops, m_Stats.CachedFrames, m_Stats.MaxLoopGapMillis);
+		}
+		m_Stats = SOURCE_READER_STATS();
+	}
+	ResetLoopCache();
 	if (m_FramerateTimer) {
 		m_FramerateTimer->StopTimer(true);
 	}
@@ -108,7 +163,15 @@ HRESULT SourceReaderBase::AcquireNextFrame(_In_ DWORD timeoutMillis, _Outptr_opt
 	DWORD result = WAIT_OBJECT_0;
 
 	if (m_LastGrabTimeStamp.QuadPart >= m_LastSampleReceivedTimeStamp.QuadPart) {
-		result = WaitForSingleObject(m_NewFrameEvent, timeoutMillis);
+		//While the loop cache plays, wake up in time for its next frame.
+		DWORD loopCacheWaitMillis = GetMillisUntilNextLoopCacheFrame();
+		result = WaitForSingleObject(m_NewFrameEvent, min(timeoutMillis, loopCacheWaitMillis));
+		if (result == WAIT_TIMEOUT && loopCacheWaitMillis <= timeoutMillis) {
+			HRESULT hr = AcquireLoopCacheFrame(ppFrame);
+			if (hr != S_FALSE) {
+				return hr;
+			}
+		}
 	}
 	HRESULT hr = S_OK;
 	if (result == WAIT_OBJECT_0) {
@@ -117,40 +180,14 @@ HRESULT SourceReaderBase::AcquireNextFrame(_In_ DWORD timeoutMillis, _Outptr_opt
 			EnterCriticalSection(&m_CriticalSection);
 			LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"GetFrameBuffer");
 
-
-			DWORD len;
-			BYTE *data;
-			hr = m_Sample->Lock(&data, NULL, &len);
-			ExecuteFuncOnExit releaseSampleLock([&]() {
-				m_Sample->Unlock();
-			});
-			if (FAILED(hr))
-			{
-				delete[] m_PtrFrameBuffer;
-				m_PtrFrameBuffer = nullptr;
-				return hr;
-			}
-			if (SUCCEEDED(hr)) {
-				hr = ResizeFrameBuffer(len);
-				int bytesPerPixel = abs(m_Stride) / m_FrameSize.cx;
-				//Copy the bitmap buffer, with handling of negative stride. https://docs.microsoft.com/en-us/windows/win32/medfound/image-stride
-				hr = MFCopyImage(
-					m_PtrFrameBuffer,       // Destination buffer.
-					abs(m_Stride),                    // Destination stride. We use the absolute value to flip bitmaps with negative stride. 
-					m_Stride > 0 ? data : data + (m_FrameSize.cy - 1) * abs(m_Stride), // First row in source image with positive stride, or the last row with negative stride.
-					m_Stride,						  // Source stride.
-					bytesPerPixel * m_FrameSize.cx,	      // Image width in bytes.
-					m_FrameSize.cy						  // Image height in pixels.
-				);
-
-				CComPtr<ID3D11Texture2D> pTexture;
-				hr = m_TextureManager->CreateTextureFromBuffer(m_PtrFrameBuffer, m_Stride, m_FrameSize.cx, m_FrameSize.cy, &pTexture, 0, D3D11_BIND_SHADER_RESOURCE);
-				if (SUCCEEDED(hr)) {
-					*ppFrame = pTexture;
-					(*ppFrame)->AddRef();
-					QueryPerformanceCounter(&m_LastGrabTimeStamp);
-				}
-			}
+			CComPtr<ID3D11Texture2D> pTexture;
+			bool isGpuFrame;
+			UINT64 copiedBytes;
+			RETURN_ON_BAD_HR(hr = CreateFrameTexture(m_Sample, false, &pTexture, &isGpuFrame, &copiedBytes));
+			UpdateStats(isGpuFrame, copiedBytes);
+			*ppFrame = pTexture;
+			(*ppFrame)->AddRef();
+			QueryPerformanceCounter(&m_LastGrabTimeStamp);
 		}
 	}
 	else if (result == WAIT_TIMEOUT) {
@@ -164,6 +201,370 @@ HRESULT SourceReaderBase::AcquireNextFrame(_In_ DWORD timeoutMillis, _Outptr_opt
 	return hr;
 }
 
+HRESULT SourceReaderBase::CreateFrameTexture(_In_ IMFMediaBuffer *pBuffer, _In_ bool isNewTexture, _Outptr_ ID3D11Texture2D **ppFrame, _Out_ bool *pIsGpuFrame, _Out_ UINT64 *pCopiedBytes)
+{
+	*ppFrame = nullptr;
+	*pIsGpuFrame = false;
+	*pCopiedBytes = 0;
+	if (!pBuffer) {
+		return E_POINTER;
+	}
+	HRESULT hr;
+	{
+		CComPtr<ID3D11Texture2D> pTexture;
+		if (CopyDXGIBufferToTexture(pBuffer, isNewTexture, &pTexture) == S_OK) {
+			*pIsGpuFrame = true;
+			*ppFrame = pTexture;
+			(*ppFrame)->AddRef();
+			return S_OK;
+		}
+	}
+
+	if (m_YuvFormat.has_value()) {
+		RETURN_ON_BAD_HR(hr = ConvertYuvFrame(pBuffer));
+		CComPtr<ID3D11Texture2D> pTexture;
+		RETURN_ON_BAD_HR(hr = m_TextureManager->CreateTextureFromBuffer(m_PtrFrameBuffer, m_FrameSize.cx * 4, m_FrameSize.cx, m_FrameSize.cy, &pTexture, 0, D3D11_BIND_SHADER_RESOURCE));
+		*pCopiedBytes = (UINT64)m_FrameSize.cx * 4 * m_FrameSize.cy;
+		*ppFrame = pTexture;
+		(*ppFrame)->AddRef();
+		return hr;
+	}
+
+	DWORD len;
+	BYTE *data;
+	hr = pBuffer->Lock(&data, NULL, &len);
+	ExecuteFuncOnExit releaseSampleLock([&]() {
+		pBuffer->Unlock();
+	});
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	hr = ResizeFrameBuffer(len);
+	int bytesPerPixel = abs(m_Stride) / m_FrameSize.cx;
+	//Copy the bitmap buffer, with handling of negative stride. https://docs.microsoft.com/en-us/windows/win32/medfound/image-stride
+	hr = MFCopyImage(
+		m_PtrFrameBuffer,       // Destination buffer.
+		abs(m_Stride),                    // Destination stride. We use the absolute value to flip bitmaps with negative stride. 
+		m_Stride > 0 ? data : data + (m_FrameSize.cy - 1) * abs(m_Stride), // First row in source image with positive stride, or the last row with negative stride.
+		m_Stride,						  // Source stride.
+		bytesPerPixel * m_FrameSize.cx,	      // Image width in bytes.
+		m_FrameSize.cy						  // Image height in pixels.
+	);
+
+	CComPtr<ID3D11Texture2D> pTexture;
+	hr = m_TextureManager->CreateTextureFromBuffer(m_PtrFrameBuffer, m_Stride, m_FrameSize.cx, m_FrameSize.cy, &pTexture, 0, D3D11_BIND_SHADER_RESOURCE);
+	if (SUCCEEDED(hr)) {
+		*pCopiedBytes = (UINT64)bytesPerPixel * m_FrameSize.cx * m_FrameSize.cy;
+		*ppFrame = pTexture;
+		(*ppFrame)->AddRef();
+	}
+	return hr;
+}
+
+HRESULT SourceReaderBase::CopyDXGIBufferToTexture(_In_ IMFMediaBuffer *pBuffer, _In_ bool isNewTexture, _Outptr_result_maybenull_ ID3D11Texture2D **ppFrame)
+{
+	*ppFrame = nullptr;
+	CComPtr<IMFDXGIBuffer> pDXGIBuffer;
+	if (!pBuffer || FAILED(pBuffer->QueryInterface(IID_PPV_ARGS(&pDXGIBuffer)))) {
+		return S_FALSE;
+	}
+	CComPtr<ID3D11Texture2D> pDecodedTexture;
+	UINT subresourceIndex;
+	RETURN_ON_BAD_HR(pDXGIBuffer->GetResource(IID_PPV_ARGS(&pDecodedTexture)));
+	RETURN_ON_BAD_HR(pDXGIBuffer->GetSubresourceIndex(&subresourceIndex));
+	CComPtr<ID3D11Device> pDecoderDevice;
+	pDecodedTexture->GetDevice(&pDecoderDevice);
+	D3D11_TEXTURE2D_DESC decodedDesc;
+	pDecodedTexture->GetDesc(&decodedDesc);
+	//The color conversion is done on the GPU by the video processor, so anything but its Bgra output on our own device takes the system memory path.
+	if (pDecoderDevice != m_Device
+		|| decodedDesc.Format != DXGI_FORMAT_B8G8R8A8_UNORM
+		|| decodedDesc.SampleDesc.Count != 1
+		|| decodedDesc.Width < (UINT)m_FrameSize.cx
+		|| decodedDesc.Height < (UINT)m_FrameSize.cy) {
+		return S_FALSE;
+	}
+	if (m_GpuFrameTexture) {
+		D3D11_TEXTURE2D_DESC frameDesc;
+		m_GpuFrameTexture->GetDesc(&frameDesc);
+		if (frameDesc.Width != (UINT)m_FrameSize.cx || frameDesc.Height != (UINT)m_FrameSize.cy) {
+			m_GpuFrameTexture.Release();
+		}
+	}
+	CComPtr<ID3D11Texture2D> pFrameTexture = isNewTexture ? nullptr : m_GpuFrameTexture;
+	if (!pFrameTexture) {
+		D3D11_TEXTURE2D_DESC frameDesc = { 0 };
+		frameDesc.Width = m_FrameSize.cx;
+		frameDesc.Height = m_FrameSize.cy;
+		frameDesc.MipLevels = 1;
+		frameDesc.ArraySize = 1;
+		frameDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+		frameDesc.SampleDesc.Count = 1;
+		frameDesc.Usage = D3D11_USAGE_DEFAULT;
+		frameDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		RETURN_ON_BAD_HR(m_Device->CreateTexture2D(&frameDesc, nullptr, &pFrameTexture));
+		if (!isNewTexture) {
+			m_GpuFrameTexture = pFrameTexture;
+		}
+	}
+	//The decoded texture goes back to the pool of the video processor when the next sample arrives, so the frame is copied to a texture of our own.
+	D3D11_BOX box{ 0, 0, 0, (UINT)m_FrameSize.cx, (UINT)m_FrameSize.cy, 1 };
+	m_DeviceContext->CopySubresourceRegion(pFrameTexture, 0, 0, 0, 0, pDecodedTexture, subresourceIndex, &box);
+	*ppFrame = pFrameTexture;
+	(*ppFrame)->AddRef();
+	return S_OK;
+}
+
+void SourceReaderBase::UpdateStats(_In_ bool isGpuFrame, _In_ UINT64 copiedBytes)
+{
+	if (m_Stats.GpuFrames + m_Stats.CopiedFrames == 0 || m_Stats.IsGpuPathActive != isGpuFrame) {
+		LOG_INFO(L"Source %ls: frames are copied %ls", m_SourceName.c_str(), isGpuFrame ? L"on the GPU" : L"through system memory");
+	}
+	m_Stats.IsGpuPathActive = isGpuFrame;
+	m_Stats.LastFrameCopiedBytes = copiedBytes;
+	if (isGpuFrame) {
+		m_Stats.GpuFrames++;
+	}
+	else {
+		m_Stats.CopiedFrames++;
+		m_Stats.CopiedBytes += copiedBytes;
+	}
+}
+
+SOURCE_READER_STATS SourceReaderBase::GetStats()
+{
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"GetStats");
+	return m_Stats;
+}
+
+bool SourceReaderBase::BeginNextLoop()
+{
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"BeginNextLoop");
+	if (m_LoopCount == 0 && m_FirstSampleTimestamp.has_value()) {
+		LONGLONG frameDuration = m_FrameRate > 0 ? (LONGLONG)(10000000 / m_FrameRate) : 0;
+		m_LoopDuration = m_LastSampleTimestamp - m_FirstSampleTimestamp.value() + frameDuration;
+		//The cache is still filling at the end of the first pass only if every frame fit in it.
+		m_IsLoopCacheComplete = m_IsLoopCacheFilling && m_LoopMode == VideoLoopModeInternal::Cached && m_LoopDuration > 0;
+		m_IsLoopCacheFilling = false;
+		if (!m_LoopCache.empty()) {
+			LOG_INFO(L"Source %ls: %zu frames cached for looping%ls", m_SourceName.c_str(), m_LoopCache.size(), m_IsLoopCacheComplete ? L", which is the whole video" : L"");
+		}
+	}
+	OnLoopStarted();
+	if (m_LoopMode != VideoLoopModeInternal::Seek && !m_LoopCache.empty()) {
+		//The end of the stream arrives one frame interval after the last frame, so the first cached frame is due now.
+		m_LoopCacheStartTime = GetPerformanceCounterTime();
+		m_LoopCacheStartLoop = m_LoopCount;
+		m_LoopCacheServedFrame = -1;
+	}
+	return !m_IsLoopCacheComplete;
+}
+
+void SourceReaderBase::OnLoopStarted()
+{
+	m_LoopCount++;
+	m_Stats.Loops = m_LoopCount;
+	m_IsWaitingForFirstLoopFrame = true;
+}
+
+void SourceReaderBase::AddToLoopCache(_In_ LONGLONG timeStamp)
+{
+	if (!m_IsLoopCacheFilling) {
+		return;
+	}
+	if (m_LoopMode == VideoLoopModeInternal::Gapless
+		&& !m_LoopCache.empty()
+		&& timeStamp - m_LoopCache.front().Timestamp >= LOOP_PREROLL_DURATION) {
+		m_IsLoopCacheFilling = false;
+		return;
+	}
+	UINT64 frameBytes = (UINT64)m_FrameSize.cx * m_FrameSize.cy * 4;
+	if ((m_LoopCache.size() + 1) * frameBytes > MAX_LOOP_CACHE_BYTES) {
+		LOG_INFO(L"Source %ls: loop cache is full after %zu frames, the rest of the video is decoded on every loop", m_SourceName.c_str(), m_LoopCache.size());
+		m_IsLoopCacheFilling = false;
+		return;
+	}
+	CComPtr<ID3D11Texture2D> pTexture;
+	bool isGpuFrame;
+	UINT64 copiedBytes;
+	HRESULT hr = CreateFrameTexture(m_Sample, true, &pTexture, &isGpuFrame, &copiedBytes);
+	if (FAILED(hr)) {
+		LOG_ERROR(L"Failed to cache frame for looping: hr = 0x%08x", hr);
+		m_IsLoopCacheFilling = false;
+		return;
+	}
+	m_LoopCache.push_back(LOOP_CACHE_FRAME{ pTexture, timeStamp });
+}
+
+void SourceReaderBase::OnFrameAvailable(_In_ LONGLONG timeStamp)
+{
+	if (m_LoopCount == 0) {
+		if (!m_FirstSampleTimestamp.has_value()) {
+			m_FirstSampleTimestamp = timeStamp;
+		}
+		m_LastSampleTimestamp = timeStamp;
+	}
+	INT64 now = GetPerformanceCounterTime();
+	if (m_IsWaitingForFirstLoopFrame) {
+		m_IsWaitingForFirstLoopFrame = false;
+		if (m_LastFrameTime > 0) {
+			double gapMillis = (now - m_LastFrameTime) / 10000.0;
+			m_Stats.LastLoopGapMillis = gapMillis;
+			m_Stats.MaxLoopGapMillis = max(m_Stats.MaxLoopGapMillis, gapMillis);
+			LOG_DEBUG(L"Source %ls: loop %u started %.1f ms after the last frame of the previous pass", m_SourceName.c_str(), m_LoopCount, gapMillis);
+		}
+	}
+	m_LastFrameTime = now;
+	m_Stats.LastFrameTimestamp = timeStamp - m_FirstSampleTimestamp.value_or(timeStamp) + m_LoopCount * m_LoopDuration;
+}
+
+bool SourceReaderBase::IsInLoopCache(_In_ LONGLONG timeStamp)
+{
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"IsInLoopCache");
+	return m_LoopCacheStartTime != 0 && !m_LoopCache.empty() && timeStamp <= m_LoopCache.back().Timestamp;
+}
+
+void SourceReaderBase::WaitForLoopCacheTimeline(_In_ LONGLONG timeStamp)
+{
+	INT64 dueTime;
+	{
+		EnterCriticalSection(&m_CriticalSection);
+		LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"WaitForLoopCacheTimeline");
+		if (m_LoopCacheStartTime == 0 || m_LoopCache.empty()) {
+			return;
+		}
+		dueTime = m_LoopCacheStartTime + (timeStamp - m_LoopCache.front().Timestamp);
+	}
+	INT64 waitTime = dueTime - GetPerformanceCounterTime();
+	if (waitTime > 0) {
+		WaitForSingleObject(m_StopCaptureEvent, (DWORD)(waitTime / 10000));
+	}
+}
+
+DWORD SourceReaderBase::GetMillisUntilNextLoopCacheFrame()
+{
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"GetMillisUntilNextLoopCacheFrame");
+	if (m_LoopCacheStartTime == 0 || m_LoopCache.empty()) {
+		return INFINITE;
+	}
+	INT64 nextFrame = m_LoopCacheServedFrame + 1;
+	INT64 pass = nextFrame / (INT64)m_LoopCache.size();
+	if (pass > 0 && !m_IsLoopCacheComplete) {
+		//The rest of the pass comes from the source reader.
+		return INFINITE;
+	}
+	const LOOP_CACHE_FRAME &frame = m_LoopCache[(size_t)(nextFrame % (INT64)m_LoopCache.size())];
+	INT64 dueTime = m_LoopCacheStartTime + pass * m_LoopDuration + (frame.Timestamp - m_LoopCache.front().Timestamp);
+	INT64 waitTime = dueTime - GetPerformanceCounterTime();
+	return waitTime > 0 ? (DWORD)((waitTime + 9999) / 10000) : 0;
+}
+
+HRESULT SourceReaderBase::AcquireLoopCacheFrame(_Outptr_opt_ ID3D11Texture2D **ppFrame)
+{
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"AcquireLoopCacheFrame");
+	if (m_LoopCacheStartTime == 0 || m_LoopCache.empty()) {
+		return S_FALSE;
+	}
+	INT64 elapsed = GetPerformanceCounterTime() - m_LoopCacheStartTime;
+	if (elapsed < 0) {
+		return S_FALSE;
+	}
+	INT64 pass = 0;
+	if (m_IsLoopCacheComplete) {
+		pass = elapsed / m_LoopDuration;
+		elapsed %= m_LoopDuration;
+	}
+	//The due frame is the last one that starts before the elapsed time.
+	LONGLONG dueTimestamp = m_LoopCache.front().Timestamp + elapsed;
+	auto next = std::upper_bound(m_LoopCache.begin(), m_LoopCache.end(), dueTimestamp, [](LONGLONG timestamp, const LOOP_CACHE_FRAME &frame) {
+		return timestamp < frame.Timestamp;
+	});
+	INT64 frameIndex = (next - m_LoopCache.begin()) - 1;
+	INT64 servedFrame = pass * (INT64)m_LoopCache.size() + frameIndex;
+	if (servedFrame <= m_LoopCacheServedFrame) {
+		return S_FALSE;
+	}
+	m_LoopCacheServedFrame = servedFrame;
+	while (m_LoopCacheStartLoop + pass > m_LoopCount) {
+		OnLoopStarted();
+	}
+	const LOOP_CACHE_FRAME &frame = m_LoopCache[(size_t)frameIndex];
+	OnFrameAvailable(frame.Timestamp);
+	m_Stats.CachedFrames++;
+	if (ppFrame) {
+		*ppFrame = frame.Texture;
+		(*ppFrame)->AddRef();
+	}
+	QueryPerformanceCounter(&m_LastGrabTimeStamp);
+	return S_OK;
+}
+
+void SourceReaderBase::ResetLoopCache()
+{
+	m_LoopCache.clear();
+	m_IsLoopCacheFilling = false;
+	m_IsLoopCacheComplete = false;
+	m_LoopCacheStartTime = 0;
+	m_LoopCacheStartLoop = 0;
+	m_LoopCacheServedFrame = -1;
+	m_LoopCount = 0;
+	m_LoopDuration = 0;
+	m_FirstSampleTimestamp.reset();
+	m_LastSampleTimestamp = 0;
+	m_LastFrameTime = 0;
+	m_IsWaitingForFirstLoopFrame = false;
+}
+
+HRESULT SourceReaderBase::ConvertYuvFrame(_In_ IMFMediaBuffer *pBuffer)
+{
+	if (!pBuffer) {
+		return E_POINTER;
+	}
+	YuvFormat format = m_YuvFormat.value();
+	BYTE *data = nullptr;
+	LONG pitch = 0;
+	//2D buffers know their real pitch, which may include padding that the default stride of the media type doesn't.
+	CComPtr<IMF2DBuffer> p2DBuffer;
+	if (SUCCEEDED(pBuffer->QueryInterface(IID_PPV_ARGS(&p2DBuffer))) && FAILED(p2DBuffer->Lock2D(&data, &pitch))) {
+		p2DBuffer.Release();
+	}
+	if (!p2DBuffer) {
+		DWORD length;
+		RETURN_ON_BAD_HR(pBuffer->Lock(&data, NULL, &length));
+		pitch = abs(m_Stride);
+		if (length < GetYuvBufferSize(format, m_FrameSize.cy, pitch)) {
+			pBuffer->Unlock();
+			LOG_ERROR(L"Sample of %u bytes is too small for a %dx%d frame with a stride of %d", length, m_FrameSize.cx, m_FrameSize.cy, pitch);
+			return MF_E_BUFFERTOOSMALL;
+		}
+	}
+	ExecuteFuncOnExit releaseBufferLock([&]() {
+		if (p2DBuffer) {
+			p2DBuffer->Unlock2D();
+		}
+		else {
+			pBuffer->Unlock();
+		}
+	});
+	if (pitch <= 0) {
+		LOG_ERROR(L"Bottom-up YUV frames are not supported");
+		return MF_E_INVALIDMEDIATYPE;
+	}
+	RETURN_ON_BAD_HR(ResizeFrameBuffer(m_FrameSize.cx * 4 * m_FrameSize.cy));
+	YUV_IMAGE image = MakeYuvImage(format, m_FrameSize.cx, m_FrameSize.cy, data, pitch);
+	if (!ConvertYuvToBgra(image, m_YuvColorMatrix, m_YuvColorRange, m_PtrFrameBuffer, m_FrameSize.cx * 4)) {
+		LOG_ERROR(L"Failed to convert a %dx%d YUV frame with a pitch of %d", m_FrameSize.cx, m_FrameSize.cy, pitch);
+		return E_FAIL;
+	}
+	return S_OK;
+}
+
 HRESULT SourceReaderBase::ResizeFrameBuffer(UINT bufferSize) {
 	// Old buffer too small
 	if (bufferSize > m_BufferSize)
@@ -191,6 +592,7 @@ HRESULT SourceReaderBase::Initialize(_In_ ID3D11DeviceContext *pDeviceContext, _
 {
 	m_Device = pDevice;
 	m_DeviceContext = pDeviceContext;
+	m_GpuFrameTexture.Release();
 
 	m_Device->AddRef();
 	m_DeviceContext->AddRef();
@@ -352,22 +754,91 @@ HRESULT SourceReaderBase::CreateIMFTransform(_In_ DWORD streamIndex, _In_ IMFMed
 	return hr;
 }
 
+HRESULT SourceReaderBase::CreateYuvDecoderTransform(_In_ DWORD streamIndex, _In_ IMFMediaType *pInputMediaType, _Outptr_ IMFTransform **ppDecoder, _Outptr_ IMFMediaType **ppOutputMediaType)
+{
+	*ppDecoder = nullptr;
+	*ppOutputMediaType = nullptr;
+	HRESULT hr;
+	GUID inputSubtype;
+	RETURN_ON_BAD_HR(hr = pInputMediaType->GetGUID(MF_MT_SUBTYPE, &inputSubtype));
+	//Only synchronous decoders, as OnReadSample runs the transform synchronously.
+	CComPtr<IMFActivate> pDecoderActivate = nullptr;
+	RETURN_ON_BAD_HR(hr = FindVideoDecoder(&inputSubtype, nullptr, false, false, false, &pDecoderActivate));
+	CComPtr<IMFTransform> pDecoder = nullptr;
+	RETURN_ON_BAD_HR(hr = pDecoderActivate->ActivateObject(IID_PPV_ARGS(&pDecoder)));
+	RETURN_ON_BAD_HR(hr = pDecoder->SetInputType(streamIndex, pInputMediaType, 0));
+
+	CComPtr<IMFMediaType> pOutputMediaType = nullptr;
+	for (DWORD i = 0; ; i++)
+	{
+		CComPtr<IMFMediaType> pMediaType = nullptr;
+		hr = pDecoder->GetOutputAvailableType(streamIndex, i, &pMediaType);
+		if (FAILED(hr)) {
+			break;
+		}
+		GUID outputSubtype;
+		if (SUCCEEDED(pMediaType->GetGUID(MF_MT_SUBTYPE, &outputSubtype))
+			&& GetYuvFormat(outputSubtype)
+			&& SUCCEEDED(pDecoder->SetOutputType(streamIndex, pMediaType, 0))) {
+			pOutputMediaType = pMediaType;
+			break;
+		}
+	}
+	if (!pOutputMediaType) {
+		LOG_INFO(L"No decoder with NV12 or YUY2 output found");
+		return MF_E_INVALIDMEDIATYPE;
+	}
+	*ppDecoder = pDecoder;
+	(*ppDecoder)->AddRef();
+	*ppOutputMediaType = pOutputMediaType;
+	(*ppOutputMediaType)->AddRef();
+	return S_OK;
+}
+
+bool SourceReaderBase::GetYuvFormat(_In_ const GUID &subtype, _Out_opt_ YuvFormat *pFormat)
+{
+	YuvFormat format;
+	if (subtype == MFVideoFormat_NV12) {
+		format = YuvFormat::NV12;
+	}
+	else if (subtype == MFVideoFormat_YUY2) {
+		format = YuvFormat::YUY2;
+	}
+	else {
+		return false;
+	}
+	if (pFormat) {
+		*pFormat = format;
+	}
+	return true;
+}
+
 //Method from IMFSourceReaderCallback
 HRESULT SourceReaderBase::OnReadSample(HRESULT status, DWORD streamIndex, DWORD streamFlags, LONGLONG timeStamp, IMFSample *sample)
 {
 	HRESULT hr = status;
 	if (SUCCEEDED(hr) && WaitForSingleObject(m_StopCaptureEvent, 0) != WAIT_OBJECT_0) {
 		if (streamFlags & MF_SOURCE_READERF_ENDOFSTREAM) {
+			if (!BeginNextLoop()) {
+				//Every frame is in the loop cache, so the video plays from the cache and no more samples are needed.
+				return S_OK;
+			}
 			PROPVARIANT var;
 			HRESULT hr = InitPropVariantFromInt64(0, &var);
 			hr = m_SourceReader->SetCurrentPosition(GUID_NULL, var);
 			PropVariantClear(&var);
 		}
+		if (sample && IsInLoopCache(timeStamp)) {
+			//The frame is shown from the loop cache, so read on until the source reader has caught up with it.
+			sample = nullptr;
+		}
 		if (sample)
 		{
+			WaitForLoopCacheTimeline(timeStamp);
 			EnterCriticalSection(&m_CriticalSection);
 			{
 				LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"OnReadSample");
+				bool isNewFrame = false;
 				if (m_MediaTransform) {
 					//Run media transform to convert sample to MFVideoFormat_ARGB32
 					MFT_OUTPUT_STREAM_INFO info{};
@@ -380,22 +851,27 @@ HRESULT SourceReaderBase::OnReadSample(HRESULT status, DWORD streamIndex, DWORD
 					RtlZeroMemory(&outputDataBuffer, sizeof(outputDataBuffer));
 					outputDataBuffer.dwStreamID = 0;
 					if (!transformProvidesSamples) {
-						IMFMediaBuffer *transformBuffer = nullptr;
-						//create a buffer for the output sample
-						hr = MFCreateMemoryBuffer(info.cbSize, &transformBuffer);
-						if (FAILED(hr))
-						{
-							LOG_ERROR(L"MFCreateMemoryBuffer failed: hr = 0x%08x", hr);
+						//The output sample is created once and reused, as the previous frame is released below before the new one is stored.
+						if (!m_TransformSample) {
+							CComPtr<IMFMediaBuffer> transformBuffer = nullptr;
+							//create a buffer for the output sample
+							hr = MFCreateMemoryBuffer(info.cbSize, &transformBuffer);
+							if (FAILED(hr))
+							{
+								LOG_ERROR(L"MFCreateMemoryBuffer failed: hr = 0x%08x", hr);
+							}
+							CComPtr<IMFSample> transformSample = nullptr;
+							if (SUCCEEDED(hr)) {
+								hr = MFCreateSample(&transformSample);
+								if (FAILED(hr)) {
+									LOG_ERROR(L"MFCreateSample failed: hr = 0x%08x", hr);
+								}
+							}
+							if (SUCCEEDED(hr) && SUCCEEDED(hr = transformSample->AddBuffer(transformBuffer))) {
+								m_TransformSample = transformSample;
+							}
 						}
-						IMFSample *transformSample;
-						hr = MFCreateSample(&transformSample);
-						if (FAILED(hr)) {
-							LOG_ERROR(L"MFCreateSample failed: hr = 0x%08x", hr);
-						}
-						hr = transformSample->AddBuffer(transformBuffer);
-
-						outputDataBuffer.pSample = transformSample;
-						SafeRelease(&transformBuffer);
+						outputDataBuffer.pSample = m_TransformSample;
 					}
 					hr = m_MediaTransform->ProcessInput(0, sample, 0);
 					if (FAILED(hr)) {
@@ -403,30 +879,52 @@ HRESULT SourceReaderBase::OnReadSample(HRESULT status, DWORD streamIndex, DWORD
 					}
 					DWORD dwDSPStatus = 0;
 					hr = m_MediaTransform->ProcessOutput(0, 1, &outputDataBuffer, &dwDSPStatus);
-					if (FAILED(hr)) {
-						LOG_ERROR(L"ProcessOutput failed: hr = 0x%08x", hr);
+					SafeRelease(&outputDataBuffer.pEvents);
+					if (hr == MF_E_TRANSFORM_NEED_MORE_INPUT) {
+						//The transform has not produced a frame for this sample yet, so keep the previous frame and read the next sample.
+						hr = S_OK;
+					}
+					else {
+						if (FAILED(hr)) {
+							LOG_ERROR(L"ProcessOutput failed: hr = 0x%08x", hr);
+						}
+						if (outputDataBuffer.pSample) {
+							SafeRelease(&m_Sample);
+							//Store the converted media buffer
+							IMFMediaBuffer *mediaBuffer = NULL;
+							outputDataBuffer.pSample->GetBufferByIndex(0, &mediaBuffer);
+							if (transformProvidesSamples) {
+								outputDataBuffer.pSample->Release();
+							}
+							m_Sample = mediaBuffer;
+						}
+						isNewFrame = true;
 					}
-					SafeRelease(&m_Sample);
-					//Store the converted media buffer
-					IMFMediaBuffer *mediaBuffer = NULL;
-					outputDataBuffer.pSample->GetBufferByIndex(0, &mediaBuffer);
-					outputDataBuffer.pSample->Release();
-					m_Sample = mediaBuffer;
 				}
 				else {
+					//The sample belongs to the source reader, so only the buffer is kept.
+					SafeRelease(&m_Sample);
 					IMFMediaBuffer *mediaBuffer = NULL;
 					sample->GetBufferByIndex(0, &mediaBuffer);
-					sample->Release();
 					m_Sample = mediaBuffer;
+					isNewFrame = true;
+				}
+				if (isNewFrame) {
+					//The source reader has caught up with the loop cache, so the cache stops playing.
+					m_LoopCacheStartTime = 0;
+					AddToLoopCache(timeStamp);
+					OnFrameAvailable(timeStamp);
+					//Update timestamp and notify that there is a new sample available
+					QueryPerformanceCounter(&m_LastSampleReceivedTimeStamp);
+					SetEvent(m_NewFrameEvent);
 				}
-				//Update timestamp and notify that there is a new sample available
-				QueryPerformanceCounter(&m_LastSampleReceivedTimeStamp);
-				SetEvent(m_NewFrameEvent);
 			}
 			if (SUCCEEDED(hr)) {
 				if (!m_FramerateTimer) {
 					m_FramerateTimer = new HighresTimer();
-					m_FramerateTimer->StartRecurringTimer((INT64)floor(1000 / m_FrameRate));
+					if (m_FrameRate > 0) {
+						m_FramerateTimer->StartRecurringTimer(MillisToHundredNanos(1000 / m_FrameRate));
+					}
 				}
 				if (m_FrameRate > 0) {
 					auto t1 = std::chrono::high_resolution_clock::now();
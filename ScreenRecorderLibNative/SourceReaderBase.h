@@ -13,6 +13,36 @@
 #include "CaptureBase.h"
 #include "TextureManager.h"
 #include "MF.util.h"
+#include "YuvConverter.h"
+
+struct SOURCE_READER_STATS {
+	/// <summary>Frames copied from the decoded texture on the GPU, without going through system memory.</summary>
+	UINT64 GpuFrames = 0;
+	/// <summary>Frames copied through system memory and uploaded to a new texture.</summary>
+	UINT64 CopiedFrames = 0;
+	/// <summary>The bytes copied through system memory for all copied frames.</summary>
+	UINT64 CopiedBytes = 0;
+	/// <summary>The bytes copied through system memory for the last frame. 0 if it was copied on the GPU.</summary>
+	UINT64 LastFrameCopiedBytes = 0;
+	/// <summary>True if the last frame was copied on the GPU.</summary>
+	bool IsGpuPathActive = false;
+	/// <summary>Frames shown from the loop cache instead of the source reader.</summary>
+	UINT64 CachedFrames = 0;
+	/// <summary>The number of times the video restarted from the beginning.</summary>
+	UINT32 Loops = 0;
+	/// <summary>The time in 100 nanosecond units of the last frame since the start of the first pass, so it keeps increasing across loops.</summary>
+	INT64 LastFrameTimestamp = 0;
+	/// <summary>The wall clock time between the last frame of a pass and the first frame of the next, for the last loop.</summary>
+	double LastLoopGapMillis = 0;
+	/// <summary>The longest time between the last frame of a pass and the first frame of the next.</summary>
+	double MaxLoopGapMillis = 0;
+};
+
+struct LOOP_CACHE_FRAME {
+	CComPtr<ID3D11Texture2D> Texture;
+	/// <summary>The sample time of the frame in 100 nanosecond units.</summary>
+	LONGLONG Timestamp;
+};
 
 class SourceReaderBase abstract : public CaptureBase, public IMFSourceReaderCallback  //this class inherits from IMFSourceReaderCallback
 {
@@ -28,6 +58,10 @@ public:
 	inline virtual HRESULT GetMouse(_Inout_ PTR_INFO *pPtrInfo, _In_ RECT frameCoordinates, _In_ int offsetX, _In_ int offsetY) override {
 		return S_FALSE;
 	}
+	/// <summary>
+	/// Returns which path the frames took since the capture was started. The stats are logged and reset on Close.
+	/// </summary>
+	SOURCE_READER_STATS GetStats();
 
 	//  the class must implement the methods from IMFSourceReaderCallback 
 	STDMETHODIMP OnReadSample(HRESULT status, DWORD streamIndex, DWORD streamFlags, LONGLONG timeStamp, IMFSample *sample);
@@ -60,6 +94,14 @@ protected:
 
 	virtual HRESULT CreateOutputMediaType(_In_ SIZE frameSize, _Outptr_ IMFMediaType **pType, _Out_ LONG *stride);
 	virtual HRESULT CreateIMFTransform(_In_ DWORD streamIndex, _In_ IMFMediaType *pInputMediaType, _Outptr_ IMFTransform **pColorConverter, _Outptr_ IMFMediaType **ppOutputMediaType);
+	/// <summary>
+	/// Creates a decoder for compressed input, such as MJPEG, that outputs NV12 or YUY2, so the frames can be converted by ConvertYuvToBgra instead of a color converter.
+	/// </summary>
+	virtual HRESULT CreateYuvDecoderTransform(_In_ DWORD streamIndex, _In_ IMFMediaType *pInputMediaType, _Outptr_ IMFTransform **ppDecoder, _Outptr_ IMFMediaType **ppOutputMediaType);
+	/// <summary>
+	/// Returns true if samples of the subtype can be converted by ConvertYuvToBgra.
+	/// </summary>
+	static bool GetYuvFormat(_In_ const GUID &subtype, _Out_opt_ YuvFormat *pFormat = nullptr);
 	virtual HRESULT SourceReaderBase::ResizeFrameBuffer(UINT bufferSize);
 	CRITICAL_SECTION m_CriticalSection;
 	inline IMFDXGIDeviceManager *GetDeviceManager() { return m_DeviceManager; }
@@ -74,6 +116,8 @@ private:
 	IMFMediaType *m_InputMediaType;
 	IMFSourceReader *m_SourceReader;
 	IMFTransform *m_MediaTransform;
+	//The sample the media transform writes to, if it doesn't provide its own. It is reused for every frame.
+	CComPtr<IMFSample> m_TransformSample;
 	CComPtr<IMFDXGIDeviceManager> m_DeviceManager;
 	UINT m_ResetToken;
 	UINT m_BufferSize;
@@ -81,4 +125,77 @@ private:
 	LONG m_Stride;
 	SIZE m_FrameSize;
 	double m_FrameRate;
+	//The texture decoded frames are copied to on the GPU. It is reused for every frame.
+	CComPtr<ID3D11Texture2D> m_GpuFrameTexture;
+	SOURCE_READER_STATS m_Stats;
+	std::wstring m_SourceName;
+	//Set if the output samples are NV12 or YUY2, which are converted to Bgra in AcquireNextFrame.
+	std::optional<YuvFormat> m_YuvFormat;
+	YuvColorMatrix m_YuvColorMatrix;
+	YuvColorRange m_YuvColorRange;
+
+	VideoLoopModeInternal m_LoopMode;
+	//Decoded frames from the start of the video, shown while the source reader seeks back to the start and decodes the first frames again.
+	std::vector<LOOP_CACHE_FRAME> m_LoopCache;
+	//True while frames are added to the loop cache, which is only during the first pass.
+	bool m_IsLoopCacheFilling;
+	//True if every frame of the video is in the loop cache, so the source reader is not needed after the first pass.
+	bool m_IsLoopCacheComplete;
+	//The performance counter time in 100 nanosecond units when the first cached frame was due, or 0 if the loop cache is not playing.
+	INT64 m_LoopCacheStartTime;
+	//The loop count when the loop cache started playing. A complete cache counts the loops itself.
+	UINT32 m_LoopCacheStartLoop;
+	//The position of the last frame shown from the loop cache, counted in frames since it started playing.
+	INT64 m_LoopCacheServedFrame;
+	UINT32 m_LoopCount;
+	//The length of one pass through the video in 100 nanosecond units, measured at the end of the first pass.
+	LONGLONG m_LoopDuration;
+	std::optional<LONGLONG> m_FirstSampleTimestamp;
+	LONGLONG m_LastSampleTimestamp;
+	//The performance counter time in 100 nanosecond units when the last frame became available.
+	INT64 m_LastFrameTime;
+	bool m_IsWaitingForFirstLoopFrame;
+
+	HRESULT ConvertYuvFrame(_In_ IMFMediaBuffer *pBuffer);
+	/// <summary>
+	/// Creates a Bgra texture with the frame in the buffer, on the GPU if possible.
+	/// </summary>
+	/// <param name="isNewTexture">If false, a frame copied on the GPU reuses the same texture for every frame. If true, the caller gets a texture of its own.</param>
+	HRESULT CreateFrameTexture(_In_ IMFMediaBuffer *pBuffer, _In_ bool isNewTexture, _Outptr_ ID3D11Texture2D **ppFrame, _Out_ bool *pIsGpuFrame, _Out_ UINT64 *pCopiedBytes);
+	/// <summary>
+	/// Copies a frame that was decoded to a Bgra texture on our device, such as the output of a D3D11 aware video processor, on the GPU.
+	/// </summary>
+	/// <returns>S_FALSE if the buffer isn't such a texture, and the frame must be copied through system memory.</returns>
+	HRESULT CopyDXGIBufferToTexture(_In_ IMFMediaBuffer *pBuffer, _In_ bool isNewTexture, _Outptr_result_maybenull_ ID3D11Texture2D **ppFrame);
+	void UpdateStats(_In_ bool isGpuFrame, _In_ UINT64 copiedBytes);
+
+	/// <summary>
+	/// Updates the loop state when the source reader reaches the end of the video, and starts playing the loop cache.
+	/// </summary>
+	/// <returns>false if the whole video is cached, so the source reader is not needed anymore.</returns>
+	bool BeginNextLoop();
+	void OnLoopStarted();
+	/// <summary>
+	/// Stores the frame in m_Sample in the loop cache, while the first pass is decoded.
+	/// </summary>
+	void AddToLoopCache(_In_ LONGLONG timeStamp);
+	/// <summary>
+	/// Updates the loop state and stats for a new frame from the source reader or the loop cache.
+	/// </summary>
+	void OnFrameAvailable(_In_ LONGLONG timeStamp);
+	/// <summary>
+	/// Returns true if a frame with the timestamp is already shown from the loop cache, so the source reader can skip it.
+	/// </summary>
+	bool IsInLoopCache(_In_ LONGLONG timeStamp);
+	/// <summary>
+	/// Waits until a frame with the timestamp is due on the timeline of the playing loop cache, so the first frame after the cached ones is not shown early.
+	/// </summary>
+	void WaitForLoopCacheTimeline(_In_ LONGLONG timeStamp);
+	DWORD GetMillisUntilNextLoopCacheFrame();
+	/// <summary>
+	/// Returns the frame from the loop cache that is due now.
+	/// </summary>
+	/// <returns>S_FALSE if the loop cache is not playing, or the due frame was already returned.</returns>
+	HRESULT AcquireLoopCacheFrame(_Outptr_opt_ ID3D11Texture2D **ppFrame);
+	void ResetLoopCache();
 };
\ No newline at end of file
@@ -66,52 +66,39 @@ HRESULT TextureManager::Initialize(_In_ ID3D11DeviceContext *pDeviceContext, _In
 	return hr;
 }
 
-HRESULT TextureManager::ResizeTexture(_In_ ID3D11Texture2D *pOrgTexture, _In_  SIZE targetSize, _In_ TextureStretchMode stretch, _Outptr_ ID3D11Texture2D **ppResizedTexture, _Out_opt_ RECT *pContentRect)
+SIZE TextureManager::GetResizedSize(_In_ SIZE originalSize, _In_ SIZE targetSize, _In_ TextureStretchMode stretch)
 {
-	HRESULT hr;
-
-	// Create shader resource from texture of the original frame
-	D3D11_TEXTURE2D_DESC frameDesc = {};
-	pOrgTexture->GetDesc(&frameDesc);
-	UINT targetWidth = targetSize.cx;
-	UINT targetHeight = targetSize.cy;
-	UINT originalWidth = frameDesc.Width;
-	UINT originalHeight = frameDesc.Height;
-	// Calculate aspect ratios
-	double originalAspect = static_cast<double>(originalWidth) / originalHeight;
-	double targetAspect = static_cast<double>(targetWidth) / targetHeight;
-
-	double widthRatio = static_cast<double>(targetWidth) / originalWidth;
-	double heightRatio = static_cast<double>(targetHeight) / originalHeight;
-	UINT widthDiff = originalWidth - targetWidth;
-	UINT heightDiff = originalHeight - targetHeight;
-	LONG resizedWidth = 0;
-	LONG resizedHeight = 0;
+	double widthRatio = static_cast<double>(targetSize.cx) / originalSize.cx;
+	double heightRatio = static_cast<double>(targetSize.cy) / originalSize.cy;
 	switch (stretch)
 	{
 		case TextureStretchMode::Fill: {
-			resizedWidth = MakeEven((LONG)round(targetWidth));
-			resizedHeight = MakeEven((LONG)round(targetHeight));
-			break;
+			return SIZE{ MakeEven(targetSize.cx), MakeEven(targetSize.cy) };
 		}
 		case TextureStretchMode::UniformToFill: {
 			double resizeRatio = max(widthRatio, heightRatio);
-			resizedWidth = MakeEven((LONG)round(originalWidth * resizeRatio));
-			resizedHeight = MakeEven((LONG)round(originalHeight * resizeRatio));
-			break;
+			return SIZE{ MakeEven((LONG)round(originalSize.cx * resizeRatio)), MakeEven((LONG)round(originalSize.cy * resizeRatio)) };
 		}
 		case TextureStretchMode::Uniform: {
 			double resizeRatio = min(widthRatio, heightRatio);
-			resizedWidth = MakeEven((LONG)round(originalWidth * resizeRatio));
-			resizedHeight = MakeEven((LONG)round(originalHeight * resizeRatio));
-			break;
+			return SIZE{ MakeEven((LONG)round(originalSize.cx * resizeRatio)), MakeEven((LONG)round(originalSize.cy * resizeRatio)) };
 		}
 		case TextureStretchMode::None:
 		default:
-			resizedWidth = MakeEven((LONG)round(originalWidth));
-			resizedHeight = MakeEven((LONG)round(originalHeight));
-			break;
+			return SIZE{ MakeEven(originalSize.cx), MakeEven(originalSize.cy) };
 	}
+}
+
+HRESULT TextureManager::ResizeTexture(_In_ ID3D11Texture2D *pOrgTexture, _In_  SIZE targetSize, _In_ TextureStretchMode stretch, _Outptr_ ID3D11Texture2D **ppResizedTexture, _Out_opt_ RECT *pContentRect)
+{
+	HRESULT hr;
+
+	// Create shader resource from texture of the original frame
+	D3D11_TEXTURE2D_DESC frameDesc = {};
+	pOrgTexture->GetDesc(&frameDesc);
+	SIZE resizedSize = GetResizedSize(SIZE{ static_cast<LONG>(frameDesc.Width), static_cast<LONG>(frameDesc.Height) }, targetSize, stretch);
+	LONG resizedWidth = resizedSize.cx;
+	LONG resizedHeight = resizedSize.cy;
 	if (pContentRect) {
 		*pContentRect = RECT{ 0,0,resizedWidth,resizedHeight };
 	}
@@ -13,6 +13,10 @@ public:
 	~TextureManager();
 	HRESULT Initialize(_In_ ID3D11DeviceContext *pDeviceContext, _In_ ID3D11Device *Device);
 	HRESULT ResizeTexture(_In_ ID3D11Texture2D *pOrgTexture, _In_  SIZE targetSize, _In_ TextureStretchMode stretch, _Outptr_ ID3D11Texture2D **ppResizedTexture, _Out_opt_ RECT *pContentRect = nullptr);
+	/// <summary>
+	/// Returns the size ResizeTexture resizes a texture of originalSize to.
+	/// </summary>
+	static SIZE GetResizedSize(_In_ SIZE originalSize, _In_ SIZE targetSize, _In_ TextureStretchMode stretch);
 	HRESULT RotateTexture(_In_ ID3D11Texture2D *pOrgTexture, _In_ DXGI_MODE_ROTATION rotation, _Outptr_ ID3D11Texture2D **ppRotatedTexture);
 	HRESULT DrawTexture(_Inout_ ID3D11Texture2D *pCanvasTexture, _In_ ID3D11Texture2D *pTexture, _In_ RECT rect);
 	/// <summary>
@@ -0,0 +1,427 @@
+#include "TextureReadback.h"
+#include <algorithm>
+#include <atlbase.h>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+struct ReadbackWorkerPool::Impl {
+	Impl(UINT maxThreadCount) :
+		m_MaxThreadCount(max<UINT>(maxThreadCount, 1))
+	{
+	}
+
+	~Impl()
+	{
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			m_IsStopping = true;
+		}
+		m_WorkQueuedCondition.notify_all();
+		for (thread &worker : m_Threads) {
+			worker.join();
+		}
+	}
+
+	void Submit(function<void()> work)
+	{
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			m_WorkQueue.push_back(std::move(work));
+			if (m_IdleThreadCount < m_WorkQueue.size() && m_Threads.size() < m_MaxThreadCount) {
+				m_Threads.push_back(thread([this]() { WorkerLoop(); }));
+			}
+		}
+		m_WorkQueuedCondition.notify_one();
+	}
+
+private:
+	const UINT m_MaxThreadCount;
+	mutex m_Mutex;
+	condition_variable m_WorkQueuedCondition;
+	deque<function<void()>> m_WorkQueue;
+	vector<thread> m_Threads;
+	size_t m_IdleThreadCount = 0;
+	bool m_IsStopping = false;
+
+	void WorkerLoop()
+	{
+		unique_lock<mutex> lock(m_Mutex);
+		while (true) {
+			m_IdleThreadCount++;
+			m_WorkQueuedCondition.wait(lock, [this]() { return m_IsStopping || !m_WorkQueue.empty(); });
+			m_IdleThreadCount--;
+			if (m_WorkQueue.empty()) {
+				break;
+			}
+			function<void()> work = std::move(m_WorkQueue.front());
+			m_WorkQueue.pop_front();
+			lock.unlock();
+			work();
+			lock.lock();
+		}
+	}
+};
+
+ReadbackWorkerPool::ReadbackWorkerPool(_In_ UINT maxThreadCount) :
+	m_Impl(make_unique<Impl>(maxThreadCount))
+{
+}
+
+ReadbackWorkerPool::~ReadbackWorkerPool()
+{
+}
+
+void ReadbackWorkerPool::Submit(_In_ std::function<void()> work)
+{
+	m_Impl->Submit(std::move(work));
+}
+
+struct TextureReadback::Impl {
+	struct STAGING_TEXTURE {
+		CComPtr<ID3D11Texture2D> Texture;
+		D3D11_TEXTURE2D_DESC Desc{};
+		bool IsInUse = false;
+	};
+	struct PENDING_FRAME {
+		int FrameNumber;
+		INT64 Timestamp;
+		//Index of the staging texture the frame is copied to, or -1 if the frame has no bitmap.
+		int StagingIndex;
+	};
+	struct DELIVERY_FRAME {
+		int FrameNumber;
+		INT64 Timestamp;
+		bool HasBitmap;
+		int Stride;
+		int Width;
+		int Height;
+		vector<BYTE> Buffer;
+	};
+
+	Impl(shared_ptr<ReadbackWorkerPool> pWorkerPool) :
+		m_WorkerPool(pWorkerPool ? pWorkerPool : make_shared<ReadbackWorkerPool>(1))
+	{
+	}
+
+	~Impl()
+	{
+		unique_lock<mutex> lock(m_Mutex);
+		m_DeliveryQueue.clear();
+		//A delivery that is already submitted to the pool must finish before this is gone.
+		m_FrameDeliveredCondition.wait(lock, [this]() { return !m_IsDelivering; });
+	}
+
+	HRESULT Initialize(ID3D11DeviceContext *pDeviceContext, ID3D11Device *pDevice, TextureReadbackCallback callback, UINT ringSize, UINT maxQueuedFrames)
+	{
+		//Staging textures from a previous device can't be mapped on the new one, so frames still in the ring lose their bitmap.
+		for (PENDING_FRAME &pending : m_PendingFrames) {
+			pending.StagingIndex = -1;
+		}
+		m_StagingTextures.clear();
+		m_StagingTextures.resize(max<UINT>(ringSize, 1));
+		m_DeviceContext = pDeviceContext;
+		m_Device = pDevice;
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			m_Callback = callback;
+			m_MaxQueuedFrames = max<UINT>(maxQueuedFrames, 1);
+		}
+		return ReadPendingFrames(false);
+	}
+
+	void SetMaxFramesPerSecond(UINT32 fps)
+	{
+		if (fps != m_MaxFramesPerSecond) {
+			m_MaxFramesPerSecond = fps;
+			m_NextReadbackTime = steady_clock::time_point::min();
+		}
+	}
+
+	bool IsReadbackDue()
+	{
+		if (m_MaxFramesPerSecond == 0) {
+			return true;
+		}
+		auto now = steady_clock::now();
+		if (now < m_NextReadbackTime) {
+			lock_guard<mutex> lock(m_Mutex);
+			m_Stats.SkippedFrames++;
+			return false;
+		}
+		auto interval = duration_cast<steady_clock::duration>(duration<double>(1.0 / m_MaxFramesPerSecond));
+		//Keep the average rate when frames arrive slightly late, but don't let a long gap cause a burst of frames.
+		if (m_NextReadbackTime == steady_clock::time_point::min() || now - m_NextReadbackTime >= interval) {
+			m_NextReadbackTime = now + interval;
+		}
+		else {
+			m_NextReadbackTime += interval;
+		}
+		return true;
+	}
+
+	HRESULT Enqueue(int frameNumber, INT64 timestamp, ID3D11Texture2D *pTexture)
+	{
+		HRESULT hr = S_OK;
+		int stagingIndex = -1;
+		if (pTexture && m_Device) {
+			stagingIndex = GetFreeStagingIndex();
+			while (stagingIndex < 0 && !m_PendingFrames.empty()) {
+				//All staging textures are still in use, so wait for the oldest copy to finish.
+				{
+					lock_guard<mutex> lock(m_Mutex);
+					m_Stats.BlockingMaps++;
+				}
+				LOG_ON_BAD_HR(ReadNextPendingFrame(true));
+				stagingIndex = GetFreeStagingIndex();
+			}
+			if (stagingIndex >= 0) {
+				hr = CopyToStagingTexture(pTexture, m_StagingTextures[stagingIndex]);
+				if (SUCCEEDED(hr)) {
+					m_StagingTextures[stagingIndex].IsInUse = true;
+					lock_guard<mutex> lock(m_Mutex);
+					m_Stats.ReadbackFrames++;
+				}
+				else {
+					LOG_ERROR(L"Failed to copy frame to staging texture: hr = 0x%08x", hr);
+					stagingIndex = -1;
+				}
+			}
+		}
+		m_PendingFrames.push_back(PENDING_FRAME{ frameNumber, timestamp, stagingIndex });
+		LOG_ON_BAD_HR(ReadPendingFrames(false));
+		return hr;
+	}
+
+	HRESULT Flush()
+	{
+		HRESULT hr = ReadPendingFrames(true);
+		unique_lock<mutex> lock(m_Mutex);
+		m_FrameDeliveredCondition.wait(lock, [this]() { return m_DeliveryQueue.empty() && !m_IsDelivering; });
+		return hr;
+	}
+
+	TEXTURE_READBACK_STATS GetStats()
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		return m_Stats;
+	}
+
+private:
+	CComPtr<ID3D11DeviceContext> m_DeviceContext;
+	CComPtr<ID3D11Device> m_Device;
+	vector<STAGING_TEXTURE> m_StagingTextures;
+	//Frames not yet handed to the delivery thread, in the order they were enqueued.
+	deque<PENDING_FRAME> m_PendingFrames;
+	UINT32 m_MaxFramesPerSecond = 0;
+	steady_clock::time_point m_NextReadbackTime = steady_clock::time_point::min();
+
+	shared_ptr<ReadbackWorkerPool> m_WorkerPool;
+
+	//Guards everything below, which is shared with the worker pool.
+	mutex m_Mutex;
+	condition_variable m_FrameDeliveredCondition;
+	TextureReadbackCallback m_Callback;
+	UINT m_MaxQueuedFrames = DEFAULT_MAX_QUEUED_FRAMES;
+	deque<DELIVERY_FRAME> m_DeliveryQueue;
+	vector<vector<BYTE>> m_FreeBuffers;
+	TEXTURE_READBACK_STATS m_Stats{};
+	//True while a delivery is submitted to the worker pool. Only one is submitted at a time, to deliver the frames in order.
+	bool m_IsDelivering = false;
+
+	int GetFreeStagingIndex()
+	{
+		for (size_t i = 0; i < m_StagingTextures.size(); i++) {
+			if (!m_StagingTextures[i].IsInUse) {
+				return static_cast<int>(i);
+			}
+		}
+		return -1;
+	}
+
+	HRESULT CopyToStagingTexture(ID3D11Texture2D *pTexture, STAGING_TEXTURE &staging)
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		pTexture->GetDesc(&desc);
+		if (!staging.Texture
+			|| staging.Desc.Width != desc.Width
+			|| staging.Desc.Height != desc.Height
+			|| staging.Desc.Format != desc.Format) {
+			staging.Texture.Release();
+			desc.Usage = D3D11_USAGE_STAGING;
+			desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+			desc.MiscFlags = 0;
+			desc.BindFlags = 0;
+			RETURN_ON_BAD_HR(m_Device->CreateTexture2D(&desc, nullptr, &staging.Texture));
+			staging.Desc = desc;
+		}
+		m_DeviceContext->CopyResource(staging.Texture, pTexture);
+		//Submit the copy now, so it is likely finished by the time the frame is mapped.
+		m_DeviceContext->Flush();
+		return S_OK;
+	}
+
+	HRESULT ReadPendingFrames(bool wait)
+	{
+		HRESULT hr = S_OK;
+		while (!m_PendingFrames.empty()) {
+			hr = ReadNextPendingFrame(wait);
+			if (hr == DXGI_ERROR_WAS_STILL_DRAWING) {
+				return S_FALSE;
+			}
+		}
+		return hr;
+	}
+
+	/// <summary>
+	/// Maps the oldest pending frame and hands it to the delivery thread.
+	/// </summary>
+	/// <returns>DXGI_ERROR_WAS_STILL_DRAWING if wait is false and the GPU has not finished copying the frame.</returns>
+	HRESULT ReadNextPendingFrame(bool wait)
+	{
+		PENDING_FRAME pending = m_PendingFrames.front();
+		DELIVERY_FRAME frame{ pending.FrameNumber, pending.Timestamp, false, 0, 0, 0 };
+		HRESULT hr = S_OK;
+		if (pending.StagingIndex >= 0) {
+			STAGING_TEXTURE &staging = m_StagingTextures[pending.StagingIndex];
+			D3D11_MAPPED_SUBRESOURCE map;
+			hr = m_DeviceContext->Map(staging.Texture, 0, D3D11_MAP_READ, wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, &map);
+			if (hr == DXGI_ERROR_WAS_STILL_DRAWING && !wait) {
+				return hr;
+			}
+			if (SUCCEEDED(hr)) {
+				frame.Buffer = GetBuffer();
+				frame.Buffer.resize(map.DepthPitch);
+				memcpy(frame.Buffer.data(), map.pData, map.DepthPitch);
+				m_DeviceContext->Unmap(staging.Texture, 0);
+				frame.HasBitmap = true;
+				frame.Stride = map.RowPitch;
+				frame.Width = staging.Desc.Width;
+				frame.Height = staging.Desc.Height;
+			}
+			else {
+				LOG_ERROR(L"Failed to map staging texture: hr = 0x%08x", hr);
+			}
+			staging.IsInUse = false;
+		}
+		m_PendingFrames.pop_front();
+		QueueForDelivery(std::move(frame));
+		return hr;
+	}
+
+	vector<BYTE> GetBuffer()
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		if (m_FreeBuffers.empty()) {
+			return vector<BYTE>();
+		}
+		vector<BYTE> buffer = std::move(m_FreeBuffers.back());
+		m_FreeBuffers.pop_back();
+		return buffer;
+	}
+
+	void QueueForDelivery(DELIVERY_FRAME &&frame)
+	{
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			if (frame.HasBitmap) {
+				size_t queuedBitmaps = count_if(m_DeliveryQueue.begin(), m_DeliveryQueue.end(), [](const DELIVERY_FRAME &queued) { return queued.HasBitmap; });
+				if (queuedBitmaps >= m_MaxQueuedFrames) {
+					//The consumer is too slow. Drop the bitmap of the oldest waiting frame, but still deliver its frame number.
+					auto oldest = find_if(m_DeliveryQueue.begin(), m_DeliveryQueue.end(), [](const DELIVERY_FRAME &queued) { return queued.HasBitmap; });
+					oldest->HasBitmap = false;
+					m_FreeBuffers.push_back(std::move(oldest->Buffer));
+					m_Stats.DroppedFrames++;
+				}
+			}
+			m_DeliveryQueue.push_back(std::move(frame));
+			if (m_IsDelivering) {
+				return;
+			}
+			m_IsDelivering = true;
+		}
+		m_WorkerPool->Submit([this]() { DeliverNextFrame(); });
+	}
+
+	/// <summary>
+	/// Runs on the worker pool. Delivers one frame and resubmits itself if there are more, so readbacks sharing the pool take turns.
+	/// </summary>
+	void DeliverNextFrame()
+	{
+		unique_lock<mutex> lock(m_Mutex);
+		if (!m_DeliveryQueue.empty()) {
+			DELIVERY_FRAME frame = std::move(m_DeliveryQueue.front());
+			m_DeliveryQueue.pop_front();
+			TextureReadbackCallback callback = m_Callback;
+			lock.unlock();
+
+			if (callback) {
+				if (frame.HasBitmap) {
+					FRAME_BITMAP_DATA bitmap(frame.Stride, frame.Buffer.data(), static_cast<int>(frame.Buffer.size()), frame.Width, frame.Height);
+					callback(frame.FrameNumber, frame.Timestamp, &bitmap);
+				}
+				else {
+					callback(frame.FrameNumber, frame.Timestamp, nullptr);
+				}
+			}
+
+			lock.lock();
+			if (frame.HasBitmap) {
+				m_FreeBuffers.push_back(std::move(frame.Buffer));
+			}
+		}
+		if (m_DeliveryQueue.empty()) {
+			m_IsDelivering = false;
+			m_FrameDeliveredCondition.notify_all();
+		}
+		else {
+			lock.unlock();
+			m_WorkerPool->Submit([this]() { DeliverNextFrame(); });
+		}
+	}
+};
+
+TextureReadback::TextureReadback(_In_opt_ std::shared_ptr<ReadbackWorkerPool> pWorkerPool) :
+	m_Impl(make_unique<Impl>(pWorkerPool))
+{
+}
+
+TextureReadback::~TextureReadback()
+{
+}
+
+HRESULT TextureReadback::Initialize(_In_ ID3D11DeviceContext *pDeviceContext, _In_ ID3D11Device *pDevice, _In_ TextureReadbackCallback callback, _In_ UINT ringSize, _In_ UINT maxQueuedFrames)
+{
+	return m_Impl->Initialize(pDeviceContext, pDevice, callback, ringSize, maxQueuedFrames);
+}
+
+void TextureReadback::SetMaxFramesPerSecond(_In_ UINT32 fps)
+{
+	m_Impl->SetMaxFramesPerSecond(fps);
+}
+
+bool TextureReadback::IsReadbackDue()
+{
+	return m_Impl->IsReadbackDue();
+}
+
+HRESULT TextureReadback::Enqueue(_In_ int frameNumber, _In_ INT64 timestamp, _In_opt_ ID3D11Texture2D *pTexture)
+{
+	return m_Impl->Enqueue(frameNumber, timestamp, pTexture);
+}
+
+HRESULT TextureReadback::Flush()
+{
+	return m_Impl->Flush();
+}
+
+TEXTURE_READBACK_STATS TextureReadback::GetStats()
+{
+	return m_Impl->GetStats();
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <d3d11.h>
+#include <functional>
+#include <memory>
+#include "CommonTypes.h"
+
+/// <summary>
+/// Called with every enqueued frame, in the order they were enqueued. The bitmap is null if the frame was enqueued without a texture, or if it was dropped because the consumer was too slow.
+/// The bitmap data is only valid for the duration of the call. Called on a thread of the worker pool of the TextureReadback.
+/// </summary>
+typedef std::function<void(int frameNumber, INT64 timestamp, _In_opt_ FRAME_BITMAP_DATA *pBitmap)> TextureReadbackCallback;
+
+struct TEXTURE_READBACK_STATS {
+	/// <summary>Frames copied to the staging ring.</summary>
+	UINT64 ReadbackFrames = 0;
+	/// <summary>Frames that were not read back because of the max frame rate.</summary>
+	UINT64 SkippedFrames = 0;
+	/// <summary>Frames that were read back, but whose bitmap was dropped because the consumer had not handled the previous ones yet.</summary>
+	UINT64 DroppedFrames = 0;
+	/// <summary>Times all staging textures were in use and the caller had to wait for the GPU to finish a copy.</summary>
+	UINT64 BlockingMaps = 0;
+};
+
+/// <summary>
+/// A small pool of threads shared by the deliveries of several TextureReadback instances, so bitmap callbacks for many sources don't need a thread each.
+/// Threads are started on demand, up to the max thread count.
+/// </summary>
+class ReadbackWorkerPool
+{
+public:
+	ReadbackWorkerPool(_In_ UINT maxThreadCount);
+	/// <summary>
+	/// Runs the work that is already submitted, and stops the threads.
+	/// </summary>
+	~ReadbackWorkerPool();
+	void Submit(_In_ std::function<void()> work);
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_Impl;
+};
+
+/// <summary>
+/// Reads textures back to the CPU without stalling the caller on the GPU.
+/// Each texture is copied into one of a ring of staging textures, and a staging texture is only mapped once the GPU has finished copying to it,
+/// so frame N is mapped while frame N+1 and N+2 are still being copied. The mapped data is copied into a pooled buffer, and the buffers are handed
+/// to the callback on a worker pool thread. Frames of one TextureReadback are always delivered one at a time and in order, also when the pool is shared. If the callback can't keep up, the oldest waiting bitmaps are dropped instead of blocking the caller.
+/// The staging textures are mapped on the calling thread rather than on the worker pool. The device is multithread protected, so mapping from a worker would be allowed,
+/// but a Map that waits for the GPU holds the device lock while it waits, which would stall the recording thread's own use of the context. Checking with DO_NOT_WAIT
+/// on each Enqueue never holds the lock for long, and keeps the staging ring owned by a single thread.
+/// All methods except GetStats must be called from one thread at a time.
+/// </summary>
+class TextureReadback
+{
+public:
+	static const UINT DEFAULT_RING_SIZE = 3;
+	static const UINT DEFAULT_MAX_QUEUED_FRAMES = 2;
+
+	/// <param name="pWorkerPool">The pool that runs the callbacks. If null, the readback uses a pool with a single thread of its own.</param>
+	TextureReadback(_In_opt_ std::shared_ptr<ReadbackWorkerPool> pWorkerPool = nullptr);
+	/// <summary>
+	/// Discards frames that are not yet delivered, and waits for the callback if it is running.
+	/// </summary>
+	~TextureReadback();
+	/// <summary>
+	/// Sets up the readback for a device. Can be called again with a new device, e.g. after a device loss. Frames that were still being copied on the previous device are delivered without bitmap.
+	/// </summary>
+	/// <param name="ringSize">The number of staging textures. The caller only waits for the GPU if all of them are in use.</param>
+	/// <param name="maxQueuedFrames">The number of bitmaps that can wait for the callback before the oldest is dropped.</param>
+	HRESULT Initialize(_In_ ID3D11DeviceContext *pDeviceContext, _In_ ID3D11Device *pDevice, _In_ TextureReadbackCallback callback, _In_ UINT ringSize = DEFAULT_RING_SIZE, _In_ UINT maxQueuedFrames = DEFAULT_MAX_QUEUED_FRAMES);
+	/// <summary>
+	/// Limits how often IsReadbackDue returns true. 0 means no limit.
+	/// </summary>
+	void SetMaxFramesPerSecond(_In_ UINT32 fps);
+	/// <summary>
+	/// Returns true if the next frame should be read back according to the max frame rate. Frames that are not due should be enqueued without a texture.
+	/// </summary>
+	bool IsReadbackDue();
+	/// <summary>
+	/// Copies the texture to the staging ring and delivers any earlier frames that have finished copying.
+	/// </summary>
+	/// <param name="pTexture">The texture to read back. It can be reused by the caller when this returns. If null, only the frame number and timestamp are delivered.</param>
+	HRESULT Enqueue(_In_ int frameNumber, _In_ INT64 timestamp, _In_opt_ ID3D11Texture2D *pTexture);
+	/// <summary>
+	/// Waits for all enqueued frames to be read back and handed to the callback.
+	/// </summary>
+	HRESULT Flush();
+	TEXTURE_READBACK_STATS GetStats();
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_Impl;
+};
@@ -0,0 +1,77 @@
+#include "TimerSchedule.h"
+#include <algorithm>
+
+using namespace std;
+
+TimerId TimerSchedule::Add(int64_t dueTime, int64_t period)
+{
+	TimerId id = m_NextId++;
+	m_Timers[id] = TIMER{ dueTime, max<int64_t>(period, 0) };
+	m_Queue.emplace(dueTime, id);
+	m_Stats.ActiveTimers = m_Timers.size();
+	return id;
+}
+
+bool TimerSchedule::Remove(TimerId id)
+{
+	auto timer = m_Timers.find(id);
+	if (timer == m_Timers.end()) {
+		return false;
+	}
+	m_Queue.erase(make_pair(timer->second.DueTime, id));
+	m_Timers.erase(timer);
+	m_Stats.ActiveTimers = m_Timers.size();
+	return true;
+}
+
+bool TimerSchedule::GetDueTime(TimerId id, int64_t *pDueTime) const
+{
+	auto timer = m_Timers.find(id);
+	if (timer == m_Timers.end()) {
+		return false;
+	}
+	if (pDueTime) {
+		*pDueTime = timer->second.DueTime;
+	}
+	return true;
+}
+
+bool TimerSchedule::GetNextDueTime(int64_t *pDueTime) const
+{
+	if (m_Queue.empty()) {
+		return false;
+	}
+	*pDueTime = m_Queue.begin()->first;
+	return true;
+}
+
+void TimerSchedule::Advance(int64_t now, std::vector<TimerId> &dueTimers)
+{
+	m_Stats.Wakeups++;
+	while (!m_Queue.empty() && m_Queue.begin()->first <= now) {
+		auto [dueTime, id] = *m_Queue.begin();
+		m_Queue.erase(m_Queue.begin());
+		dueTimers.push_back(id);
+		int64_t lateness = now - dueTime;
+		m_Stats.Ticks++;
+		m_Stats.TotalLateness += lateness;
+		m_Stats.MaxLateness = max(m_Stats.MaxLateness, lateness);
+
+		TIMER &timer = m_Timers[id];
+		if (timer.Period == 0) {
+			m_Timers.erase(id);
+			continue;
+		}
+		//Ticks that were due before this wakeup are skipped rather than signaled in a burst, and the next tick stays on the grid of the first due time.
+		int64_t missedTicks = lateness / timer.Period;
+		m_Stats.MissedTicks += missedTicks;
+		timer.DueTime = dueTime + (missedTicks + 1) * timer.Period;
+		m_Queue.emplace(timer.DueTime, id);
+	}
+	m_Stats.ActiveTimers = m_Timers.size();
+}
+
+TIMER_SCHEDULE_STATS TimerSchedule::GetStats() const
+{
+	return m_Stats;
+}
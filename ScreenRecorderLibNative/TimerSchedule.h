@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//The deadlines of all timers in the process, which the one thread of TimingService waits for.
+//Like MouseEventRing.h, it doesn't depend on any platform API, so it can be tested on any platform with a virtual clock.
+//
+//Times are in 100 nanosecond units on any monotonic clock. The next tick of a periodic timer is due one period after the previous due time,
+//not one period after it fired, so late wakeups don't add up to drift.
+
+typedef uint64_t TimerId;
+
+struct TIMER_SCHEDULE_STATS {
+	/// <summary>The number of times the schedule was advanced, which is once for every wakeup of the timer thread.</summary>
+	uint64_t Wakeups = 0;
+	/// <summary>The number of times a timer was due. Timers due at the same time share a wakeup.</summary>
+	uint64_t Ticks = 0;
+	/// <summary>Ticks of periodic timers that were skipped, because the wakeup came a period or more after they were due.</summary>
+	uint64_t MissedTicks = 0;
+	/// <summary>The sum of the time between each tick being due and the wakeup that handled it.</summary>
+	int64_t TotalLateness = 0;
+	/// <summary>The longest time between a tick being due and the wakeup that handled it.</summary>
+	int64_t MaxLateness = 0;
+	/// <summary>The number of timers that are scheduled.</summary>
+	uint64_t ActiveTimers = 0;
+};
+
+class TimerSchedule
+{
+public:
+	/// <summary>
+	/// Schedules a timer that is due at dueTime, and every period after that if period is greater than 0.
+	/// </summary>
+	/// <returns>The id of the timer, which is never 0.</returns>
+	TimerId Add(int64_t dueTime, int64_t period);
+	/// <summary>
+	/// Unschedules the timer.
+	/// </summary>
+	/// <returns>false if the timer was not scheduled, such as a one shot timer that was already due.</returns>
+	bool Remove(TimerId id);
+	/// <summary>
+	/// Returns the time the next tick of the timer is due.
+	/// </summary>
+	/// <returns>false if the timer is not scheduled.</returns>
+	bool GetDueTime(TimerId id, int64_t *pDueTime) const;
+	/// <summary>
+	/// Returns the earliest time any timer is due, which is when the timer thread must wake up next.
+	/// </summary>
+	/// <returns>false if no timer is scheduled.</returns>
+	bool GetNextDueTime(int64_t *pDueTime) const;
+	/// <summary>
+	/// Appends the timers that are due at now to dueTimers, and schedules the next tick of the periodic ones. One shot timers are removed.
+	/// Each timer is appended once, however many of its ticks were due.
+	/// </summary>
+	void Advance(int64_t now, std::vector<TimerId> &dueTimers);
+	TIMER_SCHEDULE_STATS GetStats() const;
+private:
+	struct TIMER {
+		int64_t DueTime;
+		int64_t Period;
+	};
+	//The timers ordered by due time, so the next one due is always first.
+	std::set<std::pair<int64_t, TimerId>> m_Queue;
+	std::unordered_map<TimerId, TIMER> m_Timers;
+	TimerId m_NextId = 1;
+	TIMER_SCHEDULE_STATS m_Stats;
+};
@@ -0,0 +1,183 @@
+#include "TimingService.h"
+#include <mutex>
+#include "CommonTypes.h"
+#include "Cleanup.h"
+#include "Log.h"
+
+using namespace std;
+
+std::shared_ptr<TimingService> TimingService::Acquire()
+{
+	static std::mutex s_Mutex;
+	static std::weak_ptr<TimingService> s_Service;
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	std::shared_ptr<TimingService> pService = s_Service.lock();
+	if (!pService) {
+		pService = std::shared_ptr<TimingService>(new TimingService());
+		HRESULT hr = pService->Start();
+		if (FAILED(hr)) {
+			LOG_ERROR(L"Failed to start timing service: hr = 0x%08x", hr);
+		}
+		s_Service = pService;
+	}
+	return pService;
+}
+
+TimingService::TimingService() :
+	m_Schedule{},
+	m_TimerEvents{},
+	m_DueTimers{},
+	m_WaitableTimer(nullptr),
+	m_ScheduleChangedEvent(nullptr),
+	m_StopEvent(nullptr),
+	m_TimerThread(nullptr),
+	m_TimerResolution(0)
+{
+	InitializeCriticalSection(&m_CriticalSection);
+	TIMECAPS tc;
+	UINT targetResolutionMs = 1;
+	if (timeGetDevCaps(&tc, sizeof(TIMECAPS)) == TIMERR_NOERROR)
+	{
+		m_TimerResolution = min(max(tc.wPeriodMin, targetResolutionMs), tc.wPeriodMax);
+		timeBeginPeriod(m_TimerResolution);
+	}
+	//CREATE_WAITABLE_TIMER_HIGH_RESOLUTION is an undocumented flag introduced in Windows 10 1803.
+	//CreateWaitableTimerEx returns NULL if not available.
+	m_WaitableTimer = CreateWaitableTimerEx(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (m_WaitableTimer == NULL) {
+		m_WaitableTimer = CreateWaitableTimer(NULL, false, NULL);
+	}
+	m_ScheduleChangedEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	m_StopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+}
+
+TimingService::~TimingService()
+{
+	if (m_TimerThread) {
+		SetEvent(m_StopEvent);
+		if (WaitForSingleObject(m_TimerThread, 5000) != WAIT_OBJECT_0) {
+			LOG_ERROR(L"Timing service thread did not exit");
+		}
+		CloseHandle(m_TimerThread);
+	}
+	TIMER_SCHEDULE_STATS stats = m_Schedule.GetStats();
+	LOG_DEBUG(L"Stopped timing service after %llu wakeups for %llu timer ticks", stats.Wakeups, stats.Ticks);
+	if (m_TimerResolution > 0) {
+		timeEndPeriod(m_TimerResolution);
+	}
+	CloseHandle(m_WaitableTimer);
+	CloseHandle(m_ScheduleChangedEvent);
+	CloseHandle(m_StopEvent);
+	DeleteCriticalSection(&m_CriticalSection);
+}
+
+HRESULT TimingService::Start()
+{
+	if (!m_WaitableTimer || !m_ScheduleChangedEvent || !m_StopEvent) {
+		DWORD dwErr = GetLastError();
+		LOG_ERROR(L"Failed to create timing service events: last error = %u", dwErr);
+		return HRESULT_FROM_WIN32(dwErr);
+	}
+	m_TimerThread = CreateThread(nullptr, 0, TimerThreadProc, this, 0, nullptr);
+	if (!m_TimerThread) {
+		DWORD dwErr = GetLastError();
+		LOG_ERROR(L"Failed to create timing service thread: %ls", GetLastErrorStdWstr().c_str());
+		return HRESULT_FROM_WIN32(dwErr);
+	}
+	//The thread only signals events, so a high priority keeps the wakeups on time without costing other threads much.
+	SetThreadPriority(m_TimerThread, THREAD_PRIORITY_HIGHEST);
+	LOG_DEBUG(L"Started timing service");
+	return S_OK;
+}
+
+TimerId TimingService::AddTimer(_In_ HANDLE hEvent, _In_ INT64 dueTime, _In_ INT64 period)
+{
+	if (!m_TimerThread) {
+		return 0;
+	}
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"AddTimer");
+	TimerId id = m_Schedule.Add(dueTime, period);
+	m_TimerEvents[id] = hEvent;
+	SetEvent(m_ScheduleChangedEvent);
+	return id;
+}
+
+void TimingService::RemoveTimer(_In_ TimerId id)
+{
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"RemoveTimer");
+	m_Schedule.Remove(id);
+	m_TimerEvents.erase(id);
+}
+
+bool TimingService::GetDueTime(_In_ TimerId id, _Out_ INT64 *pDueTime)
+{
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"GetDueTime");
+	int64_t dueTime = 0;
+	bool isScheduled = m_Schedule.GetDueTime(id, &dueTime);
+	*pDueTime = dueTime;
+	return isScheduled;
+}
+
+TIMER_SCHEDULE_STATS TimingService::GetStats()
+{
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"GetStats");
+	return m_Schedule.GetStats();
+}
+
+DWORD WINAPI TimingService::TimerThreadProc(_In_ void *pParam)
+{
+	static_cast<TimingService *>(pParam)->RunTimerThread();
+	return 0;
+}
+
+void TimingService::RunTimerThread()
+{
+	HANDLE waitHandles[3]{ m_StopEvent, m_ScheduleChangedEvent, m_WaitableTimer };
+	while (true) {
+		int64_t dueTime = 0;
+		bool isTimerScheduled;
+		{
+			EnterCriticalSection(&m_CriticalSection);
+			LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"RunTimerThread");
+			isTimerScheduled = m_Schedule.GetNextDueTime(&dueTime);
+		}
+		if (isTimerScheduled) {
+			LARGE_INTEGER liDueTime;
+			liDueTime.QuadPart = -max(0LL, dueTime - GetPerformanceCounterTime()); // negative means relative time
+			if (!SetWaitableTimer(m_WaitableTimer, &liDueTime, 0, NULL, NULL, FALSE)) {
+				LOG_ERROR(L"SetWaitableTimer failed in timing service: last error = %u", GetLastError());
+				return;
+			}
+		}
+		DWORD result = WaitForMultipleObjects(isTimerScheduled ? ARRAYSIZE(waitHandles) : ARRAYSIZE(waitHandles) - 1, waitHandles, FALSE, INFINITE);
+		if (result == WAIT_OBJECT_0) {
+			CancelWaitableTimer(m_WaitableTimer);
+			return;
+		}
+		else if (result == WAIT_OBJECT_0 + 2) {
+			EnterCriticalSection(&m_CriticalSection);
+			LeaveCriticalSectionOnExit leaveCriticalSection(&m_CriticalSection, L"RunTimerThread");
+			m_DueTimers.clear();
+			//The waitable timer may fire slightly before the performance counter reaches the due time, in which case nothing is due yet and the timer is rearmed.
+			m_Schedule.Advance(GetPerformanceCounterTime(), m_DueTimers);
+			for (TimerId id : m_DueTimers) {
+				auto timerEvent = m_TimerEvents.find(id);
+				if (timerEvent == m_TimerEvents.end()) {
+					continue;
+				}
+				SetEvent(timerEvent->second);
+				if (!m_Schedule.GetDueTime(id, nullptr)) {
+					m_TimerEvents.erase(timerEvent);
+				}
+			}
+		}
+		else if (result != WAIT_OBJECT_0 + 1) {
+			LOG_ERROR(L"WaitForMultipleObjects failed in timing service: last error = %u", GetLastError());
+			return;
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <Windows.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "TimerSchedule.h"
+
+/// <summary>
+/// One thread with one high resolution waitable timer that signals the events of all timers in the process when they are due,
+/// instead of every reader owning a waitable timer and a raised system timer resolution of its own.
+/// The system timer resolution is raised once, for as long as the service is in use.
+/// </summary>
+class TimingService
+{
+public:
+	/// <summary>
+	/// Returns the service of the process, and starts it if it is not running. It stops when the last reference is released.
+	/// </summary>
+	static std::shared_ptr<TimingService> Acquire();
+	~TimingService();
+	/// <summary>
+	/// Sets hEvent at dueTime, and every period after it if period is greater than 0. Times are in 100 nanosecond units on the performance counter clock, as returned by GetPerformanceCounterTime.
+	/// </summary>
+	/// <returns>The id of the timer, or 0 if the service failed to start.</returns>
+	TimerId AddTimer(_In_ HANDLE hEvent, _In_ INT64 dueTime, _In_ INT64 period);
+	void RemoveTimer(_In_ TimerId id);
+	/// <summary>
+	/// Returns the time the next tick of the timer is due, or false if it is not scheduled.
+	/// </summary>
+	bool GetDueTime(_In_ TimerId id, _Out_ INT64 *pDueTime);
+	/// <summary>
+	/// Returns the wakeups and ticks since the service started. The difference between two calls gives the counts for a recording.
+	/// </summary>
+	TIMER_SCHEDULE_STATS GetStats();
+private:
+	TimingService();
+	HRESULT Start();
+	static DWORD WINAPI TimerThreadProc(_In_ void *pParam);
+	void RunTimerThread();
+
+	CRITICAL_SECTION m_CriticalSection;
+	TimerSchedule m_Schedule;
+	//The event of each scheduled timer.
+	std::unordered_map<TimerId, HANDLE> m_TimerEvents;
+	std::vector<TimerId> m_DueTimers;
+	HANDLE m_WaitableTimer;
+	//Set when a timer is added, so the thread rearms the waitable timer if the new timer is due first.
+	HANDLE m_ScheduleChangedEvent;
+	HANDLE m_StopEvent;
+	HANDLE m_TimerThread;
+	UINT m_TimerResolution;
+};
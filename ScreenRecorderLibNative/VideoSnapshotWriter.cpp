@@ -0,0 +1,277 @@
+#include "VideoSnapshotWriter.h"
+#include "SnapshotEncoder.h"
+#include "TextureReadback.h"
+#include <algorithm>
+#include <atlbase.h>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+struct VideoSnapshotWriter::Impl {
+	struct STAGING_TEXTURE {
+		CComPtr<ID3D11Texture2D> Texture;
+		D3D11_TEXTURE2D_DESC Desc{};
+		//Guarded by m_Mutex, as it is released by the worker.
+		bool IsInUse = false;
+	};
+
+	struct PENDING_SNAPSHOT {
+		shared_ptr<STAGING_TEXTURE> Staging;
+		//The context the copy was queued on, so a snapshot from before a device change is mapped on its own device.
+		CComPtr<ID3D11DeviceContext> DeviceContext;
+		wstring Path;
+	};
+
+	Impl(UINT maxQueuedSnapshots) :
+		m_MaxQueuedSnapshots(max<UINT>(maxQueuedSnapshots, 1)),
+		//Snapshots are rare compared to frames, so a single thread keeps up and keeps the encoding from competing with the recording for cores.
+		m_WorkerPool(make_unique<ReadbackWorkerPool>(1))
+	{
+	}
+
+	~Impl()
+	{
+		Flush();
+	}
+
+	HRESULT Initialize(ID3D11DeviceContext *pDeviceContext, ID3D11Device *pDevice, ImageEncoderInternal encoder, REFGUID guidContainerFormat, VideoSnapshotWrittenCallback callback)
+	{
+		//Snapshots copied on the previous device are handed to the worker first, or fail to map if the device is lost.
+		ReadPendingSnapshots(true);
+		lock_guard<mutex> lock(m_Mutex);
+		//Snapshots in flight keep their staging texture alive.
+		m_StagingTextures.clear();
+		for (UINT i = 0; i < m_MaxQueuedSnapshots; i++) {
+			m_StagingTextures.push_back(make_shared<STAGING_TEXTURE>());
+		}
+		m_DeviceContext = pDeviceContext;
+		m_Device = pDevice;
+		m_Encoder = encoder;
+		m_ContainerFormat = guidContainerFormat;
+		m_Callback = callback;
+		return S_OK;
+	}
+
+	HRESULT WriteSnapshot(wstring path, ID3D11Texture2D *pTexture, RECT sourceRect)
+	{
+		if (!pTexture || !m_Device) {
+			return E_INVALIDARG;
+		}
+		shared_ptr<STAGING_TEXTURE> staging;
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			auto freeTexture = find_if(m_StagingTextures.begin(), m_StagingTextures.end(), [](const shared_ptr<STAGING_TEXTURE> &texture) { return !texture->IsInUse; });
+			if (freeTexture == m_StagingTextures.end()) {
+				m_Stats.SkippedSnapshots++;
+				LOG_WARN(L"Skipping snapshot %ls, the previous snapshots are still being written", path.c_str());
+				return S_FALSE;
+			}
+			staging = *freeTexture;
+			staging->IsInUse = true;
+			m_QueuedCount++;
+		}
+		HRESULT hr = CopyToStagingTexture(pTexture, sourceRect, *staging);
+		if (FAILED(hr)) {
+			LOG_ERROR(L"Failed to copy snapshot to staging texture: hr = 0x%08x", hr);
+			OnSnapshotDone(*staging, hr, path);
+			return hr;
+		}
+		m_PendingSnapshots.push_back(PENDING_SNAPSHOT{ staging, m_DeviceContext, std::move(path) });
+		ReadPendingSnapshots(false);
+		return S_OK;
+	}
+
+	/// <summary>
+	/// Maps the pending snapshots whose copy has finished, in the order they were queued, and hands them to the worker.
+	/// If wait is false, Map is called with DO_NOT_WAIT, so the device lock is never held while waiting for the GPU.
+	/// </summary>
+	void ReadPendingSnapshots(bool wait)
+	{
+		while (!m_PendingSnapshots.empty()) {
+			PENDING_SNAPSHOT &pending = m_PendingSnapshots.front();
+			D3D11_MAPPED_SUBRESOURCE map;
+			HRESULT hr = pending.DeviceContext->Map(pending.Staging->Texture, 0, D3D11_MAP_READ, wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, &map);
+			if (hr == DXGI_ERROR_WAS_STILL_DRAWING && !wait) {
+				//Copies finish in the order they were queued, so the later ones are not done either.
+				return;
+			}
+			PENDING_SNAPSHOT snapshot = std::move(pending);
+			m_PendingSnapshots.pop_front();
+			if (FAILED(hr)) {
+				OnSnapshotDone(*snapshot.Staging, hr, snapshot.Path);
+				continue;
+			}
+			ImageEncoderInternal encoder = m_Encoder;
+			GUID containerFormat = m_ContainerFormat;
+			m_WorkerPool->Submit([this, snapshot = std::move(snapshot), map, encoder, containerFormat]() {
+				HRESULT hr = CoInitializeEx(nullptr, COINITBASE_MULTITHREADED | COINIT_DISABLE_OLE1DDE);
+				bool isCoInitialized = SUCCEEDED(hr);
+				hr = EncodeSnapshot(map, *snapshot.Staging, encoder, containerFormat, snapshot.Path);
+				//Unmap doesn't wait for the GPU, and the device is multithread protected, so the worker releases the mapping itself.
+				snapshot.DeviceContext->Unmap(snapshot.Staging->Texture, 0);
+				if (isCoInitialized) {
+					CoUninitialize();
+				}
+				OnSnapshotDone(*snapshot.Staging, hr, snapshot.Path);
+			});
+		}
+	}
+
+	void Flush()
+	{
+		ReadPendingSnapshots(true);
+		unique_lock<mutex> lock(m_Mutex);
+		m_SnapshotDoneCondition.wait(lock, [this]() { return m_QueuedCount == 0; });
+	}
+
+	VIDEO_SNAPSHOT_WRITER_STATS GetStats()
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		return m_Stats;
+	}
+
+private:
+	const UINT m_MaxQueuedSnapshots;
+	CComPtr<ID3D11DeviceContext> m_DeviceContext;
+	CComPtr<ID3D11Device> m_Device;
+	ImageEncoderInternal m_Encoder = ImageEncoderInternal::Wic;
+	GUID m_ContainerFormat{};
+	VideoSnapshotWrittenCallback m_Callback;
+	//Snapshots copied to a staging texture but not yet mapped, in the order they were queued. Only used on the calling thread.
+	deque<PENDING_SNAPSHOT> m_PendingSnapshots;
+
+	//Guards everything below, which is shared with the worker.
+	mutex m_Mutex;
+	condition_variable m_SnapshotDoneCondition;
+	vector<shared_ptr<STAGING_TEXTURE>> m_StagingTextures;
+	UINT m_QueuedCount = 0;
+	VIDEO_SNAPSHOT_WRITER_STATS m_Stats{};
+
+	//Declared last, so the pool is stopped before the members its work uses are destroyed.
+	unique_ptr<ReadbackWorkerPool> m_WorkerPool;
+
+	HRESULT CopyToStagingTexture(ID3D11Texture2D *pTexture, RECT sourceRect, STAGING_TEXTURE &staging)
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		pTexture->GetDesc(&desc);
+		//If the frame is larger than the source rect, only the rect is copied, to avoid black borders around the snapshots.
+		D3D11_BOX box{};
+		box.left = static_cast<UINT>(clamp<LONG>(sourceRect.left, 0, desc.Width));
+		box.top = static_cast<UINT>(clamp<LONG>(sourceRect.top, 0, desc.Height));
+		box.right = static_cast<UINT>(clamp<LONG>(sourceRect.right, box.left, desc.Width));
+		box.bottom = static_cast<UINT>(clamp<LONG>(sourceRect.bottom, box.top, desc.Height));
+		box.front = 0;
+		box.back = 1;
+		if (box.right == box.left || box.bottom == box.top) {
+			box.left = box.top = 0;
+			box.right = desc.Width;
+			box.bottom = desc.Height;
+		}
+		desc.Width = box.right - box.left;
+		desc.Height = box.bottom - box.top;
+		if (!staging.Texture
+			|| staging.Desc.Width != desc.Width
+			|| staging.Desc.Height != desc.Height
+			|| staging.Desc.Format != desc.Format) {
+			staging.Texture.Release();
+			desc.MipLevels = 1;
+			desc.ArraySize = 1;
+			desc.SampleDesc.Count = 1;
+			desc.SampleDesc.Quality = 0;
+			desc.Usage = D3D11_USAGE_STAGING;
+			desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+			desc.MiscFlags = 0;
+			desc.BindFlags = 0;
+			RETURN_ON_BAD_HR(m_Device->CreateTexture2D(&desc, nullptr, &staging.Texture));
+			staging.Desc = desc;
+		}
+		m_DeviceContext->CopySubresourceRegion(staging.Texture, 0, 0, 0, 0, pTexture, 0, &box);
+		//Submit the copy now, so the worker doesn't wait for the next frame's flush to map it.
+		m_DeviceContext->Flush();
+		return S_OK;
+	}
+
+	/// <summary>
+	/// Runs on the worker. Encodes straight from the mapped staging texture.
+	/// </summary>
+	static HRESULT EncodeSnapshot(const D3D11_MAPPED_SUBRESOURCE &map, STAGING_TEXTURE &staging, ImageEncoderInternal encoder, REFGUID containerFormat, const wstring &path)
+	{
+		std::wstring directory = std::filesystem::path(path).parent_path().wstring();
+		if (!directory.empty() && !std::filesystem::exists(directory)) {
+			std::error_code ec;
+			if (!std::filesystem::create_directories(directory, ec)) {
+				LOG_ERROR(L"failed to create snapshot output folder");
+				return E_FAIL;
+			}
+			LOG_DEBUG(L"Snapshot output folder created");
+		}
+		return SaveSnapshotBitmapToFile(static_cast<const BYTE *>(map.pData), map.RowPitch, staging.Desc.Width, staging.Desc.Height, staging.Desc.Format, encoder, containerFormat, path.c_str());
+	}
+
+	void OnSnapshotDone(STAGING_TEXTURE &staging, HRESULT hr, const wstring &path)
+	{
+		VideoSnapshotWrittenCallback callback;
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			staging.IsInUse = false;
+			if (SUCCEEDED(hr)) {
+				m_Stats.WrittenSnapshots++;
+				callback = m_Callback;
+			}
+			else {
+				m_Stats.FailedSnapshots++;
+			}
+		}
+		if (SUCCEEDED(hr)) {
+			LOG_TRACE(L"Wrote snapshot to %s", path.c_str());
+			if (callback) {
+				callback(path);
+			}
+		}
+		else {
+			LOG_ERROR(L"Writing of snapshot %ls failed: hr = 0x%08x", path.c_str(), hr);
+		}
+		//Done last, so Flush doesn't return while the callback is still running.
+		lock_guard<mutex> lock(m_Mutex);
+		m_QueuedCount--;
+		m_SnapshotDoneCondition.notify_all();
+	}
+};
+
+VideoSnapshotWriter::VideoSnapshotWriter(_In_ UINT maxQueuedSnapshots) :
+	m_Impl(make_unique<Impl>(maxQueuedSnapshots))
+{
+}
+
+VideoSnapshotWriter::~VideoSnapshotWriter()
+{
+}
+
+HRESULT VideoSnapshotWriter::Initialize(_In_ ID3D11DeviceContext *pDeviceContext, _In_ ID3D11Device *pDevice, _In_ ImageEncoderInternal encoder, _In_ REFGUID guidContainerFormat, _In_opt_ VideoSnapshotWrittenCallback callback)
+{
+	return m_Impl->Initialize(pDeviceContext, pDevice, encoder, guidContainerFormat, callback);
+}
+
+HRESULT VideoSnapshotWriter::WriteSnapshot(_In_ std::wstring path, _In_ ID3D11Texture2D *pTexture, _In_ RECT sourceRect)
+{
+	return m_Impl->WriteSnapshot(std::move(path), pTexture, sourceRect);
+}
+
+void VideoSnapshotWriter::ReadPendingSnapshots()
+{
+	m_Impl->ReadPendingSnapshots(false);
+}
+
+void VideoSnapshotWriter::Flush()
+{
+	m_Impl->Flush();
+}
+
+VIDEO_SNAPSHOT_WRITER_STATS VideoSnapshotWriter::GetStats()
+{
+	return m_Impl->GetStats();
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <d3d11.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include "CommonTypes.h"
+
+/// <summary>
+/// Called on a worker thread with the path of each snapshot that was written.
+/// </summary>
+typedef std::function<void(const std::wstring &path)> VideoSnapshotWrittenCallback;
+
+struct VIDEO_SNAPSHOT_WRITER_STATS {
+	/// <summary>Snapshots encoded and written to their file.</summary>
+	UINT64 WrittenSnapshots = 0;
+	/// <summary>Snapshots that were not taken because all staging textures were still waiting for or being encoded.</summary>
+	UINT64 SkippedSnapshots = 0;
+	/// <summary>Snapshots that could not be read back, encoded or written.</summary>
+	UINT64 FailedSnapshots = 0;
+};
+
+/// <summary>
+/// Writes the periodic snapshots of a video recording without taking time from the frame loop.
+/// WriteSnapshot only queues a GPU copy of the frame into a pooled staging texture. Like in TextureReadback, the staging texture is only mapped once the GPU has finished the copy,
+/// which is checked with DO_NOT_WAIT on each WriteSnapshot and ReadPendingSnapshots call, so the device lock is never held while waiting for the GPU.
+/// Encoding and writing the file happen on a worker thread, which unmaps the texture when done.
+/// The number of snapshots in flight is bounded by the number of staging textures. If they are all in use, the snapshot is skipped instead of waiting, as a late snapshot is worth less than a smooth recording.
+/// All methods except GetStats must be called from one thread at a time.
+/// </summary>
+class VideoSnapshotWriter
+{
+public:
+	static const UINT DEFAULT_MAX_QUEUED_SNAPSHOTS = 2;
+
+	/// <param name="maxQueuedSnapshots">The number of snapshots that can be waiting for or being encoded before new ones are skipped.</param>
+	VideoSnapshotWriter(_In_ UINT maxQueuedSnapshots = DEFAULT_MAX_QUEUED_SNAPSHOTS);
+	/// <summary>
+	/// Waits for the snapshots being encoded.
+	/// </summary>
+	~VideoSnapshotWriter();
+	/// <summary>
+	/// Sets up the writer for a device. Can be called again with a new device, e.g. after a device loss. Snapshots that were still being copied on the previous device fail if that device is lost.
+	/// </summary>
+	HRESULT Initialize(_In_ ID3D11DeviceContext *pDeviceContext, _In_ ID3D11Device *pDevice, _In_ ImageEncoderInternal encoder, _In_ REFGUID guidContainerFormat, _In_opt_ VideoSnapshotWrittenCallback callback);
+	/// <summary>
+	/// Queues a copy of the texture, cropped to the source rect, to be written to the given path. The directory of the path is created if needed.
+	/// </summary>
+	/// <param name="sourceRect">The area of the texture to write. It is clamped to the size of the texture.</param>
+	/// <returns>S_FALSE if the snapshot was skipped because too many snapshots are in flight.</returns>
+	HRESULT WriteSnapshot(_In_ std::wstring path, _In_ ID3D11Texture2D *pTexture, _In_ RECT sourceRect);
+	/// <summary>
+	/// Hands the snapshots whose copy has finished to the worker. Should be called once per frame, so a snapshot doesn't wait for the next one to be mapped.
+	/// </summary>
+	void ReadPendingSnapshots();
+	/// <summary>
+	/// Waits for all queued snapshots to be written.
+	/// </summary>
+	void Flush();
+	VIDEO_SNAPSHOT_WRITER_STATS GetStats();
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_Impl;
+};
@@ -39,7 +39,10 @@ WindowsGraphicsCapture::WindowsGraphicsCapture() :
 	m_CursorOffsetX(0),
 	m_CursorOffsetY(0),
 	m_CursorScaleX(1.0),
-	m_CursorScaleY(1.0)
+	m_CursorScaleY(1.0),
+	m_FramePoolState{},
+	m_Stats{},
+	m_ArrivedFrames{ 0 }
 {
 	RtlZeroMemory(&m_CurrentData, sizeof(m_CurrentData));
 	m_NewFrameEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
@@ -51,6 +54,11 @@ WindowsGraphicsCapture::~WindowsGraphicsCapture()
 	StopCapture();
 	SafeRelease(&m_CurrentData.Frame);
 	CloseHandle(m_NewFrameEvent);
+	FRAME_POOL_STATS stats = GetStats();
+	if (stats.ArrivedFrames > 0) {
+		LOG_INFO(L"Windows Graphics Capture: %llu frames arrived, %llu delivered, %llu stale, %llu dropped, frame pool recreated %llu times and %llu resizes absorbed, longest hold %.1f ms",
+			stats.ArrivedFrames, stats.DeliveredFrames, stats.StaleFrames, stats.DroppedFrames, stats.Recreations, stats.AbsorbedResizes, HundredNanosToMillisDouble(stats.MaxHoldTime));
+	}
 }
 
 HRESULT WindowsGraphicsCapture::Initialize(_In_ ID3D11DeviceContext *pDeviceContext, _In_ ID3D11Device *pDevice)
@@ -91,6 +99,7 @@ HRESULT WindowsGraphicsCapture::WriteNextFrameToSharedSurface(_In_ DWORD timeout
 	if (pTexture) {
 		m_CurrentData.Frame = pTexture;
 		QueryPerformanceCounter(&m_CurrentData.Timestamp);
+		m_CurrentData.PresentTime = PerformanceCounterToHundredNanos(m_CurrentData.Timestamp.QuadPart);
 		D3D11_TEXTURE2D_DESC desc;
 		pTexture->GetDesc(&desc);
 		m_CurrentData.ContentSize = SIZE{ static_cast<long>(desc.Width),static_cast<long>(desc.Height) };
@@ -186,6 +195,7 @@ HRESULT WindowsGraphicsCapture::WriteNextFrameToSharedSurface(_In_ DWORD timeout
 		m_CursorScaleX = cursorScaleX;
 		m_CursorScaleY = cursorScaleY;
 		QueryPerformanceCounter(&m_LastGrabTimeStamp);
+		m_LastFramePresentTime = m_CurrentData.PresentTime;
 		SendBitmapCallback(pProcessedTexture);
 	}
 	return hr;
@@ -217,7 +227,15 @@ HRESULT WindowsGraphicsCapture::StartCapture(_In_ RECORDING_SOURCE_BASE &recordi
 			// the frame pool was created on. This also means that the creating thread
 			// must have a DispatcherQueue. If you use this method, it's best not to do
 			// it on the UI thread. 
-			m_framePool = winrt::Direct3D11CaptureFramePool::CreateFreeThreaded(direct3DDevice, winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized, 2, m_CaptureItem.Size());
+			winrt::SizeInt32 itemSize = m_CaptureItem.Size();
+			FRAME_POOL_LAYOUT layout{ itemSize.Width, itemSize.Height, 2 };
+			//Windows are likely to be resized, so they get room to grow from the start.
+			if (recordingSource.Type == RecordingSourceType::Window) {
+				layout.Width = GetFramePoolDimension(itemSize.Width);
+				layout.Height = GetFramePoolDimension(itemSize.Height);
+			}
+			m_framePool = winrt::Direct3D11CaptureFramePool::CreateFreeThreaded(direct3DDevice, winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized, layout.BufferCount, winrt::SizeInt32{ layout.Width, layout.Height });
+			m_FramePoolState = CreateFramePoolState(layout);
 
 			m_session = m_framePool.CreateCaptureSession(m_CaptureItem);
 
@@ -273,6 +291,18 @@ HRESULT WindowsGraphicsCapture::StopCapture()
 	return hr;
 }
 
+FRAME_POOL_STATS WindowsGraphicsCapture::GetStats()
+{
+	FRAME_POOL_STATS stats = m_Stats;
+	stats.ArrivedFrames = m_ArrivedFrames.load();
+	//Frames that arrived but were never taken from the frame pool were discarded when it was recreated or closed.
+	UINT64 takenFrames = stats.DeliveredFrames + stats.StaleFrames + stats.DroppedFrames;
+	if (stats.ArrivedFrames > takenFrames) {
+		stats.DroppedFrames += stats.ArrivedFrames - takenFrames;
+	}
+	return stats;
+}
+
 HRESULT WindowsGraphicsCapture::GetNativeSize(_In_ RECORDING_SOURCE_BASE &recordingSource, _Out_ SIZE *nativeMediaSize)
 {
 	HRESULT hr = S_OK;
@@ -381,9 +411,9 @@ HRESULT WindowsGraphicsCapture::GetCaptureItem(_In_ RECORDING_SOURCE_BASE &recor
 	return hr;
 }
 
-HRESULT WindowsGraphicsCapture::RecreateFramePool(_Inout_ GRAPHICS_FRAME_DATA *pData, _In_ winrt::SizeInt32 newSize)
+HRESULT WindowsGraphicsCapture::RecreateFramePool(_In_ const FRAME_POOL_LAYOUT &layout)
 {
-	//The source has changed size, so we must recreate the frame pool with the new size.
+	//Recreating the frame pool discards the frames in it, so it is only done when FramePoolPolicy changes its size or buffer count.
 	CComPtr<IDXGIDevice> DxgiDevice = nullptr;
 	HRESULT hr = m_Device->QueryInterface(__uuidof(IDXGIDevice), reinterpret_cast<void **>(&DxgiDevice));
 	if (FAILED(hr))
@@ -395,16 +425,9 @@ HRESULT WindowsGraphicsCapture::RecreateFramePool(_Inout_ GRAPHICS_FRAME_DATA *p
 	try
 	{
 		auto direct3DDevice = Graphics::Capture::Util::CreateDirect3DDevice(DxgiDevice);
-		winrt::SizeInt32 newFramePoolSize = newSize;
-
-		/// If recording a window, make the frame pool return a slightly larger texture that we crop later.
-		/// This prevents issues with clipping when resizing windows.
-		if (m_RecordingSource->Type == RecordingSourceType::Window) {
-			newFramePoolSize.Width += 100;
-			newFramePoolSize.Height += 100;
-		}
-		m_framePool.Recreate(direct3DDevice, winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized, 1, newFramePoolSize);
-		LOG_TRACE(L"Recreated WGC Frame Pool size [%d,%d]", newFramePoolSize.Width, newFramePoolSize.Height);
+		m_framePool.Recreate(direct3DDevice, winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized, layout.BufferCount, winrt::SizeInt32{ layout.Width, layout.Height });
+		m_Stats.Recreations++;
+		LOG_TRACE(L"Recreated WGC Frame Pool size [%d,%d] with %d buffers", layout.Width, layout.Height, layout.BufferCount);
 	}
 	catch (winrt::hresult_error const &ex)
 	{
@@ -412,11 +435,51 @@ HRESULT WindowsGraphicsCapture::RecreateFramePool(_Inout_ GRAPHICS_FRAME_DATA *p
 		LOG_ERROR(L"Failed to recreate WindowsGraphicsCapture frame pool: error is %ls", ex.message().c_str());
 		return hr;
 	}
-	pData->ContentSize.cx = newSize.Width;
-	pData->ContentSize.cy = newSize.Height;
 	return hr;
 }
 
+winrt::Direct3D11CaptureFrame WindowsGraphicsCapture::TryGetNewestFrame(_Out_ INT64 *pMaxHoldTime)
+{
+	*pMaxHoldTime = 0;
+	winrt::Direct3D11CaptureFrame frame = m_framePool.TryGetNextFrame();
+	while (frame) {
+		winrt::Direct3D11CaptureFrame nextFrame = m_framePool.TryGetNextFrame();
+		if (!nextFrame) {
+			break;
+		}
+		*pMaxHoldTime = max<INT64>(*pMaxHoldTime, CloseFrame(frame));
+		m_Stats.StaleFrames++;
+		frame = nextFrame;
+	}
+	return frame;
+}
+
+INT64 WindowsGraphicsCapture::CloseFrame(_In_ winrt::Direct3D11CaptureFrame const &frame)
+{
+	//SystemRelativeTime is the performance counter in 100 nanosecond units when the frame was presented, and the buffer is in use from then until it is closed.
+	INT64 holdTime = max<INT64>(0, GetPerformanceCounterTime() - frame.SystemRelativeTime().count());
+	frame.Close();
+	m_Stats.MaxHoldTime = max<INT64>(m_Stats.MaxHoldTime, holdTime);
+	return holdTime;
+}
+
+HRESULT WindowsGraphicsCapture::UpdateFramePool(_In_ winrt::SizeInt32 contentSize, _In_ INT64 presentTime, _In_ INT64 holdTime, _Out_ bool *pIsRecreated)
+{
+	*pIsRecreated = false;
+	FRAME_POOL_FRAME poolFrame;
+	poolFrame.ContentWidth = contentSize.Width;
+	poolFrame.ContentHeight = contentSize.Height;
+	poolFrame.PresentTime = presentTime;
+	poolFrame.HoldTime = holdTime;
+	FRAME_POOL_STATE nextState = GetNextFramePoolState(m_FramePoolState, poolFrame);
+	if (nextState.Layout != m_FramePoolState.Layout) {
+		RETURN_ON_BAD_HR(RecreateFramePool(nextState.Layout));
+		*pIsRecreated = true;
+	}
+	m_FramePoolState = nextState;
+	return S_OK;
+}
+
 HRESULT WindowsGraphicsCapture::ProcessRecordingTimeout(_Inout_ GRAPHICS_FRAME_DATA *pData)
 {
 	if (m_RecordingSource->Type == RecordingSourceType::Window) {
@@ -448,6 +511,7 @@ HRESULT WindowsGraphicsCapture::ProcessRecordingTimeout(_Inout_ GRAPHICS_FRAME_D
 			pData->ContentSize = windowSize;
 			m_TextureManager->BlankTexture(pData->Frame, RECT{ 0,0,windowSize.cx,windowSize.cy });
 			QueryPerformanceCounter(&pData->Timestamp);
+			pData->PresentTime = PerformanceCounterToHundredNanos(pData->Timestamp.QuadPart);
 			return S_OK;
 		}
 		else if (IsRecordingSessionStale()) {
@@ -483,6 +547,7 @@ bool WindowsGraphicsCapture::IsRecordingSessionStale()
 void WindowsGraphicsCapture::OnFrameArrived(winrt::Direct3D11CaptureFramePool const &sender, winrt::IInspectable const &)
 {
 	QueryPerformanceCounter(&m_LastSampleReceivedTimeStamp);
+	m_ArrivedFrames++;
 	SetEvent(m_NewFrameEvent);
 	if (m_session.IsCursorCaptureEnabled() != m_RecordingSource->IsCursorCaptureEnabled.value_or(true)) {
 		m_session.IsCursorCaptureEnabled(m_RecordingSource->IsCursorCaptureEnabled.value_or(true));
@@ -498,9 +563,10 @@ HRESULT WindowsGraphicsCapture::GetNextFrame(_In_ DWORD timeoutMillis, _Inout_ G
 	}
 	if (result == WAIT_OBJECT_0) {
 		winrt::Direct3D11CaptureFrame frame = nullptr;
+		INT64 holdTime = 0;
 		try
 		{
-			frame = m_framePool.TryGetNextFrame();
+			frame = TryGetNewestFrame(&holdTime);
 		}
 		catch (winrt::hresult_error const &ex)
 		{
@@ -510,20 +576,35 @@ HRESULT WindowsGraphicsCapture::GetNextFrame(_In_ DWORD timeoutMillis, _Inout_ G
 		}
 		if (frame) {
 			MeasureExecutionTime measureGetFrame(L"WindowsGraphicsManager::GetNextFrame");
-			if (frame.ContentSize().Width != pData->ContentSize.cx
-					|| frame.ContentSize().Height != pData->ContentSize.cy) {
-
-				RETURN_ON_BAD_HR(hr = RecreateFramePool(pData, frame.ContentSize()));
-
+			winrt::SizeInt32 contentSize = frame.ContentSize();
+			//SystemRelativeTime is the performance counter in 100 nanosecond units when the frame was presented, which can be well before it arrived here.
+			INT64 presentTime = frame.SystemRelativeTime().count();
+			auto surfaceTexture = Graphics::Capture::Util::GetDXGIInterfaceFromObject<ID3D11Texture2D>(frame.Surface());
+			D3D11_TEXTURE2D_DESC surfaceDesc;
+			surfaceTexture->GetDesc(&surfaceDesc);
+			bool isRecreated = false;
+			if (contentSize.Width > (int)surfaceDesc.Width || contentSize.Height > (int)surfaceDesc.Height) {
+				//The content has outgrown the frame pool, so the frame is clipped. It is dropped, and the next one arrives in a frame pool grown to fit it.
+				holdTime = max<INT64>(holdTime, CloseFrame(frame));
+				m_Stats.DroppedFrames++;
+				RETURN_ON_BAD_HR(hr = UpdateFramePool(contentSize, presentTime, holdTime, &isRecreated));
+				if (!isRecreated) {
+					RETURN_ON_BAD_HR(hr = RecreateFramePool(m_FramePoolState.Layout));
+				}
+				return DXGI_ERROR_WAIT_TIMEOUT;
+			}
+			bool isResized = contentSize.Width != pData->ContentSize.cx || contentSize.Height != pData->ContentSize.cy;
+			bool isFirstResize = pData->ContentSize.cx == 0;
+			if (isResized) {
+				pData->ContentSize.cx = contentSize.Width;
+				pData->ContentSize.cy = contentSize.Height;
 				/*
 				* If the recording is started on a minimized window, we will have guesstimated a size for it when starting the recording.
 				* In this instance we continue to use this size instead of the Direct3D11CaptureFrame::ContentSize(), as it may differ by a few pixels
 				* due to windows 10 window borders and trigger a resize, which leads to blurry recordings.
 				*/
-				auto newFrameSize = (!m_HaveDeliveredFirstFrame && pData->ContentSize.cx > 0) ? winrt::SizeInt32{ pData->ContentSize.cx, pData->ContentSize.cy } : frame.ContentSize();
-				auto surfaceTexture = Graphics::Capture::Util::GetDXGIInterfaceFromObject<ID3D11Texture2D>(frame.Surface());
-				D3D11_TEXTURE2D_DESC newFrameDesc;
-				surfaceTexture->GetDesc(&newFrameDesc);
+				auto newFrameSize = (!m_HaveDeliveredFirstFrame && pData->ContentSize.cx > 0) ? winrt::SizeInt32{ pData->ContentSize.cx, pData->ContentSize.cy } : contentSize;
+				D3D11_TEXTURE2D_DESC newFrameDesc = surfaceDesc;
 				newFrameDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
 				newFrameDesc.Width = newFrameSize.Width;
 				newFrameDesc.Height = newFrameSize.Height;
@@ -535,14 +616,20 @@ HRESULT WindowsGraphicsCapture::GetNextFrame(_In_ DWORD timeoutMillis, _Inout_ G
 					return hr;
 				}
 
-				measureGetFrame.SetName(L"WindowsGraphicsManager::GetNextFrame recreated");
+				measureGetFrame.SetName(L"WindowsGraphicsManager::GetNextFrame resized");
 
 				//Some times the size of the first frame is wrong when recording windows, so we just skip it and get a new after resizing the frame pool.
 				if (m_RecordingSource->Type == RecordingSourceType::Window
 					&& !m_HaveDeliveredFirstFrame)
 				{
 					m_HaveDeliveredFirstFrame = true;
-					frame.Close();
+					holdTime = max<INT64>(holdTime, CloseFrame(frame));
+					m_Stats.DroppedFrames++;
+					RETURN_ON_BAD_HR(hr = UpdateFramePool(contentSize, presentTime, holdTime, &isRecreated));
+					//Recreating the frame pool makes it send a new frame, so it is recreated even if it already fits the content.
+					if (!isRecreated) {
+						RETURN_ON_BAD_HR(hr = RecreateFramePool(m_FramePoolState.Layout));
+					}
 					return GetNextFrame(timeoutMillis, pData);
 				}
 			}
@@ -553,16 +640,21 @@ HRESULT WindowsGraphicsCapture::GetNextFrame(_In_ DWORD timeoutMillis, _Inout_ G
 			D3D11_BOX sourceRegion;
 			RtlZeroMemory(&sourceRegion, sizeof(sourceRegion));
 			sourceRegion.left = 0;
-			sourceRegion.right = min(frame.ContentSize().Width, (int)desc.Width);
+			sourceRegion.right = min(min(contentSize.Width, (int)desc.Width), (int)surfaceDesc.Width);
 			sourceRegion.top = 0;
-			sourceRegion.bottom = min(frame.ContentSize().Height, (int)desc.Height);
+			sourceRegion.bottom = min(min(contentSize.Height, (int)desc.Height), (int)surfaceDesc.Height);
 			sourceRegion.front = 0;
 			sourceRegion.back = 1;
-			auto surfaceTexture = Graphics::Capture::Util::GetDXGIInterfaceFromObject<ID3D11Texture2D>(frame.Surface());
 			m_DeviceContext->CopySubresourceRegion(pData->Frame, 0, 0, 0, 0, surfaceTexture.get(), 0, &sourceRegion);
 			m_HaveDeliveredFirstFrame = true;
 			QueryPerformanceCounter(&pData->Timestamp);
-			frame.Close();
+			pData->PresentTime = presentTime;
+			holdTime = max<INT64>(holdTime, CloseFrame(frame));
+			m_Stats.DeliveredFrames++;
+			RETURN_ON_BAD_HR(hr = UpdateFramePool(contentSize, presentTime, holdTime, &isRecreated));
+			if (isResized && !isFirstResize && !isRecreated) {
+				m_Stats.AbsorbedResizes++;
+			}
 			hr = S_OK;
 		}
 		else {
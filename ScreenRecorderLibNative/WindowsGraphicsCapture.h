@@ -5,6 +5,7 @@
 #include <memory>
 #include "WindowsGraphicsCapture.util.h"
 #include "MouseManager.h"
+#include "FramePoolPolicy.h"
 class WindowsGraphicsCapture : public CaptureBase
 {
 public:
@@ -18,12 +19,25 @@ public:
 	virtual HRESULT GetNativeSize(_In_ RECORDING_SOURCE_BASE &recordingSource, _Out_ SIZE *nativeMediaSize) override;
 	virtual HRESULT GetMouse(_Inout_ PTR_INFO *pPtrInfo, _In_ RECT frameCoordinates, _In_ int offsetX, _In_ int offsetY) override;
 	virtual inline std::wstring Name() override { return L"WindowsGraphicsCapture"; };
+	FRAME_POOL_STATS GetStats();
 
 private:
 	void OnFrameArrived(winrt::Windows::Graphics::Capture::Direct3D11CaptureFramePool const &sender, winrt::Windows::Foundation::IInspectable const &args);
 	HRESULT GetNextFrame(_In_ DWORD timeoutMillis, _Inout_ GRAPHICS_FRAME_DATA *pData);
 	HRESULT GetCaptureItem(_In_ RECORDING_SOURCE_BASE &recordingSource, _Out_ winrt::Windows::Graphics::Capture::GraphicsCaptureItem *item);
-	HRESULT RecreateFramePool(_Inout_ GRAPHICS_FRAME_DATA *pData, _In_ winrt::Windows::Graphics::SizeInt32 newSize);
+	HRESULT RecreateFramePool(_In_ const FRAME_POOL_LAYOUT &layout);
+	/// <summary>
+	/// Returns the newest frame in the frame pool, and closes the frames before it. Frames only wait in the pool if it has more than one buffer.
+	/// </summary>
+	winrt::Windows::Graphics::Capture::Direct3D11CaptureFrame TryGetNewestFrame(_Out_ INT64 *pMaxHoldTime);
+	/// <summary>
+	/// Closes the frame, and returns how long it was held since it was presented.
+	/// </summary>
+	INT64 CloseFrame(_In_ winrt::Windows::Graphics::Capture::Direct3D11CaptureFrame const &frame);
+	/// <summary>
+	/// Passes a frame through FramePoolPolicy, and recreates the frame pool if the policy changes its size or buffer count.
+	/// </summary>
+	HRESULT UpdateFramePool(_In_ winrt::Windows::Graphics::SizeInt32 contentSize, _In_ INT64 presentTime, _In_ INT64 holdTime, _Out_ bool *pIsRecreated);
 	HRESULT ProcessRecordingTimeout(_Inout_ GRAPHICS_FRAME_DATA *pData);
 	bool IsRecordingSessionStale();
 	winrt::Windows::Graphics::Capture::GraphicsCaptureItem m_CaptureItem;
@@ -44,5 +58,9 @@ private:
 	LARGE_INTEGER m_QPCFrequency;
 	LARGE_INTEGER m_LastSampleReceivedTimeStamp;
 	LARGE_INTEGER m_LastCaptureSessionRestart;
+	FRAME_POOL_STATE m_FramePoolState;
+	FRAME_POOL_STATS m_Stats;
+	//Counted on the thread FrameArrived is raised on.
+	std::atomic<UINT64> m_ArrivedFrames;
 
 };
\ No newline at end of file
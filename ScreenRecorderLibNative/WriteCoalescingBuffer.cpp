@@ -0,0 +1,317 @@
+#include "WriteCoalescingBuffer.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct WriteCoalescingBuffer::Impl {
+	struct CHUNK {
+		int64_t Offset;
+		vector<uint8_t> Data;
+	};
+
+	Impl(IWriteCoalescingTarget *pTarget, size_t bufferSize, size_t maxPendingBuffers) :
+		m_pTarget(pTarget),
+		m_BufferSize(max<size_t>(bufferSize, 1)),
+		m_MaxPendingBuffers(max<size_t>(maxPendingBuffers, 1))
+	{
+		if (!m_pTarget->GetPosition(&m_Position) || !m_pTarget->GetLength(&m_Length)) {
+			m_Position = 0;
+			m_Length = 0;
+			m_HasFailed = true;
+		}
+		m_TargetPosition = m_Position;
+		m_ActiveOffset = m_Position;
+		m_Active.reserve(m_BufferSize);
+		m_WriterThread = thread([this]() { WriterLoop(); });
+	}
+
+	~Impl()
+	{
+		{
+			unique_lock<mutex> lock(m_Mutex);
+			Drain(lock);
+			m_IsStopping = true;
+		}
+		m_WorkAvailable.notify_all();
+		m_WriterThread.join();
+	}
+
+	/// <summary>
+	/// Queues a chunk for the writer thread, blocking while the queue is full.
+	/// </summary>
+	void Enqueue(unique_lock<mutex> &lock, int64_t offset, vector<uint8_t> &&data)
+	{
+		m_WorkDone.wait(lock, [this]() { return m_Pending.size() < m_MaxPendingBuffers || m_HasFailed; });
+		m_Pending.push_back(CHUNK{ offset, std::move(data) });
+		m_WorkAvailable.notify_one();
+	}
+
+	void SealActive(unique_lock<mutex> &lock)
+	{
+		if (m_Active.empty()) {
+			return;
+		}
+		int64_t offset = m_ActiveOffset;
+		vector<uint8_t> data = std::move(m_Active);
+		m_Active = TakeFreeBuffer();
+		Enqueue(lock, offset, std::move(data));
+	}
+
+	bool Drain(unique_lock<mutex> &lock)
+	{
+		SealActive(lock);
+		m_WorkDone.wait(lock, [this]() { return m_Pending.empty() && !m_IsWriting; });
+		return !m_HasFailed;
+	}
+
+	vector<uint8_t> TakeFreeBuffer()
+	{
+		vector<uint8_t> buffer;
+		if (!m_FreeBuffers.empty()) {
+			buffer = std::move(m_FreeBuffers.back());
+			m_FreeBuffers.pop_back();
+		}
+		buffer.clear();
+		buffer.reserve(m_BufferSize);
+		return buffer;
+	}
+
+	void WriterLoop()
+	{
+		unique_lock<mutex> lock(m_Mutex);
+		while (true) {
+			m_WorkAvailable.wait(lock, [this]() { return m_IsStopping || !m_Pending.empty(); });
+			if (m_Pending.empty()) {
+				break;
+			}
+			CHUNK chunk = std::move(m_Pending.front());
+			m_Pending.pop_front();
+			m_IsWriting = true;
+			bool hasFailed = m_HasFailed;
+			int64_t targetPosition = m_TargetPosition;
+			lock.unlock();
+
+			bool isSeeked = false;
+			bool isWritten = false;
+			//After a failed write the stream contents are undefined, so remaining chunks are discarded.
+			if (!hasFailed) {
+				bool isPositioned = true;
+				if (chunk.Offset != targetPosition) {
+					isSeeked = true;
+					isPositioned = m_pTarget->Seek(chunk.Offset);
+				}
+				isWritten = isPositioned && m_pTarget->Write(chunk.Data.data(), chunk.Data.size());
+			}
+
+			lock.lock();
+			if (isSeeked) {
+				m_Stats.TargetSeekCalls++;
+			}
+			if (!hasFailed) {
+				m_Stats.TargetWriteCalls++;
+			}
+			if (isWritten) {
+				m_TargetPosition = chunk.Offset + static_cast<int64_t>(chunk.Data.size());
+			}
+			else {
+				m_HasFailed = true;
+				m_TargetPosition = -1;
+			}
+			if (m_FreeBuffers.size() <= m_MaxPendingBuffers) {
+				chunk.Data.clear();
+				m_FreeBuffers.push_back(std::move(chunk.Data));
+			}
+			m_IsWriting = false;
+			m_WorkDone.notify_all();
+		}
+	}
+
+	IWriteCoalescingTarget *m_pTarget;
+	size_t m_BufferSize;
+	size_t m_MaxPendingBuffers;
+
+	mutex m_Mutex;
+	condition_variable m_WorkAvailable;
+	condition_variable m_WorkDone;
+	thread m_WriterThread;
+	deque<CHUNK> m_Pending;
+	vector<vector<uint8_t>> m_FreeBuffers;
+
+	//The buffer currently receiving writes, holding the stream bytes [m_ActiveOffset, m_ActiveOffset + m_Active.size()).
+	vector<uint8_t> m_Active;
+	int64_t m_ActiveOffset = 0;
+	//The position the client sees.
+	int64_t m_Position = 0;
+	int64_t m_Length = 0;
+	//The actual position of the target stream, or -1 if unknown.
+	int64_t m_TargetPosition = 0;
+
+	bool m_IsWriting = false;
+	bool m_IsStopping = false;
+	bool m_HasFailed = false;
+	WRITE_COALESCING_STATS m_Stats{};
+};
+
+WriteCoalescingBuffer::WriteCoalescingBuffer(IWriteCoalescingTarget *pTarget, size_t bufferSize, size_t maxPendingBuffers) :
+	m_Impl(make_unique<Impl>(pTarget, bufferSize, maxPendingBuffers))
+{
+}
+
+WriteCoalescingBuffer::~WriteCoalescingBuffer()
+{
+}
+
+bool WriteCoalescingBuffer::Write(const uint8_t *pData, size_t cb)
+{
+	Impl &impl = *m_Impl;
+	unique_lock<mutex> lock(impl.m_Mutex);
+	impl.m_Stats.WriteCalls++;
+	impl.m_Stats.BytesWritten += cb;
+	if (impl.m_HasFailed) {
+		return false;
+	}
+	if (cb == 0) {
+		return true;
+	}
+	int64_t activeEnd = impl.m_ActiveOffset + static_cast<int64_t>(impl.m_Active.size());
+	if (impl.m_Active.empty()) {
+		impl.m_ActiveOffset = impl.m_Position;
+	}
+	else if (impl.m_Position < impl.m_ActiveOffset || impl.m_Position > activeEnd) {
+		impl.SealActive(lock);
+		impl.m_ActiveOffset = impl.m_Position;
+	}
+
+	size_t consumed = 0;
+	size_t relativePosition = static_cast<size_t>(impl.m_Position - impl.m_ActiveOffset);
+	if (relativePosition < impl.m_Active.size()) {
+		consumed = min(cb, impl.m_Active.size() - relativePosition);
+		memcpy(impl.m_Active.data() + relativePosition, pData, consumed);
+		impl.m_Stats.PatchedWrites++;
+	}
+	size_t remaining = cb - consumed;
+	if (remaining > 0) {
+		if (impl.m_Active.size() + remaining > impl.m_BufferSize) {
+			impl.SealActive(lock);
+			impl.m_ActiveOffset = impl.m_Position + static_cast<int64_t>(consumed);
+		}
+		if (remaining >= impl.m_BufferSize) {
+			//Writes larger than the buffer are queued as-is, there is nothing to coalesce them with.
+			vector<uint8_t> data(pData + consumed, pData + cb);
+			impl.Enqueue(lock, impl.m_ActiveOffset, std::move(data));
+			impl.m_ActiveOffset = impl.m_Position + static_cast<int64_t>(cb);
+		}
+		else {
+			impl.m_Active.insert(impl.m_Active.end(), pData + consumed, pData + cb);
+		}
+	}
+	impl.m_Position += static_cast<int64_t>(cb);
+	impl.m_Length = max(impl.m_Length, impl.m_Position);
+	return !impl.m_HasFailed;
+}
+
+bool WriteCoalescingBuffer::Read(uint8_t *pData, size_t cb, size_t *pcbRead)
+{
+	Impl &impl = *m_Impl;
+	unique_lock<mutex> lock(impl.m_Mutex);
+	*pcbRead = 0;
+	if (!impl.Drain(lock)) {
+		return false;
+	}
+	if (impl.m_TargetPosition != impl.m_Position) {
+		impl.m_Stats.TargetSeekCalls++;
+		if (!impl.m_pTarget->Seek(impl.m_Position)) {
+			impl.m_TargetPosition = -1;
+			return false;
+		}
+		impl.m_TargetPosition = impl.m_Position;
+	}
+	size_t read = 0;
+	bool isSuccess = impl.m_pTarget->Read(pData, cb, &read);
+	if (!isSuccess) {
+		impl.m_TargetPosition = -1;
+		return false;
+	}
+	impl.m_Position += static_cast<int64_t>(read);
+	impl.m_TargetPosition = impl.m_Position;
+	*pcbRead = read;
+	return true;
+}
+
+bool WriteCoalescingBuffer::Seek(int64_t offset, WriteCoalescingSeekOrigin origin, int64_t *pNewPosition)
+{
+	Impl &impl = *m_Impl;
+	lock_guard<mutex> lock(impl.m_Mutex);
+	impl.m_Stats.SeekCalls++;
+	int64_t basePosition;
+	switch (origin)
+	{
+	case WriteCoalescingSeekOrigin::Begin:
+		basePosition = 0;
+		break;
+	case WriteCoalescingSeekOrigin::Current:
+		basePosition = impl.m_Position;
+		break;
+	case WriteCoalescingSeekOrigin::End:
+		basePosition = impl.m_Length;
+		break;
+	default:
+		return false;
+	}
+	int64_t newPosition = basePosition + offset;
+	if (newPosition < 0) {
+		return false;
+	}
+	//The target is not touched here. If the next write lands outside the buffered range, the buffer is flushed then.
+	impl.m_Position = newPosition;
+	if (pNewPosition) {
+		*pNewPosition = newPosition;
+	}
+	return true;
+}
+
+bool WriteCoalescingBuffer::SetLength(int64_t length)
+{
+	Impl &impl = *m_Impl;
+	unique_lock<mutex> lock(impl.m_Mutex);
+	if (length < 0 || !impl.Drain(lock)) {
+		return false;
+	}
+	if (!impl.m_pTarget->SetLength(length)) {
+		return false;
+	}
+	impl.m_Length = length;
+	//Shrinking a stream may move its position, so let the next flush re-establish it.
+	impl.m_TargetPosition = -1;
+	return true;
+}
+
+int64_t WriteCoalescingBuffer::GetLength()
+{
+	lock_guard<mutex> lock(m_Impl->m_Mutex);
+	return m_Impl->m_Length;
+}
+
+int64_t WriteCoalescingBuffer::GetPosition()
+{
+	lock_guard<mutex> lock(m_Impl->m_Mutex);
+	return m_Impl->m_Position;
+}
+
+bool WriteCoalescingBuffer::Flush()
+{
+	unique_lock<mutex> lock(m_Impl->m_Mutex);
+	return m_Impl->Drain(lock);
+}
+
+WRITE_COALESCING_STATS WriteCoalescingBuffer::GetStats()
+{
+	lock_guard<mutex> lock(m_Impl->m_Mutex);
+	return m_Impl->m_Stats;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+/// <summary>
+/// The stream a WriteCoalescingBuffer forwards coalesced writes to.
+/// Every call on this interface is assumed to be expensive, e.g. a managed/native transition.
+/// All positions are absolute byte offsets from the start of the stream.
+/// </summary>
+class IWriteCoalescingTarget {
+public:
+	virtual ~IWriteCoalescingTarget() {}
+	virtual bool Write(const uint8_t *pData, size_t cb) = 0;
+	virtual bool Read(uint8_t *pData, size_t cb, size_t *pcbRead) = 0;
+	virtual bool Seek(int64_t position) = 0;
+	virtual bool SetLength(int64_t length) = 0;
+	virtual bool GetLength(int64_t *pLength) = 0;
+	virtual bool GetPosition(int64_t *pPosition) = 0;
+};
+
+struct WRITE_COALESCING_STATS {
+	/// <summary>Write calls made by the client.</summary>
+	uint64_t WriteCalls = 0;
+	/// <summary>Seek calls made by the client.</summary>
+	uint64_t SeekCalls = 0;
+	/// <summary>Write calls forwarded to the target.</summary>
+	uint64_t TargetWriteCalls = 0;
+	/// <summary>Seek calls forwarded to the target.</summary>
+	uint64_t TargetSeekCalls = 0;
+	/// <summary>Client writes that overwrote data still held in the buffer, e.g. container header fix-ups.</summary>
+	uint64_t PatchedWrites = 0;
+	/// <summary>Total bytes written by the client.</summary>
+	uint64_t BytesWritten = 0;
+
+	uint64_t GetCallsSaved() const {
+		uint64_t clientCalls = WriteCalls + SeekCalls;
+		uint64_t targetCalls = TargetWriteCalls + TargetSeekCalls;
+		return clientCalls > targetCalls ? clientCalls - targetCalls : 0;
+	}
+};
+
+enum class WriteCoalescingSeekOrigin {
+	Begin = 0,
+	Current = 1,
+	End = 2
+};
+
+/// <summary>
+/// Collects many small writes and seeks into few large writes to an IWriteCoalescingTarget.
+/// Sequential writes are appended to a buffer, writes that land inside the buffered range are patched in place,
+/// and full buffers are handed to a background thread that writes them to the target in order.
+/// Seeks only move a logical position; the target is only seeked when a buffer is flushed to a different offset than where the target is.
+/// Reads, SetLength and Flush drain all pending writes before touching the target.
+/// </summary>
+class WriteCoalescingBuffer
+{
+public:
+	/// <param name="pTarget">The target stream. Must outlive this object. If its position or length can't be read, every call on the buffer fails.</param>
+	/// <param name="bufferSize">The size in bytes of each write buffer.</param>
+	/// <param name="maxPendingBuffers">The number of full buffers that may be queued for the background writer before Write blocks.</param>
+	WriteCoalescingBuffer(IWriteCoalescingTarget *pTarget, size_t bufferSize, size_t maxPendingBuffers = 4);
+	~WriteCoalescingBuffer();
+
+	bool Write(const uint8_t *pData, size_t cb);
+	bool Read(uint8_t *pData, size_t cb, size_t *pcbRead);
+	bool Seek(int64_t offset, WriteCoalescingSeekOrigin origin, int64_t *pNewPosition);
+	bool SetLength(int64_t length);
+	int64_t GetLength();
+	int64_t GetPosition();
+	/// <summary>
+	/// Blocks until all buffered data is written to the target.
+	/// </summary>
+	/// <returns>false if any write to the target has failed.</returns>
+	bool Flush();
+	WRITE_COALESCING_STATS GetStats();
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_Impl;
+};
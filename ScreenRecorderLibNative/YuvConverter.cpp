@@ -0,0 +1,416 @@
+#include "YuvConverter.h"
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define YUV_CONVERTER_SSE2
+#endif
+
+//The AVX2 kernels are compiled into every x86 build and only used when the CPU supports them.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define YUV_CONVERTER_AVX2
+#define YUV_AVX2_TARGET
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define YUV_CONVERTER_AVX2
+#define YUV_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+using namespace std;
+
+namespace {
+	const int COEFFICIENT_BITS = 13;
+	const int32_t ROUNDING = 1 << (COEFFICIENT_BITS - 1);
+
+	/// <summary>
+	/// The conversion in fixed point with COEFFICIENT_BITS fraction bits. Every channel is
+	/// ((Y - YOffset) * Y + ROUNDING + (U - 128) * U + (V - 128) * V) >> COEFFICIENT_BITS, clamped to 0-255.
+	/// The coefficients are small enough that each product fits in 16 bits by 16 bits, and each sum in 32 bits.
+	/// </summary>
+	struct YUV_COEFFICIENTS {
+		int16_t YOffset;
+		int16_t Y;
+		int16_t BU;
+		int16_t BV;
+		int16_t GU;
+		int16_t GV;
+		int16_t RU;
+		int16_t RV;
+	};
+
+	int16_t ToFixedPoint(double value)
+	{
+		return static_cast<int16_t>(lround(value * (1 << COEFFICIENT_BITS)));
+	}
+
+	YUV_COEFFICIENTS GetCoefficients(YuvColorMatrix matrix, YuvColorRange range)
+	{
+		double kr = matrix == YuvColorMatrix::BT709 ? 0.2126 : 0.299;
+		double kb = matrix == YuvColorMatrix::BT709 ? 0.0722 : 0.114;
+		double kg = 1.0 - kr - kb;
+		bool isLimited = range == YuvColorRange::Limited;
+		double yScale = isLimited ? 255.0 / 219.0 : 1.0;
+		double chromaScale = isLimited ? 255.0 / 224.0 : 1.0;
+
+		YUV_COEFFICIENTS coefficients{};
+		coefficients.YOffset = isLimited ? 16 : 0;
+		coefficients.Y = ToFixedPoint(yScale);
+		coefficients.BU = ToFixedPoint(2.0 * (1.0 - kb) * chromaScale);
+		coefficients.BV = 0;
+		coefficients.GU = ToFixedPoint(-2.0 * (1.0 - kb) * kb / kg * chromaScale);
+		coefficients.GV = ToFixedPoint(-2.0 * (1.0 - kr) * kr / kg * chromaScale);
+		coefficients.RU = 0;
+		coefficients.RV = ToFixedPoint(2.0 * (1.0 - kr) * chromaScale);
+		return coefficients;
+	}
+
+	inline uint8_t Clamp8(int32_t value)
+	{
+		return static_cast<uint8_t>(value < 0 ? 0 : value > 255 ? 255 : value);
+	}
+
+	inline void ConvertPixel(int32_t y, int32_t u, int32_t v, const YUV_COEFFICIENTS &c, uint8_t *bgra)
+	{
+		int32_t luma = (y - c.YOffset) * c.Y + ROUNDING;
+		u -= 128;
+		v -= 128;
+		bgra[0] = Clamp8((luma + u * c.BU + v * c.BV) >> COEFFICIENT_BITS);
+		bgra[1] = Clamp8((luma + u * c.GU + v * c.GV) >> COEFFICIENT_BITS);
+		bgra[2] = Clamp8((luma + u * c.RU + v * c.RV) >> COEFFICIENT_BITS);
+		bgra[3] = 0xFF;
+	}
+
+	void ConvertNV12RowScalar(const uint8_t *y, const uint8_t *uv, uint32_t first, uint32_t width, const YUV_COEFFICIENTS &c, uint8_t *bgra)
+	{
+		for (uint32_t x = first; x < width; x++) {
+			const uint8_t *chroma = uv + (x & ~1u);
+			ConvertPixel(y[x], chroma[0], chroma[1], c, bgra + x * 4);
+		}
+	}
+
+	void ConvertYUY2RowScalar(const uint8_t *yuy2, uint32_t first, uint32_t width, const YUV_COEFFICIENTS &c, uint8_t *bgra)
+	{
+		for (uint32_t x = first; x < width; x++) {
+			const uint8_t *pair = yuy2 + (x & ~1u) * 2;
+			ConvertPixel(yuy2[x * 2], pair[1], pair[3], c, bgra + x * 4);
+		}
+	}
+
+#ifdef YUV_CONVERTER_SSE2
+	struct SSE2_COEFFICIENTS {
+		__m128i YOffset;
+		__m128i ChromaOffset;
+		/// <summary>Y and ROUNDING, multiplied with Y and 1.</summary>
+		__m128i Luma;
+		/// <summary>Pairs of U and V coefficients, multiplied with the interleaved U and V samples.</summary>
+		__m128i Blue;
+		__m128i Green;
+		__m128i Red;
+	};
+
+	SSE2_COEFFICIENTS GetSse2Coefficients(const YUV_COEFFICIENTS &c)
+	{
+		SSE2_COEFFICIENTS sse;
+		sse.YOffset = _mm_set1_epi16(c.YOffset);
+		sse.ChromaOffset = _mm_set1_epi16(128);
+		sse.Luma = _mm_set1_epi32((ROUNDING << 16) | static_cast<uint16_t>(c.Y));
+		sse.Blue = _mm_set1_epi32((static_cast<uint16_t>(c.BV) << 16) | static_cast<uint16_t>(c.BU));
+		sse.Green = _mm_set1_epi32((static_cast<uint16_t>(c.GV) << 16) | static_cast<uint16_t>(c.GU));
+		sse.Red = _mm_set1_epi32((static_cast<uint16_t>(c.RV) << 16) | static_cast<uint16_t>(c.RU));
+		return sse;
+	}
+
+	/// <summary>
+	/// Returns 8 channel values as 16 bit integers. The chroma term is computed once for each pair of pixels that shares it.
+	/// </summary>
+	inline __m128i ConvertChannel(__m128i lumaLow, __m128i lumaHigh, __m128i chroma, __m128i coefficients)
+	{
+		__m128i chromaTerm = _mm_madd_epi16(chroma, coefficients);
+		__m128i low = _mm_add_epi32(lumaLow, _mm_shuffle_epi32(chromaTerm, _MM_SHUFFLE(1, 1, 0, 0)));
+		__m128i high = _mm_add_epi32(lumaHigh, _mm_shuffle_epi32(chromaTerm, _MM_SHUFFLE(3, 3, 2, 2)));
+		return _mm_packs_epi32(_mm_srai_epi32(low, COEFFICIENT_BITS), _mm_srai_epi32(high, COEFFICIENT_BITS));
+	}
+
+	/// <summary>
+	/// Converts 8 pixels.
+	/// </summary>
+	/// <param name="y">8 Y samples as 16 bit integers.</param>
+	/// <param name="chroma">4 interleaved pairs of U and V samples as 16 bit integers, one for each pair of pixels.</param>
+	inline void ConvertPixels8(__m128i y, __m128i chroma, const SSE2_COEFFICIENTS &c, uint8_t *bgra)
+	{
+		const __m128i one = _mm_set1_epi16(1);
+		y = _mm_sub_epi16(y, c.YOffset);
+		chroma = _mm_sub_epi16(chroma, c.ChromaOffset);
+		__m128i lumaLow = _mm_madd_epi16(_mm_unpacklo_epi16(y, one), c.Luma);
+		__m128i lumaHigh = _mm_madd_epi16(_mm_unpackhi_epi16(y, one), c.Luma);
+		__m128i b = ConvertChannel(lumaLow, lumaHigh, chroma, c.Blue);
+		__m128i g = ConvertChannel(lumaLow, lumaHigh, chroma, c.Green);
+		__m128i r = ConvertChannel(lumaLow, lumaHigh, chroma, c.Red);
+
+		__m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+		__m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_set1_epi8(-1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(bgra), _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(bgra + 16), _mm_unpackhi_epi16(bg, ra));
+	}
+
+	void ConvertNV12RowSse2(const uint8_t *y, const uint8_t *uv, uint32_t width, const YUV_COEFFICIENTS &c, const SSE2_COEFFICIENTS &sse, uint8_t *bgra)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		uint32_t x = 0;
+		for (; x + 8 <= width; x += 8) {
+			__m128i luma = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(y + x)), zero);
+			__m128i chroma = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(uv + x)), zero);
+			ConvertPixels8(luma, chroma, sse, bgra + x * 4);
+		}
+		ConvertNV12RowScalar(y, uv, x, width, c, bgra);
+	}
+
+	void ConvertYUY2RowSse2(const uint8_t *yuy2, uint32_t width, const YUV_COEFFICIENTS &c, const SSE2_COEFFICIENTS &sse, uint8_t *bgra)
+	{
+		const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+		uint32_t x = 0;
+		for (; x + 8 <= width; x += 8) {
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(yuy2 + x * 2));
+			ConvertPixels8(_mm_and_si128(pixels, lowBytes), _mm_srli_epi16(pixels, 8), sse, bgra + x * 4);
+		}
+		ConvertYUY2RowScalar(yuy2, x, width, c, bgra);
+	}
+#endif
+
+#ifdef YUV_CONVERTER_AVX2
+	struct AVX2_COEFFICIENTS {
+		__m256i YOffset;
+		__m256i ChromaOffset;
+		__m256i Luma;
+		__m256i Blue;
+		__m256i Green;
+		__m256i Red;
+	};
+
+	YUV_AVX2_TARGET AVX2_COEFFICIENTS GetAvx2Coefficients(const YUV_COEFFICIENTS &c)
+	{
+		AVX2_COEFFICIENTS avx;
+		avx.YOffset = _mm256_set1_epi16(c.YOffset);
+		avx.ChromaOffset = _mm256_set1_epi16(128);
+		avx.Luma = _mm256_set1_epi32((ROUNDING << 16) | static_cast<uint16_t>(c.Y));
+		avx.Blue = _mm256_set1_epi32((static_cast<uint16_t>(c.BV) << 16) | static_cast<uint16_t>(c.BU));
+		avx.Green = _mm256_set1_epi32((static_cast<uint16_t>(c.GV) << 16) | static_cast<uint16_t>(c.GU));
+		avx.Red = _mm256_set1_epi32((static_cast<uint16_t>(c.RV) << 16) | static_cast<uint16_t>(c.RU));
+		return avx;
+	}
+
+	YUV_AVX2_TARGET inline __m256i ConvertChannel(__m256i lumaLow, __m256i lumaHigh, __m256i chroma, __m256i coefficients)
+	{
+		__m256i chromaTerm = _mm256_madd_epi16(chroma, coefficients);
+		__m256i low = _mm256_add_epi32(lumaLow, _mm256_shuffle_epi32(chromaTerm, _MM_SHUFFLE(1, 1, 0, 0)));
+		__m256i high = _mm256_add_epi32(lumaHigh, _mm256_shuffle_epi32(chromaTerm, _MM_SHUFFLE(3, 3, 2, 2)));
+		return _mm256_packs_epi32(_mm256_srai_epi32(low, COEFFICIENT_BITS), _mm256_srai_epi32(high, COEFFICIENT_BITS));
+	}
+
+	/// <summary>
+	/// Converts 16 pixels, like ConvertPixels8. Each 128 bit lane holds 8 pixels, and the lanes are only combined when the pixels are stored.
+	/// </summary>
+	YUV_AVX2_TARGET inline void ConvertPixels16(__m256i y, __m256i chroma, const AVX2_COEFFICIENTS &c, uint8_t *bgra)
+	{
+		const __m256i one = _mm256_set1_epi16(1);
+		y = _mm256_sub_epi16(y, c.YOffset);
+		chroma = _mm256_sub_epi16(chroma, c.ChromaOffset);
+		__m256i lumaLow = _mm256_madd_epi16(_mm256_unpacklo_epi16(y, one), c.Luma);
+		__m256i lumaHigh = _mm256_madd_epi16(_mm256_unpackhi_epi16(y, one), c.Luma);
+		__m256i b = ConvertChannel(lumaLow, lumaHigh, chroma, c.Blue);
+		__m256i g = ConvertChannel(lumaLow, lumaHigh, chroma, c.Green);
+		__m256i r = ConvertChannel(lumaLow, lumaHigh, chroma, c.Red);
+
+		__m256i bg = _mm256_unpacklo_epi8(_mm256_packus_epi16(b, b), _mm256_packus_epi16(g, g));
+		__m256i ra = _mm256_unpacklo_epi8(_mm256_packus_epi16(r, r), _mm256_set1_epi8(-1));
+		__m256i low = _mm256_unpacklo_epi16(bg, ra);
+		__m256i high = _mm256_unpackhi_epi16(bg, ra);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(bgra), _mm256_permute2x128_si256(low, high, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(bgra + 32), _mm256_permute2x128_si256(low, high, 0x31));
+	}
+
+	YUV_AVX2_TARGET void ConvertNV12RowAvx2(const uint8_t *y, const uint8_t *uv, uint32_t width, const YUV_COEFFICIENTS &c, const AVX2_COEFFICIENTS &avx, uint8_t *bgra)
+	{
+		uint32_t x = 0;
+		for (; x + 16 <= width; x += 16) {
+			__m256i luma = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x)));
+			__m256i chroma = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(uv + x)));
+			ConvertPixels16(luma, chroma, avx, bgra + x * 4);
+		}
+		ConvertNV12RowScalar(y, uv, x, width, c, bgra);
+	}
+
+	YUV_AVX2_TARGET void ConvertYUY2RowAvx2(const uint8_t *yuy2, uint32_t width, const YUV_COEFFICIENTS &c, const AVX2_COEFFICIENTS &avx, uint8_t *bgra)
+	{
+		const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+		uint32_t x = 0;
+		for (; x + 16 <= width; x += 16) {
+			__m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(yuy2 + x * 2));
+			ConvertPixels16(_mm256_and_si256(pixels, lowBytes), _mm256_srli_epi16(pixels, 8), avx, bgra + x * 4);
+		}
+		ConvertYUY2RowScalar(yuy2, x, width, c, bgra);
+	}
+
+	YUV_AVX2_TARGET void ConvertAvx2(const YUV_IMAGE &image, const YUV_COEFFICIENTS &c, uint8_t *bgra, uint32_t bgraPitch)
+	{
+		AVX2_COEFFICIENTS avx = GetAvx2Coefficients(c);
+		for (uint32_t row = 0; row < image.Height; row++) {
+			uint8_t *output = bgra + static_cast<size_t>(row) * bgraPitch;
+			const uint8_t *data = image.Data + static_cast<size_t>(row) * image.Pitch;
+			if (image.Format == YuvFormat::NV12) {
+				ConvertNV12RowAvx2(data, image.ChromaData + static_cast<size_t>(row / 2) * image.ChromaPitch, image.Width, c, avx, output);
+			}
+			else {
+				ConvertYUY2RowAvx2(data, image.Width, c, avx, output);
+			}
+		}
+		_mm256_zeroupper();
+	}
+
+	bool IsAvx2Supported()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		const int osxsave = 1 << 27;
+		const int avx = 1 << 28;
+		if ((info[2] & (osxsave | avx)) != (osxsave | avx)) {
+			return false;
+		}
+		//The OS must save the upper halves of the YMM registers on context switches.
+		if ((_xgetbv(0) & 6) != 6) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	YuvKernel GetBestKernel()
+	{
+#ifdef YUV_CONVERTER_AVX2
+		static const bool isAvx2Supported = IsAvx2Supported();
+		if (isAvx2Supported) {
+			return YuvKernel::Avx2;
+		}
+#endif
+#ifdef YUV_CONVERTER_SSE2
+		return YuvKernel::Sse2;
+#else
+		return YuvKernel::Scalar;
+#endif
+	}
+}
+
+size_t GetYuvBufferSize(YuvFormat format, uint32_t height, uint32_t pitch)
+{
+	size_t size = static_cast<size_t>(height) * pitch;
+	if (format == YuvFormat::NV12) {
+		size += static_cast<size_t>((height + 1) / 2) * pitch;
+	}
+	return size;
+}
+
+YUV_IMAGE MakeYuvImage(YuvFormat format, uint32_t width, uint32_t height, const uint8_t *pData, uint32_t pitch)
+{
+	YUV_IMAGE image;
+	image.Format = format;
+	image.Width = width;
+	image.Height = height;
+	image.Data = pData;
+	image.Pitch = pitch;
+	if (format == YuvFormat::NV12) {
+		image.ChromaData = pData + static_cast<size_t>(height) * pitch;
+		image.ChromaPitch = pitch;
+	}
+	return image;
+}
+
+bool IsYuvKernelSupported(YuvKernel kernel)
+{
+	switch (kernel)
+	{
+	case YuvKernel::Auto:
+	case YuvKernel::Scalar:
+		return true;
+	case YuvKernel::Sse2:
+#ifdef YUV_CONVERTER_SSE2
+		return true;
+#else
+		return false;
+#endif
+	case YuvKernel::Avx2:
+		return GetBestKernel() == YuvKernel::Avx2;
+	default:
+		return false;
+	}
+}
+
+bool ConvertYuvToBgra(const YUV_IMAGE &image, YuvColorMatrix matrix, YuvColorRange range, uint8_t *bgra, uint32_t bgraPitch, YuvKernel kernel)
+{
+	if (image.Width == 0 || image.Height == 0 || !image.Data || !bgra || bgraPitch < image.Width * 4) {
+		return false;
+	}
+	if (image.Format == YuvFormat::NV12) {
+		if (image.Pitch < image.Width || !image.ChromaData || image.ChromaPitch < ((image.Width + 1) & ~1u)) {
+			return false;
+		}
+	}
+	else if (image.Format == YuvFormat::YUY2) {
+		if (image.Pitch < ((image.Width + 1) & ~1u) * 2) {
+			return false;
+		}
+	}
+	else {
+		return false;
+	}
+	if (!IsYuvKernelSupported(kernel)) {
+		return false;
+	}
+	if (kernel == YuvKernel::Auto) {
+		kernel = GetBestKernel();
+	}
+
+	YUV_COEFFICIENTS c = GetCoefficients(matrix, range);
+#ifdef YUV_CONVERTER_AVX2
+	if (kernel == YuvKernel::Avx2) {
+		ConvertAvx2(image, c, bgra, bgraPitch);
+		return true;
+	}
+#endif
+#ifdef YUV_CONVERTER_SSE2
+	SSE2_COEFFICIENTS sse = GetSse2Coefficients(c);
+#endif
+	for (uint32_t row = 0; row < image.Height; row++) {
+		uint8_t *output = bgra + static_cast<size_t>(row) * bgraPitch;
+		const uint8_t *data = image.Data + static_cast<size_t>(row) * image.Pitch;
+		const uint8_t *chroma = image.Format == YuvFormat::NV12 ? image.ChromaData + static_cast<size_t>(row / 2) * image.ChromaPitch : nullptr;
+#ifdef YUV_CONVERTER_SSE2
+		if (kernel == YuvKernel::Sse2) {
+			if (chroma) {
+				ConvertNV12RowSse2(data, chroma, image.Width, c, sse, output);
+			}
+			else {
+				ConvertYUY2RowSse2(data, image.Width, c, sse, output);
+			}
+			continue;
+		}
+#endif
+		if (chroma) {
+			ConvertNV12RowScalar(data, chroma, 0, image.Width, c, output);
+		}
+		else {
+			ConvertYUY2RowScalar(data, 0, image.Width, c, output);
+		}
+	}
+	return true;
+}
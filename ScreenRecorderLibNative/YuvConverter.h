@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+//Converts the YUV formats cameras deliver natively to Bgra32, so camera frames don't need a Media Foundation color converter.
+//Like CursorShape.h, it doesn't depend on any platform API, so it can be tested on any platform.
+//
+//All kernels use the same 13 bit fixed point arithmetic, so they give exactly the same result.
+//Chroma is sampled from the nearest chroma sample, without interpolation.
+
+enum class YuvFormat : uint32_t {
+	/// <summary>A plane of 8 bit Y, followed by a plane of interleaved 8 bit U and V at half width and half height.</summary>
+	NV12 = 1,
+	/// <summary>Packed Y0 U Y1 V, with one U and V sample for each pair of pixels.</summary>
+	YUY2 = 2
+};
+
+enum class YuvColorMatrix : uint32_t {
+	/// <summary>ITU-R BT.601, used by most webcams and by JPEG.</summary>
+	BT601 = 0,
+	/// <summary>ITU-R BT.709, used by HD video.</summary>
+	BT709 = 1
+};
+
+enum class YuvColorRange : uint32_t {
+	/// <summary>Y from 16 to 235, and U and V from 16 to 240.</summary>
+	Limited = 0,
+	/// <summary>Y, U and V from 0 to 255.</summary>
+	Full = 1
+};
+
+enum class YuvKernel : uint32_t {
+	/// <summary>The fastest kernel the CPU supports.</summary>
+	Auto = 0,
+	Scalar = 1,
+	Sse2 = 2,
+	Avx2 = 3
+};
+
+struct YUV_IMAGE {
+	YuvFormat Format = YuvFormat::NV12;
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	/// <summary>The Y plane for NV12, or the packed pixels for YUY2.</summary>
+	const uint8_t *Data = nullptr;
+	/// <summary>The number of bytes per row of Data.</summary>
+	uint32_t Pitch = 0;
+	/// <summary>The interleaved UV plane for NV12. Unused for YUY2.</summary>
+	const uint8_t *ChromaData = nullptr;
+	/// <summary>The number of bytes per row of ChromaData.</summary>
+	uint32_t ChromaPitch = 0;
+};
+
+/// <summary>
+/// Returns the number of bytes an image of the format takes when its planes are stored back to back with the same pitch, as in a Media Foundation buffer.
+/// </summary>
+size_t GetYuvBufferSize(YuvFormat format, uint32_t height, uint32_t pitch);
+/// <summary>
+/// Fills in an image whose planes are stored back to back with the same pitch, starting at pData.
+/// </summary>
+YUV_IMAGE MakeYuvImage(YuvFormat format, uint32_t width, uint32_t height, const uint8_t *pData, uint32_t pitch);
+bool IsYuvKernelSupported(YuvKernel kernel);
+/// <summary>
+/// Converts the image to opaque Bgra32 pixels.
+/// </summary>
+/// <param name="bgra">Receives Height rows of Width * 4 bytes.</param>
+/// <param name="bgraPitch">The number of bytes per row of bgra.</param>
+/// <param name="kernel">The implementation to use. Other than Auto it is only meant for testing.</param>
+/// <returns>false if the image is empty, its pitch is too small, or the kernel is not supported by the CPU.</returns>
+bool ConvertYuvToBgra(const YUV_IMAGE &image, YuvColorMatrix matrix, YuvColorRange range, uint8_t *bgra, uint32_t bgraPitch, YuvKernel kernel = YuvKernel::Auto);
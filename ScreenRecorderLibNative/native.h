@@ -1,6 +1,6 @@
 #pragma once
 #include "RecordingManager.h"
-#include "fifo_map.h"
+#include "FrameManifest.h"
 #include "DX.util.h"
 #include "MF.util.h"
 #include "CoreAudio.util.h"
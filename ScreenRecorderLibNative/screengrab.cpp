@@ -260,12 +260,91 @@ HRESULT __cdecl SaveWICTextureToWicStream(
 	if (!pStream)
 		return E_INVALIDARG;
 
+	return ReadTextureBitmap(pContext, pSource, [&](const BYTE *pData, UINT rowPitch, const D3D11_TEXTURE2D_DESC &desc) {
+		return SaveWICBitmapToWicStream(pData, rowPitch, desc.Width, desc.Height, desc.Format, guidContainerFormat, pStream, destSize, targetFormat, setCustomProps);
+	});
+}
+
+HRESULT __cdecl ReadTextureBitmap(
+	_In_ ID3D11DeviceContext *pContext,
+	_In_ ID3D11Resource *pSource,
+	_In_ std::function<HRESULT(const BYTE *pData, UINT rowPitch, const D3D11_TEXTURE2D_DESC &desc)> readBitmap)
+{
+	if (!readBitmap)
+		return E_INVALIDARG;
+
 	D3D11_TEXTURE2D_DESC desc = {};
 	CComPtr<ID3D11Texture2D> pStaging;
 	HRESULT hr = CaptureTexture(pContext, pSource, desc, pStaging);
 	if (FAILED(hr))
 		return hr;
 
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	hr = pContext->Map(pStaging, 0, D3D11_MAP_READ, 0, &mapped);
+	if (FAILED(hr))
+		return hr;
+
+	hr = readBitmap(reinterpret_cast<const BYTE *>(mapped.pData), mapped.RowPitch, desc);
+	pContext->Unmap(pStaging, 0);
+	return hr;
+}
+
+HRESULT __cdecl SaveWICBitmapToFile(
+	_In_ const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_ DXGI_FORMAT format,
+	_In_ REFGUID guidContainerFormat,
+	_In_z_ const wchar_t *filePath,
+	_In_opt_ const std::optional<SIZE> destSize,
+	_In_opt_ const GUID *targetFormat,
+	_In_opt_ std::function<void(IPropertyBag2 *)> setCustomProps)
+{
+	if (!filePath)
+		return E_INVALIDARG;
+
+	CComPtr<IWICImagingFactory> pWIC = _GetWIC();
+	if (!pWIC)
+		return E_NOINTERFACE;
+
+	CComPtr<IWICStream> wicStream;
+	HRESULT hr = pWIC->CreateStream(&wicStream);
+	if (FAILED(hr))
+		return hr;
+
+	hr = wicStream->InitializeFromFilename(filePath, GENERIC_WRITE);
+	if (FAILED(hr))
+		return hr;
+	hr = SaveWICBitmapToWicStream(pData, rowPitch, width, height, format, guidContainerFormat, wicStream, destSize, targetFormat, setCustomProps);
+	if (FAILED(hr)) {
+		wicStream.Release();
+		DeleteFileW(filePath);
+	}
+	return hr;
+}
+
+HRESULT __cdecl SaveWICBitmapToWicStream(
+	_In_ const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_ DXGI_FORMAT format,
+	_In_ REFGUID guidContainerFormat,
+	_Inout_ IWICStream *pStream,
+	_In_opt_ const std::optional<SIZE> destSize,
+	_In_opt_ const GUID *targetFormat,
+	_In_opt_ std::function<void(IPropertyBag2 *)> setCustomProps)
+{
+	if (!pData || !pStream)
+		return E_INVALIDARG;
+
+	HRESULT hr = S_OK;
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = width;
+	desc.Height = height;
+	desc.Format = format;
+
 	// Determine source format's WIC equivalent
 	WICPixelFormatGUID pfGuid;
 	bool sRGB = false;
@@ -461,21 +540,12 @@ HRESULT __cdecl SaveWICTextureToWicStream(
 		}
 	}
 
-	D3D11_MAPPED_SUBRESOURCE mapped;
-	hr = pContext->Map(pStaging, 0, D3D11_MAP_READ, 0, &mapped);
-	if (FAILED(hr))
-		return hr;
-
-
 	CComPtr<IWICBitmap> source;
 	hr = pWIC->CreateBitmapFromMemory(desc.Width, desc.Height, pfGuid,
-		mapped.RowPitch, mapped.RowPitch * desc.Height,
-		reinterpret_cast<BYTE *>(mapped.pData), &source);
+		rowPitch, rowPitch * desc.Height,
+		const_cast<BYTE *>(pData), &source);
 	if (FAILED(hr))
-	{
-		pContext->Unmap(pStaging, 0);
 		return hr;
-	}
 	CComPtr<IWICBitmapScaler> bitmapScaler;
 	hr = pWIC->CreateBitmapScaler(&bitmapScaler);
 	if (FAILED(hr))
@@ -494,10 +564,7 @@ HRESULT __cdecl SaveWICTextureToWicStream(
 		CComPtr<IWICFormatConverter> FC;
 		hr = pWIC->CreateFormatConverter(&FC);
 		if (FAILED(hr))
-		{
-			pContext->Unmap(pStaging, 0);
 			return hr;
-		}
 
 		BOOL canConvert = FALSE;
 		hr = FC->CanConvert(pfGuid, targetGuid, &canConvert);
@@ -508,16 +575,12 @@ HRESULT __cdecl SaveWICTextureToWicStream(
 
 		hr = FC->Initialize(imageSource, targetGuid, WICBitmapDitherTypeNone, 0, 0, WICBitmapPaletteTypeMedianCut);
 		if (FAILED(hr))
-		{
-			pContext->Unmap(pStaging, 0);
 			return hr;
-		}
 		imageSource.Release();
 		imageSource = FC;
 	}
 
 	hr = frame->WriteSource(imageSource, NULL);
-	pContext->Unmap(pStaging, 0);
 	if (FAILED(hr))
 		return hr;
 
@@ -33,6 +33,41 @@ HRESULT __cdecl SaveWICTextureToWicStream(
 	_In_opt_ const GUID *targetFormat = nullptr,
 	_In_opt_ std::function<void __cdecl(IPropertyBag2 *)> setCustomProps = nullptr);
 
+/// <summary>
+/// Copies the texture to a staging texture, and calls readBitmap with the mapped bitmap. The bitmap is only valid during the call.
+/// </summary>
+HRESULT __cdecl ReadTextureBitmap(
+	_In_ ID3D11DeviceContext *pContext,
+	_In_ ID3D11Resource *pSource,
+	_In_ std::function<HRESULT(const BYTE *pData, UINT rowPitch, const D3D11_TEXTURE2D_DESC &desc)> readBitmap);
+
+/// <summary>
+/// Encodes a bitmap in memory, e.g. a mapped staging texture, without touching the device. Safe to call from any thread.
+/// </summary>
+HRESULT __cdecl SaveWICBitmapToFile(
+	_In_ const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_ DXGI_FORMAT format,
+	_In_ REFGUID guidContainerFormat,
+	_In_z_ const wchar_t *filePath,
+	_In_opt_ const std::optional<SIZE> destSize = std::nullopt,
+	_In_opt_ const GUID *targetFormat = nullptr,
+	_In_opt_ std::function<void __cdecl(IPropertyBag2 *)> setCustomProps = nullptr);
+
+HRESULT __cdecl SaveWICBitmapToWicStream(
+	_In_ const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_ DXGI_FORMAT format,
+	_In_ REFGUID guidContainerFormat,
+	_In_ IWICStream *pStream,
+	_In_opt_ const std::optional<SIZE> destSize = std::nullopt,
+	_In_opt_ const GUID *targetFormat = nullptr,
+	_In_opt_ std::function<void __cdecl(IPropertyBag2 *)> setCustomProps = nullptr);
+
 HRESULT CreateWICBitmapFromFile(
 	_In_z_ const wchar_t *filePath,
 	_In_ const GUID targetFormat,
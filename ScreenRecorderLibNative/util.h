@@ -157,6 +157,26 @@ inline double HundredNanosToSeconds(INT64 hundredNanos) {
 	return (double)hundredNanos / 10 / 1000 / 1000;
 }
 /// <summary>
+/// Converts a performance counter value, such as a QueryPerformanceCounter result or a DXGI LastMouseUpdateTime, to 100 nanosecond units.
+/// </summary>
+inline INT64 PerformanceCounterToHundredNanos(LONGLONG counter) {
+	static const LONGLONG frequency = []() {
+		LARGE_INTEGER value;
+		QueryPerformanceFrequency(&value);
+		return value.QuadPart;
+	}();
+	//Split in whole seconds and the rest, so the multiplication doesn't overflow.
+	return (counter / frequency) * 10000000 + (counter % frequency) * 10000000 / frequency;
+}
+/// <summary>
+/// Returns the performance counter in 100 nanosecond units. Mouse events and frames are timed with it, so they can be matched with each other.
+/// </summary>
+inline INT64 GetPerformanceCounterTime() {
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return PerformanceCounterToHundredNanos(counter.QuadPart);
+}
+/// <summary>
 /// Forces the dimensions of rect to be even by adding 1*modifier pixel if odd.
 /// </summary>
 inline RECT MakeRectEven(_In_ RECT &rect, _In_ int modifier = -1)
@@ -2,6 +2,7 @@
 using System.Collections.Generic;
 using System.Diagnostics;
 using System.IO;
+using System.IO.MemoryMappedFiles;
 using System.Linq;
 using System.Net;
 using System.Threading;
@@ -28,8 +29,10 @@ namespace ScreenRecorderLib
             switch (format)
             {
                 case ImageFormat.PNG:
+                case ImageFormat.FastPNG:
                     return "PNG";
                 case ImageFormat.JPEG:
+                case ImageFormat.FastJPEG:
                     return "JPEG";
                 case ImageFormat.TIFF:
                     return "TIFF";
@@ -319,6 +322,700 @@ namespace ScreenRecorderLib
             }
         }
 
+        [TestMethod]
+        public void RecordingToStreamWithWriteBuffer()
+        {
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            try
+            {
+                using (var outStream = File.Open(filePath, FileMode.Create, FileAccess.ReadWrite, FileShare.Read))
+                {
+                    RecorderOptions options = RecorderOptions.DefaultMainMonitor;
+                    options.OutputOptions = new OutputOptions { StreamWriteBufferSize = 256 * 1024 };
+                    using (var rec = Recorder.CreateRecorder(options))
+                    {
+                        string error = "";
+                        bool isError = false;
+                        bool isComplete = false;
+                        ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                        ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
+                        rec.OnRecordingComplete += (s, args) =>
+                        {
+                            isComplete = true;
+                            finalizeResetEvent.Set();
+                        };
+                        rec.OnRecordingFailed += (s, args) =>
+                        {
+                            isError = true;
+                            error = args.Error;
+                            finalizeResetEvent.Set();
+                            recordingResetEvent.Set();
+                        };
+                        rec.OnFrameRecorded += (s, args) =>
+                        {
+                            if (args.FrameNumber == 10)
+                            {
+                                recordingResetEvent.Set();
+                            }
+                        };
+                        rec.Record(outStream);
+                        recordingResetEvent.WaitOne(DefaultMaxRecordingLengthMillis);
+                        rec.Stop();
+                        finalizeResetEvent.WaitOne(5000);
+                        //All buffered data must have reached the stream when the recording completes.
+                        long lengthOnComplete = outStream.Length;
+                        outStream.Flush();
+                        Assert.IsFalse(isError, error);
+                        Assert.IsTrue(isComplete);
+                        Assert.AreNotEqual(lengthOnComplete, 0);
+                        Assert.AreEqual(lengthOnComplete, outStream.Length);
+
+                        var mediaInfo = new MediaInfoWrapper(filePath);
+                        Assert.IsTrue(mediaInfo.Format == "MPEG-4");
+                        Assert.IsTrue(mediaInfo.VideoStreams.Count > 0);
+                    }
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+            }
+        }
+
+        [TestMethod]
+        public void RecordingBackToBackWhileFinalizing()
+        {
+            string firstFilePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            string secondFilePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            try
+            {
+                using (var rec = Recorder.CreateRecorder(RecorderOptions.DefaultMainMonitor))
+                {
+                    string error = "";
+                    bool isError = false;
+                    var completedPaths = new System.Collections.Concurrent.ConcurrentBag<string>();
+                    CountdownEvent finalizeCountdown = new CountdownEvent(2);
+                    ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        completedPaths.Add(args.FilePath);
+                        finalizeCountdown.Signal();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeCountdown.Signal();
+                        recordingResetEvent.Set();
+                    };
+                    rec.OnFrameRecorded += (s, args) =>
+                    {
+                        if (args.FrameNumber == 10)
+                        {
+                            recordingResetEvent.Set();
+                        }
+                    };
+                    rec.Record(firstFilePath);
+                    recordingResetEvent.WaitOne(DefaultMaxRecordingLengthMillis);
+                    rec.Stop();
+                    //The first recording is finalized in the background, so the recorder accepts a new recording as soon as it leaves the recording state.
+                    var stopwatch = Stopwatch.StartNew();
+                    while (rec.Status == RecorderStatus.Recording && stopwatch.ElapsedMilliseconds < 5000)
+                    {
+                        Thread.Sleep(10);
+                    }
+                    recordingResetEvent.Reset();
+                    rec.Record(secondFilePath);
+                    recordingResetEvent.WaitOne(DefaultMaxRecordingLengthMillis);
+                    rec.Stop();
+                    finalizeCountdown.Wait(10000);
+                    Assert.IsFalse(isError, error);
+                    Assert.AreEqual(2, completedPaths.Count);
+                    CollectionAssert.AreEquivalent(new[] { firstFilePath, secondFilePath }, completedPaths.ToArray());
+                    foreach (string path in completedPaths)
+                    {
+                        var mediaInfo = new MediaInfoWrapper(path);
+                        Assert.IsTrue(mediaInfo.Format == "MPEG-4");
+                        Assert.IsTrue(mediaInfo.VideoStreams.Count > 0);
+                    }
+                }
+            }
+            finally
+            {
+                File.Delete(firstFilePath);
+                File.Delete(secondFilePath);
+            }
+        }
+
+        [TestMethod]
+        public void RecordingWarmStartupLatency()
+        {
+            var filePaths = new List<string>();
+            try
+            {
+                using (var rec = Recorder.CreateRecorder(RecorderOptions.DefaultMainMonitor))
+                {
+                    TimeSpan RecordAndGetStartupLatency()
+                    {
+                        string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+                        filePaths.Add(filePath);
+                        string error = "";
+                        bool isError = false;
+                        ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
+                        ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                        EventHandler<RecordingCompleteEventArgs> onComplete = (s, args) => finalizeResetEvent.Set();
+                        EventHandler<RecordingFailedEventArgs> onFailed = (s, args) =>
+                        {
+                            isError = true;
+                            error = args.Error;
+                            finalizeResetEvent.Set();
+                            recordingResetEvent.Set();
+                        };
+                        EventHandler<FrameRecordedEventArgs> onFrame = (s, args) =>
+                        {
+                            if (args.FrameNumber == 5)
+                            {
+                                recordingResetEvent.Set();
+                            }
+                        };
+                        rec.OnRecordingComplete += onComplete;
+                        rec.OnRecordingFailed += onFailed;
+                        rec.OnFrameRecorded += onFrame;
+                        try
+                        {
+                            rec.Record(filePath);
+                            recordingResetEvent.WaitOne(DefaultMaxRecordingLengthMillis);
+                            rec.Stop();
+                            finalizeResetEvent.WaitOne(5000);
+                        }
+                        finally
+                        {
+                            rec.OnRecordingComplete -= onComplete;
+                            rec.OnRecordingFailed -= onFailed;
+                            rec.OnFrameRecorded -= onFrame;
+                        }
+                        Assert.IsFalse(isError, error);
+                        Assert.IsTrue(rec.LastStartupLatency.HasValue);
+                        return rec.LastStartupLatency.Value;
+                    }
+
+                    Assert.IsFalse(rec.IsWarm);
+                    TimeSpan coldLatency = RecordAndGetStartupLatency();
+                    Assert.IsTrue(rec.Warm());
+                    Assert.IsTrue(rec.IsWarm);
+                    TimeSpan firstWarmLatency = RecordAndGetStartupLatency();
+                    TimeSpan secondWarmLatency = RecordAndGetStartupLatency();
+                    Assert.IsTrue(rec.IsWarm);
+                    //The fastest warm start is compared, so a single slow start on a busy machine doesn't fail the test.
+                    TimeSpan warmLatency = firstWarmLatency < secondWarmLatency ? firstWarmLatency : secondWarmLatency;
+                    Assert.IsTrue(warmLatency <= coldLatency, $"Warm startup took {warmLatency.TotalMilliseconds:F2} ms, cold startup took {coldLatency.TotalMilliseconds:F2} ms");
+                    rec.Cool();
+                    Assert.IsFalse(rec.IsWarm);
+                    RecordAndGetStartupLatency();
+                }
+                foreach (string path in filePaths)
+                {
+                    var mediaInfo = new MediaInfoWrapper(path);
+                    Assert.IsTrue(mediaInfo.Format == "MPEG-4");
+                    Assert.IsTrue(mediaInfo.VideoStreams.Count > 0);
+                }
+            }
+            finally
+            {
+                foreach (string path in filePaths)
+                {
+                    File.Delete(path);
+                }
+            }
+        }
+
+        [TestMethod]
+        public void RecordingWithSegmentedOutput()
+        {
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            string manifestPath = Path.ChangeExtension(filePath, ".m3u8");
+            List<FrameData> segments = new List<FrameData>();
+            try
+            {
+                RecorderOptions options = RecorderOptions.DefaultMainMonitor;
+                options.OutputOptions = new OutputOptions
+                {
+                    SegmentDurationMillis = 1000,
+                    SegmentManifestFormat = SegmentManifestFormat.M3U8
+                };
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+                    ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        isComplete = true;
+                        segments = args.FrameInfos;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.Record(filePath);
+                    Thread.Sleep(3500);
+                    rec.Stop();
+                    finalizeResetEvent.WaitOne(5000);
+
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                    Assert.IsTrue(segments.Count > 1);
+                    Assert.AreEqual(filePath, segments[0].Path);
+                    foreach (FrameData segment in segments)
+                    {
+                        Assert.IsTrue(File.Exists(segment.Path));
+                        var mediaInfo = new MediaInfoWrapper(segment.Path);
+                        Assert.IsTrue(mediaInfo.Format == "MPEG-4");
+                        Assert.IsTrue(mediaInfo.VideoStreams.Count > 0);
+                    }
+                    Assert.IsTrue(File.Exists(manifestPath));
+                    string manifest = File.ReadAllText(manifestPath);
+                    Assert.IsTrue(manifest.Contains("#EXT-X-ENDLIST"));
+                    foreach (FrameData segment in segments)
+                    {
+                        Assert.IsTrue(manifest.Contains(Path.GetFileName(segment.Path)));
+                    }
+                }
+            }
+            finally
+            {
+                foreach (FrameData segment in segments)
+                {
+                    File.Delete(segment.Path);
+                }
+                File.Delete(filePath);
+                File.Delete(manifestPath);
+            }
+        }
+
+        [TestMethod]
+        public void RecordingWithReplayBuffer()
+        {
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            string replayPath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            try
+            {
+                RecorderOptions options = RecorderOptions.DefaultMainMonitor;
+                options.OutputOptions = new OutputOptions { ReplayBufferDurationMillis = 2000 };
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+                    ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        isComplete = true;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.Record(filePath);
+                    Thread.Sleep(5000);
+                    //Nothing is written to the output until the recording stops.
+                    Assert.IsTrue(!File.Exists(filePath) || new FileInfo(filePath).Length == 0);
+                    Assert.IsTrue(rec.SaveReplay(replayPath));
+                    Thread.Sleep(1000);
+                    rec.Stop();
+                    finalizeResetEvent.WaitOne(5000);
+
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                    foreach (string path in new[] { replayPath, filePath })
+                    {
+                        var mediaInfo = new MediaInfoWrapper(path);
+                        Assert.IsTrue(mediaInfo.Format == "MPEG-4");
+                        Assert.IsTrue(mediaInfo.VideoStreams.Count > 0);
+                        //The buffer holds at least the buffer duration, plus up to one keyframe interval.
+                        Assert.IsTrue(mediaInfo.Duration >= 1500, $"Replay duration {mediaInfo.Duration} ms is too short");
+                        Assert.IsTrue(mediaInfo.Duration < 4000, $"Replay duration {mediaInfo.Duration} ms is too long");
+                    }
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+                File.Delete(replayPath);
+            }
+        }
+
+        [TestMethod]
+        public void RecordingWithRateLimitedFramePreview()
+        {
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            try
+            {
+                RecorderOptions options = RecorderOptions.DefaultMainMonitor;
+                options.VideoEncoderOptions = new VideoEncoderOptions { IsFixedFramerate = true, Framerate = 30 };
+                options.OutputOptions = new OutputOptions { IsVideoFramePreviewEnabled = true, VideoFramePreviewSize = new ScreenSize(0, 150), VideoFramePreviewFps = 5 };
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+                    int frameCount = 0;
+                    int bitmapCount = 0;
+                    int lastFrameNumber = 0;
+                    bool isOutOfOrder = false;
+                    bool isBitmapInvalid = false;
+                    ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    rec.OnFrameRecorded += (s, args) =>
+                    {
+                        if (args.FrameNumber <= lastFrameNumber)
+                        {
+                            isOutOfOrder = true;
+                        }
+                        lastFrameNumber = args.FrameNumber;
+                        frameCount++;
+                        if (args.BitmapData != null)
+                        {
+                            bitmapCount++;
+                            if (args.BitmapData.Height != 150 || args.BitmapData.Data == IntPtr.Zero || args.BitmapData.Length < args.BitmapData.Stride * args.BitmapData.Height)
+                            {
+                                isBitmapInvalid = true;
+                            }
+                        }
+                    };
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        isComplete = true;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.Record(filePath);
+                    Thread.Sleep(3000);
+                    rec.Stop();
+                    finalizeResetEvent.WaitOne(5000);
+
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                    Assert.IsFalse(isOutOfOrder, "Frame numbers were not delivered in order");
+                    Assert.IsFalse(isBitmapInvalid, "Preview bitmap has unexpected dimensions");
+                    Assert.IsTrue(frameCount > 0);
+                    Assert.IsTrue(bitmapCount > 0);
+                    //5 previews per second over 3 seconds, with some margin for timing.
+                    Assert.IsTrue(bitmapCount <= 20, $"{bitmapCount} preview bitmaps exceeds the preview frame rate");
+                    Assert.IsTrue(bitmapCount < frameCount);
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+            }
+        }
+
+        [TestMethod]
+        public void RecordingWithRateLimitedSourcePreviews()
+        {
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            try
+            {
+                var displaySource = new DisplayRecordingSource
+                {
+                    DeviceName = DisplayRecordingSource.MainMonitor.DeviceName,
+                    OutputSize = new ScreenSize(500, 500),
+                    SourceRect = new ScreenRect(100, 100, 500, 500),
+                    IsVideoFramePreviewEnabled = true,
+                    VideoFramePreviewSize = new ScreenSize(0, 100),
+                    VideoFramePreviewFps = 5
+                };
+                var imageSource = new ImageRecordingSource
+                {
+                    SourceStream = File.OpenRead(@"testmedia\earth.gif"),
+                    IsVideoFramePreviewEnabled = true,
+                    VideoFramePreviewSize = new ScreenSize(0, 100),
+                    VideoFramePreviewFps = 5
+                };
+                RecorderOptions options = new RecorderOptions
+                {
+                    SourceOptions = new SourceOptions { RecordingSources = { displaySource, imageSource } }
+                };
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+                    int displayBitmapCount = 0;
+                    int imageBitmapCount = 0;
+                    bool isBitmapInvalid = false;
+                    ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    displaySource.OnFrameRecorded += (s, args) =>
+                    {
+                        Interlocked.Increment(ref displayBitmapCount);
+                        if (args.BitmapData.Height != 100 || args.BitmapData.Data == IntPtr.Zero)
+                        {
+                            isBitmapInvalid = true;
+                        }
+                    };
+                    imageSource.OnFrameRecorded += (s, args) =>
+                    {
+                        Interlocked.Increment(ref imageBitmapCount);
+                        if (args.BitmapData.Height != 100 || args.BitmapData.Data == IntPtr.Zero)
+                        {
+                            isBitmapInvalid = true;
+                        }
+                    };
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        isComplete = true;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.Record(filePath);
+                    Thread.Sleep(3000);
+                    rec.Stop();
+                    finalizeResetEvent.WaitOne(5000);
+
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                    Assert.IsFalse(isBitmapInvalid, "Source preview bitmap has unexpected dimensions");
+                    Assert.IsTrue(displayBitmapCount > 0);
+                    Assert.IsTrue(imageBitmapCount > 0);
+                    //5 previews per second over 3 seconds, with some margin for timing.
+                    Assert.IsTrue(displayBitmapCount <= 20, $"{displayBitmapCount} display preview bitmaps exceeds the preview frame rate");
+                    Assert.IsTrue(imageBitmapCount <= 20, $"{imageBitmapCount} image preview bitmaps exceeds the preview frame rate");
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+            }
+        }
+
+        [TestMethod]
+        public void VideoSourceGaplessLoop()
+        {
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            try
+            {
+                var videoSource = new VideoRecordingSource
+                {
+                    SourcePath = @"testmedia\cat.mp4",//480x480px, 12.5 seconds
+                    LoopMode = VideoLoopMode.Gapless,
+                    IsVideoFramePreviewEnabled = true,
+                    VideoFramePreviewSize = new ScreenSize(0, 100)
+                };
+                RecorderOptions options = new RecorderOptions
+                {
+                    SourceOptions = new SourceOptions { RecordingSources = { videoSource } }
+                };
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+                    var frameTimes = new List<double>();
+                    var stopwatch = new Stopwatch();
+                    ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    videoSource.OnFrameRecorded += (s, args) =>
+                    {
+                        lock (frameTimes)
+                        {
+                            frameTimes.Add(stopwatch.Elapsed.TotalMilliseconds);
+                        }
+                    };
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        isComplete = true;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                    };
+                    stopwatch.Start();
+                    rec.Record(filePath);
+                    //Long enough for the video to loop once.
+                    Thread.Sleep(16000);
+                    rec.Stop();
+                    finalizeResetEvent.WaitOne(5000);
+
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                    double maxGapMillis = 0;
+                    lock (frameTimes)
+                    {
+                        //Skip the first second, while the recording starts up.
+                        var steadyFrameTimes = frameTimes.Where(time => time > 1000).ToList();
+                        Assert.IsTrue(steadyFrameTimes.Count > 0);
+                        Assert.IsTrue(steadyFrameTimes.Last() > 14000, "The video did not play past the end of the first pass");
+                        for (int i = 1; i < steadyFrameTimes.Count; i++)
+                        {
+                            maxGapMillis = Math.Max(maxGapMillis, steadyFrameTimes[i] - steadyFrameTimes[i - 1]);
+                        }
+                    }
+                    Assert.IsTrue(maxGapMillis < 200, $"The video paused for {maxGapMillis:F1} ms");
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+            }
+        }
+
+        [TestMethod]
+        public void RecordingWithFrameExport()
+        {
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            string exportName = $"Local\\SrlTest_{Guid.NewGuid():N}";
+            try
+            {
+                RecorderOptions options = RecorderOptions.DefaultMainMonitor;
+                options.OutputOptions = new OutputOptions { FrameExportName = exportName, FrameExportSlotCount = 4, FrameExportFps = 10 };
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+                    ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        isComplete = true;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                        recordingResetEvent.Set();
+                    };
+                    rec.OnStatusChanged += (s, args) =>
+                    {
+                        if (args.Status == RecorderStatus.Recording)
+                        {
+                            recordingResetEvent.Set();
+                        }
+                    };
+                    rec.Record(filePath);
+                    recordingResetEvent.WaitOne(5000);
+                    Thread.Sleep(1000);
+                    Assert.IsFalse(isError, error);
+                    using (var ring = MemoryMappedFile.OpenExisting(exportName, MemoryMappedFileRights.Read))
+                    using (var view = ring.CreateViewAccessor(0, 0, MemoryMappedFileAccess.Read))
+                    {
+                        //See FrameExportLayout.h for the offsets.
+                        Assert.AreEqual(0x58465253u, view.ReadUInt32(0), "Unexpected magic");
+                        Assert.AreEqual(4u, view.ReadUInt32(12), "Unexpected slot count");
+                        Assert.IsTrue(view.ReadUInt64(32) > 0, "No frames were exported");
+                        uint headerSize = view.ReadUInt32(8);
+                        long slotStride = view.ReadInt64(16);
+                        bool hasFrame = false;
+                        for (int i = 0; i < 4; i++)
+                        {
+                            long slot = headerSize + i * slotStride;
+                            if (view.ReadUInt64(slot + 8) > 0)
+                            {
+                                hasFrame = true;
+                                Assert.IsTrue(view.ReadUInt32(slot + 24) > 0 && view.ReadUInt32(slot + 28) > 0, "Exported frame has no size");
+                            }
+                        }
+                        Assert.IsTrue(hasFrame);
+                    }
+                    rec.Stop();
+                    finalizeResetEvent.WaitOne(5000);
+
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+            }
+        }
+
+        [TestMethod]
+        public void RecordingWithRenditions()
+        {
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            string proxyPath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            string fragmentedPath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            try
+            {
+                RecorderOptions options = RecorderOptions.DefaultMainMonitor;
+                options.VideoEncoderOptions = new VideoEncoderOptions { IsFixedFramerate = true, Framerate = 30 };
+                options.OutputOptions = new OutputOptions
+                {
+                    Renditions = new List<OutputRendition>
+                    {
+                        new OutputRendition(proxyPath) { FrameSize = new ScreenSize(640, 360), FramerateDivisor = 2, Bitrate = 1000 * 1000 },
+                        new OutputRendition(fragmentedPath) { IsFragmentedMp4Enabled = true }
+                    }
+                };
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+                    ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        isComplete = true;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.Record(filePath);
+                    Thread.Sleep(3000);
+                    rec.Stop();
+                    finalizeResetEvent.WaitOne(5000);
+
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                    var mediaInfo = new MediaInfoWrapper(filePath);
+                    Assert.IsTrue(mediaInfo.Format == "MPEG-4");
+                    Assert.IsTrue(mediaInfo.VideoStreams.Count > 0);
+
+                    var proxyInfo = new MediaInfoWrapper(proxyPath);
+                    Assert.IsTrue(proxyInfo.Format == "MPEG-4");
+                    Assert.IsTrue(proxyInfo.VideoStreams.Count > 0);
+                    Assert.IsTrue(proxyInfo.Width == 640 && proxyInfo.Height == 360, $"Expected rendition size 640x360, was {proxyInfo.Width}x{proxyInfo.Height}");
+                    Assert.IsTrue(proxyInfo.Framerate <= 16, $"Expected rendition framerate of 15, was {proxyInfo.Framerate}");
+
+                    var fragmentedInfo = new MediaInfoWrapper(fragmentedPath);
+                    Assert.IsTrue(fragmentedInfo.VideoStreams.Count > 0);
+                    Assert.IsTrue(fragmentedInfo.Width == mediaInfo.Width && fragmentedInfo.Height == mediaInfo.Height, "Expected rendition with the size of the recording");
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+                File.Delete(proxyPath);
+                File.Delete(fragmentedPath);
+            }
+        }
+
         [TestMethod]
         public void RecordingWithManualSnapshots()
         {
@@ -864,24 +1561,213 @@ namespace ScreenRecorderLib
         }
 
         [TestMethod]
-        public void FixedFramerate()
+        public void FixedFramerate()
+        {
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            try
+            {
+                using (var outStream = File.Open(filePath, FileMode.Create, FileAccess.ReadWrite, FileShare.Read))
+                {
+                    RecorderOptions options = new RecorderOptions();
+                    options.VideoEncoderOptions = new VideoEncoderOptions { IsFixedFramerate = true };
+                    options.VideoEncoderOptions.Framerate = 10;
+                    using (var rec = Recorder.CreateRecorder(options))
+                    {
+                        string error = "";
+                        bool isError = false;
+                        bool isComplete = false;
+                        ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                        ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
+                        ManualResetEvent recordingStartedEvent = new ManualResetEvent(false);
+                        rec.OnRecordingComplete += (s, args) =>
+                        {
+                            isComplete = true;
+                            finalizeResetEvent.Set();
+                        };
+                        rec.OnRecordingFailed += (s, args) =>
+                        {
+                            isError = true;
+                            error = args.Error;
+                            finalizeResetEvent.Set();
+                            recordingResetEvent.Set();
+                        };
+                        rec.OnStatusChanged += (s, args) =>
+                        {
+                            switch (args.Status)
+                            {
+                                case RecorderStatus.Recording:
+                                    {
+                                        recordingStartedEvent.Set();
+                                        break;
+                                    }
+                                default: break;
+                            }
+                        };
+                        int durationMillis = 5000;
+                        rec.Record(outStream);
+                        recordingStartedEvent.WaitOne(3000);
+                        recordingResetEvent.WaitOne(durationMillis);
+                        rec.Stop();
+                        finalizeResetEvent.WaitOne(5000);
+                        outStream.Flush();
+                        Assert.IsFalse(isError, error);
+                        Assert.IsTrue(isComplete);
+                        Assert.AreNotEqual(outStream.Length, 0);
+                        var mediaInfo = new MediaInfoWrapper(filePath);
+                        int estimatedFrameCount = (int)Math.Floor(options.VideoEncoderOptions.Framerate * ((double)durationMillis / 1000));
+                        Assert.IsTrue(Math.Abs(rec.CurrentFrameNumber - estimatedFrameCount) <= 2, "Recorder framenumber {0} not equal to estimated frame number {1}", rec.CurrentFrameNumber, estimatedFrameCount);
+                        Assert.IsTrue(Math.Abs(mediaInfo.Framerate - options.VideoEncoderOptions.Framerate) <= 2, "MediaInfo framerate {0} not equal to configured framerate {1}", mediaInfo.Framerate, options.VideoEncoderOptions.Framerate);
+                    }
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+            }
+        }
+
+        [TestMethod]
+        public void CustomFixedBitrate()
+        {
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            try
+            {
+                RecorderOptions options = new RecorderOptions();
+                options.VideoEncoderOptions = new VideoEncoderOptions
+                {
+                    Encoder = new H264VideoEncoder { BitrateMode = H264BitrateControlMode.CBR },
+                    IsHardwareEncodingEnabled = false,
+                    Bitrate = 1000 * 1000
+                };
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+                    ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        isComplete = true;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                        recordingResetEvent.Set();
+                    };
+                    rec.OnFrameRecorded += (s, args) =>
+                    {
+                        if (args.FrameNumber == 10)
+                        {
+                            recordingResetEvent.Set();
+                        }
+                    };
+                    rec.Record(filePath);
+                    recordingResetEvent.WaitOne(DefaultMaxRecordingLengthMillis);
+                    rec.Stop();
+                    finalizeResetEvent.WaitOne(5000);
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                    Assert.IsTrue(new FileInfo(filePath).Length > 0);
+                    var mediaInfo = new MediaInfoWrapper(filePath);
+                    Assert.IsTrue(mediaInfo.VideoStreams.Count > 0);
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+            }
+        }
+
+        [TestMethod]
+        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.PNG)]
+        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.JPEG)]
+        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.TIFF)]
+        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.BMP)]
+        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.FastPNG)]
+        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.FastJPEG)]
+        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.PNG)]
+        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.JPEG)]
+        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.TIFF)]
+        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.BMP)]
+        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.FastPNG)]
+        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.FastJPEG)]
+        public void Screenshot(RecorderApi api, ImageFormat format)
+        {
+            RecorderOptions options = new RecorderOptions();
+            options.OutputOptions = new OutputOptions { RecorderMode = RecorderMode.Screenshot };
+            options.SnapshotOptions = new SnapshotOptions { SnapshotFormat = format };
+            options.SourceOptions = new SourceOptions { RecordingSources = { new DisplayRecordingSource { DeviceName = DisplayRecordingSource.MainMonitor.DeviceName, RecorderApi = api } } };
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), "." + format.ToString().ToLower()));
+            try
+            {
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+                    ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        isComplete = true;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.Record(filePath);
+                    finalizeResetEvent.WaitOne(5000);
+
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                    Assert.IsTrue(new FileInfo(filePath).Length > 0);
+                    var mediaInfo = new MediaInfoWrapper(filePath);
+                    Assert.IsTrue(mediaInfo.Format == MediaInfoFormatForImageFormat(format));
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+            }
+        }
+
+        [TestMethod]
+        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.PNG)]
+        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.JPEG)]
+        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.TIFF)]
+        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.BMP)]
+        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.FastPNG)]
+        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.FastJPEG)]
+        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.PNG)]
+        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.JPEG)]
+        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.TIFF)]
+        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.BMP)]
+        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.FastPNG)]
+        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.FastJPEG)]
+        public void ScreenshotToStream(RecorderApi api, ImageFormat format)
         {
-            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            RecorderOptions options = new RecorderOptions();
+            options.OutputOptions = new OutputOptions { RecorderMode = RecorderMode.Screenshot };
+            options.SnapshotOptions = new SnapshotOptions { SnapshotFormat = format };
+            options.SourceOptions = new SourceOptions { RecordingSources = { new DisplayRecordingSource { DeviceName = DisplayRecordingSource.MainMonitor.DeviceName, RecorderApi = api } } };
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), "." + format.ToString().ToLower()));
             try
             {
-                using (var outStream = File.Open(filePath, FileMode.Create, FileAccess.ReadWrite, FileShare.Read))
+                using (var rec = Recorder.CreateRecorder(options))
                 {
-                    RecorderOptions options = new RecorderOptions();
-                    options.VideoEncoderOptions = new VideoEncoderOptions { IsFixedFramerate = true };
-                    options.VideoEncoderOptions.Framerate = 10;
-                    using (var rec = Recorder.CreateRecorder(options))
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+
+                    using (Stream ms = File.Create(filePath))
                     {
-                        string error = "";
-                        bool isError = false;
-                        bool isComplete = false;
                         ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
-                        ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
-                        ManualResetEvent recordingStartedEvent = new ManualResetEvent(false);
                         rec.OnRecordingComplete += (s, args) =>
                         {
                             isComplete = true;
@@ -892,35 +1778,15 @@ namespace ScreenRecorderLib
                             isError = true;
                             error = args.Error;
                             finalizeResetEvent.Set();
-                            recordingResetEvent.Set();
-                        };
-                        rec.OnStatusChanged += (s, args) =>
-                        {
-                            switch (args.Status)
-                            {
-                                case RecorderStatus.Recording:
-                                    {
-                                        recordingStartedEvent.Set();
-                                        break;
-                                    }
-                                default: break;
-                            }
                         };
-                        int durationMillis = 5000;
-                        rec.Record(outStream);
-                        recordingStartedEvent.WaitOne(3000);
-                        recordingResetEvent.WaitOne(durationMillis);
-                        rec.Stop();
+                        rec.Record(ms);
                         finalizeResetEvent.WaitOne(5000);
-                        outStream.Flush();
-                        Assert.IsFalse(isError, error);
-                        Assert.IsTrue(isComplete);
-                        Assert.AreNotEqual(outStream.Length, 0);
-                        var mediaInfo = new MediaInfoWrapper(filePath);
-                        int estimatedFrameCount = (int)Math.Floor(options.VideoEncoderOptions.Framerate * ((double)durationMillis / 1000));
-                        Assert.IsTrue(Math.Abs(rec.CurrentFrameNumber - estimatedFrameCount) <= 2, "Recorder framenumber {0} not equal to estimated frame number {1}", rec.CurrentFrameNumber, estimatedFrameCount);
-                        Assert.IsTrue(Math.Abs(mediaInfo.Framerate - options.VideoEncoderOptions.Framerate) <= 2, "MediaInfo framerate {0} not equal to configured framerate {1}", mediaInfo.Framerate, options.VideoEncoderOptions.Framerate);
                     }
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                    Assert.IsTrue(new FileInfo(filePath).Length > 0);
+                    var mediaInfo = new MediaInfoWrapper(filePath);
+                    Assert.IsTrue(mediaInfo.Format == MediaInfoFormatForImageFormat(format));
                 }
             }
             finally
@@ -930,25 +1796,24 @@ namespace ScreenRecorderLib
         }
 
         [TestMethod]
-        public void CustomFixedBitrate()
+        public void ScreenshotQoi()
         {
-            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            RecorderOptions options = new RecorderOptions();
+            options.OutputOptions = new OutputOptions
+            {
+                RecorderMode = RecorderMode.Screenshot,
+                SourceRect = new ScreenRect(100, 100, 200, 200)
+            };
+            options.SnapshotOptions = new SnapshotOptions { SnapshotFormat = ImageFormat.QOI };
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".qoi"));
             try
             {
-                RecorderOptions options = new RecorderOptions();
-                options.VideoEncoderOptions = new VideoEncoderOptions
-                {
-                    Encoder = new H264VideoEncoder { BitrateMode = H264BitrateControlMode.CBR },
-                    IsHardwareEncodingEnabled = false,
-                    Bitrate = 1000 * 1000
-                };
                 using (var rec = Recorder.CreateRecorder(options))
                 {
                     string error = "";
                     bool isError = false;
                     bool isComplete = false;
                     ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
-                    ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
                     rec.OnRecordingComplete += (s, args) =>
                     {
                         isComplete = true;
@@ -959,24 +1824,22 @@ namespace ScreenRecorderLib
                         isError = true;
                         error = args.Error;
                         finalizeResetEvent.Set();
-                        recordingResetEvent.Set();
-                    };
-                    rec.OnFrameRecorded += (s, args) =>
-                    {
-                        if (args.FrameNumber == 10)
-                        {
-                            recordingResetEvent.Set();
-                        }
                     };
                     rec.Record(filePath);
-                    recordingResetEvent.WaitOne(DefaultMaxRecordingLengthMillis);
-                    rec.Stop();
                     finalizeResetEvent.WaitOne(5000);
+
                     Assert.IsFalse(isError, error);
                     Assert.IsTrue(isComplete);
-                    Assert.IsTrue(new FileInfo(filePath).Length > 0);
-                    var mediaInfo = new MediaInfoWrapper(filePath);
-                    Assert.IsTrue(mediaInfo.VideoStreams.Count > 0);
+                    byte[] bytes = File.ReadAllBytes(filePath);
+                    //14 byte header, followed by the chunks and an 8 byte end marker.
+                    Assert.IsTrue(bytes.Length > 22);
+                    Assert.AreEqual("qoif", System.Text.Encoding.ASCII.GetString(bytes, 0, 4));
+                    int width = (bytes[4] << 24) | (bytes[5] << 16) | (bytes[6] << 8) | bytes[7];
+                    int height = (bytes[8] << 24) | (bytes[9] << 16) | (bytes[10] << 8) | bytes[11];
+                    Assert.AreEqual(200, width);
+                    Assert.AreEqual(200, height);
+                    Assert.AreEqual(3, bytes[12]);
+                    CollectionAssert.AreEqual(new byte[] { 0, 0, 0, 0, 0, 0, 0, 1 }, bytes.Skip(bytes.Length - 8).ToArray());
                 }
             }
             finally
@@ -987,20 +1850,117 @@ namespace ScreenRecorderLib
 
         [TestMethod]
         [DataRow(RecorderApi.DesktopDuplication, ImageFormat.PNG)]
-        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.JPEG)]
-        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.TIFF)]
-        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.BMP)]
+        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.FastPNG)]
         [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.PNG)]
-        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.JPEG)]
-        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.TIFF)]
-        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.BMP)]
-        public void Screenshot(RecorderApi api, ImageFormat format)
+        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.FastPNG)]
+        public void TakeScreenshot(RecorderApi api, ImageFormat format)
         {
             RecorderOptions options = new RecorderOptions();
-            options.OutputOptions = new OutputOptions { RecorderMode = RecorderMode.Screenshot };
             options.SnapshotOptions = new SnapshotOptions { SnapshotFormat = format };
             options.SourceOptions = new SourceOptions { RecordingSources = { new DisplayRecordingSource { DeviceName = DisplayRecordingSource.MainMonitor.DeviceName, RecorderApi = api } } };
             string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), "." + format.ToString().ToLower()));
+            string streamFilePath = Path.ChangeExtension(filePath, ".stream." + format.ToString().ToLower());
+            try
+            {
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    Assert.IsTrue(rec.TakeScreenshot(filePath));
+                    using (Stream stream = File.Create(streamFilePath))
+                    {
+                        Assert.IsTrue(rec.TakeScreenshot(stream));
+                    }
+                    Assert.AreEqual(RecorderStatus.Idle, rec.Status);
+                }
+                foreach (string path in new[] { filePath, streamFilePath })
+                {
+                    Assert.IsTrue(new FileInfo(path).Length > 0);
+                    var mediaInfo = new MediaInfoWrapper(path);
+                    Assert.IsTrue(mediaInfo.Format == MediaInfoFormatForImageFormat(format));
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+                File.Delete(streamFilePath);
+            }
+        }
+
+        [TestMethod]
+        public void TakeScreenshotLatency()
+        {
+            const int iterations = 20;
+            RecorderOptions options = new RecorderOptions();
+            options.OutputOptions = new OutputOptions { RecorderMode = RecorderMode.Screenshot };
+            options.SnapshotOptions = new SnapshotOptions { SnapshotFormat = ImageFormat.FastPNG };
+            var filePaths = new List<string>();
+            string NewFilePath()
+            {
+                string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".png"));
+                filePaths.Add(filePath);
+                return filePath;
+            }
+            try
+            {
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    string error = "";
+                    bool isError = false;
+                    AutoResetEvent finalizeResetEvent = new AutoResetEvent(false);
+                    rec.OnRecordingComplete += (s, args) => finalizeResetEvent.Set();
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                    };
+                    double MeasureMillis(Action takeScreenshot)
+                    {
+                        //The first screenshot of each path includes one-time setup, so it is not measured.
+                        takeScreenshot();
+                        Stopwatch sw = Stopwatch.StartNew();
+                        for (int i = 0; i < iterations; i++)
+                        {
+                            takeScreenshot();
+                        }
+                        return sw.Elapsed.TotalMilliseconds / iterations;
+                    }
+                    double recordingModeMillis = MeasureMillis(() =>
+                    {
+                        rec.Record(NewFilePath());
+                        Assert.IsTrue(finalizeResetEvent.WaitOne(5000));
+                        Assert.IsFalse(isError, error);
+                    });
+                    double coldMillis = MeasureMillis(() => Assert.IsTrue(rec.TakeScreenshot(NewFilePath())));
+                    Assert.IsTrue(rec.Warm());
+                    double warmMillis = MeasureMillis(() => Assert.IsTrue(rec.TakeScreenshot(NewFilePath())));
+                    rec.Cool();
+                    Assert.IsTrue(warmMillis < recordingModeMillis, $"TakeScreenshot warm took {warmMillis:F2} ms, recorder mode took {recordingModeMillis:F2} ms");
+                    Assert.IsTrue(warmMillis <= coldMillis, $"TakeScreenshot warm took {warmMillis:F2} ms, cold took {coldMillis:F2} ms");
+                }
+                foreach (string path in filePaths)
+                {
+                    Assert.IsTrue(new FileInfo(path).Length > 0);
+                }
+            }
+            finally
+            {
+                foreach (string path in filePaths)
+                {
+                    File.Delete(path);
+                }
+            }
+        }
+
+        [TestMethod]
+        public void ScreenshotWithCropping()
+        {
+            RecorderOptions options = new RecorderOptions();
+            options.OutputOptions = new OutputOptions
+            {
+                RecorderMode = RecorderMode.Screenshot,
+                SourceRect = new ScreenRect(100, 100, 200, 200)
+            };
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".png"));
             try
             {
                 using (var rec = Recorder.CreateRecorder(options))
@@ -1009,25 +1969,33 @@ namespace ScreenRecorderLib
                     bool isError = false;
                     bool isComplete = false;
                     ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
                     rec.OnRecordingComplete += (s, args) =>
                     {
                         isComplete = true;
                         finalizeResetEvent.Set();
+                        recordingResetEvent.Set();
                     };
                     rec.OnRecordingFailed += (s, args) =>
                     {
                         isError = true;
                         error = args.Error;
                         finalizeResetEvent.Set();
+                        recordingResetEvent.Set();
                     };
                     rec.Record(filePath);
+                    recordingResetEvent.WaitOne(DefaultMaxRecordingLengthMillis);
+                    rec.Stop();
                     finalizeResetEvent.WaitOne(5000);
 
                     Assert.IsFalse(isError, error);
                     Assert.IsTrue(isComplete);
                     Assert.IsTrue(new FileInfo(filePath).Length > 0);
-                    var mediaInfo = new MediaInfoWrapper(filePath);
-                    Assert.IsTrue(mediaInfo.Format == MediaInfoFormatForImageFormat(format));
+                    using (var bitmap = System.Drawing.Bitmap.FromFile(filePath))
+                    {
+                        Assert.IsTrue(bitmap.Width == options.OutputOptions.SourceRect.Width
+                            && bitmap.Height == options.OutputOptions.SourceRect.Height);
+                    }
                 }
             }
             finally
@@ -1037,71 +2005,151 @@ namespace ScreenRecorderLib
         }
 
         [TestMethod]
-        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.PNG)]
-        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.JPEG)]
-        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.TIFF)]
-        [DataRow(RecorderApi.DesktopDuplication, ImageFormat.BMP)]
-        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.PNG)]
-        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.JPEG)]
-        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.TIFF)]
-        [DataRow(RecorderApi.WindowsGraphicsCapture, ImageFormat.BMP)]
-        public void ScreenshotToStream(RecorderApi api, ImageFormat format)
+        public void Slideshow()
+        {
+            string directoryPath = Path.Combine(GetTempPath(), Path.GetFileNameWithoutExtension(Path.GetRandomFileName()));
+            try
+            {
+                int recordingLengthMillis = 5000;
+
+                RecorderOptions options = new RecorderOptions();
+                options.OutputOptions = new OutputOptions { RecorderMode = RecorderMode.Slideshow };
+                options.SnapshotOptions = new SnapshotOptions { SnapshotsIntervalMillis = 200 };
+                Directory.CreateDirectory(directoryPath);
+                Assert.IsTrue(Directory.Exists(directoryPath));
+                Stopwatch sw = new Stopwatch();
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+                    ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
+                    ManualResetEvent recordingStartedEvent = new ManualResetEvent(false);
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        isComplete = true;
+                        finalizeResetEvent.Set();
+                        sw.Stop();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                        recordingResetEvent.Set();
+                        sw.Stop();
+                    };
+                    rec.OnStatusChanged += (s, args) =>
+                    {
+                        switch (args.Status)
+                        {
+                            case RecorderStatus.Recording:
+                                {
+                                    recordingStartedEvent.Set();
+                                    break;
+                                }
+                            default: break;
+                        }
+                    };
+                    rec.Record(directoryPath);
+                    recordingStartedEvent.WaitOne(1000);
+                    sw.Start();
+                    recordingResetEvent.WaitOne(recordingLengthMillis);
+                    rec.Stop();
+                    finalizeResetEvent.WaitOne(5000);
+                    long actualRecordingLength = sw.ElapsedMilliseconds;
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                    var files = Directory.GetFiles(directoryPath);
+                    //First image is written immediately, then there should be one per interval.
+                    int expectedSlideshowCount = 1 + (int)Math.Floor((double)actualRecordingLength / options.SnapshotOptions.SnapshotsIntervalMillis);
+                    Assert.IsTrue(Math.Abs(files.Length - expectedSlideshowCount) <= 1, $"Slideshow count of {files.Length} differs from expected {expectedSlideshowCount}");
+                    foreach (string filePath in files)
+                    {
+                        FileInfo fi = new FileInfo(filePath);
+                        var mediaInfo = new MediaInfoWrapper(filePath);
+                        Assert.IsTrue(mediaInfo.Format == "PNG");
+                    }
+                }
+            }
+            finally
+            {
+                Directory.Delete(directoryPath, true);
+            }
+        }
+
+        [TestMethod]
+        public void SlideshowManifest()
         {
-            RecorderOptions options = new RecorderOptions();
-            options.OutputOptions = new OutputOptions { RecorderMode = RecorderMode.Screenshot };
-            options.SnapshotOptions = new SnapshotOptions { SnapshotFormat = format };
-            options.SourceOptions = new SourceOptions { RecordingSources = { new DisplayRecordingSource { DeviceName = DisplayRecordingSource.MainMonitor.DeviceName, RecorderApi = api } } };
-            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), "." + format.ToString().ToLower()));
+            string directoryPath = Path.Combine(GetTempPath(), Path.GetFileNameWithoutExtension(Path.GetRandomFileName()));
             try
             {
+                RecorderOptions options = new RecorderOptions();
+                options.OutputOptions = new OutputOptions { RecorderMode = RecorderMode.Slideshow, IsSlideshowManifestEnabled = true };
+                options.SnapshotOptions = new SnapshotOptions { SnapshotsIntervalMillis = 100 };
+                Directory.CreateDirectory(directoryPath);
                 using (var rec = Recorder.CreateRecorder(options))
                 {
                     string error = "";
                     bool isError = false;
                     bool isComplete = false;
-
-                    using (Stream ms = File.Create(filePath))
+                    List<FrameData> frameInfos = null;
+                    ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
+                    rec.OnRecordingComplete += (s, args) =>
                     {
-                        ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
-                        rec.OnRecordingComplete += (s, args) =>
-                        {
-                            isComplete = true;
-                            finalizeResetEvent.Set();
-                        };
-                        rec.OnRecordingFailed += (s, args) =>
-                        {
-                            isError = true;
-                            error = args.Error;
-                            finalizeResetEvent.Set();
-                        };
-                        rec.Record(ms);
-                        finalizeResetEvent.WaitOne(5000);
-                    }
+                        isComplete = true;
+                        frameInfos = args.FrameInfos;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                        recordingResetEvent.Set();
+                    };
+                    rec.Record(directoryPath);
+                    recordingResetEvent.WaitOne(2000);
+                    rec.Stop();
+                    finalizeResetEvent.WaitOne(5000);
                     Assert.IsFalse(isError, error);
                     Assert.IsTrue(isComplete);
-                    Assert.IsTrue(new FileInfo(filePath).Length > 0);
-                    var mediaInfo = new MediaInfoWrapper(filePath);
-                    Assert.IsTrue(mediaInfo.Format == MediaInfoFormatForImageFormat(format));
+
+                    string manifestPath = Path.Combine(directoryPath, "frames.tsv");
+                    Assert.IsTrue(File.Exists(manifestPath));
+                    string[] lines = File.ReadAllLines(manifestPath);
+                    Assert.IsTrue(frameInfos.Count > 1);
+                    Assert.AreEqual(frameInfos.Count, lines.Length);
+                    for (int i = 0; i < lines.Length; i++)
+                    {
+                        string[] fields = lines[i].Split('\t');
+                        Assert.AreEqual(2, fields.Length);
+                        Assert.AreEqual(frameInfos[i].Delay, int.Parse(fields[0]));
+                        Assert.AreEqual(Path.GetFileName(frameInfos[i].Path), fields[1]);
+                        Assert.IsTrue(File.Exists(Path.Combine(directoryPath, fields[1])));
+                    }
+                    Assert.AreEqual(0, frameInfos[0].Delay);
                 }
             }
             finally
             {
-                File.Delete(filePath);
+                Directory.Delete(directoryPath, true);
             }
         }
 
-        [TestMethod]
-        public void ScreenshotWithCropping()
+        [DataTestMethod]
+        [DataRow(AnimationFormat.GIF, ".gif", "GIF")]
+        [DataRow(AnimationFormat.APNG, ".png", "PNG")]
+        public void RecordingAnimation(AnimationFormat animationFormat, string extension, string expectedFormat)
         {
-            RecorderOptions options = new RecorderOptions();
-            options.OutputOptions = new OutputOptions
-            {
-                RecorderMode = RecorderMode.Screenshot,
-                SourceRect = new ScreenRect(100, 100, 200, 200)
-            };
-            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".png"));
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), extension));
             try
             {
+                RecorderOptions options = new RecorderOptions();
+                options.OutputOptions = new OutputOptions { RecorderMode = RecorderMode.Animation, AnimationFormat = animationFormat };
+                options.VideoEncoderOptions = new VideoEncoderOptions { Framerate = 10 };
                 using (var rec = Recorder.CreateRecorder(options))
                 {
                     string error = "";
@@ -1113,7 +2161,6 @@ namespace ScreenRecorderLib
                     {
                         isComplete = true;
                         finalizeResetEvent.Set();
-                        recordingResetEvent.Set();
                     };
                     rec.OnRecordingFailed += (s, args) =>
                     {
@@ -1123,18 +2170,27 @@ namespace ScreenRecorderLib
                         recordingResetEvent.Set();
                     };
                     rec.Record(filePath);
-                    recordingResetEvent.WaitOne(DefaultMaxRecordingLengthMillis);
+                    recordingResetEvent.WaitOne(2000);
                     rec.Stop();
                     finalizeResetEvent.WaitOne(5000);
-
                     Assert.IsFalse(isError, error);
                     Assert.IsTrue(isComplete);
-                    Assert.IsTrue(new FileInfo(filePath).Length > 0);
-                    using (var bitmap = System.Drawing.Bitmap.FromFile(filePath))
+                    Assert.IsTrue(File.Exists(filePath));
+                    byte[] header = new byte[8];
+                    using (var stream = File.OpenRead(filePath))
                     {
-                        Assert.IsTrue(bitmap.Width == options.OutputOptions.SourceRect.Width
-                            && bitmap.Height == options.OutputOptions.SourceRect.Height);
+                        Assert.AreEqual(header.Length, stream.Read(header, 0, header.Length));
+                    }
+                    if (animationFormat == AnimationFormat.GIF)
+                    {
+                        Assert.AreEqual("GIF89a", System.Text.Encoding.ASCII.GetString(header, 0, 6));
+                    }
+                    else
+                    {
+                        CollectionAssert.AreEqual(new byte[] { 0x89, (byte)'P', (byte)'N', (byte)'G', 0x0D, 0x0A, 0x1A, 0x0A }, header);
                     }
+                    var mediaInfo = new MediaInfoWrapper(filePath);
+                    Assert.AreEqual(expectedFormat, mediaInfo.Format);
                 }
             }
             finally
@@ -1143,8 +2199,11 @@ namespace ScreenRecorderLib
             }
         }
 
-        [TestMethod]
-        public void Slideshow()
+        [DataTestMethod]
+        [DataRow(4)]
+        [DataRow(8)]
+        [DataRow(16)]
+        public void SlideshowThroughput(int encoderThreadCount)
         {
             string directoryPath = Path.Combine(GetTempPath(), Path.GetFileNameWithoutExtension(Path.GetRandomFileName()));
             try
@@ -1152,64 +2211,57 @@ namespace ScreenRecorderLib
                 int recordingLengthMillis = 5000;
 
                 RecorderOptions options = new RecorderOptions();
-                options.OutputOptions = new OutputOptions { RecorderMode = RecorderMode.Slideshow };
-                options.SnapshotOptions = new SnapshotOptions { SnapshotsIntervalMillis = 200 };
+                options.OutputOptions = new OutputOptions { RecorderMode = RecorderMode.Slideshow, SlideshowEncoderThreadCount = encoderThreadCount };
+                options.SnapshotOptions = new SnapshotOptions { SnapshotsIntervalMillis = 16, SnapshotFormat = ImageFormat.PNG };
                 Directory.CreateDirectory(directoryPath);
-                Assert.IsTrue(Directory.Exists(directoryPath));
                 Stopwatch sw = new Stopwatch();
                 using (var rec = Recorder.CreateRecorder(options))
                 {
                     string error = "";
                     bool isError = false;
                     bool isComplete = false;
+                    int frameCount = 0;
                     ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
-                    ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
                     ManualResetEvent recordingStartedEvent = new ManualResetEvent(false);
                     rec.OnRecordingComplete += (s, args) =>
                     {
                         isComplete = true;
                         finalizeResetEvent.Set();
-                        sw.Stop();
                     };
                     rec.OnRecordingFailed += (s, args) =>
                     {
                         isError = true;
                         error = args.Error;
                         finalizeResetEvent.Set();
-                        recordingResetEvent.Set();
-                        sw.Stop();
+                        recordingStartedEvent.Set();
+                    };
+                    rec.OnFrameRecorded += (s, args) =>
+                    {
+                        frameCount = args.FrameNumber;
                     };
                     rec.OnStatusChanged += (s, args) =>
                     {
-                        switch (args.Status)
+                        if (args.Status == RecorderStatus.Recording)
                         {
-                            case RecorderStatus.Recording:
-                                {
-                                    recordingStartedEvent.Set();
-                                    break;
-                                }
-                            default: break;
+                            recordingStartedEvent.Set();
                         }
                     };
                     rec.Record(directoryPath);
                     recordingStartedEvent.WaitOne(1000);
                     sw.Start();
-                    recordingResetEvent.WaitOne(recordingLengthMillis);
+                    Thread.Sleep(recordingLengthMillis);
                     rec.Stop();
-                    finalizeResetEvent.WaitOne(5000);
-                    long actualRecordingLength = sw.ElapsedMilliseconds;
+                    finalizeResetEvent.WaitOne(10000);
+                    sw.Stop();
                     Assert.IsFalse(isError, error);
                     Assert.IsTrue(isComplete);
                     var files = Directory.GetFiles(directoryPath);
-                    //First image is written immediately, then there should be one per interval.
-                    int expectedSlideshowCount = 1 + (int)Math.Floor((double)actualRecordingLength / options.SnapshotOptions.SnapshotsIntervalMillis);
-                    Assert.IsTrue(Math.Abs(files.Length - expectedSlideshowCount) <= 1, $"Slideshow count of {files.Length} differs from expected {expectedSlideshowCount}");
-                    foreach (string filePath in files)
-                    {
-                        FileInfo fi = new FileInfo(filePath);
-                        var mediaInfo = new MediaInfoWrapper(filePath);
-                        Assert.IsTrue(mediaInfo.Format == "PNG");
-                    }
+                    //The encoders must keep up with at least a quarter of the requested rate, including the time to finish the queued frames.
+                    double framesPerSecond = files.Length / sw.Elapsed.TotalSeconds;
+                    double minFramesPerSecond = 1000.0 / options.SnapshotOptions.SnapshotsIntervalMillis / 4;
+                    Assert.IsTrue(framesPerSecond >= minFramesPerSecond, $"Wrote {files.Length} slideshow frames with {encoderThreadCount} encoder threads, {framesPerSecond:F1} frames/s");
+                    //Frames are never dropped, so every recorded frame must have its image.
+                    Assert.IsTrue(Math.Abs(files.Length - frameCount) <= 1, $"Slideshow count of {files.Length} differs from recorded frame count {frameCount}");
                 }
             }
             finally
@@ -1218,7 +2270,6 @@ namespace ScreenRecorderLib
             }
         }
 
-
         [TestMethod]
         [DynamicData(nameof(GetVideoEncoders), DynamicDataSourceType.Method)]
         public void Encoders(IVideoEncoder encoder)
@@ -1271,6 +2322,58 @@ namespace ScreenRecorderLib
             }
         }
 
+        [TestMethod]
+        public void MousePointerMetadata()
+        {
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            string cursorTrackPath = filePath + ".cursor";
+            try
+            {
+                var options = new RecorderOptions
+                {
+                    MouseOptions = new MouseOptions { IsMousePointerEnabled = false, IsMousePointerMetadataEnabled = true }
+                };
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+                    ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        isComplete = true;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                        recordingResetEvent.Set();
+                    };
+                    rec.Record(filePath);
+                    recordingResetEvent.WaitOne(2000);
+                    rec.Stop();
+                    finalizeResetEvent.WaitOne(5000);
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                    Assert.IsTrue(File.Exists(cursorTrackPath));
+                    byte[] cursorTrack = File.ReadAllBytes(cursorTrackPath);
+                    //The header, followed by at least the viewport record.
+                    Assert.IsTrue(cursorTrack.Length >= 12 + 5 + 48);
+                    Assert.AreEqual("SRCURSOR", System.Text.Encoding.ASCII.GetString(cursorTrack, 0, 8));
+                    Assert.AreEqual(1, BitConverter.ToInt32(cursorTrack, 8));
+                    Assert.AreEqual(1, cursorTrack[12], "the first record is not a viewport");
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+                File.Delete(cursorTrackPath);
+            }
+        }
+
         [TestMethod]
         public void DefaultRecordingToFolder()
         {
@@ -1393,6 +2496,66 @@ namespace ScreenRecorderLib
             }
         }
 
+        [TestMethod]
+        public void RecordingToFileWithFrequentSnapshots()
+        {
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            string snapshotsDir = Path.ChangeExtension(filePath, null);
+            try
+            {
+                RecorderOptions options = new RecorderOptions();
+                //Snapshots are due faster than they can be written, so some are skipped, but the recording must not fail or stall.
+                options.SnapshotOptions = new SnapshotOptions { SnapshotsWithVideo = true, SnapshotsIntervalMillis = 10, SnapshotFormat = ImageFormat.PNG };
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    List<string> snapshotCallbackList = new List<string>();
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+                    int frameCount = 0;
+                    ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        isComplete = true;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                        recordingResetEvent.Set();
+                    };
+                    rec.OnFrameRecorded += (s, args) =>
+                    {
+                        frameCount = args.FrameNumber;
+                    };
+                    rec.OnSnapshotSaved += (s, args) =>
+                    {
+                        snapshotCallbackList.Add(args.SnapshotPath);
+                    };
+                    rec.Record(filePath);
+                    recordingResetEvent.WaitOne(3000);
+                    rec.Stop();
+                    finalizeResetEvent.WaitOne(5000);
+
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                    Assert.IsTrue(new FileInfo(filePath).Length > 0);
+                    var snapshotsOnDisk = Directory.GetFiles(snapshotsDir);
+                    Assert.IsTrue(snapshotsOnDisk.Length > 0);
+                    Assert.IsTrue(snapshotsOnDisk.Length <= frameCount);
+                    CollectionAssert.AreEquivalent(snapshotsOnDisk, snapshotCallbackList);
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+                Directory.Delete(snapshotsDir, recursive: true);
+            }
+        }
+
         [TestMethod]
         public void DefaultRecording30SecondsToFile()
         {
@@ -1456,6 +2619,69 @@ namespace ScreenRecorderLib
             }
         }
 
+        [TestMethod]
+        [DataRow(RecorderApi.DesktopDuplication)]
+        [DataRow(RecorderApi.WindowsGraphicsCapture)]
+        public void FixedFramerateRecordingTimedByPresentation(RecorderApi api)
+        {
+            RecorderOptions options = new RecorderOptions();
+            options.VideoEncoderOptions = new VideoEncoderOptions { IsFixedFramerate = true, Framerate = 60 };
+            options.SourceOptions = new SourceOptions { RecordingSources = { new DisplayRecordingSource { DeviceName = DisplayRecordingSource.MainMonitor.DeviceName, RecorderApi = api } } };
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            try
+            {
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+                    int frameCount = 0;
+                    ManualResetEvent finalizingResetEvent = new ManualResetEvent(false);
+                    ManualResetEvent recordingStartedEvent = new ManualResetEvent(false);
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        isComplete = true;
+                        finalizingResetEvent.Set();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizingResetEvent.Set();
+                    };
+                    rec.OnStatusChanged += (s, args) =>
+                    {
+                        if (args.Status == RecorderStatus.Recording)
+                        {
+                            recordingStartedEvent.Set();
+                        }
+                    };
+                    rec.OnFrameRecorded += (s, args) =>
+                    {
+                        frameCount = args.FrameNumber;
+                    };
+                    int recordingTimeMillis = 5000;
+                    rec.Record(filePath);
+                    recordingStartedEvent.WaitOne(1000);
+                    Thread.Sleep(recordingTimeMillis);
+                    rec.Stop();
+                    finalizingResetEvent.WaitOne(5000);
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                    //Each frame is written when the next one is acquired, and the last one when the recording stops, so no time is lost at the end.
+                    var mediaInfo = new MediaInfoWrapper(filePath);
+                    Assert.IsTrue(mediaInfo.VideoStreams.Count > 0);
+                    double videoDurationMillis = mediaInfo.VideoStreams[0].Duration.TotalMilliseconds;
+                    Assert.IsTrue(Math.Abs(videoDurationMillis - recordingTimeMillis) < 500, $"video length {videoDurationMillis} ms does not match recording time {recordingTimeMillis} ms");
+                    Assert.IsTrue(frameCount >= recordingTimeMillis / 1000 * 60 * 0.8, $"only {frameCount} frames were recorded at 60 fps");
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+            }
+        }
+
         [TestMethod]
         [DataRow(RecorderApi.WindowsGraphicsCapture, RecorderApi.WindowsGraphicsCapture)]
         [DataRow(RecorderApi.DesktopDuplication, RecorderApi.WindowsGraphicsCapture)]